@@ -126,11 +126,44 @@ const platform_gpio_t platform_gpio_pins[] =
 //  [MICO_GPIO_38]                      = { GPIOA,  4 },
 };
 
+/* LED duty cycle streams, no IRQ. TIM4_UP and TIM1_UP share their streams
+ * with MICO_UART_1 TX and MICO_SPI_1 TX, so TIM4 and TIM1 raise the request
+ * of an unused compare channel at the update event instead */
+static const platform_dma_config_t pwm_r_dma =
+{
+  .controller                 = DMA1,
+  .stream                     = DMA1_Stream0,
+  .channel                    = DMA_Channel_2,
+  .irq_vector                 = DMA1_Stream0_IRQn,
+  .complete_flags             = DMA_LISR_TCIF0,
+  .error_flags                = ( DMA_LISR_TEIF0 | DMA_LISR_DMEIF0 ),
+};
+
+static const platform_dma_config_t pwm_g_dma =
+{
+  .controller                 = DMA1,
+  .stream                     = DMA1_Stream1,
+  .channel                    = DMA_Channel_3,
+  .irq_vector                 = DMA1_Stream1_IRQn,
+  .complete_flags             = DMA_LISR_TCIF1,
+  .error_flags                = ( DMA_LISR_TEIF1 | DMA_LISR_DMEIF1 ),
+};
+
+static const platform_dma_config_t pwm_b_dma =
+{
+  .controller                 = DMA2,
+  .stream                     = DMA2_Stream1,
+  .channel                    = DMA_Channel_6,
+  .irq_vector                 = DMA2_Stream1_IRQn,
+  .complete_flags             = DMA_LISR_TCIF1,
+  .error_flags                = ( DMA_LISR_TEIF1 | DMA_LISR_DMEIF1 ),
+};
+
 const platform_pwm_t platform_pwm_peripherals[] = 
 {
-  [MICO_PWM_R]  = {TIM4, 3, RCC_APB1Periph_TIM4, GPIO_AF_TIM4, &platform_gpio_pins[LED_PIN_R]}, 
-  [MICO_PWM_G]  = {TIM2, 1, RCC_APB1Periph_TIM2, GPIO_AF_TIM2, &platform_gpio_pins[LED_PIN_G]},
-  [MICO_PWM_B]  = {TIM1, 4, RCC_APB2Periph_TIM1, GPIO_AF_TIM1, &platform_gpio_pins[LED_PIN_B]},    
+  [MICO_PWM_R]  = {TIM4, 3, RCC_APB1Periph_TIM4, GPIO_AF_TIM4, &platform_gpio_pins[LED_PIN_R], &pwm_r_dma, TIM_DMA_CC1}, 
+  [MICO_PWM_G]  = {TIM2, 1, RCC_APB1Periph_TIM2, GPIO_AF_TIM2, &platform_gpio_pins[LED_PIN_G], &pwm_g_dma, TIM_DMA_Update},
+  [MICO_PWM_B]  = {TIM1, 4, RCC_APB2Periph_TIM1, GPIO_AF_TIM1, &platform_gpio_pins[LED_PIN_B], &pwm_b_dma, TIM_DMA_CC1},    
 };
 
 const platform_i2c_t platform_i2c_peripherals[] =
@@ -371,11 +404,22 @@ const mico_spi_device_t mico_spi_flash =
 };
 #endif
 
+/* ADC1 streams are moved by DMA2 Stream4 and polled for completion, no IRQ */
+static const platform_dma_config_t adc1_dma =
+{
+  .controller                 = DMA2,
+  .stream                     = DMA2_Stream4,
+  .channel                    = DMA_Channel_0,
+  .irq_vector                 = DMA2_Stream4_IRQn,
+  .complete_flags             = DMA_HISR_TCIF4,
+  .error_flags                = ( DMA_HISR_TEIF4 | DMA_HISR_DMEIF4 ),
+};
+
 const platform_adc_t platform_adc_peripherals[] =
 {
-  [MICO_ADC_1] = { ADC1, ADC_Channel_4, RCC_APB2Periph_ADC1, 1, (platform_gpio_t*)&platform_gpio_pins[ADC_PIN] },
+  [MICO_ADC_1] = { ADC1, ADC_Channel_4, RCC_APB2Periph_ADC1, 1, (platform_gpio_t*)&platform_gpio_pins[ADC_PIN], &adc1_dma },
 #if 0
-  [MICO_ADC_2] = { ADC1, ADC_Channel_5, RCC_APB2Periph_ADC1, 1, (platform_gpio_t*)&platform_gpio_pins[MICO_GPIO_34] },
+  [MICO_ADC_2] = { ADC1, ADC_Channel_5, RCC_APB2Periph_ADC1, 1, (platform_gpio_t*)&platform_gpio_pins[MICO_GPIO_34], &adc1_dma },
 #endif
 };
 
@@ -435,6 +479,13 @@ MICO_RTOS_DEFINE_ISR( DMA2_Stream2_IRQHandler )
   platform_uart_rx_dma_irq( &platform_uart_drivers[MICO_UART_2] );
 }
 
+#if defined ( USE_MICO_SPI_FLASH ) && defined ( USE_MICO_SPI_DMA_IRQ )
+MICO_RTOS_DEFINE_ISR( DMA2_Stream0_IRQHandler )
+{
+  platform_spi_rx_dma_irq( &platform_spi_drivers[MICO_SPI_1] );
+}
+#endif
+
 
 /******************************************************
 *               Function Definitions
@@ -453,6 +504,7 @@ void platform_init_peripheral_irq_priorities( void )
   NVIC_SetPriority( DMA1_Stream5_IRQn,  7 ); /* MICO_UART_1 RX DMA  */
   NVIC_SetPriority( DMA2_Stream7_IRQn,  7 ); /* MICO_UART_2 TX DMA  */
   NVIC_SetPriority( DMA2_Stream2_IRQn,  7 ); /* MICO_UART_2 RX DMA  */
+  NVIC_SetPriority( DMA2_Stream0_IRQn,  8 ); /* MICO_SPI_1 RX DMA   */
   NVIC_SetPriority( EXTI0_IRQn       , 14 ); /* GPIO                */
   NVIC_SetPriority( EXTI1_IRQn       , 14 ); /* GPIO                */
   NVIC_SetPriority( EXTI2_IRQn       , 14 ); /* GPIO                */
@@ -326,6 +326,7 @@ typedef enum
 
 /* Components connected to external I/Os*/
 #define USE_MICO_SPI_FLASH
+#define USE_MICO_SPI_DMA_IRQ
 #define SFLASH_SUPPORT_MACRONIX_PARTS 
 //#define SFLASH_SUPPORT_SST_PARTS
 //#define SFLASH_SUPPORT_WINBOND_PARTS
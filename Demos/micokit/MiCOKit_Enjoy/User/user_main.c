@@ -118,6 +118,7 @@ void system_state_display( app_context_t * const app_context, user_context_t *us
     user_context->status.oled_keep_s--;  // keep display current info
   }
   else{
+    OLED_BeginUpdate();  // rows below go out together, and only where they changed
     if(!app_context->appStatus.isWifiConnected){
       OLED_ShowString(OLED_DISPLAY_COLUMN_START, OLED_DISPLAY_ROW_2, (uint8_t*)"Wi-Fi           ");
       OLED_ShowString(OLED_DISPLAY_COLUMN_START, OLED_DISPLAY_ROW_3, (uint8_t*)"  Connecting... ");
@@ -154,6 +155,7 @@ void system_state_display( app_context_t * const app_context, user_context_t *us
                user_context->status.temperature, user_context->status.humidity);
       OLED_ShowString(OLED_DISPLAY_COLUMN_START, OLED_DISPLAY_ROW_4, (uint8_t*)oled_show_line);
     }
+    OLED_EndUpdate();
   }
 }
 
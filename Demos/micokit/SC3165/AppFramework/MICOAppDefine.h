@@ -106,6 +106,21 @@
  *                              APP CONTEXT
  ******************************************************************************/
     
+/* Size of the object model blob saved by OMFactory */
+#define OBJECTMODEL_STORE_SIZE   (128)
+
+/* Network state kept across reboots for a fast reconnect, see MICOFastResume.c.
+   Times are RTC seconds. */
+typedef struct
+{
+  uint32_t              magic;
+  mico_system_lease_t   lease;                    // last lease given by DHCP
+  uint32_t              leaseAcquired;
+  uint32_t              leaseExpires;
+  char                  mqttServer[maxIpLen];     // resolved address of DEFAULT_MQTT_SERVER
+  uint32_t              mqttServerExpires;
+} fast_resume_config_t;
+
 /* Application's configuration stores in flash */
 typedef struct
 {
@@ -113,6 +128,10 @@ typedef struct
   uint32_t          bonjourServicePort;   // for bonjour service port
 
   fogcloud_config_t fogcloudConfig;       // fogcloud settings
+
+  uint8_t           objectModel[OBJECTMODEL_STORE_SIZE]; // object model settings, encoded by OMFactory
+
+  fast_resume_config_t fastResume;        // lease and server address for a fast reconnect
 } application_config_t;
 
 /* Running status */
@@ -22,7 +22,9 @@
 #include "mico.h"
 #include "MICOAppDefine.h"
 #include "MiCOFogCloud.h"
+#include "MICOFastResume.h"
 #include "led.h"
+#include <stddef.h>
 
 //#ifdef USE_MiCOKit_EXT
 //#include "micokit_ext.h"
@@ -107,6 +109,19 @@ void appRestoreDefault_callback(void * const user_config_data, uint32_t size)
   
   // restore fogcloud config
   MiCOFogCloudRestoreDefault(&(appConfig->fogcloudConfig));
+
+  // object model falls back to its defaults on next start
+  memset(appConfig->objectModel, 0x0, OBJECTMODEL_STORE_SIZE);
+
+  FastResumeRestoreDefault(&(appConfig->fastResume));
+}
+
+/* MICO system callback: size of application_config_t in firmware with the legacy
+   parameter layout, objectModel and fastResume were added behind it later */
+uint32_t appLegacyConfigSize_callback(uint32_t size)
+{
+  UNUSED_PARAMETER(size);
+  return offsetof(application_config_t, objectModel);
 }
 
 int application_start(void)
@@ -134,6 +149,10 @@ int application_start(void)
     require_noerr( err, exit );
   }
 
+  /* lease and server address kept from the last connection */
+  err = FastResumeInit( app_context );
+  require_noerr( err, exit );
+
   /* mico system initialize */
   app_log("start mico_system_init");
   err = mico_system_init( mico_context );
@@ -158,8 +177,8 @@ int application_start(void)
 //#endif
 
   // initialize with red LED for unconfig airkiss
-  LedDutyInit(100.0, 0, 0);
-  LedPwmStart();
+  LedInit();
+  LedSolid(100.0, 0, 0, 0);
   app_log("[DBG]application_start: startup with unconfig airkiss by red LED ");
 
   
@@ -0,0 +1,331 @@
+/**
+******************************************************************************
+* @file    MICOFastResume.c
+* @author  MICO Application Team
+* @version V1.0.0
+* @date    19-Oct-2016
+* @brief   Reuse of the DHCP lease and the MQTT server address across reboots,
+*          and boot to first publish timing.
+******************************************************************************
+* @attention
+*
+* THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+* WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+* TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+* DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+* FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+* CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+*
+* <h2><center>&copy; COPYRIGHT 2016 MXCHIP Inc.</center></h2>
+******************************************************************************
+*/
+
+#include <time.h>
+
+#include "mico.h"
+#include "MICOFastResume.h"
+#include "fogcloud.h"
+#include "sntp.h"
+#ifdef MICO_CLI_ENABLE
+#include "command_console/mico_cli.h"
+#endif
+
+#define fast_resume_log(M, ...) custom_log("FAST_RESUME", M, ##__VA_ARGS__)
+#define fast_resume_log_trace() custom_log_trace("FAST_RESUME")
+
+
+/*******************************************************************************
+ *                                  DEFINES
+ ******************************************************************************/
+#define FAST_RESUME_MAGIC       (0x46525331)   // "FRS1"
+
+/* On a wake the station comes up with the lease DHCP gave last time and the
+ * FogCloud client connects to the address DNS gave last time, so the first
+ * publish only waits for association and the MQTT connect. Both are kept in
+ * the application config with an expiry in RTC seconds, which survives resets
+ * and STOP mode. A lease is only reused for the access point that gave it,
+ * and only for what is left of FAST_RESUME_LEASE_SECONDS: MiCO system moves
+ * the station to DHCP when that runs out. If the cloud is not reached in
+ * FAST_RESUME_FALLBACK_MS the cache is dropped and the station reconnects
+ * with DHCP. */
+
+
+/*******************************************************************************
+ *                                  VARIABLES
+ ******************************************************************************/
+static struct {
+  app_context_t*    context;
+  uint32_t          mark[FastResume_MAX];   // mico_get_time(), 0 while not reached
+  bool              lease_used;
+  bool              mqtt_used;
+  bool              mqtt_checked;           // address refreshed or found fresh this boot
+  bool              fallen_back;
+  bool              cli_registered;
+} resume;
+
+
+/*******************************************************************************
+ *                                  FUNCTIONS
+ ******************************************************************************/
+static bool FastResumeNow(uint32_t *now)
+{
+  struct tm time;
+
+  if(kNoErr != sntp_current_time_get(&time)){
+    return false;
+  }
+  *now = (uint32_t)mktime(&time);
+  return true;
+}
+
+// valid from 'from' up to 'expires', anything else means the RTC was reset
+static bool FastResumeFresh(uint32_t now, uint32_t from, uint32_t expires)
+{
+  return ((int32_t)(now - from) >= 0) && ((int32_t)(expires - now) > 0);
+}
+
+static void FastResumeForget(void)
+{
+  mico_Context_t* mico_context = resume.context->mico_context;
+
+  mico_rtos_lock_mutex(&mico_context->flashContentInRam_mutex);
+  FastResumeRestoreDefault(&resume.context->appConfig->fastResume);
+  mico_system_context_update(mico_context);
+  mico_rtos_unlock_mutex(&mico_context->flashContentInRam_mutex);
+}
+
+static void FastResumeWifiStatusHandler(WiFiEvent event, void* arg)
+{
+  (void)arg;
+  if(NOTIFY_STATION_UP == event){
+    FastResumeMark(FastResume_StationUp);
+    if(resume.lease_used){
+      FastResumeMark(FastResume_IpReady);   // no DHCP runs
+    }
+  }
+}
+
+static void FastResumeDHCPCompleteHandler(IPStatusTypedef *pnet, void* arg)
+{
+  (void)pnet;
+  (void)arg;
+  FastResumeMark(FastResume_IpReady);
+}
+
+/* MICO system delegate: reuse the last lease for the same access point */
+bool mico_system_delegate_lease_recall( const char *bssid, mico_system_lease_t *lease )
+{
+  fast_resume_config_t* config;
+  uint32_t now;
+  bool valid;
+
+  if(NULL == resume.context || !FastResumeNow(&now)){
+    return false;
+  }
+  config = &resume.context->appConfig->fastResume;
+
+  mico_rtos_lock_mutex(&resume.context->mico_context->flashContentInRam_mutex);
+  valid = (FAST_RESUME_MAGIC == config->magic) &&
+          ('\0' != config->lease.localIp[0]) &&
+          (0 == memcmp(config->lease.bssid, bssid, 6)) &&
+          FastResumeFresh(now, config->leaseAcquired, config->leaseExpires);
+  if(valid){
+    memcpy(lease, &config->lease, sizeof(mico_system_lease_t));
+    lease->seconds = config->leaseExpires - now;
+  }
+  mico_rtos_unlock_mutex(&resume.context->mico_context->flashContentInRam_mutex);
+
+  resume.lease_used = valid;
+  return valid;
+}
+
+/* MICO system delegate: keep every lease DHCP gives */
+void mico_system_delegate_lease_acquired( const mico_system_lease_t *lease )
+{
+  fast_resume_config_t* config;
+  uint32_t now;
+
+  if(NULL == resume.context || !FastResumeNow(&now)){
+    return;
+  }
+  config = &resume.context->appConfig->fastResume;
+
+  mico_rtos_lock_mutex(&resume.context->mico_context->flashContentInRam_mutex);
+  config->magic = FAST_RESUME_MAGIC;
+  memcpy(&config->lease, lease, sizeof(mico_system_lease_t));
+  config->leaseAcquired = now;
+  config->leaseExpires = now + FAST_RESUME_LEASE_SECONDS;
+  mico_system_context_update(resume.context->mico_context);
+  mico_rtos_unlock_mutex(&resume.context->mico_context->flashContentInRam_mutex);
+}
+
+const char* FastResumeMqttServer(void)
+{
+  fast_resume_config_t* config;
+  uint32_t now;
+
+  if(NULL == resume.context || !FastResumeNow(&now)){
+    return NULL;
+  }
+  config = &resume.context->appConfig->fastResume;
+
+  if((FAST_RESUME_MAGIC != config->magic) || ('\0' == config->mqttServer[0]) ||
+     !FastResumeFresh(now, config->mqttServerExpires - FAST_RESUME_DNS_SECONDS, config->mqttServerExpires)){
+    return NULL;
+  }
+  resume.mqtt_used = true;
+  return config->mqttServer;
+}
+
+void FastResumeMark(fast_resume_mark_t mark)
+{
+  uint32_t* t = resume.mark;
+
+  if(mark >= FastResume_MAX || 0 != t[mark]){
+    return;
+  }
+  t[mark] = mico_get_time();
+
+  if(FastResume_FirstPublish == mark){
+    fast_resume_log("boot to first publish %d ms (station up %d, ip %d, cloud %d), lease %s, mqtt server %s",
+                    t[FastResume_FirstPublish], t[FastResume_StationUp],
+                    t[FastResume_IpReady], t[FastResume_CloudConnected],
+                    resume.lease_used ? "cached" : "dhcp",
+                    resume.mqtt_used ? "cached" : "dns");
+  }
+}
+
+#ifdef MICO_CLI_ENABLE
+static const char* const mark_name[FastResume_MAX] = {
+  "station up",
+  "ip ready",
+  "cloud connected",
+  "first publish",
+};
+
+static void FastResumeCommand(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv)
+{
+  fast_resume_config_t* config = &resume.context->appConfig->fastResume;
+  uint32_t now = 0;
+  uint8_t i;
+
+  if(argc > 1){
+    if(strcmp(argv[1], "forget") == 0){
+      FastResumeForget();
+    }
+    else{
+      cmd_printf("Usage: resume [forget]\r\n");
+      return;
+    }
+  }
+
+  for(i = 0; i < FastResume_MAX; i++){
+    cmd_printf("%-16s %10d ms\r\n", mark_name[i], resume.mark[i]);
+  }
+  cmd_printf("lease %-5s mqtt server %-5s%s\r\n", resume.lease_used ? "cache" : "dhcp",
+             resume.mqtt_used ? "cache" : "dns", resume.fallen_back ? ", fell back" : "");
+
+  FastResumeNow(&now);
+  if(FAST_RESUME_MAGIC != config->magic){
+    cmd_printf("nothing cached\r\n");
+    return;
+  }
+  if('\0' != config->lease.localIp[0]){
+    cmd_printf("lease %s gw %s, %d s left\r\n", config->lease.localIp, config->lease.gateWay,
+               (int32_t)(config->leaseExpires - now));
+  }
+  if('\0' != config->mqttServer[0]){
+    cmd_printf("mqtt server %s, %d s left\r\n", config->mqttServer,
+               (int32_t)(config->mqttServerExpires - now));
+  }
+}
+
+static const struct cli_command resume_cmd = {
+  "resume", "[forget] fast reconnect cache and boot to first publish time", FastResumeCommand
+};
+#endif
+
+void FastResumeCheck(app_context_t * const inContext)
+{
+  fast_resume_config_t* config = &inContext->appConfig->fastResume;
+  char address[maxIpLen];
+  uint32_t now;
+
+#ifdef MICO_CLI_ENABLE
+  // the console only exists once mico_system_init() has run
+  if(!resume.cli_registered){
+    resume.cli_registered = true;
+    cli_register_command(&resume_cmd);
+  }
+#endif
+
+  if(inContext->appStatus.fogcloudStatus.isCloudConnected){
+    // the connection is up, so a lookup now costs the next wake nothing
+    if(resume.mqtt_checked || !FastResumeNow(&now)){
+      return;
+    }
+    resume.mqtt_checked = true;
+    if((FAST_RESUME_MAGIC == config->magic) && ('\0' != config->mqttServer[0]) &&
+       FastResumeFresh(now, config->mqttServerExpires - FAST_RESUME_DNS_SECONDS / 2, config->mqttServerExpires)){
+      return;
+    }
+    memset(address, 0, sizeof(address));
+    if(kNoErr != gethostbyname(DEFAULT_MQTT_SERVER, (uint8_t *)address, sizeof(address))){
+      return;
+    }
+
+    mico_rtos_lock_mutex(&inContext->mico_context->flashContentInRam_mutex);
+    if(FAST_RESUME_MAGIC != config->magic){
+      FastResumeRestoreDefault(config);
+      config->magic = FAST_RESUME_MAGIC;
+    }
+    strncpy(config->mqttServer, address, maxIpLen);
+    config->mqttServerExpires = now + FAST_RESUME_DNS_SECONDS;
+    mico_system_context_update(inContext->mico_context);
+    mico_rtos_unlock_mutex(&inContext->mico_context->flashContentInRam_mutex);
+    fast_resume_log("mqtt server %s cached", address);
+    return;
+  }
+
+  // never reached the cloud this boot with cached state, start over without it
+  if(resume.fallen_back || 0 != resume.mark[FastResume_CloudConnected] ||
+     (!resume.lease_used && !resume.mqtt_used) || 0 == resume.mark[FastResume_StationUp] ||
+     (mico_get_time() - resume.mark[FastResume_StationUp]) < FAST_RESUME_FALLBACK_MS){
+    return;
+  }
+  resume.fallen_back = true;
+  fast_resume_log("cloud not reached with cached lease/address, dropping them");
+
+  FastResumeForget();
+  if(resume.mqtt_used){
+    fogCloudSetMqttServer(NULL);
+    resume.mqtt_used = false;
+  }
+  if(resume.lease_used){
+    resume.lease_used = false;
+    mico_system_lease_revoke(inContext->mico_context);
+  }
+}
+
+
+void FastResumeRestoreDefault(fast_resume_config_t * const config)
+{
+  memset(config, 0x0, sizeof(fast_resume_config_t));
+}
+
+OSStatus FastResumeInit(app_context_t * const inContext)
+{
+  OSStatus err = kNoErr;
+  require_action(inContext, exit, err = kParamErr);
+
+  resume.context = inContext;
+
+  // registered before mico_system_init() starts connecting
+  err = mico_system_notify_register( mico_notify_WIFI_STATUS_CHANGED, (void *)FastResumeWifiStatusHandler, NULL );
+  require_noerr( err, exit );
+  err = mico_system_notify_register( mico_notify_DHCP_COMPLETED, (void *)FastResumeDHCPCompleteHandler, NULL );
+  require_noerr( err, exit );
+
+exit:
+  return err;
+}
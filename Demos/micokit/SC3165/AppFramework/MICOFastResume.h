@@ -0,0 +1,73 @@
+/**
+******************************************************************************
+* @file    MICOFastResume.h
+* @author  MICO Application Team
+* @version V1.0.0
+* @date    19-Oct-2016
+* @brief   Reuse of the DHCP lease and the MQTT server address across reboots,
+*          and boot to first publish timing.
+******************************************************************************
+* @attention
+*
+* THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+* WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+* TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+* DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+* FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+* CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+*
+* <h2><center>&copy; COPYRIGHT 2016 MXCHIP Inc.</center></h2>
+******************************************************************************
+*/
+
+#ifndef __MICO_FAST_RESUME_H_
+#define __MICO_FAST_RESUME_H_
+
+#include "mico.h"
+#include "MICOAppDefine.h"
+
+/*******************************************************************************
+ *                                DEFINES
+ ******************************************************************************/
+
+// DHCP does not report the lease time, reuse a lease for this long, which is
+// below the renewal time of common routers
+#ifndef FAST_RESUME_LEASE_SECONDS
+  #define FAST_RESUME_LEASE_SECONDS      (30*60)
+#endif
+
+// gethostbyname does not report the TTL either
+#ifndef FAST_RESUME_DNS_SECONDS
+  #define FAST_RESUME_DNS_SECONDS        (24*60*60)
+#endif
+
+// cached state is dropped when the cloud is not reached this long after station up
+#ifndef FAST_RESUME_FALLBACK_MS
+  #define FAST_RESUME_FALLBACK_MS        (20*1000)
+#endif
+
+typedef enum {
+  FastResume_StationUp = 0,
+  FastResume_IpReady,
+  FastResume_CloudConnected,
+  FastResume_FirstPublish,
+  FastResume_MAX
+} fast_resume_mark_t;
+
+/*******************************************************************************
+ *                               INTERFACES
+ ******************************************************************************/
+// before mico_system_init(), which starts the Wi-Fi connection
+OSStatus FastResumeInit(app_context_t * const inContext);
+void FastResumeRestoreDefault(fast_resume_config_t * const config);
+
+// cached address of DEFAULT_MQTT_SERVER, NULL when it has to be resolved
+const char* FastResumeMqttServer(void);
+
+// first time since boot each milestone is reached, reported at the first publish
+void FastResumeMark(fast_resume_mark_t mark);
+
+// called about once a second by the fogcloud main thread
+void FastResumeCheck(app_context_t * const inContext);
+
+#endif  // __MICO_FAST_RESUME_H_
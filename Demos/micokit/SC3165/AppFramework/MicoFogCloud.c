@@ -26,6 +26,7 @@ operation
 #include "MiCOFogCloud.h"
 #include "fogcloud.h"
 #include "FogCloudUtils.h"
+#include "MICOFastResume.h"
 
 #define fogcloud_log(M, ...) custom_log("MiCO_FOG", M, ##__VA_ARGS__)
 #define fogcloud_log_trace() custom_log_trace("MiCO_FOG")
@@ -45,6 +46,8 @@ static mico_queue_t msg_recv_queue = NULL;   // fogcloud msg recv queue
 static volatile uint32_t total_recv_buf_len = 0;
 static mico_mutex_t msg_recv_queue_mutex = NULL;
 
+static mico_semaphore_t wifi_up_sem = NULL;
+
 
 /*******************************************************************************
  *                                  FUNCTIONS
@@ -68,6 +71,9 @@ void fogNotify_WifiStatusHandler(WiFiEvent event, app_context_t * const inContex
   case NOTIFY_STATION_UP:
     fogcloud_log("wifi station up.");
     inContext->appStatus.isWifiConnected = true;
+    if(NULL != wifi_up_sem){
+      mico_rtos_set_semaphore(&wifi_up_sem);
+    }
     break;
   case NOTIFY_STATION_DOWN:
     fogcloud_log("wifi station down.");
@@ -148,7 +154,7 @@ void fogcloud_main_thread(void *arg)
   
   /* wait for station on */
   while(!inContext->appStatus.isWifiConnected){
-    mico_thread_msleep(500);
+    mico_rtos_get_semaphore(&wifi_up_sem, 500);
   }
   
   //--- create msg recv queue, NOTE: just push msg pionter into queue, so msg memory must be freed after used.
@@ -248,6 +254,7 @@ void fogcloud_main_thread(void *arg)
     }
     
     mico_thread_sleep(1);
+    FastResumeCheck(inContext);
     if(inContext->appStatus.fogcloudStatus.isOTAInProgress){
       continue;  // ota is in progress, the oled && system led will be holding
     }
@@ -305,6 +312,10 @@ OSStatus MiCOStartFogCloudService(app_context_t* const inContext)
   inContext->appStatus.fogcloudStatus.isActivated = inContext->appConfig->fogcloudConfig.isActivated;
   inContext->appStatus.fogcloudStatus.isOTAInProgress = false;
   
+  err = mico_rtos_init_semaphore(&wifi_up_sem, 1);
+  require_noerr_action(err, exit, 
+                       fogcloud_log("ERROR: mico_rtos_init_semaphore (wifi_up_sem) failed!") );
+  
   //init fogcloud service interface
   err = fogCloudInit(inContext);
   require_noerr_action(err, exit, 
@@ -457,6 +468,7 @@ OSStatus MiCOFogCloudMsgSend(app_context_t* const context, const char* topic,
   
   err = fogCloudSendtoChannel(topic, inBuf, inBufLen);  // transfer raw data
   require_noerr_action( err, exit, fogcloud_log("ERROR: send to cloud error! err=%d", err) );
+  FastResumeMark(FastResume_FirstPublish);
   return kNoErr;
   
 exit:
@@ -551,15 +563,18 @@ OSStatus MiCOFogCloudMsgRecv(app_context_t* const context, fogcloud_msg_t **msg,
   }
      
   if(NULL != msg_recv_queue){
-    mico_rtos_lock_mutex(&msg_recv_queue_mutex);
-    if(mico_rtos_is_queue_empty(&msg_recv_queue)){
-      mico_rtos_unlock_mutex(&msg_recv_queue_mutex);
+    if(0 == timeout_ms && mico_rtos_is_queue_empty(&msg_recv_queue)){
       return kUnderrunErr;
     }
+    // wait on the queue itself, holding the mutex here would block the cloud thread
     err = mico_rtos_pop_from_queue(&msg_recv_queue, msg, timeout_ms);  // just pop msg pointer from queue
-    mico_rtos_unlock_mutex(&msg_recv_queue_mutex);
     if(kNoErr == err){
+      mico_rtos_lock_mutex(&msg_recv_queue_mutex);
       total_recv_buf_len -= (sizeof(fogcloud_msg_t) - 1 + (*msg)->topic_len + (*msg)->data_len);
+      mico_rtos_unlock_mutex(&msg_recv_queue_mutex);
+    }
+    else if(0 != timeout_ms){
+      err = kUnderrunErr;
     }
   }
   else{
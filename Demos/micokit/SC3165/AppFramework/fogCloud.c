@@ -26,6 +26,8 @@
 #include "fogcloud.h"   
 #include "FogCloudService.h"
 #include "CheckSumUtils.h"
+#include "LightsMonitor.h"
+#include "MICOFastResume.h"
 
 
 #define cloud_if_log(M, ...) custom_log("FOGCLOUD_IF", M, ##__VA_ARGS__)
@@ -74,6 +76,7 @@ void cloudServiceStatusChangedHandler(void* context, easycloud_service_status_t
   if (FOGCLOUD_CONNECTED == serviceStateInfo.state){
     cloud_if_log("cloud service connected!");
     inContext->appStatus.fogcloudStatus.isCloudConnected = true;
+    FastResumeMark(FastResume_CloudConnected);
     //set_RF_LED_cloud_connected(inContext);
   }
   else{
@@ -81,6 +84,7 @@ void cloudServiceStatusChangedHandler(void* context, easycloud_service_status_t
     inContext->appStatus.fogcloudStatus.isCloudConnected = false;
     //set_RF_LED_cloud_disconnected(inContext);
   }
+  LightsNotify();
 }
 
 OSStatus fogCloudPrintVersion(void)
@@ -114,6 +118,11 @@ OSStatus fogCloudInit(app_context_t* const inContext)
   easyCloudContext.service_config_info.statusNotify = cloudServiceStatusChangedHandler;
   easyCloudContext.service_config_info.context = (void*)inContext;
   
+  // a cached server address saves the DNS lookup on the first connect
+  if(NULL != FastResumeMqttServer()){
+    fogCloudSetMqttServer(FastResumeMqttServer());
+  }
+  
   // set cloud status
   memset((void*)&(easyCloudContext.service_status), '\0', sizeof(easyCloudContext.service_status));
   easyCloudContext.service_status.isActivated = inContext->appConfig->fogcloudConfig.isActivated;
@@ -140,6 +149,20 @@ exit:
 }
 
 
+OSStatus fogCloudSetMqttServer(const char* server)
+{
+  if(NULL == server){
+    server = DEFAULT_MQTT_SERVER;
+  }
+  cloud_if_log("MQTT server: %s", server);
+  
+  strncpy(easyCloudContext.service_config_info.mqttServerDomain, 
+          server, MAX_SIZE_DOMAIN_NAME - 1);
+  easyCloudContext.service_config_info.mqttServerPort = DEFAULT_MQTT_PORT;
+  easyCloudContext.service_config_info.mqttKeepAliveInterval = DEFAULT_MQTT_CLLIENT_KEEPALIVE_INTERVAL;
+  return kNoErr;
+}
+
 OSStatus fogCloudStart(app_context_t* const inContext)
 {
   OSStatus err = kUnknownErr;
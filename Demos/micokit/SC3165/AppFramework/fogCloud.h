@@ -62,6 +62,8 @@ OSStatus fogCloudResetCloudDevInfo(app_context_t* const inContext,
 OSStatus fogCloudStop(app_context_t* const inContext);
 OSStatus fogCloudDeinit(app_context_t* const inContext);
 OSStatus fogCloudPrintVersion(void);
+// MQTT server for the next connect attempt, NULL for DEFAULT_MQTT_SERVER
+OSStatus fogCloudSetMqttServer(const char* server);
 
 
 #endif  // __FOGCLOUD_INTERFACES_H_
@@ -14,10 +14,12 @@ History:
 #include "mico.h"
 #include "json_c/json.h"
 #include "DeviceMonitor.h"
+#include "HealthMonitor.h"
 #include "CheckSumUtils.h"
 #include "user_debug.h"
 #include "controllerBus.h"
 #include "AaInclude.h"
+#include "MICOAppDefine.h"
 
 
 #ifdef DEBUG
@@ -31,6 +33,7 @@ History:
 #endif
 
 
+/* Legacy json object model in MICO_PARTITION_OBJECTMODEL, only read once to migrate */
 #define OBJECTMODEL_LENGTH_OFFSET   0x0
 #define OBJECTMODEL_LENGTH_SIZE     sizeof(uint16_t)
 
@@ -39,14 +42,49 @@ History:
 
 #define OBJECTMODEL_PARAMETER_OFFSET 0x20
 
+/* Binary object model in application_config_t.objectModel
+ * [0-1] magic, [2] version, [3] payload length, [4-5] payload crc16, [6-7] reserved
+ */
+#define OBJECTMODEL_STORE_MAGIC     0x4F4D
+#define OBJECTMODEL_STORE_VERSION   1
+#define OBJECTMODEL_STORE_HEADER    8
+
+#define OBJECTMODEL_FLAG_NOTIFYLIGHT    (1<<0)
+#define OBJECTMODEL_FLAG_LEDSWITCH      (1<<1)
+#define OBJECTMODEL_FLAG_NODISTURBING   (1<<2)
+
+/* Payload bytes of a version 1 store */
+#define OBJECTMODEL_STORE_LENGTH    (9 + 4*MAX_DEPTH_PICKUP + 6*MAX_DEPTH_PUTDOWN + 7*MAX_DEPTH_SCHEDULE)
+
+/* volume is a percentage on the music controller */
+#define OBJECTMODEL_VOLUME_MAX      100
+
+/* A burst of settings is written once, after no change for SAVE_DELAY,
+ * but no later than SAVE_MAX_DELAY after the first change */
+#define OBJECTMODEL_SAVE_DELAY_MS       2000
+#define OBJECTMODEL_SAVE_MAX_DELAY_MS   10000
+
+#define STACK_SIZE_FACTORY_THREAD   0x400
+
 
 static mico_mutex_t _factory_save_mutex = NULL;
+static mico_semaphore_t _factory_save_sem = NULL;
+static mico_thread_t _factory_thread_handle = NULL;
+static volatile bool _factory_dirty = false;
+static bool _factory_retry = false;
+static bool _factory_legacy_pending = false;
 
 
 static void OMFactoryRead();
+static bool OMFactoryReadLegacy();
 static bool ParseOM(const char* string);
+static void CommitInitParameter();
+static void EncodeOM(uint8_t* store);
+static bool DecodeOM(const uint8_t* store);
+static bool CheckOM(const uint8_t* p);
 static void SaveObjectModelDefaultParameter();
 static void PrintInitParameter();
+static void factory_thread(void* arg);
 
 
 void OMFactoryInit()
@@ -60,64 +98,89 @@ void OMFactoryInit()
     else {
         AaSysLogPrint(LOGLEVEL_INF, "create _factory_save_mutex success");
     }
+
+    err = mico_rtos_init_semaphore(&_factory_save_sem, 1);
+    if(err != kNoErr) {
+        AaSysLogPrint(LOGLEVEL_ERR, "create _factory_save_sem failed");
+    }
     
     OMFactoryRead();
+
+    // settings are written behind the application threads
+    err = AaThreadCreate(&_factory_thread_handle, MICO_APPLICATION_PRIORITY + 1, "OMFactory", 
+                         factory_thread, STACK_SIZE_FACTORY_THREAD, 
+                         NULL );
+    if(err != kNoErr) {
+        AaSysLogPrint(LOGLEVEL_ERR, "create OMFactory thread failed");
+    }
 }
 
 static void OMFactoryRead()
+{
+    application_config_t* app_config = mico_system_context_get_user_data(mico_system_context_get());
+
+    if(DecodeOM(app_config->objectModel)) {
+        user_log("[DBG]OMFactoryRead: restore objectmodel from user config");
+    }
+    else if(OMFactoryReadLegacy()) {
+        user_log("[DBG]OMFactoryRead: migrate objectmodel from legacy partition");
+        _factory_legacy_pending = true;
+        OMFactorySave();
+    }
+    else {
+        SaveObjectModelDefaultParameter();
+    }
+    
+    PrintInitParameter();
+}
+
+static bool OMFactoryReadLegacy()
 {
     OSStatus err;
+    bool ret = false;
     uint16_t objectmodel_length = 0;
     uint16_t objectmodel_crc_from_flash = 0;
     uint16_t objectmodel_crc_by_calc = 0;
     uint32_t para_offset;
-    char* conf_string;
+    char* conf_string = NULL;
     CRC16_Context contex;
     
     para_offset = OBJECTMODEL_LENGTH_OFFSET;
     err = MicoFlashRead(MICO_PARTITION_OBJECTMODEL, &para_offset, (uint8_t *)&objectmodel_length, OBJECTMODEL_LENGTH_SIZE);
-    require_noerr_action(err, exit, user_log("[ERR]OMFactoryRead: read flash objectmodel length failed"));
-    user_log("[DBG]OMFactoryRead: read flash objectmodel length 0x%x", objectmodel_length);
+    require_noerr_action(err, exit, user_log("[ERR]OMFactoryReadLegacy: read flash objectmodel length failed"));
+    user_log("[DBG]OMFactoryReadLegacy: read flash objectmodel length 0x%x", objectmodel_length);
 
-    if(objectmodel_length == 0xFFFF) {
-        user_log("[WRN]OMFactoryRead: there is no objectmodel parameter save in flash");
-        SaveObjectModelDefaultParameter();
+    if(objectmodel_length == 0xFFFF || objectmodel_length == 0) {
+        user_log("[WRN]OMFactoryReadLegacy: there is no objectmodel parameter save in flash");
+        goto exit;
     }
-    else {
-        para_offset = OBJECTMODEL_CRC_OFFSET;
-        err = MicoFlashRead(MICO_PARTITION_OBJECTMODEL, &para_offset, (uint8_t *)&objectmodel_crc_from_flash, OBJECTMODEL_CRC_SIZE);
-        require_noerr_action(err, exit, user_log("[ERR]OMFactoryRead: read flash objectmodel crc failed"));
-        user_log("[DBG]OMFactoryRead: read flash objectmodel crc 0x%x", objectmodel_crc_from_flash);
-
-        conf_string = malloc(objectmodel_length);
-        if(conf_string == NULL) {
-            user_log("[ERR]OMFactoryRead: malloc conf_string failed");
-        }
-        else {
-            para_offset = OBJECTMODEL_PARAMETER_OFFSET;
-            err = MicoFlashRead(MICO_PARTITION_OBJECTMODEL, &para_offset, (uint8_t *)conf_string, objectmodel_length);
-            require_noerr_action(err, exit, user_log("[ERR]OMFactoryRead: read flash objectmodel parameter failed"));
 
-            CRC16_Init(&contex);
-            CRC16_Update( &contex, conf_string, objectmodel_length);
-            CRC16_Final( &contex, &objectmodel_crc_by_calc);
+    para_offset = OBJECTMODEL_CRC_OFFSET;
+    err = MicoFlashRead(MICO_PARTITION_OBJECTMODEL, &para_offset, (uint8_t *)&objectmodel_crc_from_flash, OBJECTMODEL_CRC_SIZE);
+    require_noerr_action(err, exit, user_log("[ERR]OMFactoryReadLegacy: read flash objectmodel crc failed"));
 
-            if(objectmodel_crc_by_calc != objectmodel_crc_from_flash) {
-                user_log("[ERR]OMFactoryRead: crc from flash(0x%x) != crc by calc(0x%x)", objectmodel_crc_from_flash, objectmodel_crc_by_calc);
-            }
-            else {
-                user_log("[DBG]OMFactoryRead: crc from flash(0x%x) is same with crc by calc", objectmodel_crc_from_flash);
-                if(!ParseOM((const char*)conf_string)) {
-                    SaveObjectModelDefaultParameter();
-                }
-            }
-        }
+    conf_string = malloc(objectmodel_length + 1);
+    require_action(conf_string, exit, user_log("[ERR]OMFactoryReadLegacy: malloc conf_string failed"));
+
+    para_offset = OBJECTMODEL_PARAMETER_OFFSET;
+    err = MicoFlashRead(MICO_PARTITION_OBJECTMODEL, &para_offset, (uint8_t *)conf_string, objectmodel_length);
+    require_noerr_action(err, exit, user_log("[ERR]OMFactoryReadLegacy: read flash objectmodel parameter failed"));
+    conf_string[objectmodel_length] = '\0';
+
+    CRC16_Init(&contex);
+    CRC16_Update( &contex, conf_string, objectmodel_length);
+    CRC16_Final( &contex, &objectmodel_crc_by_calc);
+
+    if(objectmodel_crc_by_calc != objectmodel_crc_from_flash) {
+        user_log("[ERR]OMFactoryReadLegacy: crc from flash(0x%x) != crc by calc(0x%x)", objectmodel_crc_from_flash, objectmodel_crc_by_calc);
+        goto exit;
     }
-    
-    PrintInitParameter();
+
+    ret = ParseOM((const char*)conf_string);
 
 exit:
     if( conf_string!= NULL) free( conf_string );
+    return ret;
 }
 
 static bool ParseOM(const char* string)
@@ -126,7 +189,6 @@ static bool ParseOM(const char* string)
     json_object *get_json_object = NULL;
     char om_string[64];
     u8 index;
-    unsigned char volume;
     
     get_json_object = json_tokener_parse(string);
     if (NULL != get_json_object){
@@ -277,29 +339,7 @@ static bool ParseOM(const char* string)
             }
         }
 
-        // clear setting flag
-        IsEnableNotifyLightChanged();
-        IsLedSwitchChanged();
-        IsLedConfChanged();
-        if(IsVolumeChanged()) {
-            user_log("[DBG]ParseOM: volume changed, sending volume config");
-            volume = GetVolume();
-            ControllerBusSend(CONTROLLERBUS_CMD_VOLUME, &volume, sizeof(volume));
-        }
-        IsIfNoDisturbingChanged();
-        IsNoDisturbingTimeChanged();
-        for(index = 0; index < MAX_DEPTH_PICKUP; index++) {
-            IsPickupChanged(index);
-        }
-        for(index = 0; index < MAX_DEPTH_PUTDOWN; index++) {
-            IsPutdownChanged(index);
-        }
-        for(index = 0; index < MAX_DEPTH_IMMEDIATE; index++) {
-            IsImmediateChanged(index);
-        }
-        for(index = 0; index < MAX_DEPTH_SCHEDULE; index++) {
-            IsScheduleChanged(index);
-        }
+        CommitInitParameter();
 
         // free memory of json object
         json_object_put(get_json_object);
@@ -315,133 +355,264 @@ static bool ParseOM(const char* string)
     return ret;
 }
 
-void OMFactorySave()
+// clear setting flag, copy the staged values into the model
+static void CommitInitParameter()
 {
-    OSStatus err;
-    mico_logic_partition_t* objectmodel_partition;
-    uint16_t objectmodel_length = 0;
-    uint16_t objectmodel_crc = 0;
-    uint32_t para_offset;
-    json_object *save_json_object = NULL;
-    const char *save_data = NULL;
+    u8 index;
+    unsigned char volume;
+
+    IsEnableNotifyLightChanged();
+    IsLedSwitchChanged();
+    IsLedConfChanged();
+    if(IsVolumeChanged()) {
+        user_log("[DBG]CommitInitParameter: volume changed, sending volume config");
+        volume = GetVolume();
+        ControllerBusSend(CONTROLLERBUS_CMD_VOLUME, &volume, sizeof(volume));
+    }
+    IsIfNoDisturbingChanged();
+    IsNoDisturbingTimeChanged();
+    for(index = 0; index < MAX_DEPTH_PICKUP; index++) {
+        IsPickupChanged(index);
+    }
+    for(index = 0; index < MAX_DEPTH_PUTDOWN; index++) {
+        IsPutdownChanged(index);
+    }
+    for(index = 0; index < MAX_DEPTH_IMMEDIATE; index++) {
+        IsImmediateChanged(index);
+    }
+    for(index = 0; index < MAX_DEPTH_SCHEDULE; index++) {
+        if(IsScheduleChanged(index)) {
+            HealthScheduleChanged(index);
+        }
+    }
+}
+
+static void EncodeOM(uint8_t* store)
+{
+    uint8_t* p = store + OBJECTMODEL_STORE_HEADER;
+    uint16_t crc;
     CRC16_Context contex;
-    char om_string[64];
     u8 index;
 
-    mico_rtos_lock_mutex(&_factory_save_mutex);
+    memset(store, 0x0, OBJECTMODEL_STORE_SIZE);
 
-    save_json_object = json_object_new_object();
-    if(NULL == save_json_object){
-        user_log("[ERR]OMFactorySave: create json object error");
+    *p++ = (GetEnableNotifyLight() ? OBJECTMODEL_FLAG_NOTIFYLIGHT : 0) |
+           (GetLedSwitch() ? OBJECTMODEL_FLAG_LEDSWITCH : 0) |
+           (GetIfNoDisturbing() ? OBJECTMODEL_FLAG_NODISTURBING : 0);
+    *p++ = GetVolume();
+    *p++ = GetRedConf();
+    *p++ = GetGreenConf();
+    *p++ = GetBlueConf();
+    *p++ = GetNoDisturbingStartHour();
+    *p++ = GetNoDisturbingStartMinute();
+    *p++ = GetNoDisturbingEndHour();
+    *p++ = GetNoDisturbingEndMinute();
+
+    for(index = 0; index < MAX_DEPTH_PICKUP; index++) {
+        *p++ = GetPickUpEnable(index);
+        *p++ = GetPickUpTrackType(index);
+        *p++ = GetPickUpSelTrack(index) & 0xFF;
+        *p++ = GetPickUpSelTrack(index) >> 8;
+    }
+    for(index = 0; index < MAX_DEPTH_PUTDOWN; index++) {
+        *p++ = GetPutDownEnable(index);
+        *p++ = GetPutDownTrackType(index);
+        *p++ = GetPutDownSelTrack(index) & 0xFF;
+        *p++ = GetPutDownSelTrack(index) >> 8;
+        *p++ = GetPutDownRemindDelay(index) & 0xFF;
+        *p++ = GetPutDownRemindDelay(index) >> 8;
+    }
+    for(index = 0; index < MAX_DEPTH_SCHEDULE; index++) {
+        *p++ = GetScheduleEnable(index);
+        *p++ = GetScheduleTrackType(index);
+        *p++ = GetScheduleSelTrack(index) & 0xFF;
+        *p++ = GetScheduleSelTrack(index) >> 8;
+        *p++ = GetScheduleRemindHour(index);
+        *p++ = GetScheduleRemindMinute(index);
+        *p++ = GetScheduleRemindTimes(index);
     }
-    else {
-        json_object_object_add(save_json_object, "LIGHTS-1/EnableNotifyLight", json_object_new_boolean(GetEnableNotifyLight()));
-        json_object_object_add(save_json_object, "LIGHTS-1/LedSwitch", json_object_new_boolean(GetLedSwitch()));
-        json_object_object_add(save_json_object, "LIGHTS-1/LedConfRed", json_object_new_int(GetRedConf()));
-        json_object_object_add(save_json_object, "LIGHTS-1/LedConfGreen", json_object_new_int(GetGreenConf()));
-        json_object_object_add(save_json_object, "LIGHTS-1/LedConfBlue", json_object_new_int(GetBlueConf()));
-        json_object_object_add(save_json_object, "MUSIC-1/Volume", json_object_new_int(GetVolume()));
-        json_object_object_add(save_json_object, "HEALTH-1/IfNoDisturbing", json_object_new_boolean(GetIfNoDisturbing()));
-        json_object_object_add(save_json_object, "HEALTH-1/NoDisturbingStartHour", json_object_new_int(GetNoDisturbingStartHour()));
-        json_object_object_add(save_json_object, "HEALTH-1/NoDisturbingStartMinute", json_object_new_int(GetNoDisturbingStartMinute()));
-        json_object_object_add(save_json_object, "HEALTH-1/NoDisturbingEndHour", json_object_new_int(GetNoDisturbingEndHour()));
-        json_object_object_add(save_json_object, "HEALTH-1/NoDisturbingEndMinute", json_object_new_int(GetNoDisturbingEndMinute()));
-        for(index = 0; index < MAX_DEPTH_PICKUP; index++) {
-            sprintf(om_string, "HEALTH-1/PICKUP-%d/Enable\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_boolean(GetPickUpEnable(index)));
-
-            sprintf(om_string, "HEALTH-1/PICKUP-%d/TrackType\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetPickUpTrackType(index)));
-            
-            sprintf(om_string, "HEALTH-1/PICKUP-%d/SelTrack\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetPickUpSelTrack(index)));
-        }
-        for(index = 0; index < MAX_DEPTH_PUTDOWN; index++) {
-            sprintf(om_string, "HEALTH-1/PUTDOWN-%d/Enable\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_boolean(GetPutDownEnable(index)));
 
-            sprintf(om_string, "HEALTH-1/PUTDOWN-%d/RemindDelay\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetPutDownRemindDelay(index)));
+    CRC16_Init(&contex);
+    CRC16_Update(&contex, store + OBJECTMODEL_STORE_HEADER, p - store - OBJECTMODEL_STORE_HEADER);
+    CRC16_Final(&contex, &crc);
 
-            sprintf(om_string, "HEALTH-1/PUTDOWN-%d/TrackType\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetPutDownTrackType(index)));
+    store[0] = OBJECTMODEL_STORE_MAGIC & 0xFF;
+    store[1] = OBJECTMODEL_STORE_MAGIC >> 8;
+    store[2] = OBJECTMODEL_STORE_VERSION;
+    store[3] = p - store - OBJECTMODEL_STORE_HEADER;
+    store[4] = crc & 0xFF;
+    store[5] = crc >> 8;
+}
 
-            sprintf(om_string, "HEALTH-1/PUTDOWN-%d/SelTrack\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetPutDownSelTrack(index)));
-        }
-/*        
-        for(index = 0; index < MAX_DEPTH_IMMEDIATE; index++) {
-            sprintf(om_string, "HEALTH-1/IMMEDIATE-%d/Enable\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_boolean(GetImmediateEnable(index)));
+static bool DecodeOM(const uint8_t* store)
+{
+    const uint8_t* p = store + OBJECTMODEL_STORE_HEADER;
+    uint16_t crc;
+    CRC16_Context contex;
+    u8 index;
 
-            sprintf(om_string, "HEALTH-1/IMMEDIATE-%d/TrackType\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetImmediateTrackType(index)));
+    if(store[0] != (OBJECTMODEL_STORE_MAGIC & 0xFF) || store[1] != (OBJECTMODEL_STORE_MAGIC >> 8)) {
+        user_log("[WRN]DecodeOM: no objectmodel in user config");
+        return false;
+    }
+    if(store[2] != OBJECTMODEL_STORE_VERSION || store[3] != OBJECTMODEL_STORE_LENGTH) {
+        user_log("[WRN]DecodeOM: unsupported objectmodel version %d length %d", store[2], store[3]);
+        return false;
+    }
 
-            sprintf(om_string, "HEALTH-1/IMMEDIATE-%d/SelTrack\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetImmediateSelTrack(index)));
-        }
-*/        
-        for(index = 0; index < MAX_DEPTH_SCHEDULE; index++) {
-            sprintf(om_string, "HEALTH-1/SCHEDULE-%d/Enable\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_boolean(GetScheduleEnable(index)));
+    CRC16_Init(&contex);
+    CRC16_Update(&contex, p, store[3]);
+    CRC16_Final(&contex, &crc);
+    if(crc != (store[4] | (store[5] << 8))) {
+        user_log("[ERR]DecodeOM: objectmodel crc error");
+        return false;
+    }
+
+    // nothing is applied unless every value is in range
+    if(!CheckOM(p)) {
+        return false;
+    }
+
+    SetEnableNotifyLight(p[0] & OBJECTMODEL_FLAG_NOTIFYLIGHT);
+    SetLedSwitch(p[0] & OBJECTMODEL_FLAG_LEDSWITCH);
+    SetIfNoDisturbing(p[0] & OBJECTMODEL_FLAG_NODISTURBING);
+    SetVolume(p[1]);
+    SetRedConf(p[2]);
+    SetGreenConf(p[3]);
+    SetBlueConf(p[4]);
+    SetNoDisturbingStartHour(p[5]);
+    SetNoDisturbingStartMinute(p[6]);
+    SetNoDisturbingEndHour(p[7]);
+    SetNoDisturbingEndMinute(p[8]);
+    p += 9;
+
+    for(index = 0; index < MAX_DEPTH_PICKUP; index++, p += 4) {
+        SetPickUpEnable(index, p[0]);
+        SetPickUpTrackType(index, p[1]);
+        SetPickUpSelTrack(index, p[2] | (p[3] << 8));
+    }
+    for(index = 0; index < MAX_DEPTH_PUTDOWN; index++, p += 6) {
+        SetPutDownEnable(index, p[0]);
+        SetPutDownTrackType(index, p[1]);
+        SetPutDownSelTrack(index, p[2] | (p[3] << 8));
+        SetPutDownRemindDelay(index, p[4] | (p[5] << 8));
+    }
+    for(index = 0; index < MAX_DEPTH_SCHEDULE; index++, p += 7) {
+        SetScheduleEnable(index, p[0]);
+        SetScheduleTrackType(index, p[1]);
+        SetScheduleSelTrack(index, p[2] | (p[3] << 8));
+        SetScheduleRemindHour(index, p[4]);
+        SetScheduleRemindMinute(index, p[5]);
+        SetScheduleRemindTimes(index, p[6]);
+    }
 
-            sprintf(om_string, "HEALTH-1/SCHEDULE-%d/RemindHour\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetScheduleRemindHour(index)));
+    CommitInitParameter();
 
-            sprintf(om_string, "HEALTH-1/SCHEDULE-%d/RemindMinute\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetScheduleRemindMinute(index)));
+    return true;
+}
 
-            sprintf(om_string, "HEALTH-1/SCHEDULE-%d/RemindTimes\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetScheduleRemindTimes(index)));
+static bool CheckOM(const uint8_t* p)
+{
+    u8 index;
 
-            sprintf(om_string, "HEALTH-1/SCHEDULE-%d/TrackType\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetScheduleTrackType(index)));
+    if(p[1] > OBJECTMODEL_VOLUME_MAX || p[5] >= 24 || p[6] >= 60 || p[7] >= 24 || p[8] >= 60) {
+        user_log("[ERR]CheckOM: volume %d or no disturbing time %d:%d-%d:%d out of range", p[1], p[5], p[6], p[7], p[8]);
+        return false;
+    }
+    p += 9;
 
-            sprintf(om_string, "HEALTH-1/SCHEDULE-%d/SelTrack\0", index + 1);
-            json_object_object_add(save_json_object, om_string, json_object_new_int(GetScheduleSelTrack(index)));
+    for(index = 0; index < MAX_DEPTH_PICKUP; index++, p += 4) {
+        if(p[0] > 1 || !CheckTrackType(p[1])) {
+            user_log("[ERR]CheckOM: pickup %d enable %d type %d out of range", index, p[0], p[1]);
+            return false;
         }
-
-        save_data = json_object_to_json_string(save_json_object);
-        if(NULL == save_data) {
-            user_log("[ERR]OMFactorySave: create data string error");
+    }
+    for(index = 0; index < MAX_DEPTH_PUTDOWN; index++, p += 6) {
+        if(p[0] > 1 || !CheckTrackType(p[1])) {
+            user_log("[ERR]CheckOM: putdown %d enable %d type %d out of range", index, p[0], p[1]);
+            return false;
         }
-        else {
-            objectmodel_partition = MicoFlashGetInfo( MICO_PARTITION_OBJECTMODEL );
-            err = MicoFlashErase( MICO_PARTITION_OBJECTMODEL, 0x0, objectmodel_partition->partition_length );
-            require_noerr(err, exit);
-
-            objectmodel_length = strlen(save_data);
-            para_offset = OBJECTMODEL_LENGTH_OFFSET;
-            err = MicoFlashWrite(MICO_PARTITION_OBJECTMODEL, &para_offset, (uint8_t *)&objectmodel_length, OBJECTMODEL_LENGTH_SIZE);
-            require_noerr(err, exit);
-
-            CRC16_Init( &contex );
-            CRC16_Update( &contex, save_data, objectmodel_length);
-            CRC16_Final( &contex, &objectmodel_crc );
-            para_offset = OBJECTMODEL_CRC_OFFSET;
-            err = MicoFlashWrite(MICO_PARTITION_OBJECTMODEL, &para_offset, (uint8_t *)&objectmodel_crc, OBJECTMODEL_CRC_SIZE);
-            require_noerr(err, exit);
-
-            para_offset = OBJECTMODEL_PARAMETER_OFFSET;
-            err = MicoFlashWrite(MICO_PARTITION_OBJECTMODEL, &para_offset, (uint8_t *)save_data, objectmodel_length);
-            require_noerr(err, exit);
-
-            user_log("[DBG]OMFactorySave: save data string success");
+    }
+    for(index = 0; index < MAX_DEPTH_SCHEDULE; index++, p += 7) {
+        if(p[0] > 1 || !CheckTrackType(p[1]) || p[4] >= 24 || p[5] >= 60) {
+            user_log("[ERR]CheckOM: schedule %d enable %d type %d time %d:%d out of range", index, p[0], p[1], p[4], p[5]);
+            return false;
         }
     }
 
-exit:
-    // free json object memory
-    json_object_put(save_json_object);
-    save_json_object = NULL;
+    return true;
+}
+
+// request a save, the write is deferred and merged with following requests
+void OMFactorySave()
+{
+    _factory_dirty = true;
+    mico_rtos_set_semaphore(&_factory_save_sem);
+}
+
+// write the object model into user config now if it has been changed
+void OMFactoryFlush()
+{
+    OSStatus err = kNoErr;
+    mico_Context_t* mico_context = mico_system_context_get();
+    application_config_t* app_config = mico_system_context_get_user_data(mico_context);
+    mico_logic_partition_t* objectmodel_partition;
+    uint8_t store[OBJECTMODEL_STORE_SIZE];
+
+    mico_rtos_lock_mutex(&_factory_save_mutex);
+
+    if(!_factory_dirty) {
+        goto exit;
+    }
+    _factory_dirty = false;
+
+    EncodeOM(store);
+    if(!_factory_retry && memcmp(store, app_config->objectModel, OBJECTMODEL_STORE_SIZE) == 0) {
+        user_log("[DBG]OMFactoryFlush: objectmodel not changed");
+        goto exit;
+    }
+
+    mico_rtos_lock_mutex(&mico_context->flashContentInRam_mutex);
+    memcpy(app_config->objectModel, store, OBJECTMODEL_STORE_SIZE);
+    err = mico_system_context_update(mico_context);
+    mico_rtos_unlock_mutex(&mico_context->flashContentInRam_mutex);
+
+    _factory_retry = (err != kNoErr);
+    require_noerr_action(err, exit, user_log("[ERR]OMFactoryFlush: save objectmodel failed %d", err));
+    user_log("[DBG]OMFactoryFlush: save objectmodel success");
 
+    if(_factory_legacy_pending) {
+        objectmodel_partition = MicoFlashGetInfo( MICO_PARTITION_OBJECTMODEL );
+        err = MicoFlashErase( MICO_PARTITION_OBJECTMODEL, 0x0, objectmodel_partition->partition_length );
+        _factory_legacy_pending = (err != kNoErr);
+    }
+
+exit:
     mico_rtos_unlock_mutex(&_factory_save_mutex);
 }
 
+static void factory_thread(void* arg)
+{
+    uint32_t start;
+
+    while(1) {
+        mico_rtos_get_semaphore(&_factory_save_sem, MICO_WAIT_FOREVER);
+
+        // every new request restarts the quiet period
+        start = mico_get_time();
+        while(mico_get_time() - start < OBJECTMODEL_SAVE_MAX_DELAY_MS) {
+            if(mico_rtos_get_semaphore(&_factory_save_sem, OBJECTMODEL_SAVE_DELAY_MS) != kNoErr) {
+                break;
+            }
+        }
+
+        OMFactoryFlush();
+    }
+}
+
 static void SaveObjectModelDefaultParameter()
 {
     u8 index;
-    unsigned char volume;
 
     user_log("[DBG]SaveObjectModelDefaultParameter: will save default parameter");
     
@@ -484,31 +655,7 @@ static void SaveObjectModelDefaultParameter()
         SetScheduleSelTrack(index, 0);
     }
 
-    // clear setting flag
-    IsEnableNotifyLightChanged();
-    IsLedSwitchChanged();
-    IsLedConfChanged();
-    if(IsVolumeChanged()) {
-        user_log("[DBG]ParseOM: volume changed, sending volume config");
-        volume = GetVolume();
-        ControllerBusSend(CONTROLLERBUS_CMD_VOLUME, &volume, sizeof(volume));
-    }
-    IsIfNoDisturbingChanged();
-    IsNoDisturbingTimeChanged();
-    for(index = 0; index < MAX_DEPTH_PICKUP; index++) {
-        IsPickupChanged(index);
-    }
-    for(index = 0; index < MAX_DEPTH_PUTDOWN; index++) {
-        IsPutdownChanged(index);
-    }
-/*    
-    for(index = 0; index < MAX_DEPTH_IMMEDIATE; index++) {
-        IsImmediateChanged(index);
-    }
-*/    
-    for(index = 0; index < MAX_DEPTH_SCHEDULE; index++) {
-        IsScheduleChanged(index);
-    }
+    CommitInitParameter();
 
     OMFactorySave();
 }
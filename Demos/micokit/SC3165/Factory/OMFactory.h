@@ -21,6 +21,7 @@ History:
 
 void OMFactoryInit();
 void OMFactorySave();
+void OMFactoryFlush();
 
 
    
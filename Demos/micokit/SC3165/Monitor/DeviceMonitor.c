@@ -35,23 +35,25 @@ History:
 #define STACK_SIZE_DEVICE_THREAD    0x400
 
 
-mico_timer_t timer_device_notify;
+static SAaTimer timer_device_notify;
 
 static mico_thread_t _device_handler = NULL;
 
 // device notify interval, unit: second
 u8 device_notify_interval = 10;//60;
 
+// the interval doubles up to this while battery and signal stay the same
+#define DEVICE_NOTIFY_INTERVAL_MAX  60
+
+static u8 notify_interval;
+
 bool _f411_online = false;
 
 
 static void DeviceHandler(void* arg);
 static void DeviceEstimator(void* arg);
-static void PowerNotification(app_context_t *app_context);
-static bool PushIntoQueue(float* voltage, uint16_t deepth, uint16_t index, float data);
-static float GetQueueAverage(float* voltage, uint16_t deepth);
-static void PrintQueueValidValue(float* voltage, uint16_t deepth);
-static void SignalStrengthNotification(app_context_t *app_context);
+static bool PowerNotification(app_context_t *app_context);
+static bool SignalStrengthNotification(app_context_t *app_context);
 static void TemperatureNotification();
 static void QueryTfStatus();
 static OSStatus HandleTfStatusResponse(void* msg_ptr, app_context_t *app_context);
@@ -62,9 +64,9 @@ void DeviceInit(app_context_t *app_context)
     OSStatus err;
     
     // start the device monitor thread
-    err = mico_rtos_create_thread(&_device_handler, MICO_APPLICATION_PRIORITY, "DeviceHandler", 
-                                  DeviceHandler, STACK_SIZE_DEVICE_THREAD, 
-                                  app_context );
+    err = AaThreadCreate(&_device_handler, MICO_APPLICATION_PRIORITY, "DeviceHandler", 
+                         DeviceHandler, STACK_SIZE_DEVICE_THREAD, 
+                         app_context );
     if(kNoErr != err) {
         AaSysLogPrint(LOGLEVEL_ERR, "create device thread failed");
     }
@@ -72,21 +74,16 @@ void DeviceInit(app_context_t *app_context)
         AaSysLogPrint(LOGLEVEL_INF, "create device thread success");
     }
 
-    // start device timer estimator
-    err = mico_init_timer(&timer_device_notify, device_notify_interval*UpTicksPerSecond(), DeviceEstimator, app_context);
+    // the estimator runs in the device thread, armed for its next check only
+    notify_interval = device_notify_interval;
+    TMP75SetSamplePeriod(notify_interval*1000);
+    AaTimerSetup(&timer_device_notify, MsgQueue_DeviceHandler, DeviceEstimator, app_context);
+    err = AaTimerStart(&timer_device_notify, notify_interval*1000);
     if(kNoErr != err) {
-        AaSysLogPrint(LOGLEVEL_ERR, "create timer_device_notify failed");
+        AaSysLogPrint(LOGLEVEL_ERR, "start timer_device_notify failed");
     }
     else {
-        AaSysLogPrint(LOGLEVEL_INF, "create timer_device_notify success");
-
-        err = mico_start_timer(&timer_device_notify);
-        if(kNoErr != err) {
-            AaSysLogPrint(LOGLEVEL_ERR, "start timer_device_notify failed");
-        }
-        else {
-            AaSysLogPrint(LOGLEVEL_INF, "start timer_device_notify success");
-        }
+        AaSysLogPrint(LOGLEVEL_INF, "start timer_device_notify success");
     }
 }
 
@@ -108,6 +105,9 @@ static void DeviceHandler(void* arg)
             case API_MESSAGE_ID_TFSTATUS_RESP: 
                 HandleTfStatusResponse(msg_ptr, app_context);
                 break;
+            case API_MESSAGE_ID_TIMER_IND:
+                AaTimerDispatch(msg_ptr);
+                break;
             default: 
                 AaSysLogPrint(LOGLEVEL_WRN, "no message id 0x%04x", msg->msg_id); 
                 break;
@@ -119,69 +119,48 @@ static void DeviceHandler(void* arg)
 
 static void DeviceEstimator(void* arg)
 {
-    OSStatus err;
+    bool changed;
     app_context_t *app_context = (app_context_t*)arg;
 
-    err = mico_reload_timer(&timer_device_notify);
-    if(err != kNoErr) {
-        AaSysLogPrint(LOGLEVEL_ERR, "reload timer_device_notify failed");
-    }
-    
-    PowerNotification(app_context);
-    SignalStrengthNotification(app_context);
+    changed = PowerNotification(app_context);
+    changed |= SignalStrengthNotification(app_context);
     QueryTfStatus();
+
+    // back off while nothing moves, any change brings the short interval back
+    if(changed) {
+        notify_interval = device_notify_interval;
+    }
+    else if(notify_interval < DEVICE_NOTIFY_INTERVAL_MAX) {
+        notify_interval = (notify_interval*2 < DEVICE_NOTIFY_INTERVAL_MAX) ? notify_interval*2 : DEVICE_NOTIFY_INTERVAL_MAX;
+    }
+    // the temperature is read once per check, no need to sample it faster
+    TMP75SetSamplePeriod(notify_interval*1000);
+    AaTimerStart(&timer_device_notify, notify_interval*1000);
 }
 
 #define LOW_POWER_LIMIT         15
-#define VOLTAGE_BUFFER_DEEPTH   10
 
-static void PowerNotification(app_context_t *app_context)
+static bool PowerNotification(app_context_t *app_context)
 {
     bool ret;
-    float voltage_tmp = 0;
-    static float voltage[VOLTAGE_BUFFER_DEEPTH] = {0};
-    static uint16_t vol_buf_idx = 0;
-    static uint16_t vol_buf_lenth = 0;
+    bool changed = false;
+    uint16_t millivolt = 0;
 
-    if(GetBatteryVoltage(&voltage_tmp) != true) {
-        AaSysLogPrint(LOGLEVEL_ERR, "get battery voltage_tmp failed");
-        return ;
+    if(GetBatteryMillivolt(&millivolt) != true) {
+        AaSysLogPrint(LOGLEVEL_ERR, "get battery voltage failed");
+        return false;
     }
 
-    voltage_tmp *= 100.0;
-    
-    if(voltage_tmp < BATTERY_VOLTAGE_LOW) {
-        AaSysLogPrint(LOGLEVEL_WRN, "battery voltage_tmp below the lowest");
+    if(millivolt < BATTERY_MILLIVOLT_LOW) {
+        AaSysLogPrint(LOGLEVEL_WRN, "battery voltage %d mV below the lowest", millivolt);
         SetPower(0);
-        return ;
     }
-    else if(voltage_tmp > BATTERY_VOLTAGE_HIGH) {
-        AaSysLogPrint(LOGLEVEL_WRN, "battery voltage_tmp is full");
+    else if(millivolt > BATTERY_MILLIVOLT_HIGH) {
+        AaSysLogPrint(LOGLEVEL_WRN, "battery voltage is full");
         SetPower(100);
-        return ;
     }
     else {
-        if(true != PushIntoQueue(voltage, VOLTAGE_BUFFER_DEEPTH, vol_buf_idx, voltage_tmp)) {
-            return ;
-        }
-
-        if(vol_buf_idx < VOLTAGE_BUFFER_DEEPTH) {
-            vol_buf_idx++;
-            if(vol_buf_idx >= VOLTAGE_BUFFER_DEEPTH) {
-                vol_buf_idx = 0;
-            }
-        }
-        vol_buf_lenth < VOLTAGE_BUFFER_DEEPTH ? vol_buf_lenth++ : NULL;
-
-        if(vol_buf_lenth < VOLTAGE_BUFFER_DEEPTH) {
-            voltage_tmp = GetQueueAverage(voltage, vol_buf_lenth);
-        } else {
-            voltage_tmp = GetQueueAverage(voltage, VOLTAGE_BUFFER_DEEPTH);
-        }
-
-//        PrintQueueValidValue(voltage, VOLTAGE_BUFFER_DEEPTH);
-
-        int percent = (int)((voltage_tmp - BATTERY_VOLTAGE_LOW)*100.0/(BATTERY_VOLTAGE_HIGH - BATTERY_VOLTAGE_LOW));
+        int percent = (millivolt - BATTERY_MILLIVOLT_LOW) * 100 / (BATTERY_MILLIVOLT_HIGH - BATTERY_MILLIVOLT_LOW);
         SetPower(percent);
 //        user_log("[DBG]PowerNotification: current power percent %d", percent);
     }
@@ -191,59 +170,27 @@ static void PowerNotification(app_context_t *app_context)
 
     ret = false;
     if(IsPowerChanged()) {
+        changed = true;
         ret = SendJsonInt(app_context, "DEVICE-1/Power", GetPower());
         AaSysLogPrint(LOGLEVEL_DBG, "Power change to %d with ret %s", GetPower(), ret ? "true" : "false");
     }
 
     ret = false;
     if(IsLowPowerAlarmChanged()) {
+        changed = true;
         ret = SendJsonBool(app_context, "DEVICE-1/LowPowerAlarm", GetLowPowerAlarm());
         AaSysLogPrint(LOGLEVEL_DBG, "LowPowerAlarm change to %s with ret %s", 
                 GetLowPowerAlarm() ? "true" : "false",
                 ret ? "true" : "false");
     }
-}
 
-static bool PushIntoQueue(float* voltage, uint16_t deepth, uint16_t index, float data)
-{
-    if(index >= deepth) {
-        AaSysLogPrint(LOGLEVEL_WRN, "error input index %d larger than deepth %d", index, deepth);
-        return false;
-    }
-
-    voltage[index] = data;
-//    user_log("[DBG]PushIntoQueue: voltage[%d] get value %f", index, voltage[index]);
-
-    return true;
+    return changed;
 }
 
-static float GetQueueAverage(float* voltage, uint16_t deepth)
-{
-    uint16_t i;
-    float ret = voltage[0];
-
-//    user_log("[DBG]GetQueueAverage: get the first value voltage[0] %f", voltage[0]);
-
-    for(i=1; i<deepth; i++) {
-        ret = (ret + voltage[i])/2;
-//        user_log("[DBG]GetQueueAverage: get the voltage[%d] %f and ret with %f", i, voltage[i], ret);
-    }
-
-    return ret;
-}
-
-static void PrintQueueValidValue(float* voltage, uint16_t deepth)
-{
-    uint16_t i;
-
-    for(i=0; i<deepth; i++) {
-        AaSysLogPrint(LOGLEVEL_DBG, "voltage[%d] %f", i, voltage[i]);
-    }
-}
-
-static void SignalStrengthNotification(app_context_t *app_context)
+static bool SignalStrengthNotification(app_context_t *app_context)
 {
     bool ret;
+    bool changed = false;
     OSStatus err = kNoErr;
     LinkStatusTypeDef wifi_link_status;
     static int link_strength;
@@ -251,7 +198,7 @@ static void SignalStrengthNotification(app_context_t *app_context)
     err = micoWlanGetLinkStatus(&wifi_link_status);
     if(kNoErr != err){
       AaSysLogPrint(LOGLEVEL_ERR, "get link status err code(%d)", err);
-      return ;
+      return false;
     }
 
     // will never reach 100 percent, range from 0 to 5
@@ -264,9 +211,12 @@ static void SignalStrengthNotification(app_context_t *app_context)
 
     ret = false;
     if(IsSignalStrenghChanged()) {
+        changed = true;
         ret = SendJsonInt(app_context, "DEVICE-1/SignalStrength", GetSignalStrengh());
         AaSysLogPrint(LOGLEVEL_DBG, "SignalStrength change to %d with ret %s", GetSignalStrengh(), ret ? "true" : "false");
     }
+
+    return changed;
 }
 
 static void TemperatureNotification()
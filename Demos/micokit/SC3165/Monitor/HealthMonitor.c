@@ -25,7 +25,7 @@ History:
 
 typedef struct SputDownTimer_t {
     u8           index;
-    mico_timer_t timer;
+    SAaTimer     timer;
 } SMngTimer;
 
 
@@ -40,19 +40,16 @@ typedef struct SputDownTimer_t {
 #endif
 
 
-#define CHECK_CUPSTATUS_TIMEOUT   1000 //ms
-
 #define STACK_SIZE_HEALTH_THREAD    0x400
 
 
-mico_semaphore_t semaphore_getup;
-mico_semaphore_t semaphore_putdown;
-
 static SMngTimer putdown_timer[MAX_DEPTH_PUTDOWN];
 static SMngTimer schedule_timer[MAX_DEPTH_SCHEDULE];
 
 static mico_timer_t timer_health_notify;
 
+static bool health_ready = false;
+
 static mico_thread_t health_monitor_thread_handle = NULL;
 
 
@@ -62,6 +59,8 @@ extern SImmediate	gImmediate[MAX_DEPTH_IMMEDIATE];
 extern SSchedule	gSchedule[MAX_DEPTH_SCHEDULE];
 
 static void health_thread(void* arg);
+static void HandleCupStatus(app_context_t *app_context, EKey ot);
+static void CupStatusChanged(EKey status);
 static bool NoDisturbing();
 static bool IsPickupSetting();
 static OSStatus FindPickupTrack(u8 *type, u16 *track);
@@ -69,85 +68,94 @@ static bool IsPutDownSetting();
 static void startPutDownTimerGroup();
 static void PutdownTimeout(void* arg);
 //static void MOChangedNotification(void *arg);
+static void ScheduleArm(u8 index);
 static void ScheduleTimeout(void* arg);
 static void SendPlayReq(u8 t_type, u16 t_idx);
 static void SendQuitReq(void);
 
 
+static void HandleCupStatus(app_context_t *app_context, EKey ot)
+{
+    if(OUTERTRIGGER_PICKUP == ot) {
+        SetDrinkPutStatus(true);
+
+        if(IsDrinkPutStatusChanged()) {
+            // start the track first, the cloud report can wait
+            if(!NoDisturbing() && IsPickupSetting()) {
+                u8 type;
+                u16 track_id;
+                
+                FindPickupTrack(&type, &track_id);
+                AaSysLogPrint(LOGLEVEL_DBG, "track type %d index %d will be played", type, track_id);
+                // stop last track before play new song
+                SendQuitReq();
+                SendPlayReq(type, track_id);
+            }
+            SendJsonBool(app_context, "HEALTH-1/DrinkPutStatus", GetDrinkPutStatus());
+        }
+    }
+    else if(OUTERTRIGGER_PUTDOWN == ot) {
+        SetDrinkPutStatus(false);
+
+        if(IsDrinkPutStatusChanged()) {
+            SendJsonBool(app_context, "HEALTH-1/DrinkPutStatus", GetDrinkPutStatus());
+            if(!NoDisturbing() && IsPutDownSetting()) {
+                startPutDownTimerGroup();
+            }
+        }
+    }
+}
+
 static void health_thread(void* arg)
 {
     app_context_t *app_context = (app_context_t *)arg;
     user_log_trace();
-    EKey ot;
-
-#if 0
-    u8 cup_status_temp, cup_status;
+    void* msg_ptr;
+    SMsgHeader* msg;
+    ApiCupStatusInd* ind;
 
-    cup_status = cup_status_temp = KEY_getValue();
-#endif
-  
-    /* thread loop */
+    /* thread loop, sleeps until the cup is picked up or put down */
     while(1){
-#if 1
-        ot = GetOuterTriggerStatus();
-        if(OUTERTRIGGER_PICKUP == ot) {
-            SetDrinkPutStatus(true);
-
-            if(IsDrinkPutStatusChanged()) {
-                SendJsonBool(app_context, "HEALTH-1/DrinkPutStatus", GetDrinkPutStatus());
-                if(!NoDisturbing() && IsPickupSetting()) {
-                    u8 type;
-                    u16 track_id;
-                    
-                    FindPickupTrack(&type, &track_id);
-                    AaSysLogPrint(LOGLEVEL_DBG, "track type %d index %d will be played", type, track_id);
-                    // stop last track before play new song
-                    SendQuitReq();
-                    SendPlayReq(type, track_id);
-                }
-            }
+        msg_ptr = AaSysComReceiveHandler(MsgQueue_HealthHandler, MICO_WAIT_FOREVER);
+        if(msg_ptr == NULL) {
+            continue;
         }
-        else if(OUTERTRIGGER_PUTDOWN == ot) {
-            SetDrinkPutStatus(false);
-
-            if(IsDrinkPutStatusChanged()) {
-                SendJsonBool(app_context, "HEALTH-1/DrinkPutStatus", GetDrinkPutStatus());
-                if(!NoDisturbing() && IsPutDownSetting()) {
-                    startPutDownTimerGroup();
-                }
-            }
+        msg = (SMsgHeader*)msg_ptr;
+
+        switch(msg->msg_id) {
+            case API_MESSAGE_ID_CUPSTATUS_IND:
+                ind = AaSysComGetPayload(msg_ptr);
+                HandleCupStatus(app_context, (EKey)ind->status);
+                break;
+            case API_MESSAGE_ID_TIMER_IND:
+                // putdown and schedule reminders run here
+                AaTimerDispatch(msg_ptr);
+                break;
+            default:
+                AaSysLogPrint(LOGLEVEL_WRN, "no message id 0x%04x", msg->msg_id);
+                break;
         }
 
-        mico_thread_msleep(100);
-#elif
-        if(mico_rtos_get_semaphore(&semaphore_getup, CHECK_CUPSTATUS_TIMEOUT)) {
-            // key fliter
-            cup_status_temp = KEY_getValue();
-            if(cup_status != cup_status_temp) {
-                cup_status = cup_status_temp;
-                
-                SetDrinkStamp(true);
-                
-                if(!NoDisturbing() && IsPickupSetting()) {
-                    PlayingSong(FindPickupTrack());
-                }
-            }
-        }
+        AaSysComDestory(msg_ptr);
+    }
+}
 
-        if(mico_rtos_get_semaphore(&semaphore_putdown, CHECK_CUPSTATUS_TIMEOUT)) {
-            // key fliter
-            cup_status_temp = KEY_getValue();
-            if(cup_status != cup_status_temp) {
-                cup_status = cup_status_temp;
-                
-                SetPutDownStamp(true);
+// debounced outTrigger transition, timer context
+static void CupStatusChanged(EKey status)
+{
+    void* msg;
 
-                if(!NoDisturbing() && IsPutDownSetting()) {
-                    startPutDownTimerGroup();
-                }
-            }
-        }
-#endif
+    msg = AaSysComCreate(API_MESSAGE_ID_CUPSTATUS_IND, MsgQueue_HealthHandler, MsgQueue_HealthHandler, sizeof(ApiCupStatusInd));
+    if(msg == NULL) {
+        AaSysLogPrint(LOGLEVEL_ERR, "API_MESSAGE_ID_CUPSTATUS_IND create failed");
+        return ;
+    }
+
+    ApiCupStatusInd* ind = AaSysComGetPayload(msg);
+    ind->status = status;
+
+    if(kNoErr != AaSysComSend(msg)) {
+        AaSysLogPrint(LOGLEVEL_ERR, "API_MESSAGE_ID_CUPSTATUS_IND send failed");
     }
 }
 
@@ -158,38 +166,16 @@ OSStatus HealthInit(app_context_t *app_context)
     
     for(idx = 0; idx < MAX_DEPTH_PUTDOWN; idx++) {
         putdown_timer[idx].index = idx;
+        AaTimerSetup(&putdown_timer[idx].timer, MsgQueue_HealthHandler, PutdownTimeout, &putdown_timer[idx]);
     }
 
-    // check if schedule remind timneout every 1 minute
+    // each schedule is armed for its next remind time, nothing runs in between
     for(idx = 0; idx < MAX_DEPTH_SCHEDULE; idx++) {
         schedule_timer[idx].index = idx;
-        err = mico_init_timer(&schedule_timer[idx].timer, 60*UpTicksPerSecond(), ScheduleTimeout, &schedule_timer[idx]);
-        if(kNoErr != err) {
-            user_log("[ERR]HealthInit: create schedule_timer[%d] failed", idx);
-        }
-        else {
-            user_log("[DBG]HealthInit: create schedule_timer[%d] success", idx);
-        }
-
-        err = mico_start_timer(&schedule_timer[idx].timer);
-        if(kNoErr != err) {
-            user_log("[ERR]HealthInit: start schedule_timer[%d] failed", idx);
-        }
-        else {
-            user_log("[DBG]HealthInit: start schedule_timer[%d] success", idx);
-        }
+        AaTimerSetup(&schedule_timer[idx].timer, MsgQueue_HealthHandler, ScheduleTimeout, &schedule_timer[idx]);
+        ScheduleArm(idx);
     }
-
-#if 0
-    // initialize if outTrigger is implement by semaphore
-    err = mico_rtos_init_semaphore(&semaphore_getup, 1);
-    require_noerr_action(err, exit, user_log("[ERR]HealthInit: create semaphore_getup failed"));
-    user_log("[DBG]HealthInit: create semaphore_getup success");
-
-    err = mico_rtos_init_semaphore(&semaphore_putdown, 1);
-    require_noerr_action(err, exit, user_log("[ERR]HealthInit: create semaphore_putdown failed"));
-    user_log("[DBG]HealthInit: create semaphore_putdown success");
-#endif
+    health_ready = true;
 
 /*
     err = mico_init_timer(&timer_health_notify, 2*UpTicksPerSecond(), MOChangedNotification, app_context);
@@ -202,11 +188,15 @@ OSStatus HealthInit(app_context_t *app_context)
 */
 
     // start the health monitor thread
-    err = mico_rtos_create_thread(&health_monitor_thread_handle, MICO_APPLICATION_PRIORITY, "health_monitor", 
-                                  health_thread, STACK_SIZE_HEALTH_THREAD, 
-                                  app_context);
+    err = AaThreadCreate(&health_monitor_thread_handle, MICO_APPLICATION_PRIORITY, "health_monitor", 
+                         health_thread, STACK_SIZE_HEALTH_THREAD, 
+                         app_context);
     require_noerr_action( err, exit, user_log("[ERR]HealthInit: create health thread failed!"));
     user_log("[DBG]HealthInit: create health thread success!");
+
+    // cup events come from the outTrigger edge interrupt from now on
+    err = OuterTriggerStartDetect(CupStatusChanged);
+    require_noerr_action( err, exit, user_log("[ERR]HealthInit: start outTrigger detection failed!"));
     
 exit:
     return err;
@@ -307,17 +297,8 @@ static void startPutDownTimerGroup()
             SendPlayReq(type, track_id);
         }
         else {
-            // if another putdown action trigger, reset last timers
-            if(mico_is_timer_running(&putdown_timer[idx].timer)) {
-                mico_stop_timer(&putdown_timer[idx].timer);
-                mico_deinit_timer(&putdown_timer[idx].timer);
-            }
-            
-            mico_init_timer(&putdown_timer[idx].timer, 
-                            GetPutDownRemindDelay(idx)*60*UpTicksPerSecond(), 
-                            PutdownTimeout, 
-                            &putdown_timer[idx]);
-            mico_start_timer(&putdown_timer[idx].timer);
+            // if another putdown action trigger, the reminder starts over
+            AaTimerStart(&putdown_timer[idx].timer, GetPutDownRemindDelay(idx)*60*1000);
         }
     }
 }
@@ -326,8 +307,6 @@ static void PutdownTimeout(void* arg)
 {
     SMngTimer* mng = (SMngTimer*)arg;
 
-    mico_deinit_timer(&mng->timer);
-    
     // if this putdown tag is disable during timer timeout, do not need to play song
     if(GetPutDownEnable(mng->index)) {
         u8 type = GetPutDownTrackType(mng->index);
@@ -360,23 +339,40 @@ static void MOChangedNotification(void *arg)
 }
 */
 
+// Arm the schedule for the next time the clock shows its remind time
+static void ScheduleArm(u8 index)
+{
+    struct tm time;
+    int delay;
+
+    if(!GetScheduleEnable(index)) {
+        AaTimerStop(&schedule_timer[index].timer);
+        return ;
+    }
+
+    sntp_current_time_get(&time);
+    delay = (GetScheduleRemindHour(index)*60 + GetScheduleRemindMinute(index))*60
+            - (time.tm_hour*3600 + time.tm_min*60 + time.tm_sec);
+    if(delay <= 0) {
+        delay += 24*3600;
+    }
+
+    AaTimerStart(&schedule_timer[index].timer, delay*1000);
+}
+
 static void ScheduleTimeout(void* arg)
 {
     u8 times;
-    OSStatus err;
     struct tm time;
     SMngTimer* mng = (SMngTimer*)arg;
 
-    err = mico_reload_timer(&mng->timer);
-    if(err != kNoErr) {
-        user_log("[ERR]ScheduleTimeout: reload schedule[%d] failed", mng->index);
-    }
-
     u16 remind_time = GetScheduleRemindHour(mng->index)*60 + GetScheduleRemindMinute(mng->index);
     sntp_current_time_get(&time);
     u16 current_time = time.tm_hour*60 + time.tm_min;
 
-    if(current_time < remind_time) {
+    if(current_time != remind_time) {
+        // the clock was set since the timer was armed, aim again
+        ScheduleArm(mng->index);
         return ;
     }
 
@@ -388,6 +384,27 @@ static void ScheduleTimeout(void* arg)
         SendQuitReq();
         SendPlayReq(type, track_id);
     }
+
+    ScheduleArm(mng->index);
+}
+
+void HealthScheduleChanged(u8 index)
+{
+    if(health_ready && index < MAX_DEPTH_SCHEDULE) {
+        ScheduleArm(index);
+    }
+}
+
+void HealthClockChanged(void)
+{
+    u8 idx;
+
+    if(!health_ready) {
+        return ;
+    }
+    for(idx = 0; idx < MAX_DEPTH_SCHEDULE; idx++) {
+        ScheduleArm(idx);
+    }
 }
 
 static void SendPlayReq(u8 t_type, u16 t_idx)
@@ -21,6 +21,9 @@ History:
 
 
 OSStatus HealthInit(app_context_t *app_context);
+// re-arm reminders after a schedule is edited or the clock is set
+void HealthScheduleChanged(u8 index);
+void HealthClockChanged(void);
 
    
 #ifdef __cplusplus
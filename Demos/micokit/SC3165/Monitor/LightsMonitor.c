@@ -13,6 +13,7 @@ History:
 #include "If_MO.h"
 #include "led.h"
 #include "user_debug.h"
+#include "AaInclude.h"
 
 #ifdef DEBUG
   #define user_log(M, ...) custom_log("LightsMonitor", M, ##__VA_ARGS__)
@@ -34,24 +35,36 @@ enum {
 
 #define MAX_LIGHT   80
 
+// the colour cycle walks 3 x 1.6 s, 240 frames of the LED sequencer
+#define CYCLE_PERIOD_MS             4800
+#define FADE_MS                     500
+#define DISCONNECTED_BLINK_MS       3000
+
+#define DUTY_TO_COLOUR(d)           ((uint8_t)((u32)(d) * 255 / 100))
+
 #define STACK_SIZE_LIGHTS_THREAD    0x400
 
 
 static mico_thread_t lights_monitor_thread_handle = NULL;
+static mico_semaphore_t lights_event = NULL;
 
 
 static void lights_thread(void* arg);
 static void FlashSecond(uint8_t colour, uint16_t sec);
+static void FlashColour(uint8_t colour, led_effect_color_t* rgb);
 
 
 OSStatus LightsInit(app_context_t *app_context)
 {
     OSStatus err;
+
+    err = mico_rtos_init_semaphore(&lights_event, 1);
+    require_noerr_action( err, exit, user_log("[ERR]LightsInit: create lights event failed") );
     
     // start the lights monitor thread
-    err = mico_rtos_create_thread(&lights_monitor_thread_handle, MICO_APPLICATION_PRIORITY, "lights_monitor", 
-                                  lights_thread, STACK_SIZE_LIGHTS_THREAD, 
-                                  app_context );
+    err = AaThreadCreate(&lights_monitor_thread_handle, MICO_APPLICATION_PRIORITY, "lights_monitor", 
+                         lights_thread, STACK_SIZE_LIGHTS_THREAD, 
+                         app_context );
     require_noerr_action( err, exit, user_log("[ERR]LightsInit: create lights thread failed") );
     user_log("[DBG]LightsInit: create lights thread success");
 
@@ -59,96 +72,101 @@ exit:
     return err;
 }
 
+void LightsNotify(void)
+{
+    if(lights_event != NULL) {
+        mico_rtos_set_semaphore(&lights_event);
+    }
+}
+
+// the effect the light should play in the current state
+static void LightsEffect(app_context_t *app_context, led_effect_t* effect)
+{
+    memset(effect, 0x0, sizeof(led_effect_t));
+    effect->type = LED_EFFECT_SOLID;
+    effect->fade_ms = FADE_MS;
+
+    if(app_context->appStatus.fogcloudStatus.isCloudConnected != true) {
+        // blinks red until the cloud is back
+        effect->type = LED_EFFECT_BLINK;
+        effect->period_ms = DISCONNECTED_BLINK_MS;
+        effect->fade_ms = 0;
+        FlashColour(FLASH_RED, &effect->color);
+    }
+    else if(GetEnableNotifyLight()) {
+        effect->type = LED_EFFECT_CYCLE;
+        effect->period_ms = CYCLE_PERIOD_MS;
+        effect->color.red = DUTY_TO_COLOUR(MAX_LIGHT);
+        effect->color.green = DUTY_TO_COLOUR(MAX_LIGHT);
+        effect->color.blue = DUTY_TO_COLOUR(MAX_LIGHT);
+    }
+    else if(GetLedSwitch() == true) {
+        effect->color.red = DUTY_TO_COLOUR(GetRedConf());
+        effect->color.green = DUTY_TO_COLOUR(GetGreenConf());
+        effect->color.blue = DUTY_TO_COLOUR(GetBlueConf());
+    }
+}
+
 static void lights_thread(void* arg)
 {
     app_context_t *app_context = (app_context_t *)arg;
+    led_effect_t effect, shown;
+    bool started = false;
     user_log_trace();
 
-    static u8 led[3];
-    static u8 countup_led, countdown_led;
-
     if(app_context->appStatus.fogcloudStatus.isCloudConnected == true) {
         user_log("[DBG]lights_thread: could is connected");
         FlashSecond(FLASH_BLUE, 3);
     }
 
-    led[0] = MAX_LIGHT;
-    led[1] = 0;
-    led[2] = 0;
-    countdown_led = 0;
-    countup_led = countdown_led + 1;
-  
     /* thread loop */
     while(1){
-        if(app_context->appStatus.fogcloudStatus.isCloudConnected != true) {
-            user_log("[WRN]lights_thread: could disconnect");
-            FlashSecond(FLASH_RED, 1);
-            mico_thread_sleep(2);
-            continue;
-        }
-        
-        if(GetEnableNotifyLight()) {
-            LedDutyInit((float)led[0], (float)led[1], (float)led[2]);
-            LedPwmStart();
-//            user_log("[DBG]lights_thread: R(%d) G(%d) B(%d)", led[0], led[1], led[2]);
-
-            // type2
-            if(led[countdown_led] == 0 || led[countup_led] >= MAX_LIGHT) {
-                countdown_led++;
-                if(countdown_led >= 3) {
-                    countdown_led = 0;
-                }
-
-                countup_led = countdown_led + 1;
-                if(countup_led >= 3) {
-                    countup_led = 0;
-                }
+        LightsEffect(app_context, &effect);
+        if(!started || memcmp(&effect, &shown, sizeof(led_effect_t)) != 0) {
+            if(effect.type == LED_EFFECT_BLINK) {
+                user_log("[WRN]lights_thread: could disconnect");
             }
-            
-            led[countdown_led]--;
-            led[countup_led] = MAX_LIGHT - led[countdown_led];
+            started = (LedEffect(&effect) == kNoErr);
+            shown = effect;
+        }
 
-            // stay in this colour for a while
-            if(led[countup_led] % 10 == 0) {
-                mico_thread_msleep(200);
-            }
-            else {
-                mico_thread_msleep(100);
-            }
+        // the effect plays by itself, nothing to do until the configuration
+        // or the cloud state changes
+        if(app_context->appStatus.fogcloudStatus.isCloudConnected != true) {
+            mico_rtos_get_semaphore(&lights_event, 2000);
         }
         else {
-            if(GetLedSwitch() == true) {
-                LedDutyInit((float)GetRedConf(), (float)GetGreenConf(), (float)GetBlueConf());
-                LedPwmStart();
-            }
-            else {
-                LedPwmStop();
-            }
-
-            mico_thread_sleep(2);
+            mico_rtos_get_semaphore(&lights_event, MICO_WAIT_FOREVER);
         }
     }
 }
 
-static void FlashSecond(uint8_t colour, uint16_t sec)
+static void FlashColour(uint8_t colour, led_effect_color_t* rgb)
 {
-    uint16_t i;
-
-    for(i=0; i<sec; i++) {
-        LedPwmStop();
-        user_log("[DBG]FlashSecond: stop led");
-        mico_thread_msleep(500);
-        switch(colour) {
-            case FLASH_RED: LedDutyInit(100.0, 0, 0); break;
-            case FLASH_GREEN: LedDutyInit(0, 100.0, 0); break;
-            case FLASH_BLUE: LedDutyInit(0, 0, 100.0); break;
-        }
-        LedPwmStart();
-        user_log("[DBG]FlashSecond: startup led flash");
-        mico_thread_msleep(500);
+    memset(rgb, 0x0, sizeof(led_effect_color_t));
+    switch(colour) {
+        case FLASH_RED: rgb->red = 255; break;
+        case FLASH_GREEN: rgb->green = 255; break;
+        case FLASH_BLUE: rgb->blue = 255; break;
     }
+}
 
-    LedPwmStop();
+static void FlashSecond(uint8_t colour, uint16_t sec)
+{
+    led_effect_t effect;
+
+    memset(&effect, 0x0, sizeof(led_effect_t));
+    effect.type = LED_EFFECT_BLINK;
+    effect.period_ms = 1000;
+    effect.count = sec;
+    FlashColour(colour, &effect.color);
+
+    if(LedEffect(&effect) != kNoErr) {
+        user_log("[ERR]FlashSecond: start led flash failed");
+        return;
+    }
+    // the blink ends dark by itself
+    mico_thread_msleep(sec * 1000);
     user_log("[DBG]FlashSecond: finish led flash");
 }
 
@@ -22,6 +22,8 @@ History:
 
 
 OSStatus LightsInit(app_context_t *app_context);
+// wake the lights thread after the LED configuration or cloud state changed
+void LightsNotify(void);
 
    
 #ifdef __cplusplus
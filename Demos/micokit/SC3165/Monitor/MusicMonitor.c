@@ -64,9 +64,9 @@ OSStatus MusicInit(app_context_t *app_context)
     OSStatus err;
     
     // start the music monitor thread
-    err = mico_rtos_create_thread(&music_monitor_thread_handle, MICO_APPLICATION_PRIORITY, "MusicHandler", 
-                                  MusicHandler, STACK_SIZE_MUSIC_THREAD, 
-                                  app_context );
+    err = AaThreadCreate(&music_monitor_thread_handle, MICO_APPLICATION_PRIORITY, "MusicHandler", 
+                         MusicHandler, STACK_SIZE_MUSIC_THREAD, 
+                         app_context );
     require_noerr_action( err, exit, AaSysLogPrint(LOGLEVEL_ERR, "create music thread failed") );
     AaSysLogPrint(LOGLEVEL_INF, "create music thread success");
 
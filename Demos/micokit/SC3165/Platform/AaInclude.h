@@ -19,6 +19,10 @@ History:
 #include "AaSysCom.h"
 #include "AaSysLog.h"
 #include "ApiInternalMsg.h"
+#include "AaTimer.h"
+#include "AaPower.h"
+#include "AaThread.h"
+#include "AaProfiler.h"
 
    
 #ifdef __cplusplus
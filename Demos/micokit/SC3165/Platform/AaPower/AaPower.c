@@ -0,0 +1,180 @@
+
+
+
+/***
+
+History:
+2016-10-19: Create
+
+*/
+
+#include "AaPower.h"
+#include "AaSysLog.h"
+#ifdef MICO_CLI_ENABLE
+#include "command_console/mico_cli.h"
+#endif
+
+
+static struct {
+    mico_mutex_t    mutex;
+    bool            held[AaPowerUser_MAX];
+    u32             held_since[AaPowerUser_MAX];
+    u32             held_ms[AaPowerUser_MAX];     // completed holds since the last reset
+} power;
+
+static bool _aa_power_ready = false;
+
+static const char* const power_user_name[AaPowerUser_MAX] = {
+    "led",
+    "cli",
+};
+
+
+#ifdef MICO_CLI_ENABLE
+static void AaPowerCommand(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
+
+static const struct cli_command power_cmd = {
+    "power", "[reset | hold | release] MCU run/sleep/stop residency", AaPowerCommand
+};
+#endif
+
+
+OSStatus AaPowerInit(bool stop_enabled)
+{
+    OSStatus err;
+
+    if(_aa_power_ready) {
+        return kNoErr;
+    }
+
+    memset(&power, 0x0, sizeof(power));
+    err = mico_rtos_init_mutex(&power.mutex);
+    if(err != kNoErr) {
+        AaSysLogPrint(LOGLEVEL_ERR, "power manager initialize failed");
+        return err;
+    }
+    _aa_power_ready = true;
+
+    // enable is not counted by the platform, so only do it once
+    if(!stop_enabled) {
+        MicoMcuPowerSaveConfig(true);
+    }
+    MicoMcuPowerSaveGetStatistics(NULL, true);
+#ifdef MICO_CLI_ENABLE
+    cli_register_command(&power_cmd);
+#endif
+
+    AaSysLogPrint(LOGLEVEL_INF, "power manager initialize success");
+    return kNoErr;
+}
+
+void AaPowerHold(EAaPowerUser user)
+{
+    if(!_aa_power_ready || user >= AaPowerUser_MAX) {
+        return;
+    }
+
+    mico_rtos_lock_mutex(&power.mutex);
+    if(!power.held[user]) {
+        power.held[user] = true;
+        power.held_since[user] = mico_get_time();
+        MicoMcuPowerSaveConfig(false);
+    }
+    mico_rtos_unlock_mutex(&power.mutex);
+}
+
+void AaPowerRelease(EAaPowerUser user)
+{
+    if(!_aa_power_ready || user >= AaPowerUser_MAX) {
+        return;
+    }
+
+    mico_rtos_lock_mutex(&power.mutex);
+    if(power.held[user]) {
+        power.held[user] = false;
+        power.held_ms[user] += mico_get_time() - power.held_since[user];
+        MicoMcuPowerSaveConfig(true);
+    }
+    mico_rtos_unlock_mutex(&power.mutex);
+}
+
+#ifdef MICO_CLI_ENABLE
+static uint32_t Percent(uint32_t part, uint32_t total)
+{
+    return (total == 0) ? 0 : (uint32_t)((uint64_t)part * 100 / total);
+}
+
+static void AaPowerCommand(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv)
+{
+    mico_mcu_powersave_stats_t stats;
+    bool reset = false;
+    uint32_t now, held_ms, run_ms;
+    u8 user;
+
+    if(argc > 1) {
+        if(strcmp(argv[1], "hold") == 0) {
+            AaPowerHold(AaPowerUser_Cli);
+        }
+        else if(strcmp(argv[1], "release") == 0) {
+            AaPowerRelease(AaPowerUser_Cli);
+        }
+        else if(strcmp(argv[1], "reset") == 0) {
+            reset = true;
+        }
+        else {
+            cmd_printf("Usage: power [reset | hold | release]\r\n");
+            return;
+        }
+    }
+
+    if(MicoMcuPowerSaveGetStatistics(&stats, reset) != kNoErr) {
+        cmd_printf("power statistics not supported by this MCU\r\n");
+        return;
+    }
+
+    run_ms = stats.total_ms - stats.sleep_ms - stats.stop_ms;
+    if(cli_output_mode() == CLI_OUTPUT_TEXT) {
+        cmd_printf("total %10d ms\r\n", stats.total_ms);
+        cmd_printf("run   %10d ms %3d%%\r\n", run_ms, Percent(run_ms, stats.total_ms));
+        cmd_printf("sleep %10d ms %3d%%\r\n", stats.sleep_ms, Percent(stats.sleep_ms, stats.total_ms));
+        cmd_printf("stop  %10d ms %3d%%, %d entries\r\n", stats.stop_ms, Percent(stats.stop_ms, stats.total_ms), stats.stop_count);
+    }
+    else {
+        cli_record_start("power");
+        cli_record_uint("total_ms", stats.total_ms);
+        cli_record_uint("run_ms", run_ms);
+        cli_record_uint("sleep_ms", stats.sleep_ms);
+        cli_record_uint("stop_ms", stats.stop_ms);
+        cli_record_uint("stop_count", stats.stop_count);
+        cli_record_end();
+    }
+
+    mico_rtos_lock_mutex(&power.mutex);
+    now = mico_get_time();
+    for(user = 0; user < AaPowerUser_MAX; user++) {
+        held_ms = power.held_ms[user];
+        if(power.held[user]) {
+            held_ms += now - power.held_since[user];
+        }
+        if(cli_output_mode() == CLI_OUTPUT_TEXT) {
+            cmd_printf("hold %-5s %-4s %10d ms\r\n", power_user_name[user], power.held[user] ? "yes" : "no", held_ms);
+        }
+        else {
+            cli_record_start("power_hold");
+            cli_record_str("user", power_user_name[user]);
+            cli_record_uint("held", power.held[user]);
+            cli_record_uint("held_ms", held_ms);
+            cli_record_end();
+        }
+        if(reset) {
+            power.held_ms[user] = 0;
+            power.held_since[user] = now;
+        }
+    }
+    mico_rtos_unlock_mutex(&power.mutex);
+}
+#endif
+
+// end of file
+
+
@@ -0,0 +1,51 @@
+
+
+
+/***
+
+History:
+2016-10-19: Create
+
+*/
+
+#ifndef _AAPOWER_H_
+#define _AAPOWER_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+
+#include "AaPlatform.h"
+#include <stdbool.h>
+
+
+// The RTOS idle hook already sleeps until the earliest blocked thread times
+// out, so threads declare their next deadline simply by blocking with that
+// timeout, or forever when only events wake them. AaPower lets the MCU drop
+// into STOP mode during those sleeps and keeps it in run mode while a user
+// needs clocks that STOP mode halts, such as the LED PWM timers.
+
+typedef enum {
+    AaPowerUser_Led = 0,        // PWM output freezes in STOP mode
+    AaPowerUser_Cli,            // "power hold", for measuring against run mode
+    AaPowerUser_MAX
+} EAaPowerUser;
+
+
+// stop_enabled: the system already enabled MCU powersave from its config
+OSStatus AaPowerInit(bool stop_enabled);
+// holds are not counted, holding twice needs only one release
+void AaPowerHold(EAaPowerUser user);
+void AaPowerRelease(EAaPowerUser user);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _AAPOWER_H_
+
+// end of file
+
+
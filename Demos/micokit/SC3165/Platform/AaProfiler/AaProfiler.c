@@ -0,0 +1,692 @@
+
+
+
+/***
+
+History:
+2016-10-19: Create
+
+*/
+
+#include "AaProfiler.h"
+#include "AaSysLog.h"
+#include <string.h>
+#ifdef MICO_CLI_ENABLE
+#include "command_console/mico_cli.h"
+#endif
+
+
+// exported by the kernel in the mxchipWNet library but not declared by MiCO,
+// vTaskGetStackInfo() always writes 0 to its last argument
+extern void* xTaskGetCurrentTaskHandle(void);
+extern void vTaskGetStackInfo(void* task, u32** stack_base, u32** stack_top, u32* reserved);
+
+// where that kernel keeps the name in its task control block, vTaskList()
+// reads it from the same place
+#define AAPROFILER_TCB_NAME_OFFSET  0x34
+#define AAPROFILER_STACK_FILL       0xa5        // the kernel fills new stacks with it
+#define AAPROFILER_IDLE_NAME        "IDLE"
+
+#if defined(__ICCARM__)
+// the IAR runtime heap is dlmalloc
+extern void __iar_dlmalloc_inspect_all(void (*handler)(void* start, void* end, size_t used, void* arg), void* arg);
+#endif
+
+#define AAPROFILER_BLOCK_MAGIC      0xA10C
+
+// in front of every AaMalloc() block, 8 bytes keep the alignment of malloc()
+typedef struct {
+    u32     size;
+    u16     site;           // AAPROFILER_MAX_SITES when the table was full
+    u16     magic;
+} SAaProfilerBlock;
+
+// written by the tick hook, cleared by the period timer with interrupts off
+typedef struct {
+    void* volatile  task;
+    volatile u32    ticks;
+} SAaProfilerTick;
+
+typedef struct {
+    char    name[AAPROFILER_NAME_LEN];
+    u32     last_ticks;
+    u32     total_ticks;
+    u16     ticks[AAPROFILER_HISTORY];      // same slot as the sample
+} SAaProfilerRow;
+
+typedef struct {
+    mico_thread_t   thread;
+    const char*     name;
+    u32             stack_size;
+    u32             stack_free;
+} SAaProfilerThread;
+
+
+static struct {
+    mico_mutex_t        mutex;
+    mico_timer_t        timer;
+    u32                 last_time;
+    u32                 last_other;
+    u8                  head;               // slot of the next sample
+    u8                  count;
+    SAaProfilerRow      row[AAPROFILER_MAX_TASKS];
+    SAaProfilerSample   sample[AAPROFILER_HISTORY];
+} profiler;
+
+static bool _aa_profiler_ready = false;
+
+static SAaProfilerTick _tick[AAPROFILER_MAX_TASKS];
+static volatile u32 _tick_other = 0;
+static volatile bool _tick_enabled = false;
+
+// both under mico_rtos_suspend_all_thread(), they are filled before AaProfilerInit()
+static SAaProfilerThread _thread[AAPROFILER_MAX_TASKS];
+static SAaProfilerSite _site[AAPROFILER_MAX_SITES];
+
+
+#ifdef MICO_CLI_ENABLE
+static void AaProfilerCommand(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
+
+static const struct cli_command top_cmd = {
+    "top", "[history | sites] thread CPU and stack, heap and allocation sites", AaProfilerCommand
+};
+#endif
+
+
+// MICO platform hook, in the tick interrupt before the tick is counted
+void MicoSysTickHook(void)
+{
+    SAaProfilerTick* empty = NULL;
+    void* current;
+    u8 i;
+
+    if(!_tick_enabled) {
+        return;
+    }
+
+    current = xTaskGetCurrentTaskHandle();
+    for(i = 0; i < AAPROFILER_MAX_TASKS; i++) {
+        if(_tick[i].task == current) {
+            _tick[i].ticks++;
+            return;
+        }
+        if(_tick[i].task == NULL && empty == NULL) {
+            empty = &_tick[i];
+        }
+    }
+
+    if(empty != NULL) {
+        empty->ticks = 1;
+        empty->task = current;
+    }
+    else {
+        _tick_other++;
+    }
+}
+
+static SAaProfilerThread* AaProfilerFindThread(void* task)
+{
+    u8 i;
+
+    for(i = 0; i < AAPROFILER_MAX_TASKS; i++) {
+        if(_thread[i].thread != NULL && _thread[i].thread == task) {
+            return &_thread[i];
+        }
+    }
+    return NULL;
+}
+
+static void AaProfilerTaskName(void* task, char* name)
+{
+    const char* tcb_name = (const char*)task + AAPROFILER_TCB_NAME_OFFSET;
+    SAaProfilerThread* thread;
+    u8 i;
+
+    mico_rtos_suspend_all_thread();
+    thread = AaProfilerFindThread(task);
+    if(thread != NULL) {
+        strncpy(name, thread->name, AAPROFILER_NAME_LEN - 1);
+        name[AAPROFILER_NAME_LEN - 1] = '\0';
+    }
+    mico_rtos_resume_all_thread();
+    if(thread != NULL) {
+        return;
+    }
+
+    for(i = 0; i < AAPROFILER_NAME_LEN - 1 && tcb_name[i] != '\0'; i++) {
+        if(tcb_name[i] < ' ' || tcb_name[i] > '~') {
+            // not the layout this was written for, the handle still tells threads apart
+            snprintf(name, AAPROFILER_NAME_LEN, "%p", task);
+            return;
+        }
+        name[i] = tcb_name[i];
+    }
+    name[i] = '\0';
+}
+
+static void AaProfilerScanStacks(void)
+{
+    SAaProfilerThread* thread;
+    u32* base;
+    u32* top;
+    u32 reserved;
+    u8* p;
+    u8 i;
+
+    // nothing runs, so no registered thread is deleted under the scan
+    mico_rtos_suspend_all_thread();
+    for(i = 0; i < AAPROFILER_MAX_TASKS; i++) {
+        thread = &_thread[i];
+        if(thread->thread == NULL) {
+            continue;
+        }
+        vTaskGetStackInfo(thread->thread, &base, &top, &reserved);
+        // not a live stack, the thread ended without AaThreadDelete()
+        if(top <= base || (u32)((u8*)top - (u8*)base) > thread->stack_size) {
+            continue;
+        }
+        for(p = (u8*)base; p < (u8*)top && *p == AAPROFILER_STACK_FILL; p++);
+        if((u32)(p - (u8*)base) < thread->stack_free) {
+            thread->stack_free = (u32)(p - (u8*)base);
+        }
+    }
+    mico_rtos_resume_all_thread();
+}
+
+#if defined(__ICCARM__)
+typedef struct {
+    u32     free;
+    u32     largest;
+    u16     chunks;
+} SAaProfilerHeapWalk;
+
+static void AaProfilerHeapChunk(void* start, void* end, size_t used, void* arg)
+{
+    SAaProfilerHeapWalk* walk = (SAaProfilerHeapWalk*)arg;
+    u32 size = (u32)((u8*)end - (u8*)start);
+
+    if(used != 0) {
+        return;
+    }
+    walk->free += size;
+    walk->chunks++;
+    if(size > walk->largest) {
+        walk->largest = size;
+    }
+}
+#endif
+
+static void AaProfilerScanHeap(SAaProfilerSample* sample)
+{
+    micoMemInfo_t* info = MicoGetMemoryInfo();
+
+    sample->heap_total = info->total_memory;
+    sample->heap_free = info->free_memory;
+    sample->heap_largest = 0;
+    sample->heap_free_chunks = info->num_of_chunks;
+    sample->heap_fragmentation = 0;
+
+#if defined(__ICCARM__)
+    SAaProfilerHeapWalk walk = {0, 0, 0};
+
+    // dlmalloc does not lock the walk itself, no thread may allocate meanwhile
+    mico_rtos_suspend_all_thread();
+    __iar_dlmalloc_inspect_all(AaProfilerHeapChunk, &walk);
+    mico_rtos_resume_all_thread();
+
+    sample->heap_largest = walk.largest;
+    sample->heap_free_chunks = walk.chunks;
+    if(walk.free != 0) {
+        sample->heap_fragmentation = 100 - (u8)((uint64_t)walk.largest * 100 / walk.free);
+    }
+#endif
+}
+
+// a row that has not been ticked for the whole history goes to the next new
+// thread, unless a registered thread owns it
+static bool AaProfilerRowStale(u8 index, u32 ticks, u8 slot)
+{
+    SAaProfilerRow* row = &profiler.row[index];
+    u8 i;
+
+    if(ticks != row->last_ticks || AaProfilerFindThread(_tick[index].task) != NULL) {
+        return false;
+    }
+    for(i = 0; i < AAPROFILER_HISTORY; i++) {
+        if(i != slot && row->ticks[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void AaProfilerPeriod(void* arg)
+{
+    // static to spare the stack of the RTOS timer thread
+    static void* task[AAPROFILER_MAX_TASKS];
+    static u32 ticks[AAPROFILER_MAX_TASKS];
+    SAaProfilerSample sample;
+    SAaProfilerRow* row;
+    u32 now, other, delta;
+    u8 slot, i;
+
+    (void)arg;
+    memset(&sample, 0x0, sizeof(sample));
+    AaProfilerScanHeap(&sample);
+    AaProfilerScanStacks();
+
+    mico_rtos_lock_mutex(&profiler.mutex);
+    now = mico_get_time();
+    slot = profiler.head;
+
+    __disable_irq();
+    for(i = 0; i < AAPROFILER_MAX_TASKS; i++) {
+        task[i] = _tick[i].task;
+        ticks[i] = _tick[i].ticks;
+        if(task[i] != NULL && AaProfilerRowStale(i, ticks[i], slot)) {
+            _tick[i].task = NULL;
+            _tick[i].ticks = 0;
+            task[i] = NULL;
+            memset(&profiler.row[i], 0x0, sizeof(SAaProfilerRow));
+        }
+    }
+    other = _tick_other;
+    __enable_irq();
+
+    sample.time = now;
+    sample.period_ms = now - profiler.last_time;
+    sample.other_ticks = other - profiler.last_other;
+    sample.run_ticks = sample.other_ticks;
+    for(i = 0; i < AAPROFILER_MAX_TASKS; i++) {
+        row = &profiler.row[i];
+        if(task[i] == NULL) {
+            row->ticks[slot] = 0;
+            continue;
+        }
+        delta = ticks[i] - row->last_ticks;
+        row->last_ticks = ticks[i];
+        row->total_ticks += delta;
+        row->ticks[slot] = (delta > 0xFFFF) ? 0xFFFF : (u16)delta;
+        // handles are reused after a thread is deleted, so look again
+        if(delta != 0 || row->name[0] == '\0') {
+            AaProfilerTaskName(task[i], row->name);
+        }
+        sample.run_ticks += delta;
+        if(strcmp(row->name, AAPROFILER_IDLE_NAME) == 0) {
+            sample.idle_ticks += delta;
+        }
+    }
+
+    profiler.sample[slot] = sample;
+    profiler.head = (slot + 1) % AAPROFILER_HISTORY;
+    if(profiler.count < AAPROFILER_HISTORY) {
+        profiler.count++;
+    }
+    profiler.last_time = now;
+    profiler.last_other = other;
+    mico_rtos_unlock_mutex(&profiler.mutex);
+}
+
+OSStatus AaProfilerInit(void)
+{
+    OSStatus err;
+
+    if(_aa_profiler_ready) {
+        return kNoErr;
+    }
+
+    memset(&profiler, 0x0, sizeof(profiler));
+    err = mico_rtos_init_mutex(&profiler.mutex);
+    if(err == kNoErr) {
+        err = mico_init_timer(&profiler.timer, AAPROFILER_PERIOD_MS, AaProfilerPeriod, NULL);
+    }
+    if(err != kNoErr) {
+        AaSysLogPrint(LOGLEVEL_ERR, "profiler initialize failed");
+        return err;
+    }
+    _aa_profiler_ready = true;
+
+    profiler.last_time = mico_get_time();
+    _tick_enabled = true;
+    mico_start_timer(&profiler.timer);
+#ifdef MICO_CLI_ENABLE
+    cli_register_command(&top_cmd);
+#endif
+
+    AaSysLogPrint(LOGLEVEL_INF, "profiler initialize success");
+    return kNoErr;
+}
+
+void AaProfilerThreadAdd(mico_thread_t thread, const char* name, u32 stack_size)
+{
+    SAaProfilerThread* free_ptr = NULL;
+
+    if(thread == NULL) {
+        return;
+    }
+
+    mico_rtos_suspend_all_thread();
+    for(u8 i = 0; i < AAPROFILER_MAX_TASKS && free_ptr == NULL; i++) {
+        if(_thread[i].thread == NULL) {
+            free_ptr = &_thread[i];
+        }
+    }
+    if(free_ptr != NULL) {
+        free_ptr->thread = thread;
+        free_ptr->name = name;
+        free_ptr->stack_size = stack_size;
+        free_ptr->stack_free = stack_size;
+    }
+    mico_rtos_resume_all_thread();
+}
+
+void AaProfilerThreadRemove(mico_thread_t thread)
+{
+    SAaProfilerThread* find_ptr;
+
+    if(thread == NULL) {
+        return;
+    }
+
+    mico_rtos_suspend_all_thread();
+    find_ptr = AaProfilerFindThread(thread);
+    if(find_ptr != NULL) {
+        memset(find_ptr, 0x0, sizeof(SAaProfilerThread));
+    }
+    mico_rtos_resume_all_thread();
+}
+
+OSStatus AaProfilerGetSample(u8 age, SAaProfilerSample* sample)
+{
+    OSStatus err = kNotFoundErr;
+
+    if(!_aa_profiler_ready || sample == NULL) {
+        return kNotInitializedErr;
+    }
+
+    mico_rtos_lock_mutex(&profiler.mutex);
+    if(age < profiler.count) {
+        *sample = profiler.sample[(profiler.head + AAPROFILER_HISTORY - 1 - age) % AAPROFILER_HISTORY];
+        err = kNoErr;
+    }
+    mico_rtos_unlock_mutex(&profiler.mutex);
+    return err;
+}
+
+OSStatus AaProfilerGetTask(u8 index, SAaProfilerTask* task)
+{
+    SAaProfilerThread* thread;
+    SAaProfilerRow* row;
+    u8 i, last;
+
+    if(!_aa_profiler_ready || task == NULL) {
+        return kNotInitializedErr;
+    }
+
+    mico_rtos_lock_mutex(&profiler.mutex);
+    for(i = 0; i < AAPROFILER_MAX_TASKS; i++) {
+        if(profiler.row[i].name[0] != '\0' && index-- == 0) {
+            break;
+        }
+    }
+    if(i == AAPROFILER_MAX_TASKS) {
+        mico_rtos_unlock_mutex(&profiler.mutex);
+        return kNotFoundErr;
+    }
+
+    row = &profiler.row[i];
+    memset(task, 0x0, sizeof(SAaProfilerTask));
+    memcpy(task->name, row->name, AAPROFILER_NAME_LEN);
+    last = (profiler.head + AAPROFILER_HISTORY - 1) % AAPROFILER_HISTORY;
+    task->ticks = row->ticks[last];
+    for(i = 0; i < AAPROFILER_HISTORY; i++) {
+        task->window_ticks += row->ticks[i];
+    }
+    task->total_ticks = row->total_ticks;
+
+    mico_rtos_suspend_all_thread();
+    thread = AaProfilerFindThread(_tick[row - profiler.row].task);
+    if(thread != NULL) {
+        task->stack_size = thread->stack_size;
+        task->stack_free = thread->stack_free;
+    }
+    mico_rtos_resume_all_thread();
+    mico_rtos_unlock_mutex(&profiler.mutex);
+    return kNoErr;
+}
+
+OSStatus AaProfilerGetSite(u8 index, SAaProfilerSite* site)
+{
+    OSStatus err = kNotFoundErr;
+
+    if(site == NULL) {
+        return kParamErr;
+    }
+
+    mico_rtos_suspend_all_thread();
+    if(index < AAPROFILER_MAX_SITES && _site[index].file != NULL) {
+        *site = _site[index];
+        err = kNoErr;
+    }
+    mico_rtos_resume_all_thread();
+    return err;
+}
+
+void* AaProfilerMalloc(u32 size, const char* file, u16 line)
+{
+    SAaProfilerBlock* block = (SAaProfilerBlock*)malloc(sizeof(SAaProfilerBlock) + size);
+    SAaProfilerSite* site;
+    u8 i;
+
+    if(block == NULL) {
+        return NULL;
+    }
+    block->size = size;
+    block->site = AAPROFILER_MAX_SITES;
+    block->magic = AAPROFILER_BLOCK_MAGIC;
+
+    mico_rtos_suspend_all_thread();
+    for(i = 0; i < AAPROFILER_MAX_SITES; i++) {
+        site = &_site[i];
+        if(site->file == NULL) {
+            site->file = file;
+            site->line = line;
+        }
+        if(site->file == file && site->line == line) {
+            site->allocs++;
+            site->live_bytes += size;
+            if(site->live_bytes > site->peak_bytes) {
+                site->peak_bytes = site->live_bytes;
+            }
+            block->site = i;
+            break;
+        }
+    }
+    mico_rtos_resume_all_thread();
+
+    return block + 1;
+}
+
+void AaProfilerFree(void* ptr)
+{
+    SAaProfilerBlock* block;
+    SAaProfilerSite* site;
+
+    if(ptr == NULL) {
+        return;
+    }
+
+    block = (SAaProfilerBlock*)ptr - 1;
+    if(block->magic != AAPROFILER_BLOCK_MAGIC) {
+        // freed twice or not from AaMalloc(), leaking it is safer than freeing it
+        AaSysLogPrint(LOGLEVEL_ERR, "free of %p not allocated by AaMalloc", ptr);
+        return;
+    }
+    block->magic = 0;
+
+    if(block->site < AAPROFILER_MAX_SITES) {
+        site = &_site[block->site];
+        mico_rtos_suspend_all_thread();
+        site->frees++;
+        site->live_bytes -= block->size;
+        mico_rtos_resume_all_thread();
+    }
+    free(block);
+}
+
+#ifdef MICO_CLI_ENABLE
+// tenths of a percent
+static uint32_t Permille(uint32_t part, uint32_t total)
+{
+    return (total == 0) ? 0 : (uint32_t)((uint64_t)part * 1000 / total);
+}
+
+static const char* BaseName(const char* path)
+{
+    const char* name = path;
+
+    for(; *path != '\0'; path++) {
+        if(*path == '/' || *path == '\\') {
+            name = path + 1;
+        }
+    }
+    return name;
+}
+
+static void AaProfilerPrintTop(char *pcWriteBuffer, int xWriteBufferLen)
+{
+    SAaProfilerSample sample, old;
+    SAaProfilerTask task;
+    uint32_t window_ms = 0, busy, stop, now, win;
+    u8 i;
+
+    if(AaProfilerGetSample(0, &sample) != kNoErr) {
+        cmd_printf("no period closed yet, every %d ms\r\n", AAPROFILER_PERIOD_MS);
+        return;
+    }
+    for(i = 0; AaProfilerGetSample(i, &old) == kNoErr; i++) {
+        window_ms += old.period_ms;
+    }
+
+    if(cli_output_mode() == CLI_OUTPUT_TEXT) {
+        busy = Permille(sample.run_ticks - sample.idle_ticks, sample.period_ms);
+        stop = Permille(sample.period_ms - sample.run_ticks, sample.period_ms);
+        cmd_printf("period %d ms, busy %d.%d%%, stop %d.%d%%, other threads %d ms\r\n", sample.period_ms,
+                   busy / 10, busy % 10, stop / 10, stop % 10, sample.other_ticks);
+        cmd_printf("heap %d total, %d free, %d largest, %d%% fragmented, %d free chunks\r\n",
+                   sample.heap_total, sample.heap_free, sample.heap_largest,
+                   sample.heap_fragmentation, sample.heap_free_chunks);
+        cmd_printf("%-16s %6s %6s %s\r\n", "thread", "cpu%", "avg%", "stack free/size");
+    }
+    else {
+        cli_record_start("profile");
+        cli_record_uint("period_ms", sample.period_ms);
+        cli_record_uint("run_ms", sample.run_ticks);
+        cli_record_uint("idle_ms", sample.idle_ticks);
+        cli_record_uint("other_ms", sample.other_ticks);
+        cli_record_uint("window_ms", window_ms);
+        cli_record_uint("heap_total", sample.heap_total);
+        cli_record_uint("heap_free", sample.heap_free);
+        cli_record_uint("heap_largest", sample.heap_largest);
+        cli_record_uint("heap_free_chunks", sample.heap_free_chunks);
+        cli_record_uint("heap_fragmentation", sample.heap_fragmentation);
+        cli_record_end();
+    }
+
+    for(i = 0; AaProfilerGetTask(i, &task) == kNoErr; i++) {
+        if(cli_output_mode() == CLI_OUTPUT_TEXT) {
+            now = Permille(task.ticks, sample.period_ms);
+            win = Permille(task.window_ticks, window_ms);
+            if(task.stack_size != 0) {
+                cmd_printf("%-16s %4d.%d %4d.%d %6d/%d\r\n", task.name, now / 10, now % 10,
+                           win / 10, win % 10, task.stack_free, task.stack_size);
+            }
+            else {
+                cmd_printf("%-16s %4d.%d %4d.%d %6s\r\n", task.name, now / 10, now % 10,
+                           win / 10, win % 10, "-");
+            }
+        }
+        else {
+            cli_record_start("task");
+            cli_record_str("name", task.name);
+            cli_record_uint("ms", task.ticks);
+            cli_record_uint("window_ms", task.window_ticks);
+            cli_record_uint("total_ms", task.total_ticks);
+            cli_record_uint("stack_size", task.stack_size);
+            cli_record_uint("stack_free", task.stack_free);
+            cli_record_end();
+        }
+    }
+}
+
+static void AaProfilerPrintHistory(char *pcWriteBuffer, int xWriteBufferLen)
+{
+    SAaProfilerSample sample;
+    uint32_t busy;
+    u8 age;
+
+    for(age = 0; AaProfilerGetSample(age, &sample) == kNoErr; age++) {
+        if(cli_output_mode() == CLI_OUTPUT_TEXT) {
+            busy = Permille(sample.run_ticks - sample.idle_ticks, sample.period_ms);
+            cmd_printf("%10d ms busy %3d.%d%% run %5d ms heap free %6d largest %6d\r\n", sample.time,
+                       busy / 10, busy % 10, sample.run_ticks, sample.heap_free, sample.heap_largest);
+        }
+        else {
+            cli_record_start("sample");
+            cli_record_uint("time", sample.time);
+            cli_record_uint("period_ms", sample.period_ms);
+            cli_record_uint("run_ms", sample.run_ticks);
+            cli_record_uint("idle_ms", sample.idle_ticks);
+            cli_record_uint("heap_free", sample.heap_free);
+            cli_record_uint("heap_largest", sample.heap_largest);
+            cli_record_end();
+        }
+    }
+}
+
+static void AaProfilerPrintSites(char *pcWriteBuffer, int xWriteBufferLen)
+{
+    SAaProfilerSite site;
+    u8 i;
+
+    if(cli_output_mode() == CLI_OUTPUT_TEXT) {
+        cmd_printf("%-24s %8s %8s %8s %8s\r\n", "site", "allocs", "frees", "live", "peak");
+    }
+    for(i = 0; AaProfilerGetSite(i, &site) == kNoErr; i++) {
+        if(cli_output_mode() == CLI_OUTPUT_TEXT) {
+            cmd_printf("%18s:%-5d %8d %8d %8d %8d\r\n", BaseName(site.file), site.line,
+                       site.allocs, site.frees, site.live_bytes, site.peak_bytes);
+        }
+        else {
+            cli_record_start("site");
+            cli_record_str("file", BaseName(site.file));
+            cli_record_uint("line", site.line);
+            cli_record_uint("allocs", site.allocs);
+            cli_record_uint("frees", site.frees);
+            cli_record_uint("live", site.live_bytes);
+            cli_record_uint("peak", site.peak_bytes);
+            cli_record_end();
+        }
+    }
+}
+
+static void AaProfilerCommand(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv)
+{
+    if(argc == 1) {
+        AaProfilerPrintTop(pcWriteBuffer, xWriteBufferLen);
+    }
+    else if(strcmp(argv[1], "history") == 0) {
+        AaProfilerPrintHistory(pcWriteBuffer, xWriteBufferLen);
+    }
+    else if(strcmp(argv[1], "sites") == 0) {
+        AaProfilerPrintSites(pcWriteBuffer, xWriteBufferLen);
+    }
+    else {
+        cmd_printf("Usage: top [history | sites]\r\n");
+    }
+}
+#endif
+
+// end of file
+
+
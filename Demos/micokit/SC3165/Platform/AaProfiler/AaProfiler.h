@@ -0,0 +1,107 @@
+
+
+
+/***
+
+History:
+2016-10-19: Create
+
+*/
+
+#ifndef _AAPROFILER_H_
+#define _AAPROFILER_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+
+#include "AaPlatform.h"
+#include <stdbool.h>
+
+
+// Every RTOS tick MicoSysTickHook() counts one tick for the thread it
+// interrupted, so a thread's share of the ticks is its share of the CPU. A
+// RTOS timer closes a sampling period every AAPROFILER_PERIOD_MS: it takes
+// the tick counts, the lowest free stack of the threads AaThreadCreate()
+// registered and a walk of the heap, and keeps the last AAPROFILER_HISTORY
+// periods. One tick is one millisecond. No tick is counted while the MCU is
+// in STOP mode, so the part of a period without ticks is the time spent there.
+
+#define AAPROFILER_PERIOD_MS    5000
+#define AAPROFILER_HISTORY      12      // one minute
+#define AAPROFILER_MAX_TASKS    20      // ticks of further threads go to "other"
+#define AAPROFILER_MAX_SITES    16
+#define AAPROFILER_NAME_LEN     16
+
+// 1: AaMalloc()/AaFree() count allocations by call site, 8 bytes per block
+#ifndef AAPROFILER_MALLOC_SITES
+#define AAPROFILER_MALLOC_SITES 1
+#endif
+
+typedef struct {
+    char    name[AAPROFILER_NAME_LEN];
+    u32     ticks;          // last period
+    u32     window_ticks;   // periods in the history
+    u32     total_ticks;    // since AaProfilerInit()
+    u32     stack_size;     // bytes, 0 when the thread is not registered
+    u32     stack_free;     // lowest free stack seen, bytes
+} SAaProfilerTask;
+
+typedef struct {
+    u32     time;           // mico_get_time() when the period closed
+    u32     period_ms;
+    u32     run_ticks;      // ticks counted, the rest of the period was STOP mode
+    u32     idle_ticks;     // ticks of the RTOS idle thread
+    u32     other_ticks;    // ticks of threads beyond AAPROFILER_MAX_TASKS
+    u32     heap_total;
+    u32     heap_free;
+    u32     heap_largest;   // largest free block, 0 when the heap can not be walked
+    u16     heap_free_chunks;
+    u8      heap_fragmentation;     // % of the free heap outside the largest block
+} SAaProfilerSample;
+
+typedef struct {
+    const char*     file;
+    u16             line;
+    u32             allocs;
+    u32             frees;
+    u32             live_bytes;
+    u32             peak_bytes;
+} SAaProfilerSite;
+
+
+OSStatus AaProfilerInit(void);
+
+// called by AaThreadCreate()/AaThreadDelete(), work before AaProfilerInit()
+void AaProfilerThreadAdd(mico_thread_t thread, const char* name, u32 stack_size);
+void AaProfilerThreadRemove(mico_thread_t thread);
+
+// age 0 is the last period, kNotFoundErr past the history
+OSStatus AaProfilerGetSample(u8 age, SAaProfilerSample* sample);
+// index from 0 until kNotFoundErr, threads seen in the history only
+OSStatus AaProfilerGetTask(u8 index, SAaProfilerTask* task);
+OSStatus AaProfilerGetSite(u8 index, SAaProfilerSite* site);
+
+// a block from AaMalloc() goes back through AaFree() and nothing else
+void* AaProfilerMalloc(u32 size, const char* file, u16 line);
+void AaProfilerFree(void* ptr);
+
+#if AAPROFILER_MALLOC_SITES
+#define AaMalloc(size)      AaProfilerMalloc((size), __FILE__, __LINE__)
+#define AaFree(ptr)         AaProfilerFree(ptr)
+#else
+#define AaMalloc(size)      malloc(size)
+#define AaFree(ptr)         free(ptr)
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _AAPROFILER_H_
+
+// end of file
+
+
@@ -10,6 +10,7 @@ History:
 
 #include "AaSysCom.h"
 #include "AaSysLog.h"
+#include "AaProfiler.h"
 #include <stdbool.h>
 #include <string.h>
 #include "ApiInternalMsg.h"
@@ -64,7 +65,7 @@ void* AaSysComCreate(SAaSysComMsgId msgid, SAaSysComSicad sender, SAaSysComSicad
         return NULL;
     }
 
-    SMsgHeader* msg_ptr = malloc(sizeof(SMsgHeader) + pl_size);
+    SMsgHeader* msg_ptr = AaMalloc(sizeof(SMsgHeader) + pl_size);
     if(msg_ptr == NULL) {
         AaSysLogPrint(LOGLEVEL_ERR, "create message 0x%04x failed", msgid);
         return NULL;
@@ -123,7 +124,7 @@ OSStatus AaSysComSend(void* msg_ptr)
     if(kNoErr != mico_rtos_push_to_queue(&msg_queue[header.target], &header, MICO_WAIT_FOREVER)) {
         AaSysLogPrint(LOGLEVEL_ERR, "message 0x%04x send failed", header.msg_id);
 
-        if(msg_ptr != NULL) free(msg_ptr);
+        if(msg_ptr != NULL) AaFree(msg_ptr);
         return kInProgressErr;
     }
 
@@ -212,7 +213,7 @@ OSStatus AaSysComForward(void* msg_ptr, SAaSysComSicad sender, SAaSysComSicad re
 
     SMsgHeader* msg = (SMsgHeader*)msg_ptr;
 
-    SMsgHeader* msg_fw = malloc(sizeof(SMsgHeader) + msg->pl_size);
+    SMsgHeader* msg_fw = AaMalloc(sizeof(SMsgHeader) + msg->pl_size);
     if(msg_fw == NULL) {
         AaSysLogPrint(LOGLEVEL_ERR, "forward message 0x%04x failed", msg->msg_id);
         return kNoMemoryErr;
@@ -263,7 +264,7 @@ void* AaSysComReceiveHandler(SAaSysComSicad receiver, u32 timeout)
         }
 
         if(failed == true) {
-            if(header.body != NULL) free(header.body);
+            if(header.body != NULL) AaFree(header.body);
             return NULL;
         }
 
@@ -281,7 +282,7 @@ void* AaSysComReceiveHandler(SAaSysComSicad receiver, u32 timeout)
 
 OSStatus AaSysComDestory(void* msg_ptr)
 {
-    if(msg_ptr != NULL) free(msg_ptr);
+    if(msg_ptr != NULL) AaFree(msg_ptr);
     return kNoErr;
 }
 
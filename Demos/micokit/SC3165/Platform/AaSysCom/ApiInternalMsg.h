@@ -24,6 +24,7 @@ History:
 enum {
     API_MESSAGE_ID_NONE = 0x0000,
     // platform layer
+    API_MESSAGE_ID_TIMER_IND = 0x1001,
     
     // application layer
     API_MESSAGE_ID_TFSTATUS_REQ = 0x2001,
@@ -57,11 +58,19 @@ enum {
     API_MESSAGE_ID_PAUSE_RESP,
 
     API_MESSAGE_ID_TRACKLIST_REQ,
+
+    API_MESSAGE_ID_CUPSTATUS_IND,
     
     API_MESSAGE_ID_MAX = 0xFFFF,
 };
 
 
+// API_MESSAGE_ID_TIMER_IND
+typedef struct ApiTimerInd_t {
+    void*   timer;          // SAaTimer
+    u32     generation;
+} ApiTimerInd;
+
 // API_MESSAGE_ID_TFSTATUS_REQ
 typedef struct ApiTfStatusReq_t {
     u16 reserve;
@@ -177,6 +186,11 @@ typedef struct {
     u8 reserve;
 } ApiTrackListReq;
 
+// API_MESSAGE_ID_CUPSTATUS_IND
+typedef struct {
+    u8 status;      // EKey, OUTERTRIGGER_PICKUP or OUTERTRIGGER_PUTDOWN
+} ApiCupStatusInd;
+
 
 
 #ifdef __cplusplus
@@ -9,18 +9,503 @@ History:
 */
 
 #include "AaSyslog.h"
+#include <stdarg.h>
+#include <string.h>
 
 
 uint8_t _syslog_level = LOGLEVEL_ALL;
 
 
+#if AASYSLOG_DEFERRED
+
+// number of records buffered between AaSysLogPrint and the drain thread
+#define AASYSLOG_RECORDS            32
+
+// argument bytes per record, larger argument lists are cut short
+#define AASYSLOG_PAYLOAD_SIZE       32
+
+#define AASYSLOG_LINE_LENGTH        160
+
+#define STACK_SIZE_SYSLOG_THREAD    0x500
+
+// %s arguments inside the firmware image outlive any record and are kept
+// as pointers, anything else (RAM, stack) is copied into the record
+#ifndef AASYSLOG_ROM_START
+#define AASYSLOG_ROM_START          0x08000000UL
+#endif
+#ifndef AASYSLOG_ROM_END
+#define AASYSLOG_ROM_END            0x08100000UL
+#endif
+
+#define AASYSLOG_IN_ROM(p)          ((u32)(p) >= AASYSLOG_ROM_START && (u32)(p) < AASYSLOG_ROM_END)
+
+// first payload byte of a %s argument
+#define LOGSTR_POINTER              0
+#define LOGSTR_COPY                 1
+
+// last character of a copied string that was cut short
+#define LOGSTR_CUT_MARK             '~'
+
+
+typedef enum {
+    LOGARG_INT = 0,
+    LOGARG_LONG,
+    LOGARG_LONGLONG,
+    LOGARG_DOUBLE,
+    LOGARG_STRING,
+    LOGARG_POINTER,
+} ELogArg;
+
+typedef struct SLogRecord_t {
+    const char*     fmt;
+    const char*     file;
+    u32             time;
+    u16             line;
+    u8              level;
+    u8              size;           // payload bytes used
+    volatile u8     ready;          // set by the writer once the record is complete
+    u8              payload[AASYSLOG_PAYLOAD_SIZE];
+} SLogRecord;
+
+
+static SLogRecord _log_ring[AASYSLOG_RECORDS];
+
+// _log_tail is claimed by writers with interrupts off, _log_head is only
+// moved by the drain thread. Both count records and wrap freely.
+static volatile u32 _log_head = 0;
+static volatile u32 _log_tail = 0;
+
+static volatile u32 _log_dropped = 0;
+static u32 _log_dropped_reported = 0;
+static u32 _log_emitted = 0;
+
+static EAaSysLogMode _log_mode = AASYSLOG_MODE_TEXT;
+static mico_thread_t _log_thread = NULL;
+// set by writers once a record is ready or dropped, the drain thread sleeps on it
+static mico_semaphore_t _log_event = NULL;
+
+static const char* const _log_level_name[] = { "NC", "ERR", "WRN", "INF", "DBG", "NC" };
+
+
+// Find the next conversion in fmt. Returns the character after it, or NULL
+// at the end of the string or on a conversion the logger cannot carry.
+static const char* AaSysLogNextSpec(const char* p, const char** spec, ELogArg* type)
+{
+    u8 longs = 0;
+
+    while(*p != '\0') {
+        if(*p++ != '%') continue;
+        if(*p == '%') {
+            p++;
+            continue;
+        }
+
+        *spec = p - 1;
+        while(*p != '\0' && strchr("-+ #0123456789.", *p) != NULL) p++;
+        while(*p == 'l') {
+            longs++;
+            p++;
+        }
+        while(*p != '\0' && strchr("hzjt", *p) != NULL) p++;
+
+        switch(*p) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                *type = (longs >= 2) ? LOGARG_LONGLONG : (longs == 1) ? LOGARG_LONG : LOGARG_INT;
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                *type = LOGARG_DOUBLE;
+                break;
+            case 's':
+                *type = LOGARG_STRING;
+                break;
+            case 'p':
+                *type = LOGARG_POINTER;
+                break;
+            default:
+                return NULL;
+        }
+        return p + 1;
+    }
+
+    return NULL;
+}
+
+// Copy the arguments named by fmt into out, returns the bytes used
+static u8 AaSysLogPackArgs(u8* out, const char* fmt, va_list ap)
+{
+    const char* spec;
+    ELogArg type;
+    u32 n = 0;
+    u32 len;
+    u32 cut;
+
+    while((fmt = AaSysLogNextSpec(fmt, &spec, &type)) != NULL) {
+        switch(type) {
+            case LOGARG_INT: {
+                int v = va_arg(ap, int);
+                if(n + sizeof(v) > AASYSLOG_PAYLOAD_SIZE) return n;
+                memcpy(out + n, &v, sizeof(v));
+                n += sizeof(v);
+                break;
+            }
+            case LOGARG_LONG: {
+                long v = va_arg(ap, long);
+                if(n + sizeof(v) > AASYSLOG_PAYLOAD_SIZE) return n;
+                memcpy(out + n, &v, sizeof(v));
+                n += sizeof(v);
+                break;
+            }
+            case LOGARG_LONGLONG: {
+                long long v = va_arg(ap, long long);
+                if(n + sizeof(v) > AASYSLOG_PAYLOAD_SIZE) return n;
+                memcpy(out + n, &v, sizeof(v));
+                n += sizeof(v);
+                break;
+            }
+            case LOGARG_DOUBLE: {
+                double v = va_arg(ap, double);
+                if(n + sizeof(v) > AASYSLOG_PAYLOAD_SIZE) return n;
+                memcpy(out + n, &v, sizeof(v));
+                n += sizeof(v);
+                break;
+            }
+            case LOGARG_POINTER: {
+                void* v = va_arg(ap, void*);
+                if(n + sizeof(v) > AASYSLOG_PAYLOAD_SIZE) return n;
+                memcpy(out + n, &v, sizeof(v));
+                n += sizeof(v);
+                break;
+            }
+            case LOGARG_STRING: {
+                const char* v = va_arg(ap, const char*);
+                if(v == NULL) v = "(null)";
+                if(AASYSLOG_IN_ROM(v)) {
+                    if(n + 1 + sizeof(v) > AASYSLOG_PAYLOAD_SIZE) return n;
+                    out[n++] = LOGSTR_POINTER;
+                    memcpy(out + n, &v, sizeof(v));
+                    n += sizeof(v);
+                    break;
+                }
+
+                // the caller's string may not outlive the record, keep a copy
+                if(n + 2 >= AASYSLOG_PAYLOAD_SIZE) return n;
+                out[n++] = LOGSTR_COPY;
+                // at most half the record, so later arguments still fit
+                len = strlen(v);
+                cut = len;
+                if(cut > AASYSLOG_PAYLOAD_SIZE / 2 - 1) cut = AASYSLOG_PAYLOAD_SIZE / 2 - 1;
+                if(cut > AASYSLOG_PAYLOAD_SIZE - n - 1) cut = AASYSLOG_PAYLOAD_SIZE - n - 1;
+                memcpy(out + n, v, cut);
+                if(cut < len) out[n + cut - 1] = LOGSTR_CUT_MARK;
+                out[n + cut] = '\0';
+                n += cut + 1;
+                break;
+            }
+        }
+    }
+
+    return n;
+}
+
+// Expand a record's format string with its packed arguments
+static u32 AaSysLogFormatArgs(char* buf, u32 size, const SLogRecord* rec)
+{
+    const char* p = rec->fmt;
+    const char* next;
+    const char* spec;
+    ELogArg type;
+    char spec_buf[16];
+    u32 off = 0;
+    u32 n = 0;
+    int r;
+
+    while(n + 1 < size) {
+        next = AaSysLogNextSpec(p, &spec, &type);
+
+        // literal text up to the conversion, "%%" prints as '%'
+        while(*p != '\0' && (next == NULL || p < spec) && n + 1 < size) {
+            if(p[0] == '%' && p[1] == '%') p++;
+            buf[n++] = *p++;
+        }
+        if(next == NULL || n + 1 >= size) break;
+
+        if((u32)(next - spec) >= sizeof(spec_buf)) break;
+        memcpy(spec_buf, spec, next - spec);
+        spec_buf[next - spec] = '\0';
+        p = next;
+
+        r = -1;
+        switch(type) {
+            case LOGARG_INT: {
+                int v;
+                if(off + sizeof(v) > rec->size) break;
+                memcpy(&v, rec->payload + off, sizeof(v));
+                off += sizeof(v);
+                r = snprintf(buf + n, size - n, spec_buf, v);
+                break;
+            }
+            case LOGARG_LONG: {
+                long v;
+                if(off + sizeof(v) > rec->size) break;
+                memcpy(&v, rec->payload + off, sizeof(v));
+                off += sizeof(v);
+                r = snprintf(buf + n, size - n, spec_buf, v);
+                break;
+            }
+            case LOGARG_LONGLONG: {
+                long long v;
+                if(off + sizeof(v) > rec->size) break;
+                memcpy(&v, rec->payload + off, sizeof(v));
+                off += sizeof(v);
+                r = snprintf(buf + n, size - n, spec_buf, v);
+                break;
+            }
+            case LOGARG_DOUBLE: {
+                double v;
+                if(off + sizeof(v) > rec->size) break;
+                memcpy(&v, rec->payload + off, sizeof(v));
+                off += sizeof(v);
+                r = snprintf(buf + n, size - n, spec_buf, v);
+                break;
+            }
+            case LOGARG_POINTER: {
+                void* v;
+                if(off + sizeof(v) > rec->size) break;
+                memcpy(&v, rec->payload + off, sizeof(v));
+                off += sizeof(v);
+                r = snprintf(buf + n, size - n, spec_buf, v);
+                break;
+            }
+            case LOGARG_STRING: {
+                const char* v;
+                if(off >= rec->size) break;
+                if(rec->payload[off++] == LOGSTR_POINTER) {
+                    if(off + sizeof(v) > rec->size) break;
+                    memcpy(&v, rec->payload + off, sizeof(v));
+                    off += sizeof(v);
+                } else {
+                    if(off >= rec->size) break;
+                    v = (const char*)rec->payload + off;
+                    off += strlen(v) + 1;
+                }
+                r = snprintf(buf + n, size - n, spec_buf, v);
+                break;
+            }
+        }
+
+        // arguments that did not fit in the record
+        if(r < 0) r = snprintf(buf + n, size - n, "<?>");
+        n += r;
+        if(n >= size) n = size - 1;
+    }
+
+    buf[n] = '\0';
+    return n;
+}
+
+static void AaSysLogEmitText(const SLogRecord* rec)
+{
+    char line[AASYSLOG_LINE_LENGTH];
+    const char* file = rec->file;
+    const char* p;
+    u32 n;
+
+    if((p = strrchr(file, '\\')) != NULL) file = p + 1;
+    if((p = strrchr(file, '/')) != NULL) file = p + 1;
+
+    n = snprintf(line, sizeof(line) - 2, "[%lu][%s][%s:%4d] ", (unsigned long)rec->time,
+                 _log_level_name[rec->level < LOGLEVEL_ALL ? rec->level : LOGLEVEL_ALL], file, rec->line);
+    if(n > sizeof(line) - 3) n = sizeof(line) - 3;
+    n += AaSysLogFormatArgs(line + n, sizeof(line) - 2 - n, rec);
+    line[n++] = '\r';
+    line[n++] = '\n';
+
+    mico_rtos_lock_mutex( &stdio_tx_mutex );
+    MicoUartSendAsync( STDIO_UART, line, n, NULL, NULL );
+    mico_rtos_unlock_mutex( &stdio_tx_mutex );
+}
+
+static void AaSysLogEmitBinary(const SLogRecord* rec, u16 seq)
+{
+    u8 frame[sizeof(SAaSysLogFrame) + AASYSLOG_PAYLOAD_SIZE];
+    SAaSysLogFrame* hdr = (SAaSysLogFrame*)frame;
+
+    hdr->sync[0] = 0xA5;
+    hdr->sync[1] = 0x5A;
+    hdr->level = rec->level;
+    hdr->size = rec->size;
+    hdr->time = rec->time;
+    hdr->fmt = (u32)rec->fmt;
+    hdr->file = (u32)rec->file;
+    hdr->line = rec->line;
+    hdr->seq = seq;
+    memcpy(frame + sizeof(SAaSysLogFrame), rec->payload, rec->size);
+
+    mico_rtos_lock_mutex( &stdio_tx_mutex );
+    MicoUartSendAsync( STDIO_UART, frame, sizeof(SAaSysLogFrame) + rec->size, NULL, NULL );
+    mico_rtos_unlock_mutex( &stdio_tx_mutex );
+}
+
+static void AaSysLogReportDropped(void)
+{
+    SLogRecord rec;
+    u32 dropped = _log_dropped - _log_dropped_reported;
+    unsigned long count = dropped;
+
+    if(dropped == 0) return;
+    _log_dropped_reported += dropped;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.time = mico_get_time();
+    if(_log_mode == AASYSLOG_MODE_BINARY) {
+        rec.size = sizeof(dropped);
+        memcpy(rec.payload, &dropped, sizeof(dropped));
+        AaSysLogEmitBinary(&rec, (u16)_log_head);
+    } else {
+        rec.fmt = "%lu log records dropped";
+        rec.file = __FILE__;
+        rec.line = __LINE__;
+        rec.level = LOGLEVEL_WRN;
+        rec.size = sizeof(count);
+        memcpy(rec.payload, &count, sizeof(count));
+        AaSysLogEmitText(&rec);
+    }
+}
+
+static void AaSysLogDrainThread(void* arg)
+{
+    SLogRecord* rec;
+
+    UNUSED_PARAMETER(arg);
+
+    while(1) {
+        AaSysLogReportDropped();
+
+        // a writer may have claimed the slot but not finished filling it
+        rec = &_log_ring[_log_head % AASYSLOG_RECORDS];
+        if(_log_head == _log_tail || !rec->ready) {
+            mico_rtos_get_semaphore(&_log_event, MICO_WAIT_FOREVER);
+            continue;
+        }
+
+        if(_log_mode == AASYSLOG_MODE_BINARY) {
+            AaSysLogEmitBinary(rec, (u16)_log_head);
+        } else {
+            AaSysLogEmitText(rec);
+        }
+
+        rec->ready = 0;
+        _log_head++;
+        _log_emitted++;
+    }
+}
+
+
 void AaSysLogInit(void)
 {
+    OSStatus err;
 
+    if(_log_thread != NULL) return;
+
+    if(_log_event == NULL) {
+        err = mico_rtos_init_semaphore(&_log_event, 1);
+        if(err != kNoErr) {
+            _log_event = NULL;
+            printf("[AaSysLog] create drain semaphore failed %d\r\n", err);
+            return;
+        }
+    }
+
+    // one below the application threads, logging never delays them
+    err = mico_rtos_create_thread(&_log_thread, MICO_APPLICATION_PRIORITY + 1, "AaSysLog",
+                                  AaSysLogDrainThread, STACK_SIZE_SYSLOG_THREAD, NULL);
+    if(err != kNoErr) {
+        _log_thread = NULL;
+        printf("[AaSysLog] create drain thread failed %d\r\n", err);
+    }
 }
 
+void AaSysLogWrite(u8 level, const char* file, u16 line, const char* fmt, ...)
+{
+    SLogRecord* rec;
+    va_list ap;
+    u32 slot;
+
+    DISABLE_INTERRUPTS;
+    if(_log_tail - _log_head >= AASYSLOG_RECORDS) {
+        _log_dropped++;
+        ENABLE_INTERRUPTS;
+        if(_log_event != NULL) mico_rtos_set_semaphore(&_log_event);
+        return;
+    }
+    slot = _log_tail++;
+    ENABLE_INTERRUPTS;
 
+    rec = &_log_ring[slot % AASYSLOG_RECORDS];
+    rec->fmt = fmt;
+    rec->file = file;
+    rec->line = line;
+    rec->level = level;
+    rec->time = mico_get_time();
 
-// end of file
+    va_start(ap, fmt);
+    rec->size = AaSysLogPackArgs(rec->payload, fmt, ap);
+    va_end(ap);
+
+    rec->ready = 1;
+    // safe from interrupts, records written before AaSysLogInit are drained when it starts
+    if(_log_event != NULL) mico_rtos_set_semaphore(&_log_event);
+}
+
+void AaSysLogSetMode(EAaSysLogMode mode)
+{
+    _log_mode = mode;
+}
+
+void AaSysLogGetStats(SAaSysLogStats* stats)
+{
+    if(stats == NULL) return;
 
+    stats->dropped = _log_dropped;
+    stats->emitted = _log_emitted;
+    stats->written = _log_tail;
+}
 
+#else
+
+void AaSysLogInit(void)
+{
+
+}
+
+void AaSysLogWrite(u8 level, const char* file, u16 line, const char* fmt, ...)
+{
+    va_list ap;
+
+    mico_rtos_lock_mutex( &stdio_tx_mutex );
+    printf("[%d][%s][%s:%4d] ", mico_get_time(), level == LOGLEVEL_ERR ? "ERR" : level == LOGLEVEL_WRN ? "WRN" :
+           level == LOGLEVEL_INF ? "INF" : level == LOGLEVEL_DBG ? "DBG" : "NC", file, line);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\r\n");
+    mico_rtos_unlock_mutex( &stdio_tx_mutex );
+}
+
+void AaSysLogSetMode(EAaSysLogMode mode)
+{
+    UNUSED_PARAMETER(mode);
+}
+
+void AaSysLogGetStats(SAaSysLogStats* stats)
+{
+    if(stats == NULL) return;
+
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif
+
+
+
+// end of file
@@ -29,10 +29,58 @@ enum {
 };
 
 
+// 1: AaSysLogPrint only records the format string and arguments, a low
+// priority thread formats and prints them later. 0: print on the caller.
+#ifndef AASYSLOG_DEFERRED
+#define AASYSLOG_DEFERRED   1
+#endif
+
+typedef enum {
+    AASYSLOG_MODE_TEXT = 0,     // formatted lines, same layout as before
+    AASYSLOG_MODE_BINARY,       // raw SAaSysLogFrame records for a host decoder
+} EAaSysLogMode;
+
+// Binary mode frame, followed by 'size' bytes of packed arguments: 32 bit
+// for integers and pointers, 64 bit for long long and double. A string
+// starts with a tag byte: 0 and a 32 bit address for strings in the
+// firmware image, 1 and a copy with its terminating NUL for strings in RAM;
+// a copy that was cut short ends in '~'. fmt, file and string addresses are
+// in the firmware image and are resolved from the ELF file on the host. A frame
+// with fmt == 0 carries the u32 number of records dropped since the last one.
+#pragma pack(1)
+typedef struct SAaSysLogFrame_t {
+    u8      sync[2];            // 0xA5 0x5A
+    u8      level;
+    u8      size;
+    u32     time;
+    u32     fmt;
+    u32     file;
+    u16     line;
+    u16     seq;                // gaps show dropped records
+} SAaSysLogFrame;
+#pragma pack()
+
+typedef struct SAaSysLogStats_t {
+    u32     written;            // records queued by AaSysLogPrint
+    u32     dropped;            // records lost because the buffer was full
+    u32     emitted;            // records printed by the drain thread
+} SAaSysLogStats;
+
+
 extern mico_mutex_t stdio_tx_mutex;
 extern uint8_t _syslog_level;
 
 
+#if AASYSLOG_DEFERRED
+
+// M must be a string literal, it is read again when the record is printed
+#define AaSysLogPrint(level, M, ...) do { \
+                                    if(level > _syslog_level) break; \
+                                    AaSysLogWrite(level, __FILE__, __LINE__, "" M, ##__VA_ARGS__); \
+                                } while(0)
+
+#else
+
 #define AaSysLogPrint(level, M, ...) do { \
                                     if(level > _syslog_level) break; \
                                     mico_rtos_lock_mutex( &stdio_tx_mutex ); \
@@ -48,8 +96,13 @@ extern uint8_t _syslog_level;
                                     mico_rtos_unlock_mutex( &stdio_tx_mutex ); \
                                 } while(0)
 
+#endif
+
 
 void AaSysLogInit(void);
+void AaSysLogWrite(u8 level, const char* file, u16 line, const char* fmt, ...);
+void AaSysLogSetMode(EAaSysLogMode mode);
+void AaSysLogGetStats(SAaSysLogStats* stats);
 
    
 #ifdef __cplusplus
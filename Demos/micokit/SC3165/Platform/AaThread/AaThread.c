@@ -10,6 +10,7 @@ History:
 
 #include "AaThread.h"
 #include "AaSysLog.h"
+#include "AaProfiler.h"
 
 
 #ifdef DEBUG
@@ -44,14 +45,14 @@ OSStatus AaThreadCreate(mico_thread_t* thread,
                             uint32_t stack_size, 
                             void* arg)
 {
-    SAaThread* thread_ptr = (SAaThread*)malloc(sizeof(SAaThread));
+    SAaThread* thread_ptr = (SAaThread*)AaMalloc(sizeof(SAaThread));
     if(thread_ptr == NULL) {
         return kNoMemoryErr;
     }
     
     OSStatus err = mico_rtos_create_thread(thread, priority, name, function, stack_size, arg);
     if(err != kNoErr) {
-        if(thread_ptr != NULL) free(thread_ptr);
+        if(thread_ptr != NULL) AaFree(thread_ptr);
         return kGeneralErr;
     }
 
@@ -59,6 +60,7 @@ OSStatus AaThreadCreate(mico_thread_t* thread,
     thread_ptr->name = name;
     thread_ptr->tid = _aa_thread_id++;
     thread_ptr->next = NULL;
+    AaProfilerThreadAdd(*thread, name, stack_size);
 
     SAaThread* find_ptr = _aa_thread_list;
     if(find_ptr == NULL) {
@@ -77,38 +79,31 @@ OSStatus AaThreadCreate(mico_thread_t* thread,
 
 OSStatus AaThreadDelete(mico_thread_t* thread)
 {
-    OSStatus err = mico_rtos_delete_thread(thread);
-
     SAaThread* prev_ptr = NULL;
     SAaThread* find_ptr = _aa_thread_list;
-    
-    if(find_ptr == NULL) return kGeneralErr;
-    
-    if(*(find_ptr->thread) == *thread) {
-        _aa_thread_list = find_ptr->next;
-        free(find_ptr);
-    }
-    else {
-        do {
-            prev_ptr = find_ptr;
-            find_ptr = find_ptr->next;
-        } while(*(find_ptr->thread) != *thread && find_ptr != NULL);
+    bool found = false;
 
-        if(find_ptr == NULL) {
-            return kGeneralErr;
-        }
+    // unlink first, a thread deleting itself does not come back
+    AaProfilerThreadRemove(*thread);
+    while(find_ptr != NULL && *(find_ptr->thread) != *thread) {
+        prev_ptr = find_ptr;
+        find_ptr = find_ptr->next;
+    }
 
-        if(find_ptr->next == NULL) {
-            prev_ptr->next = NULL;
+    if(find_ptr != NULL) {
+        if(prev_ptr == NULL) {
+            _aa_thread_list = find_ptr->next;
         }
         else {
             prev_ptr->next = find_ptr->next;
         }
-
-        free(find_ptr);
+        AaFree(find_ptr);
+        found = true;
     }
 
-    return kNoErr;
+    mico_rtos_delete_thread(thread);
+
+    return found ? kNoErr : kGeneralErr;
 }
 
 u8 AaThreadGetCurrentId()
@@ -0,0 +1,387 @@
+
+
+
+/***
+
+History:
+2016-10-19: Create
+
+*/
+
+#include "AaTimer.h"
+#include "AaSysLog.h"
+#include "ApiInternalMsg.h"
+
+
+#define LEVEL_SHIFT(l)      ((l) * AATIMER_SLOT_BITS)
+#define SLOT_MASK           (AATIMER_SLOTS - 1)
+#define WHEEL_SPAN          (1UL << LEVEL_SHIFT(AATIMER_LEVELS))
+
+#define NO_DEADLINE         0xFFFFFFFF
+
+// expiries posted per pass, more due timers stay in the wheel for the next one
+#define POST_MAX            8
+
+
+// taken under the mutex, the message is built from this copy only
+typedef struct {
+    SAaTimer*       timer;
+    u32             generation;
+    SAaSysComSicad  receiver;
+} SAaTimerExpiry;
+
+typedef struct {
+    u8              count;
+    SAaTimerExpiry  entry[POST_MAX];
+} SAaTimerExpired;
+
+
+static struct {
+    mico_mutex_t    mutex;
+    mico_timer_t    rtos_timer;
+    bool            armed;
+    u32             deadline;   // tick the RTOS timer is armed for
+    u32             now;        // last tick the wheel was advanced to
+    u32             last_ms;    // mico_get_time() at tick now
+    SAaTimer*       slot[AATIMER_LEVELS][AATIMER_SLOTS];
+} wheel;
+
+static bool _aa_timer_ready = false;
+
+
+static void AaTimerExpired(void* arg);
+
+
+static void WheelUnlink(SAaTimer* timer)
+{
+    if(timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    }
+    else {
+        wheel.slot[timer->level][timer->slot] = timer->next;
+    }
+    if(timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    timer->next = timer->prev = NULL;
+}
+
+// Level by distance to the deadline, slot by the deadline itself: a timer in
+// level l is cascaded down when the wheel reaches its slot at that level.
+static void WheelInsert(SAaTimer* timer)
+{
+    u32 delta = timer->expires - wheel.now;
+    u32 key = timer->expires;
+    u8 l, s;
+
+    if((int32_t)delta < 0) {
+        key = wheel.now;    // already due, run it with the current slot
+        delta = 0;
+    }
+    else if(delta >= WHEEL_SPAN) {
+        key = wheel.now + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+
+    for(l = 0; l < AATIMER_LEVELS - 1; l++) {
+        if(delta < (1UL << LEVEL_SHIFT(l + 1))) {
+            break;
+        }
+    }
+    s = (key >> LEVEL_SHIFT(l)) & SLOT_MASK;
+
+    timer->level = l;
+    timer->slot = s;
+    timer->prev = NULL;
+    timer->next = wheel.slot[l][s];
+    if(timer->next != NULL) {
+        timer->next->prev = timer;
+    }
+    wheel.slot[l][s] = timer;
+}
+
+// Earliest tick at which something has to happen: a level 0 slot to run or a
+// higher level slot to cascade.
+static u32 WheelNextDeadline(void)
+{
+    u32 best = NO_DEADLINE;
+    u32 cur, at;
+    u8 l, k;
+
+    for(l = 0; l < AATIMER_LEVELS; l++) {
+        cur = wheel.now >> LEVEL_SHIFT(l);
+        for(k = (l == 0) ? 0 : 1; k <= AATIMER_SLOTS; k++) {
+            if(l == 0 && k == AATIMER_SLOTS) break;
+            if(wheel.slot[l][(cur + k) & SLOT_MASK] != NULL) {
+                at = (cur + k) << LEVEL_SHIFT(l);
+                if(best == NO_DEADLINE || (int32_t)(at - wheel.now) < (int32_t)(best - wheel.now)) {
+                    best = at;
+                }
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+// Move the wheel to tick `to`, which must not be past the next deadline, and
+// collect what expires there. What does not fit into expired stays due in the
+// slot of `to`.
+static void WheelProcess(u32 to, SAaTimerExpired* expired)
+{
+    SAaTimer* list;
+    SAaTimer* timer;
+    u8 l;
+
+    wheel.now = to;
+
+    for(l = 1; l < AATIMER_LEVELS; l++) {
+        if((to & ((1UL << LEVEL_SHIFT(l)) - 1)) != 0) {
+            break;
+        }
+        list = wheel.slot[l][(to >> LEVEL_SHIFT(l)) & SLOT_MASK];
+        wheel.slot[l][(to >> LEVEL_SHIFT(l)) & SLOT_MASK] = NULL;
+        while(list != NULL) {
+            timer = list;
+            list = list->next;
+            WheelInsert(timer);
+        }
+    }
+
+    list = wheel.slot[0][to & SLOT_MASK];
+    wheel.slot[0][to & SLOT_MASK] = NULL;
+    while(list != NULL) {
+        timer = list;
+        list = list->next;
+        if((int32_t)(timer->expires - to) > 0 || expired->count == POST_MAX) {
+            WheelInsert(timer);     // parked at the end of the wheel span, or no room
+            continue;
+        }
+        timer->pending = false;
+        timer->next = timer->prev = NULL;
+        expired->entry[expired->count].timer = timer;
+        expired->entry[expired->count].generation = timer->generation;
+        expired->entry[expired->count].receiver = timer->receiver;
+        expired->count++;
+    }
+}
+
+static u32 WheelCurrentTick(void)
+{
+    u32 elapsed = mico_get_time() - wheel.last_ms;
+    return wheel.now + elapsed / AATIMER_TICK_MS;
+}
+
+// Run every deadline up to the current tick. Called with the mutex held.
+static void WheelAdvance(SAaTimerExpired* expired)
+{
+    u32 from = wheel.now;
+    u32 target = WheelCurrentTick();
+    u32 next;
+
+    while(1) {
+        next = WheelNextDeadline();
+        if(next == NO_DEADLINE || (int32_t)(next - target) > 0) {
+            break;
+        }
+        WheelProcess(next, expired);
+        if(expired->count == POST_MAX) {
+            // stay on this tick, WheelArm() comes back for the rest at once
+            target = wheel.now;
+            break;
+        }
+    }
+
+    // nothing is due in between, so the wheel can jump
+    wheel.last_ms += (target - from) * AATIMER_TICK_MS;
+    wheel.now = target;
+}
+
+// Arm the single RTOS timer for the earliest deadline, or leave it off.
+static void WheelArm(void)
+{
+    u32 next = WheelNextDeadline();
+    u32 delay_ms, elapsed;
+
+    if(wheel.armed && next == wheel.deadline) {
+        return;
+    }
+
+    if(wheel.armed) {
+        mico_stop_timer(&wheel.rtos_timer);
+        mico_deinit_timer(&wheel.rtos_timer);
+        wheel.armed = false;
+    }
+
+    if(next == NO_DEADLINE) {
+        return;
+    }
+
+    delay_ms = (next - wheel.now) * AATIMER_TICK_MS;
+    elapsed = mico_get_time() - wheel.last_ms;
+    delay_ms = (elapsed < delay_ms) ? (delay_ms - elapsed) : 1;
+
+    if(kNoErr != mico_init_timer(&wheel.rtos_timer, delay_ms, AaTimerExpired, NULL)) {
+        AaSysLogPrint(LOGLEVEL_ERR, "timer wheel arm failed");
+        return;
+    }
+    mico_start_timer(&wheel.rtos_timer);
+    wheel.armed = true;
+    wheel.deadline = next;
+}
+
+// Runs without the mutex, the timers themselves may be restarted or stopped
+// meanwhile and are not touched here.
+static void PostExpired(SAaTimerExpired* expired)
+{
+    SAaTimerExpiry* entry;
+    void* msg;
+    ApiTimerInd* ind;
+    u8 i;
+
+    for(i = 0; i < expired->count; i++) {
+        entry = &expired->entry[i];
+
+        msg = AaSysComCreate(API_MESSAGE_ID_TIMER_IND, entry->receiver, entry->receiver, sizeof(ApiTimerInd));
+        if(msg == NULL) {
+            AaSysLogPrint(LOGLEVEL_ERR, "API_MESSAGE_ID_TIMER_IND create failed");
+            continue;
+        }
+        ind = AaSysComGetPayload(msg);
+        ind->timer = entry->timer;
+        ind->generation = entry->generation;
+
+        if(kNoErr != AaSysComSend(msg)) {
+            AaSysLogPrint(LOGLEVEL_ERR, "API_MESSAGE_ID_TIMER_IND send failed");
+        }
+    }
+}
+
+static void AaTimerExpired(void* arg)
+{
+    SAaTimerExpired expired;
+    (void)arg;
+
+    expired.count = 0;
+
+    mico_rtos_lock_mutex(&wheel.mutex);
+    if(wheel.armed) {
+        mico_stop_timer(&wheel.rtos_timer);
+        mico_deinit_timer(&wheel.rtos_timer);
+        wheel.armed = false;
+    }
+    WheelAdvance(&expired);
+    WheelArm();
+    mico_rtos_unlock_mutex(&wheel.mutex);
+
+    PostExpired(&expired);
+}
+
+
+OSStatus AaTimerInit(void)
+{
+    OSStatus err;
+
+    if(_aa_timer_ready) {
+        return kNoErr;
+    }
+
+    memset(&wheel, 0x0, sizeof(wheel));
+    err = mico_rtos_init_mutex(&wheel.mutex);
+    if(err != kNoErr) {
+        AaSysLogPrint(LOGLEVEL_ERR, "timer wheel initialize failed");
+        return err;
+    }
+    wheel.last_ms = mico_get_time();
+    _aa_timer_ready = true;
+
+    AaSysLogPrint(LOGLEVEL_INF, "timer wheel initialize success");
+    return kNoErr;
+}
+
+void AaTimerSetup(SAaTimer* timer, SAaSysComSicad receiver, AaTimerHandler handler, void* arg)
+{
+    memset(timer, 0x0, sizeof(SAaTimer));
+    timer->receiver = receiver;
+    timer->handler = handler;
+    timer->arg = arg;
+}
+
+OSStatus AaTimerStart(SAaTimer* timer, u32 delay_ms)
+{
+    SAaTimerExpired expired;
+
+    if(!_aa_timer_ready) {
+        return kNotPreparedErr;
+    }
+    if(timer == NULL || timer->handler == NULL || timer->receiver >= MsgQueue_MAX) {
+        return kParamErr;
+    }
+
+    expired.count = 0;
+    mico_rtos_lock_mutex(&wheel.mutex);
+    WheelAdvance(&expired);
+    if(timer->pending) {
+        WheelUnlink(timer);
+    }
+    timer->generation++;
+    timer->expires = wheel.now + (delay_ms + AATIMER_TICK_MS - 1) / AATIMER_TICK_MS;
+    timer->pending = true;
+    WheelInsert(timer);
+    WheelArm();
+    mico_rtos_unlock_mutex(&wheel.mutex);
+
+    PostExpired(&expired);
+    return kNoErr;
+}
+
+OSStatus AaTimerStop(SAaTimer* timer)
+{
+    if(!_aa_timer_ready) {
+        return kNotPreparedErr;
+    }
+    if(timer == NULL) {
+        return kParamErr;
+    }
+
+    mico_rtos_lock_mutex(&wheel.mutex);
+    timer->generation++;    // an expiry already on its way is dropped too
+    if(timer->pending) {
+        WheelUnlink(timer);
+        timer->pending = false;
+        WheelArm();
+    }
+    mico_rtos_unlock_mutex(&wheel.mutex);
+
+    return kNoErr;
+}
+
+bool AaTimerIsPending(SAaTimer* timer)
+{
+    return (timer != NULL) && timer->pending;
+}
+
+void AaTimerDispatch(void* msg_ptr)
+{
+    ApiTimerInd* ind = AaSysComGetPayload(msg_ptr);
+    SAaTimer* timer;
+    bool run;
+
+    if(ind == NULL || ind->timer == NULL) {
+        return;
+    }
+    timer = (SAaTimer*)ind->timer;
+
+    mico_rtos_lock_mutex(&wheel.mutex);
+    run = !timer->pending && timer->generation == ind->generation;
+    mico_rtos_unlock_mutex(&wheel.mutex);
+
+    if(run && timer->handler != NULL) {
+        timer->handler(timer->arg);
+    }
+}
+
+// end of file
+
+
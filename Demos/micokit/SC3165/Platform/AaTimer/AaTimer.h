@@ -0,0 +1,72 @@
+
+
+
+/***
+
+History:
+2016-10-19: Create
+
+*/
+
+#ifndef _AATIMER_H_
+#define _AATIMER_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+
+#include "AaPlatform.h"
+#include "AaSysCom.h"
+#include <stdbool.h>
+
+
+// One RTOS timer serves every SAaTimer. The timers sit in a hierarchical
+// wheel of AATIMER_LEVELS levels with AATIMER_SLOTS slots each, and the RTOS
+// timer is only armed for the earliest slot that holds something, so nothing
+// wakes up while no timer is due. An expired timer is posted to its receiver
+// queue as API_MESSAGE_ID_TIMER_IND, the receiver thread hands the message to
+// AaTimerDispatch() and the handler runs there, in thread context.
+
+#define AATIMER_TICK_MS     100
+#define AATIMER_SLOT_BITS   6
+#define AATIMER_SLOTS       (1 << AATIMER_SLOT_BITS)
+#define AATIMER_LEVELS      4       // 2^24 ticks, about 19 days, longer delays are re-cascaded
+
+typedef void (*AaTimerHandler)(void* arg);
+
+// owned by the caller, usually static, the wheel only links it
+typedef struct SAaTimer_t {
+    struct SAaTimer_t*  next;
+    struct SAaTimer_t*  prev;
+    u32                 expires;        // wheel tick
+    u32                 generation;     // bumped on every start and stop
+    bool                pending;
+    u8                  level;          // where the wheel keeps it while pending
+    u8                  slot;
+    AaTimerHandler      handler;
+    void*               arg;
+    SAaSysComSicad      receiver;
+} SAaTimer;
+
+
+OSStatus AaTimerInit(void);
+void AaTimerSetup(SAaTimer* timer, SAaSysComSicad receiver, AaTimerHandler handler, void* arg);
+// (re)start, a pending timer is moved to the new deadline
+OSStatus AaTimerStart(SAaTimer* timer, u32 delay_ms);
+OSStatus AaTimerStop(SAaTimer* timer);
+bool AaTimerIsPending(SAaTimer* timer);
+// call with an API_MESSAGE_ID_TIMER_IND message, runs the handler unless the
+// timer was stopped or restarted after it expired
+void AaTimerDispatch(void* msg_ptr);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _AATIMER_H_
+
+// end of file
+
+
@@ -431,6 +431,72 @@ bool SendJsonTrackName(app_context_t *arg, char* string)
     return ret;
 }
 
+// last profiler period, the threads seen in its history and the heap
+bool SendJsonProfile(app_context_t *arg)
+{
+    bool ret = false;
+    json_object *send_json_object = NULL;
+    json_object *profile = NULL;
+    json_object *tasks = NULL;
+    json_object *task_object;
+    SAaProfilerSample sample;
+    SAaProfilerTask task;
+    u8 index;
+
+    if(!arg->appStatus.fogcloudStatus.isCloudConnected) {
+        AaSysLogPrint(LOGLEVEL_WRN, "cloud disconnected, upload failed");
+        return false;
+    }
+
+    if(kNoErr != AaProfilerGetSample(0, &sample)) {
+        AaSysLogPrint(LOGLEVEL_WRN, "no profiler period closed yet");
+        return false;
+    }
+
+    send_json_object = json_object_new_object();
+    profile = json_object_new_object();
+    tasks = json_object_new_array();
+    if(NULL == send_json_object || NULL == profile || NULL == tasks){
+        user_log("[ERR]%s: create json object error", __FUNCTION__);
+        json_object_put(tasks);
+        json_object_put(profile);
+    }
+    else {
+        json_object_object_add(profile, "period_ms", json_object_new_int(sample.period_ms));
+        json_object_object_add(profile, "run_ms", json_object_new_int(sample.run_ticks));
+        json_object_object_add(profile, "idle_ms", json_object_new_int(sample.idle_ticks));
+        json_object_object_add(profile, "other_ms", json_object_new_int(sample.other_ticks));
+        json_object_object_add(profile, "heap_total", json_object_new_int(sample.heap_total));
+        json_object_object_add(profile, "heap_free", json_object_new_int(sample.heap_free));
+        json_object_object_add(profile, "heap_largest", json_object_new_int(sample.heap_largest));
+        json_object_object_add(profile, "heap_free_chunks", json_object_new_int(sample.heap_free_chunks));
+        json_object_object_add(profile, "heap_fragmentation", json_object_new_int(sample.heap_fragmentation));
+
+        for(index = 0; kNoErr == AaProfilerGetTask(index, &task); index++) {
+            task_object = json_object_new_object();
+            if(NULL == task_object) {
+                break;
+            }
+            json_object_object_add(task_object, "name", json_object_new_string(task.name));
+            json_object_object_add(task_object, "ms", json_object_new_int(task.ticks));
+            json_object_object_add(task_object, "window_ms", json_object_new_int(task.window_ticks));
+            json_object_object_add(task_object, "stack_size", json_object_new_int(task.stack_size));
+            json_object_object_add(task_object, "stack_free", json_object_new_int(task.stack_free));
+            json_object_array_add(tasks, task_object);
+        }
+        json_object_object_add(profile, "tasks", tasks);
+        json_object_object_add(send_json_object, "DEVICE-1/Profile", profile);
+
+        ret = SendJson(arg, send_json_object);
+    }
+
+    // free json object memory
+    json_object_put(send_json_object);
+    send_json_object = NULL;
+
+    return ret;
+}
+
 
 // end of file
 
@@ -34,6 +34,7 @@ bool SendJsonSchedule(app_context_t *arg);
 bool SendJsonAppointment(app_context_t *arg);
 bool FmtStringJsonTrack(app_context_t *arg, u8 type, STrack* track, char* cp_buf, u16* cp_len);
 bool SendJsonTrackName(app_context_t *arg, char* string);
+bool SendJsonProfile(app_context_t *arg);
 
 
    
@@ -23,7 +23,21 @@ History:
 
 
 #define BATTERY_ADC                 MICO_ADC_1
-#define BATTERY_ADC_SAMPLE_CYCLE    3
+#define BATTERY_ADC_SAMPLE_CYCLE    84    // the divider is high impedance, give the sample cap time
+
+#define BATTERY_BURST_SAMPLES       32    // one DMA burst per read
+#define BATTERY_FILTER_DEEPTH       8     // reads in the moving average, power of 2
+#define BATTERY_FILTER_SHIFT        3
+
+// The pin sees half the battery voltage against a 3.3V reference, 12 bit
+#define BATTERY_COUNTS_TO_MV(sum, n)  ((uint32_t)(sum) * 3300UL * 2 / ((uint32_t)(n) * 4096UL))
+
+static bool adc_ready = false;
+
+static uint16_t filter_buf[BATTERY_FILTER_DEEPTH];
+static uint32_t filter_sum = 0;
+static uint8_t filter_idx = 0;
+static uint8_t filter_len = 0;
 
 
 bool BatteryInit(void)
@@ -33,50 +47,99 @@ bool BatteryInit(void)
   err = MicoAdcInitialize(BATTERY_ADC, BATTERY_ADC_SAMPLE_CYCLE);
   if(kNoErr != err){
     user_log("[ERR]BatteryInit: MicoAdcInitialize failed");
+    adc_ready = false;
     return false;
   }
+  adc_ready = true;
 
   user_log("[INF]BatteryInit: initialize success");
   
   return true;
 }
 
-bool BatteryRead(uint16_t *data)
+// Mean of the middle half of a burst: spikes from the radio or the motor land
+// in the outer quarters and are dropped, the rest is averaged.
+static uint16_t BatteryBurstMillivolt(uint16_t *samples, uint16_t count)
+{
+  uint16_t i, j, v;
+  uint32_t sum = 0;
+
+  for(i = 1; i < count; i++) {
+    v = samples[i];
+    for(j = i; j > 0 && samples[j-1] > v; j--) {
+      samples[j] = samples[j-1];
+    }
+    samples[j] = v;
+  }
+
+  for(i = count/4; i < count - count/4; i++) {
+    sum += samples[i];
+  }
+
+  return (uint16_t)BATTERY_COUNTS_TO_MV(sum, count - 2*(count/4));
+}
+
+static uint16_t BatteryFilter(uint16_t millivolt)
+{
+  if(filter_len < BATTERY_FILTER_DEEPTH) {
+    filter_len++;
+  } else {
+    filter_sum -= filter_buf[filter_idx];
+  }
+  filter_buf[filter_idx] = millivolt;
+  filter_sum += millivolt;
+  filter_idx = (filter_idx + 1) & (BATTERY_FILTER_DEEPTH - 1);
+
+  if(filter_len < BATTERY_FILTER_DEEPTH) {
+    return (uint16_t)(filter_sum / filter_len);
+  }
+  return (uint16_t)(filter_sum >> BATTERY_FILTER_SHIFT);
+}
+
+bool BatteryRead(uint16_t *millivolt)
 {
-  int ret = 0;
   OSStatus err = kUnknownErr;
-  
-  // init ADC
-  err = MicoAdcInitialize(BATTERY_ADC, BATTERY_ADC_SAMPLE_CYCLE);
-  if(kNoErr != err){
-    user_log("[ERR]BatteryRead: MicoAdcInitialize failed");
+  uint16_t samples[BATTERY_BURST_SAMPLES];
+
+  if(!adc_ready && BatteryInit() != true) {
     return false;
   }
-  // get ADC data
-  err = MicoAdcTakeSample(BATTERY_ADC, data);
-  if(kNoErr == err){
-//    user_log("[DBG]BatteryRead: MicoAdcTakeSample success with sample %d", *data);
-    ret = true;   // get data succeed
-  }
-  else{
-    user_log("[ERR]BatteryRead: MicoAdcTakeSample failed");
-    ret = false;  // get data error
+
+  err = MicoAdcTakeSampleStreram(BATTERY_ADC, samples, sizeof(samples));
+  if(kNoErr != err){
+    user_log("[ERR]BatteryRead: MicoAdcTakeSampleStreram failed %d", err);
+    adc_ready = false;  // initialize again on the next read
+    return false;
   }
-  
-  return ret;
+
+  *millivolt = BatteryBurstMillivolt(samples, BATTERY_BURST_SAMPLES);
+  return true;
 }
 
-bool GetBatteryVoltage(float* voltage)
+bool GetBatteryMillivolt(uint16_t* millivolt)
 {
-    uint16_t adc_data;
-    if(BatteryRead(&adc_data) != true) {
-        user_log("[ERR]GetBatteryVoltage: BatteryRead failed");
+    uint16_t burst;
+
+    if(BatteryRead(&burst) != true) {
+        user_log("[ERR]GetBatteryMillivolt: BatteryRead failed");
         return false;
     }
 
-    *voltage = 3.3 * adc_data / (4096 >> 1);
-//    user_log("[DBG]GetBatteryVoltage: get battery(%f) success", *voltage);
+    *millivolt = BatteryFilter(burst);
+//    user_log("[DBG]GetBatteryMillivolt: burst %d mV, filtered %d mV", burst, *millivolt);
+
+    return true;
+}
+
+bool GetBatteryVoltage(float* voltage)
+{
+    uint16_t millivolt;
+
+    if(GetBatteryMillivolt(&millivolt) != true) {
+        return false;
+    }
 
+    *voltage = millivolt / 1000.0f;
     return true;
 }
 
@@ -21,12 +21,14 @@ History:
 
 
 // Battery voltage range
-// unit: 10mV
-#define BATTERY_VOLTAGE_LOW     (250.0f)
-#define BATTERY_VOLTAGE_HIGH    (425.0f)
+// unit: mV
+#define BATTERY_MILLIVOLT_LOW   (2500)
+#define BATTERY_MILLIVOLT_HIGH  (4250)
 
 
 bool BatteryInit(void);
+// filtered: trimmed mean of a sample burst, then a moving average over reads
+bool GetBatteryMillivolt(uint16_t* millivolt);
 bool GetBatteryVoltage(float* voltage);
 
 
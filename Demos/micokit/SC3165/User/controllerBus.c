@@ -68,7 +68,7 @@ OSStatus ControllerBusSend(ECBusCmd cmd, unsigned char *inData, unsigned int inD
     unsigned char* inBuf;
     unsigned int bufLen = sizeof(SCBusHeader) + inDataLen;
 
-    inBuf = malloc(bufLen);
+    inBuf = AaMalloc(bufLen);
     if(inBuf == NULL) {
         user_log("[ERR]ControllerBusSend: memory failed");
         return kGeneralErr;
@@ -106,7 +106,7 @@ OSStatus ControllerBusSend(ECBusCmd cmd, unsigned char *inData, unsigned int inD
     user_log("[DBG]ControllerBusSend: send with following data");
     print_serial_data(inBuf, bufLen);
 
-    if(inBuf != NULL) free(inBuf);
+    if(inBuf != NULL) AaFree(inBuf);
     
     return kNoErr;
 }
@@ -335,7 +335,7 @@ static void ControllerBusProtocolHandler(void* arg)
 
     // normally should not access
     AaSysLogPrint(LOGLEVEL_ERR, "some fatal error occur, thread dead");
-    mico_rtos_delete_thread(NULL);  // delete current thread
+    AaThreadDelete(&bus_recv_handle);  // delete current thread
 }
 
 static OSStatus ParseControllerBus(SCBusHeader* header, uint8_t* payload)
@@ -557,9 +557,9 @@ bool ControllerBusInit(void)
     }
     
     // start the uart receive thread to handle controller bus data
-    err = mico_rtos_create_thread(&bus_recv_handle, MICO_APPLICATION_PRIORITY, "CBusProtoHandler", 
-                                ControllerBusProtocolHandler, CONTROLLERBUS_STACK_SIZE_RINGBUFFER_THREAD, 
-                                NULL);
+    err = AaThreadCreate(&bus_recv_handle, MICO_APPLICATION_PRIORITY, "CBusProtoHandler", 
+                       ControllerBusProtocolHandler, CONTROLLERBUS_STACK_SIZE_RINGBUFFER_THREAD, 
+                       NULL);
     if(err != kNoErr) {
         AaSysLogPrint(LOGLEVEL_ERR, "create controller bus protocol handler thread failed");
         return false;
@@ -569,9 +569,9 @@ bool ControllerBusInit(void)
     }
 
     // start the uart send thread to handle request message
-    err = mico_rtos_create_thread(&bus_send_handle, MICO_APPLICATION_PRIORITY, "BusRequestSend", 
-                                ControllerBusMsgHandler, CONTROLLERBUS_STACK_SIZE_RINGBUFFER_THREAD, 
-                                NULL);
+    err = AaThreadCreate(&bus_send_handle, MICO_APPLICATION_PRIORITY, "BusRequestSend", 
+                       ControllerBusMsgHandler, CONTROLLERBUS_STACK_SIZE_RINGBUFFER_THREAD, 
+                       NULL);
     if(err != kNoErr) {
         AaSysLogPrint(LOGLEVEL_ERR, "create controller bus message handler thread failed");
         return false;
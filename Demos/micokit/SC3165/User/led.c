@@ -10,6 +10,7 @@ History:
 
 #include "led.h"
 #include "user_debug.h"
+#include "AaInclude.h"
 
 #ifdef DEBUG
   #define user_log(M, ...) custom_log("LightsMonitor", M, ##__VA_ARGS__)
@@ -22,39 +23,138 @@ History:
 #endif
 
 
+// one effect frame per PWM period
+#define LED_PWM_FREQUENCY   50
+#define LED_STEP_MS         (1000 / LED_PWM_FREQUENCY)
 
-bool LedDutyInit(float r_duty, float g_duty, float b_duty)
+
+// the board wires the LED colours to other PWM names
+static const mico_pwm_t led_pwm[LED_EFFECT_CHANNELS] = { MICO_PWM_G, MICO_PWM_B, MICO_PWM_R };
+
+static uint32_t led_full[LED_EFFECT_CHANNELS];
+static uint32_t led_compare[LED_EFFECT_CHANNELS][LED_EFFECT_MAX_FRAMES];
+static bool led_lit[LED_EFFECT_MAX_FRAMES];
+
+
+static OSStatus LedWrite(const uint16_t* level);
+static OSStatus LedStore(uint16_t index, const uint16_t* level);
+static OSStatus LedPlay(uint16_t first, uint16_t count, bool loop);
+static OSStatus LedStop(void);
+
+static const led_effect_backend_t led_backend = {
+    LED_STEP_MS,
+    LED_EFFECT_MAX_FRAMES,
+    LedWrite,
+    LedStore,
+    LedPlay,
+    LedStop,
+};
+
+
+static uint32_t LedCompare(u8 channel, uint16_t level)
 {
-    if(r_duty > 100.0 || g_duty > 100.0 || b_duty > 100.0) {
-        user_log("[ERR]LedInit: R %f G %f B %f duty cycle error", r_duty, g_duty, b_duty);
-        return false;
+    return (uint32_t)(((uint64_t)level * led_full[channel] + LED_EFFECT_LEVEL_MAX / 2) / LED_EFFECT_LEVEL_MAX);
+}
+
+static OSStatus LedWrite(const uint16_t* level)
+{
+    if(LedStore(0, level) != kNoErr) {
+        return kGeneralErr;
+    }
+    return LedPlay(0, 1, false);
+}
+
+static OSStatus LedStore(uint16_t index, const uint16_t* level)
+{
+    u8 c;
+
+    if(index >= LED_EFFECT_MAX_FRAMES) {
+        return kParamErr;
+    }
+
+    for(c = 0; c < LED_EFFECT_CHANNELS; c++) {
+        led_compare[c][index] = LedCompare(c, level[c]);
+    }
+    led_lit[index] = (level[0] > 0 || level[1] > 0 || level[2] > 0);
+    return kNoErr;
+}
+
+static OSStatus LedPlay(uint16_t first, uint16_t count, bool loop)
+{
+    OSStatus err = kNoErr;
+    bool lit = false;
+    uint16_t i;
+    u8 c;
+
+    // the PWM timers halt in STOP mode, a dark LED does not mind
+    for(i = first; i < first + count && !lit; i++) {
+        lit = led_lit[i];
+    }
+    if(lit) {
+        AaPowerHold(AaPowerUser_Led);
+    }
+    else {
+        AaPowerRelease(AaPowerUser_Led);
+    }
+
+    for(c = 0; c < LED_EFFECT_CHANNELS; c++) {
+        err = MicoPwmStreamStart(led_pwm[c], &led_compare[c][first], count, loop);
+        if(err != kNoErr) {
+            user_log("[ERR]LedPlay: channel %d stream start failed %d", c, err);
+            break;
+        }
+    }
+    return err;
+}
+
+static OSStatus LedStop(void)
+{
+    u8 c;
+
+    for(c = 0; c < LED_EFFECT_CHANNELS; c++) {
+        MicoPwmStreamStop(led_pwm[c]);
+    }
+    return kNoErr;
+}
+
+OSStatus LedInit(void)
+{
+    OSStatus err;
+    u8 c;
+
+    for(c = 0; c < LED_EFFECT_CHANNELS; c++) {
+        MicoPwmInitialize(led_pwm[c], LED_PWM_FREQUENCY, 0);
+        err = MicoPwmGetResolution(led_pwm[c], &led_full[c]);
+        require_noerr_action(err, exit, user_log("[ERR]LedInit: PWM %d has no resolution", c));
+        MicoPwmStart(led_pwm[c]);
     }
 
-    MicoPwmInitialize(MICO_PWM_R, 50, b_duty);
-    MicoPwmInitialize(MICO_PWM_G, 50, r_duty);
-    MicoPwmInitialize(MICO_PWM_B, 50, g_duty);
+    err = led_effect_init(&led_backend);
+    require_noerr_action(err, exit, user_log("[ERR]LedInit: effect engine initialize failed"));
 
-//    user_log("[INF]LedDutyInit: initialize with R %f G %f B %f duty cycle success", r_duty, g_duty, b_duty);
+exit:
+    return err;
+}
+
+OSStatus LedSolid(float r_duty, float g_duty, float b_duty, uint32_t fade_ms)
+{
+    if(r_duty > 100.0 || g_duty > 100.0 || b_duty > 100.0) {
+        user_log("[ERR]LedSolid: R %f G %f B %f duty cycle error", r_duty, g_duty, b_duty);
+        return kParamErr;
+    }
 
-    return true;
+    return led_effect_solid((uint8_t)(r_duty * 255 / 100), (uint8_t)(g_duty * 255 / 100),
+                            (uint8_t)(b_duty * 255 / 100), fade_ms);
 }
 
-void LedPwmStart(void)
+OSStatus LedEffect(const led_effect_t* effect)
 {
-    MicoPwmStart(MICO_PWM_R);
-    MicoPwmStart(MICO_PWM_G);
-    MicoPwmStart(MICO_PWM_B);
-//    user_log("[DBG]LedPwmStart: start");
+    return led_effect_start(effect);
 }
 
-void LedPwmStop(void)
+void LedOff(uint32_t fade_ms)
 {
-//    MicoPwmStop(MICO_PWM_R);
-//    MicoPwmStop(MICO_PWM_G);
-//    MicoPwmStop(MICO_PWM_B);
-    LedDutyInit(0, 0, 0);
-    LedPwmStart();
-//    user_log("[DBG]LedPwmStop: stop");
+    led_effect_solid(0, 0, 0, fade_ms);
 }
 
 
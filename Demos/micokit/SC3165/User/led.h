@@ -18,12 +18,15 @@ History:
 #include "Object_int.h"
 #include "stdbool.h"
 #include "mico.h"
+#include "rgb_led/led_effect/led_effect.h"
 
 
-
-bool LedDutyInit(float r_duty, float g_duty, float b_duty);
-void LedPwmStart(void);
-void LedPwmStop(void);
+// The LED plays led_effect effects, the PWM duty cycles are streamed by DMA.
+OSStatus LedInit(void);
+// duty cycles in percent, before gamma correction
+OSStatus LedSolid(float r_duty, float g_duty, float b_duty, uint32_t fade_ms);
+OSStatus LedEffect(const led_effect_t* effect);
+void LedOff(uint32_t fade_ms);
 
    
 #ifdef __cplusplus
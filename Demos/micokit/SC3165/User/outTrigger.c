@@ -27,6 +27,14 @@ History:
 
 #define KEY_CHECK_TIMES     (100/20)
 
+// the level must hold this long after the last edge to count as a transition
+#define KEY_DEBOUNCE_MS     30
+
+
+static mico_timer_t debounce_timer;
+static OuterTriggerCallback transition_cb = NULL;
+static volatile EKey stable_status = OUTERTRIGGER_NONE;
+
 
 void OuterTriggerInit(mico_gpio_irq_handler_t handler)
 {
@@ -39,6 +47,55 @@ void OuterTriggerInit(mico_gpio_irq_handler_t handler)
 }
 
 
+// Every edge, bounce or not, pushes the debounce timer back, so the timer only
+// fires once the pin has been quiet for KEY_DEBOUNCE_MS.
+static void OuterTriggerEdge(void* arg)
+{
+    (void)arg;
+    mico_start_timer(&debounce_timer);
+}
+
+static void OuterTriggerSettled(void* arg)
+{
+    EKey status;
+    (void)arg;
+
+    mico_stop_timer(&debounce_timer);
+
+    status = (true == MicoGpioInputGet(KEY_PIN)) ? OUTERTRIGGER_PICKUP : OUTERTRIGGER_PUTDOWN;
+    if(status == stable_status) {
+        return;     // bounced back to where it was
+    }
+    stable_status = status;
+
+    if(transition_cb != NULL) {
+        transition_cb(status);
+    }
+}
+
+OSStatus OuterTriggerStartDetect(OuterTriggerCallback callback)
+{
+    OSStatus err;
+
+    transition_cb = callback;
+    stable_status = OUTERTRIGGER_NONE;
+
+    err = mico_init_timer(&debounce_timer, KEY_DEBOUNCE_MS, OuterTriggerSettled, NULL);
+    require_noerr(err, exit);
+
+    err = MicoGpioEnableIRQ(KEY_PIN, IRQ_TRIGGER_BOTH_EDGES, OuterTriggerEdge, NULL);
+    require_noerr(err, exit);
+
+    // report the level the cup is resting at now
+    err = mico_start_timer(&debounce_timer);
+    require_noerr(err, exit);
+
+    user_log("[INF]OuterTriggerStartDetect: edge detection started");
+
+exit:
+    return err;
+}
+
 EKey GetOuterTriggerStatus(void)
 {
     EKey status[2] = {OUTERTRIGGER_NONE, OUTERTRIGGER_NONE};
@@ -27,8 +27,14 @@ typedef enum EKey_t {
     OUTERTRIGGER_NONE
 } EKey;
 
+// called from timer context with the new, debounced status
+typedef void (*OuterTriggerCallback)(EKey status);
+
 
 void OuterTriggerInit(mico_gpio_irq_handler_t handler);
+// Interrupt driven detection, callback runs once per confirmed pickup or
+// putdown and once at start with the current status
+OSStatus OuterTriggerStartDetect(OuterTriggerCallback callback);
 EKey GetOuterTriggerStatus(void);
 
 
@@ -10,6 +10,7 @@ History:
 
 #include "led.h"
 #include "user_debug.h"
+#include "sensor_hub/sensor_hub.h"
 
 #ifdef DEBUG
   #define user_log(M, ...) custom_log("Temperature", M, ##__VA_ARGS__)
@@ -36,6 +37,16 @@ History:
 #define TMP75_CONFREG_RX                (0x3<<5)
 #define TMP75_CONFREG_OS                (1<<7)
 
+// a hub sample older than this many periods means the hub stopped reading
+#define TMP75_STALE_PERIODS             2
+
+static bool tmp75_on_hub = false;
+static uint8_t tmp75_hub_id;
+// set by the consumer to its own read interval, 0 reads on demand
+static u32 tmp75_period_ms = 0;
+
+static bool TMP75HubRegister(void);
+
 
 mico_i2c_device_t tmp75_device = 
 {
@@ -157,6 +168,70 @@ bool TemperatureInit(void)
 
     user_log("[INF]TemperatureInit: set CONFREG(0x%02x) success", confRegAgain);
 
+    // sample in the background once a consumer sets its period, see TMP75SetSamplePeriod
+    if(TMP75HubRegister() != true) {
+        user_log("[WRN]TemperatureInit: sensor hub unavailable, reading on demand");
+    }
+
+    return true;
+}
+
+static OSStatus TMP75HubDecode(const uint8_t* raw, sensor_hub_sample_t* sample, void* arg)
+{
+    UNUSED_PARAMETER(arg);
+    // 12 bit two's complement, left aligned, 0.0625 degC per LSB
+    sample->value[0] = (float)(int16_t)(((uint16_t)raw[0] << 8) | raw[1]) / 256.0f;
+    return kNoErr;
+}
+
+static bool TMP75HubRegister(void)
+{
+    sensor_hub_desc_t desc = {
+        "TMP75", &tmp75_device, TMP75_POINTERADDR_TEMPREG, 2,
+        tmp75_period_ms, TMP75HubDecode, NULL
+    };
+
+    if(sensor_hub_start() != kNoErr) {
+        return false;
+    }
+    if(sensor_hub_register(&desc, &tmp75_hub_id) != kNoErr) {
+        return false;
+    }
+    tmp75_on_hub = true;
+    return true;
+}
+
+bool TMP75SetSamplePeriod(u32 period_ms)
+{
+    if(period_ms == tmp75_period_ms) return true;
+    tmp75_period_ms = period_ms;
+    if(tmp75_on_hub && sensor_hub_set_period(tmp75_hub_id, period_ms) != kNoErr) {
+        return false;
+    }
+    return true;
+}
+
+// Newest hub sample. The queue is popped empty on every read so it never
+// fills up, when it is already empty the latest sample is the newest one.
+static bool TMP75HubLatest(float* temperature)
+{
+    sensor_hub_sample_t sample;
+    sensor_hub_sample_t popped;
+    bool found = false;
+
+    while(sensor_hub_read(tmp75_hub_id, &popped, 1) == 1) {
+        sample = popped;
+        found = true;
+    }
+    if(!found && sensor_hub_latest(tmp75_hub_id, &sample) != kNoErr) {
+        return false;
+    }
+
+    if(mico_get_time() - sample.timestamp > TMP75_STALE_PERIODS * tmp75_period_ms) {
+        user_log("[WRN]TMP75ReadTemperature: sample is %d ms old", mico_get_time() - sample.timestamp);
+        return false;
+    }
+    *temperature = sample.value[0];
     return true;
 }
 
@@ -165,6 +240,10 @@ bool TMP75ReadTemperature(float* temperature)
     u8 temp[2];
     bool ret = false;
 
+    if(tmp75_on_hub && tmp75_period_ms != 0) {
+        return TMP75HubLatest(temperature);
+    }
+
     ret = TMP75_IO_Read(temp, TMP75_POINTERADDR_TEMPREG, 2);
     if(ret != true) {
         user_log("[ERR]TMP75ReadTemperature: TMP75_IO_Read failed");
@@ -23,6 +23,8 @@ History:
 
 bool TemperatureInit(void);
 bool TMP75ReadTemperature(float* temperature);
+// how often the caller reads, the sensor hub samples at the same rate
+bool TMP75SetSamplePeriod(u32 period_ms);
 
 
    
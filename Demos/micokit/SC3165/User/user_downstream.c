@@ -27,6 +27,8 @@
 #include "led.h"
 #include "OMFactory.h"
 #include "MusicMonitor.h"
+#include "LightsMonitor.h"
+#include "HealthMonitor.h"
 #include "controllerBus.h"
 #include "AaInclude.h"
 
@@ -70,19 +72,11 @@ void user_downstream_thread(void* arg)
   
   /* thread loop to handle cloud message */
   while(1){
-    mico_thread_sleep(1);
-        
-    // check fogcloud connect status
-    if(!app_context->appStatus.fogcloudStatus.isCloudConnected){
-      user_log("[ERR]user_downstream_thread: cloud disconnected");
-      mico_thread_sleep(2);
-      continue;
-    }
-    
     /* get a msg pointer, points to the memory of a msg: 
      * msg data format: recv_msg->data = <topic><data>
+     * nothing arrives while the cloud is disconnected, so just wait for one
      */
-    err = MiCOFogCloudMsgRecv(app_context, &recv_msg, 1000);
+    err = MiCOFogCloudMsgRecv(app_context, &recv_msg, MICO_WAIT_FOREVER);
     if(kNoErr == err){
       // debug log in MICO dubug uart
       user_log("Cloud => Module: topic[%d]=[%.*s]\tdata[%d]=[%.*s]", 
@@ -93,6 +87,7 @@ void user_downstream_thread(void* arg)
       if(NULL != recv_msg) {
         ParseOMfromCloud(app_context, (const char*)(recv_msg->data + recv_msg->topic_len));
         IsParameterChanged();
+        LightsNotify();
       }
       
       // NOTE: must free msg memory after been used.
@@ -101,6 +96,9 @@ void user_downstream_thread(void* arg)
         recv_msg = NULL;
       }
     }
+    else if(kNotInitializedErr == err){
+      mico_thread_sleep(1);  // the receive queue is created once Wi-Fi is up
+    }
   }
 
 exit:
@@ -172,6 +170,11 @@ static bool ParseOMfromCloud(app_context_t *app_context, const char* string)
                 user_log("[DBG]ParseOMfromCloud: will delete track(%d) here", json_object_get_int(val));
                 // TODO: will delete the track
             }
+            else if(strcmp(key, "DEVICE-1/GetProfile") == 0) {
+                if(json_object_get_boolean(val) == true) {
+                    SendJsonProfile(app_context);
+                }
+            }
             else if(strcmp(key, "HEALTH-1/IfNoDisturbing") == 0) {
                 SetIfNoDisturbing(json_object_get_boolean(val));
             }
@@ -448,6 +451,8 @@ bool IsParameterChanged()
                     GetScheduleRemindTimes(index),
                     GetScheduleTrackType(index),
                     GetScheduleSelTrack(index));
+            // the change flag is cleared now, the reminder must be aimed again here
+            HealthScheduleChanged(index);
         }
     }
 
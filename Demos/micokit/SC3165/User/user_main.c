@@ -74,6 +74,10 @@ OSStatus user_main( app_context_t * const app_context )
   // platform initialize
   AaSysComInit();
   AaSysLogInit();
+  AaTimerInit();
+  // let idle drop into STOP mode, the system did it already if its config asks for it
+  AaPowerInit(app_context->mico_context->flashContentInRam.micoSystemConfig.mcuPowerSaveEnable);
+  AaProfilerInit();
 
   // application initialize
   ControllerBusInit();
@@ -103,9 +107,9 @@ OSStatus user_main( app_context_t * const app_context )
   MusicInit(app_context);
 
   // start the downstream thread to handle user command
-  err = mico_rtos_create_thread(&user_downstrem_thread_handle, MICO_APPLICATION_PRIORITY, "user_downstream", 
-                                user_downstream_thread, STACK_SIZE_USER_DOWNSTREAM_THREAD, 
-                                app_context );
+  err = AaThreadCreate(&user_downstrem_thread_handle, MICO_APPLICATION_PRIORITY, "user_downstream", 
+                       user_downstream_thread, STACK_SIZE_USER_DOWNSTREAM_THREAD, 
+                       app_context );
   require_noerr_action( err, exit, user_log("ERROR: create user_downstream thread failed!") );
 #endif
 
@@ -148,26 +152,11 @@ exit:
 
 OSStatus SntpInit(app_context_t * const app_context)
 {
-    u8 cnt = 0;
-    
-    user_log("[DBG]SntpInit: waiting for cloud connected...");
-
-    // will wait for 3 second
-    while(cnt < 6) {
-        if(app_context->appStatus.fogcloudStatus.isCloudConnected == false) {
-            mico_thread_msleep(500);
-        }
-        else {
-            break;
-        }
-        cnt++;
-    }
+    (void)app_context;
 
-    if(cnt >= 6) {
-        user_log("[WRN]SntpInit: cloud disconnected");
-        return kGeneralErr;
-    }
-    
+    // the client waits for the network itself and keeps the RTC on time from then on,
+    // schedules are armed again whenever it steps the clock
+    sntp_set_time_changed_callback(HealthClockChanged);
     return sntp_client_start();
 }
 
@@ -66,7 +66,8 @@ OSStatus user_uartSend(unsigned char *inBuf, unsigned int inBufLen)
   
 //  user_uart_log("[DBG]user_uartSend:[%d]=%.*s", inBufLen, inBufLen, inBuf);
   
-  err = MicoUartSend(USER_UART, inBuf, inBufLen);
+  /* Copied into the UART transmit queue, so callers may free inBuf straight away */
+  err = MicoUartSendAsync(USER_UART, inBuf, inBufLen, NULL, NULL);
   require_noerr_action( err, exit, user_uart_log("[ERR]user_uartSend: send to USART error! err=%d", err) );
   return kNoErr;
   
@@ -16,7 +16,7 @@
 #define baseEvents_log(M, ...) custom_log("BaseEvents", M, ##__VA_ARGS__)
 #define baseEvents_log_trace() custom_log_trace("BaseEvents")
 
-extern mqtt_broker_handle_t broker_mqtt;
+extern OSStatus sw_publish_message(SiteWhere_Command command, char* originator, const pb_field_t fields[], const void* message);
 //mico_Context_t *context;
 /*****************************************************/
 // Update these with values suitable for your network.
@@ -63,42 +63,36 @@ const pb_field_t ArduinoCustom_RGB_fields[4] = {
   PB_LAST_FIELD
 };
 
+/** Acknowledge a command, encoded straight into the MQTT queue */
+static void publishAcknowledge(char* message, char* originator) {
+  SiteWhere_Acknowledge ack;
+  sw_acknowledge_message(&ack, hardwareId, message);
+  sw_publish_message(SiteWhere_Command_ACKNOWLEDGE, originator, SiteWhere_Acknowledge_fields, &ack);
+}
+
 /** Handle the 'ping' command */
 void handlePing(ArduinoCustom_ping ping, char* originator) {
-  unsigned int len = 0;
-  memset(buffer,0,300);
-  if (len = sw_acknowledge(hardwareId, "Ping received.", buffer, sizeof(buffer), originator)) {
-    mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
-  }
+  publishAcknowledge("Ping received.", originator);
 }
 
 void handleMotor(ArduinoCustom_motor motor, char* originator) {
-  unsigned int len = 0;
-  memset(buffer,0,300);
-  if (len = sw_acknowledge(hardwareId, "motor received.", buffer, sizeof(buffer), originator)) {
-    mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
-  }
+  publishAcknowledge("motor received.", originator);
 }
 
 /** Handle the 'serialPrintln' command */
 void handleSerialPrintln(ArduinoCustom_serialPrintln serialPrintln,char* originator) {
-  unsigned int len = 0;
-  memset(buffer,0,300);
   OLED_Init();
   char oled_show_line[OLED_DISPLAY_MAX_CHAR_PER_ROW+1] = {'\0'};
   baseEvents_log("%s",serialPrintln.message);
   snprintf(oled_show_line, OLED_DISPLAY_MAX_CHAR_PER_ROW+1, "%s",serialPrintln.message);
   OLED_ShowString(OLED_DISPLAY_COLUMN_START, OLED_DISPLAY_ROW_3, (uint8_t*)oled_show_line);
-  if (len = sw_acknowledge(hardwareId, "Message sent to Serial.println().", buffer, sizeof(buffer), originator)) {
-    mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
-  }
+  publishAcknowledge("Message sent to Serial.println().", originator);
 }
 
 device_func cmdd[50];
 /** Handle the 'testEvents' command */
 void handleTestEvents(ArduinoCustom_testData testEvents, char* originator) {
-  unsigned int len = 0;
-  memset(buffer,0,300);
+  SiteWhere_DeviceMeasurements measurements;
 
   memset(cmdd,0,sizeof(cmdd));
   cmdd[0].engine.temp="humidity";
@@ -113,9 +107,9 @@ void handleTestEvents(ArduinoCustom_testData testEvents, char* originator) {
   cmdd[3].engine.temp="light";
   cmdd[3].engine.value = testEvents.light;
   
-  if (len = sw_measurement(hardwareId,&cmdd[0],4,NULL, buffer, sizeof(buffer), originator)) {
-    mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
-  }
+  /* All four readings in one envelope and one publish */
+  sw_measurement_message(&measurements, hardwareId, &cmdd[0], 4, NULL);
+  sw_publish_message(SiteWhere_Command_DEVICEMEASUREMENT, originator, SiteWhere_DeviceMeasurements_fields, &measurements);
 }
 
 ArduinoCustom_RGB_LED RGB_LED;
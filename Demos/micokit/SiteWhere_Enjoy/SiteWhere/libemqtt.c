@@ -26,6 +26,7 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 #include <libemqtt.h>
 
 #define MQTT_DUP_FLAG     1<<3
@@ -42,6 +43,64 @@
 #define MQTT_PASSWORD_FLAG  1<<6
 
 
+typedef struct {
+	const void* data;
+	uint32_t length;
+} mqtt_part_t;
+
+static uint32_t mqtt_parts_length(const mqtt_part_t* parts, uint8_t count) {
+	uint32_t length = 0;
+	uint8_t i;
+
+	for(i = 0; i < count; i++) {
+		length += parts[i].length;
+	}
+	return length;
+}
+
+// Writes the remaining length in 1 to 4 bytes, returns 0 if it is too large
+static uint8_t mqtt_encode_rem_len(uint32_t length, uint8_t* buf) {
+	uint8_t num_bytes = 0;
+
+	if(length > MQTT_MAX_REM_LEN) {
+		return 0;
+	}
+
+	do {
+		buf[num_bytes] = length % 128;
+		length /= 128;
+		if(length > 0) {
+			buf[num_bytes] |= 0x80;
+		}
+		num_bytes++;
+	} while(length > 0);
+
+	return num_bytes;
+}
+
+static int mqtt_send_parts(mqtt_broker_handle_t* broker, uint8_t header, const mqtt_part_t* parts, uint8_t count) {
+	uint8_t fixed_header[5];
+	uint8_t rlb;
+	uint8_t i;
+
+	fixed_header[0] = header;
+	rlb = mqtt_encode_rem_len(mqtt_parts_length(parts, count), fixed_header+1);
+	if(rlb == 0) {
+		return -1;
+	}
+
+	if(broker->send(broker->socket_info, fixed_header, 1+rlb) < (int)(1+rlb)) {
+		return -1;
+	}
+	for(i = 0; i < count; i++) {
+		if(parts[i].length && broker->send(broker->socket_info, parts[i].data, parts[i].length) < (int)parts[i].length) {
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
 uint8_t mqtt_num_rem_len_bytes(const uint8_t* buf) {
 	uint8_t num_bytes = 1;
 
@@ -59,10 +118,11 @@ uint8_t mqtt_num_rem_len_bytes(const uint8_t* buf) {
 	return num_bytes;
 }
 
-uint16_t mqtt_parse_rem_len(const uint8_t* buf) {
-	uint16_t multiplier = 1;
-	uint16_t value = 0;
+uint32_t mqtt_parse_rem_len(const uint8_t* buf) {
+	uint32_t multiplier = 1;
+	uint32_t value = 0;
 	uint8_t digit;
+	uint8_t num_bytes = 0;
 
 	//printf("mqtt_parse_rem_len\n");
 
@@ -73,7 +133,7 @@ uint16_t mqtt_parse_rem_len(const uint8_t* buf) {
 		value += (digit & 127) * multiplier;
 		multiplier *= 128;
 		buf++;
-	} while ((digit & 128) != 0);
+	} while ((digit & 128) != 0 && ++num_bytes < 4);
 
 	return value;
 }
@@ -91,7 +151,7 @@ uint16_t mqtt_parse_msg_id(const uint8_t* buf) {
 				// fixed header length + Topic (UTF encoded)
 				// = 1 for "flags" byte + rlb for length bytes + topic size
 				uint8_t rlb = mqtt_num_rem_len_bytes(buf);
-				uint8_t offset = *(buf+1+rlb)<<8;	// topic UTF MSB
+				uint32_t offset = *(buf+1+rlb)<<8;	// topic UTF MSB
 				offset |= *(buf+1+rlb+1);			// topic UTF LSB
 				offset += (1+rlb+2);					// fixed header + topic size
 				id = *(buf+offset)<<8;				// id MSB
@@ -139,12 +199,12 @@ uint16_t mqtt_parse_pub_topic_ptr(const uint8_t* buf, const uint8_t **topic_ptr)
 	return len;
 }
 
-uint16_t mqtt_parse_publish_msg(const uint8_t* buf, uint8_t* msg) {
+uint32_t mqtt_parse_publish_msg(const uint8_t* buf, uint8_t* msg) {
 	const uint8_t* ptr;
 
 	//printf("mqtt_parse_publish_msg\n");
 
-	uint16_t msg_len = mqtt_parse_pub_msg_ptr(buf, &ptr);
+	uint32_t msg_len = mqtt_parse_pub_msg_ptr(buf, &ptr);
 
 	if(msg_len != 0 && ptr != NULL) {
 		memcpy(msg, ptr, msg_len);
@@ -153,8 +213,8 @@ uint16_t mqtt_parse_publish_msg(const uint8_t* buf, uint8_t* msg) {
 	return msg_len;
 }
 
-uint16_t mqtt_parse_pub_msg_ptr(const uint8_t* buf, const uint8_t **msg_ptr) {
-	uint16_t len = 0;
+uint32_t mqtt_parse_pub_msg_ptr(const uint8_t* buf, const uint8_t **msg_ptr) {
+	uint32_t len = 0;
 
 	//printf("mqtt_parse_pub_msg_ptr\n");
 
@@ -162,7 +222,7 @@ uint16_t mqtt_parse_pub_msg_ptr(const uint8_t* buf, const uint8_t **msg_ptr) {
 		// message starts at
 		// fixed header length + Topic (UTF encoded) + msg id (if QoS>0)
 		uint8_t rlb = mqtt_num_rem_len_bytes(buf);
-		uint8_t offset = (*(buf+1+rlb))<<8;	// topic UTF MSB
+		uint32_t offset = (*(buf+1+rlb))<<8;	// topic UTF MSB
 		offset |= *(buf+1+rlb+1);			// topic UTF LSB
 		offset += (1+rlb+2);				// fixed header + topic size
 
@@ -177,7 +237,7 @@ uint16_t mqtt_parse_pub_msg_ptr(const uint8_t* buf, const uint8_t **msg_ptr) {
 		// variable header is offset - fixed header
 		// fixed header is 1 + rlb
 		// so, lom = remlen - (offset - (1+rlb))
-      	len = mqtt_parse_rem_len(buf) - (offset-(rlb+1));
+		len = mqtt_parse_rem_len(buf) - (offset-(rlb+1));
 	} else {
 		*msg_ptr = NULL;
 	}
@@ -193,7 +253,7 @@ void mqtt_init(mqtt_broker_handle_t* broker, const char* clientid) {
 	memset(broker->username, 0, sizeof(broker->username));
 	memset(broker->password, 0, sizeof(broker->password));
 	if(clientid) {
-		strncpy(broker->clientid, clientid, sizeof(broker->clientid));
+		strncpy(broker->clientid, clientid, sizeof(broker->clientid)-1);
 	} else {
 		strcpy(broker->clientid, "emqtt");
 	}
@@ -212,22 +272,38 @@ void mqtt_set_alive(mqtt_broker_handle_t* broker, uint16_t alive) {
 	broker->alive = alive;
 }
 
-int mqtt_connect(mqtt_broker_handle_t* broker)
-{
-	uint8_t flags = 0x00;
+static uint16_t mqtt_next_id(mqtt_broker_handle_t* broker) {
+	uint16_t id = broker->seq++;
+
+	if(broker->seq == 0) {
+		broker->seq = 1; // 0 is not a valid message identifier
+	}
+	return id;
+}
 
+typedef struct {
+	uint8_t var_header[12];
+	uint8_t clientid_len[2];
+	uint8_t username_len[2];
+	uint8_t password_len[2];
+} mqtt_connect_header_t;
+
+// Fills parts[7] with a CONNECT, protocol_level 3 is MQTT 3.1 ("MQIsdp"), 4 is MQTT 3.1.1 ("MQTT")
+static uint8_t mqtt_connect_parts(mqtt_broker_handle_t* broker, uint8_t protocol_level, mqtt_connect_header_t* h, mqtt_part_t* parts) {
+	static const uint8_t mqisdp[] = {0x00,0x06,'M','Q','I','s','d','p'};
+	static const uint8_t mqtt[] = {0x00,0x04,'M','Q','T','T'};
 	uint16_t clientidlen = strlen(broker->clientid);
 	uint16_t usernamelen = strlen(broker->username);
 	uint16_t passwordlen = strlen(broker->password);
-	uint16_t payload_len = clientidlen + 2;
+	uint8_t flags = 0x00;
+	uint8_t offset;
+	uint8_t count = 0;
 
 	// Preparing the flags
 	if(usernamelen) {
-		payload_len += usernamelen + 2;
 		flags |= MQTT_USERNAME_FLAG;
 	}
 	if(passwordlen) {
-		payload_len += passwordlen + 2;
 		flags |= MQTT_PASSWORD_FLAG;
 	}
 	if(broker->clean_session) {
@@ -235,73 +311,91 @@ int mqtt_connect(mqtt_broker_handle_t* broker)
 	}
 
 	// Variable header
-	uint8_t var_header[] = {
-		0x00,0x06,0x4d,0x51,0x49,0x73,0x64,0x70, // Protocol name: MQIsdp
-		0x03, // Protocol version
-		flags, // Connect flags
-		broker->alive>>8, broker->alive&0xFF, // Keep alive
-	};
-
+	if(protocol_level == 3) {
+		memcpy(h->var_header, mqisdp, sizeof(mqisdp));
+		offset = sizeof(mqisdp);
+	} else {
+		memcpy(h->var_header, mqtt, sizeof(mqtt));
+		offset = sizeof(mqtt);
+	}
+	h->var_header[offset++] = protocol_level; // Protocol version
+	h->var_header[offset++] = flags; // Connect flags
+	h->var_header[offset++] = broker->alive>>8; // Keep alive
+	h->var_header[offset++] = broker->alive&0xFF;
+	parts[count].data = h->var_header;
+	parts[count++].length = offset;
 
-   	// Fixed header
-    uint8_t fixedHeaderSize = 2;    // Default size = one byte Message Type + one byte Remaining Length
-    uint8_t remainLen = sizeof(var_header)+payload_len;
-    if (remainLen > 127) {
-        fixedHeaderSize++;          // add an additional byte for Remaining Length
-    }
-    uint8_t fixed_header[fixedHeaderSize];
-
-    // Message Type
-    fixed_header[0] = MQTT_MSG_CONNECT;
-
-    // Remaining Length
-    if (remainLen <= 127) {
-        fixed_header[1] = remainLen;
-    } else {
-        // first byte is remainder (mod) of 128, then set the MSB to indicate more bytes
-        fixed_header[1] = remainLen % 128;
-        fixed_header[1] = fixed_header[1] | 0x80;
-        // second byte is number of 128s
-        fixed_header[2] = remainLen / 128;
-    }
-
-	uint16_t offset = 0;
-	uint8_t packet[sizeof(fixed_header)+sizeof(var_header)+payload_len];
-	memset(packet, 0, sizeof(packet));
-	memcpy(packet, fixed_header, sizeof(fixed_header));
-	offset += sizeof(fixed_header);
-	memcpy(packet+offset, var_header, sizeof(var_header));
-	offset += sizeof(var_header);
 	// Client ID - UTF encoded
-	packet[offset++] = clientidlen>>8;
-	packet[offset++] = clientidlen&0xFF;
-	memcpy(packet+offset, broker->clientid, clientidlen);
-	offset += clientidlen;
+	h->clientid_len[0] = clientidlen>>8;
+	h->clientid_len[1] = clientidlen&0xFF;
+	parts[count].data = h->clientid_len;
+	parts[count++].length = 2;
+	parts[count].data = broker->clientid;
+	parts[count++].length = clientidlen;
 
 	if(usernamelen) {
 		// Username - UTF encoded
-		packet[offset++] = usernamelen>>8;
-		packet[offset++] = usernamelen&0xFF;
-		memcpy(packet+offset, broker->username, usernamelen);
-		offset += usernamelen;
+		h->username_len[0] = usernamelen>>8;
+		h->username_len[1] = usernamelen&0xFF;
+		parts[count].data = h->username_len;
+		parts[count++].length = 2;
+		parts[count].data = broker->username;
+		parts[count++].length = usernamelen;
 	}
 
 	if(passwordlen) {
 		// Password - UTF encoded
-		packet[offset++] = passwordlen>>8;
-		packet[offset++] = passwordlen&0xFF;
-		memcpy(packet+offset, broker->password, passwordlen);
-		offset += passwordlen;
+		h->password_len[0] = passwordlen>>8;
+		h->password_len[1] = passwordlen&0xFF;
+		parts[count].data = h->password_len;
+		parts[count++].length = 2;
+		parts[count].data = broker->password;
+		parts[count++].length = passwordlen;
 	}
 
-	// Send the packet
-	if(broker->send(broker->socket_info, packet, sizeof(packet)) < sizeof(packet)) {
-		return -1;
+	return count;
+}
+
+// Fills parts[3] with a PUBLISH variable header and payload
+static uint8_t mqtt_publish_parts(const char* topic, uint16_t message_id, uint8_t qos, uint8_t* topic_len, uint8_t* id, const void* msg, uint32_t msglen, mqtt_part_t* parts) {
+	uint16_t topiclen = strlen(topic);
+	uint8_t count = 0;
+
+	topic_len[0] = topiclen>>8;
+	topic_len[1] = topiclen&0xFF;
+	parts[count].data = topic_len;
+	parts[count++].length = 2;
+	parts[count].data = topic;
+	parts[count++].length = topiclen;
+	if(qos) {
+		id[0] = message_id>>8;
+		id[1] = message_id&0xFF;
+		parts[count].data = id;
+		parts[count++].length = 2;
 	}
-//        for(int i =0;i<sizeof(packet);i++)
-//            printf("%02x ", packet[i]);
+	parts[count].data = msg;
+	parts[count++].length = msglen;
 
-	return 1;
+	return count;
+}
+
+static uint8_t mqtt_qos_flag(uint8_t qos) {
+	if(qos == 1) {
+		return MQTT_QOS1_FLAG;
+	} else if(qos == 2) {
+		return MQTT_QOS2_FLAG;
+	}
+	return MQTT_QOS0_FLAG;
+}
+
+int mqtt_connect(mqtt_broker_handle_t* broker)
+{
+	mqtt_connect_header_t header;
+	mqtt_part_t parts[7];
+	uint8_t count = mqtt_connect_parts(broker, 3, &header, parts);
+
+	// Send the packet
+	return mqtt_send_parts(broker, MQTT_MSG_CONNECT, parts, count);
 }
 
 
@@ -312,7 +406,7 @@ int mqtt_disconnect(mqtt_broker_handle_t* broker) {
 	};
 
 	// Send the packet
-	if(broker->send(broker->socket_info, packet, sizeof(packet)) < sizeof(packet)) {
+	if(broker->send(broker->socket_info, packet, sizeof(packet)) < (int)sizeof(packet)) {
 		return -1;
 	}
 
@@ -326,7 +420,7 @@ int mqtt_ping(mqtt_broker_handle_t* broker) {
 	};
 
 	// Send the packet
-	if(broker->send(broker->socket_info, packet, sizeof(packet)) < sizeof(packet)) {
+	if(broker->send(broker->socket_info, packet, sizeof(packet)) < (int)sizeof(packet)) {
 		return -1;
 	}
 
@@ -336,84 +430,34 @@ int mqtt_ping(mqtt_broker_handle_t* broker) {
 int mqtt_publish(mqtt_broker_handle_t* broker, const char* topic, const char* msg, int msglen, uint8_t retain) {
   return mqtt_publish_with_qos(broker, topic, msg, msglen, retain, 0, NULL);
 }
-int msglen1=0;
-        int sendlength=0;
+
 int mqtt_publish_with_qos(mqtt_broker_handle_t* broker, const char* topic, const char* msg, int msglen, uint8_t retain, uint8_t qos, uint16_t* message_id) {
-	uint16_t topiclen = strlen(topic);
-//	uint16_t msglen = strlen(msg);
-msglen1 =msglen;
-	uint8_t qos_flag = MQTT_QOS0_FLAG;
-	uint8_t qos_size = 0; // No QoS included
-	if(qos == 1) {
-		qos_size = 2; // 2 bytes for QoS
-		qos_flag = MQTT_QOS1_FLAG;
-	}
-	else if(qos == 2) {
-		qos_size = 2; // 2 bytes for QoS
-		qos_flag = MQTT_QOS2_FLAG;
+	uint8_t topic_len[2];
+	uint8_t id[2];
+	uint16_t seq = 0;
+	mqtt_part_t parts[4];
+	uint8_t count;
+	uint8_t header;
+
+	if(msglen < 0 || qos > 2) {
+		return -1;
 	}
 
-	// Variable header
-	uint8_t var_header[topiclen+2+qos_size]; // Topic size (2 bytes), utf-encoded topic
-	memset(var_header, 0, sizeof(var_header));
-	var_header[0] = topiclen>>8;
-	var_header[1] = topiclen&0xFF;
-	memcpy(var_header+2, topic, topiclen);
-	if(qos_size) {
-		var_header[topiclen+2] = broker->seq>>8;
-		var_header[topiclen+3] = broker->seq&0xFF;
+	if(qos) {
+		seq = mqtt_next_id(broker);
 		if(message_id) { // Returning message id
-			*message_id = broker->seq;
+			*message_id = seq;
 		}
-		broker->seq++;
-	}
-
-	// Fixed header
-	// the remaining length is one byte for messages up to 127 bytes, then two bytes after that
-	// actually, it can be up to 4 bytes but I'm making the assumption the embedded device will only
-	// need up to two bytes of length (handles up to 16,383 (almost 16k) sized message)
-	uint8_t fixedHeaderSize = 2;    // Default size = one byte Message Type + one byte Remaining Length
-	uint16_t remainLen = sizeof(var_header)+msglen1;
-	if (remainLen > 127) {
-		fixedHeaderSize++;          // add an additional byte for Remaining Length
 	}
-	uint8_t fixed_header[fixedHeaderSize];
 
-   // Message Type, DUP flag, QoS level, Retain
-   fixed_header[0] = MQTT_MSG_PUBLISH | qos_flag;
+	// Message Type, DUP flag, QoS level, Retain
+	header = MQTT_MSG_PUBLISH | mqtt_qos_flag(qos);
 	if(retain) {
-		fixed_header[0] |= MQTT_RETAIN_FLAG;
-   }
-   // Remaining Length
-   if (remainLen <= 127) {
-       fixed_header[1] = remainLen;
-   } else {
-       // first byte is remainder (mod) of 128, then set the MSB to indicate more bytes
-       fixed_header[1] = remainLen % 128;
-       fixed_header[1] = fixed_header[1] | 0x80;
-       // second byte is number of 128s
-       fixed_header[2] = remainLen / 128;
-   }
-
-	uint8_t packet[sizeof(fixed_header)+sizeof(var_header)+msglen1];
-	memset(packet, 0, sizeof(packet));
-	memcpy(packet, fixed_header, sizeof(fixed_header));
-	memcpy(packet+sizeof(fixed_header), var_header, sizeof(var_header));
-	memcpy(packet+sizeof(fixed_header)+sizeof(var_header), msg, msglen1);
-
-//        sendlength=send(broker->socket_info, packet, sizeof(packet));
-//        printf("len : %d\r\n", sizeof(packet));
-//	if(sendlength< sizeof(packet)) {
-//		return -1;
-//	}
-////        for(int i=0;i<sendlength;i++){
-////            printf("%02x ", packet[i]);
-////        }
-	if(broker->send(broker->socket_info, packet, sizeof(packet)) < sizeof(packet)) {
-		return -1;
+		header |= MQTT_RETAIN_FLAG;
 	}
 
-	return 1;
+	count = mqtt_publish_parts(topic, seq, qos, topic_len, id, msg, msglen, parts);
+	return mqtt_send_parts(broker, header, parts, count);
 }
 
 int mqtt_pubrel(mqtt_broker_handle_t* broker, uint16_t message_id) {
@@ -425,7 +469,7 @@ int mqtt_pubrel(mqtt_broker_handle_t* broker, uint16_t message_id) {
 	};
 
 	// Send the packet
-	if(broker->send(broker->socket_info, packet, sizeof(packet)) < sizeof(packet)) {
+	if(broker->send(broker->socket_info, packet, sizeof(packet)) < (int)sizeof(packet)) {
 		return -1;
 	}
 
@@ -434,78 +478,705 @@ int mqtt_pubrel(mqtt_broker_handle_t* broker, uint16_t message_id) {
 
 int mqtt_subscribe(mqtt_broker_handle_t* broker, const char* topic, uint16_t* message_id) {
 	uint16_t topiclen = strlen(topic);
+	uint16_t seq = mqtt_next_id(broker);
+	uint8_t var_header[4]; // Message ID, topic size
+	uint8_t qos = 0;
+	mqtt_part_t parts[3] = {
+		{var_header, sizeof(var_header)},
+		{topic, topiclen},
+		{&qos, 1},
+	};
 
-	// Variable header
-	uint8_t var_header[2]; // Message ID
-	var_header[0] = broker->seq>>8;
-	var_header[1] = broker->seq&0xFF;
+	var_header[0] = seq>>8;
+	var_header[1] = seq&0xFF;
+	var_header[2] = topiclen>>8;
+	var_header[3] = topiclen&0xFF;
 	if(message_id) { // Returning message id
-		*message_id = broker->seq;
+		*message_id = seq;
 	}
-	broker->seq++;
 
-	// utf topic
-	uint8_t utf_topic[topiclen+3]; // Topic size (2 bytes), utf-encoded topic, QoS byte
-	memset(utf_topic, 0, sizeof(utf_topic));
-	utf_topic[0] = topiclen>>8;
-	utf_topic[1] = topiclen&0xFF;
-	memcpy(utf_topic+2, topic, topiclen);
+	return mqtt_send_parts(broker, MQTT_MSG_SUBSCRIBE | MQTT_QOS1_FLAG, parts, 3);
+}
 
-	// Fixed header
-	uint8_t fixed_header[] = {
-		MQTT_MSG_SUBSCRIBE | MQTT_QOS1_FLAG, // Message Type, DUP flag, QoS level, Retain
-		sizeof(var_header)+sizeof(utf_topic)
+int mqtt_unsubscribe(mqtt_broker_handle_t* broker, const char* topic, uint16_t* message_id) {
+	uint16_t topiclen = strlen(topic);
+	uint16_t seq = mqtt_next_id(broker);
+	uint8_t var_header[4]; // Message ID, topic size
+	mqtt_part_t parts[2] = {
+		{var_header, sizeof(var_header)},
+		{topic, topiclen},
 	};
 
-	uint8_t packet[sizeof(var_header)+sizeof(fixed_header)+sizeof(utf_topic)];
-	memset(packet, 0, sizeof(packet));
-	memcpy(packet, fixed_header, sizeof(fixed_header));
-	memcpy(packet+sizeof(fixed_header), var_header, sizeof(var_header));
-	memcpy(packet+sizeof(fixed_header)+sizeof(var_header), utf_topic, sizeof(utf_topic));
+	var_header[0] = seq>>8;
+	var_header[1] = seq&0xFF;
+	var_header[2] = topiclen>>8;
+	var_header[3] = topiclen&0xFF;
+	if(message_id) { // Returning message id
+		*message_id = seq;
+	}
 
-	// Send the packet
-	if(broker->send(broker->socket_info, packet, sizeof(packet)) < sizeof(packet)) {
+	return mqtt_send_parts(broker, MQTT_MSG_UNSUBSCRIBE | MQTT_QOS1_FLAG, parts, 2);
+}
+
+
+/*
+ * Event-driven client engine
+ */
+
+// Queues one packet, returns 1 on success, 0 if the transmit ring is too full
+static int client_queue(mqtt_client_t* client, uint8_t header, const mqtt_part_t* parts, uint8_t count) {
+	uint8_t fixed_header[5];
+	uint8_t rlb;
+	uint8_t i;
+
+	fixed_header[0] = header;
+	rlb = mqtt_encode_rem_len(mqtt_parts_length(parts, count), fixed_header+1);
+	if(rlb == 0) {
+		return 0;
+	}
+	if(ring_buffer_free_space(&client->tx_ring) < 1 + rlb + mqtt_parts_length(parts, count)) {
+		return 0;
+	}
+
+	ring_buffer_write(&client->tx_ring, fixed_header, 1+rlb);
+	for(i = 0; i < count; i++) {
+		ring_buffer_write(&client->tx_ring, parts[i].data, parts[i].length);
+	}
+	client->stats.tx_packets++;
+
+	return 1;
+}
+
+static int client_queue_ack(mqtt_client_t* client, uint8_t header, uint16_t message_id) {
+	uint8_t id[2] = {message_id>>8, message_id&0xFF};
+	mqtt_part_t part = {id, sizeof(id)};
+
+	return client_queue(client, header, &part, 1);
+}
+
+// Queues a stored PUBLISH again with DUP set, or the PUBREL that follows it
+static int client_queue_inflight(mqtt_client_t* client, mqtt_inflight_t* entry) {
+	if(entry->type == MQTT_MSG_PUBREL) {
+		return client_queue_ack(client, MQTT_MSG_PUBREL | MQTT_QOS1_FLAG, entry->msg_id);
+	}
+
+	if(ring_buffer_free_space(&client->tx_ring) < entry->length) {
+		return 0;
+	}
+	entry->packet[0] |= MQTT_DUP_FLAG;
+	ring_buffer_write(&client->tx_ring, entry->packet, entry->length);
+	client->stats.tx_packets++;
+	return 1;
+}
+
+static mqtt_inflight_t* client_find_inflight(mqtt_client_t* client, uint8_t type, uint16_t message_id) {
+	uint8_t i;
+
+	for(i = 0; i < MQTT_CLIENT_INFLIGHT; i++) {
+		if(client->inflight[i].type == type && client->inflight[i].msg_id == message_id) {
+			return &client->inflight[i];
+		}
+	}
+	return NULL;
+}
+
+static void client_release_inflight(mqtt_inflight_t* entry) {
+	if(entry->packet) {
+		free(entry->packet);
+	}
+	memset(entry, 0, sizeof(mqtt_inflight_t));
+}
+
+static void client_event(mqtt_client_t* client, mqtt_client_event_t event, uint16_t message_id, uint8_t code) {
+	if(client->ops->on_event) {
+		client->ops->on_event(client, event, message_id, code);
+	}
+}
+
+static int client_lost(mqtt_client_t* client, uint8_t code) {
+	client->state = MQTT_CLIENT_DISCONNECTED;
+	client_event(client, MQTT_EVENT_DISCONNECTED, 0, code);
+	return -1;
+}
+
+// Records an inbound QoS 2 id, returns 0 if it was already delivered
+static int client_qos2_first(mqtt_client_t* client, uint16_t message_id) {
+	uint8_t i;
+	uint8_t free_slot = MQTT_CLIENT_QOS2_IDS;
+
+	for(i = 0; i < MQTT_CLIENT_QOS2_IDS; i++) {
+		if(client->qos2_ids[i] == message_id) {
+			return 0;
+		}
+		if(client->qos2_ids[i] == 0 && free_slot == MQTT_CLIENT_QOS2_IDS) {
+			free_slot = i;
+		}
+	}
+	// A full list forgets the oldest id, the worst case is a duplicate delivery
+	if(free_slot == MQTT_CLIENT_QOS2_IDS) {
+		memmove(client->qos2_ids, client->qos2_ids+1, sizeof(client->qos2_ids)-sizeof(uint16_t));
+		free_slot = MQTT_CLIENT_QOS2_IDS-1;
+	}
+	client->qos2_ids[free_slot] = message_id;
+	return 1;
+}
+
+static void client_qos2_release(mqtt_client_t* client, uint16_t message_id) {
+	uint8_t i;
+
+	for(i = 0; i < MQTT_CLIENT_QOS2_IDS; i++) {
+		if(client->qos2_ids[i] == message_id) {
+			client->qos2_ids[i] = 0;
+		}
+	}
+}
+
+// Decodes the fixed header, returns 1 with the packet length, 0 if more bytes are needed, -1 if malformed
+static int client_frame_length(const uint8_t* buf, uint32_t have, uint32_t* length) {
+	uint32_t value = 0;
+	uint32_t multiplier = 1;
+	uint8_t i;
+
+	for(i = 1; i <= 4; i++) {
+		if(i >= have) {
+			return 0;
+		}
+		value += (buf[i] & 127) * multiplier;
+		multiplier *= 128;
+		if((buf[i] & 128) == 0) {
+			*length = 1 + i + value;
+			return 1;
+		}
+	}
+	return -1;
+}
+
+// Acknowledges and delivers one complete packet, returns -1 to drop the connection
+static int client_dispatch(mqtt_client_t* client, const uint8_t* buf, uint32_t length) {
+	uint8_t type = MQTTParseMessageType(buf);
+	uint8_t rlb = mqtt_num_rem_len_bytes(buf);
+	const uint8_t* body = buf + 1 + rlb;
+	uint32_t rem_len = length - 1 - rlb;
+	uint16_t message_id = 0;
+	mqtt_inflight_t* entry;
+	uint8_t i;
+
+	client->stats.rx_packets++;
+
+	if(type != MQTT_MSG_PINGRESP && type != MQTT_MSG_PUBLISH) {
+		if(rem_len < 2) {
+			return client_lost(client, 2);
+		}
+		message_id = (body[0]<<8) | body[1];
+	}
+
+	switch(type) {
+	case MQTT_MSG_CONNACK:
+		if(client->state != MQTT_CLIENT_CONNECTING) {
+			return client_lost(client, 2);
+		}
+		if(body[1] != 0) {
+			client->state = MQTT_CLIENT_DISCONNECTED;
+			client_event(client, MQTT_EVENT_CONNECT_REFUSED, 0, body[1]);
+			return -1;
+		}
+		client->state = MQTT_CLIENT_CONNECTED;
+		client->ping_outstanding = 0;
+		// Delivery is at least once across reconnects, with or without a clean session
+		for(i = 0; i < MQTT_CLIENT_INFLIGHT; i++) {
+			if(client->inflight[i].type && client_queue_inflight(client, &client->inflight[i])) {
+				client->inflight[i].sent_at = client->now;
+				client->stats.retransmits++;
+			}
+		}
+		client_event(client, MQTT_EVENT_CONNECTED, 0, body[0] & 0x01);
+		break;
+
+	case MQTT_MSG_PUBLISH: {
+		uint8_t qos = MQTTParseMessageQos(buf);
+		uint16_t topic_len;
+		uint32_t header_len;
+
+		if(rem_len < 2 || qos > 2) {
+			return client_lost(client, 2);
+		}
+		topic_len = (body[0]<<8) | body[1];
+		header_len = 2 + topic_len + (qos ? 2 : 0);
+		if(header_len > rem_len) {
+			return client_lost(client, 2);
+		}
+		if(qos) {
+			message_id = (body[2+topic_len]<<8) | body[2+topic_len+1];
+		}
+
+		// An ack that does not fit is simply not sent, the broker sends the message again
+		if(qos == 1) {
+			client_queue_ack(client, MQTT_MSG_PUBACK, message_id);
+		} else if(qos == 2) {
+			client_queue_ack(client, MQTT_MSG_PUBREC, message_id);
+			if(!client_qos2_first(client, message_id)) {
+				break;
+			}
+		}
+		if(client->ops->on_message) {
+			client->ops->on_message(client, (const char*)body+2, topic_len, body+header_len, rem_len-header_len, qos);
+		}
+		break;
+	}
+
+	case MQTT_MSG_PUBACK:
+		entry = client_find_inflight(client, MQTT_MSG_PUBLISH, message_id);
+		if(entry) {
+			client_release_inflight(entry);
+			client_event(client, MQTT_EVENT_PUBLISHED, message_id, 1);
+		}
+		break;
+
+	case MQTT_MSG_PUBREC:
+		entry = client_find_inflight(client, MQTT_MSG_PUBLISH, message_id);
+		if(entry) {
+			free(entry->packet);
+			entry->packet = NULL;
+			entry->length = 0;
+			entry->type = MQTT_MSG_PUBREL;
+			entry->retries = 0;
+			entry->sent_at = client->now;
+		}
+		client_queue_ack(client, MQTT_MSG_PUBREL | MQTT_QOS1_FLAG, message_id);
+		break;
+
+	case MQTT_MSG_PUBREL:
+		client_qos2_release(client, message_id);
+		client_queue_ack(client, MQTT_MSG_PUBCOMP, message_id);
+		break;
+
+	case MQTT_MSG_PUBCOMP:
+		entry = client_find_inflight(client, MQTT_MSG_PUBREL, message_id);
+		if(entry) {
+			client_release_inflight(entry);
+			client_event(client, MQTT_EVENT_PUBLISHED, message_id, 2);
+		}
+		break;
+
+	case MQTT_MSG_SUBACK:
+		client_event(client, MQTT_EVENT_SUBACK, message_id, rem_len > 2 ? body[2] : 0x80);
+		break;
+
+	case MQTT_MSG_UNSUBACK:
+		client_event(client, MQTT_EVENT_UNSUBACK, message_id, 0);
+		break;
+
+	case MQTT_MSG_PINGRESP:
+		client->ping_outstanding = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int client_receive(mqtt_client_t* client) {
+	uint32_t length;
+	uint32_t offset;
+	int ret;
+
+	for(;;) {
+		ret = client->ops->recv(client->broker.socket_info, client->rx_buf + client->rx_have, sizeof(client->rx_buf) - client->rx_have);
+		if(ret == 0) {
+			return 0;
+		} else if(ret < 0) {
+			return client_lost(client, 0);
+		}
+		client->last_rx = client->now;
+
+		// Discard the rest of an oversized packet
+		if(client->rx_skip) {
+			uint32_t skip = (uint32_t)ret < client->rx_skip ? (uint32_t)ret : client->rx_skip;
+			memmove(client->rx_buf, client->rx_buf + skip, ret - skip);
+			client->rx_skip -= skip;
+			ret -= skip;
+		}
+		client->rx_have += ret;
+
+		// Dispatch every complete packet, keep a partial one for the next read
+		offset = 0;
+		while(client->rx_have - offset >= 2) {
+			ret = client_frame_length(client->rx_buf + offset, client->rx_have - offset, &length);
+			if(ret < 0) {
+				return client_lost(client, 2);
+			} else if(ret == 0) {
+				break;
+			}
+			if(length > sizeof(client->rx_buf)) {
+				client->stats.rx_skipped++;
+				client->rx_skip = length - (client->rx_have - offset);
+				offset = client->rx_have;
+				break;
+			}
+			if(length > client->rx_have - offset) {
+				break;
+			}
+			if(client_dispatch(client, client->rx_buf + offset, length) < 0) {
+				return -1;
+			}
+			offset += length;
+		}
+		if(offset) {
+			memmove(client->rx_buf, client->rx_buf + offset, client->rx_have - offset);
+			client->rx_have -= offset;
+		}
+	}
+}
+
+static int client_timers(mqtt_client_t* client) {
+	uint32_t keep_alive_ms = client->broker.alive * 1000UL;
+	uint8_t i;
+
+	if(client->state == MQTT_CLIENT_CONNECTING) {
+		if(client->now - client->ping_sent >= MQTT_CLIENT_RETRY_MS) {
+			return client_lost(client, 1);
+		}
+		return 0;
+	}
+
+	for(i = 0; i < MQTT_CLIENT_INFLIGHT; i++) {
+		mqtt_inflight_t* entry = &client->inflight[i];
+
+		if(entry->type == 0 || client->now - entry->sent_at < MQTT_CLIENT_RETRY_MS) {
+			continue;
+		}
+		if(entry->retries >= MQTT_CLIENT_MAX_RETRIES) {
+			uint16_t message_id = entry->msg_id;
+			client_release_inflight(entry);
+			client_event(client, MQTT_EVENT_PUBLISH_FAILED, message_id, 0);
+		} else if(client_queue_inflight(client, entry)) {
+			entry->retries++;
+			entry->sent_at = client->now;
+			client->stats.retransmits++;
+		}
+	}
+
+	if(keep_alive_ms) {
+		if(client->ping_outstanding) {
+			if(client->now - client->ping_sent >= keep_alive_ms / 2) {
+				return client_lost(client, 1);
+			}
+		} else if(client->now - client->last_tx >= keep_alive_ms - keep_alive_ms / 4) {
+			// Ping a quarter period early so a slow poll cannot miss the deadline
+			uint8_t packet[2] = {MQTT_MSG_PINGREQ, 0x00};
+			if(ring_buffer_free_space(&client->tx_ring) >= sizeof(packet)) {
+				ring_buffer_write(&client->tx_ring, packet, sizeof(packet));
+				client->stats.tx_packets++;
+				client->ping_outstanding = 1;
+				client->ping_sent = client->now;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// Sends as much of the queue as the socket takes, each call may carry several packets
+static int client_flush(mqtt_client_t* client) {
+	uint8_t* data;
+	uint32_t length;
+	int ret;
+
+	while(ring_buffer_used_space(&client->tx_ring)) {
+		ring_buffer_get_data(&client->tx_ring, &data, &length);
+		ret = client->ops->send(client->broker.socket_info, data, length);
+		if(ret < 0) {
+			return client_lost(client, 0);
+		} else if(ret == 0) {
+			break;
+		}
+		ring_buffer_consume(&client->tx_ring, ret);
+		client->last_tx = client->now;
+		client->stats.tx_batches++;
+		if((uint32_t)ret < length) {
+			break;
+		}
+	}
+	return 0;
+}
+
+void mqtt_client_init(mqtt_client_t* client, const mqtt_client_ops_t* ops, void* socket_info, const char* clientid) {
+	memset(client, 0, sizeof(mqtt_client_t));
+	mqtt_init(&client->broker, clientid);
+	client->broker.socket_info = socket_info;
+	client->broker.send = ops->send;
+	client->ops = ops;
+	ring_buffer_init(&client->tx_ring, client->tx_buf, sizeof(client->tx_buf));
+}
+
+int mqtt_client_connect(mqtt_client_t* client, void* socket_info, uint32_t now) {
+	mqtt_connect_header_t header;
+	mqtt_part_t parts[7];
+	uint8_t count;
+
+	client->broker.socket_info = socket_info;
+	client->tx_ring.head = client->tx_ring.tail = 0;
+	client->tx_reserved = 0;
+	client->rx_have = 0;
+	client->rx_skip = 0;
+	client->ping_outstanding = 0;
+	client->now = client->last_tx = client->last_rx = client->ping_sent = now;
+	client->state = MQTT_CLIENT_CONNECTING;
+
+	count = mqtt_connect_parts(&client->broker, 4, &header, parts);
+	if(!client_queue(client, MQTT_MSG_CONNECT, parts, count)) {
+		client->state = MQTT_CLIENT_DISCONNECTED;
 		return -1;
 	}
+	return 1;
+}
 
+int mqtt_client_disconnect(mqtt_client_t* client) {
+	uint8_t packet[2] = {MQTT_MSG_DISCONNECT, 0x00};
+
+	if(client->state == MQTT_CLIENT_DISCONNECTED) {
+		return 1;
+	}
+	if(ring_buffer_free_space(&client->tx_ring) >= sizeof(packet)) {
+		ring_buffer_write(&client->tx_ring, packet, sizeof(packet));
+	}
+	client_flush(client);
+	client->state = MQTT_CLIENT_DISCONNECTED;
 	return 1;
 }
 
-int mqtt_unsubscribe(mqtt_broker_handle_t* broker, const char* topic, uint16_t* message_id) {
+int mqtt_client_publish(mqtt_client_t* client, const char* topic, const void* payload, uint32_t length, uint8_t qos, uint8_t retain, uint16_t* message_id) {
+	mqtt_inflight_t* entry = NULL;
+	uint8_t topic_len[2];
+	uint8_t id[2];
+	uint16_t seq = 0;
+	mqtt_part_t parts[4];
+	uint8_t fixed_header[5];
+	uint8_t count;
+	uint8_t rlb;
+	uint32_t total;
+	uint8_t i;
+
+	if(topic == NULL || qos > 2 || (length && payload == NULL)) {
+		return -1;
+	}
+	if(client->state == MQTT_CLIENT_DISCONNECTED) {
+		return 0;
+	}
+
+	if(qos) {
+		for(i = 0; i < MQTT_CLIENT_INFLIGHT && entry == NULL; i++) {
+			if(client->inflight[i].type == 0) {
+				entry = &client->inflight[i];
+			}
+		}
+		if(entry == NULL) {
+			return 0;
+		}
+		seq = client->broker.seq;
+	}
+
+	fixed_header[0] = MQTT_MSG_PUBLISH | mqtt_qos_flag(qos) | (retain ? MQTT_RETAIN_FLAG : 0);
+	count = mqtt_publish_parts(topic, seq, qos, topic_len, id, payload, length, parts);
+	rlb = mqtt_encode_rem_len(mqtt_parts_length(parts, count), fixed_header+1);
+	if(rlb == 0) {
+		return -1;
+	}
+	total = 1 + rlb + mqtt_parts_length(parts, count);
+	if(total > MQTT_CLIENT_TX_SIZE - 1) {
+		return -1;
+	}
+	if(ring_buffer_free_space(&client->tx_ring) < total) {
+		return 0;
+	}
+
+	if(qos) {
+		// Keep a flat copy for retransmission
+		uint8_t* packet = malloc(total);
+		uint32_t offset = 1 + rlb;
+
+		if(packet == NULL) {
+			return 0;
+		}
+		memcpy(packet, fixed_header, 1 + rlb);
+		for(i = 0; i < count; i++) {
+			memcpy(packet + offset, parts[i].data, parts[i].length);
+			offset += parts[i].length;
+		}
+		entry->type = MQTT_MSG_PUBLISH;
+		entry->msg_id = mqtt_next_id(&client->broker);
+		entry->retries = 0;
+		entry->sent_at = client->now;
+		entry->packet = packet;
+		entry->length = total;
+		if(message_id) {
+			*message_id = entry->msg_id;
+		}
+		ring_buffer_write(&client->tx_ring, packet, total);
+		client->stats.tx_packets++;
+	} else {
+		client_queue(client, fixed_header[0], parts, count);
+	}
+
+	return 1;
+}
+
+// Copies into the two segments of a ring reservation, starting offset bytes in
+static void client_copy_reserved(uint8_t* data1, uint32_t length1, uint8_t* data2, uint32_t offset, const void* src, uint32_t length) {
+	const uint8_t* from = src;
+
+	if(offset < length1) {
+		uint32_t first = length1 - offset < length ? length1 - offset : length;
+		memcpy(data1 + offset, from, first);
+		from += first;
+		length -= first;
+		offset = length1;
+	}
+	memcpy(data2 + (offset - length1), from, length);
+}
+
+int mqtt_client_publish_reserve(mqtt_client_t* client, const char* topic, uint32_t length, uint8_t retain, uint8_t** data1, uint32_t* length1, uint8_t** data2, uint32_t* length2) {
+	uint8_t topic_len[2];
+	uint8_t id[2];
+	mqtt_part_t parts[4];
+	uint8_t fixed_header[5];
+	uint8_t* seg1;
+	uint8_t* seg2;
+	uint32_t seg1_len;
+	uint32_t seg2_len;
+	uint32_t header_len;
+	uint32_t total;
+	uint8_t count;
+	uint8_t rlb;
+	uint8_t i;
+
+	client->tx_reserved = 0;
+	if(topic == NULL) {
+		return -1;
+	}
+
+	fixed_header[0] = MQTT_MSG_PUBLISH | (retain ? MQTT_RETAIN_FLAG : 0);
+	count = mqtt_publish_parts(topic, 0, 0, topic_len, id, NULL, length, parts);
+	rlb = mqtt_encode_rem_len(mqtt_parts_length(parts, count), fixed_header+1);
+	if(rlb == 0) {
+		return -1;
+	}
+	total = 1 + rlb + mqtt_parts_length(parts, count);
+	if(total > MQTT_CLIENT_TX_SIZE - 1) {
+		return -1;
+	}
+	if(client->state == MQTT_CLIENT_DISCONNECTED) {
+		return 0;
+	}
+	if(ring_buffer_write_reserve(&client->tx_ring, &seg1, &seg1_len, &seg2, &seg2_len) < total) {
+		return 0;
+	}
+
+	// Fixed header and topic, the payload is the last part
+	client_copy_reserved(seg1, seg1_len, seg2, 0, fixed_header, 1 + rlb);
+	header_len = 1 + rlb;
+	for(i = 0; i + 1 < count; i++) {
+		client_copy_reserved(seg1, seg1_len, seg2, header_len, parts[i].data, parts[i].length);
+		header_len += parts[i].length;
+	}
+
+	if(header_len < seg1_len) {
+		*data1 = seg1 + header_len;
+		*length1 = seg1_len - header_len < length ? seg1_len - header_len : length;
+		*data2 = seg2;
+		*length2 = length - *length1;
+	} else {
+		*data1 = seg2 + (header_len - seg1_len);
+		*length1 = length;
+		*data2 = NULL;
+		*length2 = 0;
+	}
+	client->tx_reserved = total;
+	client->tx_reserved_at = client->tx_ring.tail;
+	return 1;
+}
+
+void mqtt_client_publish_commit(mqtt_client_t* client) {
+	// Anything queued since the reservation has overwritten it
+	if(client->tx_reserved && client->tx_reserved_at == client->tx_ring.tail) {
+		ring_buffer_write_commit(&client->tx_ring, client->tx_reserved);
+		client->stats.tx_packets++;
+	}
+	client->tx_reserved = 0;
+}
+
+int mqtt_client_subscribe(mqtt_client_t* client, const char* topic, uint8_t qos, uint16_t* message_id) {
 	uint16_t topiclen = strlen(topic);
+	uint16_t seq = client->broker.seq;
+	uint8_t var_header[4]; // Message ID, topic size
+	mqtt_part_t parts[3] = {
+		{var_header, sizeof(var_header)},
+		{topic, topiclen},
+		{&qos, 1},
+	};
 
-	// Variable header
-	uint8_t var_header[2]; // Message ID
-	var_header[0] = broker->seq>>8;
-	var_header[1] = broker->seq&0xFF;
-	if(message_id) { // Returning message id
-		*message_id = broker->seq;
+	if(client->state == MQTT_CLIENT_DISCONNECTED) {
+		return 0;
 	}
-	broker->seq++;
 
-	// utf topic
-	uint8_t utf_topic[topiclen+2]; // Topic size (2 bytes), utf-encoded topic
-	memset(utf_topic, 0, sizeof(utf_topic));
-	utf_topic[0] = topiclen>>8;
-	utf_topic[1] = topiclen&0xFF;
-	memcpy(utf_topic+2, topic, topiclen);
+	var_header[0] = seq>>8;
+	var_header[1] = seq&0xFF;
+	var_header[2] = topiclen>>8;
+	var_header[3] = topiclen&0xFF;
+	if(!client_queue(client, MQTT_MSG_SUBSCRIBE | MQTT_QOS1_FLAG, parts, 3)) {
+		return 0;
+	}
+	mqtt_next_id(&client->broker);
+	if(message_id) { // Returning message id
+		*message_id = seq;
+	}
+	return 1;
+}
 
-	// Fixed header
-	uint8_t fixed_header[] = {
-		MQTT_MSG_UNSUBSCRIBE | MQTT_QOS1_FLAG, // Message Type, DUP flag, QoS level, Retain
-		sizeof(var_header)+sizeof(utf_topic)
+int mqtt_client_unsubscribe(mqtt_client_t* client, const char* topic, uint16_t* message_id) {
+	uint16_t topiclen = strlen(topic);
+	uint16_t seq = client->broker.seq;
+	uint8_t var_header[4]; // Message ID, topic size
+	mqtt_part_t parts[2] = {
+		{var_header, sizeof(var_header)},
+		{topic, topiclen},
 	};
 
-	uint8_t packet[sizeof(var_header)+sizeof(fixed_header)+sizeof(utf_topic)];
-	memset(packet, 0, sizeof(packet));
-	memcpy(packet, fixed_header, sizeof(fixed_header));
-	memcpy(packet+sizeof(fixed_header), var_header, sizeof(var_header));
-	memcpy(packet+sizeof(fixed_header)+sizeof(var_header), utf_topic, sizeof(utf_topic));
+	if(client->state == MQTT_CLIENT_DISCONNECTED) {
+		return 0;
+	}
 
-	// Send the packet
-	if(broker->send(broker->socket_info, packet, sizeof(packet)) < sizeof(packet)) {
+	var_header[0] = seq>>8;
+	var_header[1] = seq&0xFF;
+	var_header[2] = topiclen>>8;
+	var_header[3] = topiclen&0xFF;
+	if(!client_queue(client, MQTT_MSG_UNSUBSCRIBE | MQTT_QOS1_FLAG, parts, 2)) {
+		return 0;
+	}
+	mqtt_next_id(&client->broker);
+	if(message_id) { // Returning message id
+		*message_id = seq;
+	}
+	return 1;
+}
+
+int mqtt_client_poll(mqtt_client_t* client, uint32_t now) {
+	client->now = now;
+
+	if(client->state == MQTT_CLIENT_DISCONNECTED) {
+		return -1;
+	}
+	if(client_receive(client) < 0) {
+		return -1;
+	}
+	if(client_timers(client) < 0) {
 		return -1;
 	}
+	return client_flush(client);
+}
 
-	return 1;
-}
\ No newline at end of file
+int mqtt_client_wants_write(mqtt_client_t* client) {
+	return client->state != MQTT_CLIENT_DISCONNECTED && ring_buffer_used_space(&client->tx_ring) != 0;
+}
@@ -29,6 +29,7 @@
 #define __LIBEMQTT_H__
 
 #include <stdint.h>
+#include "RingBufferUtils.h"
 
 #ifndef MQTT_CONF_USERNAME_LENGTH
 	#define MQTT_CONF_USERNAME_LENGTH 13 // Recommended by MQTT Specification (12 + '\0')
@@ -106,7 +107,7 @@ uint8_t mqtt_num_rem_len_bytes(const uint8_t* buf);
  *
  * @retval remaining length
  */
-uint16_t mqtt_parse_rem_len(const uint8_t* buf);
+uint32_t mqtt_parse_rem_len(const uint8_t* buf);
 
 /** Parse packet buffer for message id.
  *
@@ -144,13 +145,13 @@ uint16_t mqtt_parse_pub_topic_ptr(const uint8_t* buf, const uint8_t** topic_ptr)
  *
  * @retval size in bytes of topic (0 = no publish message in buffer)
  */
-uint16_t mqtt_parse_publish_msg(const uint8_t* buf, uint8_t* msg);
+uint32_t mqtt_parse_publish_msg(const uint8_t* buf, uint8_t* msg);
 
 /** Parse a packet buffer for a pointer to the publish message.
  *
  *  Not called directly - called by mqtt_parse_pub_msg
  */
-uint16_t mqtt_parse_pub_msg_ptr(const uint8_t* buf, const uint8_t** msg_ptr);
+uint32_t mqtt_parse_pub_msg_ptr(const uint8_t* buf, const uint8_t** msg_ptr);
 
 
 typedef struct {
@@ -284,4 +285,159 @@ int mqtt_unsubscribe(mqtt_broker_handle_t* broker, const char* topic, uint16_t*
 int mqtt_ping(mqtt_broker_handle_t* broker);
 
 
+/*
+ * Event-driven MQTT 3.1.1 client engine.
+ *
+ * The engine never blocks. Packets are framed into a transmit ring and go
+ * out, several per send() where possible, from mqtt_client_poll(). The
+ * receive side is fed whatever the socket has and reassembles packets
+ * across reads. The owner thread waits in select() (read, plus write while
+ * mqtt_client_wants_write()) and calls mqtt_client_poll() after every
+ * wake-up and at least once a second for the timers.
+ *
+ * QoS 1 and 2 publishes are kept in an in-flight window until acknowledged.
+ * They are sent again with DUP set after MQTT_CLIENT_RETRY_MS and after a
+ * reconnect, and reported as failed after MQTT_CLIENT_MAX_RETRIES.
+ */
+
+#ifndef MQTT_CLIENT_RX_SIZE
+	#define MQTT_CLIENT_RX_SIZE      1024  // largest inbound packet, bigger ones are skipped
+#endif
+
+#ifndef MQTT_CLIENT_TX_SIZE
+	#define MQTT_CLIENT_TX_SIZE      1024  // outbound queue, one byte is kept free
+#endif
+
+#ifndef MQTT_CLIENT_INFLIGHT
+	#define MQTT_CLIENT_INFLIGHT     4     // unacknowledged QoS 1/2 publishes
+#endif
+
+#ifndef MQTT_CLIENT_RETRY_MS
+	#define MQTT_CLIENT_RETRY_MS     10000
+#endif
+
+#ifndef MQTT_CLIENT_MAX_RETRIES
+	#define MQTT_CLIENT_MAX_RETRIES  3
+#endif
+
+#ifndef MQTT_CLIENT_QOS2_IDS
+	#define MQTT_CLIENT_QOS2_IDS     4     // inbound QoS 2 ids waiting for PUBREL
+#endif
+
+#define MQTT_MAX_REM_LEN          268435455
+
+typedef enum {
+	MQTT_CLIENT_DISCONNECTED = 0,
+	MQTT_CLIENT_CONNECTING,       // CONNECT queued, waiting for CONNACK
+	MQTT_CLIENT_CONNECTED,
+} mqtt_client_state_t;
+
+typedef enum {
+	MQTT_EVENT_CONNECTED = 0,     // code: CONNACK session present flag
+	MQTT_EVENT_CONNECT_REFUSED,   // code: CONNACK return code
+	MQTT_EVENT_SUBACK,            // code: granted QoS, 0x80 on failure
+	MQTT_EVENT_UNSUBACK,
+	MQTT_EVENT_PUBLISHED,         // QoS 1/2 publish acknowledged
+	MQTT_EVENT_PUBLISH_FAILED,    // QoS 1/2 publish given up after MQTT_CLIENT_MAX_RETRIES
+	MQTT_EVENT_DISCONNECTED,      // code: 0 socket error, 1 CONNACK or PINGRESP timeout, 2 protocol error
+} mqtt_client_event_t;
+
+typedef struct mqtt_client_t mqtt_client_t;
+
+typedef struct {
+	// Both return the bytes moved, 0 if the socket would block, -1 if the connection is gone
+	int (*send)(void* socket_info, const void* buf, unsigned int count);
+	int (*recv)(void* socket_info, void* buf, unsigned int count);
+	void (*on_message)(mqtt_client_t* client, const char* topic, uint16_t topic_len, const uint8_t* payload, uint32_t length, uint8_t qos);
+	void (*on_event)(mqtt_client_t* client, mqtt_client_event_t event, uint16_t msg_id, uint8_t code);
+} mqtt_client_ops_t;
+
+typedef struct {
+	uint8_t  type;                // MQTT_MSG_PUBLISH waiting for PUBACK/PUBREC, MQTT_MSG_PUBREL waiting for PUBCOMP, 0 if free
+	uint8_t  retries;
+	uint16_t msg_id;
+	uint32_t sent_at;
+	uint8_t* packet;              // PUBLISH as sent, for retransmission
+	uint32_t length;
+} mqtt_inflight_t;
+
+typedef struct {
+	uint32_t tx_packets;
+	uint32_t rx_packets;
+	uint32_t tx_batches;          // send() calls, compare with tx_packets
+	uint32_t retransmits;
+	uint32_t rx_skipped;          // inbound packets too large for the receive buffer
+} mqtt_client_stats_t;
+
+struct mqtt_client_t {
+	mqtt_broker_handle_t      broker;    // identity, auth, keep-alive and packet ids
+	const mqtt_client_ops_t*  ops;
+	void*                     user;
+	mqtt_client_state_t       state;
+	// Receive framing
+	uint8_t                   rx_buf[MQTT_CLIENT_RX_SIZE];
+	uint32_t                  rx_have;   // bytes received and not yet dispatched
+	uint32_t                  rx_skip;   // bytes of an oversized packet still to discard
+	// Transmit queue
+	ring_buffer_t             tx_ring;
+	uint8_t                   tx_buf[MQTT_CLIENT_TX_SIZE];
+	uint32_t                  tx_reserved; // publish written in place, waiting for mqtt_client_publish_commit
+	uint32_t                  tx_reserved_at; // ring tail when it was reserved
+	// Timers, in the caller's millisecond clock
+	uint32_t                  now;
+	uint32_t                  last_tx;
+	uint32_t                  last_rx;
+	uint32_t                  ping_sent; // PINGREQ queued, or CONNECT queued while connecting
+	uint8_t                   ping_outstanding;
+	mqtt_inflight_t           inflight[MQTT_CLIENT_INFLIGHT];
+	uint16_t                  qos2_ids[MQTT_CLIENT_QOS2_IDS];
+	mqtt_client_stats_t       stats;
+};
+
+/** Prepare a client, socket_info is passed to the ops.
+ * @note Set broker fields such as alive, clean_session or auth before mqtt_client_connect.
+ */
+void mqtt_client_init(mqtt_client_t* client, const mqtt_client_ops_t* ops, void* socket_info, const char* clientid);
+
+/** Queue CONNECT on a newly opened connection, anything still queued is dropped.
+ * Unacknowledged QoS 1/2 publishes are sent again once CONNACK arrives.
+ * @retval  1 On success.
+ * @retval -1 If the transmit queue is full.
+ */
+int mqtt_client_connect(mqtt_client_t* client, void* socket_info, uint32_t now);
+
+/** Queue DISCONNECT, try to send it and stop the timers. The socket must be closed by the caller. */
+int mqtt_client_disconnect(mqtt_client_t* client);
+
+/** Queue a publish, the whole packet must fit in MQTT_CLIENT_TX_SIZE - 1 bytes.
+ * @retval  1 On success, *message_id set for QoS 1 and 2.
+ * @retval  0 If the transmit queue or in-flight window is full, try again after mqtt_client_poll.
+ * @retval -1 On bad arguments or a packet that can never fit.
+ */
+int mqtt_client_publish(mqtt_client_t* client, const char* topic, const void* payload, uint32_t length, uint8_t qos, uint8_t retain, uint16_t* message_id);
+
+/** Reserve a QoS 0 publish of exactly length payload bytes in the transmit queue, so
+ * the payload can be encoded in place. The headers are written, and the payload area
+ * is returned as up to two segments because the queue may wrap.
+ * @note Nothing is sent before mqtt_client_publish_commit, a reservation that is not
+ * committed is dropped by the next call that queues a packet.
+ * @retval  1, 0 or -1 like mqtt_client_publish.
+ */
+int mqtt_client_publish_reserve(mqtt_client_t* client, const char* topic, uint32_t length, uint8_t retain, uint8_t** data1, uint32_t* length1, uint8_t** data2, uint32_t* length2);
+void mqtt_client_publish_commit(mqtt_client_t* client);
+
+/** Queue a subscribe or unsubscribe, same return values as mqtt_client_publish. */
+int mqtt_client_subscribe(mqtt_client_t* client, const char* topic, uint8_t qos, uint16_t* message_id);
+int mqtt_client_unsubscribe(mqtt_client_t* client, const char* topic, uint16_t* message_id);
+
+/** Receive, run the timers and send what is queued.
+ * @retval  0 While the connection is usable.
+ * @retval -1 When it is not, close the socket and connect again.
+ */
+int mqtt_client_poll(mqtt_client_t* client, uint32_t now);
+
+/** True while queued data is waiting for the socket to accept it. */
+int mqtt_client_wants_write(mqtt_client_t* client);
+
+
 #endif // __LIBEMQTT_H__
@@ -50,84 +50,38 @@ extern  char Command1[COMMAND1_SIZE];
 /** Inbound system command topic */
 extern char System1[SYSTEM1_SIZE];
 
-/** Message buffer */
-extern uint8_t buffer[300];
-
-extern void mqtt_client(void);
-extern void handleSpecificationCommand(byte* payload, unsigned int length);
-extern void handleSystemCommand(byte* payload, unsigned int length);
+extern void sw_mqtt_init(void);
+extern OSStatus sw_mqtt_start(int fd);
+extern OSStatus sw_mqtt_poll(void);
+extern bool sw_mqtt_wants_write(void);
+extern OSStatus sw_publish_message(SiteWhere_Command command, char* originator, const pb_field_t fields[], const void* message);
 extern void handleTestEvents(ArduinoCustom_testData testEvents, char* originator);
 
 uint8_t connected_to_ethernet=0;
 extern uint8_t MQTT_REGISTERED;
 extern bool registered;
 
-extern mqtt_broker_handle_t broker_mqtt;
-
-int send_packet(void* socket_info, const void* buf, unsigned int count)
-{
-  return send((int)socket_info, buf, count, 0);
-}
-
-OSStatus sppWlanCommandProcess(unsigned char *inBuf, int *inBufLen, int inSocketFd, mico_Context_t * const inContext)
-{
-  client_log_trace();
-  (void)inSocketFd;
-  (void)inContext;
-  OSStatus err = kUnknownErr;
-  
-  uint8_t *packet_buffer;
-  
-  packet_buffer = inBuf;
-  
-  client_log("Packet Header: 0x%x...\n", packet_buffer[0]);
-  if(MQTTParseMessageType(packet_buffer) == MQTT_MSG_PUBLISH)
-  {
-    uint8_t topic[255], msg[1000];
-    uint16_t len;
-    len = mqtt_parse_pub_topic(packet_buffer, topic);
-    topic[len] = '\0'; // for printf
-    len = mqtt_parse_publish_msg(packet_buffer, msg);
-    msg[len] = '\0';
-    
-    
-    if (strcmp((char*)topic, System1) == 0)
-    {
-      handleSystemCommand(msg, len);
-    }
-    else if (strcmp((char*)topic, Command1) == 0)
-    {
-      handleSpecificationCommand(msg, len);
-    }
-  }
-  
-  *inBufLen = 0;
-  return err;
-}
-
 void sitewhere_main_thread(void *inContext)
 {
   client_log_trace();
   OSStatus err = kUnknownErr;
-  int len;
   app_context_t *app_context = inContext;
   struct sockaddr_t addr;
-  fd_set readfds;
+  fd_set readfds, writefds;
   char ipstr[16];
   struct timeval_t t;
   int remoteTcpClient_fd = -1;
-  uint8_t *inDataBuffer = NULL;
+  uint32_t next_report = 0;
   ArduinoCustom_testData testEvents;
+  SiteWhere_DeviceAlert alert;
+  SiteWhere_DeviceLocation location;
   
   uint16_t infrared_data = 0;
   uint16_t light_data = 0;
   int32_t temperature = 0;
   uint32_t humidity = 0;
   
-  memset(buffer,0,300);
-  
-  inDataBuffer = malloc(1024);
-  require_action(inDataBuffer, exit, err = kNoMemoryErr);
+  sw_mqtt_init();
   
   while(1) {
     if(remoteTcpClient_fd == -1 ) {
@@ -150,46 +104,48 @@ void sitewhere_main_thread(void *inContext)
       require_noerr_quiet(err, ReConnWithDelay);
       client_log("Remote server connected at port: %d, fd: %d",  1883,
                  remoteTcpClient_fd);
-      broker_mqtt.socket_info =(void *)remoteTcpClient_fd;
-      broker_mqtt.send = send_packet;
       
-      mqtt_client();
+      /* CONNECT and everything after it is sent from the loop below, never blocking */
+      err = sw_mqtt_start(remoteTcpClient_fd);
+      require_noerr(err, ReConnWithDelay);
       
       connected_to_ethernet =1;
       app_context->appStatus.isCloudConnected = true;
+      next_report = mico_get_time() + 2000;
     }
     else{
-      MicoGpioOutputTrigger(MICO_RF_LED);
-      
       FD_ZERO(&readfds);
       FD_SET(remoteTcpClient_fd, &readfds);
-      t.tv_sec = 2;
+      FD_ZERO(&writefds);
+      if(sw_mqtt_wants_write())
+        FD_SET(remoteTcpClient_fd, &writefds);
+      t.tv_sec = 1;
       t.tv_usec = 0;
-      select(1, &readfds, NULL, NULL, &t);
+      select(remoteTcpClient_fd + 1, &readfds, &writefds, NULL, &t);
+      
+      /*recv, dispatch commands, keep-alive and retransmit, send queued messages*/
+      err = sw_mqtt_poll();
+      if(err != kNoErr) {
+        client_log("Remote client closed, fd: %d", remoteTcpClient_fd);
+        connected_to_ethernet =0;
+        goto ReConnWithDelay;
+      }
       
-      /*recv wlan data using remote client fd*/
       if(MQTT_REGISTERED==1)
       {
-        if (FD_ISSET(remoteTcpClient_fd, &readfds)) {
-          len = recv(remoteTcpClient_fd, inDataBuffer, 1024, 0);
-          if(len <= 0) {
-            client_log("Remote client closed, fd: %d", remoteTcpClient_fd);
-            connected_to_ethernet =0;
-            goto ReConnWithDelay;
-          }
-          client_log("recv: %d", len);
-          sppWlanCommandProcess(inDataBuffer, &len, remoteTcpClient_fd, app_context->mico_context);
-        }
-        else{ // no message received, just upload test data every 2s.
+        /* upload test data every 2s, whatever the inbound traffic */
+        if((int32_t)(mico_get_time() - next_report) >= 0) {
+          next_report = mico_get_time() + 2000;
+          MicoGpioOutputTrigger(MICO_RF_LED);
           if(registered){
             // alert
-            if (len = sw_alert(hardwareId, clientName, "is alive", NULL, buffer, sizeof(buffer), NULL)) {
-              mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
+            sw_alert_message(&alert, hardwareId, clientName, "is alive", NULL);
+            if (sw_publish_message(SiteWhere_Command_DEVICEALERT, NULL, SiteWhere_DeviceAlert_fields, &alert) == kNoErr) {
               client_log("Sent alert.");
             }
             // location
-            if (len = sw_location(hardwareId, 31.00f, 121.00f, 0.0f, NULL, buffer, sizeof(buffer), NULL)) {
-              mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
+            sw_location_message(&location, hardwareId, 31.00f, 121.00f, 0.0f, NULL);
+            if (sw_publish_message(SiteWhere_Command_DEVICELOCATION, NULL, SiteWhere_DeviceLocation_fields, &location) == kNoErr) {
               client_log("Sent location.");
             }
             
@@ -227,8 +183,6 @@ void sitewhere_main_thread(void *inContext)
     }
   }
   
-exit:
-  if(inDataBuffer) free(inDataBuffer);
   client_log("Exit: local client exit with err = %d", err);
   mico_rtos_delete_thread(NULL);
   return;
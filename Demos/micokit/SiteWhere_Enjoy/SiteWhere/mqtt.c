@@ -16,7 +16,7 @@
 #define mqtt(M, ...) custom_log("MICO", M, ##__VA_ARGS__)
 #define mqtt_log_trace() custom_log_trace("MICO")
 
-mqtt_broker_handle_t broker_mqtt;
+mqtt_client_t sw_mqtt;
 mico_Context_t *context;
 /*****************************************************/
 void loop(void);
@@ -54,109 +54,196 @@ extern char Command1[COMMAND1_SIZE];
 /** Inbound system command topic */
 extern char System1[SYSTEM1_SIZE];
 
-#define RCVBUFSIZE 1024
-uint8_t packet_buffer[RCVBUFSIZE];
+extern void handleSpecificationCommand(byte* payload, unsigned int length);
+extern void handleSystemCommand(byte* payload, unsigned int length);
 
-int read_packet(int timeout,mqtt_broker_handle_t* broker)
-{
-  int socket_id = (int)broker->socket_info;
-
-  if(timeout > 0)
-  {
-    fd_set readfds;
-
-    // Initialize the file descriptor set
-    FD_ZERO (&readfds);
-    FD_SET (socket_id, &readfds);
-  }
+uint8_t MQTT_REGISTERED =0;
 
-  int total_bytes = 0, bytes_rcvd, packet_length;
-  memset(packet_buffer, 0, sizeof(packet_buffer));
+OSStatus sw_mqtt_poll(void);
 
-  if((bytes_rcvd = read(socket_id, (packet_buffer+total_bytes), RCVBUFSIZE)) <= 0) {
-    return -1;
-  }
+static int sw_mqtt_send(void* socket_info, const void* buf, unsigned int count)
+{
+  int fd = (int)socket_info;
+  int ret = send(fd, buf, count, 0);
+  int err = 0;
+  socklen_t err_len = sizeof(err);
+
+  if(ret > 0)
+    return ret;
+  getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+  return (err == EAGAIN) ? 0 : -1;
+}
 
-  total_bytes += bytes_rcvd; // Keep tally of total bytes
-  if (total_bytes < 2)
-    return -1;
+static int sw_mqtt_recv(void* socket_info, void* buf, unsigned int count)
+{
+  int fd = (int)socket_info;
+  int ret = recv(fd, buf, count, 0);
+  int err = 0;
+  socklen_t err_len = sizeof(err);
+
+  if(ret > 0)
+    return ret;
+  if(ret == 0)
+    return -1;  // Closed by the broker
+  getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+  return (err == EAGAIN) ? 0 : -1;
+}
 
-  // now we have the full fixed header in packet_buffer
-  // parse it for remaining length and number of bytes
-  uint16_t rem_len = mqtt_parse_rem_len(packet_buffer);
-  uint8_t rem_len_bytes = mqtt_num_rem_len_bytes(packet_buffer);
+static bool sw_topic_is(const char* topic, uint16_t topic_len, const char* name)
+{
+  return topic_len == strlen(name) && memcmp(topic, name, topic_len) == 0;
+}
 
-  //packet_length = packet_buffer[1] + 2; // Remaining length + fixed header length
-  // total packet length = remaining length + byte 1 of fixed header + remaning length part of fixed header
-  packet_length = rem_len + rem_len_bytes + 1;
+static void sw_mqtt_on_message(mqtt_client_t* client, const char* topic, uint16_t topic_len, const uint8_t* payload, uint32_t length, uint8_t qos)
+{
+  (void)client;
+  (void)qos;
 
-  while(total_bytes < packet_length) // Reading the packet
+  if (sw_topic_is(topic, topic_len, System1))
   {
-    if((bytes_rcvd = read(socket_id, (packet_buffer+total_bytes), RCVBUFSIZE)) <= 0)
-      return -1;
-    total_bytes += bytes_rcvd; // Keep tally of total bytes
+    handleSystemCommand((byte*)payload, length);
+  }
+  else if (sw_topic_is(topic, topic_len, Command1))
+  {
+    handleSpecificationCommand((byte*)payload, length);
   }
-
-  return packet_length;
 }
 
-
-
-int len = 0;
-uint8_t MQTT_REGISTERED =0;
-/** Set up processing */
-void mqtt_client()
+static void sw_mqtt_on_event(mqtt_client_t* client, mqtt_client_event_t event, uint16_t msg_id, uint8_t code)
 {
-    mqtt("Connected to ethernet.");
-    
-    strcpy(broker_mqtt.clientid,hardwareId);
-    mqtt_init(&broker_mqtt,hardwareId);
-
-    mqtt_connect(&broker_mqtt);
-    read_packet(10,&broker_mqtt);
-    if(MQTTParseMessageType(packet_buffer) == MQTT_MSG_CONNACK)
-    {
-        mqtt("Connected to MQTT.");
-    }
-
-  if(packet_buffer[3] == 0x00)
-  {
-        mqtt("CONNACK successed!\n");
-        mqtt_subscribe(&broker_mqtt,Command1,0);
-        read_packet(10,&broker_mqtt);
+  unsigned int len = 0;
 
-        if(MQTTParseMessageType(packet_buffer) != MQTT_MSG_SUBACK)
+  switch(event)
+  {
+    case MQTT_EVENT_CONNECTED:
+      mqtt("Connected to MQTT.");
+      // Queued together, they go out in one segment behind any retransmissions
+      mqtt_client_subscribe(client, Command1, 0, NULL);
+      mqtt_client_subscribe(client, System1, 0, NULL);
+      if ((len = sw_register(hardwareId, specificationToken, buffer, sizeof(buffer), NULL)) != 0)
+      {
+        if(mqtt_client_publish(client, outbound, buffer, len, 1, 0, NULL) == 1)
         {
-            mqtt("SUBACK expected!\n");
-            return;
+          MQTT_REGISTERED =1;
+          mqtt("Sent registration.");
         }
+      }
+      break;
+    case MQTT_EVENT_CONNECT_REFUSED:
+      mqtt("CONNACK failed: %d", code);
+      break;
+    case MQTT_EVENT_SUBACK:
+      if(code & 0x80)
+        mqtt("SUBSCRIBE %d refused", msg_id);
+      break;
+    case MQTT_EVENT_PUBLISH_FAILED:
+      mqtt("Publish %d not acknowledged", msg_id);
+      break;
+    case MQTT_EVENT_DISCONNECTED:
+      mqtt("MQTT disconnected: %d", code);
+      MQTT_REGISTERED =0;
+      break;
+    default:
+      break;
+  }
+}
 
+static const mqtt_client_ops_t sw_mqtt_ops = {
+  sw_mqtt_send,
+  sw_mqtt_recv,
+  sw_mqtt_on_message,
+  sw_mqtt_on_event,
+};
 
-        mqtt_subscribe(&broker_mqtt,System1,0);
-        read_packet(10,&broker_mqtt);
+/** Set up the MQTT client once, in-flight messages survive later reconnects */
+void sw_mqtt_init(void)
+{
+  mqtt_client_init(&sw_mqtt, &sw_mqtt_ops, NULL, hardwareId);
+}
 
-        if(MQTTParseMessageType(packet_buffer) != MQTT_MSG_SUBACK)
-        {
-            mqtt("SUBACK expected!\n");
-            return;
-        }
+/** Start the MQTT session on a connected socket, the socket is switched to non-blocking mode */
+OSStatus sw_mqtt_start(int fd)
+{
+  int opt = 1;
 
-        mqtt("subscirbe successed");
+  setsockopt(fd, SOL_SOCKET, SO_BLOCKMODE, &opt, sizeof(opt));
+  if(mqtt_client_connect(&sw_mqtt, (void*)fd, mico_get_time()) < 0)
+    return kNoResourcesErr;
+  return sw_mqtt_poll();
+}
 
-        if (len = sw_register(hardwareId, specificationToken, buffer, sizeof(buffer), NULL))
-        {
-            mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
-            MQTT_REGISTERED =1;
-            mqtt("Sent registration.");
+/** Receive, run the MQTT timers and send what is queued */
+OSStatus sw_mqtt_poll(void)
+{
+  return (mqtt_client_poll(&sw_mqtt, mico_get_time()) < 0) ? kConnectionErr : kNoErr;
+}
 
-        }
+/** True while queued MQTT data waits for the socket to become writable */
+bool sw_mqtt_wants_write(void)
+{
+  return mqtt_client_wants_write(&sw_mqtt) != 0;
+}
+
+typedef struct {
+  uint8_t* data[2];
+  uint32_t length[2];
+  uint32_t offset;    /* submessage streams count from 0, so track the position here */
+} sw_segments_t;
+
+/* nanopb stream callback writing into the two segments of a queue reservation */
+static bool sw_segments_write(pb_ostream_t* stream, const uint8_t* buf, size_t count)
+{
+  sw_segments_t* seg = stream->state;
+  uint32_t offset = seg->offset;
+  size_t first = 0;
 
+  seg->offset += count;
+  if(offset < seg->length[0])
+  {
+    first = MIN(seg->length[0] - offset, count);
+    memcpy(seg->data[0] + offset, buf, first);
+    offset = seg->length[0];
   }
-  else
+  if(count > first)
+    memcpy(seg->data[1] + (offset - seg->length[0]), buf + first, count - first);
+  return true;
+}
+
+/** Encode a SiteWhere message straight into the MQTT transmit queue as one QoS 0 publish.
+ *  A sizing pass gives the payload length, so the MQTT headers are written first and the
+ *  message lands right behind them, without a scratch buffer or a second copy.
+ */
+OSStatus sw_publish_message(SiteWhere_Command command, char* originator, const pb_field_t fields[], const void* message)
+{
+  OSStatus err = kNoErr;
+  pb_ostream_t sizing = PB_OSTREAM_SIZING;
+  pb_ostream_t stream = PB_OSTREAM_SIZING;
+  sw_segments_t seg;
+  int ret;
+
+  require_action(sw_encode(&sizing, command, originator, fields, message), exit, err = kMalformedErr);
+
+  ret = mqtt_client_publish_reserve(&sw_mqtt, outbound, sizing.bytes_written, 0,
+                                    &seg.data[0], &seg.length[0], &seg.data[1], &seg.length[1]);
+  require_action(ret >= 0, exit, err = kSizeErr);
+  if(ret == 0)
   {
-      mqtt("CONNACK failed!\n");
+    mqtt("Outbound queue full, message dropped.");
+    err = kNoSpaceErr;
+    goto exit;
   }
+
+  seg.offset = 0;
+  stream.callback = sw_segments_write;
+  stream.state = &seg;
+  stream.max_size = sizing.bytes_written;
+  require_action(sw_encode(&stream, command, originator, fields, message), exit, err = kMalformedErr);
+  mqtt_client_publish_commit(&sw_mqtt);
+
+exit:
+  return err;
 }
+
 uint32_t now_event;
 uint8_t MICO_report[15];
 
@@ -174,12 +261,12 @@ uint8_t MICO_report[15];
 //
 //                // alert
 //                if (len = sw_alert(hardwareId, clientName, "is alive", NULL, buffer, sizeof(buffer), NULL)) {
-//                    mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
+//                    sw_publish(buffer,len);
 //                    mqtt("Sent alert.");
 //                }
 //                // location
 //                if (len = sw_location(hardwareId, 31.05f, 121.76f, 0.0f, NULL, buffer, sizeof(buffer), NULL)) {
-//                  mqtt_publish(&broker_mqtt,outbound,(char*)buffer,len,0);
+//                  sw_publish(buffer,len);
 //                  mqtt("Sent location.");
 //                }
 //                
@@ -6,150 +6,130 @@
 // Signals end of stream.
 uint8_t zero = 0;
 
-unsigned int sw_register(char* hardwareId, char* specificationToken, uint8_t* buffer, size_t length, char* originator) {
-	pb_ostream_t stream = pb_ostream_from_buffer(buffer, length);
-
+bool sw_encode(pb_ostream_t* stream, SiteWhere_Command command, char* originator, const pb_field_t fields[], const void* message) {
 	SiteWhere_Header header;
-	header.command = SiteWhere_Command_REGISTER;
+
+	memset(&header, 0, sizeof(header));
+	header.command = command;
 	if (originator != NULL) {
 		header.has_originator = true;
-		strcpy(header.originator, originator);
+		strncpy(header.originator, originator, sizeof(header.originator) - 1);
 	}
-	if (!pb_encode_delimited(&stream, SiteWhere_Header_fields, &header)) {
-		return 0;
+	if (!pb_encode_delimited(stream, SiteWhere_Header_fields, &header)) {
+		return false;
 	}
 
-	SiteWhere_RegisterDevice registerDevice;
-	strcpy(registerDevice.hardwareId, hardwareId);
-	strcpy(registerDevice.specificationToken, specificationToken);
-	if (!pb_encode_delimited(&stream, SiteWhere_RegisterDevice_fields, &registerDevice)) {
+	return pb_encode_delimited(stream, fields, message);
+}
+
+// Encodes into a flat buffer, returns the length or 0 on failure
+static unsigned int sw_encode_buffer(uint8_t* buffer, size_t length, SiteWhere_Command command, char* originator, const pb_field_t fields[], const void* message) {
+	pb_ostream_t stream = pb_ostream_from_buffer(buffer, length);
+
+	if (!sw_encode(&stream, command, originator, fields, message)) {
 		return 0;
 	}
 
 	return stream.bytes_written;
 }
 
-unsigned int sw_acknowledge(char* hardwareId, char* message, uint8_t* buffer, size_t length, char* originator) {
-	pb_ostream_t stream = pb_ostream_from_buffer(buffer, length);
+void sw_register_message(SiteWhere_RegisterDevice* registerDevice, char* hardwareId, char* specificationToken) {
+	memset(registerDevice, 0, sizeof(SiteWhere_RegisterDevice));
+	strncpy(registerDevice->hardwareId, hardwareId, sizeof(registerDevice->hardwareId) - 1);
+	strncpy(registerDevice->specificationToken, specificationToken, sizeof(registerDevice->specificationToken) - 1);
+}
 
-	SiteWhere_Header header;
-	header.command = SiteWhere_Command_ACKNOWLEDGE;
-	if (originator != NULL) {
-		header.has_originator = true;
-		strcpy(header.originator, originator);
-	}
-	if (!pb_encode_delimited(&stream, SiteWhere_Header_fields, &header)) {
-		return 0;
-	}
+unsigned int sw_register(char* hardwareId, char* specificationToken, uint8_t* buffer, size_t length, char* originator) {
+	SiteWhere_RegisterDevice registerDevice;
 
-	SiteWhere_Acknowledge ack;
-	strcpy(ack.hardwareId, hardwareId);
+	sw_register_message(&registerDevice, hardwareId, specificationToken);
+	return sw_encode_buffer(buffer, length, SiteWhere_Command_REGISTER, originator, SiteWhere_RegisterDevice_fields, &registerDevice);
+}
+
+void sw_acknowledge_message(SiteWhere_Acknowledge* ack, char* hardwareId, char* message) {
+	memset(ack, 0, sizeof(SiteWhere_Acknowledge));
+	strncpy(ack->hardwareId, hardwareId, sizeof(ack->hardwareId) - 1);
 	if (message != NULL) {
-		ack.has_message = true;
-		strcpy(ack.message, message);
-	}
-	if (!pb_encode_delimited(&stream, SiteWhere_Acknowledge_fields, &ack)) {
-		return 0;
+		ack->has_message = true;
+		strncpy(ack->message, message, sizeof(ack->message) - 1);
 	}
+}
 
-	return stream.bytes_written;
+unsigned int sw_acknowledge(char* hardwareId, char* message, uint8_t* buffer, size_t length, char* originator) {
+	SiteWhere_Acknowledge ack;
+
+	sw_acknowledge_message(&ack, hardwareId, message);
+	return sw_encode_buffer(buffer, length, SiteWhere_Command_ACKNOWLEDGE, originator, SiteWhere_Acknowledge_fields, &ack);
 }
 
-unsigned int sw_measurement(char* hardwareId,device_func *cmd,uint8_t count, int64_t eventDate,uint8_t* buffer, size_t length, char* originator)
-{
-	pb_ostream_t stream = pb_ostream_from_buffer(buffer, length);
+void sw_measurement_message(SiteWhere_DeviceMeasurements* measurements, char* hardwareId, device_func *cmd, uint8_t count, int64_t eventDate) {
+	uint8_t max = sizeof(measurements->measurement) / sizeof(measurements->measurement[0]);
 
-	SiteWhere_Header header;
-	header.command = SiteWhere_Command_DEVICEMEASUREMENT;
-	if (originator != NULL) {
-		header.has_originator = true;
-		strcpy(header.originator, originator);
+	memset(measurements, 0, sizeof(SiteWhere_DeviceMeasurements));
+	strncpy(measurements->hardwareId, hardwareId, sizeof(measurements->hardwareId) - 1);
+
+	// All readings travel in one envelope, as many as it holds
+	if (count > max) {
+		count = max;
 	}
-	if (!pb_encode_delimited(&stream, SiteWhere_Header_fields, &header)) {
-		return 0;
+	for (uint8_t i = 0; i < count; i++) {
+		strncpy(measurements->measurement[i].measurementId, cmd[i].engine.temp, sizeof(measurements->measurement[i].measurementId) - 1);
+		measurements->measurement[i].measurementValue = float_to_double(cmd[i].engine.value);
+	}
+	measurements->measurement_count = count;
+
+	if (eventDate != NULL) {
+		measurements->has_eventDate = true;
+		measurements->eventDate = eventDate;
 	}
+}
 
+unsigned int sw_measurement(char* hardwareId,device_func *cmd,uint8_t count, int64_t eventDate,uint8_t* buffer, size_t length, char* originator)
+{
 	SiteWhere_DeviceMeasurements measurements;
-	strcpy(measurements.hardwareId, hardwareId);
 
-	SiteWhere_Measurement measurement;
+	sw_measurement_message(&measurements, hardwareId, cmd, count, eventDate);
+	return sw_encode_buffer(buffer, length, SiteWhere_Command_DEVICEMEASUREMENT, originator, SiteWhere_DeviceMeasurements_fields, &measurements);
+}
 
-        for(uint8_t i=0;i<count;i++)
-        {
-            strcpy(measurement.measurementId, cmd[i].engine.temp);
-            measurement.measurementValue = float_to_double(cmd[i].engine.value);
-            measurements.measurement[i] = measurement;
-        }
-        measurements.measurement_count = count;
+void sw_location_message(SiteWhere_DeviceLocation* location, char* hardwareId, float lat, float lon, float ele, int64_t eventDate) {
+	memset(location, 0, sizeof(SiteWhere_DeviceLocation));
+	strncpy(location->hardwareId, hardwareId, sizeof(location->hardwareId) - 1);
+	location->latitude = float_to_double(lat);
+	location->longitude = float_to_double(lon);
+	location->elevation = float_to_double(ele);
+	location->has_elevation = true;
 
 	if (eventDate != NULL) {
-		measurements.has_eventDate = true;
-		measurements.eventDate = eventDate;
-	}
-	if (!pb_encode_delimited(&stream, SiteWhere_DeviceMeasurements_fields, &measurements)) {
-		return 0;
+		location->has_eventDate = true;
+		location->eventDate = eventDate;
 	}
-
-	return stream.bytes_written;
 }
 
 unsigned int sw_location(char* hardwareId, float lat, float lon, float ele, int64_t eventDate,
 		uint8_t* buffer, size_t length, char* originator) {
-	pb_ostream_t stream = pb_ostream_from_buffer(buffer, length);
-
-	SiteWhere_Header header;
-	header.command = SiteWhere_Command_DEVICELOCATION;
-	if (originator != NULL) {
-		header.has_originator = true;
-		strcpy(header.originator, originator);
-	}
-	if (!pb_encode_delimited(&stream, SiteWhere_Header_fields, &header)) {
-		return 0;
-	}
-
 	SiteWhere_DeviceLocation location;
-	strcpy(location.hardwareId, hardwareId);
-	location.latitude = float_to_double(lat);
-	location.longitude = float_to_double(lon);
-	location.elevation = float_to_double(ele);
-	location.has_elevation = true;
 
+	sw_location_message(&location, hardwareId, lat, lon, ele, eventDate);
+	return sw_encode_buffer(buffer, length, SiteWhere_Command_DEVICELOCATION, originator, SiteWhere_DeviceLocation_fields, &location);
+}
+
+void sw_alert_message(SiteWhere_DeviceAlert* alert, char* hardwareId, char* alertType, char* alertMessage, int64_t eventDate) {
+	memset(alert, 0, sizeof(SiteWhere_DeviceAlert));
+	strncpy(alert->hardwareId, hardwareId, sizeof(alert->hardwareId) - 1);
+	strncpy(alert->alertType, alertType, sizeof(alert->alertType) - 1);
+	strncpy(alert->alertMessage, alertMessage, sizeof(alert->alertMessage) - 1);
 	if (eventDate != NULL) {
-		location.has_eventDate = true;
-		location.eventDate = eventDate;
-	}
-	if (!pb_encode_delimited(&stream, SiteWhere_DeviceLocation_fields, &location)) {
-		return 0;
+		alert->has_eventDate = true;
+		alert->eventDate = eventDate;
 	}
-
-	return stream.bytes_written;
 }
+
 //sw_alert(hardwareId, "arduino.alive", "The Arduino is alive!", NULL, buffer, sizeof(buffer), NULL))
 unsigned int sw_alert(char* hardwareId, char* alertType, char* alertMessage, int64_t eventDate,
 		uint8_t* buffer, size_t length, char* originator) {
-	pb_ostream_t stream = pb_ostream_from_buffer(buffer, length);
-
-	SiteWhere_Header header;
-	header.command = SiteWhere_Command_DEVICEALERT;
-	if (originator != NULL) {
-		header.has_originator = true;
-		strcpy(header.originator, originator);
-	}
-	if (!pb_encode_delimited(&stream, SiteWhere_Header_fields, &header)) {
-		return 0;
-	}
-
 	SiteWhere_DeviceAlert alert;
-	strcpy(alert.hardwareId, hardwareId);
-	strcpy(alert.alertType, alertType);
-	strcpy(alert.alertMessage, alertMessage);
-	if (eventDate != NULL) {
-		alert.has_eventDate = true;
-		alert.eventDate = eventDate;
-	}
-	if (!pb_encode_delimited(&stream, SiteWhere_DeviceAlert_fields, &alert)) {
-		return 0;
-	}
 
-	return stream.bytes_written;
+	sw_alert_message(&alert, hardwareId, alertType, alertMessage, eventDate);
+	return sw_encode_buffer(buffer, length, SiteWhere_Command_DEVICEALERT, originator, SiteWhere_DeviceAlert_fields, &alert);
 }
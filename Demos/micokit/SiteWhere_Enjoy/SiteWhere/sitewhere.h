@@ -33,6 +33,16 @@ unsigned int sw_location(char* hardwareId, float lat, float lon, float elevation
 unsigned int sw_alert(char* hardwareId, char* type, char* message, int64_t eventDate,
 		uint8_t* buffer, size_t length, char* originator);
 
+/** Encode a header and one message to any nanopb stream, a sizing stream gives the length */
+bool sw_encode(pb_ostream_t* stream, SiteWhere_Command command, char* originator, const pb_field_t fields[], const void* message);
+
+/** Fill in the message for sw_encode, used to encode straight into the MQTT queue */
+void sw_register_message(SiteWhere_RegisterDevice* registerDevice, char* hardwareId, char* specificationToken);
+void sw_acknowledge_message(SiteWhere_Acknowledge* ack, char* hardwareId, char* message);
+void sw_measurement_message(SiteWhere_DeviceMeasurements* measurements, char* hardwareId, device_func *cmd, uint8_t count, int64_t eventDate);
+void sw_location_message(SiteWhere_DeviceLocation* location, char* hardwareId, float lat, float lon, float elevation, int64_t eventDate);
+void sw_alert_message(SiteWhere_DeviceAlert* alert, char* hardwareId, char* type, char* message, int64_t eventDate);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
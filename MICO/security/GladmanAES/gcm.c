@@ -94,6 +94,103 @@ extern "C"
 #define inc_ctr(x)  \
     {   int i = BLOCK_SIZE; while(i-- > CTR_POS && !++(UI8_PTR(x)[i])) ; }
 
+#if defined( GF_RUNTIME_TABLES )
+
+unsigned long gcm_table_size(               /* caller memory for a mode     */
+            gcm_tables_t mode)              /* the table mode               */
+{
+    switch(mode)
+    {
+    case GCM_TABLES_4K:     return sizeof(gf_t4k_a);
+    case GCM_TABLES_8K:     return sizeof(gf_t8k_a);
+    case GCM_TABLES_64K:    return sizeof(gf_t64k_a);
+    default:                return 0;
+    }
+}
+
+ret_type gcm_init_and_key(                  /* initialise mode and set key  */
+            const unsigned char key[],      /* the key value                */
+            unsigned long key_len,          /* and its length in bytes      */
+            gcm_ctx ctx[1])                 /* the mode context             */
+{
+    return gcm_init_and_key_tables(key, key_len, GCM_TABLES_256, 0, ctx);
+}
+
+ret_type gcm_init_and_key_tables(           /* initialise mode, set key and */
+            const unsigned char key[],      /* the key value                */
+            unsigned long key_len,          /* and its length in bytes      */
+            gcm_tables_t mode,              /* the GHASH multiplier to use  */
+            void *tab,                      /* gcm_table_size(mode) bytes   */
+            gcm_ctx ctx[1])                 /* the mode context             */
+{
+    if(mode > GCM_TABLES_64K || (gcm_table_size(mode) && !tab))
+        return RETURN_ERROR;
+
+    memset(ctx->ghash_h, 0, sizeof(ctx->ghash_h));
+    ctx->gf_mode = mode;
+    ctx->gf_tab = tab;
+
+    /* set the AES key                          */
+    aes_encrypt_key(key, (int) key_len, ctx->aes);
+
+    /* compute E(0) (for the hash function)     */
+    aes_encrypt(UI8_PTR(ctx->ghash_h), UI8_PTR(ctx->ghash_h), ctx->aes);
+
+    /* the per key tables are built once here and reused for every message */
+    switch(mode)
+    {
+    case GCM_TABLES_64K:    init_64k_table(ctx->ghash_h, (gf_t64k_t)tab); break;
+    case GCM_TABLES_8K:     init_8k_table(ctx->ghash_h, (gf_t8k_t)tab); break;
+    case GCM_TABLES_4K:     init_4k_table(ctx->ghash_h, (gf_t4k_t)tab); break;
+    case GCM_TABLES_256:    init_256_table(ctx->ghash_h, ctx->gf_t256); break;
+    default:                break;
+    }
+    return RETURN_GOOD;
+}
+
+static void gf_mul_hh(gf_t a, gcm_ctx ctx[1])
+{   gf_t    scr;
+
+    switch(ctx->gf_mode)
+    {
+    case GCM_TABLES_64K:    gf_mul_64k(a, (gf_t64k_t)ctx->gf_tab, scr); break;
+    case GCM_TABLES_8K:     gf_mul_8k(a, (gf_t8k_t)ctx->gf_tab, scr); break;
+    case GCM_TABLES_4K:     gf_mul_4k(a, (gf_t4k_t)ctx->gf_tab, scr); break;
+    case GCM_TABLES_256:    gf_mul_256(a, ctx->gf_t256, scr); break;
+    default:                gf_mul(a, ctx->ghash_h); break;
+    }
+}
+
+/*  Hash n_blk whole blocks into a, where a holds a block still waiting for
+    its multiply by H.  The multiplier is chosen once for the whole run.
+*/
+
+#define hash_run(mul)                                       \
+    while(n_blk--)                                          \
+    {   mul;                                                \
+        if(aligned)                                         \
+            xor_block_aligned(a, a, p);                     \
+        else                                                \
+            xor_block(a, a, p);                             \
+        p += BLOCK_SIZE;                                    \
+    }
+
+static void gf_hash_blocks(gf_t a, const unsigned char *p, uint_32t n_blk,
+                           int aligned, gcm_ctx ctx[1])
+{   gf_t    scr;
+
+    switch(ctx->gf_mode)
+    {
+    case GCM_TABLES_64K:    hash_run(gf_mul_64k(a, (gf_t64k_t)ctx->gf_tab, scr)); break;
+    case GCM_TABLES_8K:     hash_run(gf_mul_8k(a, (gf_t8k_t)ctx->gf_tab, scr)); break;
+    case GCM_TABLES_4K:     hash_run(gf_mul_4k(a, (gf_t4k_t)ctx->gf_tab, scr)); break;
+    case GCM_TABLES_256:    hash_run(gf_mul_256(a, ctx->gf_t256, scr)); break;
+    default:                hash_run(gf_mul(a, ctx->ghash_h)); break;
+    }
+}
+
+#else
+
 ret_type gcm_init_and_key(                  /* initialise mode and set key  */
             const unsigned char key[],      /* the key value                */
             unsigned long key_len,          /* and its length in bytes      */
@@ -157,6 +254,22 @@ static void gf_mul_hh(gf_t a, gcm_ctx ctx[1])
 #endif
 }
 
+static void gf_hash_blocks(gf_t a, const unsigned char *p, uint_32t n_blk,
+                           int aligned, gcm_ctx ctx[1])
+{
+    while(n_blk--)
+    {
+        gf_mul_hh(a, ctx);
+        if(aligned)
+            xor_block_aligned(a, a, p);
+        else
+            xor_block(a, a, p);
+        p += BLOCK_SIZE;
+    }
+}
+
+#endif
+
 ret_type gcm_init_message(                  /* initialise a new message     */
             const unsigned char iv[],       /* the initialisation vector    */
             unsigned long iv_len,           /* and its length in bytes      */
@@ -197,6 +310,7 @@ ret_type gcm_init_message(                  /* initialise a new message     */
     memset(ctx->txt_ghv, 0, BLOCK_SIZE);
     ctx->hdr_cnt = 0;
     ctx->txt_ccnt = ctx->txt_acnt = 0;
+    ctx->hdr_done = 0;
     return RETURN_GOOD;
 }
 
@@ -209,6 +323,9 @@ ret_type gcm_auth_header(                   /* authenticate the header      */
     if(!hdr_len)
         return RETURN_GOOD;
 
+    if(ctx->txt_acnt)
+        return RETURN_ERROR;
+
     if(ctx->hdr_cnt && b_pos == 0)
         gf_mul_hh((void*)ctx->hdr_ghv, ctx);
 
@@ -223,11 +340,11 @@ ret_type gcm_auth_header(                   /* authenticate the header      */
             cnt += BUF_INC; b_pos += BUF_INC;
         }
 
-        while(cnt + BLOCK_SIZE <= hdr_len)
+        if(cnt + BLOCK_SIZE <= hdr_len)
         {
-            gf_mul_hh((void*)ctx->hdr_ghv, ctx);
-            xor_block_aligned(ctx->hdr_ghv, ctx->hdr_ghv, hdr + cnt);
-            cnt += BLOCK_SIZE;
+            uint_32t n_blk = (hdr_len - cnt) / BLOCK_SIZE;
+            gf_hash_blocks((void*)ctx->hdr_ghv, hdr + cnt, n_blk, 1, ctx);
+            cnt += n_blk * BLOCK_SIZE;
         }
     }
     else
@@ -235,11 +352,11 @@ ret_type gcm_auth_header(                   /* authenticate the header      */
         while(cnt < hdr_len && b_pos < BLOCK_SIZE)
             UI8_PTR(ctx->hdr_ghv)[b_pos++] ^= hdr[cnt++];
 
-        while(cnt + BLOCK_SIZE <= hdr_len)
+        if(cnt + BLOCK_SIZE <= hdr_len)
         {
-            gf_mul_hh((void*)ctx->hdr_ghv, ctx);
-            xor_block(ctx->hdr_ghv, ctx->hdr_ghv, hdr + cnt);
-            cnt += BLOCK_SIZE;
+            uint_32t n_blk = (hdr_len - cnt) / BLOCK_SIZE;
+            gf_hash_blocks((void*)ctx->hdr_ghv, hdr + cnt, n_blk, 0, ctx);
+            cnt += n_blk * BLOCK_SIZE;
         }
     }
 
@@ -266,6 +383,19 @@ ret_type gcm_auth_data(                     /* authenticate ciphertext data */
     if(!data_len)
         return RETURN_GOOD;
 
+    /*  Continue the text hash from the finished header hash rather than
+        starting it at zero.  This is the GHASH of the header and text as
+        one stream, so the tag no longer needs the header hash raised by
+        H^n, which costs two slow bitwise multiplies per bit of n.
+    */
+    if(!ctx->txt_acnt && ctx->hdr_cnt && !ctx->hdr_done)
+    {
+        gf_mul_hh((void*)ctx->hdr_ghv, ctx);
+        memcpy(ctx->txt_ghv, ctx->hdr_ghv, BLOCK_SIZE);
+        memset(ctx->hdr_ghv, 0, BLOCK_SIZE);
+        ctx->hdr_done = 1;
+    }
+
     if(ctx->txt_acnt && b_pos == 0)
         gf_mul_hh((void*)ctx->txt_ghv, ctx);
 
@@ -280,11 +410,11 @@ ret_type gcm_auth_data(                     /* authenticate ciphertext data */
             cnt += BUF_INC; b_pos += BUF_INC;
         }
 
-        while(cnt + BLOCK_SIZE <= data_len)
+        if(cnt + BLOCK_SIZE <= data_len)
         {
-            gf_mul_hh((void*)ctx->txt_ghv, ctx);
-            xor_block_aligned(ctx->txt_ghv, ctx->txt_ghv, data + cnt);
-            cnt += BLOCK_SIZE;
+            uint_32t n_blk = (data_len - cnt) / BLOCK_SIZE;
+            gf_hash_blocks((void*)ctx->txt_ghv, data + cnt, n_blk, 1, ctx);
+            cnt += n_blk * BLOCK_SIZE;
         }
     }
     else
@@ -292,11 +422,11 @@ ret_type gcm_auth_data(                     /* authenticate ciphertext data */
         while(cnt < data_len && b_pos < BLOCK_SIZE)
             UI8_PTR(ctx->txt_ghv)[b_pos++] ^= data[cnt++];
 
-        while(cnt + BLOCK_SIZE <= data_len)
+        if(cnt + BLOCK_SIZE <= data_len)
         {
-            gf_mul_hh((void*)ctx->txt_ghv, ctx);
-            xor_block(ctx->txt_ghv, ctx->txt_ghv, data + cnt);
-            cnt += BLOCK_SIZE;
+            uint_32t n_blk = (data_len - cnt) / BLOCK_SIZE;
+            gf_hash_blocks((void*)ctx->txt_ghv, data + cnt, n_blk, 0, ctx);
+            cnt += n_blk * BLOCK_SIZE;
         }
     }
 
@@ -389,7 +519,7 @@ ret_type gcm_compute_tag(                   /* compute authentication tag   */
     gf_mul_hh((void*)ctx->hdr_ghv, ctx);
     gf_mul_hh((void*)ctx->txt_ghv, ctx);
 
-    if(ctx->hdr_cnt)
+    if(ctx->hdr_cnt && !ctx->hdr_done)
     {
         ln = (uint_32t)((ctx->txt_acnt + BLOCK_SIZE - 1) / BLOCK_SIZE);
         if(ln)
@@ -481,6 +611,10 @@ ret_type gcm_compute_tag(                   /* compute authentication tag   */
 ret_type gcm_end(                           /* clean up and end operation   */
             gcm_ctx ctx[1])                 /* the mode context             */
 {
+#if defined( GF_RUNTIME_TABLES )
+    if(ctx->gf_tab)
+        memset(ctx->gf_tab, 0, gcm_table_size(ctx->gf_mode));
+#endif
     memset(ctx, 0, sizeof(gcm_ctx));
     return RETURN_GOOD;
 }
@@ -94,10 +94,28 @@ BUFR_TYPEDEF(gcm_buf_t, UNIT_BITS, AES_BLOCK_SIZE);
 
 #define GCM_BLOCK_SIZE  AES_BLOCK_SIZE
 
+/*  The GHASH multiplier used for a key when GF_RUNTIME_TABLES is defined.
+    The 256 byte table is kept in the context, the larger ones are held in
+    caller memory of gcm_table_size() bytes (suitably aligned for gf_t).
+*/
+
+typedef enum
+{   GCM_TABLES_NONE = 0,                    /* bitwise multiply, no table   */
+    GCM_TABLES_256,                         /* 256 bytes in the context     */
+    GCM_TABLES_4K,                          /* 4k bytes of caller memory    */
+    GCM_TABLES_8K,                          /* 8k bytes of caller memory    */
+    GCM_TABLES_64K                          /* 64k bytes of caller memory   */
+} gcm_tables_t;
+
 /* The GCM-AES  context  */
 
 typedef struct
 {
+#if defined( GF_RUNTIME_TABLES )
+    gf_t256_a       gf_t256;                /* table for GCM_TABLES_256     */
+    void           *gf_tab;                 /* caller table for 4K/8K/64K   */
+    gcm_tables_t    gf_mode;                /* multiplier in use            */
+#else
 #if defined( TABLES_64K )
     gf_t64k_a       gf_t64k;
 #endif
@@ -109,6 +127,7 @@ typedef struct
 #endif
 #if defined( TABLES_256 )
     gf_t256_a       gf_t256;
+#endif
 #endif
     gcm_buf_t       ctr_val;                /* CTR counter value            */
     gcm_buf_t       enc_ctr;                /* encrypted CTR block          */
@@ -120,6 +139,7 @@ typedef struct
     uint_32t        hdr_cnt;                /* header bytes so far          */
     uint_32t        txt_ccnt;               /* text bytes so far (encrypt)  */
     uint_32t        txt_acnt;               /* text bytes so far (auth)     */
+    uint_32t        hdr_done;               /* header folded into text hash */
 } gcm_ctx;
 
 /* The following calls handle mode initialisation, keying and completion    */
@@ -129,6 +149,20 @@ ret_type gcm_init_and_key(                  /* initialise mode and set key  */
             unsigned long key_len,          /* and its length in bytes      */
             gcm_ctx ctx[1]);                /* the mode context             */
 
+#if defined( GF_RUNTIME_TABLES )
+
+unsigned long gcm_table_size(               /* caller memory for a mode     */
+            gcm_tables_t mode);             /* the table mode               */
+
+ret_type gcm_init_and_key_tables(           /* initialise mode, set key and */
+            const unsigned char key[],      /* the key value                */
+            unsigned long key_len,          /* and its length in bytes      */
+            gcm_tables_t mode,              /* the GHASH multiplier to use  */
+            void *tab,                      /* gcm_table_size(mode) bytes   */
+            gcm_ctx ctx[1]);                /* the mode context             */
+
+#endif
+
 ret_type gcm_end(                           /* clean up and end operation   */
             gcm_ctx ctx[1]);                /* the mode context             */
 
@@ -160,7 +194,9 @@ ret_type gcm_decrypt_message(               /* decrypt an entire message    */
 
 /* The following calls handle messages in a sequence of operations followed */
 /* by tag computation after the sequence has been completed. In these calls */
-/* the user is responsible for verfiying the computed tag on decryption     */
+/* the user is responsible for verfiying the computed tag on decryption.    */
+/* All of the header must be authenticated before any of the message data   */
+/* so that the two can be hashed as one stream; later header calls fail.    */
 
 ret_type gcm_init_message(                  /* initialise a new message     */
             const unsigned char iv[],       /* the initialisation vector    */
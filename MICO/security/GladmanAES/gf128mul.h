@@ -149,6 +149,27 @@ Issue Date: 11/01/2011
 #  define TABLES_256
 #endif
 
+/*  With GF_RUNTIME_TABLES defined all of the table driven multipliers are
+    built and the one to use is chosen when a key is set (see gcm.h).  The
+    larger tables are then held in memory supplied by the caller instead of
+    in the mode context, so that the speed/memory trade off can be made per
+    board or per session without rebuilding.
+*/
+#if 1
+#  define GF_RUNTIME_TABLES
+#endif
+
+#if defined( GF_RUNTIME_TABLES )
+#  undef  TABLES_64K
+#  define TABLES_64K
+#  undef  TABLES_8K
+#  define TABLES_8K
+#  undef  TABLES_4K
+#  define TABLES_4K
+#  undef  TABLES_256
+#  define TABLES_256
+#endif
+
 /* END OF USER DEFINABLE OPTIONS */
 
 #if !(defined( TABLES_64K ) || defined( TABLES_8K ) \
@@ -183,7 +204,7 @@ typedef gf_t    gf_t64k_a[16][256];
 typedef gf_t    (*gf_t64k_t)[256];
 
 void init_64k_table(const gf_t g, gf_t64k_t t);
-void gf_mul_64k(gf_t a, const gf_t64k_t t, void *r);
+void gf_mul_64k(gf_t a, const gf_t64k_t t, gf_t r);
 
 /* types and calls for 8k table driven field multiplier        */
 
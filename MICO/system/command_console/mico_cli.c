@@ -6,8 +6,6 @@
 
 
 #ifdef MICO_CLI_ENABLE
-int cli_printf(const char *msg, ...);
-int cli_putstr(const char *msg);
 int cli_getchar(char *inbuf);
 
 /// CLI ///
@@ -20,18 +18,28 @@ int cli_getchar(char *inbuf);
 #define EXIT_MSG		"exit"
 #define NUM_BUFFERS		1
 #define MAX_COMMANDS	50
+#define MAX_ARGS        16
 #define INBUF_SIZE      80
 #define OUTBUF_SIZE     1024
+#define LINE_SIZE       256
 
+/* Commands are kept sorted by name and looked up by binary search. Output is
+ * formatted into one line buffer and copied into the UART transmit FIFO, so
+ * nothing is allocated after cli_init() and a command never waits for the
+ * UART unless the FIFO is full. */
 struct cli_st {
   int initialized;
   
   unsigned int bp;	/* buffer pointer */
   char inbuf[INBUF_SIZE];
-  char outbuf[OUTBUF_SIZE];
+  char outbuf[OUTBUF_SIZE];	/* for library commands that still print into pcWriteBuffer */
+  char line[LINE_SIZE];
+  mico_mutex_t line_mutex;
   const struct cli_command *commands[MAX_COMMANDS];
   unsigned int num_commands;
   int echo_disabled;
+  cli_output_mode_t output_mode;
+  int record_len;	/* bytes of the record being built in line */
   
 } ;
 
@@ -48,31 +56,43 @@ static const mico_uart_config_t cli_uart_config =
   .flags        = UART_WAKEUP_DISABLE,
 };
 
+/* Index of the first command not sorted before 'name', comparing up to len
+* bytes if len is not 0. */
+static unsigned int lower_bound_command(const char *name, int len)
+{
+  unsigned int lo = 0, hi = pCli->num_commands, mid;
+  int cmp;
+  
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    cmp = (len != 0) ? strncmp(pCli->commands[mid]->name, name, len) :
+      strcmp(pCli->commands[mid]->name, name);
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
 /* Find the command 'name' in the cli commands table.
 * If len is 0 then full match will be performed else upto len bytes.
 * Returns: a pointer to the corresponding cli_command struct or NULL.
 */
 static const struct cli_command *lookup_command(char *name, int len)
 {
-  int i = 0;
-  int n = 0;
-  
-  while (i < MAX_COMMANDS && n < pCli->num_commands) {
-    if (pCli->commands[i]->name == NULL) {
-      i++;
-      continue;
-    }
-    /* See if partial or full match is expected */
-    if (len != 0) {
-      if (!strncmp(pCli->commands[i]->name, name, len))
-        return pCli->commands[i];
-    } else {
-      if (!strcmp(pCli->commands[i]->name, name))
-        return pCli->commands[i];
-    }
-    
-    i++;
-    n++;
+  unsigned int i = lower_bound_command(name, len);
+  
+  if (i >= pCli->num_commands)
+    return NULL;
+  
+  /* See if partial or full match is expected */
+  if (len != 0) {
+    if (!strncmp(pCli->commands[i]->name, name, len))
+      return pCli->commands[i];
+  } else {
+    if (!strcmp(pCli->commands[i]->name, name))
+      return pCli->commands[i];
   }
   
   return NULL;
@@ -95,7 +115,7 @@ static int handle_input(char *inbuf)
     unsigned inQuote:1;
     unsigned done:1;
   } stat;
-  static char *argv[16];
+  static char *argv[MAX_ARGS];
   int argc = 0;
   int i = 0;
   const struct cli_command *command = NULL;
@@ -115,8 +135,8 @@ static int handle_input(char *inbuf)
       
     case '"':
       if (i > 0 && inbuf[i - 1] == '\\' && stat.inArg) {
-        memcpy(&inbuf[i - 1], &inbuf[i],
-               strlen(&inbuf[i]) + 1);
+        memmove(&inbuf[i - 1], &inbuf[i],
+                strlen(&inbuf[i]) + 1);
         --i;
         break;
       }
@@ -126,6 +146,8 @@ static int handle_input(char *inbuf)
         return 2;
       
       if (!stat.inQuote && !stat.inArg) {
+        if (argc >= MAX_ARGS)
+          return 2;
         stat.inArg = 1;
         stat.inQuote = 1;
         argc++;
@@ -139,8 +161,8 @@ static int handle_input(char *inbuf)
       
     case ' ':
       if (i > 0 && inbuf[i - 1] == '\\' && stat.inArg) {
-        memcpy(&inbuf[i - 1], &inbuf[i],
-               strlen(&inbuf[i]) + 1);
+        memmove(&inbuf[i - 1], &inbuf[i],
+                strlen(&inbuf[i]) + 1);
         --i;
         break;
       }
@@ -152,6 +174,8 @@ static int handle_input(char *inbuf)
       
     default:
       if (!stat.inArg) {
+        if (argc >= MAX_ARGS)
+          return 2;
         stat.inArg = 1;
         argc++;
         argv[argc - 1] = &inbuf[i];
@@ -179,7 +203,7 @@ static int handle_input(char *inbuf)
     if (command == NULL)
       return 1;
     
-    memset(pCli->outbuf, 0, OUTBUF_SIZE);
+    pCli->outbuf[0] = '\0';
     cli_putstr("\r\n");
     command->function(pCli->outbuf, OUTBUF_SIZE, argc, argv);
     cli_putstr(pCli->outbuf);
@@ -196,23 +220,19 @@ static void tab_complete(char *inbuf, unsigned int *bp)
   
   cli_printf("\r\n");
   
-  /* show matching commands */
-  for (i = 0, n = 0, m = 0; i < MAX_COMMANDS && n < pCli->num_commands;
-  i++) {
-    if (pCli->commands[i]->name != NULL) {
-      if (!strncmp(inbuf, pCli->commands[i]->name, *bp)) {
-        m++;
-        if (m == 1)
-          fm = pCli->commands[i]->name;
-        else if (m == 2)
-          cli_printf("%s %s ", fm,
-                     pCli->commands[i]->name);
-        else
-          cli_printf("%s ",
-                     pCli->commands[i]->name);
-      }
-      n++;
-    }
+  /* show matching commands, they are next to each other in the sorted table */
+  for (i = (*bp == 0) ? 0 : lower_bound_command(inbuf, *bp), m = 0;
+       i < pCli->num_commands && !strncmp(inbuf, pCli->commands[i]->name, *bp);
+       i++) {
+    m++;
+    if (m == 1)
+      fm = pCli->commands[i]->name;
+    else if (m == 2)
+      cli_printf("%s %s ", fm,
+                 pCli->commands[i]->name);
+    else
+      cli_printf("%s ",
+                 pCli->commands[i]->name);
   }
   
   /* there's only one match, so complete the line */
@@ -401,9 +421,130 @@ static void partShow_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc,
 
 }
 
+#define FLASHBENCH_BLOCK_SIZE   1024
+
+static uint32_t flashbench_rate( uint32_t kbytes, uint32_t ms )
+{
+    return ( ms == 0 ) ? 0 : kbytes * 1000 / ms;
+}
+
+static void flashbench_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc, char **argv)
+{
+    mico_logic_partition_t *partition = MicoFlashGetInfo( MICO_PARTITION_OTA_TEMP );
+    uint32_t kbytes = 64, i, offset, start, elapsed;
+    uint8_t *block = NULL, *readback = NULL;
+    OSStatus err = kNoErr;
+
+    if ( argc > 1 )
+        kbytes = strtoul( argv[1], NULL, 0 );
+
+    if ( partition == NULL || kbytes == 0 || kbytes * FLASHBENCH_BLOCK_SIZE > partition->partition_length ) {
+        cmd_printf( "Usage: flashbench [KB], overwrites the OTA temp partition\r\n" );
+        return;
+    }
+
+    block = malloc( FLASHBENCH_BLOCK_SIZE );
+    readback = malloc( FLASHBENCH_BLOCK_SIZE );
+    require_action( block && readback, exit, err = kNoMemoryErr );
+    for ( i = 0; i < FLASHBENCH_BLOCK_SIZE; i++ )
+        block[i] = (uint8_t) i;
+
+    start = mico_get_time();
+    err = MicoFlashErase( MICO_PARTITION_OTA_TEMP, 0, kbytes * FLASHBENCH_BLOCK_SIZE );
+    require_noerr( err, exit );
+    elapsed = mico_get_time() - start;
+    cmd_printf( "erase  %4d KB: %6d ms %6d KB/s\r\n", kbytes, elapsed, flashbench_rate( kbytes, elapsed ) );
+
+    start = mico_get_time();
+    for ( i = 0, offset = 0; i < kbytes && err == kNoErr; i++ )
+        err = MicoFlashWrite( MICO_PARTITION_OTA_TEMP, &offset, block, FLASHBENCH_BLOCK_SIZE );
+    require_noerr( err, exit );
+    elapsed = mico_get_time() - start;
+    cmd_printf( "write  %4d KB: %6d ms %6d KB/s\r\n", kbytes, elapsed, flashbench_rate( kbytes, elapsed ) );
+
+    start = mico_get_time();
+    for ( i = 0, offset = 0; i < kbytes && err == kNoErr; i++ ) {
+        err = MicoFlashRead( MICO_PARTITION_OTA_TEMP, &offset, readback, FLASHBENCH_BLOCK_SIZE );
+        if ( err == kNoErr && memcmp( block, readback, FLASHBENCH_BLOCK_SIZE ) != 0 )
+            err = kChecksumErr;
+    }
+    require_noerr( err, exit );
+    elapsed = mico_get_time() - start;
+    cmd_printf( "read   %4d KB: %6d ms %6d KB/s\r\n", kbytes, elapsed, flashbench_rate( kbytes, elapsed ) );
+
+    /* Time spent by the caller to queue the data, against the time to program it.
+     * A different pattern, so the check below cannot pass on the old data. */
+    for ( i = 0; i < FLASHBENCH_BLOCK_SIZE; i++ )
+        block[i] = (uint8_t) ~i;
+    err = MicoFlashErase( MICO_PARTITION_OTA_TEMP, 0, kbytes * FLASHBENCH_BLOCK_SIZE );
+    require_noerr( err, exit );
+    start = mico_get_time();
+    for ( i = 0; i < kbytes && err == kNoErr; i++ )
+        err = MicoFlashWriteAsync( MICO_PARTITION_OTA_TEMP, i * FLASHBENCH_BLOCK_SIZE, block, FLASHBENCH_BLOCK_SIZE, NULL, NULL );
+    elapsed = mico_get_time() - start;
+    if ( err == kNoErr )
+        err = MicoFlashAsyncFlush( );
+    else
+        MicoFlashAsyncFlush( );
+    require_noerr( err, exit );
+    cmd_printf( "async  %4d KB: %6d ms queued, %6d ms total\r\n", kbytes, elapsed, mico_get_time() - start );
+
+    for ( i = 0, offset = 0; i < kbytes && err == kNoErr; i++ ) {
+        err = MicoFlashRead( MICO_PARTITION_OTA_TEMP, &offset, readback, FLASHBENCH_BLOCK_SIZE );
+        if ( err == kNoErr && memcmp( block, readback, FLASHBENCH_BLOCK_SIZE ) != 0 )
+            err = kChecksumErr;
+    }
+    require_noerr( err, exit );
+
+exit:
+    if ( err != kNoErr )
+        cmd_printf( "flashbench failed, err = %d\r\n", err );
+    if ( block ) free( block );
+    if ( readback ) free( readback );
+}
+
+/* Interrupt load and wake-up latency of the UART receivers. Reset, drive
+ * traffic into the port, then read the counters back. */
+static void uartstat_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc, char **argv)
+{
+    mico_uart_rx_stats_t stats;
+    bool reset = ( argc > 1 && strcmp( argv[1], "reset" ) == 0 );
+    int uart;
+
+    if ( cli_output_mode() == CLI_OUTPUT_TEXT )
+        cmd_printf( "UART |   IRQs |    bytes | bytes/IRQ | wakeups | avg us | max us | peak buf | overruns\r\n" );
+    for ( uart = 0; uart < MICO_UART_MAX; uart++ ) {
+        if ( MicoUartGetRxStatistics( (mico_uart_t) uart, &stats, reset ) != kNoErr )
+            continue;
+        if ( cli_output_mode() != CLI_OUTPUT_TEXT ) {
+            cli_record_start( "uartstat" );
+            cli_record_int( "uart", uart );
+            cli_record_uint( "irqs", stats.irq_count );
+            cli_record_uint( "bytes", stats.bytes );
+            cli_record_uint( "wakeups", stats.wakeups );
+            cli_record_uint( "latency_total_us", stats.latency_total_us );
+            cli_record_uint( "latency_max_us", stats.latency_max_us );
+            cli_record_uint( "high_water", stats.high_water );
+            cli_record_uint( "overruns", stats.overruns );
+            cli_record_end( );
+            continue;
+        }
+        cmd_printf( "%4d | %6d | %8d | %9d | %7d | %6d | %6d | %8d | %8d\r\n", uart, stats.irq_count, stats.bytes,
+                    stats.irq_count ? stats.bytes / stats.irq_count : 0, stats.wakeups,
+                    stats.wakeups ? stats.latency_total_us / stats.wakeups : 0, stats.latency_max_us, stats.high_water,
+                    stats.overruns );
+    }
+}
+
 static void uptime_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc, char **argv)
 {
-    cmd_printf("UP time %dms\r\n", mico_get_time());
+    if ( cli_output_mode() == CLI_OUTPUT_TEXT ) {
+        cmd_printf("UP time %dms\r\n", mico_get_time());
+        return;
+    }
+    cli_record_start( "time" );
+    cli_record_uint( "uptime_ms", mico_get_time() );
+    cli_record_end( );
 }
 
 static void ota_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc, char **argv)
@@ -420,16 +561,13 @@ extern void tftp_ota(void);
 * text string, if any. */
 static void help_command(char *pcWriteBuffer, int xWriteBufferLen,int argc, char **argv)
 {
-  int i, n;
+  unsigned int i;
   
   cmd_printf("\r\n");
-  for (i = 0, n = 0; i < MAX_COMMANDS && n < pCli->num_commands; i++) {
-    if (pCli->commands[i]->name) {
-      cmd_printf("%s: %s\r\n", pCli->commands[i]->name,
-                 pCli->commands[i]->help ?
-                   pCli->commands[i]->help : "");
-      n++;
-    }
+  for (i = 0; i < pCli->num_commands; i++) {
+    cmd_printf("%s: %s\r\n", pCli->commands[i]->name,
+               pCli->commands[i]->help ?
+                 pCli->commands[i]->help : "");
   }
 }
 
@@ -485,6 +623,43 @@ static void cli_exit_handler(char *pcWriteBuffer, int xWriteBufferLen,int argc,
   // exit command not excuted
 }
 
+static const char *const output_mode_name[] = { "text", "kv", "json" };
+
+static void output_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc, char **argv)
+{
+  int mode;
+  
+  if (argc > 1) {
+    for (mode = CLI_OUTPUT_TEXT; mode <= CLI_OUTPUT_JSON; mode++) {
+      if (!strcasecmp(argv[1], output_mode_name[mode]))
+        break;
+    }
+    if (mode > CLI_OUTPUT_JSON) {
+      cmd_printf("Usage: output [text|kv|json]\r\n");
+      return;
+    }
+    pCli->output_mode = (cli_output_mode_t)mode;
+  }
+  cmd_printf("Output is %s\r\n", output_mode_name[pCli->output_mode]);
+}
+
+static void heap_Command(char *pcWriteBuffer, int xWriteBufferLen,int argc, char **argv)
+{
+  micoMemInfo_t *info = MicoGetMemoryInfo();
+  
+  if (cli_output_mode() == CLI_OUTPUT_TEXT) {
+    cmd_printf("total %d, used %d, free %d, free chunks %d\r\n", info->total_memory,
+               info->allocted_memory, info->free_memory, info->num_of_chunks);
+    return;
+  }
+  cli_record_start("heap");
+  cli_record_int("total", info->total_memory);
+  cli_record_int("used", info->allocted_memory);
+  cli_record_int("free", info->free_memory);
+  cli_record_int("chunks", info->num_of_chunks);
+  cli_record_end();
+}
+
 
 static const struct cli_command built_ins[] = {
   {"help", NULL, help_command},
@@ -517,11 +692,15 @@ static const struct cli_command built_ins[] = {
   {"time",     "system time",                 uptime_Command},
   {"ota",      "system ota",                  ota_Command},
   {"flash",    "Flash memory map",            partShow_Command},
+  {"flashbench", "[KB] flash throughput test",  flashbench_Command},
+  {"uartstat", "[reset] UART RX interrupt and latency stats", uartstat_Command},
+  {"heap",     "heap usage",                  heap_Command},
+  {"output",   "[text|kv|json] output mode for test rigs", output_Command},
 };
 
 int cli_register_command(const struct cli_command *command)
 {
-  int i;
+  unsigned int i;
   if (!command->name || !command->function)
     return 1;
   
@@ -533,7 +712,14 @@ int cli_register_command(const struct cli_command *command)
       if (pCli->commands[i] == command)
         return 0;
     }
-    pCli->commands[pCli->num_commands++] = command;
+    /* Insert behind commands of the same name, so the first one registered is found */
+    i = lower_bound_command(command->name, 0);
+    while (i < pCli->num_commands && !strcmp(pCli->commands[i]->name, command->name))
+      i++;
+    memmove(&pCli->commands[i + 1], &pCli->commands[i],
+            (pCli->num_commands - i) * sizeof(struct cli_command *));
+    pCli->commands[i] = command;
+    pCli->num_commands++;
     return 0;
   }
   
@@ -621,6 +807,7 @@ int cli_init(void)
     return kNoMemoryErr;
   }
   memset((void *)pCli, 0, sizeof(struct cli_st));
+  mico_rtos_init_mutex(&pCli->line_mutex);
   
   ring_buffer_init  ( (ring_buffer_t*)&cli_rx_buffer, (uint8_t*)cli_rx_data, INBUF_SIZE );
   MicoUartInitialize( CLI_UART, &cli_uart_config, (ring_buffer_t*)&cli_rx_buffer );
@@ -657,32 +844,155 @@ int cli_init(void)
 int cli_printf(const char *msg, ...)
 {
   va_list ap; 
-  char *pos, message[256]; 
-  int sz; 
   int nMessageLen = 0;
   
-  memset(message, 0, 256);
-  pos = message;
+  if (pCli == NULL)
+    return 0;
   
-  sz = 0;
+  /* The line buffer is shared with other threads printing to the console */
+  mico_rtos_lock_mutex(&pCli->line_mutex);
   va_start(ap, msg);
-  nMessageLen = vsnprintf(pos, 256 - sz, msg, ap);
+  nMessageLen = vsnprintf(pCli->line, LINE_SIZE, msg, ap);
   va_end(ap);
   
-  if( nMessageLen<=0 ) return 0;
-  
-  cli_putstr((const char*)message);
+  if (nMessageLen > 0)
+    cli_putstr(pCli->line);
+  mico_rtos_unlock_mutex(&pCli->line_mutex);
   return 0;
 }
 
+/* Copied into the UART transmit FIFO, returns before it is sent */
 int cli_putstr(const char *msg)
 {
   if (msg[0] != 0)
-    MicoUartSend( CLI_UART, (const char*)msg, strlen(msg) );
+    MicoUartSendAsync( CLI_UART, (const char*)msg, strlen(msg), NULL, NULL );
   
   return 0;
 }
 
+cli_output_mode_t cli_output_mode(void)
+{
+  return (pCli == NULL) ? CLI_OUTPUT_TEXT : pCli->output_mode;
+}
+
+/* A record is built in the line buffer, with line_mutex held from
+ * cli_record_start() to cli_record_end(), and sent with one write, so no
+ * other console output lands in the middle of it. Only a record longer than
+ * the line goes out in pieces. */
+static void record_putc(char c)
+{
+  if (pCli->record_len >= LINE_SIZE - 1) {
+    pCli->line[pCli->record_len] = '\0';
+    cli_putstr(pCli->line);
+    pCli->record_len = 0;
+  }
+  pCli->line[pCli->record_len++] = c;
+}
+
+static void record_puts(const char *str)
+{
+  while (*str != '\0')
+    record_putc(*str++);
+}
+
+/* JSON strings only need quotes and backslashes escaped for the names and
+ * values printed here */
+static void record_put_json_string(const char *str)
+{
+  char escape[8];
+  const char *p;
+  
+  record_putc('"');
+  for (p = str; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\') {
+      record_putc('\\');
+      record_putc(*p);
+    } else if ((unsigned char)*p < 0x20) {
+      snprintf(escape, sizeof(escape), "\\u%04x", *p);
+      record_puts(escape);
+    } else {
+      record_putc(*p);
+    }
+  }
+  record_putc('"');
+}
+
+static void record_put_key(const char *key)
+{
+  if (pCli->output_mode == CLI_OUTPUT_JSON) {
+    record_putc(',');
+    record_put_json_string(key);
+    record_putc(':');
+  } else {
+    record_putc(' ');
+    record_puts(key);
+    record_putc('=');
+  }
+}
+
+void cli_record_start(const char *name)
+{
+  if (pCli == NULL)
+    return;
+  mico_rtos_lock_mutex(&pCli->line_mutex);
+  pCli->record_len = 0;
+  if (pCli->output_mode == CLI_OUTPUT_JSON) {
+    record_puts("{\"record\":");
+    record_put_json_string(name);
+  } else {
+    record_puts(name);
+  }
+}
+
+void cli_record_int(const char *key, int32_t value)
+{
+  char number[12];
+  
+  if (pCli == NULL)
+    return;
+  record_put_key(key);
+  snprintf(number, sizeof(number), "%d", value);
+  record_puts(number);
+}
+
+void cli_record_uint(const char *key, uint32_t value)
+{
+  char number[12];
+  
+  if (pCli == NULL)
+    return;
+  record_put_key(key);
+  snprintf(number, sizeof(number), "%u", value);
+  record_puts(number);
+}
+
+void cli_record_str(const char *key, const char *value)
+{
+  if (pCli == NULL)
+    return;
+  record_put_key(key);
+  if (pCli->output_mode == CLI_OUTPUT_JSON) {
+    record_put_json_string(value);
+  } else if (strchr(value, ' ') != NULL) {
+    record_putc('"');
+    record_puts(value);
+    record_putc('"');
+  } else {
+    record_puts(value);
+  }
+}
+
+void cli_record_end(void)
+{
+  if (pCli == NULL)
+    return;
+  record_puts((pCli->output_mode == CLI_OUTPUT_JSON) ? "}\r\n" : "\r\n");
+  pCli->line[pCli->record_len] = '\0';
+  cli_putstr(pCli->line);
+  pCli->record_len = 0;
+  mico_rtos_unlock_mutex(&pCli->line_mutex);
+}
+
 int cli_getchar(char *inbuf)
 {
   if (MicoUartRecv(CLI_UART, inbuf, 1, 1000) == 0)
@@ -9,12 +9,13 @@ struct cli_command {
 	/** The function that should be invoked for this command. */
 	void (*function) (char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
 };
+/* Command output is streamed to the console as it is printed, so it is not
+ * limited by xWriteBufferLen. Commands built into libraries against the old
+ * macro still fill pcWriteBuffer, which is sent once they return. */
 #define cmd_printf(...) do{\
-                                if (xWriteBufferLen > 0) {\
-                                    snprintf(pcWriteBuffer, xWriteBufferLen, __VA_ARGS__);\
-                                    xWriteBufferLen-=strlen(pcWriteBuffer);\
-                                    pcWriteBuffer+=strlen(pcWriteBuffer);\
-                                }\
+                                (void)pcWriteBuffer;\
+                                (void)xWriteBufferLen;\
+                                cli_printf(__VA_ARGS__);\
                              }while(0)
 
 #define CLI_ARGS char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv
@@ -90,6 +91,44 @@ int cli_getchar(char *inbuf);
  */
 int cli_printf(const char *buff, ...);
 
+/* Send a string to the CLI output without formatting
+ *
+ * \param msg Pointer to a NULL terminated string.
+ * \return 0 on success
+ */
+int cli_putstr(const char *msg);
+
+/** Output modes of the CLI, selected with the "output" command */
+typedef enum {
+	CLI_OUTPUT_TEXT,	/**< tables and messages for people */
+	CLI_OUTPUT_KV,		/**< one line per record: name key=value ... */
+	CLI_OUTPUT_JSON,	/**< one JSON object per line: {"record":"name","key":value,...} */
+} cli_output_mode_t;
+
+/** Get the output mode
+ *
+ * Commands with counters print them as records, see cli_record_start(),
+ * when the mode is not CLI_OUTPUT_TEXT, so test rigs can scrape them.
+ */
+cli_output_mode_t cli_output_mode(void);
+
+/** Start a record in the current machine readable output mode
+ *
+ * The record is sent in one piece by cli_record_end(), other console output
+ * waits until then, so nothing else may be printed in between.
+ *
+ * \param[in] name Record name, usually the command name.
+ */
+void cli_record_start(const char *name);
+
+/** Add a field to the record that is being printed */
+void cli_record_int(const char *key, int32_t value);
+void cli_record_uint(const char *key, uint32_t value);
+void cli_record_str(const char *key, const char *value);
+
+/** End the record that is being printed */
+void cli_record_end(void);
+
 
 
 
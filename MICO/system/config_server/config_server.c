@@ -559,10 +559,13 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico
       require_noerr( err, exit );
       sleep(1);
 
-      micoWlanSuspendSoftAP();
-      sleep(1);
-      mico_system_delegate_config_recv_ssid(inContext->flashContentInRam.micoSystemConfig.ssid, inContext->flashContentInRam.micoSystemConfig.user_key);
-      system_connect_wifi_normal( inContext );
+      /* The configuration mode closes the soft ap and connects, if it runs */
+      if( system_easylink_uap_complete( inContext ) == kNotPreparedErr ){
+        micoWlanSuspendSoftAP();
+        sleep(1);
+        mico_system_delegate_config_recv_ssid(inContext->flashContentInRam.micoSystemConfig.ssid, inContext->flashContentInRam.micoSystemConfig.user_key);
+        system_connect_wifi_normal( inContext );
+      }
     }
     goto exit;
   }
@@ -42,9 +42,33 @@
 // EasyLink Soft AP mode, HTTP configuration message define
 #define kEasyLinkURLAuth          "/auth-setup"
 
+/* Soft ap window between two EasyLink windows in CONFIG_MODE_EASYLINK_WITH_SOFTAP */
+#ifndef EasyLink_SoftAP_TimeOut
+#define EasyLink_SoftAP_TimeOut   60000
+#endif
+
+/* Configuration sources share one state: EasyLink and AirKiss are decoded
+   together by the Wi-Fi driver while sniffing, the soft ap window takes
+   credentials through the config server. The radio can only do one of the
+   two, so in CONFIG_MODE_EASYLINK_WITH_SOFTAP the windows take turns, none
+   of them waits longer than one window of the other. The first source that
+   delivers credentials claims the state, anything arriving after it is
+   dropped, and the source that is still open is closed before connecting. */
+typedef enum {
+  PROVISION_IDLE,           /**< between windows, or not running */
+  PROVISION_SNIFFING,       /**< EasyLink and AirKiss */
+  PROVISION_RECEIVED,       /**< sniffer got SSID and key, waits for the extra data */
+  PROVISION_SOFT_AP,        /**< soft ap and config server */
+  PROVISION_CLAIMED,        /**< credentials are complete, connecting */
+} provision_state_t;
+
 /* Internal vars and functions */
 static mico_semaphore_t   easylink_sem; /**< Used to suspend thread while connecting. */
-static bool               easylink_success = false; /**< true: connect to wlan, false: start soft ap mode or roll back to previoude settings */
+static mico_mutex_t       provision_mutex = NULL;
+static provision_state_t  provision_state = PROVISION_IDLE;
+static bool               provision_running = false;
+static uint32_t           provision_started = 0;    /**< mico_get_time() at start */
+static uint32_t           provision_claimed = 0;    /**< mico_get_time() when the credentials were complete */
 static uint32_t           easylinkIndentifier = 0; /**< Unique for an easylink instance. */
 static mico_config_source_t source = CONFIG_BY_NONE;
 static uint8_t            airkiss_random = 0x0;
@@ -57,6 +81,52 @@ static void remove_bonjour_for_easylink(void);
 static void airkiss_broadcast_thread(void *arg);
 
 
+/* Moves from one state to another, false if another source got there first */
+static bool provision_move( provision_state_t from, provision_state_t to )
+{
+  bool moved = false;
+
+  mico_rtos_lock_mutex( &provision_mutex );
+  if( provision_state == from ){
+    provision_state = to;
+    moved = true;
+  }
+  mico_rtos_unlock_mutex( &provision_mutex );
+  return moved;
+}
+
+static provision_state_t provision_get( void )
+{
+  provision_state_t state;
+
+  mico_rtos_lock_mutex( &provision_mutex );
+  state = provision_state;
+  mico_rtos_unlock_mutex( &provision_mutex );
+  return state;
+}
+
+static bool provision_claim( provision_state_t from, mico_config_source_t by )
+{
+  if( !provision_move( from, PROVISION_CLAIMED ) )
+    return false;
+  source = by;
+  provision_claimed = mico_get_time();
+  return true;
+}
+
+static const char *provision_source_name( mico_config_source_t by )
+{
+  switch( by ){
+  case CONFIG_BY_EASYLINK_V2:    return "EasyLink V2";
+  case CONFIG_BY_EASYLINK_PLUS:  return "EasyLink Plus";
+  case CONFIG_BY_EASYLINK_MINUS: return "EasyLink Minus";
+  case CONFIG_BY_AIRKISS:        return "AirKiss";
+  case CONFIG_BY_SOFT_AP:        return "soft ap";
+  default:                       return "unknown";
+  }
+}
+
+
 /* MiCO callback when WiFi status is changed */
 static void EasyLinkNotify_WifiStatusHandler(WiFiEvent event, mico_Context_t * const inContext)
 {
@@ -91,6 +161,7 @@ static void EasyLinkNotify_EasyLinkCompleteHandler(network_InitTypeDef_st *nwkpa
   
   require_action(inContext, exit, err = kParamErr);
   require_action(nwkpara, exit, err = kTimeoutErr);
+  require_action(provision_move( PROVISION_SNIFFING, PROVISION_RECEIVED ), exit, err = kStateErr);
 
   /* Store SSID and KEY*/
   mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
@@ -103,11 +174,16 @@ static void EasyLinkNotify_EasyLinkCompleteHandler(network_InitTypeDef_st *nwkpa
   system_log("Get SSID: %s, Key: %s", inContext->flashContentInRam.micoSystemConfig.ssid, inContext->flashContentInRam.micoSystemConfig.user_key);
 
   source = (mico_config_source_t)nwkpara->wifi_retry_interval;
+  /* Restarts the thread's wait for step 2 */
+  mico_rtos_set_semaphore(&easylink_sem);
 exit:
-  if( err != kNoErr){
+  if( err == kStateErr ){
+    /* Late or repeated, the credentials of the source that got there first stay */
+    system_log("EasyLink step 1 dropped");
+  }else if( err != kNoErr && ( provision_move( PROVISION_SNIFFING, PROVISION_IDLE ) ||
+                               provision_move( PROVISION_RECEIVED, PROVISION_IDLE ) ) ){
     /*EasyLink timeout or error*/    
     system_log("EasyLink step 1 ERROR, err: %d", err);
-    easylink_success = false;
     mico_rtos_set_semaphore(&easylink_sem);
 
     if(kNoErr == mico_system_context_restore(inContext)) {
@@ -132,6 +208,7 @@ static void EasyLinkNotify_EasyLinkGetExtraDataHandler(int datalen, char* data,
   char *debugString;
 
   require_action(inContext, exit, err = kParamErr);
+  require_action(provision_get( ) == PROVISION_RECEIVED, exit, err = kStateErr);
 
   if( source == CONFIG_BY_AIRKISS){
     airkiss_random = *data;
@@ -185,13 +262,16 @@ static void EasyLinkNotify_EasyLinkGetExtraDataHandler(int datalen, char* data,
   source = CONFIG_BY_EASYLINK_V2;
 
 exit:
-  if( err != kNoErr){
+  if( err == kStateErr ){
+    system_log("EasyLink step 2 dropped");
+    return;
+  }else if( err != kNoErr){
     /*EasyLink error*/    
     system_log("EasyLink step 2 ERROR, err: %d", err);
-    easylink_success = false;
+    provision_move( PROVISION_RECEIVED, PROVISION_IDLE );
   }else
     /* Easylink success after step 1 and step 2 */
-    easylink_success = true;
+    provision_claim( PROVISION_RECEIVED, source );
 
   mico_rtos_set_semaphore(&easylink_sem);    
   return;
@@ -203,6 +283,11 @@ OSStatus system_easylink_start( mico_Context_t * const inContext)
   OSStatus err = kUnknownErr;
   mico_thread_t easylink_thread_handler;
 
+  if( provision_mutex == NULL ){
+    err = mico_rtos_init_mutex( &provision_mutex );
+    require_noerr( err, exit );
+  }
+
   /* Start bonjour service for easylink mode */
   err = mico_easylink_bonjour_start( Station, inContext );
   require_noerr( err, exit );
@@ -222,21 +307,58 @@ exit:
   return err;
 }
 
+#if ( MICO_CONFIG_MODE == CONFIG_MODE_EASYLINK_WITH_SOFTAP ) || (MICO_CONFIG_MODE == CONFIG_MODE_SOFT_AP)
+static void easylink_soft_ap_start( mico_Context_t * const Context )
+{
+  network_InitTypeDef_st wNetConfig;
+
+  mico_system_delegate_soft_ap_will_start( );
+
+  memset(&wNetConfig, 0, sizeof(network_InitTypeDef_st));
+  wNetConfig.wifi_mode = Soft_AP;
+  snprintf(wNetConfig.wifi_ssid, 32, "EasyLink_%c%c%c%c%c%c", Context->micoStatus.mac[9],  Context->micoStatus.mac[10],
+                                                              Context->micoStatus.mac[12], Context->micoStatus.mac[13],
+                                                              Context->micoStatus.mac[15], Context->micoStatus.mac[16] );
+  strcpy((char*)wNetConfig.wifi_key, "");
+  strcpy((char*)wNetConfig.local_ip_addr, "10.10.10.1");
+  strcpy((char*)wNetConfig.net_mask, "255.255.255.0");
+  strcpy((char*)wNetConfig.gateway_ip_addr, "10.10.10.1");
+  wNetConfig.dhcpMode = DHCP_Server;
+  micoWlanStart(&wNetConfig);
+  system_log("Establish soft ap: %s.....", wNetConfig.wifi_ssid);
+
+  /* Config server is required in soft ap mode */
+  mico_easylink_bonjour_start( Soft_AP, Context );
+}
+#endif
+
+/* Called by the config server once it answered a configuration posted on the
+   soft ap, kNotPreparedErr if no configuration mode runs */
+OSStatus system_easylink_uap_complete( mico_Context_t * const inContext )
+{
+  UNUSED_PARAMETER( inContext );
+
+  if( !provision_running )
+    return kNotPreparedErr;
+  if( !provision_claim( PROVISION_SOFT_AP, CONFIG_BY_SOFT_AP ) )
+    return kStateErr;
+  mico_rtos_set_semaphore( &easylink_sem );
+  return kNoErr;
+}
+
 void easylink_thread(void *inContext)
 {    
   system_log_trace();
   OSStatus err = kNoErr;
   mico_Context_t *Context = inContext;
-#if ( MICO_CONFIG_MODE == CONFIG_MODE_EASYLINK_WITH_SOFTAP ) || (MICO_CONFIG_MODE == CONFIG_MODE_SOFT_AP)
-  network_InitTypeDef_st wNetConfig;
-#endif
   uint16_t start_easylink_cnt = 0;
 
   system_log("[DBG]easylink_thread: EASYLINK thread created");
 
   easylinkIndentifier = 0x0;
-  easylink_success = false;
   source = CONFIG_BY_NONE;
+  provision_state = PROVISION_IDLE;
+  provision_started = mico_get_time();
 
   /* Register notifications */
   mico_system_notify_register( mico_notify_WIFI_STATUS_CHANGED, (void *)EasyLinkNotify_WifiStatusHandler, inContext );
@@ -244,6 +366,7 @@ void easylink_thread(void *inContext)
   mico_system_notify_register( mico_notify_EASYLINK_GET_EXTRA_DATA, (void *)EasyLinkNotify_EasyLinkGetExtraDataHandler, inContext );
 
   mico_rtos_init_semaphore(&easylink_sem, 1);
+  provision_running = true;
 
   /* Skip Easylink mode */    
   if(Context->flashContentInRam.micoSystemConfig.easyLinkByPass == EASYLINK_BYPASS){
@@ -252,73 +375,71 @@ void easylink_thread(void *inContext)
     system_connect_wifi_fast( Context );
     goto exit;
   }
-/* If use CONFIG_MODE_SOFT_AP only, skip easylink mode, establish soft ap directly */ 
+
 restart:
+  provision_move( PROVISION_CLAIMED, PROVISION_IDLE );
 
-  while(easylink_success == false) {
+  while( provision_get( ) != PROVISION_CLAIMED ) {
     mico_system_delegate_config_will_start( ); 
 #if ( MICO_CONFIG_MODE != CONFIG_MODE_SOFT_AP ) 
+    /* The driver ends the window itself: step 2 or a timeout wakes the thread.
+       Step 2 that does not follow step 1 within a window is given up on here */
     system_log("Start easylink combo mode in %d so far", start_easylink_cnt++);
+    provision_move( PROVISION_IDLE, PROVISION_SNIFFING );
     micoWlanStartEasyLinkPlus(EasyLink_TimeOut/1000);
-    mico_rtos_get_semaphore(&easylink_sem, MICO_WAIT_FOREVER);
+    do{
+      if( mico_rtos_get_semaphore(&easylink_sem, EasyLink_TimeOut) != kNoErr &&
+          provision_move( PROVISION_RECEIVED, PROVISION_IDLE ) ){
+        system_log("EasyLink step 2 timeout");
+        micoWlanStopEasyLinkPlus();
+      }
+    }while( provision_get( ) == PROVISION_SNIFFING || provision_get( ) == PROVISION_RECEIVED );
+    if( provision_get( ) == PROVISION_CLAIMED )
+      break;
 #endif
-  }
 
-
-  /* EasyLink Success */
-  if( easylink_success == true ){
-    mico_system_delegate_config_recv_ssid(Context->flashContentInRam.micoSystemConfig.ssid, Context->flashContentInRam.micoSystemConfig.user_key);
-    system_connect_wifi_normal( Context );
-    err = mico_rtos_get_semaphore( &easylink_sem, EasyLink_ConnectWlan_Timeout );
-    /*SSID or Password is not correct, module cannot connect to wlan, so restart EasyLink again*/
-    require_noerr_action_string( err, restart, micoWlanSuspend(), "Re-start easylink commbo mode" );
-    mico_system_delegate_config_success( source );
-    if( source == CONFIG_BY_AIRKISS){
-      err = mico_rtos_create_thread( NULL, MICO_APPLICATION_PRIORITY, "AIRKISS", airkiss_broadcast_thread, 0x800, NULL );
-      require_noerr_string( err, exit, "ERROR: Unable to start the EasyLink thread." );
+#if ( MICO_CONFIG_MODE == CONFIG_MODE_EASYLINK_WITH_SOFTAP ) || (MICO_CONFIG_MODE == CONFIG_MODE_SOFT_AP)
+    mico_thread_msleep(20);
+    provision_move( PROVISION_IDLE, PROVISION_SOFT_AP );
+    easylink_soft_ap_start( Context );
+#if ( MICO_CONFIG_MODE == CONFIG_MODE_SOFT_AP )
+    while( provision_get( ) != PROVISION_CLAIMED )
+      mico_rtos_get_semaphore(&easylink_sem, MICO_WAIT_FOREVER);
+#else
+    /* Close the window unless the config server claimed it first */
+    while( provision_get( ) != PROVISION_CLAIMED ){
+      if( mico_rtos_get_semaphore(&easylink_sem, EasyLink_SoftAP_TimeOut) != kNoErr &&
+          provision_move( PROVISION_SOFT_AP, PROVISION_IDLE ) ){
+        micoWlanSuspendSoftAP();
+        break;
+      }
     }
+#endif
+#endif
+  }
 
-    goto exit;
+  /* Credentials claimed, close the source that delivered them and connect */
+  if( source == CONFIG_BY_SOFT_AP ){
+    micoWlanSuspendSoftAP();
+    mico_thread_sleep(1);
   }
-  /* EasyLink failed */
-  else{
-#if ( MICO_CONFIG_MODE == CONFIG_MODE_EASYLINK_WITH_SOFTAP ) || (MICO_CONFIG_MODE == CONFIG_MODE_SOFT_AP) //start soft ap mode 
-    mico_thread_msleep(20);
+  system_log("Configured by %s in %d ms", provision_source_name( source ), provision_claimed - provision_started);
 
-    mico_system_delegate_soft_ap_will_start( );
-
-    memset(&wNetConfig, 0, sizeof(network_InitTypeDef_st));
-    wNetConfig.wifi_mode = Soft_AP;
-    snprintf(wNetConfig.wifi_ssid, 32, "EasyLink_%c%c%c%c%c%c", Context->micoStatus.mac[9],  Context->micoStatus.mac[10],
-                                                                Context->micoStatus.mac[12], Context->micoStatus.mac[13],
-                                                                Context->micoStatus.mac[15], Context->micoStatus.mac[16] );
-    strcpy((char*)wNetConfig.wifi_key, "");
-    strcpy((char*)wNetConfig.local_ip_addr, "10.10.10.1");
-    strcpy((char*)wNetConfig.net_mask, "255.255.255.0");
-    strcpy((char*)wNetConfig.gateway_ip_addr, "10.10.10.1");
-    wNetConfig.dhcpMode = DHCP_Server;
-    micoWlanStart(&wNetConfig);
-    system_log("Establish soft ap: %s.....", wNetConfig.wifi_ssid);
-
-    /* Config server is required in soft ap mode */
-    err = mico_easylink_bonjour_start( Soft_AP, Context );
-    require_noerr( err, exit );
+  /* A wake-up left over from the windows must not pass for the station coming up */
+  while( mico_rtos_get_semaphore( &easylink_sem, 0 ) == kNoErr );
 
-    mico_rtos_get_semaphore(&easylink_sem, MICO_WAIT_FOREVER);
-
-    mico_system_delegate_config_success( CONFIG_BY_SOFT_AP );
-#else // CONFIG_MODE_EASYLINK mode
-    /*so roll back to previous settings  (if it has) and connect*/
-    if(Context->flashContentInRam.micoSystemConfig.configured != unConfigured){
-      MICOReadConfiguration( Context );
-      Context->flashContentInRam.micoSystemConfig.configured = allConfigured;
-      mico_system_context_update( Context );
-      system_connect_wifi_normal( Context );
-    }else{
-      /*module should power down in default setting*/
-      micoWlanPowerOff();
-    }
-#endif
+  mico_system_delegate_config_recv_ssid(Context->flashContentInRam.micoSystemConfig.ssid, Context->flashContentInRam.micoSystemConfig.user_key);
+  system_connect_wifi_normal( Context );
+  err = mico_rtos_get_semaphore( &easylink_sem, EasyLink_ConnectWlan_Timeout );
+  /*SSID or Password is not correct, module cannot connect to wlan, so restart EasyLink again*/
+  require_noerr_action_string( err, restart, micoWlanSuspend(), "Re-start easylink commbo mode" );
+
+  system_log("Online by %s: configured in %d ms, connected in %d ms, %d ms in total", provision_source_name( source ),
+             provision_claimed - provision_started, mico_get_time() - provision_claimed, mico_get_time() - provision_started);
+  mico_system_delegate_config_success( source );
+  if( source == CONFIG_BY_AIRKISS){
+    err = mico_rtos_create_thread( NULL, MICO_APPLICATION_PRIORITY, "AIRKISS", airkiss_broadcast_thread, 0x800, NULL );
+    require_noerr_string( err, exit, "ERROR: Unable to start the EasyLink thread." );
   }
 
 exit:
@@ -333,6 +454,8 @@ exit:
   require_noerr(err, exit);
 #endif 
 
+  provision_running = false;
+  provision_state = PROVISION_IDLE;
   mico_rtos_deinit_semaphore( &easylink_sem );
   easylink_sem = NULL;
 
@@ -378,6 +501,9 @@ OSStatus ConfigIncommingJsonMessageUAP( const uint8_t *input, size_t size )
   char *input_str = NULL;
   system_log_trace();
   mico_Context_t *inContext = mico_system_context_get();
+
+  /* Another source already delivered credentials, or the soft ap is closing */
+  require_action( !provision_running || provision_get( ) == PROVISION_SOFT_AP, exit, err = kStateErr );
   inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_BYPASS_NO;
 
   input_str = calloc(size+1, sizeof(char));
@@ -33,6 +33,7 @@
 #include "MICO.h"
 #include "mico_system.h"
 #include "CheckSumUtils.h"
+#include <stddef.h>
 
 /* Update seed number every time*/
 static int32_t seedNum = 0;
@@ -40,20 +41,91 @@ static int32_t seedNum = 0;
 #define SYS_CONFIG_OFFSET   ( sizeof( boot_table_t ) )
 #define SYS_CONFIG_SIZE     ( sizeof( mico_sys_config_t ) )
 
+/* Legacy layout, only used to migrate settings written by older firmware */
 #define USER_CONFIG_OFFSET  ( 0x400 )
 
 #define CRC_OFFSET    ( 0xE00 )
 #define CRC_SIZE      ( 2 )
 
+/* Log structured layout: PARAMETER_1 and PARAMETER_2 are used as two log sectors,
+   records are appended until the active sector is full, then the live data is 
+   compacted into the other sector. The OTA boot table stays on offset 0 of 
+   PARAMETER_1, bootloader reads and clears it there. */
+#define PARA_LOG_MAGIC          ( 0x474F4C50 )  /* "PLOG" */
+#define PARA_LOG_HEADER_OFFSET  ( 0x20 )
+#define PARA_LOG_DATA_OFFSET    ( PARA_LOG_HEADER_OFFSET + sizeof( para_log_sector_t ) )
+#define PARA_LOG_CHUNK_SIZE     ( 128 )
+#define PARA_LOG_ALIGN(x)       ( ( (x) + 3 ) & ~3UL )
+
+#define PARA_LOG_BLOB_SYS       ( 0x01 )
+#define PARA_LOG_BLOB_USER      ( 0x02 )
+#define PARA_LOG_KEY(blob, n)   ( (uint16_t)( ( (blob) << 8 ) | (n) ) )
+#define PARA_LOG_KEY_ERASED     ( 0xFFFF )
+
+#define PARA_LOG_FLAG_COMMIT    ( 0x01 )
+
+#ifndef MIN
+#define MIN(x,y)  ((x) < (y) ? (x) : (y))
+#endif
+
 //#define para_log(M, ...) custom_log("MiCO Settting", M, ##__VA_ARGS__)
 
 #define para_log(M, ...)
 
+typedef struct
+{
+  uint32_t magic;
+  uint32_t generation;
+  uint16_t crc;
+  uint16_t reserved;
+} para_log_sector_t;
+
+typedef struct
+{
+  uint16_t key;
+  uint16_t length;
+  uint32_t seq;
+  uint8_t  flags;
+  uint8_t  reserved;
+  uint16_t crc;         /* CRC16 on header fields above and record payload */
+} para_log_record_t;
+
+#define PARA_LOG_RECORD_CRC_SIZE  ( offsetof( para_log_record_t, crc ) )
+
+typedef struct
+{
+  bool     valid;       /* Header is correct and at least one transaction is committed */
+  bool     sealed;      /* Torn or uncommitted tail found, no more appends */
+  uint32_t generation;
+  uint32_t seq;         /* Sequence number of the last committed transaction */
+  uint32_t end;         /* First unused byte */
+} para_log_scan_t;
+
+typedef struct
+{
+  mico_partition_t active;
+  uint32_t         sector_size;
+  uint32_t         generation;
+  uint32_t         seq;
+  uint32_t         write_offset;
+  bool             sealed;
+  uint32_t         sys_chunks;
+  uint32_t         chunk_num;
+  uint16_t        *chunk_offset; /* Record offset of the live copy of every chunk, 0: not on flash */
+} para_log_t;
+
+static para_log_t para_log_ctx = { MICO_PARTITION_NONE, 0, 0, 0, 0, false, 0, 0, NULL };
+
 __weak void appRestoreDefault_callback(void *user_data, uint32_t size)
 {
 
 }
 
+__weak uint32_t appLegacyConfigSize_callback(uint32_t size)
+{
+  return size;
+}
+
 static bool is_crc_match( uint16_t crc_1, uint16_t crc_2)
 {
   if( crc_1 == 0 || crc_2 == 0)
@@ -65,146 +137,432 @@ static bool is_crc_match( uint16_t crc_1, uint16_t crc_2)
   return true;
 }
 
-static OSStatus internal_update_config( mico_Context_t * const inContext )
+static mico_partition_t para_log_other( mico_partition_t partition )
+{
+  return ( partition == MICO_PARTITION_PARAMETER_2 )? MICO_PARTITION_PARAMETER_1 : MICO_PARTITION_PARAMETER_2;
+}
+
+static uint16_t para_log_record_crc( para_log_record_t *record, const uint8_t *payload )
 {
-  OSStatus err = kNoErr;
-  uint32_t para_offset;
   CRC16_Context crc_context;
   uint16_t crc_result;
-  
-  uint16_t crc_readback;;
-
-  para_log("Flash write!");
 
   CRC16_Init( &crc_context );
-  CRC16_Update( &crc_context, &inContext->flashContentInRam.micoSystemConfig, SYS_CONFIG_SIZE );
-  CRC16_Update( &crc_context, inContext->user_config_data, inContext->user_config_data_size );
+  CRC16_Update( &crc_context, record, PARA_LOG_RECORD_CRC_SIZE );
+  CRC16_Update( &crc_context, payload, record->length );
+  CRC16_Final( &crc_context, &crc_result );
+  return crc_result;
+}
 
+static uint16_t para_log_sector_crc( para_log_sector_t *sector )
+{
+  CRC16_Context crc_context;
+  uint16_t crc_result;
+
+  CRC16_Init( &crc_context );
+  CRC16_Update( &crc_context, sector, offsetof( para_log_sector_t, crc ) );
   CRC16_Final( &crc_context, &crc_result );
+  return crc_result;
+}
 
-  err = MicoFlashErase( MICO_PARTITION_PARAMETER_1, 0x0, sizeof(flash_content_t) );
-  require_noerr(err, exit);
+/* Map a chunk index to its address and length in RAM */
+static uint8_t *para_log_chunk( mico_Context_t * const inContext, uint32_t index, uint16_t *key, uint32_t *len )
+{
+  uint32_t offset, size;
+  uint8_t *base;
+
+  if( index < para_log_ctx.sys_chunks ){
+    base = (uint8_t *)&inContext->flashContentInRam.micoSystemConfig;
+    size = SYS_CONFIG_SIZE;
+    offset = index * PARA_LOG_CHUNK_SIZE;
+    *key = PARA_LOG_KEY( PARA_LOG_BLOB_SYS, index );
+  } else {
+    base = inContext->user_config_data;
+    size = inContext->user_config_data_size;
+    offset = ( index - para_log_ctx.sys_chunks ) * PARA_LOG_CHUNK_SIZE;
+    *key = PARA_LOG_KEY( PARA_LOG_BLOB_USER, index - para_log_ctx.sys_chunks );
+  }
 
-  para_offset = 0x0;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
-  require_noerr(err, exit);
+  *len = MIN( PARA_LOG_CHUNK_SIZE, size - offset );
+  return base + offset;
+}
 
-  para_offset = USER_CONFIG_OFFSET;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, inContext->user_config_data, inContext->user_config_data_size );
-  require_noerr(err, exit);
+/* Map a record key to a chunk index, return -1 if the key is unknown to this firmware */
+static int32_t para_log_chunk_index( uint16_t key )
+{
+  uint32_t n = key & 0xFF;
 
-  para_offset = CRC_OFFSET;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&crc_result, CRC_SIZE );
-  require_noerr(err, exit);
-  
-  /* Read back*/
-  para_offset = CRC_OFFSET;
-  err = MicoFlashRead( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&crc_readback, CRC_SIZE );
-  para_log( "crc_readback = %d", crc_readback);
-  if( crc_readback == 0x0)
-    return kWriteErr;
-  
+  if( ( key >> 8 ) == PARA_LOG_BLOB_SYS && n < para_log_ctx.sys_chunks )
+    return n;
+  if( ( key >> 8 ) == PARA_LOG_BLOB_USER && n < para_log_ctx.chunk_num - para_log_ctx.sys_chunks )
+    return n + para_log_ctx.sys_chunks;
+  return -1;
+}
 
-  /* Write backup data*/
-  err = MicoFlashErase( MICO_PARTITION_PARAMETER_2, 0x0, sizeof(flash_content_t) );
-  require_noerr(err, exit);
+/* Walk through all records in a sector. If inContext is not NULL, committed records
+   are applied to RAM and the chunk location table, last_seq should be provided by a 
+   previous scan in this case. */
+static void para_log_scan( mico_partition_t partition, para_log_scan_t *scan, mico_Context_t * const inContext, uint32_t last_seq )
+{
+  para_log_sector_t sector;
+  para_log_record_t record;
+  uint8_t payload[PARA_LOG_CHUNK_SIZE];
+  uint32_t offset, record_offset;
+  uint16_t key;
+  uint32_t len;
+  uint8_t *data;
+  int32_t index;
+  uint32_t commit_end = PARA_LOG_DATA_OFFSET;
+
+  memset( scan, 0x0, sizeof(para_log_scan_t) );
+
+  offset = PARA_LOG_HEADER_OFFSET;
+  if( MicoFlashRead( partition, &offset, (uint8_t *)&sector, sizeof(para_log_sector_t) ) != kNoErr )
+    return;
+  if( sector.magic != PARA_LOG_MAGIC || sector.crc != para_log_sector_crc( &sector ) )
+    return;
+
+  scan->generation = sector.generation;
+  scan->end = PARA_LOG_DATA_OFFSET;
+
+  while( scan->end + sizeof(para_log_record_t) <= para_log_ctx.sector_size ){
+    record_offset = offset = scan->end;
+    if( MicoFlashRead( partition, &offset, (uint8_t *)&record, sizeof(para_log_record_t) ) != kNoErr )
+      break;
+
+    if( record.key == PARA_LOG_KEY_ERASED && record.length == 0xFFFF )
+      break;
+
+    /* Torn write, nothing after this point can be trusted */
+    if( record.length > PARA_LOG_CHUNK_SIZE || offset + record.length > para_log_ctx.sector_size ){
+      scan->sealed = true;
+      break;
+    }
+    if( MicoFlashRead( partition, &offset, payload, record.length ) != kNoErr || 
+        record.crc != para_log_record_crc( &record, payload ) ){
+      scan->sealed = true;
+      break;
+    }
 
-  para_offset = 0x0;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
-  require_noerr(err, exit);
+    scan->end = PARA_LOG_ALIGN( offset );
 
-  para_offset = USER_CONFIG_OFFSET;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, inContext->user_config_data, inContext->user_config_data_size );
-  require_noerr(err, exit);
+    if( record.flags & PARA_LOG_FLAG_COMMIT ){
+      scan->valid = true;
+      scan->seq = record.seq;
+      commit_end = scan->end;
+    }
+
+    if( inContext == NULL || record.seq > last_seq )
+      continue;
+
+    index = para_log_chunk_index( record.key );
+    if( index < 0 )
+      continue;
+    data = para_log_chunk( inContext, index, &key, &len );
+    memcpy( data, payload, MIN( len, record.length ) );
+    para_log_ctx.chunk_offset[index] = record_offset;
+  }
+
+  /* Records written after the last commit belong to an interrupted transaction,
+     never append behind them, or they would be taken by the next commit. */
+  if( scan->end != commit_end )
+    scan->sealed = true;
+}
 
-  para_offset = CRC_OFFSET;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, (uint8_t *)&crc_result, CRC_SIZE );
+static OSStatus para_log_append( mico_partition_t partition, uint32_t *offset, uint16_t key, uint32_t seq, uint8_t flags, uint8_t *data, uint32_t len )
+{
+  OSStatus err = kNoErr;
+  para_log_record_t record;
+  uint32_t pad = 0xFFFFFFFF;
+  uint32_t write_offset = *offset;
+
+  memset( &record, 0x0, sizeof(para_log_record_t) );
+  record.key = key;
+  record.length = len;
+  record.seq = seq;
+  record.flags = flags;
+  record.crc = para_log_record_crc( &record, data );
+
+  err = MicoFlashWrite( partition, &write_offset, (uint8_t *)&record, sizeof(para_log_record_t) );
+  require_noerr(err, exit);
+  err = MicoFlashWrite( partition, &write_offset, data, len );
   require_noerr(err, exit);
+  if( PARA_LOG_ALIGN( write_offset ) != write_offset ){
+    err = MicoFlashWrite( partition, &write_offset, (uint8_t *)&pad, PARA_LOG_ALIGN( write_offset ) - write_offset );
+    require_noerr(err, exit);
+  }
+
+  *offset = write_offset;
 
 exit:
   return err;
 }
 
-OSStatus mico_system_context_restore( mico_Context_t * const inContext )
-{ 
+/* Check whether the live copy of a chunk on flash equals to RAM */
+static bool para_log_chunk_is_dirty( mico_Context_t * const inContext, uint32_t index )
+{
+  para_log_record_t record;
+  uint8_t payload[PARA_LOG_CHUNK_SIZE];
+  uint32_t offset = para_log_ctx.chunk_offset[index];
+  uint16_t key;
+  uint32_t len;
+  uint8_t *data = para_log_chunk( inContext, index, &key, &len );
+
+  if( offset == 0 )
+    return true;
+  if( MicoFlashRead( para_log_ctx.active, &offset, (uint8_t *)&record, sizeof(para_log_record_t) ) != kNoErr )
+    return true;
+  if( record.length != len )
+    return true;
+  if( MicoFlashRead( para_log_ctx.active, &offset, payload, len ) != kNoErr )
+    return true;
+
+  return ( memcmp( payload, data, len ) == 0 )? false : true;
+}
+
+static OSStatus para_log_write_boot_table( mico_Context_t * const inContext )
+{
+  uint32_t offset = 0x0;
+  return MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &offset, (uint8_t *)&inContext->flashContentInRam.bootTable, sizeof(boot_table_t) );
+}
+
+/* Copy all live data into the other sector as a single transaction */
+static OSStatus para_log_compact( mico_Context_t * const inContext, mico_partition_t target )
+{
   OSStatus err = kNoErr;
-  require_action( inContext, exit, err = kNotPreparedErr );
+  para_log_sector_t sector;
+  uint32_t offset, index, len, total = 0;
+  uint32_t seq = para_log_ctx.seq + 1;
+  uint16_t key;
+  uint8_t *data;
+
+  for( index = 0; index < para_log_ctx.chunk_num; index++ ){
+    para_log_chunk( inContext, index, &key, &len );
+    total += sizeof(para_log_record_t) + PARA_LOG_ALIGN( len );
+  }
+  require_action( PARA_LOG_DATA_OFFSET + total <= para_log_ctx.sector_size, exit, err = kSizeErr );
 
-  /*wlan configration is not need to change to a default state, use easylink to do that*/
-  memset(&inContext->flashContentInRam, 0x0, sizeof(inContext->flashContentInRam));
-  sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
-  inContext->flashContentInRam.micoSystemConfig.configured = unConfigured;
-  inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_BYPASS_NO;
-  inContext->flashContentInRam.micoSystemConfig.rfPowerSaveEnable = false;
-  inContext->flashContentInRam.micoSystemConfig.mcuPowerSaveEnable = false;
-  inContext->flashContentInRam.micoSystemConfig.magic_number = SYS_MAGIC_NUMBR;
-  inContext->flashContentInRam.micoSystemConfig.seed = seedNum;
+  para_log("Compact to %s, generation %d", target == MICO_PARTITION_PARAMETER_1? "PARA1" : "PARA2", para_log_ctx.generation + 1 );
 
-  /*Application's default configuration*/
-  appRestoreDefault_callback(inContext->user_config_data, inContext->user_config_data_size);
+  /* From now on, the target sector is no longer a valid fall back */
+  err = MicoFlashErase( target, 0x0, para_log_ctx.sector_size );
+  require_noerr(err, exit);
 
-  para_log("Restore to default");
+  /* Boot table is wiped out by the erase above */
+  if( target == MICO_PARTITION_PARAMETER_1 ){
+    err = para_log_write_boot_table( inContext );
+    require_noerr(err, exit);
+  }
 
-  err = internal_update_config( inContext );
+  sector.magic = PARA_LOG_MAGIC;
+  sector.generation = para_log_ctx.generation + 1;
+  sector.reserved = 0xFFFF;
+  sector.crc = para_log_sector_crc( &sector );
+  offset = PARA_LOG_HEADER_OFFSET;
+  err = MicoFlashWrite( target, &offset, (uint8_t *)&sector, sizeof(para_log_sector_t) );
   require_noerr(err, exit);
 
+  offset = PARA_LOG_DATA_OFFSET;
+  for( index = 0; index < para_log_ctx.chunk_num; index++ ){
+    data = para_log_chunk( inContext, index, &key, &len );
+    para_log_ctx.chunk_offset[index] = offset;
+    err = para_log_append( target, &offset, key, seq, 
+                           ( index == para_log_ctx.chunk_num - 1 )? PARA_LOG_FLAG_COMMIT : 0, data, len );
+    require_noerr(err, exit);
+  }
+
+  para_log_ctx.active = target;
+  para_log_ctx.generation = sector.generation;
+  para_log_ctx.seq = seq;
+  para_log_ctx.write_offset = offset;
+  para_log_ctx.sealed = false;
+
 exit:
   return err;
 }
 
-#ifdef MFG_MODE_AUTO
-OSStatus MICORestoreMFG( void )
-{ 
+/* Write all modified chunks to flash as a single transaction */
+static OSStatus internal_update_config( mico_Context_t * const inContext )
+{
   OSStatus err = kNoErr;
-  mico_Context_t *inContext = mico_system_context_get();
-  require_action( inContext, exit, err = kNotPreparedErr );
+  boot_table_t boot_table;
+  uint32_t offset, index, len, need = 0;
+  uint32_t seq, last = 0, dirty_num = 0;
+  uint16_t key;
+  uint8_t *data;
+  bool relocate = false;
 
-  /*wlan configration is not need to change to a default state, use easylink to do that*/
-  sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
-  inContext->flashContentInRam.micoSystemConfig.configured = mfgConfigured;
-  inContext->flashContentInRam.micoSystemConfig.magic_number = SYS_MAGIC_NUMBR;
+  para_log("Flash write!");
 
-  /*Application's default configuration*/
-  appRestoreDefault_callback(inContext->user_config_data, inContext->user_config_data_size);
+  require_action( para_log_ctx.chunk_offset, exit, err = kNotPreparedErr );
 
-  err = internal_update_config( inContext );
+  /* Boot table can only be updated in place if no bit goes from 0 to 1, 
+     otherwise PARAMETER_1 has to be erased and rebuilt by a compaction. */
+  offset = 0x0;
+  err = MicoFlashRead( MICO_PARTITION_PARAMETER_1, &offset, (uint8_t *)&boot_table, sizeof(boot_table_t) );
   require_noerr(err, exit);
+  if( memcmp( &boot_table, &inContext->flashContentInRam.bootTable, sizeof(boot_table_t) ) ){
+    for( index = 0; index < sizeof(boot_table_t); index++ ){
+      if( ( ((uint8_t *)&boot_table)[index] & ((uint8_t *)&inContext->flashContentInRam.bootTable)[index] ) != 
+          ((uint8_t *)&inContext->flashContentInRam.bootTable)[index] )
+        relocate = true;
+    }
+    if( relocate == false ){
+      err = para_log_write_boot_table( inContext );
+      require_noerr(err, exit);
+    }
+  }
+
+  if( para_log_ctx.active == MICO_PARTITION_NONE ){
+    err = para_log_compact( inContext, relocate? MICO_PARTITION_PARAMETER_1 : MICO_PARTITION_PARAMETER_2 );
+    goto exit;
+  }
+
+  if( relocate ){
+    if( para_log_ctx.active == MICO_PARTITION_PARAMETER_1 ){
+      err = para_log_compact( inContext, MICO_PARTITION_PARAMETER_2 );
+      require_noerr(err, exit);
+    }
+    err = para_log_compact( inContext, MICO_PARTITION_PARAMETER_1 );
+    goto exit;
+  }
+
+  /* Dirty chunks are marked by clearing their location, they are rewritten anyway */
+  for( index = 0; index < para_log_ctx.chunk_num; index++ ){
+    if( para_log_chunk_is_dirty( inContext, index ) ){
+      para_log_ctx.chunk_offset[index] = 0;
+      para_log_chunk( inContext, index, &key, &len );
+      need += sizeof(para_log_record_t) + PARA_LOG_ALIGN( len );
+      last = index;
+      dirty_num++;
+    }
+  }
+
+  if( dirty_num == 0 )
+    goto exit;
+
+  if( para_log_ctx.sealed || para_log_ctx.write_offset + need > para_log_ctx.sector_size ){
+    err = para_log_compact( inContext, para_log_other( para_log_ctx.active ) );
+    goto exit;
+  }
+
+  para_log("Append %d chunks", dirty_num);
+
+  seq = para_log_ctx.seq + 1;
+  offset = para_log_ctx.write_offset;
+  for( index = 0; index < para_log_ctx.chunk_num; index++ ){
+    if( para_log_ctx.chunk_offset[index] != 0 )
+      continue;
+    data = para_log_chunk( inContext, index, &key, &len );
+    err = para_log_append( para_log_ctx.active, &offset, key, seq, ( index == last )? PARA_LOG_FLAG_COMMIT : 0, data, len );
+    /* The tail may be half written, let next update start from a clean sector */
+    require_noerr_action(err, exit, para_log_ctx.sealed = true);
+    para_log_ctx.chunk_offset[index] = para_log_ctx.write_offset;
+    para_log_ctx.write_offset = offset;
+  }
+  para_log_ctx.seq = seq;
 
 exit:
   return err;
 }
-#endif
 
-OSStatus MICOReadConfiguration(mico_Context_t *inContext)
+/* Prepare chunk table for current config size and find the newest valid log sector */
+static OSStatus para_log_mount( mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  para_log_scan_t scan_1, scan_2, scan;
+  mico_partition_t partition;
+  mico_logic_partition_t *partition_info;
+  uint32_t offset;
+
+  partition_info = MicoFlashGetInfo( MICO_PARTITION_PARAMETER_1 );
+  para_log_ctx.sector_size = partition_info->partition_length;
+  partition_info = MicoFlashGetInfo( MICO_PARTITION_PARAMETER_2 );
+  para_log_ctx.sector_size = MIN( para_log_ctx.sector_size, partition_info->partition_length );
+
+  para_log_ctx.active = MICO_PARTITION_NONE;
+  para_log_ctx.sys_chunks = ( SYS_CONFIG_SIZE + PARA_LOG_CHUNK_SIZE - 1 ) / PARA_LOG_CHUNK_SIZE;
+  para_log_ctx.chunk_num = para_log_ctx.sys_chunks + 
+    ( inContext->user_config_data_size + PARA_LOG_CHUNK_SIZE - 1 ) / PARA_LOG_CHUNK_SIZE;
+
+  if( para_log_ctx.chunk_offset != NULL ) free( para_log_ctx.chunk_offset );
+  para_log_ctx.chunk_offset = calloc( para_log_ctx.chunk_num, sizeof(uint16_t) );
+  require_action( para_log_ctx.chunk_offset, exit, err = kNoMemoryErr );
+
+  para_log_scan( MICO_PARTITION_PARAMETER_1, &scan_1, NULL, 0 );
+  para_log_scan( MICO_PARTITION_PARAMETER_2, &scan_2, NULL, 0 );
+
+  if( scan_1.valid && ( !scan_2.valid || (int32_t)( scan_1.generation - scan_2.generation ) > 0 ) ){
+    partition = MICO_PARTITION_PARAMETER_1;
+    scan = scan_1;
+  } else if ( scan_2.valid ) {
+    partition = MICO_PARTITION_PARAMETER_2;
+    scan = scan_2;
+  } else {
+    err = kNotFoundErr;
+    goto exit;
+  }
+
+  memset( &inContext->flashContentInRam, 0x0, sizeof(inContext->flashContentInRam) );
+  memset( inContext->user_config_data, 0x0, inContext->user_config_data_size );
+
+  offset = 0x0;
+  err = MicoFlashRead( MICO_PARTITION_PARAMETER_1, &offset, (uint8_t *)&inContext->flashContentInRam.bootTable, sizeof(boot_table_t) );
+  require_noerr(err, exit);
+
+  para_log_scan( partition, &scan, inContext, scan.seq );
+
+  para_log_ctx.active = partition;
+  para_log_ctx.generation = scan.generation;
+  para_log_ctx.seq = scan.seq;
+  para_log_ctx.write_offset = scan.end;
+  para_log_ctx.sealed = scan.sealed;
+
+  para_log("Log mounted on %s, generation %d, seq %d, used %d bytes", 
+           partition == MICO_PARTITION_PARAMETER_1? "PARA1" : "PARA2", scan.generation, scan.seq, scan.end );
+
+exit:
+  return err;
+}
+
+/* Read settings saved by firmware without log structured storage. The CRC there
+   covers the user config as large as the old firmware had it, fields added since
+   are left zero. */
+static OSStatus para_legacy_read( mico_Context_t * const inContext )
 {
   uint32_t para_offset = 0x0;
-  //uint32_t config_offset = CONFIG_OFFSET;
   uint32_t crc_offset = CRC_OFFSET;
+  uint32_t legacy_size;
   CRC16_Context crc_context;
   uint16_t crc_result, crc_target;
   uint16_t crc_backup_result, crc_backup_target;
-  mico_logic_partition_t *partition; 
   uint8_t *sys_backup_data = NULL;
   uint8_t *user_backup_data = NULL;
 
   OSStatus err = kNoErr;
 
+  legacy_size = appLegacyConfigSize_callback( inContext->user_config_data_size );
+  require_action( legacy_size <= inContext->user_config_data_size && 
+                  USER_CONFIG_OFFSET + legacy_size <= CRC_OFFSET, exit, err = kSizeErr );
+
   sys_backup_data = malloc( SYS_CONFIG_SIZE );
   require_action( sys_backup_data, exit, err = kNoMemoryErr );
 
   user_backup_data = malloc( inContext->user_config_data_size );
   require_action( user_backup_data, exit, err = kNoMemoryErr );
 
+  memset( inContext->user_config_data, 0x0, inContext->user_config_data_size );
+  memset( user_backup_data, 0x0, inContext->user_config_data_size );
 
   /* Load data and crc from main partition */
   para_offset = 0x0;
   err = MicoFlashRead( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof( flash_content_t ) );
   para_offset = USER_CONFIG_OFFSET;
-  err = MicoFlashRead( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)inContext->user_config_data, inContext->user_config_data_size );
+  err = MicoFlashRead( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)inContext->user_config_data, legacy_size );
 
   CRC16_Init( &crc_context );
   CRC16_Update( &crc_context, (uint8_t *)&inContext->flashContentInRam.micoSystemConfig, SYS_CONFIG_SIZE );
-  CRC16_Update( &crc_context, inContext->user_config_data, inContext->user_config_data_size );
+  CRC16_Update( &crc_context, inContext->user_config_data, legacy_size );
   CRC16_Final( &crc_context, &crc_result );
   para_log( "crc_result = %d", crc_result);
 
@@ -212,76 +570,105 @@ OSStatus MICOReadConfiguration(mico_Context_t *inContext)
   err = MicoFlashRead( MICO_PARTITION_PARAMETER_1, &crc_offset, (uint8_t *)&crc_target, CRC_SIZE );
   para_log( "crc_target = %d", crc_target);
 
+  if( is_crc_match( crc_result, crc_target ) == true )
+    goto exit;
+
   /* Load data and crc from backup partition */
   para_offset = SYS_CONFIG_OFFSET;
   err = MicoFlashRead( MICO_PARTITION_PARAMETER_2, &para_offset, sys_backup_data, SYS_CONFIG_SIZE );
   para_offset = USER_CONFIG_OFFSET;
-  err = MicoFlashRead( MICO_PARTITION_PARAMETER_2, &para_offset, user_backup_data, inContext->user_config_data_size );
+  err = MicoFlashRead( MICO_PARTITION_PARAMETER_2, &para_offset, user_backup_data, legacy_size );
 
   CRC16_Init( &crc_context );
   CRC16_Update( &crc_context, sys_backup_data,  SYS_CONFIG_SIZE );
-  CRC16_Update( &crc_context, user_backup_data, inContext->user_config_data_size );
+  CRC16_Update( &crc_context, user_backup_data, legacy_size );
   CRC16_Final( &crc_context, &crc_backup_result );
   para_log( "crc_backup_result = %d", crc_backup_result);
 
   crc_offset = CRC_OFFSET;
   err = MicoFlashRead( MICO_PARTITION_PARAMETER_2, &crc_offset, (uint8_t *)&crc_backup_target, CRC_SIZE );  
   para_log( "crc_backup_target = %d", crc_backup_target);
-  
-  /* Data collapsed at main partition */
-  if( is_crc_match( crc_result, crc_target ) == false ){
-    /* Data collapsed at main partition and backup partition both, restore to default */
-    if( is_crc_match( crc_backup_result, crc_backup_target ) == false ){
-      para_log("Config failed on both partition, restore to default settings!");
-      err = mico_system_context_restore( inContext );
-      require_noerr(err, exit);
-    }
-    /* main collapsed, backup correct, copy data from back up to main */
-    else {
-      para_log("Config failed on main, recover!");
 
-      memset(&inContext->flashContentInRam, 0x0, sizeof(inContext->flashContentInRam));
-      memcpy( (uint8_t *)&inContext->flashContentInRam.micoSystemConfig, sys_backup_data, SYS_CONFIG_SIZE);
+  /* Data collapsed at main partition and backup partition both */
+  require_action( is_crc_match( crc_backup_result, crc_backup_target ) == true, exit, err = kChecksumErr );
 
-      partition = MicoFlashGetInfo( MICO_PARTITION_PARAMETER_1 );
+  para_log("Config failed on main, use backup!");
+  memcpy( (uint8_t *)&inContext->flashContentInRam.micoSystemConfig, sys_backup_data, SYS_CONFIG_SIZE );
+  memcpy( inContext->user_config_data, user_backup_data, inContext->user_config_data_size );
+  err = kNoErr;
 
-      err = MicoFlashErase( MICO_PARTITION_PARAMETER_1 ,0x0, partition->partition_length );
-      require_noerr(err, exit);
+exit: 
+  if( sys_backup_data!= NULL) free( sys_backup_data );
+  if( user_backup_data!= NULL) free( user_backup_data );
+  return err;
+}
 
-      para_offset = 0x0;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t) );
-      require_noerr(err, exit);
+OSStatus mico_system_context_restore( mico_Context_t * const inContext )
+{ 
+  OSStatus err = kNoErr;
+  require_action( inContext, exit, err = kNotPreparedErr );
 
-      para_offset = USER_CONFIG_OFFSET;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, inContext->user_config_data, inContext->user_config_data_size );
-      require_noerr(err, exit);
+  /*wlan configration is not need to change to a default state, use easylink to do that*/
+  memset(&inContext->flashContentInRam, 0x0, sizeof(inContext->flashContentInRam));
+  sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
+  inContext->flashContentInRam.micoSystemConfig.configured = unConfigured;
+  inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_BYPASS_NO;
+  inContext->flashContentInRam.micoSystemConfig.rfPowerSaveEnable = false;
+  inContext->flashContentInRam.micoSystemConfig.mcuPowerSaveEnable = false;
+  inContext->flashContentInRam.micoSystemConfig.magic_number = SYS_MAGIC_NUMBR;
+  inContext->flashContentInRam.micoSystemConfig.seed = seedNum;
 
-      crc_offset = CRC_OFFSET;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &crc_offset, (uint8_t *)&crc_backup_result, CRC_SIZE );
-      require_noerr(err, exit);
-    }
-  }   
-  /* main correct */
-  else { 
-      /* main correct , backup collapsed, or main!=backup, copy data from main to back up */
-    if( is_crc_match( crc_result, crc_backup_result ) == false || is_crc_match( crc_backup_result, crc_backup_target ) == false ){
-      para_log("Config failed on backup, recover!");
+  /*Application's default configuration*/
+  appRestoreDefault_callback(inContext->user_config_data, inContext->user_config_data_size);
 
-      partition = MicoFlashGetInfo( MICO_PARTITION_PARAMETER_2 );
+  para_log("Restore to default");
 
-      err = MicoFlashErase( MICO_PARTITION_PARAMETER_2 ,0x0, partition->partition_length );
-      require_noerr(err, exit);
-  
-      para_offset = 0x0;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t) );
-      require_noerr(err, exit);
+  err = internal_update_config( inContext );
+  require_noerr(err, exit);
 
-      para_offset = USER_CONFIG_OFFSET;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, inContext->user_config_data, inContext->user_config_data_size );
-      require_noerr(err, exit);
+exit:
+  return err;
+}
+
+#ifdef MFG_MODE_AUTO
+OSStatus MICORestoreMFG( void )
+{ 
+  OSStatus err = kNoErr;
+  mico_Context_t *inContext = mico_system_context_get();
+  require_action( inContext, exit, err = kNotPreparedErr );
+
+  /*wlan configration is not need to change to a default state, use easylink to do that*/
+  sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
+  inContext->flashContentInRam.micoSystemConfig.configured = mfgConfigured;
+  inContext->flashContentInRam.micoSystemConfig.magic_number = SYS_MAGIC_NUMBR;
+
+  /*Application's default configuration*/
+  appRestoreDefault_callback(inContext->user_config_data, inContext->user_config_data_size);
 
-      crc_offset = CRC_OFFSET;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &crc_offset, (uint8_t *)&crc_target, CRC_SIZE );
+  err = internal_update_config( inContext );
+  require_noerr(err, exit);
+
+exit:
+  return err;
+}
+#endif
+
+OSStatus MICOReadConfiguration(mico_Context_t *inContext)
+{
+  OSStatus err = kNoErr;
+
+  err = para_log_mount( inContext );
+  require( err != kNoMemoryErr, exit );
+
+  if( err != kNoErr ){
+    /* Not formatted yet, try to migrate settings from legacy layout */
+    if( para_legacy_read( inContext ) == kNoErr ){
+      para_log("Migrate config to log storage");
+      err = internal_update_config( inContext );
+      require_noerr(err, exit);
+    } else {
+      para_log("Config failed on both partition, restore to default settings!");
+      err = mico_system_context_restore( inContext );
       require_noerr(err, exit);
     }
   }
@@ -310,8 +697,6 @@ OSStatus MICOReadConfiguration(mico_Context_t *inContext)
   }
 
 exit: 
-  if( sys_backup_data!= NULL) free( sys_backup_data );
-  if( user_backup_data!= NULL) free( user_backup_data );
   return err;
 }
 
@@ -328,5 +713,3 @@ OSStatus mico_system_context_update( mico_Context_t *in_context )
 exit:
   return err;
 }
-
-
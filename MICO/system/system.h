@@ -149,6 +149,18 @@ typedef struct _flash_configuration_t {
   // application_config_t     appConfig; 
 } flash_content_t;
 
+/* Addresses DHCP gave the station, the application may keep them for a
+   fast reconnect to the same access point */
+typedef struct _system_lease_t
+{
+  char                  localIp[maxIpLen];
+  char                  netMask[maxIpLen];
+  char                  gateWay[maxIpLen];
+  char                  dnsServer[maxIpLen];
+  char                  bssid[6];
+  uint32_t              seconds;        // lifetime left when recalled, 0 when given by DHCP
+} system_lease_t;
+
 typedef struct _current_mico_status_t 
 {
   system_state_t        current_sys_state;
@@ -199,6 +211,8 @@ OSStatus system_easylink_wac_start( system_context_t * const inContext );
 
 OSStatus system_easylink_start( system_context_t * const inContext );
 
+OSStatus system_easylink_uap_complete( system_context_t * const inContext );
+
 OSStatus MICORestoreMFG                 ( system_context_t * const inContext );
 
 OSStatus MICOReadConfiguration          ( system_context_t * const inContext );
@@ -33,6 +33,25 @@
 #include "StringUtils.h"
 #include "time.h"
 
+static volatile bool lease_recalled = false;  // station runs on a lease kept by the application
+static volatile bool lease_revoked = false;
+static mico_timer_t lease_timer;              // runs while lease_recalled, ends with the lease lifetime
+static bool lease_timer_armed = false;
+
+#define LEASE_SECONDS_MAX   ( 0x7FFFFFFF / 1000 )
+
+WEAK bool mico_system_delegate_lease_recall( const char *bssid, mico_system_lease_t *lease )
+{
+  (void)bssid;
+  (void)lease;
+  return false;
+}
+
+WEAK void mico_system_delegate_lease_acquired( const mico_system_lease_t *lease )
+{
+  (void)lease;
+}
+
 void system_version(char *str, int len)
 {
   snprintf( str, len, "%s %s, build at %s %s", APP_INFO, FIRMWARE_REVISION, __TIME__, __DATE__);
@@ -41,13 +60,27 @@ void system_version(char *str, int len)
 static void micoNotify_DHCPCompleteHandler(IPStatusTypedef *pnet, mico_Context_t * const inContext)
 {
   system_log_trace();
+  mico_system_lease_t lease;
+  bool dhcp;
   require(inContext, exit);
   mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
   strcpy((char *)inContext->micoStatus.localIp, pnet->ip);
   strcpy((char *)inContext->micoStatus.netMask, pnet->mask);
   strcpy((char *)inContext->micoStatus.gateWay, pnet->gate);
   strcpy((char *)inContext->micoStatus.dnsServer, pnet->dns);
+  dhcp = inContext->flashContentInRam.micoSystemConfig.dhcpEnable;
+  memcpy(lease.bssid, inContext->flashContentInRam.micoSystemConfig.bssid, 6);
+  lease.seconds = 0;
   mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+
+  /* A recalled lease must not be handed back, it would never expire */
+  if(dhcp == true && lease_recalled == false){
+    strncpy(lease.localIp, pnet->ip, maxIpLen);
+    strncpy(lease.netMask, pnet->mask, maxIpLen);
+    strncpy(lease.gateWay, pnet->gate, maxIpLen);
+    strncpy(lease.dnsServer, pnet->dns, maxIpLen);
+    mico_system_delegate_lease_acquired(&lease);
+  }
 exit:
   return;
 }
@@ -195,10 +228,32 @@ void system_connect_wifi_normal( mico_Context_t * const inContext)
   micoWlanStartAdv(&wNetConfig);
 }
 
+/* The server may give the address to another host once the lease is over,
+   move the station to DHCP before that */
+static void lease_expired_handler( void *arg )
+{
+  mico_Context_t *inContext = arg;
+
+  if(lease_recalled == false)
+    return;
+  system_log("Reused DHCP lease expired");
+  mico_system_lease_revoke(inContext);
+}
+
+static void lease_timer_stop( void )
+{
+  if(lease_timer_armed == false)
+    return;
+  mico_stop_timer(&lease_timer);
+  mico_deinit_timer(&lease_timer);
+  lease_timer_armed = false;
+}
+
 void system_connect_wifi_fast( mico_Context_t * const inContext)
 {
   system_log_trace();
   network_InitTypeDef_adv_st wNetConfig;
+  mico_system_lease_t lease;
   memset(&wNetConfig, 0x0, sizeof(network_InitTypeDef_adv_st));
   
   mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
@@ -218,12 +273,49 @@ void system_connect_wifi_fast( mico_Context_t * const inContext)
   strncpy((char*)wNetConfig.dnsServer_ip_addr, inContext->flashContentInRam.micoSystemConfig.dnsServer, maxIpLen);
   mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
 
+  /* Skip DHCP with a lease the application kept for this access point */
+  lease_recalled = false;
+  lease_timer_stop();
+  memset(&lease, 0x0, sizeof(mico_system_lease_t));
+  if(wNetConfig.dhcpMode == DHCP_Client && lease_revoked == false &&
+     mico_system_delegate_lease_recall(wNetConfig.ap_info.bssid, &lease) == true &&
+     lease.seconds > 0 &&
+     kNoErr == mico_init_timer(&lease_timer, ((lease.seconds < LEASE_SECONDS_MAX)? lease.seconds : LEASE_SECONDS_MAX) * 1000,
+                               lease_expired_handler, inContext)){
+    mico_start_timer(&lease_timer);
+    lease_timer_armed = true;
+    wNetConfig.dhcpMode = DHCP_Disable;
+    strncpy((char*)wNetConfig.local_ip_addr, lease.localIp, maxIpLen);
+    strncpy((char*)wNetConfig.net_mask, lease.netMask, maxIpLen);
+    strncpy((char*)wNetConfig.gateway_ip_addr, lease.gateWay, maxIpLen);
+    strncpy((char*)wNetConfig.dnsServer_ip_addr, lease.dnsServer, maxIpLen);
+    lease_recalled = true;
+    system_log("Reuse DHCP lease %s for %d s", lease.localIp, lease.seconds);
+  }
+
   wNetConfig.wifi_retry_interval = 100;
   system_log("Connect to %s.....", wNetConfig.ap_info.ssid);
   micoWlanStartAdv(&wNetConfig);
 }
 
 
+OSStatus mico_system_lease_revoke( mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  require_action(inContext, exit, err = kParamErr);
+
+  lease_revoked = true;
+  if(lease_recalled == false)
+    goto exit;
+
+  system_log("Reused DHCP lease revoked, reconnect with DHCP");
+  lease_recalled = false;
+  micoWlanSuspendStation();
+  system_connect_wifi_fast(inContext);
+
+exit:
+  return err;
+}
 
 OSStatus system_network_daemen_start( mico_Context_t * const inContext )
 {
@@ -38,8 +38,9 @@ OSStatus ssd1106_i2c_bus_write(uint8_t reg_addr, uint8_t *reg_data, uint8_t cnt)
   OSStatus err = kNoErr;
   mico_i2c_message_t ssd1106_i2c_msg = {NULL, NULL, 0, 0, 10, false};
 
-  uint8_t array[128];
+  uint8_t array[1 + SSD1106_I2C_BURST_MAX];
   uint8_t stringpos;
+  require_action( cnt <= SSD1106_I2C_BURST_MAX, exit, err = kParamErr );
   array[0] = reg_addr;
   for (stringpos = 0; stringpos < cnt; stringpos++) {
           array[stringpos + 1] = *(reg_data + stringpos);
@@ -82,6 +83,15 @@ const mico_spi_device_t micokit_spi_oled =
 //[6]0 1 2 3 ... 127	
 //[7]0 1 2 3 ... 127 			   
 
+static u8 oled_gram[8][X_WIDTH];      // page, column
+static u8 oled_dirty_start[8];         // dirty column span of each page,
+static u8 oled_dirty_end[8];           // empty when start >= end
+static u8 oled_update_depth = 0;       // OLED_BeginUpdate nesting
+static mico_mutex_t oled_mutex = NULL;
+
+#define OLED_LOCK()     do { if( oled_mutex != NULL ) mico_rtos_lock_mutex( &oled_mutex ); } while(0)
+#define OLED_UNLOCK()   do { if( oled_mutex != NULL ) mico_rtos_unlock_mutex( &oled_mutex ); } while(0)
+
 
 
 void OLED_WR_Bytes(u8 *dat, u8 len, u8 cmd)
@@ -144,20 +154,125 @@ void OLED_Display_Off(void)
 {
   uint8_t tmp[3] = {0X8D, 0X10, 0XAE};
   OLED_WR_Bytes( tmp, 3, OLED_CMD);
+}
+
+static void oled_mark_dirty(u8 page, u8 x0, u8 x1)
+{
+  if( oled_dirty_start[page] >= oled_dirty_end[page] ){
+    oled_dirty_start[page] = x0;
+    oled_dirty_end[page] = x1;
+  }
+  else{
+    if( x0 < oled_dirty_start[page] ) oled_dirty_start[page] = x0;
+    if( x1 > oled_dirty_end[page] ) oled_dirty_end[page] = x1;
+  }
+}
+
+// copy page formatted columns into the framebuffer, clipped to the screen
+static void oled_put_columns(u8 x, u8 page, const u8 *data, u8 len)
+{
+  if( page >= 8 || x >= X_WIDTH ) return;
+  if( len > X_WIDTH - x ) len = X_WIDTH - x;
+  if( memcmp( &oled_gram[page][x], data, len ) == 0 ) return;
+  memcpy( &oled_gram[page][x], data, len );
+  oled_mark_dirty( page, x, x + len );
+}
+
+static void oled_set_pixel(u8 x, u8 y, u8 t)
+{
+  u8 old;
+  if( x >= X_WIDTH || y >= Y_WIDTH ) return;
+  old = oled_gram[y/8][x];
+  if( t ) oled_gram[y/8][x] |= 1 << (y%8);
+  else    oled_gram[y/8][x] &= ~(1 << (y%8));
+  if( oled_gram[y/8][x] != old ) oled_mark_dirty( y/8, x, x + 1 );
+}
+
+// Push the dirty span of each page as one burst. Spans start on an even
+// column, so OLED_Set_Pos places them exactly where it always put glyphs.
+static void oled_flush(void)
+{
+  u8 page, start, len;
+#ifdef SSD1106_USE_I2C
+  static u8 burst[SSD1106_I2C_BURST_MAX];
+#endif
+
+  for( page = 0; page < 8; page++ ){
+    if( oled_dirty_start[page] >= oled_dirty_end[page] ) continue;
+    start = oled_dirty_start[page] & ~1;
+    len = oled_dirty_end[page] - start;
+    oled_dirty_start[page] = oled_dirty_end[page] = 0;
+#ifdef SSD1106_USE_I2C
+    // page and column commands, each behind a continuation control byte, then the data stream
+    burst[0] = 0xb0 + page;
+    burst[1] = 0x80;
+    burst[2] = ((start&0xf0)>>4)|0x10;
+    burst[3] = 0x80;
+    burst[4] = (start&0x0f)|0x01;
+    burst[5] = 0x40;
+    memcpy( &burst[6], &oled_gram[page][start], len );
+    ssd1106_i2c_bus_write( 0x80, burst, 6 + len );
+#else
+    OLED_Set_Pos( start, page );
+    OLED_WR_Bytes( &oled_gram[page][start], len, OLED_DATA );
+#endif
+  }
+}
+
+static void oled_changed(void)
+{
+  if( oled_update_depth == 0 ) oled_flush();
+}
+
+void OLED_BeginUpdate(void)
+{
+  OLED_LOCK();
+  oled_update_depth++;
+  OLED_UNLOCK();
+}
+
+void OLED_EndUpdate(void)
+{
+  OLED_LOCK();
+  if( oled_update_depth > 0 ) oled_update_depth--;
+  oled_changed();
+  OLED_UNLOCK();
+}
+
+void OLED_Refresh(void)
+{
+  OLED_LOCK();
+  oled_flush();
+  OLED_UNLOCK();
 }		   			 
 //,,ĻǺɫ!ûһ!!!	  
 void OLED_Clear(void)  
 {  
+  u8 i;
+  OLED_LOCK();
+  memset( oled_gram, 0x0, sizeof(oled_gram) );
+  for(i=0;i<8;i++)  
+    oled_mark_dirty( i, 0, X_WIDTH );
+  oled_changed();
+  OLED_UNLOCK();
+}
+
+// zero the whole 132 column SSD1106 RAM, including the columns the framebuffer never covers
+static void oled_clear_ram(void)
+{
   u8 i;
   uint8_t tmp_cmd[3] = {0X0, 0x00, 0x10};
-  uint8_t tmp[128];
-  memset( tmp, 0x0, 128 );
+  uint8_t tmp[132];
+  memset( tmp, 0x0, sizeof(tmp) );
   for(i=0;i<8;i++)  
   {  
     tmp_cmd[0] = 0xb0+i;
     OLED_WR_Bytes( tmp_cmd, 3, OLED_CMD);
-    OLED_WR_Bytes( tmp, 128, OLED_DATA);
-  } //ʾ
+    OLED_WR_Bytes( tmp, sizeof(tmp), OLED_DATA);
+  }
+  memset( oled_gram, 0x0, sizeof(oled_gram) );
+  memset( oled_dirty_start, 0x0, sizeof(oled_dirty_start) );
+  memset( oled_dirty_end, 0x0, sizeof(oled_dirty_end) );
 }
 
 
@@ -166,24 +281,28 @@ void OLED_Clear(void)
 //y:0~63
 //mode:0,ʾ;1,ʾ				 
 //size:ѡ 16/12 
-void OLED_ShowChar(u8 x,u8 y,u8 chr)
+static void oled_draw_char(u8 x,u8 y,u8 chr)
 {      	
   unsigned char c=0;	
   c=chr-' ';//õƫƺֵ			
   if(x>Max_Column-1){x=0;y=y+2;}
   if(SIZE ==16)
   {
-    OLED_Set_Pos(x,y);	
-    OLED_WR_Bytes( (uint8_t *)&F8X16[c*16], 8, OLED_DATA );
-    OLED_Set_Pos(x,y+1);
-    OLED_WR_Bytes( (uint8_t *)&F8X16[c*16+8], 8, OLED_DATA );
+    oled_put_columns( x, y, &F8X16[c*16], 8 );
+    oled_put_columns( x, y+1, &F8X16[c*16+8], 8 );
   }
   else {	
-    OLED_Set_Pos(x,y+1);
-    OLED_WR_Bytes( (uint8_t *)F6x8[c], 6, OLED_DATA );
-    
+    oled_put_columns( x, y+1, F6x8[c], 6 );
   }
 }
+
+void OLED_ShowChar(u8 x,u8 y,u8 chr)
+{
+  OLED_LOCK();
+  oled_draw_char(x, y, chr);
+  oled_changed();
+  OLED_UNLOCK();
+}
 //m^n
 u32 oled_pow(u8 m,u8 n)
 {
@@ -201,6 +320,7 @@ void OLED_ShowNum(u8 x,u8 y,u32 num,u8 len,u8 size)
 {         	
   u8 t,temp;
   u8 enshow=0;						   
+  OLED_LOCK();
   for(t=0;t<len;t++)
   {
     temp=(num/oled_pow(10,len-t-1))%10;
@@ -208,13 +328,15 @@ void OLED_ShowNum(u8 x,u8 y,u32 num,u8 len,u8 size)
     {
       if(temp==0)
       {
-        OLED_ShowChar(x+(size/2)*t,y,' ');
+        oled_draw_char(x+(size/2)*t,y,' ');
         continue;
       }else enshow=1; 
       
     }
-    OLED_ShowChar(x+(size/2)*t,y,temp+'0'); 
+    oled_draw_char(x+(size/2)*t,y,temp+'0'); 
   }
+  oled_changed();
+  OLED_UNLOCK();
 } 
 //ʾһַŴ
 void OLED_ShowString(u8 x,u8 y,u8 *chr)
@@ -222,19 +344,20 @@ void OLED_ShowString(u8 x,u8 y,u8 *chr)
   unsigned char j=0;
   u8 x_t = x,y_t = y;
   
+  OLED_LOCK();
   while (chr[j]!='\0')
   {	
     // add for CR/LF
     if( ('\r' == chr[j]) && ('\n' == chr[j+1]) ){  // CR LF
       while(x_t <= 120){  // fill rest chars in current line
-        OLED_ShowChar(x_t,y_t,' ');
+        oled_draw_char(x_t,y_t,' ');
         x_t += 8;
       }
       j += 2;
     }
     else if( ('\r' == chr[j]) || ('\n' == chr[j]) ){   // CR or LF
       while(x_t <= 120){  // fill rest chars in current line
-        OLED_ShowChar(x_t,y_t,' ');
+        oled_draw_char(x_t,y_t,' ');
         x_t += 8;
       }
       j += 1;
@@ -247,52 +370,93 @@ void OLED_ShowString(u8 x,u8 y,u8 *chr)
           break;
         }
       }
-      OLED_ShowChar(x_t,y_t,chr[j]);
+      oled_draw_char(x_t,y_t,chr[j]);
       x_t += 8;
       j++;
     }
   }
+  oled_changed();
+  OLED_UNLOCK();
 }
 
 //ʾ
 void OLED_ShowCHinese(u8 x,u8 y,u8 no)
 {      			    
-  u8 t,adder=0;
-  OLED_Set_Pos(x,y);	
-  for(t=0;t<16;t++)
-  {
-    OLED_WR_Byte(Hzk[2*no][t],OLED_DATA);
-    adder+=1;
-  }	
-  OLED_Set_Pos(x,y+1);	
-  for(t=0;t<16;t++)
-  {	
-    OLED_WR_Byte(Hzk[2*no+1][t],OLED_DATA);
-    adder+=1;
-  }					
+  OLED_LOCK();
+  oled_put_columns( x, y, (u8 *)Hzk[2*no], 16 );
+  oled_put_columns( x, y+1, (u8 *)Hzk[2*no+1], 16 );
+  oled_changed();
+  OLED_UNLOCK();
 }
 /***********ʾʾBMPͼƬ12864ʼ(x,y),xķΧ0127yΪҳķΧ07*****************/
 void OLED_DrawBMP(unsigned char x0, unsigned char y0,unsigned char x1, unsigned char y1,unsigned char BMP[])
 { 	
   unsigned int j=0;
-  unsigned char x,y;
+  unsigned char y;
   
-  if(y1%8==0) y=y1/8;      
-  else y=y1/8+1;
+  if(x1<=x0) return;
+  OLED_LOCK();
   for(y=y0;y<y1;y++)
   {
-    OLED_Set_Pos(x0,y);
-    for(x=x0;x<x1;x++)
-    {      
-      OLED_WR_Byte(BMP[j++],OLED_DATA);	    	
-    }
+    oled_put_columns( x0, y, &BMP[j], x1-x0 );
+    j += x1-x0;
   }
+  oled_changed();
+  OLED_UNLOCK();
+} 
+
+//x:0~127, y:0~63, t:1 lit, 0 dark
+void OLED_DrawPoint(u8 x,u8 y,u8 t)
+{
+  OLED_LOCK();
+  oled_set_pixel(x, y, t);
+  oled_changed();
+  OLED_UNLOCK();
+}
+
+//fill the pixel rectangle (x1,y1)-(x2,y2), corners included
+void OLED_Fill(u8 x1,u8 y1,u8 x2,u8 y2,u8 dot)
+{
+  u8 x,y;
+  OLED_LOCK();
+  for(x=x1;x<=x2 && x<X_WIDTH;x++)
+    for(y=y1;y<=y2 && y<Y_WIDTH;y++)
+      oled_set_pixel(x, y, dot);
+  oled_changed();
+  OLED_UNLOCK();
+}
+
+//line from (x0,y0) to (x1,y1) in pixels, Bresenham
+void OLED_DrawLine(u8 x0,u8 y0,u8 x1,u8 y1,u8 t)
+{
+  int dx = (x1 > x0) ? x1 - x0 : x0 - x1;
+  int dy = (y1 > y0) ? y0 - y1 : y1 - y0;
+  int sx = (x0 < x1) ? 1 : -1;
+  int sy = (y0 < y1) ? 1 : -1;
+  int err = dx + dy, e2;
+  int x = x0, y = y0;
+
+  OLED_LOCK();
+  for(;;)
+  {
+    oled_set_pixel(x, y, t);
+    if(x == x1 && y == y1) break;
+    e2 = 2 * err;
+    if(e2 >= dy) { err += dy; x += sx; }
+    if(e2 <= dx) { err += dx; y += sy; }
+  }
+  oled_changed();
+  OLED_UNLOCK();
 } 
 
 
 //ʼSSD1306					    
 void OLED_Init(void)
 { 	 
+  if( oled_mutex == NULL )
+    mico_rtos_init_mutex( &oled_mutex );
+  OLED_LOCK();
+
 #ifdef SSD1106_USE_I2C
   MicoI2cInitialize( &ssd1106_i2c_device );
 #else
@@ -341,9 +505,10 @@ void OLED_Init(void)
   OLED_WR_Byte(0xA4,OLED_CMD);// Disable Entire Display On (0xa4/0xa5)
   OLED_WR_Byte(0xA6,OLED_CMD);// Disable Inverse Display On (0xa6/a7)   
   
-  OLED_Clear();
+  oled_clear_ram();
   OLED_Set_Pos(0,0); 	
   OLED_WR_Byte(0xAF,OLED_CMD); /*display ON*/ 
+  OLED_UNLOCK();
 }  
 
 
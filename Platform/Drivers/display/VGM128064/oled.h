@@ -102,6 +102,9 @@
 
 #define OLED_DISPLAY_MAX_CHAR_PER_ROW    16   // max 16 chars each row
 
+// largest I2C write: page/column commands (6 bytes) plus one full page of data
+#define SSD1106_I2C_BURST_MAX    (6 + X_WIDTH)
+
 
 //OLEDú
 void OLED_WR_Byte(u8 dat, u8 cmd);   
@@ -127,6 +130,14 @@ void delay_us(u32 nus);
 void OLED_Init(void);
 void OLED_Clear(void);
 void OLED_ShowString(u8 x,u8 y, u8 *p);
+void OLED_DrawLine(u8 x0,u8 y0,u8 x1,u8 y1,u8 t);
+
+// Drawing goes to a RAM framebuffer; each call sends only the changed column
+// span of each page. Between BeginUpdate and EndUpdate (nestable) nothing is
+// sent, EndUpdate flushes everything drawn in between at once.
+void OLED_BeginUpdate(void);
+void OLED_EndUpdate(void);
+void OLED_Refresh(void);
 
 
 #endif  
@@ -27,100 +27,67 @@
 #define hsb2rgb_led_log(M, ...) custom_log("HSB2RGB_LED", M, ##__VA_ARGS__)
 #define hsb2rgb_led_log_trace() custom_log_trace("HSB2RGB_LED")
 
-#define H2R_MAX_RGB_val 255.0f
+#define H2R_MAX_RGB_val 255
 
-static float constrain(float value, float min, float max){
-  if(value >= max)
-    return max;
-  if(value <=min )
-    return min;
-  return value;
-}
-
-//float Percent(float value){
-//  return value = (((float)value / 255.0) * 100.0);
-//}
+/* Hue in degrees, saturation and brightness in percent. Within each 120
+ * degree sector one channel fades out (primary), the next one fades in
+ * (secondary) and desaturation lifts all three by the same amount. The
+ * weights are kept in 1/12000, 1/120 from the hue times 1/100 from the
+ * saturation, so everything stays in integers. */
+static void H2R_HSBtoRGB(uint16_t hue, uint8_t sat, uint8_t bright, uint8_t *color)
+{
+  uint32_t primary, secondary, tertiary, scale;
+  uint16_t p, q;
+  uint8_t sector;
 
-static void H2R_HSBtoRGB(float hue, float sat, float bright, float *color) {
   // constrain all input variables to expected range
-  hue = constrain(hue, 0, 360);
-  sat = constrain(sat, 0, 100);
-  bright = constrain(bright, 0, 100);
-  // define maximum value for RGB array elements
-  float max_rgb_val = H2R_MAX_RGB_val;
-  // convert saturation and brightness value to decimals and init r, g, b variables
-  float sat_f = (float)sat / 100.0f;
-  float bright_f = (float)bright / 100.0f;
-  float r, g, b;
-  // If brightness is 0 then color is black (achromatic)
-  // therefore, R, G and B values will all equal to 0
-  if (bright <= 0) {
-    color[0] = 0;
-    color[1] = 0;
-    color[2] = 0;
-  }
-  // If saturation is 0 then color is gray (achromatic)
-  // therefore, R, G and B values will all equal the current brightness
-  if (sat <= 0) {
-    color[0] = bright_f * max_rgb_val;
-    color[1] = bright_f * max_rgb_val;
-    color[2] = bright_f * max_rgb_val;
-  }
-  // if saturation and brightness are greater than 0 then calculate
-  // R, G and B values based on the current hue and brightness
-  else {
-    if (hue >= 0 && hue < 120) {
-      float hue_primary = 1.0f - ((float)hue / 120.0f);
-      float hue_secondary = (float)hue / 120.0f;
-      float sat_primary = (1.0f - hue_primary) * (1.0f - sat_f);
-      float sat_secondary = (1.0f - hue_secondary) * (1.0f - sat_f);
-      float sat_tertiary = 1.0f - sat_f;
-      r = (bright_f * max_rgb_val) * (hue_primary + sat_primary);
-      g = (bright_f * max_rgb_val) * (hue_secondary + sat_secondary);
-      b = (bright_f * max_rgb_val) * sat_tertiary;
-    }
-    else if (hue >= 120 && hue < 240) {
-      float hue_primary = 1.0f - (((float)hue-120.0f) / 120.0f);
-      float hue_secondary = ((float)hue-120.0f) / 120.0f;
-      float sat_primary = (1.0f - hue_primary) * (1.0f - sat_f);
-      float sat_secondary = (1.0f - hue_secondary) * (1.0f - sat_f);
-      float sat_tertiary = 1.0f - sat_f;
-      r = (bright_f * max_rgb_val) * sat_tertiary;
-      g = (bright_f * max_rgb_val) * (hue_primary + sat_primary);
-      b = (bright_f * max_rgb_val) * (hue_secondary + sat_secondary);
-    }
-    else if (hue >= 240 && hue <= 360) {
-      float hue_primary = 1.0f - (((float)hue-240.0f) / 120.0f);
-      float hue_secondary = ((float)hue-240.0f) / 120.0f;
-      float sat_primary = (1.0f - hue_primary) * (1.0f - sat_f);
-      float sat_secondary = (1.0f - hue_secondary) * (1.0f - sat_f);
-      float sat_tertiary = 1.0f - sat_f;
-      r = (bright_f * max_rgb_val) * (hue_secondary + sat_secondary);
-      g = (bright_f * max_rgb_val) * sat_tertiary;
-      b = (bright_f * max_rgb_val) * (hue_primary + sat_primary);
-    }
-    color[0] = r;
-    color[1] = g;
-    color[2] = b;
+  hue = (hue > 360) ? 360 : hue;
+  sat = (sat > 100) ? 100 : sat;
+  bright = (bright > 100) ? 100 : bright;
+
+  sector = (hue >= 240) ? 2 : (uint8_t)(hue / 120);
+  q = hue - sector * 120;
+  p = 120 - q;
+  primary = (uint32_t)p * 100 + (uint32_t)q * (100 - sat);
+  secondary = (uint32_t)q * 100 + (uint32_t)p * (100 - sat);
+  tertiary = (uint32_t)120 * (100 - sat);
+  scale = (uint32_t)bright * H2R_MAX_RGB_val;
+
+  primary = primary * scale / 1200000;
+  secondary = secondary * scale / 1200000;
+  tertiary = tertiary * scale / 1200000;
+
+  switch(sector){
+    case 0:
+      color[0] = primary; color[1] = secondary; color[2] = tertiary;
+      break;
+    case 1:
+      color[0] = tertiary; color[1] = primary; color[2] = secondary;
+      break;
+    default:
+      color[0] = secondary; color[1] = tertiary; color[2] = primary;
+      break;
   }
-  //  color[0] = Percent(color[0]);
-  //  color[1] = Percent(color[1]);
-  //  color[2] = Percent(color[2]);
+}
+
+static uint16_t H2R_Round(float value, uint16_t max)
+{
+  if(value <= 0)
+    return 0;
+  if(value >= max)
+    return max;
+  return (uint16_t)(value + 0.5f);
 }
 
 /*----------------------------------------------------- INTERNAL FUNCTION  ---------------------------------------*/
 
 // call RGB LED driver to control LED
-static void OpenLED_RGB(float *color)
+static void OpenLED_RGB(uint8_t *color)
 {
-  uint8_t blue = (uint8_t)(color[2]);
-  uint8_t green = (uint8_t)(color[1]);
-  uint8_t red = (uint8_t)(color[0]);
-  
-  //hsb2rgb_led_log("OpenLED_RGB: red=%d, green=%d, blue=%d.", red, green, blue);
+  //hsb2rgb_led_log("OpenLED_RGB: red=%d, green=%d, blue=%d.", color[0], color[1], color[2]);
   
   rgb_led_init();
-  rgb_led_open(red, green, blue);
+  rgb_led_open(color[0], color[1], color[2]);
 }
 
 static void CloseLED_RGB()
@@ -139,7 +106,12 @@ void hsb2rgb_led_init(void)
 
 void hsb2rgb_led_open(float hues, float saturation, float brightness)
 {
-  float color[3] = {0};
+  hsb2rgb_led_set(H2R_Round(hues, 360), (uint8_t)H2R_Round(saturation, 100), (uint8_t)H2R_Round(brightness, 100));
+}
+
+void hsb2rgb_led_set(uint16_t hues, uint8_t saturation, uint8_t brightness)
+{
+  uint8_t color[3];
   H2R_HSBtoRGB(hues, saturation, brightness, color);
   OpenLED_RGB(color);
 }
@@ -148,3 +120,12 @@ void hsb2rgb_led_close(void)
 {
   CloseLED_RGB();
 }
+
+void hsb2rgb_led_effect_color(uint16_t hues, uint8_t saturation, uint8_t brightness, led_effect_color_t *color)
+{
+  uint8_t rgb[3];
+  H2R_HSBtoRGB(hues, saturation, brightness, rgb);
+  color->red = rgb[0];
+  color->green = rgb[1];
+  color->blue = rgb[2];
+}
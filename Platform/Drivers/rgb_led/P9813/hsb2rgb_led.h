@@ -23,10 +23,15 @@
 #ifndef __HSB2RGB_LED_H_
 #define __HSB2RGB_LED_H_
 
+#include "rgb_led/led_effect/led_effect.h"
 
 void hsb2rgb_led_init(void);
 void hsb2rgb_led_open(float hues, float saturation, float brightness);
+// hue in degrees, saturation and brightness in percent, no float math
+void hsb2rgb_led_set(uint16_t hues, uint8_t saturation, uint8_t brightness);
 void hsb2rgb_led_close(void);
+// HSB colour of an effect or of one LED in a chain, see rgb_led_open_chain()
+void hsb2rgb_led_effect_color(uint16_t hues, uint8_t saturation, uint8_t brightness, led_effect_color_t *color);
 
 
 #endif   // __HSB2RGB_LED_H_
\ No newline at end of file
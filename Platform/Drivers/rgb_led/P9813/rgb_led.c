@@ -25,67 +25,105 @@
 #define rgb_led_log(M, ...) custom_log("RGB_LED", M, ##__VA_ARGS__)
 #define rgb_led_log_trace() custom_log_trace("RGB_LED")
 
-/* use gpio */
-static void P9813_PIN_write_frame(uint32_t data)
-{ 
-  uint8_t i;        
-  uint32_t f_data = data;
-  //rgb_led_log("P9813_PIN_write_frame = %X", f_data);
-  
-  for(i=0; i<32; i++){
-    P9813_PIN_CIN_Clr();
-    if(f_data & 0x80000000){
-      P9813_PIN_DIN_Set();
-    }
-    else{
-      P9813_PIN_DIN_Clr();
-    }
-    P9813_PIN_CIN_Set();  // raise edge to set data
-    f_data = f_data << 1;
-    //rgb_led_log("frame_data<<1 =%x", f_data);
-  } 
-  
-  //P9813_PIN_CIN_Clr();
-  //P9813_PIN_DIN_Clr();
-}
+#define P9813_FRAME_SIZE    4
 
-static void P9813_PIN_write_start_frame(void)
-{ 
-  uint32_t start_frame = 0x00000000;
-  P9813_PIN_write_frame(start_frame);     
-}
+/* start frame, one frame per LED, and a trailing zero frame that keeps the
+ * last LED from picking up noise */
+static uint8_t p9813_frames[(P9813_MAX_LEDS + 2) * P9813_FRAME_SIZE];
+
+#ifdef P9813_SPI
+static const mico_spi_device_t p9813_spi_device =
+{
+  .port        = P9813_SPI,
+  .chip_select = MICO_GPIO_NONE,
+  .speed       = P9813_SPI_SPEED,
+  .mode        = P9813_SPI_MODE,
+  .bits        = 8
+};
+#endif
 
-static void P9813_PIN_write_data(uint8_t blue, uint8_t green, uint8_t red)
+static void P9813_encode(uint8_t *frame, uint8_t blue, uint8_t green, uint8_t red)
 {
   uint8_t check_byte = 0xC0;  // starting flag "11"
-  uint32_t send_data = 0;
   
   // calc check data
   check_byte |= (((~blue) >> 2) & 0x30);  // B7, B6
   check_byte |= (((~green) >> 4) & 0x0C);  // G7,G6
   check_byte |= (((~red) >> 6) & 0x03);   // R7,R6
   
-  // create send data 32bit
-  send_data |= (check_byte << 24) | (blue << 16) | (green << 8) | (red);
-  
-  //send_data = 0xFC0000FF;
-  //rgb_led_log("P9813_PIN_write_data: %X", send_data);
-  P9813_PIN_write_frame(send_data);
+  frame[0] = check_byte;
+  frame[1] = blue;
+  frame[2] = green;
+  frame[3] = red;
 }
+
+#ifdef P9813_SPI
+/* SCK and MOSI drive CIN and DIN, the whole chain goes out in one transfer */
+static OSStatus P9813_send(const uint8_t *data, uint32_t length)
+{
+  mico_spi_message_segment_t segment = { data, NULL, length };
+  return MicoSpiTransfer(&p9813_spi_device, &segment, 1);
+}
+#else
+/* use gpio */
+static OSStatus P9813_send(const uint8_t *data, uint32_t length)
+{ 
+  uint8_t byte, bit;
+
+  while(length--){
+    byte = *data++;
+    for(bit = 0; bit < 8; bit++){
+      P9813_PIN_CIN_Clr();
+      if(byte & 0x80){
+        P9813_PIN_DIN_Set();
+      }
+      else{
+        P9813_PIN_DIN_Clr();
+      }
+      P9813_PIN_CIN_Set();  // raise edge to set data
+      byte = byte << 1;
+    }
+  }
+  return kNoErr;
+}
+#endif
  
 /*-------------------------------------------------- USER INTERFACES ------------------------------------------------*/
 
 void rgb_led_init(void)
 {
+#ifdef P9813_SPI
+  MicoSpiInitialize(&p9813_spi_device);
+#else
   MicoGpioInitialize( (mico_gpio_t)P9813_PIN_CIN, OUTPUT_PUSH_PULL );
   MicoGpioInitialize( (mico_gpio_t)P9813_PIN_DIN, OUTPUT_PUSH_PULL );
+#endif
 }
 
 void rgb_led_open(uint8_t red, uint8_t green, uint8_t blue)
 {
-  P9813_PIN_write_start_frame();
-  P9813_PIN_write_data(blue, green, red);
-  P9813_PIN_write_start_frame();  // fix led bink bug
+  led_effect_color_t color = { red, green, blue };
+  rgb_led_open_chain(&color, 1);
+}
+
+OSStatus rgb_led_open_chain(const led_effect_color_t *colors, uint16_t count)
+{
+  uint8_t *frame = p9813_frames;
+  uint16_t i;
+
+  if(colors == NULL || count == 0 || count > P9813_MAX_LEDS)
+    return kParamErr;
+
+  memset(frame, 0, P9813_FRAME_SIZE);
+  frame += P9813_FRAME_SIZE;
+  for(i = 0; i < count; i++){
+    P9813_encode(frame, colors[i].blue, colors[i].green, colors[i].red);
+    frame += P9813_FRAME_SIZE;
+  }
+  memset(frame, 0, P9813_FRAME_SIZE);  // fix led bink bug
+  frame += P9813_FRAME_SIZE;
+
+  return P9813_send(p9813_frames, (uint32_t)(frame - p9813_frames));
 }
 
 void rgb_led_close(void)
@@ -93,3 +131,18 @@ void rgb_led_close(void)
   rgb_led_init();
   rgb_led_open(0, 0, 0);
 }
+
+/* The P9813 latches one colour per frame, so the effect engine steps it from
+ * a timer. The channel levels are already gamma corrected. */
+static OSStatus rgb_led_effect_write(const uint16_t* level)
+{
+  rgb_led_open(level[0] >> 8, level[1] >> 8, level[2] >> 8);
+  return kNoErr;
+}
+
+const led_effect_backend_t rgb_led_effect_backend =
+{
+  .step_ms = RGB_LED_EFFECT_STEP_MS,
+  .frames  = 0,
+  .write   = rgb_led_effect_write,
+};
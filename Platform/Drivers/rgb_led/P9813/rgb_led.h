@@ -26,6 +26,7 @@
 #include "mico.h"
 #include "hsb2rgb_led.h"
 #include "platform.h"
+#include "rgb_led/led_effect/led_effect.h"
 
 #ifndef P9813_PIN_CIN
 #define P9813_PIN_CIN       (MICO_GPIO_NONE)
@@ -35,6 +36,22 @@
 #define P9813_PIN_DIN       (MICO_GPIO_NONE)
 #endif
 
+/* A board that wires CIN and DIN to SCK and MOSI of a SPI port defines
+ * P9813_SPI as that port, the frames are then shifted out by the SPI
+ * peripheral, with DMA unless P9813_SPI_MODE says otherwise. Without it
+ * the pins are bit-banged. */
+#ifndef P9813_SPI_SPEED
+#define P9813_SPI_SPEED     4000000
+#endif
+
+#ifndef P9813_SPI_MODE
+#define P9813_SPI_MODE      (SPI_CLOCK_RISING_EDGE | SPI_CLOCK_IDLE_LOW | SPI_MSB_FIRST | SPI_USE_DMA)
+#endif
+
+#ifndef P9813_MAX_LEDS
+#define P9813_MAX_LEDS      16      // LEDs in a daisy chain
+#endif
+
 #define P9813_PIN_CIN_Clr()        MicoGpioOutputLow(P9813_PIN_CIN)  
 #define P9813_PIN_CIN_Set()        MicoGpioOutputHigh(P9813_PIN_CIN)
 
@@ -44,7 +61,13 @@
 //-------------------- user interfaces ---------------------------
 void rgb_led_init(void);
 void rgb_led_open(uint8_t red, uint8_t green, uint8_t blue);
+// colors[0] goes to the first LED of the chain, all in one transfer
+OSStatus rgb_led_open_chain(const led_effect_color_t *colors, uint16_t count);
 void rgb_led_close(void);
 
+/* P9813 backend for led_effect, call rgb_led_init() before led_effect_init() */
+#define RGB_LED_EFFECT_STEP_MS      20
+extern const led_effect_backend_t rgb_led_effect_backend;
+
 
 #endif  // __RGB_LED_H_
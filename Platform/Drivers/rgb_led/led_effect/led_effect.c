@@ -0,0 +1,342 @@
+/**
+******************************************************************************
+* @file    led_effect.c
+* @author  MICO Application Team
+* @version V1.0.0
+* @date    19-Oct-2016
+* @brief   Precomputed RGB LED effects played by the LED hardware.
+******************************************************************************
+* @attention
+*
+* THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+* WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+* TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+* DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+* FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+* CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+*
+* <h2><center>&copy; COPYRIGHT 2016 MXCHIP Inc.</center></h2>
+******************************************************************************
+*/
+
+#include "mico.h"
+#include "led_effect.h"
+
+#define led_effect_log(M, ...) custom_log("LED_EFFECT", M, ##__VA_ARGS__)
+
+/* 65535 * (i / 256) ^ 2.2, interpolated in between */
+static const uint16_t led_effect_gamma[257] = {
+      0,     0,     2,     4,     7,    11,    17,    24,    32,    41,    52,    64,
+     78,    93,   110,   128,   147,   168,   191,   215,   240,   267,   296,   327,
+    359,   392,   428,   465,   504,   544,   586,   630,   676,   723,   772,   823,
+    875,   930,   986,  1044,  1104,  1165,  1229,  1294,  1361,  1430,  1501,  1574,
+   1648,  1725,  1803,  1884,  1966,  2050,  2136,  2224,  2314,  2406,  2500,  2595,
+   2693,  2793,  2895,  2998,  3104,  3212,  3322,  3433,  3547,  3663,  3781,  3900,
+   4022,  4146,  4272,  4400,  4530,  4663,  4797,  4933,  5072,  5212,  5355,  5499,
+   5646,  5795,  5946,  6099,  6255,  6412,  6572,  6733,  6897,  7063,  7231,  7402,
+   7574,  7749,  7926,  8105,  8286,  8469,  8655,  8843,  9033,  9225,  9419,  9616,
+   9815, 10016, 10219, 10425, 10632, 10842, 11054, 11269, 11486, 11705, 11926, 12149,
+  12375, 12603, 12833, 13066, 13301, 13538, 13777, 14019, 14263, 14509, 14758, 15009,
+  15262, 15517, 15775, 16035, 16298, 16563, 16830, 17099, 17371, 17645, 17922, 18201,
+  18482, 18765, 19051, 19339, 19630, 19923, 20218, 20516, 20816, 21119, 21424, 21731,
+  22040, 22352, 22667, 22984, 23303, 23624, 23949, 24275, 24604, 24935, 25269, 25605,
+  25943, 26284, 26628, 26973, 27322, 27672, 28026, 28381, 28739, 29100, 29462, 29828,
+  30196, 30566, 30939, 31314, 31692, 32072, 32454, 32840, 33227, 33617, 34010, 34405,
+  34802, 35202, 35605, 36010, 36417, 36827, 37240, 37655, 38072, 38493, 38915, 39340,
+  39768, 40198, 40631, 41066, 41503, 41944, 42387, 42832, 43280, 43730, 44183, 44639,
+  45097, 45557, 46020, 46486, 46954, 47425, 47899, 48374, 48853, 49334, 49818, 50304,
+  50793, 51284, 51778, 52275, 52774, 53276, 53780, 54287, 54796, 55308, 55823, 56341,
+  56860, 57383, 57908, 58436, 58966, 59499, 60035, 60573, 61114, 61657, 62203, 62752,
+  63303, 63857, 64414, 64973, 65535,
+};
+
+static struct {
+  const led_effect_backend_t*  backend;
+  mico_mutex_t                 mutex;
+  mico_timer_t                 timer;
+  bool                         timer_armed;
+  uint32_t                     generation;   // bumped per effect, stale timer callbacks are dropped
+  led_effect_t                 effect;
+  uint16_t                     fade;         // crossfade frames in front of the effect
+  uint32_t                     length;       // frames of the effect
+  bool                         loop;
+  uint32_t                     started;      // mico_get_time() at frame 0
+  uint32_t                     next;         // next frame to write, backends without sequencer
+  uint16_t                     from[LED_EFFECT_CHANNELS];   // linear colour the crossfade starts at
+} engine;
+
+static void led_effect_timer_handler( void* arg );
+
+static uint16_t led_effect_correct( uint16_t linear )
+{
+  uint16_t low = led_effect_gamma[linear >> 8];
+  uint16_t high = led_effect_gamma[(linear >> 8) + 1];
+
+  return (uint16_t)( low + ( ( (uint32_t)( high - low ) * ( linear & 0xFF ) ) >> 8 ) );
+}
+
+/* 8 bit colour times a 16 bit envelope, linear 16 bit result */
+static uint16_t led_effect_scale( uint8_t color, uint16_t envelope )
+{
+  return (uint16_t)( ( (uint32_t)color * 257 * envelope + 32767 ) / 65535 );
+}
+
+static uint32_t led_effect_length( const led_effect_t* effect, uint32_t step_ms )
+{
+  uint32_t frames = effect->period_ms / step_ms;
+
+  switch( effect->type ){
+    case LED_EFFECT_BREATHE:
+      return ( frames < 2 ) ? 2 : frames;
+    case LED_EFFECT_CYCLE:
+      return ( frames < 3 ) ? 3 : frames;
+    case LED_EFFECT_BLINK:
+      frames = ( frames < 2 ) ? 2 : frames;
+      return ( effect->count == 0 ) ? frames : frames * effect->count;
+    default:
+      return 1;
+  }
+}
+
+static bool led_effect_loops( const led_effect_t* effect )
+{
+  return effect->type == LED_EFFECT_BREATHE || effect->type == LED_EFFECT_CYCLE ||
+         ( effect->type == LED_EFFECT_BLINK && effect->count == 0 );
+}
+
+/* Frame j of the effect itself, before gamma correction */
+static void led_effect_render( uint32_t j, uint16_t* linear )
+{
+  const led_effect_t* effect = &engine.effect;
+  const uint8_t peak[LED_EFFECT_CHANNELS] = { effect->color.red, effect->color.green, effect->color.blue };
+  uint32_t length = engine.length;
+  uint32_t envelope, period, seg;
+  uint8_t c;
+
+  switch( effect->type ){
+    case LED_EFFECT_BREATHE:
+      envelope = (uint32_t)( (uint64_t)j * 2 * 65535 / length );
+      envelope = ( envelope > 65535 ) ? 131070 - envelope : envelope;
+      break;
+    case LED_EFFECT_CYCLE:
+      /* one primary fades out while the next one fades in */
+      seg = (uint32_t)( (uint64_t)j * 3 / length );
+      envelope = (uint32_t)( ( (uint64_t)j * 3 - (uint64_t)seg * length ) * 65535 / length );
+      memset( linear, 0, LED_EFFECT_CHANNELS * sizeof(uint16_t) );
+      linear[seg] = led_effect_scale( peak[seg], (uint16_t)( 65535 - envelope ) );
+      linear[( seg + 1 ) % 3] = led_effect_scale( peak[( seg + 1 ) % 3], (uint16_t)envelope );
+      return;
+    case LED_EFFECT_BLINK:
+      period = length / ( ( effect->count == 0 ) ? 1 : effect->count );
+      envelope = ( ( j % period ) < period / 2 ) ? 65535 : 0;
+      break;
+    default:
+      envelope = 65535;
+      break;
+  }
+
+  for( c = 0; c < LED_EFFECT_CHANNELS; c++ ){
+    linear[c] = led_effect_scale( peak[c], (uint16_t)envelope );
+  }
+}
+
+/* Frame i of what is played: the crossfade, then the effect */
+static void led_effect_frame( uint32_t i, uint16_t* linear )
+{
+  uint16_t target[LED_EFFECT_CHANNELS];
+  uint32_t j;
+  uint8_t c;
+
+  if( i < engine.fade ){
+    led_effect_render( 0, target );
+    for( c = 0; c < LED_EFFECT_CHANNELS; c++ ){
+      linear[c] = (uint16_t)( (int32_t)engine.from[c] +
+                  ( (int64_t)target[c] - engine.from[c] ) * ( i + 1 ) / engine.fade );
+    }
+    return;
+  }
+
+  j = i - engine.fade;
+  if( engine.loop ){
+    j %= engine.length;
+  }
+  else if( j >= engine.length ){
+    j = engine.length - 1;
+  }
+  led_effect_render( j, linear );
+}
+
+static void led_effect_output( uint32_t i, uint16_t* level )
+{
+  uint8_t c;
+
+  led_effect_frame( i, level );
+  for( c = 0; c < LED_EFFECT_CHANNELS; c++ ){
+    level[c] = led_effect_correct( level[c] );
+  }
+}
+
+static void led_effect_disarm( void )
+{
+  if( engine.timer_armed ){
+    mico_stop_timer( &engine.timer );
+    mico_deinit_timer( &engine.timer );
+    engine.timer_armed = false;
+  }
+}
+
+static OSStatus led_effect_arm( uint32_t delay_ms )
+{
+  OSStatus err;
+
+  err = mico_init_timer( &engine.timer, delay_ms, led_effect_timer_handler, (void*)(uintptr_t)engine.generation );
+  require_noerr( err, exit );
+  err = mico_start_timer( &engine.timer );
+  if( err != kNoErr ){
+    mico_deinit_timer( &engine.timer );
+    goto exit;
+  }
+  engine.timer_armed = true;
+
+exit:
+  return err;
+}
+
+/* Hands over from the crossfade to the loop on sequencers, or shows the next
+ * frame on backends without one */
+static void led_effect_timer_handler( void* arg )
+{
+  const led_effect_backend_t* backend;
+  uint16_t level[LED_EFFECT_CHANNELS];
+
+  mico_rtos_lock_mutex( &engine.mutex );
+  backend = engine.backend;
+  if( (uint32_t)(uintptr_t)arg != engine.generation || !engine.timer_armed ){
+    goto exit;
+  }
+
+  if( backend->frames > 0 ){
+    led_effect_disarm( );
+    backend->play( engine.fade, (uint16_t)engine.length, true );
+    engine.started = mico_get_time( ) - engine.fade * backend->step_ms;
+    goto exit;
+  }
+
+  led_effect_output( engine.next, level );
+  backend->write( level );
+  engine.next++;
+  if( !engine.loop && engine.next >= engine.fade + engine.length ){
+    led_effect_disarm( );
+  }
+
+exit:
+  mico_rtos_unlock_mutex( &engine.mutex );
+}
+
+OSStatus led_effect_init( const led_effect_backend_t* backend )
+{
+  OSStatus err = kNoErr;
+
+  require_action( backend != NULL && backend->write != NULL && backend->step_ms > 0, exit, err = kParamErr );
+  require_action( backend->frames == 0 ||
+                  ( backend->store != NULL && backend->play != NULL && backend->stop != NULL ), exit, err = kParamErr );
+
+  if( engine.mutex == NULL ){
+    err = mico_rtos_init_mutex( &engine.mutex );
+    require_noerr( err, exit );
+  }
+
+  mico_rtos_lock_mutex( &engine.mutex );
+  led_effect_disarm( );
+  engine.generation++;
+  engine.backend = backend;
+  engine.length = 0;
+  memset( engine.from, 0, sizeof(engine.from) );
+  mico_rtos_unlock_mutex( &engine.mutex );
+
+exit:
+  return err;
+}
+
+OSStatus led_effect_start( const led_effect_t* effect )
+{
+  const led_effect_backend_t* backend = engine.backend;
+  uint16_t level[LED_EFFECT_CHANNELS];
+  uint32_t now, length, fade, i;
+  OSStatus err = kNoErr;
+
+  require_action( effect != NULL, exit, err = kParamErr );
+  require_action( backend != NULL, exit, err = kNotInitializedErr );
+
+  length = led_effect_length( effect, backend->step_ms );
+  fade = effect->fade_ms / backend->step_ms;
+  if( backend->frames > 0 ){
+    require_action( length <= backend->frames, exit, err = kSizeErr );
+    fade = ( fade > backend->frames - length ) ? backend->frames - length : fade;
+  }
+  fade = ( fade > 0xFFFF ) ? 0xFFFF : fade;
+
+  mico_rtos_lock_mutex( &engine.mutex );
+  led_effect_disarm( );
+  engine.generation++;
+  if( backend->frames > 0 && engine.length > 0 ){
+    backend->stop( );
+  }
+
+  /* The crossfade starts at the colour shown now, where the old effect is */
+  now = mico_get_time( );
+  if( engine.length > 0 ){
+    led_effect_frame( ( now - engine.started ) / backend->step_ms, engine.from );
+  }
+
+  engine.effect = *effect;
+  engine.length = length;
+  engine.fade = (uint16_t)fade;
+  engine.loop = led_effect_loops( effect );
+  engine.started = now;
+
+  if( backend->frames > 0 ){
+    for( i = 0; i < fade + length; i++ ){
+      led_effect_output( i, level );
+      backend->store( (uint16_t)i, level );
+    }
+    if( engine.loop && fade > 0 ){
+      err = backend->play( 0, (uint16_t)fade, false );
+      require_noerr( err, unlock );
+      err = led_effect_arm( fade * backend->step_ms );
+    }
+    else{
+      err = backend->play( 0, (uint16_t)( fade + length ), engine.loop );
+    }
+  }
+  else{
+    led_effect_output( 0, level );
+    err = backend->write( level );
+    engine.next = 1;
+    if( engine.loop || fade + length > 1 ){
+      err = led_effect_arm( backend->step_ms );
+    }
+  }
+
+unlock:
+  if( err != kNoErr ){
+    led_effect_log( "effect %d start failed, err %d", effect->type, err );
+  }
+  mico_rtos_unlock_mutex( &engine.mutex );
+exit:
+  return err;
+}
+
+OSStatus led_effect_solid( uint8_t red, uint8_t green, uint8_t blue, uint32_t fade_ms )
+{
+  led_effect_t effect;
+
+  memset( &effect, 0, sizeof(effect) );
+  effect.type = LED_EFFECT_SOLID;
+  effect.color.red = red;
+  effect.color.green = green;
+  effect.color.blue = blue;
+  effect.fade_ms = fade_ms;
+  return led_effect_start( &effect );
+}
+
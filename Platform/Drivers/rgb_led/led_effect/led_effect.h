@@ -0,0 +1,87 @@
+/**
+******************************************************************************
+* @file    led_effect.h
+* @author  MICO Application Team
+* @version V1.0.0
+* @date    19-Oct-2016
+* @brief   Precomputed RGB LED effects played by the LED hardware.
+******************************************************************************
+* @attention
+*
+* THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+* WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+* TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+* DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+* FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+* CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+*
+* <h2><center>&copy; COPYRIGHT 2016 MXCHIP Inc.</center></h2>
+******************************************************************************
+*/
+
+#ifndef __LED_EFFECT_H_
+#define __LED_EFFECT_H_
+
+#include "mico.h"
+
+/* An effect is rendered once, when it is started, into frames of gamma
+ * corrected 16 bit channel levels, one frame per backend step. A crossfade
+ * from the colour shown at that moment is rendered in front of it. Backends
+ * with a sequencer (PWM timers fed by DMA) store the frames and play them on
+ * their own, so nothing runs on the CPU until the next effect is started,
+ * except one timer callback that switches from the crossfade to the looping
+ * part. Backends that can only show one colour (the P9813 driver) are given
+ * one frame per step from an RTOS timer. */
+
+#define LED_EFFECT_CHANNELS         3     // red, green, blue
+
+#ifndef LED_EFFECT_MAX_FRAMES
+#define LED_EFFECT_MAX_FRAMES       256   // sequencer size of the bundled backends
+#endif
+
+#define LED_EFFECT_LEVEL_MAX        0xFFFF
+
+typedef enum {
+  LED_EFFECT_SOLID,       // color
+  LED_EFFECT_BREATHE,     // color rising from dark and back in period_ms
+  LED_EFFECT_CYCLE,       // fades red to green to blue and back to red in period_ms
+  LED_EFFECT_BLINK,       // color on for half of period_ms, count times, then dark
+} led_effect_type_t;
+
+typedef struct {
+  uint8_t   red;
+  uint8_t   green;
+  uint8_t   blue;
+} led_effect_color_t;
+
+typedef struct {
+  led_effect_type_t   type;
+  led_effect_color_t  color;      // cycle: the level each primary peaks at
+  uint32_t            period_ms;
+  uint16_t            count;      // blink: 0 blinks until the next effect
+  uint32_t            fade_ms;    // crossfade from the colour shown now
+} led_effect_t;
+
+/* level[] holds gamma corrected red, green and blue, 0 .. LED_EFFECT_LEVEL_MAX */
+typedef struct {
+  uint32_t  step_ms;      // time one frame is shown
+  uint16_t  frames;       // frames the sequencer holds, 0 without a sequencer
+  OSStatus  (*write)( const uint16_t* level );
+  /* sequencer only */
+  OSStatus  (*store)( uint16_t index, const uint16_t* level );
+  OSStatus  (*play)( uint16_t first, uint16_t count, bool loop );   // the last frame is kept unless looping
+  OSStatus  (*stop)( void );                                        // keeps the frame being shown
+} led_effect_backend_t;
+
+/* The backend is initialised and its output started by the caller */
+OSStatus led_effect_init( const led_effect_backend_t* backend );
+
+/* Replaces the running effect. kSizeErr when the effect does not fit into
+ * the sequencer, the crossfade is shortened before that happens. */
+OSStatus led_effect_start( const led_effect_t* effect );
+
+/* Shorthand for a solid colour */
+OSStatus led_effect_solid( uint8_t red, uint8_t green, uint8_t blue, uint32_t fade_ms );
+
+#endif  // __LED_EFFECT_H_
+
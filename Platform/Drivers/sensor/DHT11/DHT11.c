@@ -110,7 +110,8 @@ uint8_t DHT11_Read_Byte(void)
   return dat;
 }
 
-uint8_t DHT11_Read_Data(uint8_t *temperature,uint8_t *humidity)    
+#ifdef DHT11_USE_BITBANG
+static uint8_t dht11_read_bitbang(uint8_t *temperature,uint8_t *humidity)    
 {        
   uint8_t buf[5];
   uint8_t i;
@@ -121,7 +122,7 @@ uint8_t DHT11_Read_Data(uint8_t *temperature,uint8_t *humidity)
     {
       buf[i]=DHT11_Read_Byte();
     }
-    if((buf[0]+buf[1]+buf[2]+buf[3])==buf[4])
+    if((uint8_t)(buf[0]+buf[1]+buf[2]+buf[3])==buf[4])
     {
       *humidity=buf[0];
       *temperature=buf[2];
@@ -133,6 +134,195 @@ uint8_t DHT11_Read_Data(uint8_t *temperature,uint8_t *humidity)
   
   return 0;	    
 }
+#endif
+
+/*------------------------- DHT11 interrupt driven read -----------------------*/
+
+/* The host pulls DATA low for 20ms, releases it, and then only timestamps the
+ * falling edges of the answer with the nanosecond clock:
+ *
+ *   F0 ........ F1 ..... F2 ..... ... F40 ..... F41
+ *   80us low + 80us high, then per bit 50us low + 26us (0) or 70us (1) high,
+ *   and a last 50us low.
+ *
+ * The falling to falling period of bit n is F(n+2) - F(n+1), ~76us for a 0
+ * and ~120us for a 1. Bits are classified against the measured 0 period,
+ * not an absolute time, so the result does not depend on the core clock the
+ * nanosecond clock was calibrated for, and up to ~15us of interrupt latency
+ * jitter per edge is tolerated. F0 may be missed when the sensor answers
+ * before the IRQ is armed, only F1..F41 are needed. A corrupted period is
+ * caught by the checksum. */
+
+#define DHT11_START_LOW_MS     20
+#define DHT11_FRAME_MS         8    // answer is at most ~5.3ms after release
+#define DHT11_FRAME_EDGES      41   // F1..F41
+#define DHT11_EDGES_MAX        (DHT11_FRAME_EDGES + 1)
+
+static struct {
+  bool                   inited;
+  volatile bool          busy;
+  mico_timer_t           start_timer;
+  mico_timer_t           frame_timer;
+  volatile uint8_t       edges;
+  uint32_t               stamp[DHT11_EDGES_MAX];
+  dht11_read_callback_t  callback;
+  void*                  arg;
+} dht11;
+
+static void dht11_edge_irq( void* arg )
+{
+  UNUSED_PARAMETER( arg );
+  if( dht11.edges < DHT11_EDGES_MAX )
+    dht11.stamp[dht11.edges] = (uint32_t)MicoNanosecondGetTime( );
+  if( dht11.edges < 0xFF )
+    dht11.edges++;
+}
+
+static OSStatus dht11_decode( const uint32_t *stamp, uint8_t edges, uint8_t *buf )
+{
+  OSStatus err = kNoErr;
+  uint32_t period[DHT11_FRAME_EDGES - 1];
+  uint32_t sorted[DHT11_FRAME_EDGES - 1];
+  uint32_t threshold, v;
+  uint64_t sum;
+  uint8_t i, j, pass;
+
+  require_action( edges >= DHT11_FRAME_EDGES, exit, err = kTimeoutErr );
+  require_action( edges <= DHT11_EDGES_MAX, exit, err = kMalformedErr );
+  stamp += edges - DHT11_FRAME_EDGES;
+
+  for( i = 0; i < DHT11_FRAME_EDGES - 1; i++ ){
+    v = period[i] = stamp[i + 1] - stamp[i];
+    for( j = i; j > 0 && sorted[j - 1] > v; j-- )
+      sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  /* At least 16 of the 40 bits are 0 (both decimal bytes and the top bits
+   * of humidity and temperature), so the 10th shortest period is a 0. A 1 is
+   * ~1.58 times as long, split at 1.3 times the 0 period, then refine that
+   * from the mean of everything classified as 0 so jitter averages out. */
+  threshold = sorted[9] + sorted[9] * 3 / 10;
+  for( pass = 0; pass < 2; pass++ ){
+    sum = 0;
+    for( i = 0; i < DHT11_FRAME_EDGES - 1 && sorted[i] <= threshold; i++ )
+      sum += sorted[i];
+    sum /= i;
+    threshold = sum + sum * 3 / 10;
+  }
+
+  memset( buf, 0x0, 5 );
+  for( i = 0; i < DHT11_FRAME_EDGES - 1; i++ ){
+    buf[i / 8] <<= 1;
+    if( period[i] > threshold ) buf[i / 8] |= 1;
+  }
+  require_action( (uint8_t)( buf[0] + buf[1] + buf[2] + buf[3] ) == buf[4], exit, err = kChecksumErr );
+
+exit:
+  return err;
+}
+
+/* 20ms start pulse is over, release DATA and listen */
+static void dht11_start_timeout( void* arg )
+{
+  UNUSED_PARAMETER( arg );
+  mico_stop_timer( &dht11.start_timer );
+
+  dht11.edges = 0;
+  MicoNanosecondInit( );
+  DHT11_DATA_Set();
+  DHT11_IO_IN();
+  MicoGpioEnableIRQ( (mico_gpio_t)DHT11_DATA, IRQ_TRIGGER_FALLING_EDGE, dht11_edge_irq, NULL );
+  mico_start_timer( &dht11.frame_timer );
+}
+
+/* frame window closed, decode what was captured and report */
+static void dht11_frame_timeout( void* arg )
+{
+  OSStatus err;
+  uint8_t buf[5] = { 0 };
+  dht11_read_callback_t callback = dht11.callback;
+  UNUSED_PARAMETER( arg );
+
+  mico_stop_timer( &dht11.frame_timer );
+  MicoGpioDisableIRQ( (mico_gpio_t)DHT11_DATA );
+
+  err = dht11_decode( dht11.stamp, dht11.edges, buf );
+  dht11.busy = false;
+  if( callback != NULL )
+    callback( err, buf[2], buf[0], dht11.arg );
+}
+
+OSStatus DHT11_Read_Async( dht11_read_callback_t callback, void *arg )
+{
+  OSStatus err = kNoErr;
+
+  if( dht11.inited == false ){
+    err = mico_init_timer( &dht11.start_timer, DHT11_START_LOW_MS, dht11_start_timeout, NULL );
+    require_noerr( err, exit );
+    err = mico_init_timer( &dht11.frame_timer, DHT11_FRAME_MS, dht11_frame_timeout, NULL );
+    require_noerr( err, exit );
+    dht11.inited = true;
+  }
+  require_action( dht11.busy == false, exit, err = kInProgressErr );
+
+  dht11.busy = true;
+  dht11.callback = callback;
+  dht11.arg = arg;
+
+  DHT11_IO_OUT();
+  DHT11_DATA_Clr();
+  err = mico_start_timer( &dht11.start_timer );
+  if( err != kNoErr ){
+    DHT11_DATA_Set();
+    dht11.busy = false;
+  }
+
+exit:
+  return err;
+}
+
+typedef struct {
+  mico_semaphore_t  done;
+  OSStatus          err;
+  uint8_t           temperature;
+  uint8_t           humidity;
+} dht11_wait_t;
+
+static void dht11_wait_done( OSStatus err, uint8_t temperature, uint8_t humidity, void *arg )
+{
+  dht11_wait_t *wait = arg;
+  wait->err = err;
+  wait->temperature = temperature;
+  wait->humidity = humidity;
+  mico_rtos_set_semaphore( &wait->done );
+}
+
+/* Blocks the calling thread only, the CPU is free while the frame arrives */
+uint8_t DHT11_Read_Data(uint8_t *temperature,uint8_t *humidity)    
+{
+#ifdef DHT11_USE_BITBANG
+  return dht11_read_bitbang( temperature, humidity );
+#else
+  OSStatus err;
+  dht11_wait_t wait;
+
+  err = mico_rtos_init_semaphore( &wait.done, 1 );
+  require_noerr( err, exit );
+  err = DHT11_Read_Async( dht11_wait_done, &wait );
+  if( err == kNoErr ){
+    mico_rtos_get_semaphore( &wait.done, MICO_WAIT_FOREVER );
+    err = wait.err;
+  }
+  mico_rtos_deinit_semaphore( &wait.done );
+  require_noerr_quiet( err, exit );
+
+  *temperature = wait.temperature;
+  *humidity = wait.humidity;
+
+exit:
+  return ( err == kNoErr ) ? 0 : 1;
+#endif
+}
 
 uint8_t DHT11_Init(void)
 {	 
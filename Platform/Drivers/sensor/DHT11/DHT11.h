@@ -43,8 +43,13 @@
 
 //-------------------------------- USER INTERFACES -----------------------------
 
+// Read result, err is kNoErr, kTimeoutErr (no or short answer), kMalformedErr
+// or kChecksumErr. Called from the RTOS timer thread, keep it short.
+typedef void (*dht11_read_callback_t)( OSStatus err, uint8_t temperature, uint8_t humidity, void *arg );
+
 uint8_t DHT11_Init(void); //Init DHT11
 uint8_t DHT11_Read_Data(uint8_t *temperature,uint8_t *humidity); //Read DHT11 Value
+OSStatus DHT11_Read_Async(dht11_read_callback_t callback, void *arg); //Start a read, returns at once
 uint8_t DHT11_Read_Byte(void);//Read One Byte
 uint8_t DHT11_Read_Bit(void);//Read One Bit
 uint8_t DHT11_Check(void);//Chack DHT11
@@ -37,6 +37,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "hts221.h"
 #include "mico.h"
+#include "../sensor_hub/sensor_hub.h"
 #include <math.h>
 
 #define hts221_log(M, ...) custom_log("HTS221", M, ##__VA_ARGS__)
@@ -600,6 +601,48 @@ OSStatus hts221_Read_Data(float *temperature,float *humidity)
   return 0;
 }
 
+/* sensor hub: one 4 byte burst of H_OUT and T_OUT, value[0] degC, value[1] %rH */
+static OSStatus hts221_hub_decode(const uint8_t* raw, sensor_hub_sample_t* sample, void* arg)
+{
+  int16_t H_T_out = (int16_t)((((uint16_t)raw[1]) << 8) | raw[0]);
+  int16_t T_out = (int16_t)((((uint16_t)raw[3]) << 8) | raw[2]);
+  float H_rh;
+  UNUSED_PARAMETER(arg);
+
+  if((H1_T0_out == H0_T0_out) || (T1_out == T0_out)){
+    return kStateErr;  // not calibrated yet
+  }
+
+  sample->value[0] = ((float)(T_out - T0_out))/(T1_out - T0_out) * (T1_degC - T0_degC) + T0_degC;
+  H_rh = ((float)(H_T_out - H0_T0_out) * (H1_rh - H0_rh)) / (H1_T0_out - H0_T0_out) + H0_rh;
+  if(H_rh < 0.0f) H_rh = 0.0f;
+  if(H_rh > 100.0f) H_rh = 100.0f;
+  sample->value[1] = H_rh;
+  return kNoErr;
+}
+
+OSStatus hts221_sensor_hub_register(uint32_t period_ms, uint8_t *id)
+{
+  sensor_hub_desc_t desc = {
+    "HTS221", &hts221_i2c_device, (HTS221_HUMIDITY_OUT_L_ADDR | HTS221_I2C_MULTIPLEBYTE_CMD), 4,
+    period_ms, hts221_hub_decode, NULL
+  };
+  uint8_t tmp = 0x00;
+
+  // the hub only reads the output registers, so convert continuously
+  if(HTS221_IO_Read(&tmp, HTS221_ADDRESS, HTS221_CTRL_REG1_ADDR, 1) != HUM_TEMP_OK){
+    return -1;
+  }
+  tmp &= ~(HTS221_ODR_MASK);
+  if(period_ms >= 1000)     tmp |= HTS221_ODR_1Hz;
+  else if(period_ms >= 143) tmp |= HTS221_ODR_7Hz;
+  else                      tmp |= HTS221_ODR_12_5Hz;
+  if(HTS221_IO_Write(&tmp, HTS221_ADDRESS, HTS221_CTRL_REG1_ADDR, 1) != HUM_TEMP_OK){
+    return -1;
+  }
+  return sensor_hub_register(&desc, id);
+}
+
 OSStatus hts221_sensor_deinit(void)
 {
   if(HTS221_Power_OFF() != HUM_TEMP_OK){
@@ -636,6 +636,7 @@ typedef struct
   */ 
 OSStatus hts221_sensor_init(void);
 OSStatus hts221_Read_Data(float *temperature,float *humidity);
+OSStatus hts221_sensor_hub_register(uint32_t period_ms, uint8_t *id);  // sample through sensor_hub
 OSStatus hts221_sensor_deinit(void);
 /**
   * @}
@@ -36,6 +36,7 @@
  */
 /* Includes ------------------------------------------------------------------*/
 #include "lps25hb.h"
+#include "../sensor_hub/sensor_hub.h"
 
 #define lps25hb_log(M, ...) custom_log("LPS25HB", M, ##__VA_ARGS__)
 #define lps25hb_log_trace() custom_log_trace("LPS25HB")
@@ -548,6 +549,43 @@ OSStatus lps25hb_Read_Data(float *temperature,float *pressure)
   return 0;
 }
 
+/* sensor hub: one 5 byte burst of P_OUT and T_OUT, value[0] degC, value[1] mbar */
+static OSStatus lps25hb_hub_decode(const uint8_t* raw, sensor_hub_sample_t* sample, void* arg)
+{
+  uint32_t raw_press = ((uint32_t)raw[2] << 16) | ((uint32_t)raw[1] << 8) | raw[0];
+  int16_t raw_temp = (int16_t)((((uint16_t)raw[4]) << 8) | raw[3]);
+  UNUSED_PARAMETER(arg);
+
+  if (raw_press & 0x00800000)
+    raw_press |= 0xFF000000;
+  sample->value[0] = ((float)raw_temp/480.0f) + 42.5f;
+  sample->value[1] = (float)raw_press /4096.0f;
+  return kNoErr;
+}
+
+OSStatus lps25hb_sensor_hub_register(uint32_t period_ms, uint8_t *id)
+{
+  sensor_hub_desc_t desc = {
+    "LPS25HB", &lps25hb_i2c_device, (LPS25HB_PRESS_POUT_XL_ADDR | LPS25HB_I2C_MULTIPLEBYTE_CMD), 5,
+    period_ms, lps25hb_hub_decode, NULL
+  };
+  uint8_t tmp = 0x00;
+
+  // the hub only reads the output registers, so convert continuously
+  if(LPS25HB_IO_Read(&tmp, LPS25HB_SlaveAddress, LPS25HB_CTRL_REG1_ADDR, 1) != PRESSURE_OK){
+    return -1;
+  }
+  tmp &= ~(LPS25HB_ODR_MASK);
+  if(period_ms >= 1000)     tmp |= LPS25HB_ODR_1Hz;
+  else if(period_ms >= 143) tmp |= LPS25HB_ODR_7Hz;
+  else if(period_ms >= 80)  tmp |= LPS25HB_ODR_12_5Hz;
+  else                      tmp |= LPS25HB_ODR_25Hz;
+  if(LPS25HB_IO_Write(&tmp, LPS25HB_SlaveAddress, LPS25HB_CTRL_REG1_ADDR, 1) != PRESSURE_OK){
+    return -1;
+  }
+  return sensor_hub_register(&desc, id);
+}
+
 OSStatus lps25hb_sensor_deinit(void)
 {
   if(LPS25HB_PowerOff() != PRESSURE_OK){
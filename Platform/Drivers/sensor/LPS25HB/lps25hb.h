@@ -623,6 +623,7 @@ extern PRESSURE_DrvExtTypeDef LPS25HBDrv_ext;
 
 OSStatus lps25hb_sensor_init(void);
 OSStatus lps25hb_Read_Data(float *temperature,float *pressure);
+OSStatus lps25hb_sensor_hub_register(uint32_t period_ms, uint8_t *id);  // sample through sensor_hub
 OSStatus lps25hb_sensor_deinit(void);
 
 /**
@@ -0,0 +1,301 @@
+/**
+******************************************************************************
+* @file    sensor_hub.c
+* @author  MICO Application Team
+* @version V1.0.0
+* @date    19-Oct-2016
+* @brief   Scheduled, batched sampling of I2C sensors.
+******************************************************************************
+* @attention
+*
+* THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+* WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+* TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+* DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+* FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+* CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+*
+* <h2><center>&copy; COPYRIGHT 2016 MXCHIP Inc.</center></h2>
+******************************************************************************
+*/
+
+#include "mico.h"
+#include "RingBufferUtils.h"
+#include "sensor_hub.h"
+
+#define sensor_hub_log(M, ...) custom_log("SENSOR_HUB", M, ##__VA_ARGS__)
+
+#define SENSOR_HUB_STACK_SIZE       0x500
+#define SENSOR_HUB_I2C_RETRIES      3
+
+typedef struct {
+  bool                 used;
+  sensor_hub_desc_t    desc;
+  uint32_t             due;
+  mico_semaphore_t*    event;
+  ring_buffer_t        queue;
+  uint8_t              queue_mem[SENSOR_HUB_QUEUE_DEPTH * sizeof(sensor_hub_sample_t) + 1];
+  bool                 has_latest;
+  sensor_hub_sample_t  latest;
+  /* owned by the hub thread during a batch */
+  uint8_t              raw[SENSOR_HUB_RAW_MAX];
+  mico_i2c_message_t   message;
+} sensor_hub_sensor_t;
+
+static struct {
+  mico_mutex_t         mutex;
+  mico_semaphore_t     wake;
+  mico_thread_t        thread;
+  bool                 started;
+  uint32_t             coalesce_ms;
+  sensor_hub_stats_t   stats;
+  sensor_hub_sensor_t  sensor[SENSOR_HUB_MAX_SENSORS];
+} hub = { NULL, NULL, NULL, false, SENSOR_HUB_COALESCE_MS };
+
+static OSStatus sensor_hub_init( void )
+{
+  OSStatus err = kNoErr;
+
+  if( hub.mutex == NULL ){
+    err = mico_rtos_init_mutex( &hub.mutex );
+    require_noerr( err, exit );
+  }
+  if( hub.wake == NULL ){
+    err = mico_rtos_init_semaphore( &hub.wake, 1 );
+    require_noerr( err, exit );
+  }
+
+exit:
+  return err;
+}
+
+/* ms until the first sensor is due, 0 when one is due now */
+static uint32_t sensor_hub_next_wait( uint32_t now )
+{
+  uint32_t wait = MICO_WAIT_FOREVER;
+  int32_t left;
+  uint8_t i;
+
+  mico_rtos_lock_mutex( &hub.mutex );
+  for( i = 0; i < SENSOR_HUB_MAX_SENSORS; i++ ){
+    if( !hub.sensor[i].used || hub.sensor[i].desc.period_ms == 0 ) continue;
+    left = (int32_t)( hub.sensor[i].due - now );
+    if( left <= 0 ){
+      wait = 0;
+      break;
+    }
+    if( (uint32_t)left < wait ) wait = (uint32_t)left;
+  }
+  mico_rtos_unlock_mutex( &hub.mutex );
+  return wait;
+}
+
+static void sensor_hub_publish( sensor_hub_sensor_t* s, const sensor_hub_sample_t* sample )
+{
+  if( ring_buffer_free_space( &s->queue ) >= sizeof(sensor_hub_sample_t) )
+    ring_buffer_write( &s->queue, (const uint8_t*)sample, sizeof(sensor_hub_sample_t) );
+  else
+    hub.stats.dropped++;
+
+  mico_rtos_lock_mutex( &hub.mutex );
+  s->latest = *sample;
+  s->has_latest = true;
+  mico_rtos_unlock_mutex( &hub.mutex );
+
+  if( s->event != NULL )
+    mico_rtos_set_semaphore( s->event );
+}
+
+/* Read every sensor due within the coalesce window: one locked pass per I2C
+ * port, then decode and queue the results */
+static void sensor_hub_run( uint32_t now )
+{
+  uint8_t due[SENSOR_HUB_MAX_SENSORS];
+  OSStatus result[SENSOR_HUB_MAX_SENSORS];
+  bool taken[SENSOR_HUB_MAX_SENSORS];
+  mico_i2c_transaction_t batch[SENSOR_HUB_MAX_SENSORS];
+  uint8_t owner[SENSOR_HUB_MAX_SENSORS];
+  sensor_hub_sensor_t* s;
+  sensor_hub_sample_t sample;
+  uint8_t i, j, n = 0, m;
+  uint32_t stamp;
+
+  mico_rtos_lock_mutex( &hub.mutex );
+  for( i = 0; i < SENSOR_HUB_MAX_SENSORS; i++ ){
+    s = &hub.sensor[i];
+    if( !s->used || s->desc.period_ms == 0 ) continue;
+    if( (int32_t)( s->due - now ) > (int32_t)hub.coalesce_ms ) continue;
+    due[n++] = i;
+    s->due += s->desc.period_ms;
+    if( (int32_t)( s->due - now ) <= 0 )  // fell behind, do not burst to catch up
+      s->due = now + s->desc.period_ms;
+  }
+  mico_rtos_unlock_mutex( &hub.mutex );
+
+  if( n == 0 ) return;
+  hub.stats.wakeups++;
+
+  memset( taken, 0x0, sizeof(taken) );
+  for( i = 0; i < n; i++ ){
+    if( taken[i] ) continue;
+    for( j = i, m = 0; j < n; j++ ){
+      s = &hub.sensor[due[j]];
+      if( taken[j] || s->desc.device->port != hub.sensor[due[i]].desc.device->port ) continue;
+      taken[j] = true;
+      MicoI2cBuildCombinedMessage( &s->message, &s->desc.reg, s->raw, 1, s->desc.length, SENSOR_HUB_I2C_RETRIES );
+      batch[m].device = s->desc.device;
+      batch[m].message = &s->message;
+      batch[m].number_of_messages = 1;
+      batch[m].result = kNoErr;
+      owner[m++] = j;
+    }
+    if( MicoI2cTransferBatch( batch, m ) == kParamErr ){
+      for( j = 0; j < m; j++ ) batch[j].result = kParamErr;
+    }
+    for( j = 0; j < m; j++ )
+      result[owner[j]] = batch[j].result;
+  }
+  hub.stats.transfers += n;
+
+  stamp = mico_get_time();
+  for( i = 0; i < n; i++ ){
+    s = &hub.sensor[due[i]];
+    memset( &sample, 0x0, sizeof(sample) );
+    sample.timestamp = stamp;
+    if( result[i] == kNoErr )
+      result[i] = s->desc.decode( s->raw, &sample, s->desc.arg );
+    if( result[i] != kNoErr ){
+      hub.stats.errors++;
+      continue;
+    }
+    sensor_hub_publish( s, &sample );
+  }
+}
+
+static void sensor_hub_thread( void* arg )
+{
+  uint32_t now, wait;
+  UNUSED_PARAMETER( arg );
+
+  while( 1 ){
+    now = mico_get_time();
+    wait = sensor_hub_next_wait( now );
+    if( wait > 0 ){
+      mico_rtos_get_semaphore( &hub.wake, wait );
+      continue;
+    }
+    sensor_hub_run( now );
+  }
+}
+
+OSStatus sensor_hub_start( void )
+{
+  OSStatus err = kNoErr;
+
+  require_quiet( hub.started == false, exit );
+  err = sensor_hub_init( );
+  require_noerr( err, exit );
+
+  err = mico_rtos_create_thread( &hub.thread, MICO_APPLICATION_PRIORITY, "sensor hub",
+                                 sensor_hub_thread, SENSOR_HUB_STACK_SIZE, NULL );
+  require_noerr( err, exit );
+  hub.started = true;
+
+exit:
+  return err;
+}
+
+OSStatus sensor_hub_register( const sensor_hub_desc_t* desc, uint8_t* id )
+{
+  OSStatus err = kNoErr;
+  sensor_hub_sensor_t* s = NULL;
+  uint8_t i;
+
+  require_action( desc != NULL && desc->device != NULL && desc->decode != NULL, exit, err = kParamErr );
+  require_action( desc->length > 0 && desc->length <= SENSOR_HUB_RAW_MAX, exit, err = kSizeErr );
+  err = sensor_hub_init( );
+  require_noerr( err, exit );
+
+  mico_rtos_lock_mutex( &hub.mutex );
+  for( i = 0; i < SENSOR_HUB_MAX_SENSORS; i++ ){
+    if( hub.sensor[i].used ) continue;
+    s = &hub.sensor[i];
+    memset( s, 0x0, sizeof(sensor_hub_sensor_t) );
+    s->desc = *desc;
+    s->due = mico_get_time( );
+    ring_buffer_init( &s->queue, s->queue_mem, sizeof(s->queue_mem) );
+    s->used = true;
+    *id = i;
+    break;
+  }
+  mico_rtos_unlock_mutex( &hub.mutex );
+  require_action( s != NULL, exit, err = kNoResourcesErr );
+
+  sensor_hub_log( "%s registered, id %d, every %d ms", desc->name ? desc->name : "sensor", *id, desc->period_ms );
+  mico_rtos_set_semaphore( &hub.wake );
+
+exit:
+  return err;
+}
+
+OSStatus sensor_hub_set_period( uint8_t id, uint32_t period_ms )
+{
+  OSStatus err = kNoErr;
+
+  require_action( id < SENSOR_HUB_MAX_SENSORS && hub.sensor[id].used, exit, err = kParamErr );
+
+  mico_rtos_lock_mutex( &hub.mutex );
+  hub.sensor[id].desc.period_ms = period_ms;
+  hub.sensor[id].due = mico_get_time( );
+  mico_rtos_unlock_mutex( &hub.mutex );
+  mico_rtos_set_semaphore( &hub.wake );
+
+exit:
+  return err;
+}
+
+void sensor_hub_set_coalesce( uint32_t window_ms )
+{
+  hub.coalesce_ms = window_ms;
+  if( hub.wake != NULL )
+    mico_rtos_set_semaphore( &hub.wake );
+}
+
+OSStatus sensor_hub_subscribe( uint8_t id, mico_semaphore_t* event )
+{
+  OSStatus err = kNoErr;
+
+  require_action( id < SENSOR_HUB_MAX_SENSORS && hub.sensor[id].used, exit, err = kParamErr );
+  hub.sensor[id].event = event;
+
+exit:
+  return err;
+}
+
+uint32_t sensor_hub_read( uint8_t id, sensor_hub_sample_t* samples, uint32_t count )
+{
+  if( id >= SENSOR_HUB_MAX_SENSORS || !hub.sensor[id].used ) return 0;
+  return ring_buffer_read( &hub.sensor[id].queue, (uint8_t*)samples, count * sizeof(sensor_hub_sample_t) ) / sizeof(sensor_hub_sample_t);
+}
+
+OSStatus sensor_hub_latest( uint8_t id, sensor_hub_sample_t* sample )
+{
+  OSStatus err = kNoErr;
+
+  require_action( id < SENSOR_HUB_MAX_SENSORS && hub.sensor[id].used, exit, err = kParamErr );
+
+  mico_rtos_lock_mutex( &hub.mutex );
+  if( hub.sensor[id].has_latest )
+    *sample = hub.sensor[id].latest;
+  else
+    err = kNotFoundErr;
+  mico_rtos_unlock_mutex( &hub.mutex );
+
+exit:
+  return err;
+}
+
+void sensor_hub_get_stats( sensor_hub_stats_t* stats )
+{
+  *stats = hub.stats;
+}
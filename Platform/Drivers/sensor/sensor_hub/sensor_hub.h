@@ -0,0 +1,97 @@
+/**
+******************************************************************************
+* @file    sensor_hub.h
+* @author  MICO Application Team
+* @version V1.0.0
+* @date    19-Oct-2016
+* @brief   Scheduled, batched sampling of I2C sensors.
+******************************************************************************
+* @attention
+*
+* THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+* WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+* TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+* DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+* FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+* CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+*
+* <h2><center>&copy; COPYRIGHT 2016 MXCHIP Inc.</center></h2>
+******************************************************************************
+*/
+
+#ifndef __SENSOR_HUB_H_
+#define __SENSOR_HUB_H_
+
+#include "mico.h"
+
+/* A driver describes how one sample is read: a burst read of `length` bytes
+ * starting at register `reg` of an I2C device, every `period_ms`. The hub
+ * thread wakes once for all sensors that are due (or due within the coalesce
+ * window), reads them in one locked pass per I2C port, decodes the raw bytes
+ * with the driver's decode function and queues the timestamped result for
+ * that sensor. Consumers pop the queue or look at the latest sample and can
+ * be woken with a semaphore. The driver keeps the device in a continuous
+ * conversion mode so a plain register read always returns fresh data. */
+
+#ifndef SENSOR_HUB_MAX_SENSORS
+#define SENSOR_HUB_MAX_SENSORS      8
+#endif
+
+#ifndef SENSOR_HUB_QUEUE_DEPTH
+#define SENSOR_HUB_QUEUE_DEPTH      8     // samples kept per sensor
+#endif
+
+#ifndef SENSOR_HUB_COALESCE_MS
+#define SENSOR_HUB_COALESCE_MS      20    // default, see sensor_hub_set_coalesce()
+#endif
+
+#define SENSOR_HUB_RAW_MAX          8     // bytes of one burst read
+#define SENSOR_HUB_VALUES           3
+
+typedef struct {
+  uint32_t  timestamp;                   // mico_get_time() of the batch
+  float     value[SENSOR_HUB_VALUES];    // meaning defined by the driver
+} sensor_hub_sample_t;
+
+typedef OSStatus (*sensor_hub_decode_t)( const uint8_t* raw, sensor_hub_sample_t* sample, void* arg );
+
+typedef struct {
+  const char*          name;
+  mico_i2c_device_t*   device;
+  uint8_t              reg;        // first register, with any auto increment bit set
+  uint8_t              length;     // 1 .. SENSOR_HUB_RAW_MAX
+  uint32_t             period_ms;  // 0 registers the sensor paused
+  sensor_hub_decode_t  decode;
+  void*                arg;
+} sensor_hub_desc_t;
+
+typedef struct {
+  uint32_t  wakeups;       // scheduler passes that read at least one sensor
+  uint32_t  transfers;     // sensor reads
+  uint32_t  errors;        // failed reads or decodes
+  uint32_t  dropped;       // samples lost to a full queue
+} sensor_hub_stats_t;
+
+OSStatus sensor_hub_start( void );
+
+/* desc is copied, id identifies the sensor in the calls below */
+OSStatus sensor_hub_register( const sensor_hub_desc_t* desc, uint8_t* id );
+OSStatus sensor_hub_set_period( uint8_t id, uint32_t period_ms );
+
+/* Sensors due within window_ms of each other are read in the same wakeup,
+ * a wider window means fewer wakeups and less timing precision */
+void sensor_hub_set_coalesce( uint32_t window_ms );
+
+/* event is set after each new sample of sensor id, several sensors may share one */
+OSStatus sensor_hub_subscribe( uint8_t id, mico_semaphore_t* event );
+
+/* Pops up to count queued samples, oldest first, returns how many. The queue
+ * is lock free with one reader, so only one consumer should pop a sensor. */
+uint32_t sensor_hub_read( uint8_t id, sensor_hub_sample_t* samples, uint32_t count );
+
+/* Newest sample without touching the queue, kNotFoundErr before the first one */
+OSStatus sensor_hub_latest( uint8_t id, sensor_hub_sample_t* sample );
+
+void sensor_hub_get_stats( sensor_hub_stats_t* stats );
+
+#endif  // __SENSOR_HUB_H_
@@ -34,9 +34,20 @@
 #include "spi_flash_internal.h"
 #include "spi_flash_platform_interface.h"
 #include <string.h> /* for NULL */
+#ifndef NO_MICO_RTOS
+#include "mico_rtos.h"
+#endif
 
 #define sFLASH_SPI_PAGESIZE       0x100
 
+/* A single DMA transfer moves at most 65535 bytes, longer reads are split */
+#define sFLASH_READ_CHUNK_SIZE    0x8000
+
+/* Erases take tens of milliseconds up to seconds, the CPU is released between polls */
+#define sFLASH_ERASE_POLL_MS      1
+
+static int sflash_wait_ready( const sflash_handle_t* const handle, sflash_command_t cmd );
+
 int sflash_read_ID( const sflash_handle_t* const handle, void* const data_addr )
 {
     return generic_sflash_command( handle, SFLASH_READ_JEDEC_ID, 0, NULL, 3, NULL, data_addr );
@@ -120,11 +131,33 @@ int sflash_read_status_register( const sflash_handle_t* const handle, void* cons
 
 int sflash_read( const sflash_handle_t* const handle, unsigned long device_address, void* const data_addr, unsigned int size )
 {
-    char device_address_array[3] =  { ( ( device_address & 0x00FF0000 ) >> 16 ),
-                                      ( ( device_address & 0x0000FF00 ) >>  8 ),
-                                      ( ( device_address & 0x000000FF ) >>  0 ) };
+    int status;
+    unsigned int read_size;
+    unsigned char* data_addr_ptr = (unsigned char*) data_addr;
 
-    return generic_sflash_command( handle, SFLASH_READ, 3, device_address_array, size, NULL, data_addr );
+    while ( size > 0 )
+    {
+        /* FAST_READ needs one dummy byte after the address, but unlike READ it is
+         * specified for the full SPI clock on every supported part */
+        char device_address_array[4] =  { ( ( device_address & 0x00FF0000 ) >> 16 ),
+                                          ( ( device_address & 0x0000FF00 ) >>  8 ),
+                                          ( ( device_address & 0x000000FF ) >>  0 ),
+                                          SFLASH_DUMMY_BYTE };
+
+        read_size = ( size > sFLASH_READ_CHUNK_SIZE )? sFLASH_READ_CHUNK_SIZE : size;
+
+        status = generic_sflash_command( handle, SFLASH_FAST_READ, 4, device_address_array, read_size, NULL, data_addr_ptr );
+        if ( status != 0 )
+        {
+            return status;
+        }
+
+        data_addr_ptr  += read_size;
+        device_address += read_size;
+        size           -= read_size;
+    }
+
+    return 0;
 }
 
 
@@ -278,91 +311,40 @@ int sflash_write_page( const sflash_handle_t* const handle, unsigned long device
 }
 
 /**
-  * @brief  Writes block of data to the FLASH. In this function, the number of
-  *         WRITE cycles are reduced, using Page WRITE sequence.
-  * @param  pBuffer: pointer to the buffer  containing the data to be written
+  * @brief  Writes block of data to the FLASH. The data is streamed as a sequence
+  *         of page programs, each split at the page boundary so that a single
+  *         Page Program command never wraps inside a page.
+  * @param  device_address: FLASH's internal address to write to.
+  * @param  data_addr: pointer to the buffer containing the data to be written
   *         to the FLASH.
-  * @param  WriteAddr: FLASH's internal address to write to.
-  * @param  NumByteToWrite: number of bytes to write to the FLASH.
-  * @retval None
+  * @param  size: number of bytes to write to the FLASH.
+  * @retval 0 on success, the first failing command status otherwise
   */
 int sflash_write( const sflash_handle_t* const handle, unsigned long device_address, const void* const data_addr, unsigned int size )
 {
-  int status;
-  uint8_t NumOfPage = 0, NumOfSingle = 0, Addr = 0, count = 0, temp = 0;
+  int status = 0;
+  unsigned int write_size;
   unsigned char* data_addr_ptr = (unsigned char*) data_addr;
 
-  Addr = device_address % sFLASH_SPI_PAGESIZE;
-  count = sFLASH_SPI_PAGESIZE - Addr;
-  NumOfPage =  size / sFLASH_SPI_PAGESIZE;
-  NumOfSingle = size % sFLASH_SPI_PAGESIZE;
-
-  if (Addr == 0) /*!< WriteAddr is sFLASH_PAGESIZE aligned  */
-  {
-    if (NumOfPage == 0) /*!< NumByteToWrite < sFLASH_PAGESIZE */
-    {
-      status = sflash_write_page( handle, device_address, data_addr_ptr, size );
-      //sFLASH_WritePage(pBuffer, WriteAddr, NumByteToWrite);
-    }
-    else /*!< NumByteToWrite > sFLASH_PAGESIZE */
-    {
-      while (NumOfPage--)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, sFLASH_SPI_PAGESIZE );
-        //sFLASH_WritePage(pBuffer, WriteAddr, sFLASH_SPI_PAGESIZE);
-        device_address +=  sFLASH_SPI_PAGESIZE;
-        data_addr_ptr += sFLASH_SPI_PAGESIZE;
-      }
-
-      status = sflash_write_page( handle, device_address, data_addr_ptr, NumOfSingle);
-    }
-  }
-  else /*!< WriteAddr is not sFLASH_PAGESIZE aligned  */
+  while ( size > 0 )
   {
-    if (NumOfPage == 0) /*!< NumByteToWrite < sFLASH_PAGESIZE */
+    write_size = sFLASH_SPI_PAGESIZE - ( device_address % sFLASH_SPI_PAGESIZE );
+    if ( write_size > size )
     {
-      if (NumOfSingle > count) /*!< (NumByteToWrite + WriteAddr) > sFLASH_PAGESIZE */
-      {
-        temp = NumOfSingle - count;
-
-        status = sflash_write_page( handle, device_address, data_addr_ptr, count );
-        //sFLASH_WritePage(pBuffer, WriteAddr, count);
-        device_address +=  count;
-        data_addr_ptr += count;
-
-        status = sflash_write_page( handle, device_address, data_addr_ptr, temp);
-      }
-      else
-      {
-        status = sflash_write_page(handle, device_address, data_addr_ptr, size);
-      }
+      write_size = size;
     }
-    else /*!< NumByteToWrite > sFLASH_PAGESIZE */
+
+    status = sflash_write_page( handle, device_address, data_addr_ptr, (int) write_size );
+    if ( status != 0 )
     {
-      size -= count;
-      NumOfPage =  size / sFLASH_SPI_PAGESIZE;
-      NumOfSingle = size % sFLASH_SPI_PAGESIZE;
-
-      status = sflash_write_page( handle, device_address, data_addr_ptr, count );
-      //sFLASH_WritePage(pBuffer, WriteAddr, count);
-      device_address +=  count;
-      data_addr_ptr += count;
-
-      while (NumOfPage--)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, sFLASH_SPI_PAGESIZE );
-        //sFLASH_WritePage(pBuffer, WriteAddr, sFLASH_SPI_PAGESIZE);
-        device_address +=  sFLASH_SPI_PAGESIZE;
-        data_addr_ptr += sFLASH_SPI_PAGESIZE;
-      }
-
-      if (NumOfSingle != 0)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, NumOfSingle );
-        //sFLASH_WritePage(pBuffer, WriteAddr, NumOfSingle);
-      }
+      return status;
     }
+
+    device_address += write_size;
+    data_addr_ptr  += write_size;
+    size           -= write_size;
   }
+
   return status;
 }
 
@@ -432,6 +414,37 @@ static inline int is_write_command( sflash_command_t cmd )
 }
 
 
+static int sflash_wait_ready( const sflash_handle_t* const handle, sflash_command_t cmd )
+{
+    int status;
+    unsigned char status_register;
+
+    while ( 1 )
+    {
+        status = sflash_read_status_register( handle, &status_register );
+        if ( status != 0 )
+        {
+            return status;
+        }
+
+        if ( ( status_register & SFLASH_STATUS_REGISTER_BUSY ) == (unsigned char) 0 )
+        {
+            return 0;
+        }
+
+#ifndef NO_MICO_RTOS
+        /* A page program completes in about a millisecond and is polled back to back,
+         * sleeping a tick there would halve the write throughput */
+        if ( cmd != SFLASH_WRITE )
+        {
+            mico_thread_msleep( sFLASH_ERASE_POLL_MS );
+        }
+#else
+        UNUSED_PARAMETER( cmd );
+#endif
+    }
+}
+
 int generic_sflash_command(                                      const sflash_handle_t* const handle,
                                                                  sflash_command_t             cmd,
                                                                  unsigned long                num_initial_parameter_bytes,
@@ -463,20 +476,14 @@ int generic_sflash_command(                                      const sflash_ha
 
     if ( is_write_command( cmd ) == 1 )
     {
-        unsigned char status_register;
         /* write commands require waiting until chip is finished writing */
-
-        do
+        status = sflash_wait_ready( handle, cmd );
+        if ( status != 0 )
         {
-            status = sflash_read_status_register( handle, &status_register );
-            if ( status != 0 )
-            {
-                /*@-mustdefine@*/ /* Lint: do not need to define data_MISO due to failure */
-                return status;
-                /*@+mustdefine@*/
-            }
-        } while( ( status_register & SFLASH_STATUS_REGISTER_BUSY ) != (unsigned char) 0 );
-
+            /*@-mustdefine@*/ /* Lint: do not need to define data_MISO due to failure */
+            return status;
+            /*@+mustdefine@*/
+        }
     }
 
     /*@-mustdefine@*/ /* Lint: lint does not realise data_MISO was set by sflash_platform_send_recv */
@@ -50,7 +50,8 @@ size_t __write( int handle, const unsigned char * buffer, size_t size )
     return 0;
   }
 
-  MicoUartSend( STDIO_UART, (const char*)buffer, size );
+  /* Copied into the UART transmit queue so the caller does not wait for the wire */
+  MicoUartSendAsync( STDIO_UART, (const char*)buffer, size, NULL, NULL );
   
   return size;
 }
@@ -166,6 +166,16 @@ OSStatus platform_adc_take_sample_stream( const platform_adc_t* adc, void* buffe
     return kNotPreparedErr;
 }
 
+OSStatus platform_adc_take_sample_sequence( const platform_adc_t* const* adcs, uint8_t count, void* buffer, uint16_t buffer_length )
+{
+    UNUSED_PARAMETER(adcs);
+    UNUSED_PARAMETER(count);
+    UNUSED_PARAMETER(buffer);
+    UNUSED_PARAMETER(buffer_length);
+    platform_log("unimplemented");
+    return kNotPreparedErr;
+}
+
 OSStatus platform_adc_deinit( const platform_adc_t* adc )
 {
     UNUSED_PARAMETER(adc);
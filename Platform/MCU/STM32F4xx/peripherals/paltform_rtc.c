@@ -59,6 +59,10 @@ else \
 #define NUM_SECONDS_IN_MINUTE       ( 60 )
 #define NUM_SECONDS_IN_HOUR         ( 3600 )
 #define NUM_1P25MS_IN_SEC           ( 800 )
+#define NUM_MSEC_IN_SEC             ( 1000 )
+#define SMOOTH_CALIB_PULSES_2P20    ( 1048576 )   /* CALM counts RTCCLK pulses in 2^20 */
+#define SMOOTH_CALIB_PLUS_PULSES    ( 512 )       /* CALP adds 512 pulses in 2^20 */
+#define SMOOTH_CALIB_MINUS_MAX      ( 511 )
 
 /******************************************************
 *                   Enumerations
@@ -135,15 +139,24 @@ OSStatus platform_rtc_init(void)
 #ifdef MICO_ENABLE_MCU_RTC
   RTC_InitTypeDef RTC_InitStruct;
   
-  RTC_DeInit( );
-  
-  RTC_InitStruct.RTC_HourFormat = RTC_HourFormat_24;
-  
-  /* RTC ticks every second */
-  RTC_InitStruct.RTC_AsynchPrediv = 0x7F;
-  RTC_InitStruct.RTC_SynchPrediv = 0xFF;
-  
-  RTC_Init( &RTC_InitStruct );
+#ifdef USE_RTC_BKP
+  /* Keep a calendar that runs since an earlier boot, with its calibration,
+     the backup domain is not reset with the MCU */
+  RCC_APB1PeriphClockCmd(RCC_APB1Periph_PWR, ENABLE);
+  PWR_BackupAccessCmd(ENABLE);
+  if (RTC_ReadBackupRegister(RTC_BKP_DR0) != USE_RTC_BKP)
+#endif
+  {
+    RTC_DeInit( );
+    
+    RTC_InitStruct.RTC_HourFormat = RTC_HourFormat_24;
+    
+    /* RTC ticks every second */
+    RTC_InitStruct.RTC_AsynchPrediv = 0x7F;
+    RTC_InitStruct.RTC_SynchPrediv = 0xFF;
+    
+    RTC_Init( &RTC_InitStruct );
+  }
 
 #ifdef USE_RTC_BKP
   /* Enable the PWR clock */
@@ -265,6 +278,128 @@ OSStatus platform_rtc_set_time( const platform_rtc_time_t* time )
 #endif /* #ifdef MICO_ENABLE_MCU_RTC */
 }
 
+/**
+* Reads the time together with the milliseconds into the current second. The
+* sub-second register is read first, which locks the calendar shadow registers
+* until the date has been read, so all three belong to the same instant.
+*
+* @return    kNoErr : on success.
+*/
+OSStatus platform_rtc_get_time_ms( platform_rtc_time_t* time, uint16_t* msec )
+{
+#ifdef MICO_ENABLE_MCU_RTC
+  uint32_t prediv_s = RTC->PRER & RTC_PRER_PREDIV_S;
+  uint32_t ssr;
+  
+  if( time == 0 || msec == 0 )
+  {
+    return kParamErr;
+  }
+  
+  ssr = RTC_GetSubSecond( );
+  platform_rtc_get_time( time );
+  
+  /* a pending shift may leave SSR above PREDIV_S for a moment */
+  *msec = ( ssr > prediv_s ) ? 0 : (uint16_t)( ( prediv_s - ssr ) * NUM_MSEC_IN_SEC / ( prediv_s + 1 ) );
+  return kNoErr;
+#else /* #ifdef MICO_ENABLE_MCU_RTC */
+  UNUSED_PARAMETER(time);
+  UNUSED_PARAMETER(msec);
+  return kUnsupportedErr;
+#endif /* #ifdef MICO_ENABLE_MCU_RTC */
+}
+
+/**
+* Moves the calendar by less than a second with the shift register, the RTC
+* keeps counting, so nothing is lost as it is with platform_rtc_set_time().
+*
+* @return    kNoErr : on success.
+*/
+OSStatus platform_rtc_shift( int32_t msec )
+{
+#ifdef MICO_ENABLE_MCU_RTC
+  uint32_t prediv_s = RTC->PRER & RTC_PRER_PREDIV_S;
+  uint32_t add1s, subfs;
+  
+  if( ( msec <= -NUM_MSEC_IN_SEC ) || ( msec >= NUM_MSEC_IN_SEC ) )
+  {
+    return kRangeErr;
+  }
+  if( msec == 0 )
+  {
+    return kNoErr;
+  }
+  
+  /* SUBFS delays the clock by a fraction of a second, ADD1S advances it by one */
+  if( msec > 0 )
+  {
+    add1s = RTC_ShiftAdd1S_Set;
+    subfs = (uint32_t)( NUM_MSEC_IN_SEC - msec ) * ( prediv_s + 1 ) / NUM_MSEC_IN_SEC;
+  }
+  else
+  {
+    add1s = RTC_ShiftAdd1S_Reset;
+    subfs = (uint32_t)( -msec ) * ( prediv_s + 1 ) / NUM_MSEC_IN_SEC;
+  }
+  
+  return ( RTC_SynchroShiftConfig( add1s, subfs ) == SUCCESS ) ? kNoErr : kGeneralErr;
+#else /* #ifdef MICO_ENABLE_MCU_RTC */
+  UNUSED_PARAMETER(msec);
+  return kUnsupportedErr;
+#endif /* #ifdef MICO_ENABLE_MCU_RTC */
+}
+
+/**
+* Trims the RTC clock with smooth calibration, in steps of 2^-20 (0.954 ppm)
+* from -487 ppm to +488 ppm. It acts on the RTC clock itself, so it also holds
+* while the RTC is reprogrammed for STOP mode.
+*
+* @return    kNoErr : on success.
+*/
+OSStatus platform_rtc_set_calibration( int32_t ppb )
+{
+#ifdef MICO_ENABLE_MCU_RTC
+  int32_t pulses;
+  
+  /* round to the nearest pulse */
+  pulses = (int32_t)( ( (int64_t)ppb * SMOOTH_CALIB_PULSES_2P20 + ( ppb >= 0 ? 500000000 : -500000000 ) ) / 1000000000 );
+  if( ( pulses > SMOOTH_CALIB_PLUS_PULSES ) || ( pulses < -SMOOTH_CALIB_MINUS_MAX ) )
+  {
+    return kRangeErr;
+  }
+  
+  if( RTC_SmoothCalibConfig( RTC_SmoothCalibPeriod_32sec,
+                             ( pulses > 0 ) ? RTC_SmoothCalibPlusPulses_Set : RTC_SmoothCalibPlusPulses_Reset,
+                             (uint32_t)( ( pulses > 0 ) ? ( SMOOTH_CALIB_PLUS_PULSES - pulses ) : -pulses ) ) != SUCCESS )
+  {
+    return kGeneralErr;
+  }
+  return kNoErr;
+#else /* #ifdef MICO_ENABLE_MCU_RTC */
+  UNUSED_PARAMETER(ppb);
+  return kUnsupportedErr;
+#endif /* #ifdef MICO_ENABLE_MCU_RTC */
+}
+
+OSStatus platform_rtc_get_calibration( int32_t* ppb )
+{
+#ifdef MICO_ENABLE_MCU_RTC
+  int32_t pulses;
+  
+  if( ppb == 0 )
+  {
+    return kParamErr;
+  }
+  
+  pulses = ( ( RTC->CALR & RTC_CALR_CALP ) ? SMOOTH_CALIB_PLUS_PULSES : 0 ) - (int32_t)( RTC->CALR & RTC_CALR_CALM );
+  *ppb = (int32_t)( (int64_t)pulses * 1000000000 / SMOOTH_CALIB_PULSES_2P20 );
+  return kNoErr;
+#else /* #ifdef MICO_ENABLE_MCU_RTC */
+  UNUSED_PARAMETER(ppb);
+  return kUnsupportedErr;
+#endif /* #ifdef MICO_ENABLE_MCU_RTC */
+}
+
 OSStatus platform_rtc_enter_powersave ( void )
 {
 
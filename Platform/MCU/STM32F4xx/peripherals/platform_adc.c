@@ -37,6 +37,9 @@
  *                    Constants
  ******************************************************/
 
+#define ADC_SEQUENCE_MAX            16   /* regular sequence length of the STM32F4 ADC */
+#define ADC_DMA_TIMEOUT_MARGIN_MS   5
+
 /******************************************************
  *                   Enumerations
  ******************************************************/
@@ -73,6 +76,56 @@ static const uint16_t adc_sampling_cycle[] =
  *               Function Definitions
  ******************************************************/
 
+static void clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags )
+{
+    if ( stream <= DMA1_Stream3 )
+    {
+        DMA1->LIFCR |= flags;
+    }
+    else if ( stream <= DMA1_Stream7 )
+    {
+        DMA1->HIFCR |= flags;
+    }
+    else if ( stream <= DMA2_Stream3 )
+    {
+        DMA2->LIFCR |= flags;
+    }
+    else
+    {
+        DMA2->HIFCR |= flags;
+    }
+}
+
+static uint32_t get_dma_irq_status( DMA_Stream_TypeDef* stream )
+{
+    if ( stream <= DMA1_Stream3 )
+    {
+        return DMA1->LISR;
+    }
+    else if ( stream <= DMA1_Stream7 )
+    {
+        return DMA1->HISR;
+    }
+    else if ( stream <= DMA2_Stream3 )
+    {
+        return DMA2->LISR;
+    }
+    else
+    {
+        return DMA2->HISR;
+    }
+}
+
+/* Sampling time index programmed for the channel by platform_adc_init() */
+static uint8_t adc_channel_sample_time( const platform_adc_t* adc )
+{
+    if ( adc->channel > ADC_Channel_9 )
+    {
+        return (uint8_t)( ( adc->port->SMPR1 >> ( 3 * ( adc->channel - 10 ) ) ) & 0x7 );
+    }
+    return (uint8_t)( ( adc->port->SMPR2 >> ( 3 * adc->channel ) ) & 0x7 );
+}
+
 
 OSStatus platform_adc_init( const platform_adc_t* adc, uint32_t sample_cycle )
 {
@@ -156,20 +209,200 @@ exit:
     return err;
 }
 
+/* Runs the ADC in continuous (and, for more than one channel, scan) mode and
+ * lets the DMA stream move count conversions into buffer. The conversion
+ * sequence and mode registers are restored afterwards so single samples keep
+ * working. Each sample is ( sampling time + 12 ) ADC clocks, PCLK2 / 2, so a
+ * burst of a few dozen samples is over in tens of microseconds; longer bursts
+ * sleep for their expected duration before polling the completion flag. */
+static OSStatus adc_dma_burst( const platform_adc_t* const* adcs, uint8_t channels, uint16_t* buffer, uint16_t count )
+{
+    const platform_adc_t*  adc = adcs[0];
+    const platform_dma_config_t* dma = adc->dma;
+    DMA_InitTypeDef        dma_init_structure;
+    RCC_ClocksTypeDef      clocks;
+    uint32_t               cr1, cr2, sqr1, sqr2, sqr3;
+    uint32_t               status, cycles, expected_ms, start;
+    uint8_t                i, sample_time;
+    OSStatus               err = kNoErr;
+
+    require_action_quiet( dma != NULL, exit, err = kUnsupportedErr );
+    for ( i = 1; i < channels; i++ )
+    {
+        require_action_quiet( adcs[i]->port == adc->port, exit, err = kParamErr );
+    }
+
+    cr1  = adc->port->CR1;
+    cr2  = adc->port->CR2;
+    sqr1 = adc->port->SQR1;
+    sqr2 = adc->port->SQR2;
+    sqr3 = adc->port->SQR3;
+
+    /* Sequence: the sampling time chosen by platform_adc_init() is kept per channel */
+    cycles = 0;
+    for ( i = 0; i < channels; i++ )
+    {
+        sample_time = adc_channel_sample_time( adcs[i] );
+        cycles += adc_sampling_cycle[sample_time] + 12;
+        ADC_RegularChannelConfig( adc->port, adcs[i]->channel, i + 1, sample_time );
+    }
+    adc->port->SQR1 = ( adc->port->SQR1 & ~ADC_SQR1_L ) | ( (uint32_t)( channels - 1 ) << 20 );
+    if ( channels > 1 )
+    {
+        adc->port->CR1 |= ADC_CR1_SCAN;
+    }
+    else
+    {
+        adc->port->CR1 &= ~ADC_CR1_SCAN;
+    }
+    ADC_ContinuousModeCmd( adc->port, ENABLE );
+
+    if ( dma->controller == DMA1 )
+    {
+        RCC->AHB1ENR |= RCC_AHB1Periph_DMA1;
+    }
+    else
+    {
+        RCC->AHB1ENR |= RCC_AHB1Periph_DMA2;
+    }
+
+    DMA_DeInit( dma->stream );
+    dma_init_structure.DMA_Channel            = dma->channel;
+    dma_init_structure.DMA_PeripheralBaseAddr = (uint32_t)&adc->port->DR;
+    dma_init_structure.DMA_Memory0BaseAddr    = (uint32_t)buffer;
+    dma_init_structure.DMA_DIR                = DMA_DIR_PeripheralToMemory;
+    dma_init_structure.DMA_BufferSize         = count;
+    dma_init_structure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
+    dma_init_structure.DMA_MemoryInc          = DMA_MemoryInc_Enable;
+    dma_init_structure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    dma_init_structure.DMA_MemoryDataSize     = DMA_MemoryDataSize_HalfWord;
+    dma_init_structure.DMA_Mode               = DMA_Mode_Normal;
+    dma_init_structure.DMA_Priority           = DMA_Priority_High;
+    dma_init_structure.DMA_FIFOMode           = DMA_FIFOMode_Disable;
+    dma_init_structure.DMA_FIFOThreshold      = DMA_FIFOThreshold_Full;
+    dma_init_structure.DMA_MemoryBurst        = DMA_MemoryBurst_Single;
+    dma_init_structure.DMA_PeripheralBurst    = DMA_PeripheralBurst_Single;
+    DMA_Init( dma->stream, &dma_init_structure );
+    clear_dma_interrupts( dma->stream, dma->complete_flags | dma->error_flags );
+    DMA_Cmd( dma->stream, ENABLE );
+
+    ADC_ClearFlag( adc->port, ADC_FLAG_OVR | ADC_FLAG_EOC );
+    ADC_DMARequestAfterLastTransferCmd( adc->port, DISABLE );
+    ADC_DMACmd( adc->port, ENABLE );
+    ADC_SoftwareStartConv( adc->port );
+
+    RCC_GetClocksFreq( &clocks );
+    expected_ms = ( cycles * ( count / channels ) ) / ( clocks.PCLK2_Frequency / 2 / 1000 );
+    if ( expected_ms > 1 )
+    {
+        mico_thread_msleep( expected_ms );
+    }
+
+    start = mico_get_time( );
+    do
+    {
+        status = get_dma_irq_status( dma->stream ) & ( dma->complete_flags | dma->error_flags );
+    } while ( status == 0 && ( mico_get_time( ) - start ) <= expected_ms + ADC_DMA_TIMEOUT_MARGIN_MS );
+
+    if ( ( status & dma->complete_flags ) == 0 )
+    {
+        err = ( status != 0 ) ? kGeneralErr : kTimeoutErr;
+    }
+
+    /* Stop converting and put the single conversion setup back */
+    ADC_DMACmd( adc->port, DISABLE );
+    ADC_ContinuousModeCmd( adc->port, DISABLE );
+    DMA_Cmd( dma->stream, DISABLE );
+    clear_dma_interrupts( dma->stream, dma->complete_flags | dma->error_flags );
+    /* At most the conversion in flight is left, it takes a few microseconds */
+    start = mico_get_time( );
+    while ( ADC_GetFlagStatus( adc->port, ADC_FLAG_EOC ) == RESET && ( mico_get_time( ) - start ) < 2 )
+    {
+    }
+    (void) adc->port->DR;
+    adc->port->SQR1 = sqr1;
+    adc->port->SQR2 = sqr2;
+    adc->port->SQR3 = sqr3;
+    adc->port->CR1  = cr1;
+    adc->port->CR2  = cr2;
+    ADC_ClearFlag( adc->port, ADC_FLAG_OVR | ADC_FLAG_EOC | ADC_FLAG_STRT );
+
+exit:
+    return err;
+}
+
 OSStatus platform_adc_take_sample_stream( const platform_adc_t* adc, void* buffer, uint16_t buffer_length )
 {
-    UNUSED_PARAMETER(adc);
-    UNUSED_PARAMETER(buffer);
-    UNUSED_PARAMETER(buffer_length);
-    platform_log("unimplemented");
-    return kNotPreparedErr;
+    OSStatus    err = kNoErr;
+    uint16_t*   output = (uint16_t*)buffer;
+    uint16_t    i;
+
+    platform_mcu_powersave_disable();
+
+    require_action_quiet( adc != NULL && buffer != NULL, exit, err = kParamErr);
+    require_action_quiet( buffer_length >= sizeof(uint16_t) && ( (uint32_t)buffer & 0x1 ) == 0, exit, err = kParamErr );
+
+    if ( adc->dma != NULL )
+    {
+        err = adc_dma_burst( &adc, 1, output, buffer_length / sizeof(uint16_t) );
+    }
+    else
+    {
+        /* No DMA stream on this board, fall back to back to back polled conversions */
+        for ( i = 0; i < buffer_length / sizeof(uint16_t); i++ )
+        {
+            ADC_SoftwareStartConv( adc->port );
+            while ( ADC_GetFlagStatus( adc->port, ADC_FLAG_EOC ) == RESET )
+            {
+            }
+            output[i] = ADC_GetConversionValue( adc->port );
+        }
+    }
+
+exit:
+    platform_mcu_powersave_enable();
+    return err;
+}
+
+OSStatus platform_adc_take_sample_sequence( const platform_adc_t* const* adcs, uint8_t count, void* buffer, uint16_t buffer_length )
+{
+    OSStatus    err = kNoErr;
+    uint16_t    samples;
+
+    platform_mcu_powersave_disable();
+
+    require_action_quiet( adcs != NULL && buffer != NULL && count > 0, exit, err = kParamErr);
+    require_action_quiet( count <= ADC_SEQUENCE_MAX, exit, err = kSizeErr );
+    require_action_quiet( ( (uint32_t)buffer & 0x1 ) == 0, exit, err = kParamErr );
+
+    /* Whole scans only, the samples are interleaved in sequence order */
+    samples = ( buffer_length / sizeof(uint16_t) ) / count * count;
+    require_action_quiet( samples > 0, exit, err = kSizeErr );
+
+    err = adc_dma_burst( adcs, count, (uint16_t*)buffer, samples );
+
+exit:
+    platform_mcu_powersave_enable();
+    return err;
 }
 
 OSStatus platform_adc_deinit( const platform_adc_t* adc )
 {
-    UNUSED_PARAMETER(adc);
-    platform_log("unimplemented");
-    return kNotPreparedErr;
+    OSStatus    err = kNoErr;
+
+    platform_mcu_powersave_disable();
+
+    require_action_quiet( adc != NULL, exit, err = kParamErr);
+
+    if ( adc->dma != NULL )
+    {
+        DMA_DeInit( adc->dma->stream );
+    }
+    ADC_Cmd( adc->port, DISABLE );
+
+exit:
+    platform_mcu_powersave_enable();
+    return err;
 }
 
 
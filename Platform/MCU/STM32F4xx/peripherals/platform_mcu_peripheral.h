@@ -73,6 +73,16 @@ extern "C"
  /* SPI1 to SPI3 */
 #define NUMBER_OF_SPI_PORTS       (3)
 
+/* Buffers queued on a UART transmitter, must be a power of 2 */
+#ifndef UART_TX_QUEUE_DEPTH
+#define UART_TX_QUEUE_DEPTH       (8)
+#endif
+
+/* Bytes a UART can buffer for callers that transmit without a release callback */
+#ifndef UART_TX_FIFO_SIZE
+#define UART_TX_FIFO_SIZE         (256)
+#endif
+
 /******************************************************
  *                   Enumerations
  ******************************************************/
@@ -135,6 +145,7 @@ typedef struct
     uint32_t               adc_peripheral_clock;
     uint8_t                rank;
     const platform_gpio_t* pin;
+    const platform_dma_config_t* dma; /* NULL: streams use polled conversions */
 } platform_adc_t;
 
 typedef struct
@@ -144,6 +155,8 @@ typedef struct
     uint32_t               tim_peripheral_clock;
     uint8_t                gpio_af;
     const platform_gpio_t* pin;
+    const platform_dma_config_t* dma; /* NULL: no duty cycle streams */
+    uint16_t               dma_request; /* TIM_DMA_Update, or a TIM_DMA_CCx raised at the update event */
 } platform_pwm_t;
 
 
@@ -165,6 +178,15 @@ typedef struct
 {
     platform_spi_t*           peripheral;
     mico_mutex_t              spi_mutex;
+#ifndef NO_MICO_RTOS
+    mico_semaphore_t          transfer_complete;
+#endif
+    volatile OSStatus         last_transfer_result;
+    /* Configuration currently applied to the port, re-init is skipped when it matches */
+    const platform_gpio_t*    chip_select;
+    uint32_t                  speed;
+    uint8_t                   mode;
+    uint8_t                   bits;
 } platform_spi_driver_t;
 
 typedef struct
@@ -208,6 +230,14 @@ typedef struct
     platform_dma_config_t  rx_dma_config;
 } platform_uart_t;
 
+typedef struct
+{
+    const uint8_t*             data;
+    uint32_t                   size;
+    void                       (*release)( OSStatus result, void* arg ); /* NULL for data in tx_fifo */
+    void*                      arg;
+} platform_uart_tx_desc_t;
+
 typedef struct
 {
     platform_uart_t*           peripheral;
@@ -217,6 +247,17 @@ typedef struct
     mico_semaphore_t           tx_complete;
     mico_mutex_t               tx_mutex;
     mico_semaphore_t           sem_wakeup;
+    /* Transmit queue, the DMA sends tx_queue[tx_queue_head] and chains the next one */
+    mico_mutex_t               tx_queue_mutex;
+    mico_semaphore_t           tx_space;
+    mico_semaphore_t           tx_idle;
+    platform_uart_tx_desc_t    tx_queue[UART_TX_QUEUE_DEPTH];
+    volatile uint32_t          tx_queue_head;
+    volatile uint32_t          tx_queue_tail;
+    volatile bool              tx_active;
+    uint8_t                    tx_fifo[UART_TX_FIFO_SIZE];
+    uint32_t                   tx_fifo_tail;
+    volatile uint32_t          tx_fifo_used;
 #else
     volatile bool              rx_complete;
     volatile bool              tx_complete;
@@ -225,6 +266,15 @@ typedef struct
     volatile uint32_t          rx_size;
     volatile OSStatus          last_receive_result;
     volatile OSStatus          last_transmit_result;
+    /* Ring buffer receive statistics, see platform_uart_get_rx_statistics() */
+    volatile uint32_t          rx_irq_count;
+    volatile uint32_t          rx_bytes;
+    volatile uint32_t          rx_wake_cycles;
+    uint32_t                   rx_wakeups;
+    uint32_t                   rx_latency_max_us;
+    uint32_t                   rx_latency_total_us;
+    volatile uint32_t          rx_overruns;
+    volatile bool              rx_overrun;      /* Set by the interrupts, the receiving thread resynchronises */
 } platform_uart_driver_t;
 
 typedef struct
@@ -268,6 +318,7 @@ void     platform_uart_tx_dma_irq            ( platform_uart_driver_t* driver );
 void     platform_uart_rx_dma_irq            ( platform_uart_driver_t* driver );
 
 uint8_t  platform_spi_get_port_number        ( platform_spi_port_t* spi );
+void     platform_spi_rx_dma_irq             ( platform_spi_driver_t* driver );
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -106,6 +106,12 @@ static unsigned long rtc_timeout_start_time       = 0;
 static int32_t       stm32f2_clock_needed_counter = 0;
 #endif /* #ifndef MICO_DISABLE_MCU_POWERSAVE */
 
+/* Residency counters, see platform_mcu_powersave_get_statistics() */
+static uint64_t      powersave_sleep_counts       = 0; /* SysTick counts spent halted in WFI */
+static uint32_t      powersave_stop_ms            = 0;
+static uint32_t      powersave_stop_count         = 0;
+static uint32_t      powersave_stats_start        = 0;
+
 /******************************************************
  *               Function Definitions
  ******************************************************/
@@ -239,6 +245,53 @@ void platform_mcu_powersave_exit_notify( void )
 #endif
 }
 
+OSStatus platform_mcu_powersave_get_statistics( platform_mcu_powersave_stats_t* stats, bool reset )
+{
+  uint32_t now = mico_get_time( );
+  uint64_t sleep_counts;
+  uint32_t stop_ms, stop_count, start;
+
+  DISABLE_INTERRUPTS;
+  sleep_counts = powersave_sleep_counts;
+  stop_ms      = powersave_stop_ms;
+  stop_count   = powersave_stop_count;
+  start        = powersave_stats_start;
+  if ( reset )
+  {
+    powersave_sleep_counts = 0;
+    powersave_stop_ms      = 0;
+    powersave_stop_count   = 0;
+    powersave_stats_start  = now;
+  }
+  ENABLE_INTERRUPTS;
+
+  if ( stats != NULL )
+  {
+    stats->total_ms   = now - start;
+    /* one SysTick period is one RTOS tick, which is 1 ms */
+    stats->sleep_ms   = (uint32_t)( sleep_counts / ( SysTick->LOAD + 1 ) );
+    stats->stop_ms    = stop_ms;
+    stats->stop_count = stop_count;
+  }
+  return kNoErr;
+}
+
+/* WFI that adds the time the core was halted to the sleep counter. SysTick
+ * keeps running and its interrupt ends the WFI, so it wraps at most once. */
+static void powersave_wfi( void )
+{
+  uint32_t before, after;
+  bool wrapped;
+
+  (void) SysTick->CTRL; /* clears COUNTFLAG */
+  before = SysTick->VAL;
+  __asm("wfi");
+  after = SysTick->VAL;
+  wrapped = ( SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk ) != 0 || after > before;
+
+  powersave_sleep_counts += wrapped ? before + ( SysTick->LOAD + 1 ) - after : before - after;
+}
+
 
 #ifndef MICO_DISABLE_MCU_POWERSAVE
 static OSStatus select_wut_prescaler_calculate_wakeup_time( unsigned long* wakeup_time, unsigned long sleep_ms, unsigned long* scale_factor )
@@ -307,7 +360,7 @@ static OSStatus select_wut_prescaler_calculate_wakeup_time( unsigned long* wakeu
 
 void platform_idle_hook( void )
 {
-    __asm("wfi");
+    powersave_wfi( );
 }
 
 uint32_t platform_power_down_hook( uint32_t sleep_ms )
@@ -329,7 +382,7 @@ static unsigned long idle_power_down_hook( unsigned long sleep_ms  )
 {
     UNUSED_PARAMETER( sleep_ms );
     ENABLE_INTERRUPTS;
-    __asm("wfi");
+    powersave_wfi( );
     return 0;
 }
 #else
@@ -344,7 +397,7 @@ static unsigned long stop_mode_power_down_hook( unsigned long sleep_ms )
   
   if ( ( ( SCB->SCR & (unsigned long)SCB_SCR_SLEEPDEEP_Msk) != 0) && sleep_ms < 5 ){
     SCB->SCR &= (~((unsigned long)SCB_SCR_SLEEPDEEP_Msk));
-    __asm("wfi");
+    powersave_wfi( );
     SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
     /* Note: We return 0 ticks passed because system tick is still going when wfi instruction gets executed */
     ENABLE_INTERRUPTS;
@@ -396,6 +449,8 @@ static unsigned long stop_mode_power_down_hook( unsigned long sleep_ms )
     wut_ticks_passed = rtc_timeout_start_time - RTC_GetWakeUpCounter();
     UNUSED_VARIABLE(wut_ticks_passed);
     platform_rtc_exit_powersave( sleep_ms, (uint32_t *)&retval );
+    powersave_stop_ms += retval;
+    powersave_stop_count++;
     /* as soon as interrupts are enabled, we will go and execute the interrupt handler */
     /* which triggered a wake up event */
     ENABLE_INTERRUPTS;
@@ -406,7 +461,7 @@ static unsigned long stop_mode_power_down_hook( unsigned long sleep_ms )
   {
     UNUSED_PARAMETER(wut_ticks_passed);
     ENABLE_INTERRUPTS;
-    __asm("wfi");
+    powersave_wfi( );
     
     /* Note: We return 0 ticks passed because system tick is still going when wfi instruction gets executed */
     return 0;
@@ -59,6 +59,47 @@
 *               Function Definitions
 ******************************************************/
 
+static void clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags )
+{
+  if ( stream <= DMA1_Stream3 )
+  {
+    DMA1->LIFCR |= flags;
+  }
+  else if ( stream <= DMA1_Stream7 )
+  {
+    DMA1->HIFCR |= flags;
+  }
+  else if ( stream <= DMA2_Stream3 )
+  {
+    DMA2->LIFCR |= flags;
+  }
+  else
+  {
+    DMA2->HIFCR |= flags;
+  }
+}
+
+static volatile uint32_t* pwm_compare_register( const platform_pwm_t* pwm )
+{
+  switch ( pwm->channel )
+  {
+    case 1: return &pwm->tim->CCR1;
+    case 2: return &pwm->tim->CCR2;
+    case 3: return &pwm->tim->CCR3;
+    case 4: return &pwm->tim->CCR4;
+    default: return NULL;
+  }
+}
+
+static void pwm_stream_halt( const platform_pwm_t* pwm )
+{
+  TIM_DMACmd( pwm->tim, pwm->dma_request, DISABLE );
+  DMA_Cmd( pwm->dma->stream, DISABLE );
+  while ( ( pwm->dma->stream->CR & DMA_SxCR_EN ) != 0 )
+  {
+  }
+}
+
 OSStatus platform_pwm_init( const platform_pwm_t* pwm, uint32_t frequency, float duty_cycle )
 {
   TIM_TimeBaseInitTypeDef tim_time_base_structure;
@@ -181,6 +222,96 @@ exit:
   return err;
 }
 
+OSStatus platform_pwm_get_resolution( const platform_pwm_t* pwm, uint32_t* full )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( pwm != NULL && full != NULL, exit, err = kParamErr);
+
+  /* PWM1 mode keeps the output high while the counter is below the compare value */
+  *full = pwm->tim->ARR + 1;
+
+exit:
+  return err;
+}
+
+/* The stream writes the compare preload register at each update event, so a
+ * value becomes the duty cycle one PWM period after it was written and every
+ * period shows a complete pulse. The compare registers of TIM2 and TIM5 are
+ * 32 bit wide and the APB bridge replicates half-word writes, so the table is
+ * moved in words for every timer. */
+OSStatus platform_pwm_stream_start( const platform_pwm_t* pwm, const uint32_t* compare, uint16_t count, bool loop )
+{
+  DMA_InitTypeDef    dma_init_structure;
+  volatile uint32_t* ccr;
+  OSStatus           err = kNoErr;
+
+  platform_mcu_powersave_disable();
+
+  require_action_quiet( pwm != NULL && compare != NULL && count > 0, exit, err = kParamErr);
+  require_action_quiet( pwm->dma != NULL, exit, err = kUnsupportedErr);
+  ccr = pwm_compare_register( pwm );
+  require_action_quiet( ccr != NULL, exit, err = kParamErr);
+
+  if ( pwm->dma->controller == DMA1 )
+  {
+    RCC->AHB1ENR |= RCC_AHB1Periph_DMA1;
+  }
+  else
+  {
+    RCC->AHB1ENR |= RCC_AHB1Periph_DMA2;
+  }
+
+  pwm_stream_halt( pwm );
+
+  DMA_DeInit( pwm->dma->stream );
+  dma_init_structure.DMA_Channel            = pwm->dma->channel;
+  dma_init_structure.DMA_PeripheralBaseAddr = (uint32_t)ccr;
+  dma_init_structure.DMA_Memory0BaseAddr    = (uint32_t)compare;
+  dma_init_structure.DMA_DIR                = DMA_DIR_MemoryToPeripheral;
+  dma_init_structure.DMA_BufferSize         = count;
+  dma_init_structure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
+  dma_init_structure.DMA_MemoryInc          = DMA_MemoryInc_Enable;
+  dma_init_structure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+  dma_init_structure.DMA_MemoryDataSize     = DMA_MemoryDataSize_Word;
+  dma_init_structure.DMA_Mode               = loop ? DMA_Mode_Circular : DMA_Mode_Normal;
+  dma_init_structure.DMA_Priority           = DMA_Priority_Low;
+  dma_init_structure.DMA_FIFOMode           = DMA_FIFOMode_Disable;
+  dma_init_structure.DMA_FIFOThreshold      = DMA_FIFOThreshold_Full;
+  dma_init_structure.DMA_MemoryBurst        = DMA_MemoryBurst_Single;
+  dma_init_structure.DMA_PeripheralBurst    = DMA_PeripheralBurst_Single;
+  DMA_Init( pwm->dma->stream, &dma_init_structure );
+  clear_dma_interrupts( pwm->dma->stream, pwm->dma->complete_flags | pwm->dma->error_flags );
+  DMA_Cmd( pwm->dma->stream, ENABLE );
+
+  if ( pwm->dma_request != TIM_DMA_Update )
+  {
+    /* compare DMA requests are raised at the update event instead */
+    TIM_SelectCCDMA( pwm->tim, ENABLE );
+  }
+  TIM_DMACmd( pwm->tim, pwm->dma_request, ENABLE );
+
+exit:
+  platform_mcu_powersave_enable();
+  return err;
+}
+
+OSStatus platform_pwm_stream_stop( const platform_pwm_t* pwm )
+{
+  OSStatus err = kNoErr;
+
+  platform_mcu_powersave_disable();
+
+  require_action_quiet( pwm != NULL, exit, err = kParamErr);
+  require_action_quiet( pwm->dma != NULL, exit, err = kUnsupportedErr);
+
+  pwm_stream_halt( pwm );
+  clear_dma_interrupts( pwm->dma->stream, pwm->dma->complete_flags | pwm->dma->error_flags );
+
+exit:
+  platform_mcu_powersave_enable();
+  return err;
+}
 
 
 
@@ -37,6 +37,17 @@
 *                    Constants
 ******************************************************/
 #define MAX_NUM_SPI_PRESCALERS     (8)
+#define SPI_DMA_TIMEOUT_MS         (100)
+#define SPI_DMA_INTERRUPT_FLAGS    ( DMA_IT_TC | DMA_IT_TE | DMA_IT_DME )
+
+/* Segments shorter than this complete faster than a context switch, they are polled */
+#define SPI_DMA_IRQ_MIN_LENGTH     (64)
+
+/* The board opts in by defining USE_MICO_SPI_DMA_IRQ and routing the RX DMA stream
+ * interrupt to platform_spi_rx_dma_irq() */
+#if defined ( USE_MICO_SPI_DMA_IRQ ) && !defined ( NO_MICO_RTOS )
+#define SPI_DMA_USE_IRQ
+#endif
 
 /******************************************************
 *                   Enumerations
@@ -61,7 +72,7 @@ typedef struct
 
 static OSStatus calculate_prescaler( uint32_t speed, uint16_t* prescaler );
 static uint16_t spi_transfer       ( const platform_spi_t* spi, uint16_t data );
-static OSStatus spi_dma_transfer   ( const platform_spi_t* spi, const platform_spi_config_t* config );
+static OSStatus spi_dma_transfer   ( platform_spi_driver_t* driver, uint32_t length );
 static void     spi_dma_config     ( const platform_spi_t* spi, const platform_spi_message_segment_t* message );
 
 /******************************************************
@@ -102,6 +113,26 @@ uint8_t platform_spi_get_port_number( platform_spi_port_t* spi )
   }
 }
 
+static void clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags )
+{
+    if ( stream <= DMA1_Stream3 )
+    {
+        DMA1->LIFCR |= flags;
+    }
+    else if ( stream <= DMA1_Stream7 )
+    {
+        DMA1->HIFCR |= flags;
+    }
+    else if ( stream <= DMA2_Stream3 )
+    {
+        DMA2->LIFCR |= flags;
+    }
+    else
+    {
+        DMA2->HIFCR |= flags;
+    }
+}
+
 static uint32_t get_dma_irq_status( DMA_Stream_TypeDef* stream )
 {
     if ( stream <= DMA1_Stream3 )
@@ -125,12 +156,24 @@ static uint32_t get_dma_irq_status( DMA_Stream_TypeDef* stream )
 OSStatus platform_spi_init( platform_spi_driver_t* driver, const platform_spi_t* peripheral, const platform_spi_config_t* config )
 {
   SPI_InitTypeDef   spi_init;
-  OSStatus          err;
+  OSStatus          err = kNoErr;
   
   platform_mcu_powersave_disable();
   
   require_action_quiet( ( driver != NULL ) && ( peripheral != NULL ) && ( config != NULL ), exit, err = kParamErr);
 
+  /* MicoSpiTransfer applies the device configuration before every transfer, the full
+   * SPI/GPIO/DMA re-initialisation is only needed when it has actually changed */
+  if ( ( driver->peripheral  == peripheral          ) &&
+       ( driver->chip_select == config->chip_select ) &&
+       ( driver->speed       == config->speed       ) &&
+       ( driver->mode        == config->mode        ) &&
+       ( driver->bits        == config->bits        ) )
+  {
+    goto exit;
+  }
+  driver->chip_select = NULL;
+
 /* Calculate prescaler */
   err = calculate_prescaler( config->speed, &spi_init.SPI_BaudRatePrescaler );
   require_noerr(err, exit);
@@ -235,8 +278,22 @@ OSStatus platform_spi_init( platform_spi_driver_t* driver, const platform_spi_t*
     }
     SPI_I2S_DMACmd( peripheral->port, SPI_I2S_DMAReq_Rx, ENABLE );
     SPI_I2S_DMACmd( peripheral->port, SPI_I2S_DMAReq_Tx, ENABLE );
+
+#ifdef SPI_DMA_USE_IRQ
+    if ( driver->transfer_complete == NULL )
+    {
+      err = mico_rtos_init_semaphore( &driver->transfer_complete, 1 );
+      require_noerr( err, exit );
+    }
+    NVIC_EnableIRQ( peripheral->rx_dma.irq_vector );
+#endif
   }
 
+  driver->chip_select = config->chip_select;
+  driver->speed       = config->speed;
+  driver->mode        = config->mode;
+  driver->bits        = config->bits;
+
 exit:
   platform_mcu_powersave_enable();
   return err;
@@ -275,7 +332,7 @@ OSStatus platform_spi_transfer( platform_spi_driver_t* driver, const platform_sp
         
         spi_dma_config( driver->peripheral, &segments[ i ] );
       
-        err = spi_dma_transfer( driver->peripheral, config );
+        err = spi_dma_transfer( driver, segments[ i ].length );
         require_noerr(err, cleanup_transfer);
       }
     }
@@ -387,19 +444,73 @@ exit:
   return err;
 }
 
-static OSStatus spi_dma_transfer( const platform_spi_t* spi, const platform_spi_config_t* config )
-{  
+static OSStatus spi_dma_transfer( platform_spi_driver_t* driver, uint32_t length )
+{
+  const platform_spi_t* spi = driver->peripheral;
+  OSStatus              err = kNoErr;
+
+#ifdef SPI_DMA_USE_IRQ
+  if ( length >= SPI_DMA_IRQ_MIN_LENGTH )
+  {
+    /* A transfer that timed out may still have completed afterwards, drop its
+     * late token so it cannot end this transfer early */
+    while ( mico_rtos_get_semaphore( &driver->transfer_complete, 0 ) == kNoErr )
+    {
+    }
+
+    driver->last_transfer_result = kNoErr;
+    DMA_ITConfig( spi->rx_dma.stream, SPI_DMA_INTERRUPT_FLAGS, ENABLE );
+
+    DMA_Cmd( spi->rx_dma.stream, ENABLE );
+    DMA_Cmd( spi->tx_dma.stream, ENABLE );
+
+    /* Sleep until the RX stream has received the last byte, other threads run meanwhile */
+    err = mico_rtos_get_semaphore( &driver->transfer_complete, SPI_DMA_TIMEOUT_MS );
+    if ( err != kNoErr )
+    {
+      DMA_ITConfig( spi->rx_dma.stream, SPI_DMA_INTERRUPT_FLAGS, DISABLE );
+      DMA_Cmd( spi->tx_dma.stream, DISABLE );
+      DMA_Cmd( spi->rx_dma.stream, DISABLE );
+      return kTimeoutErr;
+    }
+    return driver->last_transfer_result;
+  }
+#else
+  UNUSED_PARAMETER( length );
+#endif
+
   /* Enable dma channels that have just been configured */
   DMA_Cmd( spi->rx_dma.stream, ENABLE );
   DMA_Cmd( spi->tx_dma.stream, ENABLE );
   
-  /* Wait for DMA to complete */
-  /* TODO: This should wait on a semaphore that is triggered from an IRQ */  
+  /* Short transfer, poll for completion */
   while ( ( get_dma_irq_status( spi->rx_dma.stream ) & spi->rx_dma.complete_flags ) == 0  )
   {
   }
 
-  return kNoErr;
+  return err;
+}
+
+void platform_spi_rx_dma_irq( platform_spi_driver_t* driver )
+{
+  const platform_spi_t* spi    = driver->peripheral;
+  uint32_t              status;
+
+  if ( spi == NULL )
+  {
+    return;
+  }
+
+  status = get_dma_irq_status( spi->rx_dma.stream );
+  clear_dma_interrupts( spi->rx_dma.stream, spi->rx_dma.complete_flags | spi->rx_dma.error_flags );
+  DMA_ITConfig( spi->rx_dma.stream, SPI_DMA_INTERRUPT_FLAGS, DISABLE );
+
+  driver->last_transfer_result = ( status & spi->rx_dma.complete_flags ) ? kNoErr : kGeneralErr;
+
+#ifdef SPI_DMA_USE_IRQ
+  /* Set semaphore regardless of result to prevent waiting thread from locking up */
+  mico_rtos_set_semaphore( &driver->transfer_complete );
+#endif
 }
 
 static void spi_dma_config( const platform_spi_t* spi, const platform_spi_message_segment_t* message )
@@ -30,6 +30,7 @@
 */ 
 #include "platform.h"
 #include "platform_peripheral.h"
+#include "mico_platform.h"
 #include "debug.h"
 
 /******************************************************
@@ -38,6 +39,9 @@
 
 #define DMA_INTERRUPT_FLAGS  ( DMA_IT_TC | DMA_IT_TE | DMA_IT_DME | DMA_IT_FE )
 
+/* In the DMA status registers each stream's half transfer flag sits one bit below its transfer complete flag */
+#define DMA_HALF_FLAGS( complete_flags )  ( (complete_flags) >> 1 )
+
 /******************************************************
 *                   Enumerations
 ******************************************************/
@@ -115,6 +119,9 @@ static const IRQn_Type uart_irq_vectors[NUMBER_OF_UART_PORTS] =
 static OSStatus receive_bytes       ( platform_uart_driver_t* driver, void* data, uint32_t size, uint32_t timeout );
 static uint32_t get_dma_irq_status  ( DMA_Stream_TypeDef* stream );
 static void     clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags );
+static void     update_rx_tail      ( platform_uart_driver_t* driver );
+static uint32_t rx_used_space       ( platform_uart_driver_t* driver );
+static void     notify_rx_waiter    ( platform_uart_driver_t* driver );
 
 /* Interrupt service functions - called from interrupt vector table */
 #ifndef NO_MICO_RTOS
@@ -144,12 +151,26 @@ OSStatus platform_uart_init( platform_uart_driver_t* driver, const platform_uart
   driver->tx_size              = 0;
   driver->last_transmit_result = kNoErr;
   driver->last_receive_result  = kNoErr;
+  driver->rx_overrun           = false;
   driver->peripheral           = (platform_uart_t*)peripheral;
+  platform_uart_get_rx_statistics( driver, NULL, true );
 #ifndef NO_MICO_RTOS
+  /* The cycle counter times receiver wake-ups for the statistics */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+
   mico_rtos_init_semaphore( &driver->tx_complete, 1 );
   mico_rtos_init_semaphore( &driver->rx_complete, 1 );
   mico_rtos_init_semaphore( &driver->sem_wakeup,  1 );
   mico_rtos_init_mutex    ( &driver->tx_mutex );
+  mico_rtos_init_mutex    ( &driver->tx_queue_mutex );
+  mico_rtos_init_semaphore( &driver->tx_space, 1 );
+  mico_rtos_init_semaphore( &driver->tx_idle,  1 );
+  driver->tx_queue_head = 0;
+  driver->tx_queue_tail = 0;
+  driver->tx_active     = false;
+  driver->tx_fifo_tail  = 0;
+  driver->tx_fifo_used  = 0;
 #else
   driver->tx_complete = false;
   driver->rx_complete = false;
@@ -313,10 +334,18 @@ OSStatus platform_uart_init( platform_uart_driver_t* driver, const platform_uart
     /* Note that the ring_buffer should've been initialised first */
     driver->rx_buffer = optional_ring_buffer;
     driver->rx_size   = 0;
+
+    /* Ring buffer progress comes from the half/full transfer and USART idle-line interrupts */
+    NVIC_EnableIRQ( peripheral->rx_dma_config.irq_vector );
+    clear_dma_interrupts( peripheral->rx_dma_config.stream, DMA_HALF_FLAGS( peripheral->rx_dma_config.complete_flags ) | peripheral->rx_dma_config.complete_flags | peripheral->rx_dma_config.error_flags );
+    DMA_ITConfig( peripheral->rx_dma_config.stream, DMA_IT_HT | DMA_IT_TC | DMA_IT_TE, ENABLE );
+
     receive_bytes( driver, optional_ring_buffer->buffer, optional_ring_buffer->size, 0 );
   }
   else
   {
+    driver->rx_buffer = NULL;
+
     /* Not using ring buffer. Configure RX DMA interrupt on Cortex-M3 */
     NVIC_EnableIRQ( peripheral->rx_dma_config.irq_vector );
 
@@ -339,6 +368,9 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver )
 
   require_action_quiet( ( driver != NULL ), exit, err = kParamErr);
 
+  /* Let queued transmissions finish before the DMA stream goes away */
+  platform_uart_transmit_flush( driver, MICO_NEVER_TIMEOUT );
+
   uart_number = platform_uart_get_port_number( driver->peripheral->port );
 
   /* Disable USART */
@@ -367,6 +399,7 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver )
    **************************************************************************/
 
   USART_ITConfig( driver->peripheral->port, USART_IT_RXNE, DISABLE );
+  USART_ITConfig( driver->peripheral->port, USART_IT_IDLE, DISABLE );
 
   /* Disable UART interrupt vector on Cortex-M3 */
   NVIC_DisableIRQ( driver->peripheral->rx_dma_config.irq_vector );
@@ -378,6 +411,9 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver )
   mico_rtos_deinit_semaphore( &driver->rx_complete );
   mico_rtos_deinit_semaphore( &driver->tx_complete );
   mico_rtos_deinit_mutex( &driver->tx_mutex );
+  mico_rtos_deinit_mutex( &driver->tx_queue_mutex );
+  mico_rtos_deinit_semaphore( &driver->tx_space );
+  mico_rtos_deinit_semaphore( &driver->tx_idle );
 #else
   driver->rx_complete = false;
   driver->tx_complete = false;
@@ -392,15 +428,181 @@ exit:
     return err;
 }
 
+#ifndef NO_MICO_RTOS
+/* Program the DMA with the descriptor at the head of the queue if the transmitter is idle.
+ * Called from the TX DMA interrupt or with interrupts disabled. */
+static void start_next_transmit( platform_uart_driver_t* driver )
+{
+  const platform_uart_tx_desc_t* desc;
+
+  if ( driver->tx_active || driver->tx_queue_head == driver->tx_queue_tail )
+    return;
+
+  desc = &driver->tx_queue[ driver->tx_queue_head % UART_TX_QUEUE_DEPTH ];
+  driver->tx_active = true;
+
+  /* Clear interrupt status before enabling DMA otherwise error occurs immediately */
+  clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.complete_flags | driver->peripheral->tx_dma_config.error_flags );
+
+  driver->peripheral->tx_dma_config.stream->CR   &= ~(uint32_t) DMA_SxCR_CIRC;
+  driver->peripheral->tx_dma_config.stream->NDTR  = desc->size;
+  driver->peripheral->tx_dma_config.stream->M0AR  = (uint32_t)desc->data;
+
+  driver->peripheral->port->CR3 |= USART_CR3_DMAT;
+  USART_ClearFlag( driver->peripheral->port, USART_FLAG_TC );
+  driver->peripheral->tx_dma_config.stream->CR   |= DMA_SxCR_EN;
+}
+
+/* Append a descriptor and kick the DMA. Caller holds tx_queue_mutex and has checked the queue has room.
+ * Data in tx_fifo that directly follows a descriptor the DMA has not started yet is merged into it,
+ * so byte-at-a-time writers such as fputc() do not use a descriptor and an interrupt per byte. */
+static void tx_queue_push( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size, platform_uart_tx_callback_t release, void* arg )
+{
+  platform_uart_tx_desc_t* last;
+  uint32_t                 started;
+
+  platform_mcu_powersave_disable();
+
+  DISABLE_INTERRUPTS;
+  started = driver->tx_active ? 1 : 0;
+  last    = &driver->tx_queue[ ( driver->tx_queue_tail - 1 ) % UART_TX_QUEUE_DEPTH ];
+
+  if ( release == NULL )
+  {
+    driver->tx_fifo_used += size;
+  }
+
+  if ( release == NULL && driver->tx_queue_tail - driver->tx_queue_head > started
+       && last->release == NULL && last->data + last->size == data )
+  {
+    last->size += size;
+    ENABLE_INTERRUPTS;
+    /* No new descriptor, so no completion to re-enable powersave */
+    platform_mcu_powersave_enable();
+    return;
+  }
+
+  last = &driver->tx_queue[ driver->tx_queue_tail % UART_TX_QUEUE_DEPTH ];
+  last->data    = data;
+  last->size    = size;
+  last->release = release;
+  last->arg     = arg;
+  driver->tx_queue_tail++;
+
+  start_next_transmit( driver );
+  ENABLE_INTERRUPTS;
+}
+
+static void transmit_complete( OSStatus result, void* arg )
+{
+  platform_uart_driver_t* driver = (platform_uart_driver_t*)arg;
+
+  driver->last_transmit_result = result;
+  mico_rtos_set_semaphore( &driver->tx_complete );
+}
+
+OSStatus platform_uart_transmit_bytes_async( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size, platform_uart_tx_callback_t release, void* arg )
+{
+  OSStatus err = kNoErr;
+  uint32_t chunk;
+
+  require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
+
+  /* Hold the queue for the whole message so concurrent writers do not interleave */
+  mico_rtos_lock_mutex( &driver->tx_queue_mutex );
+
+  while ( size > 0 )
+  {
+    /* Wait for a free descriptor and, when copying, contiguous room in the FIFO.
+     * Only the interrupt releases either, so a stale token just costs one more check. */
+    for ( ;; )
+    {
+      chunk = 0;
+      if ( driver->tx_queue_tail - driver->tx_queue_head < UART_TX_QUEUE_DEPTH )
+      {
+        chunk = ( release != NULL ) ? size : MIN( UART_TX_FIFO_SIZE - driver->tx_fifo_used, UART_TX_FIFO_SIZE - driver->tx_fifo_tail );
+      }
+      if ( chunk != 0 )
+        break;
+      mico_rtos_get_semaphore( &driver->tx_space, MICO_NEVER_TIMEOUT );
+    }
+
+    if ( release != NULL )
+    {
+      tx_queue_push( driver, data_out, size, release, arg );
+      break;
+    }
+
+    chunk = MIN( chunk, size );
+    memcpy( &driver->tx_fifo[ driver->tx_fifo_tail ], data_out, chunk );
+    tx_queue_push( driver, &driver->tx_fifo[ driver->tx_fifo_tail ], chunk, NULL, NULL );
+    driver->tx_fifo_tail = ( driver->tx_fifo_tail + chunk ) % UART_TX_FIFO_SIZE;
+    data_out += chunk;
+    size     -= chunk;
+  }
+
+  mico_rtos_unlock_mutex( &driver->tx_queue_mutex );
+
+exit:
+  return err;
+}
+
 OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size )
 {
   OSStatus err = kNoErr;
 
-  platform_mcu_powersave_disable();
-  
-#ifndef NO_MICO_RTOS
+  require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
+
+  /* tx_complete and last_transmit_result belong to one synchronous caller at a time */
   mico_rtos_lock_mutex( &driver->tx_mutex );
-#endif
+
+  /* Send in place behind anything already queued, and return once the DMA is done with the buffer */
+  err = platform_uart_transmit_bytes_async( driver, data_out, size, transmit_complete, driver );
+  if ( err == kNoErr )
+  {
+    mico_rtos_get_semaphore( &driver->tx_complete, MICO_NEVER_TIMEOUT );
+    err = driver->last_transmit_result;
+  }
+
+  mico_rtos_unlock_mutex( &driver->tx_mutex );
+
+exit:
+  return err;
+}
+
+OSStatus platform_uart_transmit_flush( platform_uart_driver_t* driver, uint32_t timeout_ms )
+{
+  OSStatus err = kNoErr;
+  uint32_t start = mico_get_time( );
+  uint32_t elapsed;
+
+  require_action_quiet( ( driver != NULL ), exit, err = kParamErr);
+
+  while ( driver->tx_active || driver->tx_queue_head != driver->tx_queue_tail )
+  {
+    elapsed = mico_get_time( ) - start;
+    require_action_quiet( timeout_ms == MICO_NEVER_TIMEOUT || elapsed < timeout_ms, exit, err = kTimeoutErr );
+    mico_rtos_get_semaphore( &driver->tx_idle, ( timeout_ms == MICO_NEVER_TIMEOUT ) ? MICO_NEVER_TIMEOUT : timeout_ms - elapsed );
+  }
+  /* Pass the wake-up on in case another thread is flushing too */
+  mico_rtos_set_semaphore( &driver->tx_idle );
+
+  /* The last byte has been handed to the USART, wait for it to leave the shift register */
+  while ( ( driver->peripheral->port->SR & USART_SR_TC ) == 0 )
+  {
+  }
+
+exit:
+  return err;
+}
+
+#else /* NO_MICO_RTOS */
+
+OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size )
+{
+  OSStatus err = kNoErr;
+
+  platform_mcu_powersave_disable();
 
   require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
 
@@ -418,13 +620,9 @@ OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uin
   USART_ClearFlag( driver->peripheral->port, USART_FLAG_TC );
   driver->peripheral->tx_dma_config.stream->CR   |= DMA_SxCR_EN;
   
-/* Wait for transmission complete */
-#ifndef NO_MICO_RTOS
-  mico_rtos_get_semaphore( &driver->tx_complete, MICO_NEVER_TIMEOUT );
-#else 
+  /* Wait for transmission complete */
   while( driver->tx_complete == false );
   driver->tx_complete = false;
-#endif
 
   while ( ( driver->peripheral->port->SR & USART_SR_TC ) == 0 )
   {
@@ -436,13 +634,29 @@ OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uin
   err = driver->last_transmit_result;
 
 exit:  
-#ifndef NO_MICO_RTOS  
-  mico_rtos_unlock_mutex( &driver->tx_mutex );
-#endif
   platform_mcu_powersave_enable();
   return err;
 }
 
+/* Without an RTOS there is nothing to overlap with, so queued sends complete before returning */
+OSStatus platform_uart_transmit_bytes_async( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size, platform_uart_tx_callback_t release, void* arg )
+{
+  OSStatus err = platform_uart_transmit_bytes( driver, data_out, size );
+
+  if ( release != NULL )
+    release( err, arg );
+  return err;
+}
+
+OSStatus platform_uart_transmit_flush( platform_uart_driver_t* driver, uint32_t timeout_ms )
+{
+  UNUSED_PARAMETER( driver );
+  UNUSED_PARAMETER( timeout_ms );
+  return kNoErr;
+}
+
+#endif /* NO_MICO_RTOS */
+
 OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t expected_data_size, uint32_t timeout_ms )
 {
   OSStatus err = kNoErr;
@@ -457,14 +671,22 @@ OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* d
     {
       uint32_t transfer_size = MIN( driver->rx_buffer->size / 2, expected_data_size );
       
+      driver->last_receive_result = kNoErr;
+
       /* Check if ring buffer already contains the required amount of data. */
-      if ( transfer_size > ring_buffer_used_space( driver->rx_buffer ) )
+#ifndef NO_MICO_RTOS
+      while ( transfer_size > rx_used_space( driver ) )
       {
         /* Set rx_size and wait in rx_complete semaphore until data reaches rx_size or timeout occurs */
-        driver->last_receive_result = kNoErr;
-        driver->rx_size             = transfer_size;
-        
-#ifndef NO_MICO_RTOS
+        driver->rx_size = transfer_size;
+
+        /* Data that landed before rx_size was set raises no further interrupt, so look again */
+        if ( transfer_size <= rx_used_space( driver ) )
+        {
+          driver->rx_size = 0;
+          break;
+        }
+
         err = mico_rtos_get_semaphore( &driver->rx_complete, timeout_ms );
 
         /* Reset rx_size to prevent semaphore being set while nothing waits for the data */
@@ -472,35 +694,36 @@ OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* d
 
         if( err != kNoErr )
           goto exit;
-#else
-        driver->rx_complete = false;
-        int delay_start = mico_get_time_no_os();
-        while(driver->rx_complete == false){
-          if(mico_get_time_no_os() >= delay_start + timeout_ms && timeout_ms != MICO_NEVER_TIMEOUT){
-            driver->rx_size = 0;
-            err = kTimeoutErr;
-            goto exit;
+
+        /* A token left by an earlier wake-up just loops round and checks again */
+        if ( driver->rx_wake_cycles != 0 )
+        {
+          uint32_t latency_us = ( DWT->CYCCNT - driver->rx_wake_cycles ) / ( SystemCoreClock / 1000000 );
+
+          driver->rx_wake_cycles       = 0;
+          driver->rx_wakeups++;
+          driver->rx_latency_total_us += latency_us;
+          if ( latency_us > driver->rx_latency_max_us )
+          {
+            driver->rx_latency_max_us = latency_us;
           }
         }
-        driver->rx_size = 0;
-#endif
       }
+#else
+      int delay_start = mico_get_time_no_os();
+      while ( transfer_size > rx_used_space( driver ) )
+      {
+        if(mico_get_time_no_os() >= delay_start + timeout_ms && timeout_ms != MICO_NEVER_TIMEOUT){
+          err = kTimeoutErr;
+          goto exit;
+        }
+      }
+#endif
       err = driver->last_receive_result;
       expected_data_size -= transfer_size;
       
-      // Grab data from the buffer
-      do
-      {
-        uint8_t* available_data;
-        uint32_t bytes_available;
-        
-        ring_buffer_get_data( driver->rx_buffer, &available_data, &bytes_available );
-        bytes_available = MIN( bytes_available, transfer_size );
-        memcpy( data_in, available_data, bytes_available );
-        transfer_size -= bytes_available;
-        data_in = ( (uint8_t*) data_in + bytes_available );
-        ring_buffer_consume( driver->rx_buffer, bytes_available );
-      } while ( transfer_size != 0 );
+      // Grab data from the buffer, both segments in one go
+      data_in = ( (uint8_t*) data_in + ring_buffer_read( driver->rx_buffer, data_in, transfer_size ) );
     }
   }
   else
@@ -520,9 +743,11 @@ static OSStatus receive_bytes( platform_uart_driver_t* driver, void* data, uint3
   {
     driver->peripheral->rx_dma_config.stream->CR |= DMA_SxCR_CIRC;
     
-    // Enabled individual byte interrupts so progress can be updated
-    USART_ClearITPendingBit( driver->peripheral->port, USART_IT_RXNE );
-    USART_ITConfig( driver->peripheral->port, USART_IT_RXNE, ENABLE );
+    // A quiet line marks the end of a frame, so progress is updated per frame rather than per byte
+    USART_ITConfig( driver->peripheral->port, USART_IT_RXNE, DISABLE );
+    (void) driver->peripheral->port->SR;
+    (void) driver->peripheral->port->DR;
+    USART_ITConfig( driver->peripheral->port, USART_IT_IDLE, ENABLE );
   }
   else
   {
@@ -556,9 +781,108 @@ static OSStatus receive_bytes( platform_uart_driver_t* driver, void* data, uint3
 
 uint32_t platform_uart_get_length_in_buffer( platform_uart_driver_t* driver )
 {  
+  return rx_used_space( driver );
+}
+
+OSStatus platform_uart_get_rx_statistics( platform_uart_driver_t* driver, platform_uart_rx_stats_t* stats, bool reset )
+{
+  if ( stats != NULL )
+  {
+    stats->irq_count        = driver->rx_irq_count;
+    stats->bytes            = driver->rx_bytes;
+    stats->wakeups          = driver->rx_wakeups;
+    stats->latency_max_us   = driver->rx_latency_max_us;
+    stats->latency_total_us = driver->rx_latency_total_us;
+    stats->high_water       = ( driver->rx_buffer != NULL ) ? ring_buffer_high_water( driver->rx_buffer, false ) : 0;
+    stats->overruns         = driver->rx_overruns;
+  }
+
+  if ( reset )
+  {
+    driver->rx_irq_count        = 0;
+    driver->rx_bytes            = 0;
+    driver->rx_wake_cycles      = 0;
+    driver->rx_wakeups          = 0;
+    driver->rx_latency_max_us   = 0;
+    driver->rx_latency_total_us = 0;
+    driver->rx_overruns         = 0;
+    if ( driver->rx_buffer != NULL )
+    {
+      ring_buffer_high_water( driver->rx_buffer, true );
+    }
+  }
+  return kNoErr;
+}
+
+/* Offset in the ring buffer the RX DMA writes to next */
+static uint32_t rx_dma_position( platform_uart_driver_t* driver )
+{
+  uint32_t size = driver->rx_buffer->size;
+  uint32_t position = size - driver->peripheral->rx_dma_config.stream->NDTR;
+
+  return ( position >= size ) ? 0 : position;
+}
+
+/* Move the ring buffer tail up to the DMA write position. Called from both RX interrupts, which
+ * can nest, and from threads so that data is visible before the next interrupt.
+ * The DMA does not stop at the one byte the ring keeps free, so more bytes than free space
+ * means unread data was overwritten. Nothing is committed then, the receiving thread drops
+ * the buffered data and restarts at the DMA position, see rx_used_space(). A DMA that laps
+ * the whole buffer between two interrupts can not be told from a short transfer. */
+static void update_rx_tail( platform_uart_driver_t* driver )
+{
+  uint32_t size = driver->rx_buffer->size;
+  uint32_t received;
+
+  DISABLE_INTERRUPTS;
+  if ( !driver->rx_overrun )
+  {
+    received = ( rx_dma_position( driver ) + size - driver->rx_buffer->tail ) % size;
+    driver->rx_bytes += received;
+    if ( received > ring_buffer_free_space( driver->rx_buffer ) )
+    {
+      driver->rx_overruns++;
+      driver->rx_overrun = true;
+      driver->last_receive_result = kOverrunErr;
+    }
+    else
+    {
+      ring_buffer_write_commit( driver->rx_buffer, received );
+    }
+  }
+  ENABLE_INTERRUPTS;
+}
+
+/* Only the receiving thread moves head, so the resynchronisation after an overrun is done here */
+static uint32_t rx_used_space( platform_uart_driver_t* driver )
+{
+  if ( driver->rx_overrun )
+  {
+    DISABLE_INTERRUPTS;
+    driver->rx_buffer->tail = rx_dma_position( driver );
+    driver->rx_buffer->head = driver->rx_buffer->tail;
+    driver->rx_overrun = false;
+    ENABLE_INTERRUPTS;
+  }
+  update_rx_tail( driver );
   return ring_buffer_used_space( driver->rx_buffer );
 }
 
+/* Wake the receiver once the amount it asked for has arrived */
+static void notify_rx_waiter( platform_uart_driver_t* driver )
+{
+  if ( ( driver->rx_size > 0 ) && ( driver->rx_overrun || ring_buffer_used_space( driver->rx_buffer ) >= driver->rx_size ) )
+  {
+#ifndef NO_MICO_RTOS
+      driver->rx_wake_cycles = DWT->CYCCNT | 1;
+      mico_rtos_set_semaphore( &driver->rx_complete );
+#else
+      driver->rx_complete = true;
+#endif
+      driver->rx_size = 0;
+  }
+}
+
 static void clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags )
 {
     if ( stream <= DMA1_Stream3 )
@@ -684,21 +1008,19 @@ void platform_uart_irq( platform_uart_driver_t* driver )
 {
   platform_uart_port_t* uart = (platform_uart_port_t*) driver->peripheral->port;
 
-  // Clear all interrupts. It's safe to do so because only RXNE interrupt is enabled
-  uart->SR = (uint16_t) ( uart->SR | 0xffff );
-
-  // Update tail
-  driver->rx_buffer->tail = driver->rx_buffer->size - driver->peripheral->rx_dma_config.stream->NDTR;
+  // Only the idle-line interrupt is enabled. It is cleared by reading SR then DR.
+  if ( ( uart->SR & USART_SR_IDLE ) != 0 )
+  {
+    (void) uart->DR;
+  }
 
-  // Notify thread if sufficient data are available
-  if ( ( driver->rx_size > 0 ) && ( ring_buffer_used_space( driver->rx_buffer ) >= driver->rx_size ) )
+  if ( driver->rx_buffer != NULL )
   {
-      #ifndef NO_MICO_RTOS
-      mico_rtos_set_semaphore( &driver->rx_complete );
-      #else
-      driver->rx_complete = true;
-      #endif
-      driver->rx_size = 0;
+    driver->rx_irq_count++;
+
+    // Update tail and notify thread if sufficient data are available
+    update_rx_tail( driver );
+    notify_rx_waiter( driver );
   }
 #ifndef NO_MICO_RTOS
   if( driver->sem_wakeup )
@@ -708,6 +1030,10 @@ void platform_uart_irq( platform_uart_driver_t* driver )
 
 void platform_uart_tx_dma_irq( platform_uart_driver_t* driver )
 {
+#ifndef NO_MICO_RTOS
+    platform_uart_tx_desc_t desc;
+#endif
+
     if ( ( get_dma_irq_status( driver->peripheral->tx_dma_config.stream ) & driver->peripheral->tx_dma_config.complete_flags ) != 0 )
     {
         clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.complete_flags );
@@ -720,19 +1046,58 @@ void platform_uart_tx_dma_irq( platform_uart_driver_t* driver )
         driver->last_transmit_result = kGeneralErr;
     }
 
+#ifndef NO_MICO_RTOS
+    if ( driver->tx_active )
+    {
+        /* Retire the descriptor just sent and chain the next one before running the callback */
+        desc = driver->tx_queue[ driver->tx_queue_head % UART_TX_QUEUE_DEPTH ];
+        driver->tx_queue_head++;
+        driver->tx_active = false;
+        if ( desc.release == NULL )
+        {
+            driver->tx_fifo_used -= desc.size;
+        }
+        start_next_transmit( driver );
+
+        if ( desc.release != NULL )
+        {
+            desc.release( driver->last_transmit_result, desc.arg );
+        }
+
+        mico_rtos_set_semaphore( &driver->tx_space );
+        if ( !driver->tx_active )
+        {
+            mico_rtos_set_semaphore( &driver->tx_idle );
+        }
+        platform_mcu_powersave_enable();
+    }
+#else
     if ( driver->tx_size > 0 )
     {
-        #ifndef NO_MICO_RTOS
-        /* Set semaphore regardless of result to prevent waiting thread from locking up */
-        mico_rtos_set_semaphore( &driver->tx_complete );
-        #else
         driver->tx_complete = true;
-        #endif
     }
+#endif
 }
 
 void platform_uart_rx_dma_irq( platform_uart_driver_t* driver )
 {
+    if ( driver->rx_buffer != NULL )
+    {
+        /* Circular ring buffer mode: half and full transfer just move the tail */
+        uint32_t half_flags = DMA_HALF_FLAGS( driver->peripheral->rx_dma_config.complete_flags );
+
+        if ( ( get_dma_irq_status( driver->peripheral->rx_dma_config.stream ) & driver->peripheral->rx_dma_config.error_flags ) != 0 )
+        {
+            driver->last_receive_result = kGeneralErr;
+        }
+        clear_dma_interrupts( driver->peripheral->rx_dma_config.stream, half_flags | driver->peripheral->rx_dma_config.complete_flags | driver->peripheral->rx_dma_config.error_flags );
+
+        driver->rx_irq_count++;
+        update_rx_tail( driver );
+        notify_rx_waiter( driver );
+        return;
+    }
+
     if ( ( get_dma_irq_status( driver->peripheral->rx_dma_config.stream ) & driver->peripheral->rx_dma_config.complete_flags ) != 0 )
     {
         clear_dma_interrupts( driver->peripheral->rx_dma_config.stream, driver->peripheral->rx_dma_config.complete_flags );
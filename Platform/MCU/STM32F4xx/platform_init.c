@@ -38,6 +38,7 @@
 #include <string.h> // For memcmp
 #include "crt0.h"
 #include "mico_rtos.h"
+#include "mico_platform.h"
 #include "platform_init.h"
 
 #ifdef __GNUC__
@@ -286,6 +287,22 @@ OSStatus stdio_hardfault( char* data, uint32_t size )
   return kNoErr;
 }
 
+/******************************************************
+*            RTOS Tick
+******************************************************/
+
+#ifndef NO_MICO_RTOS
+extern void xPortSysTickHandler( void );
+
+/* Replaces the branch of the startup file straight to the port, so the hook
+ * sees the interrupted thread before the tick can switch to another one */
+void SysTick_Handler(void)
+{
+  MicoSysTickHook( );
+  xPortSysTickHandler( );
+}
+#endif
+
 /******************************************************
 *            NO-OS Functions
 ******************************************************/
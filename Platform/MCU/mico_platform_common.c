@@ -57,6 +57,13 @@
 *                    Constants
 ******************************************************/
 
+#ifndef NO_MICO_RTOS
+#define FLASH_ASYNC_QUEUE_DEPTH     ( 8 )
+#define FLASH_ASYNC_STACK_SIZE      ( 0x300 )
+/* The flash mutex is released between chunks so that synchronous users are not starved */
+#define FLASH_ASYNC_CHUNK_SIZE      ( 1024 )
+#endif
+
 /******************************************************
 *                   Enumerations
 ******************************************************/
@@ -69,12 +76,34 @@
 *                    Structures
 ******************************************************/
 
+#ifndef NO_MICO_RTOS
+typedef struct
+{
+  mico_partition_t            partition;
+  uint32_t                    off_set;
+  uint8_t*                    buffer;
+  uint32_t                    length;
+  mico_flash_async_callback_t callback;
+  void*                       arg;
+} flash_async_request_t;
+
+typedef struct
+{
+  mico_semaphore_t            done;
+  OSStatus                    result;
+} flash_async_flush_t;
+#endif
+
 /******************************************************
 *               Static Function Declarations
 ******************************************************/
 
 extern OSStatus mico_platform_init      ( void );
 
+#ifndef NO_MICO_RTOS
+static OSStatus flash_async_init        ( void );
+#endif
+
 /******************************************************
 *               Variable Definitions
 ******************************************************/
@@ -94,6 +123,14 @@ extern const platform_flash_t           platform_flash_peripherals[];
 extern platform_flash_driver_t          platform_flash_drivers[];
 extern const mico_logic_partition_t     mico_partitions[];
 
+#ifndef NO_MICO_RTOS
+/* The writer thread and its queue are created by the first MicoFlashWriteAsync */
+static mico_mutex_t flash_async_mutex = NULL;
+static mico_queue_t flash_async_queue = NULL;
+/* First failure since the last MicoFlashAsyncFlush, only used by the writer thread */
+static OSStatus flash_async_error = kNoErr;
+#endif
+
 /******************************************************
 *               Function Definitions
 ******************************************************/
@@ -116,6 +153,14 @@ OSStatus mico_platform_init( void )
 #endif
  
 #ifndef BOOTLOADER
+
+#ifndef NO_MICO_RTOS
+  /* Only the lock, so that two first callers cannot both start the writer */
+  if( mico_rtos_init_mutex( &flash_async_mutex ) != kNoErr )
+  {
+    platform_log( "WARNING: Flash async writer not available" );
+  }
+#endif
   
 #ifdef USE_MiCOKit_EXT
   micokit_ext_init();
@@ -158,6 +203,48 @@ OSStatus MicoAdcTakeSampleStreram( mico_adc_t adc, void* buffer, uint16_t buffer
   return (OSStatus) platform_adc_take_sample_stream( &platform_adc_peripherals[adc], buffer, buffer_length );
 }
 
+OSStatus MicoAdcTakeSampleSequence( const mico_adc_t* adcs, uint8_t count, void* buffer, uint16_t buffer_length )
+{
+  const platform_adc_t* sequence[MICO_ADC_SEQUENCE_MAX];
+  uint8_t i;
+
+  if ( adcs == NULL || count == 0 || count > MICO_ADC_SEQUENCE_MAX )
+    return kParamErr;
+  for ( i = 0; i < count; i++ )
+  {
+    if ( adcs[i] >= MICO_ADC_NONE )
+      return kUnsupportedErr;
+    sequence[i] = &platform_adc_peripherals[adcs[i]];
+  }
+  return (OSStatus) platform_adc_take_sample_sequence( sequence, count, buffer, buffer_length );
+}
+
+OSStatus MicoAdcTakeSampleOversampled( mico_adc_t adc, uint8_t extra_bits, uint16_t* output )
+{
+  uint16_t chunk[MICO_ADC_OVERSAMPLE_CHUNK];
+  uint32_t left, n, i, sum = 0;
+  OSStatus err = kNoErr;
+
+  if ( adc >= MICO_ADC_NONE )
+    return kUnsupportedErr;
+  if ( output == NULL || extra_bits > MICO_ADC_OVERSAMPLE_MAX_BITS )
+    return kParamErr;
+
+  /* 4^n samples summed and shifted by n gain n bits when the input carries
+   * at least one LSB of noise, the rest is plain averaging */
+  for ( left = 1UL << ( 2 * extra_bits ); left > 0; left -= n )
+  {
+    n = ( left > MICO_ADC_OVERSAMPLE_CHUNK ) ? MICO_ADC_OVERSAMPLE_CHUNK : left;
+    err = platform_adc_take_sample_stream( &platform_adc_peripherals[adc], chunk, n * sizeof(uint16_t) );
+    if ( err != kNoErr )
+      return err;
+    for ( i = 0; i < n; i++ )
+      sum += chunk[i];
+  }
+  *output = (uint16_t)( sum >> extra_bits );
+  return err;
+}
+
 OSStatus MicoGpioInitialize( mico_gpio_t gpio, mico_gpio_config_t configuration )
 {
   if ( gpio >= MICO_GPIO_NONE )
@@ -312,6 +399,38 @@ OSStatus MicoI2cTransfer( mico_i2c_device_t* device, mico_i2c_message_t* message
   return err;
 }
 
+OSStatus MicoI2cTransferBatch( mico_i2c_transaction_t* transactions, uint16_t count )
+{
+  OSStatus err = kNoErr;
+  platform_i2c_config_t config;
+  mico_i2c_t port;
+  uint16_t i;
+
+  require_action_quiet( count > 0, exit, err = kParamErr );
+  port = transactions[0].device->port;
+  require_action_quiet( port < MICO_I2C_NONE, exit, err = kUnsupportedErr );
+  for ( i = 1; i < count; i++ )
+    require_action_quiet( transactions[i].device->port == port, exit, err = kParamErr );
+
+  mico_rtos_lock_mutex( &platform_i2c_drivers[port].i2c_mutex );
+  for ( i = 0; i < count; i++ )
+  {
+    config.address       = transactions[i].device->address;
+    config.address_width = transactions[i].device->address_width;
+    config.flags         = 0;
+    config.speed_mode    = transactions[i].device->speed_mode;
+
+    transactions[i].result = platform_i2c_transfer( &platform_i2c_peripherals[port], &config,
+                                                    transactions[i].message, transactions[i].number_of_messages );
+    if ( transactions[i].result != kNoErr )
+      err = transactions[i].result;
+  }
+  mico_rtos_unlock_mutex( &platform_i2c_drivers[port].i2c_mutex );
+
+exit:
+  return err;
+}
+
 void MicoMcuPowerSaveConfig( int enable )
 {
   if (enable == 1)
@@ -320,6 +439,24 @@ void MicoMcuPowerSaveConfig( int enable )
     platform_mcu_powersave_disable( );
 }
 
+/* Overridden by MCUs that track their power state residency */
+WEAK OSStatus platform_mcu_powersave_get_statistics( platform_mcu_powersave_stats_t* stats, bool reset )
+{
+  UNUSED_PARAMETER( stats );
+  UNUSED_PARAMETER( reset );
+  return kUnsupportedErr;
+}
+
+OSStatus MicoMcuPowerSaveGetStatistics( mico_mcu_powersave_stats_t* stats, bool reset )
+{
+  return platform_mcu_powersave_get_statistics( stats, reset );
+}
+
+/* Overridden by applications that sample the thread each tick interrupts */
+WEAK void MicoSysTickHook( void )
+{
+}
+
 void MicoSystemStandBy( uint32_t secondsToWakeup )
 {
   platform_mcu_enter_standby( secondsToWakeup );
@@ -347,6 +484,50 @@ OSStatus MicoPwmStop( mico_pwm_t pwm )
   return (OSStatus) platform_pwm_stop( &platform_pwm_peripherals[pwm] );
 }
 
+/* Overridden by PWM drivers that can stream duty cycles */
+WEAK OSStatus platform_pwm_get_resolution( const platform_pwm_t* pwm, uint32_t* full )
+{
+  UNUSED_PARAMETER( pwm );
+  UNUSED_PARAMETER( full );
+  return kUnsupportedErr;
+}
+
+WEAK OSStatus platform_pwm_stream_start( const platform_pwm_t* pwm, const uint32_t* compare, uint16_t count, bool loop )
+{
+  UNUSED_PARAMETER( pwm );
+  UNUSED_PARAMETER( compare );
+  UNUSED_PARAMETER( count );
+  UNUSED_PARAMETER( loop );
+  return kUnsupportedErr;
+}
+
+WEAK OSStatus platform_pwm_stream_stop( const platform_pwm_t* pwm )
+{
+  UNUSED_PARAMETER( pwm );
+  return kUnsupportedErr;
+}
+
+OSStatus MicoPwmGetResolution( mico_pwm_t pwm, uint32_t* full )
+{
+  if ( pwm >= MICO_PWM_NONE )
+    return kUnsupportedErr;
+  return (OSStatus) platform_pwm_get_resolution( &platform_pwm_peripherals[pwm], full );
+}
+
+OSStatus MicoPwmStreamStart( mico_pwm_t pwm, const uint32_t* compare, uint16_t count, bool loop )
+{
+  if ( pwm >= MICO_PWM_NONE )
+    return kUnsupportedErr;
+  return (OSStatus) platform_pwm_stream_start( &platform_pwm_peripherals[pwm], compare, count, loop );
+}
+
+OSStatus MicoPwmStreamStop( mico_pwm_t pwm )
+{
+  if ( pwm >= MICO_PWM_NONE )
+    return kUnsupportedErr;
+  return (OSStatus) platform_pwm_stream_stop( &platform_pwm_peripherals[pwm] );
+}
+
 OSStatus MicoRtcGetTime(mico_rtc_time_t* time)
 {
   return (OSStatus) platform_rtc_get_time( time );
@@ -357,6 +538,52 @@ OSStatus MicoRtcSetTime(mico_rtc_time_t* time)
   return (OSStatus) platform_rtc_set_time( time );
 }
 
+/* Overridden by RTC drivers with sub-second access and smooth calibration */
+WEAK OSStatus platform_rtc_get_time_ms( platform_rtc_time_t* time, uint16_t* msec )
+{
+  UNUSED_PARAMETER( time );
+  UNUSED_PARAMETER( msec );
+  return kUnsupportedErr;
+}
+
+WEAK OSStatus platform_rtc_shift( int32_t msec )
+{
+  UNUSED_PARAMETER( msec );
+  return kUnsupportedErr;
+}
+
+WEAK OSStatus platform_rtc_set_calibration( int32_t ppb )
+{
+  UNUSED_PARAMETER( ppb );
+  return kUnsupportedErr;
+}
+
+WEAK OSStatus platform_rtc_get_calibration( int32_t* ppb )
+{
+  UNUSED_PARAMETER( ppb );
+  return kUnsupportedErr;
+}
+
+OSStatus MicoRtcGetTimeMs(mico_rtc_time_t* time, uint16_t* msec)
+{
+  return (OSStatus) platform_rtc_get_time_ms( time, msec );
+}
+
+OSStatus MicoRtcShift(int32_t msec)
+{
+  return (OSStatus) platform_rtc_shift( msec );
+}
+
+OSStatus MicoRtcSetCalibration(int32_t ppb)
+{
+  return (OSStatus) platform_rtc_set_calibration( ppb );
+}
+
+OSStatus MicoRtcGetCalibration(int32_t* ppb)
+{
+  return (OSStatus) platform_rtc_get_calibration( ppb );
+}
+
 OSStatus MicoSpiInitialize( const mico_spi_device_t* spi )
 {
   platform_spi_config_t config;
@@ -370,7 +597,7 @@ OSStatus MicoSpiInitialize( const mico_spi_device_t* spi )
   if( platform_spi_drivers[spi->port].spi_mutex == NULL)
     mico_rtos_init_mutex( &platform_spi_drivers[spi->port].spi_mutex );
   
-  config.chip_select = &platform_gpio_pins[spi->chip_select];
+  config.chip_select = ( spi->chip_select < MICO_GPIO_NONE ) ? &platform_gpio_pins[spi->chip_select] : NULL;
   config.speed       = spi->speed;
   config.mode        = spi->mode;
   config.bits        = spi->bits;
@@ -412,7 +639,7 @@ OSStatus MicoSpiTransfer( const mico_spi_device_t* spi, const mico_spi_message_s
   if( platform_spi_drivers[spi->port].spi_mutex == NULL)
     mico_rtos_init_mutex( &platform_spi_drivers[spi->port].spi_mutex );
   
-  config.chip_select = &platform_gpio_pins[spi->chip_select];
+  config.chip_select = ( spi->chip_select < MICO_GPIO_NONE ) ? &platform_gpio_pins[spi->chip_select] : NULL;
   config.speed       = spi->speed;
   config.mode        = spi->mode;
   config.bits        = spi->bits;
@@ -507,6 +734,39 @@ OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size )
   return (OSStatus) platform_uart_transmit_bytes( &platform_uart_drivers[uart], (const uint8_t*) data, size );
 }
 
+/* Overridden by UART drivers with a transmit queue, others send before returning */
+WEAK OSStatus platform_uart_transmit_bytes_async( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size, platform_uart_tx_callback_t release, void* arg )
+{
+  OSStatus err = platform_uart_transmit_bytes( driver, data_out, size );
+
+  if ( release != NULL )
+    release( err, arg );
+  return err;
+}
+
+WEAK OSStatus platform_uart_transmit_flush( platform_uart_driver_t* driver, uint32_t timeout_ms )
+{
+  UNUSED_PARAMETER( driver );
+  UNUSED_PARAMETER( timeout_ms );
+  return kNoErr;
+}
+
+OSStatus MicoUartSendAsync( mico_uart_t uart, const void* data, uint32_t size, mico_uart_tx_callback_t release, void* arg )
+{
+  if ( uart >= MICO_UART_NONE )
+    return kUnsupportedErr;
+
+  return (OSStatus) platform_uart_transmit_bytes_async( &platform_uart_drivers[uart], (const uint8_t*) data, size, release, arg );
+}
+
+OSStatus MicoUartFlush( mico_uart_t uart, uint32_t timeout )
+{
+  if ( uart >= MICO_UART_NONE )
+    return kUnsupportedErr;
+
+  return (OSStatus) platform_uart_transmit_flush( &platform_uart_drivers[uart], timeout );
+}
+
 OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t timeout )
 {
   if ( uart >= MICO_UART_NONE )
@@ -523,6 +783,23 @@ uint32_t MicoUartGetLengthInBuffer( mico_uart_t uart )
   return (OSStatus) platform_uart_get_length_in_buffer( &platform_uart_drivers[uart] );
 }
 
+/* Overridden by UART drivers that collect receive statistics */
+WEAK OSStatus platform_uart_get_rx_statistics( platform_uart_driver_t* driver, platform_uart_rx_stats_t* stats, bool reset )
+{
+  UNUSED_PARAMETER( driver );
+  UNUSED_PARAMETER( stats );
+  UNUSED_PARAMETER( reset );
+  return kUnsupportedErr;
+}
+
+OSStatus MicoUartGetRxStatistics( mico_uart_t uart, mico_uart_rx_stats_t* stats, bool reset )
+{
+  if ( uart >= MICO_UART_NONE )
+    return kUnsupportedErr;
+
+  return platform_uart_get_rx_statistics( &platform_uart_drivers[uart], stats, reset );
+}
+
 OSStatus MicoRandomNumberRead( void *inBuffer, int inByteCount )
 {
   return (OSStatus) platform_random_number_read( inBuffer, inByteCount );
@@ -530,6 +807,10 @@ OSStatus MicoRandomNumberRead( void *inBuffer, int inByteCount )
 
 void MicoSystemReboot( void )
 {
+#ifndef MICO_DISABLE_STDIO
+  /* Do not lose the last log lines still queued on the console */
+  MicoUartFlush( STDIO_UART, 100 );
+#endif
   platform_mcu_reset();
 }
 OSStatus MicoWdgInitialize( uint32_t timeout )
@@ -676,6 +957,121 @@ exit:
   return err;
 }
 
+#ifndef NO_MICO_RTOS
+static void flash_async_thread( void* arg )
+{
+  flash_async_request_t request;
+  uint32_t off_set, length;
+  OSStatus err;
+  UNUSED_PARAMETER( arg );
+
+  while( 1 )
+  {
+    if( mico_rtos_pop_from_queue( &flash_async_queue, &request, MICO_WAIT_FOREVER ) != kNoErr )
+      continue;
+
+    err = kNoErr;
+    off_set = request.off_set;
+    while( request.length > 0 && err == kNoErr )
+    {
+      length = ( request.length > FLASH_ASYNC_CHUNK_SIZE ) ? FLASH_ASYNC_CHUNK_SIZE : request.length;
+      err = MicoFlashWrite( request.partition, &off_set, request.buffer, length );
+      request.buffer += length;
+      request.length -= length;
+    }
+
+    if( err != kNoErr && flash_async_error == kNoErr )
+      flash_async_error = err;
+
+    if( request.callback != NULL )
+      request.callback( err, request.arg );
+  }
+}
+
+static OSStatus flash_async_init( void )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( flash_async_mutex != NULL, exit, err = kNotInitializedErr );
+  mico_rtos_lock_mutex( &flash_async_mutex );
+  require_quiet( flash_async_queue == NULL, unlock );
+
+  err = mico_rtos_init_queue( &flash_async_queue, "Flash async", sizeof(flash_async_request_t), FLASH_ASYNC_QUEUE_DEPTH );
+  require_noerr( err, unlock );
+  err = mico_rtos_create_thread( NULL, MICO_APPLICATION_PRIORITY, "Flash async", flash_async_thread, FLASH_ASYNC_STACK_SIZE, NULL );
+  require_noerr_action( err, unlock, mico_rtos_deinit_queue( &flash_async_queue ); flash_async_queue = NULL );
+
+unlock:
+  mico_rtos_unlock_mutex( &flash_async_mutex );
+exit:
+  return err;
+}
+
+OSStatus MicoFlashWriteAsync( mico_partition_t partition, uint32_t off_set, uint8_t* inBuffer, uint32_t inBufferLength, mico_flash_async_callback_t callback, void* arg )
+{
+  OSStatus err = kNoErr;
+  flash_async_request_t request;
+
+  require_action_quiet( partition > MICO_PARTITION_ERROR, exit, err = kParamErr );
+  require_action_quiet( partition < MICO_PARTITION_MAX, exit, err = kParamErr );
+  require_action_quiet( inBuffer != NULL || inBufferLength == 0, exit, err = kParamErr );
+  if( flash_async_queue == NULL )
+  {
+    err = flash_async_init( );
+    require_noerr_action_quiet( err, exit, err = kNotInitializedErr );
+  }
+
+  request.partition = partition;
+  request.off_set   = off_set;
+  request.buffer    = inBuffer;
+  request.length    = inBufferLength;
+  request.callback  = callback;
+  request.arg       = arg;
+
+  err = mico_rtos_push_to_queue( &flash_async_queue, &request, MICO_WAIT_FOREVER );
+  require_noerr( err, exit );
+
+exit:
+  return err;
+}
+
+static void flash_async_flush_done( OSStatus result, void* arg )
+{
+  flash_async_flush_t *flush = (flash_async_flush_t *)arg;
+  UNUSED_PARAMETER( result );
+
+  /* Runs on the writer thread, so no write can fail in between */
+  flush->result = flash_async_error;
+  flash_async_error = kNoErr;
+  mico_rtos_set_semaphore( &flush->done );
+}
+
+OSStatus MicoFlashAsyncFlush( void )
+{
+  OSStatus err = kNoErr;
+  flash_async_flush_t flush = { NULL, kNoErr };
+
+  /* Nothing was ever queued */
+  if( flash_async_queue == NULL )
+    goto exit;
+
+  /* Requests run in FIFO order, an empty request completes after all earlier ones */
+  err = mico_rtos_init_semaphore( &flush.done, 1 );
+  require_noerr( err, exit );
+
+  err = MicoFlashWriteAsync( MICO_PARTITION_PARAMETER_1, 0, NULL, 0, flash_async_flush_done, &flush );
+  if( err == kNoErr )
+    err = mico_rtos_get_semaphore( &flush.done, MICO_WAIT_FOREVER );
+  if( err == kNoErr )
+    err = flush.result;
+
+  mico_rtos_deinit_semaphore( &flush.done );
+
+exit:
+  return err;
+}
+#endif
+
 OSStatus MicoFlashEnableSecurity( mico_partition_t partition, uint32_t off_set, uint32_t size )
 {
   OSStatus err = kNoErr;
@@ -710,6 +1106,16 @@ void MicoNanosendDelay( uint64_t delayns )
   platform_nanosecond_delay( delayns );
 }
 
+void MicoNanosecondInit( void )
+{
+  platform_init_nanosecond_clock( );
+}
+
+uint64_t MicoNanosecondGetTime( void )
+{
+  return platform_get_nanosecond_clock_value( );
+}
+
 char *mico_get_bootloader_ver(void)
 {
     static char ver[33];
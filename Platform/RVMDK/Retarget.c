@@ -54,7 +54,8 @@ label:  goto label;  /* endless loop */
 }
 
 int fputc(int ch, FILE *f) {
-  MicoUartSend( STDIO_UART, &ch, 1 );
+  /* Copied into the UART transmit queue, consecutive characters share one DMA transfer */
+  MicoUartSendAsync( STDIO_UART, &ch, 1, NULL, NULL );
   return ch;
 }
 
@@ -235,6 +235,38 @@ typedef struct
     uint8_t                      flags;          /**< if set, UART can wake up MCU from stop mode, reference: @ref UART_WAKEUP_DISABLE and @ref UART_WAKEUP_ENABLE*/
 } platform_uart_config_t;
 
+/**
+ * UART receive statistics, for measuring interrupt load and wake-up latency
+ */
+typedef struct
+{
+    uint32_t irq_count;        /**< RX interrupts taken since the last reset   */
+    uint32_t bytes;            /**< Bytes received into the RX ring buffer     */
+    uint32_t wakeups;          /**< Times a waiting receiver was woken         */
+    uint32_t latency_max_us;   /**< Longest interrupt-to-receiver wake latency */
+    uint32_t latency_total_us; /**< Sum of wake latencies, divide by wakeups   */
+    uint32_t high_water;       /**< Most bytes held in the RX ring buffer      */
+    uint32_t overruns;         /**< Times the RX ring buffer was overrun and
+                                    the data it held was dropped            */
+} platform_uart_rx_stats_t;
+
+/**
+ * Time the MCU spent in each power state, the rest of total_ms was spent running
+ */
+typedef struct
+{
+    uint32_t total_ms;         /**< Time covered since the last reset          */
+    uint32_t sleep_ms;         /**< Core halted in WFI with the clocks running */
+    uint32_t stop_ms;          /**< In STOP mode, clocks and SysTick halted    */
+    uint32_t stop_count;       /**< Times STOP mode was entered                */
+} platform_mcu_powersave_stats_t;
+
+/**
+ * UART transmit completion callback. Called from interrupt context once the
+ * DMA has finished reading a buffer queued by platform_uart_transmit_bytes_async()
+ */
+typedef void (*platform_uart_tx_callback_t)( OSStatus result, void* arg );
+
 /**
  * SPI configuration
  */
@@ -453,6 +485,16 @@ void platform_mcu_enter_standby( uint32_t secondsToWakeup );
  */
 void platform_mcu_powersave_exit_notify( void );
 
+/**
+ * Read how long the MCU was running, sleeping and in STOP mode
+ *
+ * @param[out] stats : receives the residency counters, may be NULL to only reset them
+ * @param[in]  reset : restart the counters after reading them
+ *
+ * @return @ref OSStatus, kUnsupportedErr if the MCU does not collect them
+ */
+OSStatus platform_mcu_powersave_get_statistics( platform_mcu_powersave_stats_t* stats, bool reset );
+
 
 OSStatus platform_watchdog_init( uint32_t timeout_ms );
 
@@ -497,6 +539,31 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver );
 OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size );
 
 
+/**
+ * Queue data for transmission over the specified UART port and return without
+ * waiting for it to be sent. Must be called from thread context.
+ *
+ * @param[in] driver   : UART driver
+ * @param[in] data_out : data to transmit
+ * @param[in] size     : number of bytes to transmit
+ * @param[in] release  : NULL to copy the data into the driver's transmit FIFO,
+ *                       otherwise the buffer is sent in place and must stay
+ *                       valid until release is called with the result
+ * @param[in] arg      : argument passed to release
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_uart_transmit_bytes_async( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size, platform_uart_tx_callback_t release, void* arg );
+
+
+/**
+ * Wait until everything queued on the specified UART port has left the wire
+ *
+ * @return @ref OSStatus, kTimeoutErr if the queue did not drain in time
+ */
+OSStatus platform_uart_transmit_flush( platform_uart_driver_t* driver, uint32_t timeout_ms );
+
+
 /**
  * Receive data over the specified UART port
  *
@@ -512,6 +579,18 @@ OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* d
  */
 uint32_t platform_uart_get_length_in_buffer( platform_uart_driver_t* driver );
 
+
+/**
+ * Get the receive statistics of the specified UART port
+ *
+ * @param[in]  driver : UART driver
+ * @param[out] stats  : statistics collected since the last reset
+ * @param[in]  reset  : clear the statistics after reading them
+ *
+ * @return @ref OSStatus, kUnsupportedErr if the driver does not collect them
+ */
+OSStatus platform_uart_get_rx_statistics( platform_uart_driver_t* driver, platform_uart_rx_stats_t* stats, bool reset );
+
 /**
  * Initialise the specified SPI interface
  *
@@ -647,6 +726,19 @@ OSStatus platform_adc_take_sample( const platform_adc_t* adc, uint16_t* output )
 OSStatus platform_adc_take_sample_stream( const platform_adc_t* adc, void* buffer, uint16_t buffer_length );
 
 
+/**
+ * Take ADC samples from a scan sequence of channels
+ *
+ * @param[in]  adcs          : ADC interfaces in scan order, all on the same converter
+ * @param[in]  count         : number of interfaces
+ * @param[out] buffer        : buffer that will contain the interleaved samples
+ * @param[in]  buffer_length : buffer length, only whole scans are taken
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_adc_take_sample_sequence( const platform_adc_t* const* adcs, uint8_t count, void* buffer, uint16_t buffer_length );
+
+
 /**
  * Initialise I2C interface
  *
@@ -764,6 +856,45 @@ OSStatus platform_pwm_start( const platform_pwm_t* pwm );
 OSStatus platform_pwm_stop( const platform_pwm_t* pwm );
 
 
+/**
+ * Get the compare value of a 100% duty cycle
+ *
+ * @param[in]  pwm_interface : PWM interface, initialised
+ * @param[out] full          : compare value, the PWM period in timer counts
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_pwm_get_resolution( const platform_pwm_t* pwm, uint32_t* full );
+
+
+/**
+ * Play a table of compare values on a PWM interface, one per PWM period
+ *
+ * A DMA stream requested at every timer update writes the next value into
+ * the compare register, so the duty cycle follows the table without the CPU.
+ * The table is read in place and has to stay untouched until the stream is
+ * stopped or, when not looping, has played out.
+ *
+ * @param[in] pwm_interface : PWM interface, started
+ * @param[in] compare       : compare values, 0 to the value of platform_pwm_get_resolution()
+ * @param[in] count         : number of values
+ * @param[in] loop          : start over after the last value, otherwise the last value is kept
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_pwm_stream_start( const platform_pwm_t* pwm, const uint32_t* compare, uint16_t count, bool loop );
+
+
+/**
+ * Stop a duty cycle stream, the output keeps the value it was at
+ *
+ * @param[in] pwm_interface : PWM interface
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_pwm_stream_stop( const platform_pwm_t* pwm );
+
+
 /**
  * Get current real-time clock
  *
@@ -784,6 +915,47 @@ OSStatus platform_rtc_get_time( platform_rtc_time_t* time );
 OSStatus platform_rtc_set_time( const platform_rtc_time_t* time );
 
 
+/**
+ * Get current real-time clock with the milliseconds into the current second
+ *
+ * @param[in] time : variable that will contain the current real-time clock
+ * @param[in] msec : variable that will contain the milliseconds, 0 - 999
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_rtc_get_time_ms( platform_rtc_time_t* time, uint16_t* msec );
+
+
+/**
+ * Move real-time clock by less than a second without stopping it
+ *
+ * @param[in] msec : milliseconds to add, -999 - 999
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_rtc_shift( int32_t msec );
+
+
+/**
+ * Trim the rate of the real-time clock
+ *
+ * @param[in] ppb : rate correction in parts per billion, positive speeds the clock up
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_rtc_set_calibration( int32_t ppb );
+
+
+/**
+ * Get the rate correction of the real-time clock
+ *
+ * @param[out] ppb : rate correction in parts per billion
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_rtc_get_calibration( int32_t* ppb );
+
+
 /**
  * Initialise UART standard I/O
  *
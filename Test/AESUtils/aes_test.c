@@ -0,0 +1,510 @@
+/**
+  ******************************************************************************
+  * @file    aes_test.c
+  * @brief   Known-answer tests and a cycles-per-byte benchmark for the
+  *          AESUtils backends (ECB, CTR and CBC frames) and for AES-GCM
+  *          with every GHASH table size.
+  *
+  *          Host, constant-time backend, from the repository root:
+  *
+  *          gcc -O2 -ITest/AESUtils/stub -Ilibraries/utilities \
+  *              -DAES_UTILS_USE_CT_AES=1 -DTARGET_NO_OPENSSL=1 \
+  *              -o aes_test Test/AESUtils/aes_test.c libraries/utilities/AESUtils.c
+  *          ./aes_test
+  *
+  *          With the Gladman GCM sources, add to the line above:
+  *
+  *              -IMICO/security/GladmanAES -DAES_UTILS_HAS_GLADMAN_GCM=1 \
+  *              MICO/security/GladmanAES/gcm.c MICO/security/GladmanAES/gf128mul.c \
+  *              MICO/security/GladmanAES/aescrypt.c MICO/security/GladmanAES/aeskey.c \
+  *              MICO/security/GladmanAES/aestab.c libraries/utilities/SecurityUtils.c
+  *
+  *          Target, STM32 CRYP backend: the peripheral only exists on the
+  *          chip, so build this file into an application with
+  *          AES_TEST_NO_MAIN and AES_UTILS_USE_STM32_CRYP defined, and call
+  *          aes_test_run( ) from user_main. Cycles are read from the DWT
+  *          cycle counter there, on the host from the time stamp counter.
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <string.h>
+#include "AESUtils.h"
+#if AES_UTILS_HAS_GCM
+  #include "MICO.h"
+#endif
+
+#if defined( __ICCARM__ ) || defined( __CC_ARM ) || defined( __arm__ )
+  #include "stm32f4xx.h"
+  #define AES_TEST_ON_TARGET  1
+#elif defined( __x86_64__ ) || defined( __i386__ )
+  #include <x86intrin.h>
+#else
+  #include <time.h>
+#endif
+
+#define AES_BENCH_SIZE      4096
+#define AES_BENCH_ROUNDS    16
+
+typedef OSStatus (*aes_bench_func_t)( uint8_t *buf, size_t len );
+
+/* FIPS-197 appendix C.1 */
+static const uint8_t fips197_key[16] = {
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+static const uint8_t fips197_plain[16] = {
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+static const uint8_t fips197_cipher[16] = {
+  0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+
+/* SP 800-38A F.1.1, F.2.1 and F.5.1, AES-128 */
+static const uint8_t sp800_key[16] = {
+  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+static const uint8_t sp800_iv[16] = {
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+static const uint8_t sp800_counter[16] = {
+  0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+static const uint8_t sp800_plain[64] = {
+  0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+  0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+  0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+  0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10 };
+static const uint8_t sp800_ecb[64] = {
+  0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97,
+  0xf5, 0xd3, 0xd5, 0x85, 0x03, 0xb9, 0x69, 0x9d, 0xe7, 0x85, 0x89, 0x5a, 0x96, 0xfd, 0xba, 0xaf,
+  0x43, 0xb1, 0xcd, 0x7f, 0x59, 0x8e, 0xce, 0x23, 0x88, 0x1b, 0x00, 0xe3, 0xed, 0x03, 0x06, 0x88,
+  0x7b, 0x0c, 0x78, 0x5e, 0x27, 0xe8, 0xad, 0x3f, 0x82, 0x23, 0x20, 0x71, 0x04, 0x72, 0x5d, 0xd4 };
+static const uint8_t sp800_cbc[64] = {
+  0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+  0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+  0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+  0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7 };
+static const uint8_t sp800_ctr[64] = {
+  0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+  0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff,
+  0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e, 0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab,
+  0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1, 0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee };
+
+#if AES_UTILS_HAS_GCM
+/* GCM specification test cases 1 to 4, AES-128 with a 96-bit IV. Case 3 and
+   4 share the key, IV and text, case 4 drops the last 4 bytes and adds AAD. */
+static const uint8_t gcm_zero[16] = { 0 };
+static const uint8_t gcm_key[16] = {
+  0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08 };
+static const uint8_t gcm_iv[12] = {
+  0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88 };
+static const uint8_t gcm_aad[20] = {
+  0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+  0xab, 0xad, 0xda, 0xd2 };
+static const uint8_t gcm_plain[64] = {
+  0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+  0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+  0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+  0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39, 0x1a, 0xaf, 0xd2, 0x55 };
+static const uint8_t gcm_cipher[64] = {
+  0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+  0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+  0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+  0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91, 0x47, 0x3f, 0x59, 0x85 };
+static const uint8_t gcm_tc2_cipher[16] = {
+  0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92, 0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78 };
+static const uint8_t gcm_tc1_tag[16] = {
+  0x58, 0xe2, 0xfc, 0xce, 0xfa, 0x7e, 0x30, 0x61, 0x36, 0x7f, 0x1d, 0x57, 0xa4, 0xe7, 0x45, 0x5a };
+static const uint8_t gcm_tc2_tag[16] = {
+  0xab, 0x6e, 0x47, 0xd4, 0x2c, 0xec, 0x13, 0xbd, 0xf5, 0x3a, 0x67, 0xb2, 0x12, 0x57, 0xbd, 0xdf };
+static const uint8_t gcm_tc3_tag[16] = {
+  0x4d, 0x5c, 0x2a, 0xf3, 0x27, 0xcd, 0x64, 0xa6, 0x2c, 0xf3, 0x5a, 0xbd, 0x2b, 0xa6, 0xfa, 0xb4 };
+static const uint8_t gcm_tc4_tag[16] = {
+  0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb, 0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47 };
+
+typedef struct {
+  const char    *name;
+  const uint8_t *key;
+  const uint8_t *iv;
+  const uint8_t *aad;
+  size_t         aad_len;
+  const uint8_t *plain;
+  const uint8_t *cipher;
+  size_t         len;
+  const uint8_t *tag;
+} gcm_vector_t;
+
+static const gcm_vector_t gcm_vectors[] = {
+  { "GCM 1, empty", gcm_zero, gcm_zero, NULL, 0, NULL, NULL, 0, gcm_tc1_tag },
+  { "GCM 2, no AAD", gcm_zero, gcm_zero, NULL, 0, gcm_zero, gcm_tc2_cipher, 16, gcm_tc2_tag },
+  { "GCM 3, no AAD", gcm_key, gcm_iv, NULL, 0, gcm_plain, gcm_cipher, 64, gcm_tc3_tag },
+  { "GCM 4, 20-byte AAD", gcm_key, gcm_iv, gcm_aad, 20, gcm_plain, gcm_cipher, 60, gcm_tc4_tag },
+};
+
+static const char *gcm_tables_name[] = { "none", "256", "4K", "8K", "64K" };
+
+/* What the Auto table selection sees, large enough for the 64K table */
+static micoMemInfo_t gcm_mem_info = { 1024 * 1024 };
+#endif
+
+static uint8_t bench_buf[AES_BENCH_SIZE + 1];
+
+static uint32_t cycles_now( void )
+{
+#if AES_TEST_ON_TARGET
+  return DWT->CYCCNT;
+#elif defined( __x86_64__ ) || defined( __i386__ )
+  return (uint32_t)__rdtsc( );
+#else
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint32_t)( ts.tv_sec * 1000000000u + ts.tv_nsec );
+#endif
+}
+
+static void cycles_init( void )
+{
+#if AES_TEST_ON_TARGET
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+static int expect( const char *name, const uint8_t *out, const uint8_t *expected, size_t len )
+{
+  int ok = ( memcmp( out, expected, len ) == 0 );
+  printf( "%-32s %s\r\n", name, ok ? "ok" : "FAIL" );
+  return ok ? 0 : 1;
+}
+
+static int test_ecb( void )
+{
+  AES_ECB_Context ecb;
+  uint8_t out[64];
+  int fails = 0;
+
+  AES_ECB_Init( &ecb, kAES_ECB_Mode_Encrypt, fips197_key );
+  AES_ECB_Update( &ecb, fips197_plain, 16, out );
+  AES_ECB_Final( &ecb );
+  fails += expect( "FIPS-197 ECB encrypt", out, fips197_cipher, 16 );
+
+  AES_ECB_Init( &ecb, kAES_ECB_Mode_Decrypt, fips197_key );
+  AES_ECB_Update( &ecb, fips197_cipher, 16, out );
+  AES_ECB_Final( &ecb );
+  fails += expect( "FIPS-197 ECB decrypt", out, fips197_plain, 16 );
+
+  /* Four blocks in one call, the multi-block path */
+  AES_ECB_Init( &ecb, kAES_ECB_Mode_Encrypt, sp800_key );
+  AES_ECB_Update( &ecb, sp800_plain, 64, out );
+  AES_ECB_Final( &ecb );
+  fails += expect( "SP800-38A ECB encrypt", out, sp800_ecb, 64 );
+
+  AES_ECB_Init( &ecb, kAES_ECB_Mode_Decrypt, sp800_key );
+  AES_ECB_Update( &ecb, sp800_ecb, 64, out );
+  AES_ECB_Final( &ecb );
+  fails += expect( "SP800-38A ECB decrypt", out, sp800_plain, 64 );
+
+  return fails;
+}
+
+static int test_ctr( void )
+{
+  AES_CTR_Context ctr;
+  uint8_t out[65];
+  size_t split;
+  int fails = 0;
+
+  /* Every split point, so partial keystream blocks carry over between calls */
+  for( split = 0; split <= 64; split++ ) {
+    AES_CTR_Init( &ctr, sp800_key, sp800_counter );
+    AES_CTR_Update( &ctr, sp800_plain, split, out );
+    AES_CTR_Update( &ctr, sp800_plain + split, 64 - split, out + split );
+    AES_CTR_Final( &ctr );
+    if( memcmp( out, sp800_ctr, 64 ) != 0 )
+      break;
+  }
+  fails += expect( "SP800-38A CTR, all splits", out, sp800_ctr, 64 );
+
+  /* Unaligned output, the byte-wise XOR path */
+  AES_CTR_Init( &ctr, sp800_key, sp800_counter );
+  AES_CTR_Update( &ctr, sp800_plain, 64, out + 1 );
+  AES_CTR_Final( &ctr );
+  fails += expect( "SP800-38A CTR, unaligned", out + 1, sp800_ctr, 64 );
+
+  return fails;
+}
+
+static int test_cbc( void )
+{
+  AES_CBCFrame_Context cbc;
+  uint8_t out[64];
+  int fails = 0;
+
+  AES_CBCFrame_Init( &cbc, sp800_key, sp800_iv, true );
+  AES_CBCFrame_Update( &cbc, sp800_plain, 64, out );
+  fails += expect( "SP800-38A CBC encrypt", out, sp800_cbc, 64 );
+
+  /* Same context again, every frame starts from the IV */
+  AES_CBCFrame_Update2( &cbc, sp800_plain, 7, sp800_plain + 7, 57, out );
+  fails += expect( "SP800-38A CBC encrypt, 2 parts", out, sp800_cbc, 64 );
+  AES_CBCFrame_Final( &cbc );
+
+  AES_CBCFrame_Init( &cbc, sp800_key, sp800_iv, false );
+  AES_CBCFrame_Update( &cbc, sp800_cbc, 64, out );
+  fails += expect( "SP800-38A CBC decrypt", out, sp800_plain, 64 );
+
+  AES_CBCFrame_Update2( &cbc, sp800_cbc, 20, sp800_cbc + 20, 44, out );
+  fails += expect( "SP800-38A CBC decrypt, 2 parts", out, sp800_plain, 64 );
+  AES_CBCFrame_Final( &cbc );
+
+  return fails;
+}
+
+#if AES_UTILS_HAS_GCM
+#if !AES_TEST_ON_TARGET
+micoMemInfo_t* MicoGetMemoryInfo( void )
+{
+  return &gcm_mem_info;
+}
+
+uint32_t mico_get_time( void )
+{
+  return 0;
+}
+#endif
+
+/* One message with the AAD and the text each split in two calls */
+static OSStatus gcm_run( AES_GCM_Context *ctx, const gcm_vector_t *v, size_t aad_split, size_t split,
+                         int encrypt, uint8_t *out, uint8_t *tag )
+{
+  const uint8_t *in = encrypt ? v->plain : v->cipher;
+  OSStatus err;
+
+  err = AES_GCM_InitMessageEx( ctx, v->iv, 12 );
+  if( err == kNoErr && aad_split > 0 )
+    err = AES_GCM_AddAAD( ctx, v->aad, aad_split );
+  if( err == kNoErr && v->aad_len > aad_split )
+    err = AES_GCM_AddAAD( ctx, v->aad + aad_split, v->aad_len - aad_split );
+  if( err == kNoErr && split > 0 )
+    err = encrypt ? AES_GCM_Encrypt( ctx, in, split, out ) : AES_GCM_Decrypt( ctx, in, split, out );
+  if( err == kNoErr && v->len > split )
+    err = encrypt ? AES_GCM_Encrypt( ctx, in + split, v->len - split, out + split )
+                  : AES_GCM_Decrypt( ctx, in + split, v->len - split, out + split );
+  if( err == kNoErr )
+    err = encrypt ? AES_GCM_FinalizeMessage( ctx, tag ) : AES_GCM_VerifyMessage( ctx, tag );
+  return err;
+}
+
+static int test_gcm_vector( AES_GCM_Tables tables, const gcm_vector_t *v )
+{
+  AES_GCM_Context ctx;
+  uint8_t out[64], tag[16];
+  size_t aad_split, split;
+  char name[48];
+  int ok = 1;
+
+  if( AES_GCM_InitEx( &ctx, v->key, kAES_CGM_Nonce_None, tables ) != kNoErr ) {
+    printf( "%-32s init FAIL\r\n", v->name );
+    return 1;
+  }
+
+  /* Every split point of the AAD and of the text, so partial blocks carry over between calls */
+  for( aad_split = 0; ok && aad_split <= v->aad_len; aad_split++ ) {
+    for( split = 0; ok && split <= v->len; split++ ) {
+      ok = gcm_run( &ctx, v, aad_split, split, 1, out, tag ) == kNoErr
+           && memcmp( out, v->cipher, v->len ) == 0 && memcmp( tag, v->tag, 16 ) == 0;
+      memcpy( tag, v->tag, 16 );
+      ok = ok && gcm_run( &ctx, v, aad_split, split, 0, out, tag ) == kNoErr
+           && memcmp( out, v->plain, v->len ) == 0;
+    }
+  }
+  snprintf( name, sizeof( name ), "%s, all splits", v->name );
+  printf( "%-32s %s\r\n", name, ok ? "ok" : "FAIL" );
+
+  AES_GCM_Final( &ctx );
+  return ok ? 0 : 1;
+}
+
+/* A single flipped bit in the tag, the text or the AAD must fail verification */
+static int test_gcm_tamper( AES_GCM_Tables tables )
+{
+  const gcm_vector_t *v = &gcm_vectors[3];
+  gcm_vector_t bad = *v;
+  AES_GCM_Context ctx;
+  uint8_t out[64], tag[16], cipher[64], aad[20];
+  int ok = 1;
+
+  AES_GCM_InitEx( &ctx, v->key, kAES_CGM_Nonce_None, tables );
+
+  memcpy( tag, v->tag, 16 );
+  tag[15] ^= 0x01;
+  ok &= gcm_run( &ctx, v, 7, 33, 0, out, tag ) == kAuthenticationErr;
+
+  memcpy( cipher, v->cipher, v->len );
+  cipher[40] ^= 0x80;
+  bad.cipher = cipher;
+  memcpy( tag, v->tag, 16 );
+  ok &= gcm_run( &ctx, &bad, 7, 33, 0, out, tag ) == kAuthenticationErr;
+
+  memcpy( aad, v->aad, v->aad_len );
+  aad[19] ^= 0x10;
+  bad.cipher = v->cipher;
+  bad.aad = aad;
+  memcpy( tag, v->tag, 16 );
+  ok &= gcm_run( &ctx, &bad, 7, 33, 0, out, tag ) == kAuthenticationErr;
+
+  /* AAD after text is refused, the hash has already moved on */
+  AES_GCM_InitMessageEx( &ctx, v->iv, 12 );
+  AES_GCM_Encrypt( &ctx, v->plain, 16, out );
+  ok &= AES_GCM_AddAAD( &ctx, v->aad, v->aad_len ) == kStateErr;
+
+  AES_GCM_Final( &ctx );
+  printf( "%-32s %s\r\n", "GCM 4, flipped bits rejected", ok ? "ok" : "FAIL" );
+  return ok ? 0 : 1;
+}
+
+static int test_gcm( void )
+{
+  AES_GCM_Tables tables;
+  size_t i;
+  int fails = 0;
+
+  for( tables = kAES_GCM_Tables_Auto; tables <= kAES_GCM_Tables_64K; tables++ ) {
+    printf( "GHASH table: %s\r\n", tables == kAES_GCM_Tables_Auto ? "auto" : gcm_tables_name[tables] );
+    for( i = 0; i < sizeof( gcm_vectors ) / sizeof( gcm_vectors[0] ); i++ )
+      fails += test_gcm_vector( tables, &gcm_vectors[i] );
+    fails += test_gcm_tamper( tables );
+    /* The built-in self test, 16-byte nonce */
+    if( AES_GCM_Test( tables, 0, NULL ) != kNoErr ) {
+      printf( "%-32s FAIL\r\n", "AES_GCM_Test" );
+      fails++;
+    }
+  }
+  return fails;
+}
+#endif
+
+static OSStatus bench_ecb( uint8_t *buf, size_t len )
+{
+  AES_ECB_Context ecb;
+  OSStatus err;
+
+  AES_ECB_Init( &ecb, kAES_ECB_Mode_Encrypt, sp800_key );
+  err = AES_ECB_Update( &ecb, buf, len, buf );
+  AES_ECB_Final( &ecb );
+  return err;
+}
+
+static OSStatus bench_ctr( uint8_t *buf, size_t len )
+{
+  AES_CTR_Context ctr;
+  OSStatus err;
+
+  AES_CTR_Init( &ctr, sp800_key, sp800_counter );
+  err = AES_CTR_Update( &ctr, buf, len, buf );
+  AES_CTR_Final( &ctr );
+  return err;
+}
+
+static OSStatus bench_cbc_encrypt( uint8_t *buf, size_t len )
+{
+  AES_CBCFrame_Context cbc;
+  OSStatus err;
+
+  AES_CBCFrame_Init( &cbc, sp800_key, sp800_iv, true );
+  err = AES_CBCFrame_Update( &cbc, buf, len, buf );
+  AES_CBCFrame_Final( &cbc );
+  return err;
+}
+
+static OSStatus bench_cbc_decrypt( uint8_t *buf, size_t len )
+{
+  AES_CBCFrame_Context cbc;
+  OSStatus err;
+
+  AES_CBCFrame_Init( &cbc, sp800_key, sp800_iv, false );
+  err = AES_CBCFrame_Update( &cbc, buf, len, buf );
+  AES_CBCFrame_Final( &cbc );
+  return err;
+}
+
+#if AES_UTILS_HAS_GCM
+/* Set up by the caller, so that the table build is not timed */
+static AES_GCM_Context gcm_bench_ctx;
+
+static OSStatus bench_gcm( uint8_t *buf, size_t len )
+{
+  uint8_t tag[16];
+  OSStatus err;
+
+  err = AES_GCM_InitMessageEx( &gcm_bench_ctx, gcm_iv, 12 );
+  if( err == kNoErr )
+    err = AES_GCM_AddAAD( &gcm_bench_ctx, gcm_aad, sizeof( gcm_aad ) );
+  if( err == kNoErr )
+    err = AES_GCM_Encrypt( &gcm_bench_ctx, buf, len, buf );
+  if( err == kNoErr )
+    err = AES_GCM_FinalizeMessage( &gcm_bench_ctx, tag );
+  return err;
+}
+#endif
+
+/* Best of AES_BENCH_ROUNDS, the others include interrupts and cache misses */
+static void bench( const char *name, aes_bench_func_t func, uint8_t *buf )
+{
+  uint32_t start, cycles, best = 0xFFFFFFFF;
+  int round;
+
+  for( round = 0; round < AES_BENCH_ROUNDS; round++ ) {
+    start = cycles_now( );
+    if( func( buf, AES_BENCH_SIZE ) != kNoErr ) {
+      printf( "%-32s error\r\n", name );
+      return;
+    }
+    cycles = cycles_now( ) - start;
+    if( cycles < best )
+      best = cycles;
+  }
+
+  printf( "%-32s %5u.%u cycles/byte\r\n", name, (unsigned)( best / AES_BENCH_SIZE ),
+          (unsigned)( ( best % AES_BENCH_SIZE ) * 10 / AES_BENCH_SIZE ) );
+}
+
+int aes_test_run( void )
+{
+  int fails = 0;
+
+  fails += test_ecb( );
+  fails += test_ctr( );
+  fails += test_cbc( );
+#if AES_UTILS_HAS_GCM
+  fails += test_gcm( );
+#endif
+
+  cycles_init( );
+  bench( "ECB encrypt", bench_ecb, bench_buf );
+  bench( "CTR", bench_ctr, bench_buf );
+  bench( "CTR, unaligned", bench_ctr, bench_buf + 1 );
+  bench( "CBC encrypt", bench_cbc_encrypt, bench_buf );
+  bench( "CBC decrypt", bench_cbc_decrypt, bench_buf );
+#if AES_UTILS_HAS_GCM
+  {
+    AES_GCM_Tables tables;
+    char name[32];
+
+    for( tables = kAES_GCM_Tables_None; tables <= kAES_GCM_Tables_64K; tables++ ) {
+      if( AES_GCM_InitEx( &gcm_bench_ctx, gcm_key, kAES_CGM_Nonce_None, tables ) != kNoErr ) {
+        printf( "GCM, %s table: no memory\r\n", gcm_tables_name[tables] );
+        continue;
+      }
+      snprintf( name, sizeof( name ), "GCM encrypt, %s table", gcm_tables_name[tables] );
+      bench( name, bench_gcm, bench_buf );
+      AES_GCM_Final( &gcm_bench_ctx );
+    }
+  }
+#endif
+
+  printf( "%d known-answer tests failed\r\n", fails );
+  return fails;
+}
+
+#ifndef AES_TEST_NO_MAIN
+int main( void )
+{
+  return aes_test_run( ) ? 1 : 0;
+}
+#endif
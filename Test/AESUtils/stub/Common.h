@@ -0,0 +1,29 @@
+/* Host stand-in for Common.h, enough for AESUtils */
+
+#ifndef __Common_h__
+#define __Common_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef int32_t     OSStatus;
+typedef int         Boolean;
+
+#define kNoErr                  0
+#define kGeneralErr             -6700
+#define kAuthenticationErr      -6754
+#define kSizeErr                -6743
+#define kParamErr               -6705
+#define kStateErr               -6709
+#define kNoMemoryErr            -6728
+#define kMismatchErr            -6748
+
+#ifndef true
+    #define true                1
+    #define false               0
+#endif
+
+#define STATIC_INLINE           static inline
+
+#endif // __Common_h__
@@ -0,0 +1,16 @@
+/* Host stand-in for Debug.h, checks compile away */
+
+#ifndef __Debug_h__
+#define __Debug_h__
+
+#define custom_log( ... )                           do {} while( 0 )
+#define check( X )                                  do {} while( 0 )
+#define check_noerr( ERR )                          do {} while( 0 )
+#define check_ptr_overlap( P1, L1, P2, L2 )         do {} while( 0 )
+
+#define require_noerr( ERR, LABEL )                 do { if( ( ERR ) != 0 ) goto LABEL; } while( 0 )
+#define require_noerr_action( ERR, LABEL, ACTION )  do { if( ( ERR ) != 0 ) { { ACTION; } goto LABEL; } } while( 0 )
+#define require_action( X, LABEL, ACTION )          do { if( !( X ) ) { { ACTION; } goto LABEL; } } while( 0 )
+#define require_action_quiet( X, LABEL, ACTION )    require_action( X, LABEL, ACTION )
+
+#endif // __Debug_h__
@@ -0,0 +1,18 @@
+/* Host stand-in for MICO.h, what the GCM table selection and AES_GCM_Test use.
+   The test implements both calls. */
+
+#ifndef __MICO_H_
+#define __MICO_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    int free_memory;
+} micoMemInfo_t;
+
+micoMemInfo_t*  MicoGetMemoryInfo( void );
+uint32_t        mico_get_time( void );
+
+#endif // __MICO_H_
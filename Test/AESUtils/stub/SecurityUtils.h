@@ -0,0 +1,10 @@
+/* Host stand-in for SecurityUtils.h, what AESUtils uses from it */
+
+#ifndef __SecurityUtils_h__
+#define __SecurityUtils_h__
+
+#include <stddef.h>
+
+int memcmp_constant_time( const void *inA, const void *inB, size_t inLen );
+
+#endif // __SecurityUtils_h__
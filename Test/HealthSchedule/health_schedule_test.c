@@ -0,0 +1,418 @@
+/**
+  ******************************************************************************
+  * @file    health_schedule_test.c
+  * @brief   Schedules edited from the cloud: JSON messages go through the
+  *          real user_downstream_thread, the object model in If_MO.c and
+  *          the reminders in HealthMonitor.c, and the schedule timers are
+  *          checked after each message.
+  *
+  *          Build and run from the repository root:
+  *
+  *          gcc -O2 -pthread -DDEBUG -ITest/HealthSchedule/stub \
+  *              -IDemos/micokit/SC3165/User -IDemos/micokit/SC3165/Factory \
+  *              -IDemos/micokit/SC3165/Monitor \
+  *              -o health_schedule_test Test/HealthSchedule/health_schedule_test.c \
+  *              Demos/micokit/SC3165/User/user_downstream.c \
+  *              Demos/micokit/SC3165/Factory/If_MO.c \
+  *              Demos/micokit/SC3165/Monitor/HealthMonitor.c
+  *          ./health_schedule_test
+  *
+  *          The downstream thread runs on its own pthread and takes one
+  *          message at a time: the test queues a message and waits until the
+  *          thread calls LightsNotify, which it does after every message.
+  *          Timers are not run, a test fires a schedule by calling its
+  *          handler with the wall clock at the remind time.
+  ******************************************************************************
+  */
+
+#include <assert.h>
+#include <pthread.h>
+#include "mico.h"
+#include "MicoFogCloud.h"
+#include "If_MO.h"
+#include "HealthMonitor.h"
+#include "LightsMonitor.h"
+#include "OMFactory.h"
+#include "SendJson.h"
+#include "outTrigger.h"
+#include "controllerBus.h"
+#include "sntp.h"
+#include "AaInclude.h"
+
+#define MAX_TIMERS          ( MAX_DEPTH_PUTDOWN + MAX_DEPTH_SCHEDULE )
+
+#define MINUTES( h, m )     ( (h) * 60 + (m) )
+#define DELAY_MS( min )     ( (u32)(min) * 60 * 1000 )
+
+void user_downstream_thread( void* arg );
+void MOInit( void );
+
+static app_context_t app_context;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_cond = PTHREAD_COND_INITIALIZER;
+static const char *cloud_json;
+static bool cloud_handled;
+
+static int wall_minutes;
+
+/* In the order HealthInit sets them up: putdown reminders, then schedules */
+static SAaTimer *timers[MAX_TIMERS];
+static int timer_count;
+
+static int om_saves;
+static int plays;
+static ApiPlayReq last_play;
+
+
+/* RTOS */
+
+OSStatus mico_rtos_init_mutex( mico_mutex_t* mutex )
+{
+  pthread_mutex_t *m = malloc( sizeof(pthread_mutex_t) );
+  pthread_mutex_init( m, NULL );
+  *mutex = m;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex )
+{
+  pthread_mutex_lock( (pthread_mutex_t*)*mutex );
+  return kNoErr;
+}
+
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex )
+{
+  pthread_mutex_unlock( (pthread_mutex_t*)*mutex );
+  return kNoErr;
+}
+
+void mico_thread_sleep( uint32_t seconds )
+{
+  UNUSED_PARAMETER( seconds );
+}
+
+uint32_t mico_get_time( void )
+{
+  return (uint32_t)wall_minutes * 60 * 1000;
+}
+
+OSStatus AaThreadCreate( mico_thread_t* thread, uint8_t priority, const char* name, mico_thread_function_t function, uint32_t stack_size, void* arg )
+{
+  /* The health thread only dispatches timers and cup events, neither runs here */
+  UNUSED_PARAMETER( thread );
+  UNUSED_PARAMETER( priority );
+  UNUSED_PARAMETER( name );
+  UNUSED_PARAMETER( function );
+  UNUSED_PARAMETER( stack_size );
+  UNUSED_PARAMETER( arg );
+  return kNoErr;
+}
+
+void sntp_current_time_get( struct tm *time )
+{
+  memset( time, 0, sizeof(struct tm) );
+  time->tm_hour = wall_minutes / 60;
+  time->tm_min = wall_minutes % 60;
+}
+
+
+/* Cloud: one message in flight, handed over to the downstream thread */
+
+OSStatus MiCOFogCloudMsgRecv( app_context_t* const context, fogcloud_msg_t **msg, uint32_t timeout_ms )
+{
+  size_t len;
+
+  UNUSED_PARAMETER( context );
+  UNUSED_PARAMETER( timeout_ms );
+
+  pthread_mutex_lock( &sim_lock );
+  while( cloud_json == NULL )
+    pthread_cond_wait( &sim_cond, &sim_lock );
+  len = strlen( cloud_json );
+  *msg = calloc( 1, sizeof(fogcloud_msg_t) + len );
+  (*msg)->topic_len = 0;
+  (*msg)->data_len = len;
+  memcpy( (*msg)->data, cloud_json, len + 1 );
+  cloud_json = NULL;
+  pthread_mutex_unlock( &sim_lock );
+  return kNoErr;
+}
+
+/* Called by the downstream thread once a message is handled */
+void LightsNotify( void )
+{
+  pthread_mutex_lock( &sim_lock );
+  cloud_handled = true;
+  pthread_cond_broadcast( &sim_cond );
+  pthread_mutex_unlock( &sim_lock );
+}
+
+static void cloud_send( const char *json )
+{
+  pthread_mutex_lock( &sim_lock );
+  cloud_json = json;
+  cloud_handled = false;
+  pthread_cond_broadcast( &sim_cond );
+  while( !cloud_handled )
+    pthread_cond_wait( &sim_cond, &sim_lock );
+  pthread_mutex_unlock( &sim_lock );
+}
+
+
+/* Flat JSON objects only, as the cloud sends them */
+json_object* json_tokener_parse( const char *str )
+{
+  json_object *obj = calloc( 1, sizeof(json_object) );
+  const char *p = str;
+  int n;
+
+  obj->values = calloc( 16, sizeof(json_object) );
+  while( ( p = strchr( p, '"' ) ) != NULL && obj->count < 16 ) {
+    n = strcspn( ++p, "\"" );
+    snprintf( obj->keys[obj->count], sizeof(obj->keys[0]), "%.*s", n, p );
+    p = strchr( p + n, ':' ) + 1;
+    p += strspn( p, " " );
+    n = strcspn( p, ",} " );
+    snprintf( obj->values[obj->count].strings[0], sizeof(obj->strings[0]), "%.*s", n, p );
+    p += n;
+    obj->count++;
+  }
+  return obj;
+}
+
+void json_object_put( json_object *obj )
+{
+  free( obj->values );
+  free( obj );
+}
+
+const char* json_object_get_string( json_object *obj )
+{
+  return obj->strings[0];
+}
+
+bool json_object_get_boolean( json_object *obj )
+{
+  return strcmp( obj->strings[0], "true" ) == 0;
+}
+
+int32_t json_object_get_int( json_object *obj )
+{
+  return atoi( obj->strings[0] );
+}
+
+
+/* Messages and timers */
+
+void* AaSysComCreate( SAaSysComMsgId msgid, SAaSysComSicad sender, SAaSysComSicad receiver, u16 pl_size )
+{
+  SMsgHeader *msg = calloc( 1, sizeof(SMsgHeader) + pl_size );
+
+  msg->msg_id = msgid;
+  msg->sender = sender;
+  msg->target = receiver;
+  msg->pl_size = pl_size;
+  return msg;
+}
+
+void* AaSysComGetPayload( void* msg_ptr )
+{
+  return (SMsgHeader*)msg_ptr + 1;
+}
+
+OSStatus AaSysComSend( void* msg_ptr )
+{
+  SMsgHeader *msg = msg_ptr;
+
+  if( msg->msg_id == API_MESSAGE_ID_PLAY_REQ ) {
+    last_play = *(ApiPlayReq*)AaSysComGetPayload( msg );
+    plays++;
+  }
+  free( msg );
+  return kNoErr;
+}
+
+void* AaSysComReceiveHandler( SAaSysComSicad receiver, u32 timeout )
+{
+  UNUSED_PARAMETER( receiver );
+  UNUSED_PARAMETER( timeout );
+  return NULL;
+}
+
+OSStatus AaSysComDestory( void* msg_ptr )
+{
+  free( msg_ptr );
+  return kNoErr;
+}
+
+void AaTimerSetup( SAaTimer* timer, SAaSysComSicad receiver, AaTimerHandler handler, void* arg )
+{
+  assert( timer_count < MAX_TIMERS );
+  memset( timer, 0, sizeof(SAaTimer) );
+  timer->receiver = receiver;
+  timer->handler = handler;
+  timer->arg = arg;
+  timers[timer_count++] = timer;
+}
+
+OSStatus AaTimerStart( SAaTimer* timer, u32 delay_ms )
+{
+  timer->pending = true;
+  timer->delay_ms = delay_ms;
+  timer->starts++;
+  return kNoErr;
+}
+
+OSStatus AaTimerStop( SAaTimer* timer )
+{
+  timer->pending = false;
+  return kNoErr;
+}
+
+void AaTimerDispatch( void* msg_ptr )
+{
+  UNUSED_PARAMETER( msg_ptr );
+}
+
+static SAaTimer* schedule_timer( u8 index )
+{
+  return timers[MAX_DEPTH_PUTDOWN + index];
+}
+
+/* What the health thread does when the timer message arrives */
+static void schedule_fire( u8 index )
+{
+  SAaTimer *timer = schedule_timer( index );
+
+  assert( timer->pending );
+  timer->pending = false;
+  timer->handler( timer->arg );
+}
+
+
+/* The rest of the application */
+
+void OMFactoryInit( void )
+{
+}
+
+void OMFactorySave( void )
+{
+  om_saves++;
+}
+
+bool CheckTrackType( u8 type )
+{
+  return type < TRACKTYPE_MAX;
+}
+
+OSStatus OuterTriggerStartDetect( OuterTriggerCallback callback )
+{
+  UNUSED_PARAMETER( callback );
+  return kNoErr;
+}
+
+bool SendJsonBool( app_context_t *arg, char* str, bool value )
+{
+  UNUSED_PARAMETER( arg );
+  UNUSED_PARAMETER( str );
+  UNUSED_PARAMETER( value );
+  return true;
+}
+
+bool SendJsonInt( app_context_t *arg, char* str, int value )
+{
+  UNUSED_PARAMETER( arg );
+  UNUSED_PARAMETER( str );
+  UNUSED_PARAMETER( value );
+  return true;
+}
+
+bool SendJsonLedConf( app_context_t *arg )
+{
+  UNUSED_PARAMETER( arg );
+  return true;
+}
+
+bool SendJsonProfile( app_context_t *arg )
+{
+  UNUSED_PARAMETER( arg );
+  return true;
+}
+
+
+/* Scenarios */
+
+static void downstream_start( void )
+{
+  pthread_t thread;
+
+  assert( pthread_create( &thread, NULL, (void *(*)( void * ))user_downstream_thread, &app_context ) == 0 );
+  pthread_detach( thread );
+}
+
+int main( void )
+{
+  int saves;
+
+  setvbuf( stdout, NULL, _IOLBF, 0 );
+
+  wall_minutes = MINUTES( 8, 0 );
+  MOInit( );
+  assert( HealthInit( &app_context ) == kNoErr );
+  assert( timer_count == MAX_TIMERS );
+  assert( !schedule_timer( 0 )->pending );
+  downstream_start( );
+
+  /* Enabled from the cloud: armed for 09:30 today */
+  saves = om_saves;
+  cloud_send( "{\"HEALTH-1/SCHEDULE-1/Enable\":true,\"HEALTH-1/SCHEDULE-1/RemindHour\":9,"
+              "\"HEALTH-1/SCHEDULE-1/RemindMinute\":30,\"HEALTH-1/SCHEDULE-1/RemindTimes\":2,"
+              "\"HEALTH-1/SCHEDULE-1/TrackType\":1,\"HEALTH-1/SCHEDULE-1/SelTrack\":3}" );
+  assert( om_saves == saves + 1 );
+  assert( schedule_timer( 0 )->pending );
+  assert( schedule_timer( 0 )->delay_ms == DELAY_MS( 90 ) );
+  assert( !schedule_timer( 1 )->pending );
+  printf( "schedule enabled from the cloud: ok\r\n" );
+
+  /* Moved before the current time: armed for 07:15 tomorrow */
+  wall_minutes = MINUTES( 8, 10 );
+  cloud_send( "{\"HEALTH-1/SCHEDULE-1/Enable\":true,\"HEALTH-1/SCHEDULE-1/RemindHour\":7,"
+              "\"HEALTH-1/SCHEDULE-1/RemindMinute\":15,\"HEALTH-1/SCHEDULE-1/RemindTimes\":2,"
+              "\"HEALTH-1/SCHEDULE-1/TrackType\":1,\"HEALTH-1/SCHEDULE-1/SelTrack\":3}" );
+  assert( schedule_timer( 0 )->pending );
+  assert( schedule_timer( 0 )->delay_ms == DELAY_MS( MINUTES( 24, 0 ) - MINUTES( 8, 10 ) + MINUTES( 7, 15 ) ) );
+  printf( "schedule moved from the cloud: ok\r\n" );
+
+  /* Fires at the new time with the new track, then waits for the next day */
+  wall_minutes = MINUTES( 7, 15 );
+  plays = 0;
+  schedule_fire( 0 );
+  assert( plays == 2 );
+  assert( last_play.type == 0 && last_play.track_index == 3 );
+  assert( schedule_timer( 0 )->pending );
+  assert( schedule_timer( 0 )->delay_ms == DELAY_MS( MINUTES( 24, 0 ) ) );
+  printf( "schedule fired at the edited time: ok\r\n" );
+
+  /* Another schedule edited, this one keeps its timer */
+  wall_minutes = MINUTES( 12, 0 );
+  cloud_send( "{\"HEALTH-1/SCHEDULE-2/Enable\":true,\"HEALTH-1/SCHEDULE-2/RemindHour\":12,"
+              "\"HEALTH-1/SCHEDULE-2/RemindMinute\":45,\"HEALTH-1/SCHEDULE-2/RemindTimes\":1,"
+              "\"HEALTH-1/SCHEDULE-2/TrackType\":2,\"HEALTH-1/SCHEDULE-2/SelTrack\":1}" );
+  assert( schedule_timer( 1 )->pending );
+  assert( schedule_timer( 1 )->delay_ms == DELAY_MS( 45 ) );
+  assert( schedule_timer( 0 )->delay_ms == DELAY_MS( MINUTES( 24, 0 ) ) );
+  printf( "other schedule untouched: ok\r\n" );
+
+  /* Disabled from the cloud: stopped */
+  cloud_send( "{\"HEALTH-1/SCHEDULE-1/Enable\":false,\"HEALTH-1/SCHEDULE-1/RemindHour\":7,"
+              "\"HEALTH-1/SCHEDULE-1/RemindMinute\":15,\"HEALTH-1/SCHEDULE-1/RemindTimes\":2,"
+              "\"HEALTH-1/SCHEDULE-1/TrackType\":1,\"HEALTH-1/SCHEDULE-1/SelTrack\":3}" );
+  assert( !schedule_timer( 0 )->pending );
+  assert( schedule_timer( 1 )->pending );
+  printf( "schedule disabled from the cloud: ok\r\n" );
+
+  printf( "all scenarios: ok\r\n" );
+  return 0;
+}
@@ -0,0 +1,86 @@
+/* Host stand-in for AaInclude.h: message ids and payloads the code under
+   test sends, the timer type, and the calls the test records. Logging is
+   dropped. */
+
+#ifndef _AAINCLUDE_H_
+#define _AAINCLUDE_H_
+
+#include "Object_int.h"
+#include "mico.h"
+
+/* AaSysCom.h */
+typedef u32 SAaSysComMsgId;
+typedef u16 SAaSysComSicad;
+
+typedef struct SMsgHeader_t {
+    SAaSysComMsgId  msg_id;
+    SAaSysComSicad  target;
+    SAaSysComSicad  sender;
+    u16             pl_size;
+} SMsgHeader;
+
+enum {
+    MsgQueue_DownStream,
+    MsgQueue_DeviceHandler,
+    MsgQueue_MusicHandler,
+    MsgQueue_HealthHandler,
+    MsgQueue_ControllerBus,
+    MsgQueue_MAX,
+    MsgQueue_Unknow,
+};
+
+void* AaSysComCreate(SAaSysComMsgId msgid, SAaSysComSicad sender, SAaSysComSicad receiver, u16 pl_size);
+void* AaSysComGetPayload(void* msg_ptr);
+OSStatus AaSysComSend(void* msg_ptr);
+void* AaSysComReceiveHandler(SAaSysComSicad receiver, u32 timeout);
+OSStatus AaSysComDestory(void* msg_ptr);
+
+/* ApiInternalMsg.h */
+enum {
+    API_MESSAGE_ID_PLAY_REQ = 1,
+    API_MESSAGE_ID_QUIT_REQ,
+    API_MESSAGE_ID_VOLUME_REQ,
+    API_MESSAGE_ID_TRACKLIST_REQ,
+    API_MESSAGE_ID_CUPSTATUS_IND,
+    API_MESSAGE_ID_TIMER_IND,
+};
+
+typedef struct { u8 type; u16 track_index; } ApiPlayReq;
+typedef struct { u8 reserve; } ApiQuitReq;
+typedef struct { u8 volume; } ApiVolumeReq;
+typedef struct { u8 reserve; } ApiTrackListReq;
+typedef struct { u8 status; } ApiCupStatusInd;
+
+/* AaSysLog.h */
+enum {
+    LOGLEVEL_CLS = 0,
+    LOGLEVEL_ERR,
+    LOGLEVEL_WRN,
+    LOGLEVEL_INF,
+    LOGLEVEL_DBG,
+    LOGLEVEL_ALL,
+};
+
+#define AaSysLogPrint(level, M, ...)    do {} while( 0 )
+
+/* AaTimer.h */
+typedef void (*AaTimerHandler)(void* arg);
+
+typedef struct SAaTimer_t {
+    bool                pending;
+    u32                 delay_ms;       /* of the last start */
+    u32                 starts;
+    AaTimerHandler      handler;
+    void*               arg;
+    SAaSysComSicad      receiver;
+} SAaTimer;
+
+void AaTimerSetup(SAaTimer* timer, SAaSysComSicad receiver, AaTimerHandler handler, void* arg);
+OSStatus AaTimerStart(SAaTimer* timer, u32 delay_ms);
+OSStatus AaTimerStop(SAaTimer* timer);
+void AaTimerDispatch(void* msg_ptr);
+
+/* AaThread.h */
+OSStatus AaThreadCreate(mico_thread_t* thread, uint8_t priority, const char* name, mico_thread_function_t function, uint32_t stack_size, void* arg);
+
+#endif /* _AAINCLUDE_H_ */
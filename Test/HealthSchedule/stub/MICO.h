@@ -0,0 +1,3 @@
+/* Host stand-in for MICO.h, same as mico.h */
+
+#include "mico.h"
@@ -0,0 +1,22 @@
+/* Host stand-in for MicoFogCloud.h: the context is opaque to the code under
+   test, MiCOFogCloudMsgRecv hands out the messages the test queued. */
+
+#ifndef __MICO_FOGCLOUD_H_
+#define __MICO_FOGCLOUD_H_
+
+#include "mico.h"
+
+typedef struct _app_context_t
+{
+  int               unused;
+} app_context_t;
+
+typedef struct _fogcloud_msg_t {
+  uint32_t topic_len;
+  uint32_t data_len;
+  uint8_t data[1];
+} fogcloud_msg_t;
+
+OSStatus MiCOFogCloudMsgRecv( app_context_t* const context, fogcloud_msg_t **msg, uint32_t timeout_ms );
+
+#endif /* __MICO_FOGCLOUD_H_ */
@@ -0,0 +1 @@
+/* Host stand-in for TimeUtils.h, nothing is used */
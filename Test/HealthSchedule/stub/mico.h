@@ -0,0 +1,68 @@
+/* Host stand-in for mico.h: only what user_downstream.c, If_MO.c and
+   HealthMonitor.c use. The RTOS calls and the json-c subset are implemented
+   by the test. */
+
+#ifndef __MICO_H__
+#define __MICO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef int OSStatus;
+
+#define kNoErr                  0
+#define kGeneralErr             -1
+#define kUnknownErr             -6700
+#define kParamErr               -6705
+#define kNotInitializedErr      -6718
+
+#define UNUSED_PARAMETER( x )   ( (void)( x ) )
+
+/* Debug.h, the log is dropped */
+#define custom_log( N, M, ... )                 do {} while( 0 )
+#define custom_log_trace( N )                   do {} while( 0 )
+
+#define require(X, LABEL)                       do { if( !(X) ) goto LABEL; } while(0)
+#define require_noerr(ERR, LABEL)               do { if( (ERR) != 0 ) goto LABEL; } while(0)
+#define require_noerr_action(ERR, LABEL, ACTION) \
+                                                do { if( (ERR) != 0 ) { { ACTION; } goto LABEL; } } while(0)
+
+/* mico_rtos.h */
+#define MICO_WAIT_FOREVER               ( 0xFFFFFFFF )
+#define MICO_APPLICATION_PRIORITY       ( 7 )
+
+typedef void (*mico_thread_function_t)( void* arg );
+typedef void (*mico_gpio_irq_handler_t)( void* arg );
+typedef void* mico_mutex_t;
+typedef void* mico_thread_t;
+typedef void* mico_timer_t;
+
+OSStatus mico_rtos_init_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex );
+void mico_thread_sleep( uint32_t seconds );
+uint32_t mico_get_time( void );
+
+/* json-c, flat objects of strings, booleans and integers */
+typedef struct json_object
+{
+  int                   count;
+  char                  keys[16][40];
+  char                  strings[16][32];
+  struct json_object   *values;
+} json_object;
+
+json_object* json_tokener_parse( const char *str );
+void json_object_put( json_object *obj );
+const char* json_object_get_string( json_object *obj );
+bool json_object_get_boolean( json_object *obj );
+int32_t json_object_get_int( json_object *obj );
+
+#define json_object_object_foreach( obj, key, val ) \
+  char *key; json_object *val; \
+  for( int key##_i = 0; key##_i < (obj)->count && ( key = (obj)->keys[key##_i], val = &(obj)->values[key##_i], 1 ); key##_i++ )
+
+#endif /* __MICO_H__ */
@@ -0,0 +1,8 @@
+/* Host stand-in for led_effect.h, led.h only needs the type */
+
+#ifndef __LED_EFFECT_H_
+#define __LED_EFFECT_H_
+
+typedef struct led_effect_s led_effect_t;
+
+#endif /* __LED_EFFECT_H_ */
@@ -0,0 +1,10 @@
+/* Host stand-in for sntp.h, the test sets the wall clock */
+
+#ifndef __SNTP_H__
+#define __SNTP_H__
+
+#include <time.h>
+
+void sntp_current_time_get( struct tm *time );
+
+#endif /* __SNTP_H__ */
@@ -0,0 +1,566 @@
+/**
+  ******************************************************************************
+  * @file    mqtt_client_test.c
+  * @brief   Host test of the non-blocking MQTT client in libemqtt.c, run
+  *          against a broker stub in the same process: QoS 1 retransmission
+  *          and give-up, keep-alive and its timeout, remaining lengths up to
+  *          4 bytes and resending after a reconnect.
+  *
+  *          Build and run from the repository root:
+  *
+  *          gcc -O2 -ITest/MQTTClient/stub -Ilibraries/utilities \
+  *              -IDemos/micokit/SiteWhere_Enjoy/SiteWhere \
+  *              -o mqtt_client_test Test/MQTTClient/mqtt_client_test.c \
+  *              Demos/micokit/SiteWhere_Enjoy/SiteWhere/libemqtt.c \
+  *              libraries/utilities/RingBufferUtils.c
+  *          ./mqtt_client_test
+  *
+  *          The socket is a pair of byte queues. The broker stub parses what
+  *          the client sends and answers like a broker would, unless told to
+  *          drop acknowledgements or stay silent on PINGREQ. Both directions
+  *          can be limited to a few bytes per call, so packets are split
+  *          across reads and writes the way TCP may split them.
+  ******************************************************************************
+  */
+
+#include <assert.h>
+#include <stdio.h>
+#include "libemqtt.h"
+
+#define LINK_SIZE           ( 4u * 1024 * 1024 )
+#define NO_LIMIT            0xFFFFFFFFu
+#define KEEP_ALIVE_S        10
+#define MAX_EVENTS          32
+
+typedef struct
+{
+  /* Client to broker, bytes not parsed yet */
+  uint8_t   up[LINK_SIZE];
+  uint32_t  up_len;
+  uint32_t  up_total;
+  /* Broker to client */
+  uint8_t   down[LINK_SIZE];
+  uint32_t  down_len;
+  uint32_t  down_pos;
+  uint32_t  send_limit;
+  uint32_t  recv_limit;
+  bool      closed;
+  /* Behaviour */
+  uint8_t   connack_code;
+  uint32_t  drop_acks;          /* QoS 1/2 publishes left unacknowledged */
+  bool      mute_ping;
+  /* What the broker has seen */
+  uint32_t  connects;
+  uint32_t  pingreqs;
+  uint32_t  publishes;
+  uint32_t  dups;
+  uint16_t  last_id;
+  uint32_t  last_length;
+} broker_t;
+
+typedef struct
+{
+  mqtt_client_event_t event;
+  uint16_t            msg_id;
+  uint8_t             code;
+} event_t;
+
+static broker_t broker;
+static mqtt_client_t client;
+static uint32_t now = 1000;
+
+static event_t events[MAX_EVENTS];
+static uint32_t event_count;
+
+static uint32_t messages;
+static char message_topic[64];
+static uint32_t message_length;
+
+static int link_send( void* socket_info, const void* buf, unsigned int count )
+{
+  broker_t *b = socket_info;
+
+  if( b->closed )
+    return -1;
+  if( count > b->send_limit )
+    count = b->send_limit;
+  if( count > LINK_SIZE - b->up_len )
+    count = LINK_SIZE - b->up_len;
+  memcpy( b->up + b->up_len, buf, count );
+  b->up_len += count;
+  b->up_total += count;
+  return count;
+}
+
+static int link_recv( void* socket_info, void* buf, unsigned int count )
+{
+  broker_t *b = socket_info;
+  uint32_t have = b->down_len - b->down_pos;
+
+  if( b->closed )
+    return -1;
+  if( count > have )
+    count = have;
+  if( count > b->recv_limit )
+    count = b->recv_limit;
+  memcpy( buf, b->down + b->down_pos, count );
+  b->down_pos += count;
+  return count;
+}
+
+static void on_message( mqtt_client_t* c, const char* topic, uint16_t topic_len, const uint8_t* payload, uint32_t length, uint8_t qos )
+{
+  (void)c; (void)payload; (void)qos;
+  assert( topic_len < sizeof(message_topic) );
+  memcpy( message_topic, topic, topic_len );
+  message_topic[topic_len] = 0;
+  message_length = length;
+  messages++;
+}
+
+static void on_event( mqtt_client_t* c, mqtt_client_event_t event, uint16_t msg_id, uint8_t code )
+{
+  (void)c;
+  assert( event_count < MAX_EVENTS );
+  events[event_count].event = event;
+  events[event_count].msg_id = msg_id;
+  events[event_count].code = code;
+  event_count++;
+}
+
+static const mqtt_client_ops_t ops = { link_send, link_recv, on_message, on_event };
+
+/* Number of events of one kind since the last clear_events */
+static uint32_t count_events( mqtt_client_event_t event, uint16_t msg_id )
+{
+  uint32_t i, n = 0;
+
+  for( i = 0; i < event_count; i++ )
+    if( events[i].event == event && ( msg_id == 0 || events[i].msg_id == msg_id ) )
+      n++;
+  return n;
+}
+
+static void clear_events( void )
+{
+  event_count = 0;
+}
+
+/* Writes the remaining length encoding, returns its size */
+static uint8_t encode_length( uint8_t *p, uint32_t value )
+{
+  uint8_t n = 0;
+
+  do {
+    p[n] = value % 128;
+    value /= 128;
+    if( value )
+      p[n] |= 0x80;
+    n++;
+  } while( value );
+  return n;
+}
+
+static void broker_queue( const uint8_t *packet, uint32_t length )
+{
+  assert( broker.down_len + length <= LINK_SIZE );
+  memcpy( broker.down + broker.down_len, packet, length );
+  broker.down_len += length;
+}
+
+static void broker_ack( uint8_t type, uint16_t msg_id )
+{
+  uint8_t packet[4] = { type, 2, msg_id >> 8, msg_id & 0xFF };
+  broker_queue( packet, sizeof(packet) );
+}
+
+/* Queues a PUBLISH to the client, the payload is a fill byte */
+static void broker_publish( const char *topic, uint32_t length, uint8_t qos, uint16_t msg_id )
+{
+  static uint8_t packet[LINK_SIZE];
+  uint16_t topic_len = strlen( topic );
+  uint32_t rem_len = 2 + topic_len + ( qos ? 2 : 0 ) + length;
+  uint32_t n = 0;
+
+  packet[n++] = MQTT_MSG_PUBLISH | ( qos << 1 );
+  n += encode_length( packet + n, rem_len );
+  packet[n++] = topic_len >> 8;
+  packet[n++] = topic_len & 0xFF;
+  memcpy( packet + n, topic, topic_len );
+  n += topic_len;
+  if( qos ) {
+    packet[n++] = msg_id >> 8;
+    packet[n++] = msg_id & 0xFF;
+  }
+  memset( packet + n, 'p', length );
+  broker_queue( packet, n + length );
+}
+
+static void broker_handle( const uint8_t *p, uint32_t length )
+{
+  uint8_t rlb = mqtt_num_rem_len_bytes( p );
+  const uint8_t *body = p + 1 + rlb;
+  uint32_t rem_len = length - 1 - rlb;
+  uint16_t topic_len, msg_id;
+  uint8_t qos;
+
+  switch( MQTTParseMessageType( p ) ) {
+  case MQTT_MSG_CONNECT: {
+    uint8_t connack[4] = { MQTT_MSG_CONNACK, 2, 0, broker.connack_code };
+    assert( rem_len >= 10 && memcmp( body, "\0\4MQTT\4", 7 ) == 0 );
+    assert( ( ( body[8] << 8 ) | body[9] ) == client.broker.alive );
+    broker.connects++;
+    broker_queue( connack, sizeof(connack) );
+    break;
+  }
+
+  case MQTT_MSG_PUBLISH:
+    qos = MQTTParseMessageQos( p );
+    topic_len = ( body[0] << 8 ) | body[1];
+    msg_id = qos ? ( body[2 + topic_len] << 8 ) | body[3 + topic_len] : 0;
+    broker.publishes++;
+    broker.last_id = msg_id;
+    broker.last_length = rem_len - 2 - topic_len - ( qos ? 2 : 0 );
+    if( MQTTParseMessageDuplicate( p ) ) {
+      assert( qos );
+      broker.dups++;
+    }
+    if( qos && broker.drop_acks ) {
+      broker.drop_acks--;
+    } else if( qos == 1 ) {
+      broker_ack( MQTT_MSG_PUBACK, msg_id );
+    } else if( qos == 2 ) {
+      broker_ack( MQTT_MSG_PUBREC, msg_id );
+    }
+    break;
+
+  case MQTT_MSG_PUBREL:
+    assert( ( p[0] & 0x0F ) == 0x02 );
+    broker_ack( MQTT_MSG_PUBCOMP, ( body[0] << 8 ) | body[1] );
+    break;
+
+  case MQTT_MSG_SUBSCRIBE: {
+    uint8_t suback[5] = { MQTT_MSG_SUBACK, 3, body[0], body[1], body[rem_len - 1] };
+    assert( ( p[0] & 0x0F ) == 0x02 );
+    broker_queue( suback, sizeof(suback) );
+    break;
+  }
+
+  case MQTT_MSG_PINGREQ:
+    broker.pingreqs++;
+    if( !broker.mute_ping ) {
+      uint8_t pingresp[2] = { MQTT_MSG_PINGRESP, 0 };
+      broker_queue( pingresp, sizeof(pingresp) );
+    }
+    break;
+
+  case MQTT_MSG_PUBACK:
+  case MQTT_MSG_PUBREC:
+  case MQTT_MSG_PUBCOMP:
+  case MQTT_MSG_DISCONNECT:
+    break;
+
+  default:
+    assert( 0 );
+  }
+}
+
+/* Parses every complete packet the client sent */
+static void broker_process( void )
+{
+  uint32_t offset = 0, value, multiplier, length;
+  uint8_t i;
+
+  while( broker.up_len - offset >= 2 ) {
+    const uint8_t *p = broker.up + offset;
+
+    value = 0;
+    multiplier = 1;
+    length = 0;
+    for( i = 1; i <= 4 && offset + i < broker.up_len; i++ ) {
+      value += ( p[i] & 127 ) * multiplier;
+      multiplier *= 128;
+      if( ( p[i] & 128 ) == 0 ) {
+        length = 1 + i + value;
+        break;
+      }
+    }
+    assert( i <= 4 );
+    if( length == 0 || length > broker.up_len - offset )
+      break;
+    broker_handle( p, length );
+    offset += length;
+  }
+  memmove( broker.up, broker.up + offset, broker.up_len - offset );
+  broker.up_len -= offset;
+}
+
+/* A new TCP connection to the broker */
+static void link_open( void )
+{
+  broker.up_len = 0;
+  broker.down_len = 0;
+  broker.down_pos = 0;
+  broker.closed = false;
+}
+
+/* Polls at the current time until neither side has anything left to move */
+static int exchange( void )
+{
+  uint32_t up, down;
+  int ret;
+
+  do {
+    up = broker.up_total;
+    down = broker.down_pos;
+    ret = mqtt_client_poll( &client, now );
+    broker_process( );
+  } while( ret == 0 && ( broker.up_total != up || broker.down_pos != down || mqtt_client_wants_write( &client ) ) );
+  return ret;
+}
+
+static int advance( uint32_t ms )
+{
+  now += ms;
+  return exchange( );
+}
+
+static void open_session( void )
+{
+  link_open( );
+  clear_events( );
+  assert( mqtt_client_connect( &client, &broker, now ) == 1 );
+  assert( exchange( ) == 0 );
+  assert( client.state == MQTT_CLIENT_CONNECTED );
+  assert( count_events( MQTT_EVENT_CONNECTED, 0 ) == 1 );
+}
+
+static void test_connect( void )
+{
+  uint16_t msg_id;
+
+  memset( &broker, 0, sizeof(broker) );
+  broker.send_limit = NO_LIMIT;
+  broker.recv_limit = NO_LIMIT;
+  mqtt_client_init( &client, &ops, &broker, "mico" );
+  client.broker.alive = KEEP_ALIVE_S;
+
+  /* CONNACK refused */
+  link_open( );
+  broker.connack_code = 5;
+  assert( mqtt_client_connect( &client, &broker, now ) == 1 );
+  assert( exchange( ) == -1 );
+  assert( count_events( MQTT_EVENT_CONNECT_REFUSED, 0 ) == 1 && events[0].code == 5 );
+  broker.connack_code = 0;
+
+  /* Packets split into single bytes both ways */
+  broker.send_limit = 1;
+  broker.recv_limit = 1;
+  open_session( );
+  assert( broker.connects == 2 );
+  assert( mqtt_client_subscribe( &client, "mico/cmd", 1, &msg_id ) == 1 );
+  assert( exchange( ) == 0 );
+  assert( count_events( MQTT_EVENT_SUBACK, msg_id ) == 1 && events[event_count - 1].code == 1 );
+  broker.send_limit = NO_LIMIT;
+  broker.recv_limit = NO_LIMIT;
+
+  printf( "connect: ok\r\n" );
+}
+
+static void test_retransmit( void )
+{
+  uint32_t publishes = broker.publishes;
+  uint32_t retransmits = client.stats.retransmits;
+  uint16_t msg_id;
+
+  /* The first PUBACK is lost, the copy sent after MQTT_CLIENT_RETRY_MS has DUP set */
+  clear_events( );
+  broker.drop_acks = 1;
+  assert( mqtt_client_publish( &client, "mico/data", "hello", 5, 1, 0, &msg_id ) == 1 );
+  assert( exchange( ) == 0 );
+  assert( broker.publishes == publishes + 1 && broker.dups == 0 );
+  assert( advance( MQTT_CLIENT_RETRY_MS - 1 ) == 0 );
+  assert( broker.publishes == publishes + 1 );
+  assert( advance( 1 ) == 0 );
+  assert( broker.publishes == publishes + 2 && broker.dups == 1 );
+  assert( broker.last_id == msg_id && broker.last_length == 5 );
+  assert( client.stats.retransmits == retransmits + 1 );
+  assert( count_events( MQTT_EVENT_PUBLISHED, msg_id ) == 1 );
+
+  /* QoS 2 runs PUBLISH, PUBREC, PUBREL, PUBCOMP */
+  clear_events( );
+  assert( mqtt_client_publish( &client, "mico/data", "q2", 2, 2, 0, &msg_id ) == 1 );
+  assert( exchange( ) == 0 );
+  assert( count_events( MQTT_EVENT_PUBLISHED, msg_id ) == 1 && events[0].code == 2 );
+
+  printf( "retransmit: ok\r\n" );
+}
+
+static void test_give_up( void )
+{
+  uint32_t publishes = broker.publishes;
+  uint32_t dups = broker.dups;
+  uint16_t msg_id;
+  uint32_t i;
+
+  clear_events( );
+  broker.drop_acks = 100;
+  assert( mqtt_client_publish( &client, "mico/data", "lost", 4, 1, 0, &msg_id ) == 1 );
+  assert( exchange( ) == 0 );
+  for( i = 0; i < MQTT_CLIENT_MAX_RETRIES; i++ )
+    assert( advance( MQTT_CLIENT_RETRY_MS ) == 0 );
+  assert( broker.publishes == publishes + 1 + MQTT_CLIENT_MAX_RETRIES );
+  assert( broker.dups == dups + MQTT_CLIENT_MAX_RETRIES );
+  assert( count_events( MQTT_EVENT_PUBLISH_FAILED, msg_id ) == 0 );
+
+  /* One more period and the publish is given up, the connection stays up */
+  assert( advance( MQTT_CLIENT_RETRY_MS ) == 0 );
+  assert( broker.publishes == publishes + 1 + MQTT_CLIENT_MAX_RETRIES );
+  assert( count_events( MQTT_EVENT_PUBLISH_FAILED, msg_id ) == 1 );
+  assert( count_events( MQTT_EVENT_DISCONNECTED, 0 ) == 0 );
+  for( i = 0; i < MQTT_CLIENT_INFLIGHT; i++ )
+    assert( client.inflight[i].type == 0 );
+  broker.drop_acks = 0;
+
+  printf( "give up after %u retries: ok\r\n", MQTT_CLIENT_MAX_RETRIES );
+}
+
+static void test_keep_alive( void )
+{
+  uint32_t keep_alive_ms = KEEP_ALIVE_S * 1000;
+  uint32_t ping_at = keep_alive_ms - keep_alive_ms / 4;
+  uint32_t pingreqs;
+
+  /* Idle after a publish, PINGREQ a quarter period early */
+  assert( mqtt_client_publish( &client, "mico/data", "x", 1, 0, 0, NULL ) == 1 );
+  assert( exchange( ) == 0 );
+  pingreqs = broker.pingreqs;
+  assert( advance( ping_at - 1 ) == 0 );
+  assert( broker.pingreqs == pingreqs );
+  assert( advance( 1 ) == 0 );
+  assert( broker.pingreqs == pingreqs + 1 && !client.ping_outstanding );
+
+  /* Sending anything restarts the period */
+  assert( advance( ping_at - 1 ) == 0 );
+  assert( mqtt_client_publish( &client, "mico/data", "x", 1, 0, 0, NULL ) == 1 );
+  assert( exchange( ) == 0 );
+  assert( advance( 1 ) == 0 );
+  assert( broker.pingreqs == pingreqs + 1 );
+
+  /* No PINGRESP within half a period drops the connection */
+  clear_events( );
+  broker.mute_ping = true;
+  assert( advance( ping_at ) == 0 );
+  assert( broker.pingreqs == pingreqs + 2 && client.ping_outstanding );
+  assert( advance( keep_alive_ms / 2 - 1 ) == 0 );
+  assert( advance( 1 ) == -1 );
+  assert( count_events( MQTT_EVENT_DISCONNECTED, 0 ) == 1 && events[0].code == 1 );
+  broker.mute_ping = false;
+
+  /* Keep-alive 0 never pings */
+  client.broker.alive = 0;
+  open_session( );
+  pingreqs = broker.pingreqs;
+  assert( advance( 10 * keep_alive_ms ) == 0 );
+  assert( broker.pingreqs == pingreqs );
+  client.broker.alive = KEEP_ALIVE_S;
+  open_session( );
+
+  printf( "keep-alive: ok\r\n" );
+}
+
+static void test_remaining_length( void )
+{
+  /* Each encoding size at both of its ends */
+  static const uint32_t values[] = { 0, 127, 128, 16383, 16384, 2097151, 2097152, MQTT_MAX_REM_LEN };
+  static const uint8_t sizes[] = { 1, 1, 2, 2, 3, 3, 4, 4 };
+  static char payload[2200000];
+  uint8_t packet[5];
+  mqtt_broker_handle_t legacy;
+  uint16_t msg_id;
+  uint32_t i, rx_skipped;
+
+  for( i = 0; i < sizeof(values) / sizeof(values[0]); i++ ) {
+    packet[0] = MQTT_MSG_PUBLISH;
+    assert( encode_length( packet + 1, values[i] ) == sizes[i] );
+    assert( mqtt_num_rem_len_bytes( packet ) == sizes[i] );
+    assert( mqtt_parse_rem_len( packet ) == values[i] );
+  }
+
+  /* Outbound packets on both sides of the 1 to 2 byte step, topic "t" adds 3 */
+  for( i = 124; i <= 125; i++ ) {
+    assert( mqtt_client_publish( &client, "t", payload, i, 0, 0, NULL ) == 1 );
+    assert( exchange( ) == 0 );
+    assert( broker.last_length == i );
+  }
+
+  /* Inbound packets of every length size, read in odd pieces. The ones larger
+     than MQTT_CLIENT_RX_SIZE are skipped and the packet after them still arrives */
+  messages = 0;
+  rx_skipped = client.stats.rx_skipped;
+  broker.recv_limit = 777;
+  broker_publish( "a", 10, 0, 0 );
+  broker_publish( "b", 200, 1, 7 );
+  broker_publish( "c", MQTT_CLIENT_RX_SIZE - 8, 1, 8 );
+  broker_publish( "d", MQTT_CLIENT_RX_SIZE - 7, 1, 9 );
+  broker_publish( "e", 20000, 0, 0 );
+  broker_publish( "f", 3000000, 0, 0 );
+  broker_publish( "g", 3, 0, 0 );
+  assert( exchange( ) == 0 );
+  assert( broker.down_pos == broker.down_len );
+  assert( messages == 4 && strcmp( message_topic, "g" ) == 0 && message_length == 3 );
+  assert( client.stats.rx_skipped == rx_skipped + 3 );
+  broker.recv_limit = NO_LIMIT;
+
+  /* The legacy encoder writes a 4 byte length for a payload over 2,097,151 bytes */
+  mqtt_init( &legacy, "legacy" );
+  legacy.socket_info = &broker;
+  legacy.send = link_send;
+  broker.up_len = 0;
+  assert( mqtt_publish_with_qos( &legacy, "big", payload, sizeof(payload), 0, 1, &msg_id ) == 1 );
+  assert( mqtt_num_rem_len_bytes( broker.up ) == 4 );
+  assert( mqtt_parse_rem_len( broker.up ) == 2 + 3 + 2 + sizeof(payload) );
+  assert( broker.up_len == 1 + 4 + 2 + 3 + 2 + sizeof(payload) );
+  broker_process( );
+  assert( broker.last_id == msg_id && broker.last_length == sizeof(payload) );
+  link_open( );
+
+  printf( "remaining length: ok\r\n" );
+}
+
+static void test_reconnect( void )
+{
+  uint32_t dups = broker.dups;
+  uint16_t msg_id;
+
+  /* The connection drops before the PUBACK */
+  clear_events( );
+  broker.drop_acks = 1;
+  assert( mqtt_client_publish( &client, "mico/data", "again", 5, 1, 0, &msg_id ) == 1 );
+  assert( exchange( ) == 0 );
+  broker.closed = true;
+  assert( advance( 1 ) == -1 );
+  assert( count_events( MQTT_EVENT_DISCONNECTED, 0 ) == 1 && events[0].code == 0 );
+
+  /* Sent again with DUP once the new CONNACK is in */
+  open_session( );
+  assert( broker.dups == dups + 1 && broker.last_id == msg_id && broker.last_length == 5 );
+  assert( count_events( MQTT_EVENT_PUBLISHED, msg_id ) == 1 );
+
+  printf( "reconnect: ok\r\n" );
+}
+
+int main( void )
+{
+  test_connect( );
+  test_retransmit( );
+  test_give_up( );
+  test_keep_alive( );
+  test_remaining_length( );
+  test_reconnect( );
+
+  printf( "client: %u packets in %u sends, %u received, %u retransmits, %u skipped\r\n",
+          client.stats.tx_packets, client.stats.tx_batches, client.stats.rx_packets,
+          client.stats.retransmits, client.stats.rx_skipped );
+  return 0;
+}
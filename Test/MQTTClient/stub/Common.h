@@ -0,0 +1,16 @@
+/* Host stand-in for Common.h, enough for libemqtt and RingBufferUtils */
+
+#ifndef __Common_h__
+#define __Common_h__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef int32_t     OSStatus;
+
+#define kNoErr                  0
+
+#define UNUSED_PARAMETER( x )   ( (void)( x ) )
+
+#endif // __Common_h__
@@ -0,0 +1,287 @@
+/**
+  ******************************************************************************
+  * @file    para_storage_test.c
+  * @brief   Host test of the parameter log in mico_system_para_storage.c:
+  *          updates, boot table changes, migration from the legacy layout,
+  *          and power cuts injected at random points of a save.
+  *
+  *          Build and run from the repository root:
+  *
+  *          gcc -O2 -ITest/ParaStorage/stub -Ilibraries/utilities \
+  *              -o para_storage_test Test/ParaStorage/para_storage_test.c \
+  *              MICO/system/mico_system_para_storage.c libraries/utilities/CheckSumUtils.c
+  *          ./para_storage_test
+  *
+  *          Both parameter partitions are simulated in RAM with NOR flash
+  *          rules: erase sets a sector to 0xFF, programming can only clear
+  *          bits. A power cut stops the flash after a random number of
+  *          bytes; the byte or sector in progress is left with random content.
+  ******************************************************************************
+  */
+
+#include <assert.h>
+#include "MICO.h"
+#include "mico_system.h"
+#include "CheckSumUtils.h"
+
+#define SECTOR_SIZE         4096
+#define USER_SIZE           700
+
+/* Legacy layout, see para_legacy_read */
+#define LEGACY_USER_OFFSET  0x400
+#define LEGACY_CRC_OFFSET   0xE00
+#define LEGACY_USER_SIZE    500
+
+#define POWER_CUT_ROUNDS    20000
+
+static uint8_t flash[2][SECTOR_SIZE];
+static mico_logic_partition_t flash_info = { 0, "PARA", 0, SECTOR_SIZE, 0 };
+
+/* Bytes the flash still programs before the power cut, -1: no cut */
+static long power_budget = -1;
+static bool power_lost = false;
+
+static uint32_t erases = 0;
+static uint32_t programmed = 0;
+
+static uint32_t legacy_size = USER_SIZE;
+
+static mico_Context_t context;
+static uint8_t user_data[USER_SIZE];
+
+static uint8_t *sector( mico_partition_t partition )
+{
+  assert( partition == MICO_PARTITION_PARAMETER_1 || partition == MICO_PARTITION_PARAMETER_2 );
+  return flash[partition - MICO_PARTITION_PARAMETER_1];
+}
+
+/* true if the power fails on this byte */
+static bool power_cut( void )
+{
+  if( power_budget == 0 ) {
+    power_lost = true;
+    return true;
+  }
+  if( power_budget > 0 )
+    power_budget--;
+  return false;
+}
+
+mico_logic_partition_t* MicoFlashGetInfo( mico_partition_t inPartition )
+{
+  (void)inPartition;
+  return &flash_info;
+}
+
+OSStatus MicoFlashErase( mico_partition_t inPartition, uint32_t off_set, uint32_t size )
+{
+  uint8_t *p = sector( inPartition );
+  uint32_t i;
+
+  assert( off_set == 0 && size <= SECTOR_SIZE );
+  if( power_lost )
+    return kGeneralErr;
+  if( power_cut( ) ) {
+    /* An erase that did not finish leaves any mix of old data and 0xFF */
+    for( i = 0; i < SECTOR_SIZE; i++ )
+      p[i] |= (uint8_t)rand( );
+    return kGeneralErr;
+  }
+
+  memset( p, 0xFF, SECTOR_SIZE );
+  erases++;
+  return kNoErr;
+}
+
+OSStatus MicoFlashWrite( mico_partition_t inPartition, volatile uint32_t* off_set, uint8_t* inBuffer, uint32_t inBufferLength )
+{
+  uint8_t *p = sector( inPartition );
+  uint32_t i;
+
+  assert( *off_set + inBufferLength <= SECTOR_SIZE );
+  for( i = 0; i < inBufferLength; i++ ) {
+    if( power_lost )
+      return kGeneralErr;
+    if( power_cut( ) ) {
+      /* Some of the bits being cleared made it */
+      p[*off_set] &= inBuffer[i] | (uint8_t)rand( );
+      return kGeneralErr;
+    }
+    p[*off_set] &= inBuffer[i];
+    (*off_set)++;
+    programmed++;
+  }
+  return kNoErr;
+}
+
+OSStatus MicoFlashRead( mico_partition_t inPartition, volatile uint32_t* off_set, uint8_t* outBuffer, uint32_t inBufferLength )
+{
+  assert( *off_set + inBufferLength <= SECTOR_SIZE );
+  memcpy( outBuffer, sector( inPartition ) + *off_set, inBufferLength );
+  *off_set += inBufferLength;
+  return kNoErr;
+}
+
+/* Size of the user config in the firmware that wrote the legacy layout */
+uint32_t appLegacyConfigSize_callback( uint32_t size )
+{
+  (void)size;
+  return legacy_size;
+}
+
+/* Power up with working flash and read the settings back */
+static void boot( void )
+{
+  power_lost = false;
+  power_budget = -1;
+  memset( &context, 0, sizeof(context) );
+  memset( user_data, 0x5A, sizeof(user_data) );
+  context.user_config_data = user_data;
+  context.user_config_data_size = USER_SIZE;
+  assert( MICOReadConfiguration( &context ) == kNoErr );
+}
+
+/* Lay out a partition the way firmware before the parameter log saved it */
+static void write_legacy( mico_partition_t partition, const uint8_t *user, uint32_t size )
+{
+  uint8_t *p = sector( partition );
+  flash_content_t content;
+  CRC16_Context crc_context;
+  uint16_t crc;
+
+  memset( &content, 0, sizeof(content) );
+  strcpy( content.micoSystemConfig.name, "legacy" );
+  content.micoSystemConfig.magic_number = SYS_MAGIC_NUMBR;
+  content.micoSystemConfig.seed = 42;
+
+  CRC16_Init( &crc_context );
+  CRC16_Update( &crc_context, &content.micoSystemConfig, sizeof(mico_sys_config_t) );
+  CRC16_Update( &crc_context, user, size );
+  CRC16_Final( &crc_context, &crc );
+
+  memset( p, 0xFF, SECTOR_SIZE );
+  memcpy( p, &content, sizeof(content) );
+  memcpy( p + LEGACY_USER_OFFSET, user, size );
+  memcpy( p + LEGACY_CRC_OFFSET, &crc, sizeof(crc) );
+}
+
+static void test_legacy_migration( void )
+{
+  uint8_t legacy[LEGACY_USER_SIZE];
+  uint32_t i;
+
+  for( i = 0; i < LEGACY_USER_SIZE; i++ )
+    legacy[i] = (uint8_t)( i * 7 + 1 );
+
+  /* Older firmware with a smaller user config: the CRC only covers that size,
+     everything added since reads as zero */
+  legacy_size = LEGACY_USER_SIZE;
+  memset( flash, 0xFF, sizeof(flash) );
+  write_legacy( MICO_PARTITION_PARAMETER_1, legacy, LEGACY_USER_SIZE );
+  boot( );
+  assert( strcmp( context.flashContentInRam.micoSystemConfig.name, "legacy" ) == 0 );
+  assert( memcmp( user_data, legacy, LEGACY_USER_SIZE ) == 0 );
+  for( i = LEGACY_USER_SIZE; i < USER_SIZE; i++ )
+    assert( user_data[i] == 0 );
+
+  /* Migrated into the log, it reads back the same on the next boot */
+  boot( );
+  assert( strcmp( context.flashContentInRam.micoSystemConfig.name, "legacy" ) == 0 );
+  assert( memcmp( user_data, legacy, LEGACY_USER_SIZE ) == 0 );
+
+  /* Main copy broken, the backup partition is used */
+  memset( flash, 0xFF, sizeof(flash) );
+  write_legacy( MICO_PARTITION_PARAMETER_1, legacy, LEGACY_USER_SIZE );
+  write_legacy( MICO_PARTITION_PARAMETER_2, legacy, LEGACY_USER_SIZE );
+  sector( MICO_PARTITION_PARAMETER_1 )[LEGACY_USER_OFFSET + 3] ^= 0x10;
+  boot( );
+  assert( memcmp( user_data, legacy, LEGACY_USER_SIZE ) == 0 );
+
+  /* Both broken, defaults */
+  memset( flash, 0xFF, sizeof(flash) );
+  write_legacy( MICO_PARTITION_PARAMETER_1, legacy, LEGACY_USER_SIZE );
+  sector( MICO_PARTITION_PARAMETER_1 )[LEGACY_USER_OFFSET] ^= 0x01;
+  boot( );
+  assert( strcmp( context.flashContentInRam.micoSystemConfig.name, DEFAULT_NAME ) == 0 );
+
+  legacy_size = USER_SIZE;
+  printf( "legacy migration: ok\r\n" );
+}
+
+static void test_updates( uint8_t *model )
+{
+  uint32_t i;
+
+  memset( flash, 0xFF, sizeof(flash) );
+  boot( );
+  memcpy( model, user_data, USER_SIZE );
+
+  erases = 0;
+  programmed = 0;
+  for( i = 0; i < 2000; i++ ) {
+    user_data[i % USER_SIZE] = (uint8_t)i;
+    model[i % USER_SIZE] = (uint8_t)i;
+    assert( mico_system_context_update( &context ) == kNoErr );
+  }
+  printf( "2000 updates: %u erases, %u bytes programmed\r\n", erases, programmed );
+
+  boot( );
+  assert( memcmp( user_data, model, USER_SIZE ) == 0 );
+
+  /* The boot table lives at a fixed place for the bootloader */
+  context.flashContentInRam.bootTable.length = 0x1234;
+  context.flashContentInRam.bootTable.type = 'A';
+  assert( mico_system_context_update( &context ) == kNoErr );
+  context.flashContentInRam.bootTable.length = 0xFFFF;
+  assert( mico_system_context_update( &context ) == kNoErr );
+  boot( );
+  assert( context.flashContentInRam.bootTable.length == 0xFFFF );
+  assert( memcmp( user_data, model, USER_SIZE ) == 0 );
+}
+
+/* After a power cut during a save, the next boot must find either the old or
+   the new settings, never a mix or the defaults */
+static int test_power_cut( uint8_t *model )
+{
+  uint8_t updated[USER_SIZE];
+  uint32_t round, n;
+  uint32_t kept_old = 0, got_new = 0;
+  OSStatus err;
+
+  srand( 1 );
+  for( round = 0; round < POWER_CUT_ROUNDS; round++ ) {
+    for( n = 1 + rand( ) % 5; n > 0; n-- ) {
+      user_data[rand( ) % USER_SIZE] = (uint8_t)rand( );
+      if( rand( ) % 7 == 0 )
+        memset( user_data + rand( ) % ( USER_SIZE - 200 ), rand( ), 200 );
+    }
+    memcpy( updated, user_data, USER_SIZE );
+
+    power_budget = rand( ) % 1500;
+    err = mico_system_context_update( &context );
+    boot( );
+
+    if( memcmp( user_data, updated, USER_SIZE ) == 0 ) {
+      got_new++;
+      memcpy( model, updated, USER_SIZE );
+    } else if( memcmp( user_data, model, USER_SIZE ) == 0 ) {
+      assert( err != kNoErr );
+      kept_old++;
+    } else {
+      printf( "power cut round %u: settings corrupted\r\n", round );
+      return 1;
+    }
+  }
+
+  printf( "%u power cuts: %u saved, %u kept the old settings\r\n", POWER_CUT_ROUNDS, got_new, kept_old );
+  return 0;
+}
+
+int main( void )
+{
+  static uint8_t model[USER_SIZE];
+
+  test_legacy_migration( );
+  test_updates( model );
+  return test_power_cut( model );
+}
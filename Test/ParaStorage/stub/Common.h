@@ -0,0 +1,10 @@
+/* Host stand-in for Common.h, enough for CheckSumUtils */
+
+#ifndef __Common_h__
+#define __Common_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#endif /* __Common_h__ */
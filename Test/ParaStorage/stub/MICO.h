@@ -0,0 +1,116 @@
+/* Host stand-in for MICO.h: only what mico_system_para_storage.c uses. The
+   structures keep the field names of the firmware, not its exact layout. */
+
+#ifndef __MICO_H__
+#define __MICO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef int OSStatus;
+
+#define kNoErr                  0
+#define kGeneralErr             -1
+#define kChecksumErr            -6713
+#define kNotFoundErr            -6727
+#define kNoMemoryErr            -6728
+#define kSizeErr                -6743
+#define kNotPreparedErr         -6745
+#define kWriteErr               -6747
+
+#define __weak                  __attribute__((weak))
+
+#define require(X, LABEL)                       do { if( !(X) ) goto LABEL; } while(0)
+#define require_action(X, LABEL, ACTION)        do { if( !(X) ) { { ACTION; } goto LABEL; } } while(0)
+#define require_noerr(ERR, LABEL)               do { if( (ERR) != 0 ) goto LABEL; } while(0)
+#define require_noerr_action(ERR, LABEL, ACTION) do { if( (ERR) != 0 ) { { ACTION; } goto LABEL; } } while(0)
+
+typedef enum
+{
+  MICO_PARTITION_PARAMETER_1 = 5,
+  MICO_PARTITION_PARAMETER_2,
+  MICO_PARTITION_NONE = 20,
+} mico_partition_t;
+
+typedef struct
+{
+  int                         partition_owner;
+  const char*                 partition_description;
+  uint32_t                    partition_start_addr;
+  uint32_t                    partition_length;
+  uint32_t                    partition_options;
+} mico_logic_partition_t;
+
+mico_logic_partition_t* MicoFlashGetInfo( mico_partition_t inPartition );
+OSStatus MicoFlashErase( mico_partition_t inPartition, uint32_t off_set, uint32_t size );
+OSStatus MicoFlashWrite( mico_partition_t inPartition, volatile uint32_t* off_set, uint8_t* inBuffer, uint32_t inBufferLength );
+OSStatus MicoFlashRead( mico_partition_t inPartition, volatile uint32_t* off_set, uint8_t* outBuffer, uint32_t inBufferLength );
+
+#define DEFAULT_NAME            "MiCO Device"
+#define DHCP_Disable            0
+#define SYS_MAGIC_NUMBR         0xA43E2165
+#define EASYLINK_BYPASS_NO      0
+
+enum
+{
+  unConfigured,
+  wLanUnConfigured,
+  allConfigured,
+  mfgConfigured,
+};
+
+typedef struct
+{
+  uint32_t  start_address;
+  uint32_t  length;
+  uint8_t   version[8];
+  uint8_t   type;
+  uint8_t   upgrade_type;
+  uint16_t  crc;
+  uint8_t   reserved[4];
+} boot_table_t;
+
+typedef struct
+{
+  char      name[32];
+  char      ssid[32];
+  char      key[64];
+  int       configured;
+  uint8_t   easyLinkByPass;
+  bool      rfPowerSaveEnable;
+  bool      mcuPowerSaveEnable;
+  bool      dhcpEnable;
+  char      localIp[16];
+  char      netMask[16];
+  char      gateWay[16];
+  char      dnsServer[16];
+  uint32_t  magic_number;
+  int32_t   seed;
+} mico_sys_config_t;
+
+typedef struct
+{
+  boot_table_t        bootTable;
+  mico_sys_config_t   micoSystemConfig;
+} flash_content_t;
+
+typedef struct
+{
+  char      localIp[16];
+  char      netMask[16];
+  char      gateWay[16];
+  char      dnsServer[16];
+} system_status_wlan_t;
+
+typedef struct
+{
+  flash_content_t       flashContentInRam;
+  void*                 user_config_data;
+  uint32_t              user_config_data_size;
+  system_status_wlan_t  micoStatus;
+} mico_Context_t;
+
+#endif /* __MICO_H__ */
@@ -0,0 +1,15 @@
+/* Host stand-in for mico_system.h, MICO.h carries the types */
+
+#ifndef __MICO_SYSTEM_H__
+#define __MICO_SYSTEM_H__
+
+#include "MICO.h"
+
+void appRestoreDefault_callback( void * const user_config_data, uint32_t size );
+uint32_t appLegacyConfigSize_callback( uint32_t size );
+
+OSStatus MICOReadConfiguration( mico_Context_t *inContext );
+OSStatus mico_system_context_update( mico_Context_t *in_context );
+OSStatus mico_system_context_restore( mico_Context_t * const inContext );
+
+#endif /* __MICO_SYSTEM_H__ */
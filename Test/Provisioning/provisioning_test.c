@@ -0,0 +1,804 @@
+/**
+  ******************************************************************************
+  * @file    provisioning_test.c
+  * @brief   Replay simulation of the configuration state machine in
+  *          system_easylink.c: recorded sequences of Wi-Fi driver callbacks
+  *          and soft ap posts are played against the real easylink_thread,
+  *          and the method that won, the time to online and the radio calls
+  *          are checked.
+  *
+  *          Build and run from the repository root:
+  *
+  *          gcc -O2 -pthread -ITest/Provisioning/stub \
+  *              -o provisioning_test Test/Provisioning/provisioning_test.c \
+  *              MICO/system/easylink/system_easylink.c
+  *          ./provisioning_test
+  *
+  *          The thread runs on its own pthread, but only one side runs at a
+  *          time: the thread until it blocks, then the test, which moves a
+  *          simulated clock to the next recorded event, driver timeout or
+  *          thread deadline. A run of several minutes takes milliseconds and
+  *          is the same every time. Set PROVISIONING_VERBOSE to see the log.
+  *
+  *          The driver model delivers sniffed frames only while EasyLink runs
+  *          and posts only while the soft ap is up. An event recorded as late
+  *          is delivered anyway, to replay a source racing the winner. Once
+  *          step 1 is out the model stays silent if step 2 never comes, the
+  *          worst case for the thread.
+  ******************************************************************************
+  */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include "mico.h"
+#include "mico_config.h"
+
+#define SIM_LIMIT           ( 30u * 60 * 1000 )
+#define MAX_WINDOWS         16
+#define CONNECT_MS          3000
+
+#define AP_SSID             "home"
+#define AP_KEY              "secret"
+
+typedef enum
+{
+  EV_END,
+  EV_STEP1,                 /**< sniffer got SSID and key */
+  EV_STEP2,                 /**< sniffer got the extra data */
+  EV_POST,                  /**< configuration posted to the soft ap config server */
+} event_kind_t;
+
+typedef struct
+{
+  uint32_t              at;         /**< ms after system_easylink_start */
+  event_kind_t          kind;
+  mico_config_source_t  source;     /**< EV_STEP1: method reported by the driver */
+  const char           *ssid;       /**< EV_STEP1 */
+  const char           *key;        /**< EV_STEP1 */
+  const char           *data;       /**< EV_STEP2: extra data, EV_POST: JSON */
+  int                   length;     /**< EV_STEP2 */
+  bool                  late;       /**< delivered even if the radio is not listening */
+} replay_event_t;
+
+typedef struct
+{
+  mico_config_source_t  winner;
+  uint32_t              success_at;
+  uint32_t              windows;
+  char                  window_kind[MAX_WINDOWS];   /**< 'E' EasyLink, 'S' soft ap */
+  uint32_t              window_at[MAX_WINDOWS];
+  uint32_t              restores;
+  uint32_t              connects;
+  bool                  radio_busy_at_connect;
+  uint32_t              unheard;                    /**< events the radio was not listening for */
+  uint32_t              rejected_posts;
+  bool                  airkiss_ack;
+  char                  online[128];                /**< the thread's own report */
+} result_t;
+
+typedef enum
+{
+  THREAD_NONE,
+  THREAD_READY,
+  THREAD_RUNNING,
+  THREAD_WAIT,
+  THREAD_DONE,
+} thread_state_t;
+
+typedef struct
+{
+  int                   count;
+} sim_semaphore_t;
+
+typedef struct
+{
+  mico_thread_function_t function;
+  void                  *arg;
+} thread_start_t;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t sim_thread;
+static bool thread_turn;
+static thread_state_t thread_state;
+static sim_semaphore_t *thread_sem;         /* NULL while sleeping */
+static uint32_t thread_deadline;
+static uint32_t now;
+
+/* Wi-Fi driver model */
+static bool sniffing;
+static bool sniff_step1;
+static uint32_t sniff_end;
+static bool soft_ap_up;
+static bool station_pending;
+static uint32_t station_up_at;
+static void *notify_function[mico_notify_MAX];
+static void *notify_arg[mico_notify_MAX];
+
+static mico_Context_t context;
+static result_t result;
+static bool verbose;
+
+
+/* Simulated RTOS, only the easylink thread blocks */
+
+/* Hands over to the test until it resumes the thread, sim_lock held */
+static void thread_yield( void )
+{
+  thread_turn = false;
+  pthread_cond_broadcast( &sim_cond );
+  while( !thread_turn )
+    pthread_cond_wait( &sim_cond, &sim_lock );
+}
+
+static void thread_resume( void )
+{
+  pthread_mutex_lock( &sim_lock );
+  thread_state = THREAD_RUNNING;
+  thread_turn = true;
+  pthread_cond_broadcast( &sim_cond );
+  while( thread_turn )
+    pthread_cond_wait( &sim_cond, &sim_lock );
+  pthread_mutex_unlock( &sim_lock );
+}
+
+static void thread_block( sim_semaphore_t *sem, uint32_t timeout_ms )
+{
+  assert( pthread_equal( pthread_self( ), sim_thread ) );
+  pthread_mutex_lock( &sim_lock );
+  thread_state = THREAD_WAIT;
+  thread_sem = sem;
+  thread_deadline = timeout_ms == MICO_WAIT_FOREVER ? MICO_WAIT_FOREVER : now + timeout_ms;
+  thread_yield( );
+  pthread_mutex_unlock( &sim_lock );
+}
+
+static void *thread_main( void *arg )
+{
+  thread_start_t start = *(thread_start_t *)arg;
+
+  free( arg );
+  pthread_mutex_lock( &sim_lock );
+  while( !thread_turn )
+    pthread_cond_wait( &sim_cond, &sim_lock );
+  pthread_mutex_unlock( &sim_lock );
+  start.function( start.arg );
+  return NULL;
+}
+
+OSStatus mico_rtos_create_thread( mico_thread_t* thread, uint8_t priority, const char* name, mico_thread_function_t function, uint32_t stack_size, void* arg )
+{
+  thread_start_t *start;
+
+  (void)thread; (void)priority; (void)stack_size;
+  /* The AirKiss ack only sends UDP broadcasts */
+  if( strcmp( name, "AIRKISS" ) == 0 ) {
+    result.airkiss_ack = true;
+    return kNoErr;
+  }
+
+  assert( thread_state == THREAD_NONE );
+  start = malloc( sizeof(thread_start_t) );
+  start->function = function;
+  start->arg = arg;
+  thread_turn = false;
+  thread_state = THREAD_READY;
+  assert( pthread_create( &sim_thread, NULL, thread_main, start ) == 0 );
+  return kNoErr;
+}
+
+OSStatus mico_rtos_delete_thread( mico_thread_t* thread )
+{
+  assert( thread == NULL );
+  pthread_mutex_lock( &sim_lock );
+  thread_state = THREAD_DONE;
+  thread_turn = false;
+  pthread_cond_broadcast( &sim_cond );
+  pthread_mutex_unlock( &sim_lock );
+  pthread_exit( NULL );
+}
+
+OSStatus mico_rtos_init_semaphore( mico_semaphore_t* semaphore, int count )
+{
+  (void)count;
+  *semaphore = calloc( 1, sizeof(sim_semaphore_t) );
+  return kNoErr;
+}
+
+OSStatus mico_rtos_set_semaphore( mico_semaphore_t* semaphore )
+{
+  sim_semaphore_t *sem = *semaphore;
+
+  assert( sem );
+  sem->count = 1;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_get_semaphore( mico_semaphore_t* semaphore, uint32_t timeout_ms )
+{
+  sim_semaphore_t *sem = *semaphore;
+
+  assert( sem );
+  if( sem->count == 0 && timeout_ms != 0 )
+    thread_block( sem, timeout_ms );
+  if( sem->count == 0 )
+    return kTimeoutErr;
+  sem->count = 0;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_deinit_semaphore( mico_semaphore_t* semaphore )
+{
+  free( *semaphore );
+  *semaphore = NULL;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_init_mutex( mico_mutex_t* mutex )
+{
+  *mutex = (mico_mutex_t)1;
+  return kNoErr;
+}
+
+/* Only one side runs at a time, a mutex only has to exist */
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex )
+{
+  assert( *mutex != NULL );
+  return kNoErr;
+}
+
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex )
+{
+  assert( *mutex != NULL );
+  return kNoErr;
+}
+
+void mico_thread_msleep( uint32_t milliseconds )
+{
+  thread_block( NULL, milliseconds );
+}
+
+void mico_thread_sleep( uint32_t seconds )
+{
+  thread_block( NULL, seconds * 1000 );
+}
+
+void msleep( uint32_t milliseconds )
+{
+  thread_block( NULL, milliseconds );
+}
+
+uint32_t mico_get_time( void )
+{
+  return now;
+}
+
+char* MicoGetVer( void )
+{
+  return "31620002.HOST";
+}
+
+
+/* Wi-Fi driver model */
+
+static void open_window( char kind )
+{
+  assert( result.windows < MAX_WINDOWS );
+  result.window_kind[result.windows] = kind;
+  result.window_at[result.windows] = now;
+  result.windows++;
+}
+
+OSStatus micoWlanStartEasyLinkPlus( int inTimeout )
+{
+  /* The radio cannot sniff and run the soft ap together */
+  assert( !soft_ap_up && !sniffing );
+  sniffing = true;
+  sniff_step1 = false;
+  sniff_end = now + inTimeout * 1000;
+  open_window( 'E' );
+  return kNoErr;
+}
+
+OSStatus micoWlanStopEasyLinkPlus( void )
+{
+  sniffing = false;
+  return kNoErr;
+}
+
+OSStatus micoWlanStart( network_InitTypeDef_st* inNetworkInitPara )
+{
+  assert( inNetworkInitPara->wifi_mode == Soft_AP );
+  assert( !soft_ap_up && !sniffing );
+  soft_ap_up = true;
+  open_window( 'S' );
+  return kNoErr;
+}
+
+OSStatus micoWlanSuspendSoftAP( void )
+{
+  soft_ap_up = false;
+  return kNoErr;
+}
+
+OSStatus micoWlanSuspend( void )
+{
+  soft_ap_up = false;
+  sniffing = false;
+  station_pending = false;
+  return kNoErr;
+}
+
+OSStatus micoWlanGetIPStatus( net_para_st *outNetpara, WiFi_Interface inInterface )
+{
+  (void)inInterface;
+  memset( outNetpara, 0, sizeof(net_para_st) );
+  return kNoErr;
+}
+
+/* The station comes up if the credentials match the access point */
+void system_connect_wifi_normal( mico_Context_t * const inContext )
+{
+  mico_sys_config_t *config = &inContext->flashContentInRam.micoSystemConfig;
+
+  result.connects++;
+  if( sniffing || soft_ap_up )
+    result.radio_busy_at_connect = true;
+  if( strcmp( config->ssid, AP_SSID ) == 0 && strcmp( config->user_key, AP_KEY ) == 0 ) {
+    station_pending = true;
+    station_up_at = now + CONNECT_MS;
+  }
+}
+
+void system_connect_wifi_fast( mico_Context_t * const inContext )
+{
+  system_connect_wifi_normal( inContext );
+}
+
+
+/* System services */
+
+void sim_log( const char *format, ... )
+{
+  char line[256];
+  va_list args;
+
+  va_start( args, format );
+  vsnprintf( line, sizeof(line), format, args );
+  va_end( args );
+
+  if( strncmp( line, "Online by", 9 ) == 0 )
+    snprintf( result.online, sizeof(result.online), "%.127s", line );
+  if( verbose )
+    printf( "[%7u] %s\r\n", now, line );
+}
+
+OSStatus mico_system_notify_register( mico_notify_types_t notify_type, void* functionAddress, void* arg )
+{
+  notify_function[notify_type] = functionAddress;
+  notify_arg[notify_type] = arg;
+  return kNoErr;
+}
+
+OSStatus mico_system_notify_remove( mico_notify_types_t notify_type, void *functionAddress )
+{
+  assert( notify_function[notify_type] == functionAddress );
+  notify_function[notify_type] = NULL;
+  return kNoErr;
+}
+
+mico_Context_t* mico_system_context_get( void )
+{
+  return &context;
+}
+
+OSStatus mico_system_context_update( mico_Context_t* const in_context )
+{
+  (void)in_context;
+  return kNoErr;
+}
+
+/* Like the firmware, the Wi-Fi settings go back to the defaults */
+OSStatus mico_system_context_restore( mico_Context_t * const inContext )
+{
+  memset( &inContext->flashContentInRam.micoSystemConfig, 0, sizeof(mico_sys_config_t) );
+  result.restores++;
+  return kNoErr;
+}
+
+void mico_system_delegate_config_will_start( void ) { }
+void mico_system_delegate_config_will_stop( void ) { }
+void mico_system_delegate_soft_ap_will_start( void ) { }
+void mico_system_delegate_config_recv_ssid( char *ssid, char *key ) { (void)ssid; (void)key; }
+
+OSStatus mico_system_delegate_config_recv_auth_data( char * userInfo )
+{
+  (void)userInfo;
+  return kNoErr;
+}
+
+void mico_system_delegate_config_success( mico_config_source_t source )
+{
+  result.winner = source;
+  result.success_at = now;
+}
+
+OSStatus config_server_start( mico_Context_t * const inContext ) { (void)inContext; return kNoErr; }
+OSStatus config_server_stop( void ) { return kNoErr; }
+
+void mdns_add_record( mdns_init_t init, WiFi_Interface interface, uint32_t time_to_live ) { (void)init; (void)interface; (void)time_to_live; }
+void mdns_update_txt_record( char *service_name, WiFi_Interface interface, char *txt_record ) { (void)service_name; (void)interface; (void)txt_record; }
+void mdns_suspend_record( char *service_name, WiFi_Interface interface, bool will_remove ) { (void)service_name; (void)interface; (void)will_remove; }
+void SetTimer( unsigned long ms, _timer_handle_t psysTimerHandler ) { (void)ms; (void)psysTimerHandler; }
+
+int socket( int domain, int type, int protocol ) { (void)domain; (void)type; (void)protocol; return -1; }
+int sendto( int sockfd, const void *buf, size_t len, int flags, const struct sockaddr_t *dest_addr, uint32_t addrlen )
+{
+  (void)sockfd; (void)buf; (void)flags; (void)dest_addr; (void)addrlen;
+  return len;
+}
+void SocketClose( int* fd ) { *fd = -1; }
+
+char* DataToHexStringWithSpaces( const uint8_t *inBuf, size_t inBufLen )
+{
+  char *s = malloc( inBufLen * 3 + 1 );
+  size_t i;
+
+  s[0] = 0;
+  for( i = 0; i < inBufLen; i++ )
+    sprintf( s + i * 3, "%02X ", inBuf[i] );
+  return s;
+}
+
+char* __strdup( const char *src )
+{
+  char *s = malloc( strlen( src ) + 1 );
+  strcpy( s, src );
+  return s;
+}
+
+char* __strdup_trans_dot( char *src )
+{
+  return __strdup( src );
+}
+
+char* inet_ntoa( char *s, uint32_t x )
+{
+  sprintf( s, "%u.%u.%u.%u", x & 0xFF, ( x >> 8 ) & 0xFF, ( x >> 16 ) & 0xFF, x >> 24 );
+  return s;
+}
+
+/* Flat JSON objects only, as the soft ap app posts them */
+json_object* json_tokener_parse( const char *str )
+{
+  json_object *obj = calloc( 1, sizeof(json_object) );
+  const char *p = str;
+  int n;
+
+  obj->values = calloc( 8, sizeof(json_object) );
+  while( ( p = strchr( p, '"' ) ) != NULL && obj->count < 8 ) {
+    n = strcspn( ++p, "\"" );
+    snprintf( obj->keys[obj->count], sizeof(obj->keys[0]), "%.*s", n, p );
+    p = strchr( p + n, ':' ) + 1;
+    p += strspn( p, " " );
+    if( *p == '"' ) {
+      n = strcspn( ++p, "\"" );
+      snprintf( obj->values[obj->count].strings[0], sizeof(obj->strings[0]), "%.*s", n, p );
+      p += n + 1;
+    } else {
+      n = strcspn( p, ",} " );
+      snprintf( obj->values[obj->count].strings[0], sizeof(obj->strings[0]), "%.*s", n, p );
+      p += n;
+    }
+    obj->count++;
+  }
+  return obj;
+}
+
+void json_object_put( json_object *obj )
+{
+  free( obj->values );
+  free( obj );
+}
+
+const char* json_object_get_string( json_object *obj )
+{
+  return obj->strings[0];
+}
+
+bool json_object_get_boolean( json_object *obj )
+{
+  return strcmp( obj->strings[0], "true" ) == 0;
+}
+
+int32_t json_object_get_int( json_object *obj )
+{
+  return atoi( obj->strings[0] );
+}
+
+
+/* Replay */
+
+/* Runs the thread while it has something to do at the current time */
+static void settle( void )
+{
+  for( ;; ) {
+    if( thread_state == THREAD_READY )
+      ;
+    else if( thread_state == THREAD_WAIT && ( ( thread_sem && thread_sem->count ) ||
+                                              ( thread_deadline != MICO_WAIT_FOREVER && now >= thread_deadline ) ) )
+      ;
+    else
+      return;
+    thread_resume( );
+  }
+}
+
+static void deliver( const replay_event_t *e )
+{
+  static char data[256];
+  network_InitTypeDef_st para;
+  OSStatus err;
+
+  switch( e->kind ) {
+  case EV_STEP1:
+    if( ( !sniffing && !e->late ) || !notify_function[mico_notify_EASYLINK_WPS_COMPLETED] ) {
+      result.unheard++;
+      return;
+    }
+    memset( &para, 0, sizeof(para) );
+    strncpy( para.wifi_ssid, e->ssid, sizeof(para.wifi_ssid) - 1 );
+    strncpy( para.wifi_key, e->key, sizeof(para.wifi_key) - 1 );
+    para.wifi_retry_interval = e->source;
+    if( sniffing )
+      sniff_step1 = true;
+    ( (void (*)( network_InitTypeDef_st *, void * ))notify_function[mico_notify_EASYLINK_WPS_COMPLETED] )
+      ( &para, notify_arg[mico_notify_EASYLINK_WPS_COMPLETED] );
+    break;
+
+  case EV_STEP2:
+    if( ( !( sniffing && sniff_step1 ) && !e->late ) || !notify_function[mico_notify_EASYLINK_GET_EXTRA_DATA] ) {
+      result.unheard++;
+      return;
+    }
+    /* The sniffer is done after step 2 */
+    if( !e->late )
+      sniffing = false;
+    memcpy( data, e->data, e->length );
+    ( (void (*)( int, char *, void * ))notify_function[mico_notify_EASYLINK_GET_EXTRA_DATA] )
+      ( e->length, data, notify_arg[mico_notify_EASYLINK_GET_EXTRA_DATA] );
+    break;
+
+  case EV_POST:
+    if( !soft_ap_up && !e->late ) {
+      result.unheard++;
+      return;
+    }
+    /* Like the config server: store the configuration, then hand it over */
+    err = ConfigIncommingJsonMessageUAP( (const uint8_t *)e->data, strlen( e->data ) );
+    if( err == kNoErr )
+      err = system_easylink_uap_complete( &context );
+    if( err != kNoErr )
+      result.rejected_posts++;
+    break;
+
+  default:
+    break;
+  }
+}
+
+static void replay( const char *name, const replay_event_t *events )
+{
+  uint32_t next;
+
+  memset( &result, 0, sizeof(result) );
+  memset( &context, 0, sizeof(context) );
+  mico_rtos_init_mutex( &context.flashContentInRam_mutex );
+  strcpy( context.micoStatus.mac, "C8:93:46:00:00:01" );
+  now = 0;
+  sniffing = false;
+  soft_ap_up = false;
+  station_pending = false;
+  thread_state = THREAD_NONE;
+
+  assert( system_easylink_start( &context ) == kNoErr );
+
+  for( ;; ) {
+    settle( );
+    if( thread_state == THREAD_DONE )
+      break;
+
+    next = MICO_WAIT_FOREVER;
+    if( events->kind != EV_END && events->at < next )
+      next = events->at;
+    if( sniffing && sniff_end < next )
+      next = sniff_end;
+    if( station_pending && station_up_at < next )
+      next = station_up_at;
+    if( thread_state == THREAD_WAIT && thread_deadline < next )
+      next = thread_deadline;
+    /* Nothing left that could wake the thread */
+    assert( next != MICO_WAIT_FOREVER && next <= SIM_LIMIT );
+    if( next > now )
+      now = next;
+
+    /* One thing at a time, the thread reacts before the next one */
+    if( events->kind != EV_END && events->at <= now ) {
+      deliver( events++ );
+    } else if( sniffing && sniff_end <= now ) {
+      sniffing = false;
+      /* Window over, reported unless step 1 already came */
+      if( !sniff_step1 )
+        ( (void (*)( network_InitTypeDef_st *, void * ))notify_function[mico_notify_EASYLINK_WPS_COMPLETED] )
+          ( NULL, notify_arg[mico_notify_EASYLINK_WPS_COMPLETED] );
+    } else if( station_pending && station_up_at <= now ) {
+      station_pending = false;
+      ( (void (*)( WiFiEvent, void * ))notify_function[mico_notify_WIFI_STATUS_CHANGED] )
+        ( NOTIFY_STATION_UP, notify_arg[mico_notify_WIFI_STATUS_CHANGED] );
+    }
+  }
+  pthread_join( sim_thread, NULL );
+
+  /* Every event was played and the thread let go of the radio */
+  assert( events->kind == EV_END );
+  assert( !sniffing && !soft_ap_up && !result.radio_busy_at_connect );
+  printf( "%-36s %s\r\n", name, result.online );
+}
+
+static void expect_online( const char *method, uint32_t configured, uint32_t total )
+{
+  char line[128];
+
+  snprintf( line, sizeof(line), "Online by %s: configured in %u ms, connected in %u ms, %u ms in total",
+            method, configured, total - configured, total );
+  assert( strcmp( result.online, line ) == 0 );
+  assert( result.success_at == total );
+  assert( strcmp( context.flashContentInRam.micoSystemConfig.ssid, AP_SSID ) == 0 );
+}
+
+#define STEP1( at, source, ssid, key )  { at, EV_STEP1, source, ssid, key, NULL, 0, false }
+#define STEP2( at, data )               { at, EV_STEP2, CONFIG_BY_NONE, NULL, NULL, data, sizeof(data) - 1, false }
+#define POST( at, json )                { at, EV_POST, CONFIG_BY_NONE, NULL, NULL, json, 0, false }
+#define LATE_STEP1( at, ssid, key )     { at, EV_STEP1, CONFIG_BY_EASYLINK_PLUS, ssid, key, NULL, 0, true }
+#define LATE_STEP2( at, data )          { at, EV_STEP2, CONFIG_BY_NONE, NULL, NULL, data, sizeof(data) - 1, true }
+#define LATE_POST( at, json )           { at, EV_POST, CONFIG_BY_NONE, NULL, NULL, json, 0, true }
+#define END                             { 0, EV_END, CONFIG_BY_NONE, NULL, NULL, NULL, 0, false }
+
+/* Auth data, '#', 4 byte identifier */
+#define EXTRA_DATA                      "auth#\x01\x02\x03\x04"
+#define GOOD_POST                       "{\"SSID\":\"" AP_SSID "\",\"PASSWORD\":\"" AP_KEY "\",\"DHCP\":true}"
+
+static void test_easylink( void )
+{
+  static const replay_event_t events[] = {
+    STEP1( 5000, CONFIG_BY_EASYLINK_PLUS, AP_SSID, AP_KEY ),
+    STEP2( 5300, EXTRA_DATA ),
+    END
+  };
+
+  replay( "EasyLink in the first window:", events );
+  expect_online( "EasyLink V2", 5300, 5300 + CONNECT_MS );
+  assert( result.windows == 1 && result.window_kind[0] == 'E' );
+  assert( result.winner == CONFIG_BY_EASYLINK_V2 && result.restores == 0 );
+}
+
+static void test_airkiss( void )
+{
+  static const replay_event_t events[] = {
+    STEP1( 12000, CONFIG_BY_AIRKISS, AP_SSID, AP_KEY ),
+    STEP2( 12100, "\x5A" ),
+    END
+  };
+
+  replay( "AirKiss in the first window:", events );
+  expect_online( "AirKiss", 12100, 12100 + CONNECT_MS );
+  assert( result.winner == CONFIG_BY_AIRKISS && result.airkiss_ack );
+}
+
+static void test_soft_ap( void )
+{
+  static const replay_event_t events[] = {
+    POST( 75000, GOOD_POST ),
+    END
+  };
+
+  /* The sniff window times out, the soft ap follows 20 ms later. The soft ap
+     is closed and the thread waits a second before connecting */
+  replay( "Soft ap in the second window:", events );
+  expect_online( "soft ap", 75000, 75000 + 1000 + CONNECT_MS );
+  assert( result.windows == 2 && result.window_kind[1] == 'S' && result.window_at[1] == EasyLink_TimeOut + 20 );
+  assert( result.winner == CONFIG_BY_SOFT_AP && result.restores == 1 );
+}
+
+static void test_late_sources( void )
+{
+  static const replay_event_t events[] = {
+    STEP1( 5000, CONFIG_BY_EASYLINK_PLUS, AP_SSID, AP_KEY ),
+    STEP2( 5300, EXTRA_DATA ),
+    LATE_STEP1( 6000, "evil", "twin" ),
+    LATE_STEP2( 6100, EXTRA_DATA ),
+    LATE_POST( 6500, "{\"SSID\":\"evil\",\"PASSWORD\":\"twin\"}" ),
+    END
+  };
+
+  /* EasyLink won, what comes after it neither changes the credentials nor
+     passes for the station coming up */
+  replay( "Late sources after EasyLink:", events );
+  expect_online( "EasyLink V2", 5300, 5300 + CONNECT_MS );
+  assert( result.restores == 0 && result.rejected_posts == 1 && result.connects == 1 );
+}
+
+static void test_wrong_key( void )
+{
+  static const replay_event_t events[] = {
+    POST( 75000, "{\"SSID\":\"" AP_SSID "\",\"PASSWORD\":\"wrong\"}" ),
+    STEP1( 100000, CONFIG_BY_EASYLINK_PLUS, AP_SSID, AP_KEY ),
+    STEP2( 100200, EXTRA_DATA ),
+    END
+  };
+  uint32_t retry = 75000 + 1000 + EasyLink_ConnectWlan_Timeout;
+
+  /* The soft ap wins with a bad key, the connection times out and the
+     windows start again, where EasyLink gets it right */
+  replay( "Wrong key, then EasyLink:", events );
+  expect_online( "EasyLink V2", 100200, 100200 + CONNECT_MS );
+  assert( result.connects == 2 );
+  assert( result.windows == 3 && result.window_kind[2] == 'E' && result.window_at[2] == retry );
+}
+
+static void test_no_step2( void )
+{
+  static const replay_event_t events[] = {
+    STEP1( 5000, CONFIG_BY_EASYLINK_PLUS, AP_SSID, AP_KEY ),
+    POST( 70000, GOOD_POST ),
+    END
+  };
+
+  /* The driver never reports step 2 or the end of the window, the thread
+     gives up one window after step 1 and opens the soft ap */
+  replay( "Step 1 without step 2:", events );
+  expect_online( "soft ap", 70000, 70000 + 1000 + CONNECT_MS );
+  assert( result.windows == 2 && result.window_at[1] == 5000 + EasyLink_TimeOut + 20 );
+  assert( result.restores == 0 );
+}
+
+static void test_alternate( void )
+{
+  static const replay_event_t events[] = {
+    POST( 130000, GOOD_POST ),
+    STEP1( 190000, CONFIG_BY_EASYLINK_PLUS, AP_SSID, AP_KEY ),
+    POST( 200000, GOOD_POST ),
+    END
+  };
+  uint32_t i;
+
+  /* Nobody for two rounds: the windows take turns without a gap, each one at
+     most a window long, and whatever comes while the radio does the other
+     thing is not heard */
+  replay( "Two silent rounds, then soft ap:", events );
+  expect_online( "soft ap", 200000, 200000 + 1000 + CONNECT_MS );
+  assert( result.windows == 4 && result.unheard == 2 );
+  for( i = 0; i < result.windows; i++ )
+    assert( result.window_kind[i] == ( i % 2 ? 'S' : 'E' ) );
+  for( i = 1; i < result.windows; i++ )
+    assert( result.window_at[i] - result.window_at[i - 1] <= 60000 + 20 );
+}
+
+int main( void )
+{
+  /* Keep the lines before a failed assert when the output is piped */
+  setvbuf( stdout, NULL, _IOLBF, 0 );
+  verbose = getenv( "PROVISIONING_VERBOSE" ) != NULL;
+
+  test_easylink( );
+  test_airkiss( );
+  test_soft_ap( );
+  test_late_sources( );
+  test_wrong_key( );
+  test_no_step2( );
+  test_alternate( );
+
+  printf( "all scenarios: ok\r\n" );
+  return 0;
+}
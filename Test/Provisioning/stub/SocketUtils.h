@@ -0,0 +1,3 @@
+/* Host stand-in for SocketUtils.h, mico.h carries the declarations */
+
+#include "mico.h"
@@ -0,0 +1,289 @@
+/* Host stand-in for mico.h: only what system_easylink.c uses. The structures
+   keep the field names of the firmware, not its exact layout. The RTOS, Wi-Fi
+   driver, config server and mDNS calls are implemented by the test. */
+
+#ifndef __MICO_H__
+#define __MICO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef int OSStatus;
+
+#define kNoErr                  0
+#define kGeneralErr             -1
+#define kUnknownErr             -6700
+#define kParamErr               -6705
+#define kStateErr               -6709
+#define kNoResourcesErr         -6729
+#define kNoMemoryErr            -6728
+#define kTimeoutErr             -6722
+#define kNotPreparedErr         -6745
+
+#define UNUSED_PARAMETER( x )   ( (void)( x ) )
+
+/* Debug.h */
+void sim_log( const char *format, ... );
+
+#define custom_log( N, M, ... )                 sim_log( M, ##__VA_ARGS__ )
+#define custom_log_trace( N )                   do {} while( 0 )
+
+#define require(X, LABEL)                       do { if( !(X) ) goto LABEL; } while(0)
+#define require_action(X, LABEL, ACTION)        do { if( !(X) ) { { ACTION; } goto LABEL; } } while(0)
+#define require_noerr(ERR, LABEL)               do { if( (ERR) != 0 ) goto LABEL; } while(0)
+#define require_noerr_string(ERR, LABEL, STR)   do { if( (ERR) != 0 ) goto LABEL; } while(0)
+#define require_noerr_action_string(ERR, LABEL, ACTION, STR) \
+                                                do { if( (ERR) != 0 ) { { ACTION; } goto LABEL; } } while(0)
+
+/* mico_rtos.h */
+#define MICO_WAIT_FOREVER               ( 0xFFFFFFFF )
+#define MICO_APPLICATION_PRIORITY       ( 7 )
+
+typedef void (*mico_thread_function_t)( void* arg );
+typedef void* mico_semaphore_t;
+typedef void* mico_mutex_t;
+typedef void* mico_thread_t;
+
+OSStatus mico_rtos_create_thread( mico_thread_t* thread, uint8_t priority, const char* name, mico_thread_function_t function, uint32_t stack_size, void* arg );
+OSStatus mico_rtos_delete_thread( mico_thread_t* thread );
+OSStatus mico_rtos_init_semaphore( mico_semaphore_t* semaphore, int count );
+OSStatus mico_rtos_set_semaphore( mico_semaphore_t* semaphore );
+OSStatus mico_rtos_get_semaphore( mico_semaphore_t* semaphore, uint32_t timeout_ms );
+OSStatus mico_rtos_deinit_semaphore( mico_semaphore_t* semaphore );
+OSStatus mico_rtos_init_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex );
+void mico_thread_sleep( uint32_t seconds );
+void mico_thread_msleep( uint32_t milliseconds );
+uint32_t mico_get_time( void );
+void msleep( uint32_t milliseconds );
+char* MicoGetVer( void );
+
+/* mico_wlan.h */
+typedef enum
+{
+  Soft_AP,
+  Station,
+} WiFi_Interface;
+
+typedef enum
+{
+  DHCP_Disable,
+  DHCP_Client,
+  DHCP_Server,
+} DHCP_Mode;
+
+typedef enum
+{
+  SECURITY_TYPE_NONE,
+  SECURITY_TYPE_AUTO = 7,
+} SECURITY_TYPE_E;
+
+typedef struct
+{
+  char  wifi_mode;
+  char  wifi_ssid[32];
+  char  wifi_key[64];
+  char  local_ip_addr[16];
+  char  net_mask[16];
+  char  gateway_ip_addr[16];
+  char  dnsServer_ip_addr[16];
+  char  dhcpMode;
+  int   wifi_retry_interval;
+} network_InitTypeDef_st;
+
+typedef struct
+{
+  uint8_t dhcp;
+  char    ip[16];
+  char    gate[16];
+  char    mask[16];
+  char    dns[16];
+  char    mac[16];
+  char    broadcastip[16];
+} net_para_st;
+
+OSStatus micoWlanStart( network_InitTypeDef_st* inNetworkInitPara );
+OSStatus micoWlanGetIPStatus( net_para_st *outNetpara, WiFi_Interface inInterface );
+OSStatus micoWlanSuspend( void );
+OSStatus micoWlanSuspendSoftAP( void );
+OSStatus micoWlanStartEasyLinkPlus( int inTimeout );
+OSStatus micoWlanStopEasyLinkPlus( void );
+
+/* system.h */
+#define EASYLINK_BYPASS_NO      ( 0 )
+#define EASYLINK_BYPASS         ( 1 )
+
+#define maxSsidLen              32
+#define maxKeyLen               64
+#define maxNameLen              32
+#define maxIpLen                16
+
+typedef enum
+{
+  unConfigured,
+  wLanUnConfigured,
+  allConfigured,
+  mfgConfigured,
+} Config_State_t;
+
+typedef struct
+{
+  char            name[maxNameLen];
+  char            ssid[maxSsidLen];
+  char            user_key[maxKeyLen];
+  int             user_keyLength;
+  char            key[maxKeyLen];
+  int             keyLength;
+  char            bssid[6];
+  int             channel;
+  SECURITY_TYPE_E security;
+  bool            dhcpEnable;
+  char            localIp[maxIpLen];
+  char            netMask[maxIpLen];
+  char            gateWay[maxIpLen];
+  char            dnsServer[maxIpLen];
+  Config_State_t  configured;
+  uint8_t         easyLinkByPass;
+} mico_sys_config_t;
+
+typedef struct
+{
+  mico_sys_config_t   micoSystemConfig;
+} flash_content_t;
+
+typedef struct
+{
+  char                  localIp[maxIpLen];
+  char                  netMask[maxIpLen];
+  char                  gateWay[maxIpLen];
+  char                  dnsServer[maxIpLen];
+  char                  mac[18];
+  char                  rf_version[50];
+} current_mico_status_t;
+
+typedef struct
+{
+  flash_content_t           flashContentInRam;
+  mico_mutex_t              flashContentInRam_mutex;
+  current_mico_status_t     micoStatus;
+} mico_Context_t;
+
+typedef enum
+{
+  NOTIFY_STATION_UP = 1,
+  NOTIFY_STATION_DOWN,
+  NOTIFY_AP_UP,
+  NOTIFY_AP_DOWN,
+} WiFiEvent;
+
+void system_connect_wifi_normal( mico_Context_t * const inContext );
+void system_connect_wifi_fast( mico_Context_t * const inContext );
+OSStatus system_easylink_start( mico_Context_t * const inContext );
+OSStatus system_easylink_uap_complete( mico_Context_t * const inContext );
+OSStatus config_server_start( mico_Context_t * const inContext );
+OSStatus config_server_stop( void );
+OSStatus ConfigIncommingJsonMessageUAP( const uint8_t *input, size_t size );
+
+/* mico_system.h */
+typedef enum
+{
+  CONFIG_BY_NONE,
+  CONFIG_BY_EASYLINK_V2,
+  CONFIG_BY_EASYLINK_PLUS,
+  CONFIG_BY_EASYLINK_MINUS,
+  CONFIG_BY_AIRKISS,
+  CONFIG_BY_SOFT_AP,
+  CONFIG_BY_WAC,
+} mico_config_source_t;
+
+typedef enum
+{
+  mico_notify_WIFI_STATUS_CHANGED,
+  mico_notify_EASYLINK_WPS_COMPLETED,
+  mico_notify_EASYLINK_GET_EXTRA_DATA,
+  mico_notify_MAX,
+} mico_notify_types_t;
+
+OSStatus mico_system_notify_register( mico_notify_types_t notify_type, void* functionAddress, void* arg );
+OSStatus mico_system_notify_remove( mico_notify_types_t notify_type, void *functionAddress );
+mico_Context_t* mico_system_context_get( void );
+OSStatus mico_system_context_update( mico_Context_t* const in_context );
+OSStatus mico_system_context_restore( mico_Context_t * const inContext );
+
+void mico_system_delegate_config_will_start( void );
+void mico_system_delegate_config_will_stop( void );
+void mico_system_delegate_soft_ap_will_start( void );
+void mico_system_delegate_config_recv_ssid( char *ssid, char *key );
+OSStatus mico_system_delegate_config_recv_auth_data( char * userInfo );
+void mico_system_delegate_config_success( mico_config_source_t source );
+
+/* mDNS */
+typedef struct
+{
+  char *host_name;
+  char *instance_name;
+  char *service_name;
+  char *txt_record;
+  uint16_t service_port;
+} mdns_init_t;
+
+void mdns_add_record( mdns_init_t init, WiFi_Interface interface, uint32_t time_to_live );
+void mdns_update_txt_record( char *service_name, WiFi_Interface interface, char *txt_record );
+void mdns_suspend_record( char *service_name, WiFi_Interface interface, bool will_remove );
+
+/* Timers */
+typedef void (*_timer_handle_t)( void );
+void SetTimer( unsigned long ms, _timer_handle_t psysTimerHandler );
+
+/* json-c, flat objects of strings, booleans and integers */
+typedef struct json_object
+{
+  int                   count;
+  char                  keys[8][16];
+  char                  strings[8][64];
+  struct json_object   *values;
+} json_object;
+
+json_object* json_tokener_parse( const char *str );
+void json_object_put( json_object *obj );
+const char* json_object_get_string( json_object *obj );
+bool json_object_get_boolean( json_object *obj );
+int32_t json_object_get_int( json_object *obj );
+
+#define json_object_object_foreach( obj, key, val ) \
+  char *key; json_object *val; \
+  for( int key##_i = 0; key##_i < (obj)->count && ( key = (obj)->keys[key##_i], val = &(obj)->values[key##_i], 1 ); key##_i++ )
+
+/* SocketUtils.h and the MiCO socket API */
+#define socket                  sim_socket
+#define sendto                  sim_sendto
+
+#define AF_INET                 2
+#define SOCK_DGRM               2
+#define IPPROTO_UDP             17
+#define INADDR_BROADCAST        0xFFFFFFFFu
+#define IsValidSocket( s )      ( (s) >= 0 )
+
+struct sockaddr_t
+{
+  uint16_t  s_type;
+  uint16_t  s_port;
+  uint32_t  s_ip;
+  uint16_t  s_spares[6];
+};
+
+int socket( int domain, int type, int protocol );
+int sendto( int sockfd, const void *buf, size_t len, int flags, const struct sockaddr_t *dest_addr, uint32_t addrlen );
+void SocketClose( int* fd );
+
+/* StringUtils.h */
+char* DataToHexStringWithSpaces( const uint8_t *inBuf, size_t inBufLen );
+char* __strdup( const char *src );
+char* __strdup_trans_dot( char *src );
+char* inet_ntoa( char *s, uint32_t x );
+
+#endif /* __MICO_H__ */
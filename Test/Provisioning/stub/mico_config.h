@@ -0,0 +1,23 @@
+/* Host stand-in for the application's mico_config.h */
+
+#ifndef __MICO_CONFIG_H__
+#define __MICO_CONFIG_H__
+
+#define CONFIG_MODE_EASYLINK                    (2)
+#define CONFIG_MODE_SOFT_AP                     (3)
+#define CONFIG_MODE_EASYLINK_WITH_SOFTAP        (4)
+
+#define MICO_CONFIG_MODE                        CONFIG_MODE_EASYLINK_WITH_SOFTAP
+
+#define EasyLink_TimeOut                        60000
+#define EasyLink_ConnectWlan_Timeout            20000
+
+#define MODEL                                   "MiCO-Test"
+#define MANUFACTURER                            "MXCHIP Inc."
+#define PROTOCOL                                "com.mxchip.test"
+#define FIRMWARE_REVISION                       "TEST_1_0"
+#define HARDWARE_REVISION                       "HOST"
+
+#define MICO_CONFIG_SERVER_PORT                 8000
+
+#endif /* __MICO_CONFIG_H__ */
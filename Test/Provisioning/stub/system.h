@@ -0,0 +1,6 @@
+/* Host stand-in for system.h, mico.h carries the declarations */
+
+#include "mico.h"
+
+#define system_log(M, ...) custom_log("SYSTEM", M, ##__VA_ARGS__)
+#define system_log_trace() custom_log_trace("SYSTEM")
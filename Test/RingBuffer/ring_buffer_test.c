@@ -0,0 +1,182 @@
+/**
+  ******************************************************************************
+  * @file    ring_buffer_test.c
+  * @brief   Host test of ring_buffer_t: boundary checks on one thread, then a
+  *          producer and a consumer thread streaming a known byte sequence
+  *          through the ring with every read and write API mixed at random.
+  *
+  *          Build and run from the repository root:
+  *
+  *          gcc -O2 -pthread -ITest/RingBuffer/stub -Ilibraries/utilities \
+  *              -o ring_buffer_test Test/RingBuffer/ring_buffer_test.c \
+  *              libraries/utilities/RingBufferUtils.c
+  *          ./ring_buffer_test
+  *
+  *          Sizes that are a power of 2 wrap with a mask, the others by
+  *          subtraction, so both kinds are run. Any byte lost, repeated or
+  *          out of order shows up as an error.
+  ******************************************************************************
+  */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "RingBufferUtils.h"
+
+#define STREAM_BYTES        ( 20u * 1000 * 1000 )
+#define MAX_CHUNK           300
+
+typedef struct
+{
+  ring_buffer_t   ring;
+  uint32_t        total;
+} stream_t;
+
+static uint8_t storage[4096];
+
+/* Byte n of the stream, not periodic in any ring size used here */
+static uint8_t stream_byte( uint32_t n )
+{
+  return (uint8_t)( n * 7 + ( n >> 8 ) );
+}
+
+static void test_boundaries( uint32_t size )
+{
+  ring_buffer_t ring;
+  uint8_t data[16] = { 0 };
+  uint8_t *d1, *d2;
+  uint32_t l1, l2, i;
+
+  ring_buffer_init( &ring, storage, size );
+  assert( ring_buffer_used_space( &ring ) == 0 );
+  assert( ring_buffer_free_space( &ring ) == size - 1 );
+  assert( ring_buffer_read( &ring, data, sizeof(data) ) == 0 );
+  assert( ring_buffer_peek( &ring, &d1, &l1, &d2, &l2 ) == 0 );
+
+  /* One byte always stays free */
+  for( i = 0; i < size - 1; i++ )
+    assert( ring_buffer_write( &ring, data, 1 ) == 1 );
+  assert( ring_buffer_write( &ring, data, 1 ) == 0 );
+  assert( ring_buffer_write_reserve( &ring, &d1, &l1, &d2, &l2 ) == 0 );
+  assert( ring_buffer_free_space( &ring ) == 0 );
+  assert( ring_buffer_high_water( &ring, true ) == size - 1 );
+  assert( ring_buffer_high_water( &ring, false ) == 0 );
+
+  /* Leave head and tail in the middle, so the next reserve wraps */
+  ring_buffer_consume( &ring, size - 1 );
+  assert( ring_buffer_used_space( &ring ) == 0 );
+  assert( ring_buffer_write_reserve( &ring, &d1, &l1, &d2, &l2 ) == size - 1 );
+  assert( l1 + l2 == size - 1 );
+  assert( l1 == 1 && d2 == storage );
+}
+
+static void *producer( void *arg )
+{
+  stream_t *s = arg;
+  uint8_t chunk[MAX_CHUNK];
+  uint8_t *d1, *d2;
+  uint32_t l1, l2, n = 0, k, done, i;
+  unsigned seed = 1;
+
+  while( n < s->total ) {
+    k = rand_r( &seed ) % MAX_CHUNK + 1;
+    if( k > s->total - n )
+      k = s->total - n;
+
+    if( rand_r( &seed ) & 1 ) {
+      for( i = 0; i < k; i++ )
+        chunk[i] = stream_byte( n + i );
+      done = ring_buffer_write( &s->ring, chunk, k );
+    } else {
+      /* Fill the reserved space in place, maybe only part of it */
+      done = ring_buffer_write_reserve( &s->ring, &d1, &l1, &d2, &l2 );
+      if( done > k )
+        done = k;
+      for( i = 0; i < done; i++ ) {
+        if( i < l1 )
+          d1[i] = stream_byte( n + i );
+        else
+          d2[i - l1] = stream_byte( n + i );
+      }
+      ring_buffer_write_commit( &s->ring, done );
+    }
+
+    if( done == 0 )
+      sched_yield( );
+    n += done;
+  }
+
+  return NULL;
+}
+
+/* Returns the number of bytes that did not match the stream */
+static uint32_t consumer( stream_t *s )
+{
+  uint8_t chunk[MAX_CHUNK];
+  uint8_t *d1, *d2;
+  uint32_t l1, l2, n = 0, done, i, errors = 0;
+  unsigned seed = 2;
+
+  while( n < s->total ) {
+    if( rand_r( &seed ) & 1 ) {
+      done = ring_buffer_read( &s->ring, chunk, rand_r( &seed ) % MAX_CHUNK + 1 );
+      for( i = 0; i < done; i++ )
+        if( chunk[i] != stream_byte( n + i ) )
+          errors++;
+    } else {
+      done = ring_buffer_peek( &s->ring, &d1, &l1, &d2, &l2 );
+      for( i = 0; i < done; i++ )
+        if( ( i < l1 ? d1[i] : d2[i - l1] ) != stream_byte( n + i ) )
+          errors++;
+      ring_buffer_consume( &s->ring, done );
+    }
+
+    if( done == 0 )
+      sched_yield( );
+    n += done;
+  }
+
+  return errors;
+}
+
+static uint32_t test_stream( uint32_t size )
+{
+  stream_t s;
+  pthread_t thread;
+  struct timespec start, end;
+  uint32_t errors;
+  double seconds;
+
+  ring_buffer_init( &s.ring, storage, size );
+  s.total = STREAM_BYTES;
+
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  assert( pthread_create( &thread, NULL, producer, &s ) == 0 );
+  errors = consumer( &s );
+  pthread_join( thread, NULL );
+  clock_gettime( CLOCK_MONOTONIC, &end );
+
+  assert( ring_buffer_used_space( &s.ring ) == 0 );
+  seconds = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+  printf( "size %4u: %u bytes, %u errors, %.1f MB/s, high water %u of %u\r\n", size, s.total, errors,
+          s.total / seconds / 1e6, ring_buffer_high_water( &s.ring, false ), size - 1 );
+  return errors;
+}
+
+int main( void )
+{
+  static const uint32_t sizes[] = { 4096, 1000, 64, 7 };
+  uint32_t i, errors = 0;
+
+  for( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ )
+    test_boundaries( sizes[i] );
+  printf( "boundaries: ok\r\n" );
+
+  for( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ )
+    errors += test_stream( sizes[i] );
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+/* Host stand-in for Debug.h */
+
+#ifndef __Debug_h__
+#define __Debug_h__
+
+#define custom_log( ... )           do {} while( 0 )
+#define custom_log_trace( ... )     do {} while( 0 )
+
+#endif // __Debug_h__
@@ -54,5 +54,11 @@
 
 void MicoNanosendDelay( uint64_t delayus );
 
+/* Start the free running nanosecond clock from 0, timestamps read with
+ * MicoNanosecondGetTime are only meaningful relative to each other. */
+void MicoNanosecondInit( void );
+
+uint64_t MicoNanosecondGetTime( void );
+
 #endif
 
@@ -45,6 +45,10 @@
  *                   Macros
  ******************************************************/  
 
+#define MICO_ADC_SEQUENCE_MAX          16  /**< Interfaces in one MicoAdcTakeSampleSequence() scan */
+#define MICO_ADC_OVERSAMPLE_MAX_BITS    4  /**< 12 bit samples, result still fits in 16 bits */
+#define MICO_ADC_OVERSAMPLE_CHUNK      32  /**< Samples per stream while oversampling */
+
 /******************************************************
  *                   Enumerations
  ******************************************************/
@@ -116,6 +120,42 @@ OSStatus MicoAdcTakeSample( mico_adc_t adc, uint16_t* output );
 OSStatus MicoAdcTakeSampleStreram( mico_adc_t adc, void* buffer, uint16_t buffer_length );
 
 
+/** Takes samples from a scan sequence of ADC interfaces
+ *
+ * Converts the interfaces one after another, in the order given, and repeats
+ * the scan until the buffer is full. Samples are interleaved: the first
+ * count samples are one scan. All interfaces must be channels of the same
+ * converter and have been initialised with MicoAdcInitialize().
+ *
+ * @param adcs          : the interfaces which should be sampled, in scan order
+ * @param count         : number of interfaces, at most MICO_ADC_SEQUENCE_MAX
+ * @param buffer        : a memory buffer which will receive the samples
+ *                        Each sample will be uint16_t little endian.
+ * @param buffer_length : length in bytes of the memory buffer, only whole
+ *                        scans are taken.
+ *
+ * @return    kNoErr        : on success.
+ * @return    kGeneralErr   : if an error occurred with any step
+ */
+OSStatus MicoAdcTakeSampleSequence( const mico_adc_t* adcs, uint8_t count, void* buffer, uint16_t buffer_length );
+
+
+/** Takes one oversampled and decimated sample from an ADC interface
+ *
+ * Takes 4^extra_bits samples as a stream and decimates them into one
+ * value with extra_bits more resolution than the converter, a 12 bit
+ * converter with extra_bits = 2 returns a 14 bit result.
+ *
+ * @param adc        : the interface which should be sampled
+ * @param extra_bits : 0 .. MICO_ADC_OVERSAMPLE_MAX_BITS
+ * @param output     : pointer to a variable which will receive the sample
+ *
+ * @return    kNoErr        : on success.
+ * @return    kGeneralErr   : if an error occurred with any step
+ */
+OSStatus MicoAdcTakeSampleOversampled( mico_adc_t adc, uint8_t extra_bits, uint16_t* output );
+
+
 /** De-initialises an ADC interface
  *
  * Turns off an ADC hardware interface
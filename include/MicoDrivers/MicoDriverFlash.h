@@ -87,6 +87,9 @@ typedef struct
     uint32_t                   partition_options;
 } mico_logic_partition_t;
 
+/** Completion handler of an asynchronous flash write, called from the flash writer thread */
+typedef void (*mico_flash_async_callback_t)( OSStatus result, void* arg );
+
 
 /******************************************************
  *                 Global Variables
@@ -154,6 +157,34 @@ OSStatus MicoFlashRead( mico_partition_t inPartition, volatile uint32_t* off_set
 
 
 
+/** Queue data to be written to an area on a Flash logical partition
+ *
+ * @note  The write is performed by a background thread, so that the caller can
+ *        go on with other work (e.g. receive the next OTA packet) while the flash
+ *        programs. Requests are executed in the order they are queued, inBuffer
+ *        must stay valid until the callback is called. The thread is started
+ *        by the first call, nothing is allocated until then.
+ *
+ * @param  inPartition    : The target flash logical partition which should be written
+ * @param  off_set        : Start address of the written area in the partition
+ * @param  inBuffer       : point to the data buffer that will be written to flash
+ * @param  inBufferLength : The length of the buffer
+ * @param  callback       : Called with the write result when done, can be NULL
+ * @param  arg            : Argument passed to callback
+ *
+ * @return    kNoErr             : On success.
+ * @return    kNotInitializedErr : If the flash writer thread could not be started
+ * @return    kGeneralErr        : If an error occurred with any step
+ */
+OSStatus MicoFlashWriteAsync( mico_partition_t inPartition, uint32_t off_set, uint8_t* inBuffer, uint32_t inBufferLength, mico_flash_async_callback_t callback, void* arg );
+
+/** Wait until all writes queued by @ref MicoFlashWriteAsync are finished
+ *
+ * @return    kNoErr        : On success, all writes queued since the last flush succeeded.
+ * @return    other         : The error of the first queued write that failed since the last flush
+ */
+OSStatus MicoFlashAsyncFlush( void );
+
 /** Set security options on a logical partition
  *
  * @param  inPartition     : The target flash logical partition
@@ -95,6 +95,15 @@ typedef struct
  *                 Type Definitions
  ******************************************************/
 
+/* One device's part of a MicoI2cTransferBatch */
+typedef struct
+{
+    mico_i2c_device_t*   device;
+    mico_i2c_message_t*  message;
+    uint16_t             number_of_messages;
+    OSStatus             result;      /* filled in by MicoI2cTransferBatch */
+} mico_i2c_transaction_t;
+
 
 
 /******************************************************
@@ -182,6 +191,23 @@ OSStatus MicoI2cBuildCombinedMessage(mico_i2c_message_t* message, const void* tx
 OSStatus MicoI2cTransfer( mico_i2c_device_t* device, mico_i2c_message_t* message, uint16_t number_of_messages );
 
 
+/** Runs transfers to several devices on one I2C port back to back
+ *
+ * The port is locked once for the whole batch, so other users of the bus
+ * can not interleave and the batch completes in a single pass. A failing
+ * transaction does not stop the ones after it.
+ *
+ * @param  transactions : the transfers, all devices must be on the same port
+ * @param  count        : the number of transactions
+ *
+ * @return    kNoErr        : every transaction succeeded.
+ * @return    kParamErr     : the devices are not all on the same port
+ * @return    other         : the error of the last failing transaction, see
+ *                            mico_i2c_transaction_t::result for each one
+ */
+OSStatus MicoI2cTransferBatch( mico_i2c_transaction_t* transactions, uint16_t count );
+
+
 /** Deinitialises an I2C device
  *
  * @param  device : the device for which the i2c port should be deinitialised
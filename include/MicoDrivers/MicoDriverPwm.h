@@ -95,6 +95,44 @@ OSStatus MicoPwmStart(mico_pwm_t pwm);
  */
 OSStatus MicoPwmStop(mico_pwm_t pwm);
 
+
+/** Gets the compare value of a 100% duty cycle
+ *
+ * @param pwm        : the PWM interface, initialised
+ * @param full       : receives the PWM period in timer counts
+ *
+ * @return    kNoErr          : on success.
+ * @return    kUnsupportedErr : if the PWM driver cannot stream duty cycles
+ */
+OSStatus MicoPwmGetResolution(mico_pwm_t pwm, uint32_t* full);
+
+
+/** Plays a table of compare values on a PWM pin, one per PWM period
+ *
+ * The duty cycle follows the table through DMA without the CPU. The table is
+ * read in place and must stay untouched until the stream is stopped or, when
+ * not looping, has played out; the last value is then kept.
+ *
+ * @param pwm        : the PWM interface, started
+ * @param compare    : compare values, 0 to the value of @ref MicoPwmGetResolution
+ * @param count      : number of values
+ * @param loop       : start over after the last value
+ *
+ * @return    kNoErr          : on success.
+ * @return    kUnsupportedErr : if the PWM interface has no DMA stream
+ */
+OSStatus MicoPwmStreamStart(mico_pwm_t pwm, const uint32_t* compare, uint16_t count, bool loop);
+
+
+/** Stops a duty cycle stream, the output keeps its current duty cycle
+ *
+ * @param pwm        : the PWM interface
+ *
+ * @return    kNoErr        : on success.
+ * @return    kGeneralErr   : if an error occurred with any step
+ */
+OSStatus MicoPwmStreamStop(mico_pwm_t pwm);
+
 /** @} */
 /** @} */
 
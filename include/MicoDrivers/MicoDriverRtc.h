@@ -105,6 +105,52 @@ OSStatus MicoRtcGetTime(mico_rtc_time_t* time);
  */
 OSStatus MicoRtcSetTime(mico_rtc_time_t* time);
 
+/**
+ * This function will return the time read from the on board CPU real time clock together
+ * with the milliseconds into the current second
+ *
+ * @param time        : pointer to a time structure
+ * @param msec        : pointer to the milliseconds, 0 - 999
+ *
+ * @return    kNoErr          : on success.
+ * @return    kUnsupportedErr : if the RTC has no sub-second counter
+ */
+OSStatus MicoRtcGetTimeMs(mico_rtc_time_t* time, uint16_t* msec);
+
+/**
+ * This function will move the MCU RTC time by less than a second. Unlike MicoRtcSetTime,
+ * the RTC keeps counting, so the fraction of the current second is not lost.
+ *
+ * @param msec        : milliseconds to add, -999 - 999
+ *
+ * @return    kNoErr          : on success.
+ * @return    kRangeErr       : if msec is out of range
+ * @return    kUnsupportedErr : if the RTC can not be shifted
+ */
+OSStatus MicoRtcShift(int32_t msec);
+
+/**
+ * This function will trim the rate of the MCU RTC, to correct the drift of its crystal.
+ * The correction is kept by the RTC through STOP mode and, with USE_RTC_BKP, resets.
+ *
+ * @param ppb         : rate correction in parts per billion, positive speeds the clock up
+ *
+ * @return    kNoErr          : on success.
+ * @return    kRangeErr       : if the RTC can not correct that much
+ * @return    kUnsupportedErr : if the RTC can not be calibrated
+ */
+OSStatus MicoRtcSetCalibration(int32_t ppb);
+
+/**
+ * This function will return the rate correction of the MCU RTC
+ *
+ * @param ppb         : pointer to the rate correction in parts per billion
+ *
+ * @return    kNoErr          : on success.
+ * @return    kUnsupportedErr : if the RTC can not be calibrated
+ */
+OSStatus MicoRtcGetCalibration(int32_t* ppb);
+
 /** @} */
 /** @} */
 
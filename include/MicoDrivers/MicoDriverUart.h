@@ -55,6 +55,8 @@
  *                 Type Definitions
  ******************************************************/
  typedef platform_uart_config_t                  mico_uart_config_t;
+ typedef platform_uart_rx_stats_t                mico_uart_rx_stats_t;
+ typedef platform_uart_tx_callback_t             mico_uart_tx_callback_t;
 
 /******************************************************
  *                 Function Declarations
@@ -115,6 +117,34 @@ OSStatus MicoUartFinalize( mico_uart_t uart );
 OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size );
 
 
+/** Queue data for transmission on a UART interface without waiting for it
+ *  to be sent
+ *
+ * @param  uart     : the UART interface
+ * @param  data     : pointer to the start of data
+ * @param  size     : number of bytes to transmit
+ * @param  release  : NULL to copy the data into the driver, otherwise the
+ *                    data is sent in place and release is called from
+ *                    interrupt context once the buffer may be reused
+ * @param  arg      : argument passed to release
+ *
+ * @return    kNoErr        : on success.
+ * @return    kGeneralErr   : if an error occurred with any step
+ */
+OSStatus MicoUartSendAsync( mico_uart_t uart, const void* data, uint32_t size, mico_uart_tx_callback_t release, void* arg );
+
+
+/** Wait until all data queued on a UART interface has been transmitted
+ *
+ * @param  uart     : the UART interface
+ * @param  timeout  : timeout in milisecond
+ *
+ * @return    kNoErr        : on success.
+ * @return    kTimeoutErr   : if the data was not sent in time
+ */
+OSStatus MicoUartFlush( mico_uart_t uart, uint32_t timeout );
+
+
 /** Receive data on a UART interface
  *
  * @param  uart     : the UART interface
@@ -135,6 +165,18 @@ OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t tim
  */
 uint32_t MicoUartGetLengthInBuffer( mico_uart_t uart ); 
 
+/** Read the receive statistics of a UART interface: interrupts taken, bytes
+ *  received and the latency from the interrupt to a waiting receiver
+ *
+ * @param  uart     : the UART interface
+ * @param  stats    : receives the statistics, may be NULL to only reset them
+ * @param  reset    : clear the statistics after reading them
+ *
+ * @return    kNoErr          : on success.
+ * @return    kUnsupportedErr : if the platform does not collect them
+ */
+OSStatus MicoUartGetRxStatistics( mico_uart_t uart, mico_uart_rx_stats_t* stats, bool reset );
+
 /** @} */
 /** @} */
 
@@ -52,6 +52,8 @@ typedef platform_spi_slave_command_t            mico_spi_slave_command_t;
 
 typedef platform_spi_slave_data_buffer_t        mico_spi_slave_data_buffer_t;
 
+typedef platform_mcu_powersave_stats_t          mico_mcu_powersave_stats_t;
+
 
 
 #include "MicoDrivers/MICODriverI2c.h"
@@ -119,6 +121,30 @@ void MicoSystemStandBy(uint32_t secondsToWakeup);
   */
 void MicoMcuPowerSaveConfig( int enable );
 
+/** @brief    Read how long the MCU was running, halted in WFI and in STOP mode.
+  *
+  * @note:    The time not spent sleeping or in STOP mode is run time, so the
+  *           counters show how much MCU powersave actually saves.
+  *
+  * @param    stats : receives the counters, may be NULL to only reset them
+  * @param    reset : restart the counters after reading them
+  * @return   kNoErr, or kUnsupportedErr if the MCU does not collect them
+  */
+OSStatus MicoMcuPowerSaveGetStatistics( mico_mcu_powersave_stats_t* stats, bool reset );
+
+/** @brief    Called in the RTOS tick interrupt, before the tick is counted.
+  *
+  * @note:    The thread the tick interrupts is still the current thread, so
+  *           the hook can count which thread uses the CPU. It runs in interrupt
+  *           context on every tick and must be short. The default does nothing,
+  *           the application defines it to override that. Only MCUs whose
+  *           platform code handles the tick interrupt call it.
+  *
+  * @param    none
+  * @return   none
+  */
+void MicoSysTickHook( void );
+
 
 
 void MicoSysLed(bool onoff);
@@ -42,6 +42,7 @@ extern "C" {
 
 typedef system_state_t   mico_system_state_t;
 typedef system_context_t mico_Context_t;
+typedef system_lease_t   mico_system_lease_t;
 
 /** @defgroup MICO_SYSTEM  MICO System APIs
 * @brief MiCO System provide a basic framework for application based on MiCO core APIs
@@ -120,6 +121,18 @@ OSStatus mico_system_context_restore( mico_Context_t* const in_context );
   */
 void appRestoreDefault_callback(void * const user_config_data, uint32_t size);
 
+/**
+  * @brief  Application should give the size its config data had in firmware
+  *         that saved settings in the legacy (non log structured) layout, if
+  *         the config data has grown since.
+  * @note   This a delegate function, can be completed by developer. Settings
+  *         in the legacy layout are only migrated if their CRC matches on this
+  *         size, fields behind it are filled with 0.
+  * @param  size: The current size of the application's config data.
+  * @retval Size of the application's config data in the legacy layout.
+  */
+uint32_t appLegacyConfigSize_callback(uint32_t size);
+
 /**
   * @brief  Write config data hosted by cote data to non-volatile storage
   * @param  in_context: The address of the core data.
@@ -202,6 +215,38 @@ OSStatus mico_system_delegate_config_recv_auth_data( char * userInfo );
   */
 void mico_system_delegate_config_success( mico_config_source_t source );
 
+/**
+  * @brief  Ask the application for a DHCP lease kept from an earlier 
+  *         connection, the station then comes up without running DHCP.
+  * @note   This a delegate function, can be completed by developer. Answer
+  *         false when no lease is kept, when it has expired or when it was
+  *         given by another access point. The station is reconnected with
+  *         DHCP when the lifetime given in lease->seconds runs out, a lease
+  *         without lifetime is not reused.
+  * @param  bssid: The access point the station is going to join.
+  * @param  lease: Filled with the lease to reuse.
+  * @retval true if lease should be reused.
+  */
+bool mico_system_delegate_lease_recall( const char *bssid, mico_system_lease_t *lease );
+
+/**
+  * @brief  Inform the application that DHCP has given (or renewed) a lease
+  * @note   This a delegate function, can be completed by developer.
+  * @param  lease: The addresses and the access point they belong to.
+  * @retval None
+  */
+void mico_system_delegate_lease_acquired( const mico_system_lease_t *lease );
+
+/**
+  * @brief  Reconnect the station with DHCP if it runs on a lease returned
+  *         by mico_system_delegate_lease_recall(), for example when the 
+  *         network can not be reached with it. No lease is recalled again
+  *         until the next reboot.
+  * @param  in_context: The address of the core data.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_lease_revoke( mico_Context_t * const in_context );
+
 /** @} */
 /*****************************************************************************/
 /** \defgroup system_monitor System Monitor Functions
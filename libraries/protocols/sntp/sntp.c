@@ -48,8 +48,34 @@
 #define NTP_Root_Delay           0x8000
 #define NTP_Root_Dispersion      0xa00b0000
 
+#define NTP_Mode_Mask            0x07
+#define NTP_Mode_Server          0x04
+#define NTP_Leap_Mask            0xc0
+#define NTP_Leap_Unsynchronized  0xc0
+
+/* The client runs for as long as the device does. Every reply gives the
+ * offset of the RTC to the server and the round trip, the RTC is stepped when
+ * it is off by a second or more and shifted otherwise, so it keeps counting.
+ * The offsets found over at least SNTP_DRIFT_BASELINE_MS are the drift of the
+ * crystal, which is trimmed with the RTC calibration. While the RTC stays
+ * close the poll interval doubles up to SNTP_POLL_MAX_S, so the network is
+ * rarely needed and sntp_current_time_get() only ever reads the RTC. */
+#define SNTP_POLL_MIN_S          64
+#define SNTP_POLL_MAX_S          (64*1024)
+#define SNTP_RETRY_MIN_S         8
+#define SNTP_TIMEOUT_S           5
+#define SNTP_RESOLVE_FAILURES    3           // look the server up again after that many timeouts
+#define SNTP_STEP_MS             1000        // offsets from this on step the RTC
+#define SNTP_STEADY_MS           128         // offsets below this back the poll off
+#define SNTP_SHIFT_MIN_MS        4           // one RTC sub-second step
+#define SNTP_DELAY_MAX_MS        1000        // replies slower than this are dropped
+#define SNTP_DRIFT_BASELINE_MS   (3600*1000)
+#define SNTP_DRIFT_MAX_PPB       450000      // range of the STM32 smooth calibration
+
 static volatile bool _wifiConnected = false;
 static mico_semaphore_t  _wifiConnected_sem = NULL;
+static bool _started = false;
+static void (*_time_changed_callback)( void ) = NULL;
 
 
 struct NtpPacket
@@ -60,7 +86,7 @@ struct NtpPacket
 	uint8_t precision;
 	uint32_t root_delay;
 	uint32_t root_dispersion;
-	uint8_t referenceID;
+	uint32_t referenceID;
 	uint32_t ref_ts_sec;
 	uint32_t ref_ts_frac;
 	uint32_t origin_ts_sec;
@@ -71,6 +97,14 @@ struct NtpPacket
 	uint32_t trans_ts_frac;
 };
 
+/* Drift estimation, all times in ms of server time */
+static struct {
+  bool    valid;
+  int64_t base;          // sample the estimation started from
+  int64_t error;         // offset gained by the RTC since base
+  int32_t uncorrected;   // part of the last offset the RTC was not moved by
+} _drift;
+
 void ntpNotify_WifiStatusHandler(int event, void *arg)
 {
   ntp_log_trace();
@@ -82,6 +116,7 @@ void ntpNotify_WifiStatusHandler(int event, void *arg)
       mico_rtos_set_semaphore(&_wifiConnected_sem);
     break;
   case NOTIFY_STATION_DOWN:
+    _wifiConnected = false;
     break;
   default:
     break;
@@ -89,6 +124,209 @@ void ntpNotify_WifiStatusHandler(int event, void *arg)
   return;
 }
 
+static void sntp_rtc_to_tm( const mico_rtc_time_t* mico_time, struct tm* time )
+{
+  memset(time, 0x0, sizeof(struct tm));
+  time->tm_sec = mico_time->sec;
+  time->tm_min = mico_time->min;
+  time->tm_hour = mico_time->hr;
+  time->tm_mday = mico_time->date;
+  time->tm_wday = mico_time->weekday;
+  time->tm_mon = mico_time->month - 1;
+  time->tm_year = mico_time->year + 100;
+}
+
+/* RTC time in ms since 1970, without sub-second support the fraction is 0 */
+static OSStatus sntp_rtc_now( int64_t* now )
+{
+  OSStatus err;
+  mico_rtc_time_t mico_time;
+  uint16_t msec = 0;
+  struct tm time;
+
+  err = MicoRtcGetTimeMs( &mico_time, &msec );
+  if( err == kUnsupportedErr )
+    err = MicoRtcGetTime( &mico_time );
+  require_noerr( err, exit );
+
+  sntp_rtc_to_tm( &mico_time, &time );
+  *now = (int64_t)mktime( &time ) * 1000 + msec;
+
+exit:
+  return err;
+}
+
+/* Setting the RTC restarts the second, the fraction is shifted in after it */
+static OSStatus sntp_rtc_step( int64_t now )
+{
+  OSStatus err;
+  time_t current = (time_t)( now / 1000 );
+  struct tm *currentTime;
+  mico_rtc_time_t time;
+
+  currentTime = localtime(&current);
+  time.sec = currentTime->tm_sec;
+  time.min = currentTime->tm_min ;
+  time.hr = currentTime->tm_hour;
+
+  time.date = currentTime->tm_mday;
+  time.weekday = currentTime->tm_wday;
+  time.month = currentTime->tm_mon + 1;
+  time.year = (currentTime->tm_year + 1900)%100;
+
+  err = MicoRtcSetTime( &time );
+  require_noerr( err, exit );
+
+  err = MicoRtcShift( (int32_t)( now % 1000 ) );
+  if( err == kUnsupportedErr )
+    err = kNoErr;
+
+exit:
+  return err;
+}
+
+static void sntp_ms_to_ntp( int64_t ms, uint32_t* sec, uint32_t* frac )
+{
+  *sec = htonl( (uint32_t)( ms / 1000 ) + UNIX_OFFSET );
+  *frac = htonl( (uint32_t)( ( (uint64_t)( ms % 1000 ) << 32 ) / 1000 ) );
+}
+
+static int64_t sntp_ntp_to_ms( uint32_t sec, uint32_t frac )
+{
+  return (int64_t)( ntohl( sec ) - UNIX_OFFSET ) * 1000 + (int64_t)( ( (uint64_t)ntohl( frac ) * 1000 ) >> 32 );
+}
+
+/* Offsets corrected over the baseline are the rate error left by the current
+ * calibration, half of it is taken over so a noisy sample cannot swing it */
+static void sntp_drift_update( int64_t server_time, int32_t offset, int32_t corrected )
+{
+  int64_t elapsed, residual;
+  int32_t calibration;
+
+  if( !_drift.valid ) {
+    _drift.valid = true;
+    _drift.base = server_time;
+    _drift.error = 0;
+  } else {
+    _drift.error += offset - _drift.uncorrected;
+  }
+  _drift.uncorrected = offset - corrected;
+
+  elapsed = server_time - _drift.base;
+  if( elapsed < SNTP_DRIFT_BASELINE_MS )
+    return;
+
+  residual = _drift.error * 1000000000 / elapsed;
+  if( residual > 2 * SNTP_DRIFT_MAX_PPB ) residual = 2 * SNTP_DRIFT_MAX_PPB;
+  if( residual < -2 * SNTP_DRIFT_MAX_PPB ) residual = -2 * SNTP_DRIFT_MAX_PPB;
+  if( MicoRtcGetCalibration( &calibration ) == kNoErr ) {
+    calibration += (int32_t)( residual / 2 );
+    if( calibration > SNTP_DRIFT_MAX_PPB ) calibration = SNTP_DRIFT_MAX_PPB;
+    if( calibration < -SNTP_DRIFT_MAX_PPB ) calibration = -SNTP_DRIFT_MAX_PPB;
+    if( MicoRtcSetCalibration( calibration ) == kNoErr )
+      ntp_log("RTC drift %d ppb over %d s, calibration %d ppb", (int)residual, (int)( elapsed / 1000 ), calibration);
+  }
+
+  _drift.base = server_time;
+  _drift.error = 0;
+}
+
+/* One request, the times of the offset are: t1 sent, t2 received by the
+ * server, t3 sent by the server and t4 received. t4 is t1 plus the round trip
+ * measured with the system tick, which is finer than the RTC. */
+static OSStatus sntp_query( int fd, struct sockaddr_t* server, int64_t* offset, int64_t* server_time, uint32_t* delay )
+{
+  OSStatus err = kNoErr;
+  fd_set readfds;
+  struct timeval_t t;
+  struct sockaddr_t addr;
+  socklen_t addrLen = sizeof(addr);
+  struct NtpPacket outpacket, inpacket;
+  int64_t t1, t2, t3, t4;
+  uint32_t sent;
+  int32_t left;
+
+  memset(&outpacket,0x0,sizeof(outpacket));
+  outpacket.flags = NTP_Flags;
+  outpacket.stratum = NTP_Stratum;
+  outpacket.poll = NTP_Poll;
+  outpacket.precision = NTP_Precision;
+  outpacket.root_delay = NTP_Root_Delay;
+  outpacket.root_dispersion = NTP_Root_Dispersion;
+
+  err = sntp_rtc_now( &t1 );
+  require_noerr( err, exit );
+  sntp_ms_to_ntp( t1, &outpacket.trans_ts_sec, &outpacket.trans_ts_frac );
+
+  sent = mico_get_time();
+  require_action(sendto(fd, &outpacket,sizeof(outpacket), 0, server, sizeof(struct sockaddr_t)) == sizeof(outpacket), exit, err = kNotWritableErr);
+
+  while(1) {
+    left = SNTP_TIMEOUT_S * 1000 - (int32_t)( mico_get_time() - sent );
+    require_action( left > 0, exit, err = kTimeoutErr );
+    t.tv_sec = left / 1000;
+    t.tv_usec = ( left % 1000 ) * 1000;
+
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    select(fd + 1, &readfds, NULL, NULL, &t);
+    require_action( FD_ISSET(fd, &readfds), exit, err = kTimeoutErr );
+
+    require_action(recvfrom(fd, &inpacket, sizeof(struct NtpPacket), 0, &addr, &addrLen) == sizeof(struct NtpPacket), exit, err = kNotReadableErr);
+    *delay = mico_get_time() - sent;
+
+    /* a late reply to an earlier request is skipped */
+    if( inpacket.origin_ts_sec == outpacket.trans_ts_sec && inpacket.origin_ts_frac == outpacket.trans_ts_frac )
+      break;
+  }
+
+  require_action( ( inpacket.flags & NTP_Mode_Mask ) == NTP_Mode_Server, exit, err = kMalformedErr );
+  require_action( ( inpacket.flags & NTP_Leap_Mask ) != NTP_Leap_Unsynchronized, exit, err = kNotPreparedErr );
+  require_action( inpacket.stratum != 0 && inpacket.trans_ts_sec != 0, exit, err = kNotPreparedErr );
+
+  t2 = sntp_ntp_to_ms( inpacket.recv_ts_sec, inpacket.recv_ts_frac );
+  t3 = sntp_ntp_to_ms( inpacket.trans_ts_sec, inpacket.trans_ts_frac );
+  t4 = t1 + *delay;
+
+  /* round trip without the time the server held the request */
+  if( t3 - t2 >= 0 && t3 - t2 < *delay )
+    *delay -= (uint32_t)( t3 - t2 );
+  *offset = ( ( t2 - t1 ) + ( t3 - t4 ) ) / 2;
+  *server_time = t3 + *delay / 2;
+
+exit:
+  return err;
+}
+
+/* Moves the RTC by the offset, returns the interval to the next poll */
+static uint32_t sntp_discipline( int64_t offset, int64_t server_time, uint32_t poll )
+{
+  int64_t now;
+  time_t current;
+  int32_t corrected = 0;
+
+  if( offset >= SNTP_STEP_MS || offset <= -SNTP_STEP_MS ) {
+    if( sntp_rtc_now( &now ) != kNoErr || sntp_rtc_step( now + offset ) != kNoErr )
+      return SNTP_RETRY_MIN_S;
+    current = (time_t)( ( now + offset ) / 1000 );
+    ntp_log("Time Synchronoused, stepped %d s, %s", (int)( offset / 1000 ), asctime(localtime(&current)));
+    _drift.valid = false;
+    if( _time_changed_callback )
+      _time_changed_callback();
+    return SNTP_POLL_MIN_S;
+  }
+
+  if( offset >= SNTP_SHIFT_MIN_MS || offset <= -SNTP_SHIFT_MIN_MS ) {
+    if( MicoRtcShift( (int32_t)offset ) == kNoErr )
+      corrected = (int32_t)offset;
+  }
+  sntp_drift_update( server_time, (int32_t)offset, corrected );
+
+  if( offset < SNTP_STEADY_MS && offset > -SNTP_STEADY_MS )
+    return ( poll >= SNTP_POLL_MAX_S / 2 ) ? SNTP_POLL_MAX_S : poll * 2;
+  return ( poll <= SNTP_POLL_MIN_S * 2 ) ? SNTP_POLL_MIN_S : poll / 2;
+}
+
 void NTPClient_thread(void *arg)
 {
   ntp_log_trace();
@@ -96,124 +334,104 @@ void NTPClient_thread(void *arg)
   UNUSED_PARAMETER( arg );
   
   int  Ntp_fd = -1;
-  fd_set readfds;
-  struct timeval_t t ;
   struct sockaddr_t addr;
-  socklen_t addrLen;	
   char ipstr[16];
-  unsigned int trans_sec, current;
-  struct NtpPacket outpacket ,inpacket;
-  struct tm *currentTime;
-  mico_rtc_time_t time;
+  bool resolved = false;
+  uint32_t poll = SNTP_POLL_MIN_S, sleep_s, delay = 0;
+  uint8_t failures = 0;
+  int64_t offset = 0, server_time = 0;
   LinkStatusTypeDef wifi_link;
   
   /* Regisist notifications */
   err = mico_system_notify_register( mico_notify_WIFI_STATUS_CHANGED, (void *)ntpNotify_WifiStatusHandler, NULL );
   require_noerr( err, exit ); 
  
-  memset(&outpacket,0x0,sizeof(outpacket));
-  memset(&inpacket,0x0,sizeof(inpacket));
-
-  outpacket.flags = NTP_Flags;
-  outpacket.stratum = NTP_Stratum;
-  outpacket.poll = NTP_Poll;
-  outpacket.precision = NTP_Precision;
-  outpacket.root_delay = NTP_Root_Delay;
-  outpacket.root_dispersion = NTP_Root_Dispersion;
-  
   err = micoWlanGetLinkStatus( &wifi_link );
   require_noerr( err, exit );
 
   if( wifi_link.is_connected == true )
     _wifiConnected = true;
   
-  if(_wifiConnected == false)
-    mico_rtos_get_semaphore(&_wifiConnected_sem, MICO_WAIT_FOREVER);
-  
   Ntp_fd = socket(AF_INET, SOCK_DGRM, IPPROTO_UDP);
   require_action(IsValidSocket( Ntp_fd ), exit, err = kNoResourcesErr );
   addr.s_ip = INADDR_ANY; 
   addr.s_port = 45000;
-  err = bind(Ntp_fd, &addr, sizeof(addr));
-  err = kNoErr;
-  require_noerr(err, exit);
-
-   while(1) {
-     err = gethostbyname(NTP_Server, (uint8_t *)ipstr, 16);
-     require_noerr(err, ReConnWithDelay);
-     ntp_log("NTP server address: %s",ipstr);
-     break;
-
-   ReConnWithDelay:
-     mico_thread_sleep(5);
-   }
-
-  addr.s_ip = inet_addr(ipstr);
-  addr.s_port = NTP_Port;
+  bind(Ntp_fd, &addr, sizeof(addr));
 
-  t.tv_sec = 5;
-  t.tv_usec = 0;
-  
   while(1) {
-    require_action(sendto(Ntp_fd, &outpacket,sizeof(outpacket), 0, &addr, sizeof(addr)), exit, err = kNotWritableErr);
+    while(_wifiConnected == false)
+      mico_rtos_get_semaphore(&_wifiConnected_sem, MICO_WAIT_FOREVER);
 
-    FD_ZERO(&readfds);
-    FD_SET(Ntp_fd, &readfds);
-
-    select(1, &readfds, NULL, NULL, &t);
-    
-    if(FD_ISSET(Ntp_fd, &readfds))
-    {
-      require_action(recvfrom(Ntp_fd, &inpacket, sizeof(struct NtpPacket), 0, &addr, &addrLen)>=0, exit, err = kNotReadableErr);
-
-      trans_sec = inpacket.trans_ts_sec;
-      trans_sec = ntohl(trans_sec);
-      current = trans_sec - UNIX_OFFSET;
-      ntp_log("Time Synchronoused, %s",asctime(localtime(&current)));
-
-      currentTime = localtime(&current);
-      time.sec = currentTime->tm_sec;
-      time.min = currentTime->tm_min ;
-      time.hr = currentTime->tm_hour;
-
-      time.date = currentTime->tm_mday;
-      time.weekday = currentTime->tm_wday;
-      time.month = currentTime->tm_mon + 1;
-      time.year = (currentTime->tm_year + 1900)%100;
-
-      MicoRtcSetTime( &time );
-      goto exit;
+    if( !resolved ) {
+      err = gethostbyname(NTP_Server, (uint8_t *)ipstr, 16);
+      if( err != kNoErr ) {
+        mico_thread_sleep(SNTP_RETRY_MIN_S);
+        continue;
+      }
+      ntp_log("NTP server address: %s",ipstr);
+      resolved = true;
     }
+    addr.s_ip = inet_addr(ipstr);
+    addr.s_port = NTP_Port;
+
+    err = sntp_query( Ntp_fd, &addr, &offset, &server_time, &delay );
+    if( err == kNoErr && delay <= SNTP_DELAY_MAX_MS ) {
+      failures = 0;
+      poll = sntp_discipline( offset, server_time, poll );
+      sleep_s = poll;
+      ntp_log("offset %d ms, delay %d ms, next poll in %d s", (int)offset, delay, poll);
+    } else {
+      if( ++failures >= SNTP_RESOLVE_FAILURES )
+        resolved = false;
+      sleep_s = SNTP_RETRY_MIN_S << ( failures < 4 ? failures : 4 );
+      if( sleep_s > poll )
+        sleep_s = poll;
+      ntp_log("no valid reply, err = %d, retry in %d s", err, sleep_s);
+    }
+
+    /* the thread sleeps, so the MCU may stay in STOP mode till the next poll */
+    mico_thread_sleep(sleep_s);
   }
+
 exit:
     if( err!=kNoErr )ntp_log("Exit: NTP client exit with err = %d", err);
     mico_system_notify_remove( mico_notify_WIFI_STATUS_CHANGED, (void *)ntpNotify_WifiStatusHandler );
-    if(_wifiConnected_sem) mico_rtos_deinit_semaphore(&_wifiConnected_sem);
     SocketClose(&Ntp_fd);
+    _started = false;
     mico_rtos_delete_thread(NULL);
     return;
 }
 
 OSStatus sntp_client_start( void )
 {
-  mico_rtos_init_semaphore(&_wifiConnected_sem, 1);
-  return mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "NTP Client", NTPClient_thread, STACK_SIZE_NTP_CLIENT_THREAD, NULL );
-}
+  OSStatus err = kNoErr;
 
+  if( _started )
+    return kNoErr;
 
+  if( _wifiConnected_sem == NULL ) {
+    err = mico_rtos_init_semaphore(&_wifiConnected_sem, 1);
+    require_noerr( err, exit );
+  }
+  err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "NTP Client", NTPClient_thread, STACK_SIZE_NTP_CLIENT_THREAD, NULL );
+  require_noerr( err, exit );
+  _started = true;
+
+exit:
+  return err;
+}
+
+void sntp_set_time_changed_callback( void (*callback)( void ) )
+{
+  _time_changed_callback = callback;
+}
 
 OSStatus sntp_current_time_get( struct tm* time )
 {
   mico_rtc_time_t mico_time;
   /*Read current time from RTC.*/
   if( MicoRtcGetTime(&mico_time) == kNoErr ){
-    time->tm_sec = mico_time.sec;
-    time->tm_min = mico_time.min;
-    time->tm_hour = mico_time.hr;
-    time->tm_mday = mico_time.date;
-    time->tm_wday = mico_time.weekday;
-    time->tm_mon = mico_time.month - 1;
-    time->tm_year = mico_time.year + 100;
+    sntp_rtc_to_tm( &mico_time, time );
     return kNoErr;
   }else
     return kGeneralErr;
@@ -31,10 +31,20 @@
 
 #pragma once
 
+#include <time.h>
+
 #include "common.h"
 
 
+/* Keeps the RTC on NTP time for as long as the device runs, a second call
+ * does nothing */
 OSStatus sntp_client_start( void );
 
+/* Called from the NTP client thread after the RTC was stepped, not after the
+ * sub-second corrections */
+void sntp_set_time_changed_callback( void (*callback)( void ) );
+
+/* Reads the RTC, the network is never waited for */
+
 OSStatus sntp_current_time_get( struct tm* time );
 
@@ -29,7 +29,14 @@
     #include <CommonCrypto/CommonCryptorSPI.h>
 #endif
 
-#if( !AES_UTILS_USE_COMMON_CRYPTO && !AES_UTILS_USE_GLADMAN_AES && TARGET_NO_OPENSSL )
+#if( AES_UTILS_HAS_GCM )
+    #include "MICO.h"
+#endif
+
+#define AES_UTILS_HAS_AES_KEY_API      ( !AES_UTILS_USE_COMMON_CRYPTO && !AES_UTILS_USE_GLADMAN_AES && \
+                                        !AES_UTILS_USE_MICO_AES && !AES_UTILS_USE_USSL && !AES_UTILS_USE_STM32_CRYP )
+
+#if( AES_UTILS_HAS_AES_KEY_API && ( TARGET_NO_OPENSSL || AES_UTILS_USE_CT_AES ) )
 static
 void AES_cbc_encrypt(const unsigned char *in, unsigned char *out,
              const unsigned long length, const AES_KEY *key,
@@ -38,6 +45,39 @@ void AES_cbc_encrypt(const unsigned char *in, unsigned char *out,
 
 #define aes_log(M, ...) custom_log("AES", M, ##__VA_ARGS__)
 
+// Number of counter blocks AES_CTR_Update encrypts with a single backend call. Batching amortizes the per-call cost
+// (the key load on the CRYP peripheral, call overhead elsewhere) for 16 bytes of stack per block.
+
+#define kAES_CTR_BatchBlocks        4
+
+//===========================================================================================================================
+//  AES_XORBytes
+//===========================================================================================================================
+
+static void AES_XORBytes( uint8_t *inDst, const uint8_t *inSrc, const uint8_t *inKey, size_t inLen )
+{
+    // Word at a time when all buffers allow it, which is the common case for packet buffers.
+    
+    if( ( ( (uintptr_t) inDst | (uintptr_t) inSrc | (uintptr_t) inKey ) & 3 ) == 0 )
+    {
+        uint32_t *          dst = (uint32_t *) inDst;
+        const uint32_t *    src = (const uint32_t *) inSrc;
+        const uint32_t *    key = (const uint32_t *) inKey;
+        
+        for( ; inLen >= 4; inLen -= 4 )
+        {
+            *dst++ = *src++ ^ *key++;
+        }
+        inDst = (uint8_t *) dst;
+        inSrc = (const uint8_t *) src;
+        inKey = (const uint8_t *) key;
+    }
+    while( inLen-- > 0 )
+    {
+        *inDst++ = *inSrc++ ^ *inKey++;
+    }
+}
+
 //===========================================================================================================================
 //  AES_CTR_Init
 //===========================================================================================================================
@@ -63,6 +103,9 @@ OSStatus
     AesSetKeyDirect(&inContext->ctx, (unsigned char *) inKey, AES_BLOCK_SIZE, inNonce, AES_ENCRYPTION);
 #elif( AES_UTILS_USE_USSL )
     aes_setkey_enc( &inContext->ctx, (unsigned char *) inKey, kAES_CTR_Size * 8 );
+#elif( AES_UTILS_USE_STM32_CRYP )
+    RCC_AHB2PeriphClockCmd( RCC_AHB2Periph_CRYP, ENABLE );
+    memcpy( inContext->key, inKey, kAES_CTR_Size );
 #else
     AES_set_encrypt_key( inKey, kAES_CTR_Size * 8, &inContext->key );
 #endif
@@ -91,6 +134,51 @@ static inline void AES_CTR_Increment( uint8_t *inCounter )
     }
 }
 
+//===========================================================================================================================
+//  AES_CTR_EncryptBlocks
+//===========================================================================================================================
+
+static OSStatus AES_CTR_EncryptBlocks( AES_CTR_Context *inContext, uint8_t *ioBuf, size_t inBlocks )
+{
+    OSStatus        err;
+    size_t          len;
+    
+    // Encrypts inBlocks counter blocks in place. Every backend supports in-place operation.
+    
+    len = inBlocks * kAES_CTR_Size;
+#if( AES_UTILS_USE_COMMON_CRYPTO )
+    {
+        size_t      i;
+        
+        err = CCCryptorUpdate( inContext->cryptor, ioBuf, len, ioBuf, len, &i );
+        require_noerr( err, exit );
+        require_action( i == len, exit, err = kSizeErr );
+    }
+#elif( AES_UTILS_USE_GLADMAN_AES )
+    aes_ecb_encrypt( ioBuf, ioBuf, (int) len, &inContext->ctx );
+#elif( AES_UTILS_USE_STM32_CRYP )
+    require_action( CRYP_AES_ECB( MODE_ENCRYPT, inContext->key, kAES_CTR_Size * 8, ioBuf, (uint32_t) len, ioBuf ) == SUCCESS, 
+        exit, err = kGeneralErr );
+#else
+    for( ; len > 0; len -= kAES_CTR_Size, ioBuf += kAES_CTR_Size )
+    {
+        #if( AES_UTILS_USE_MICO_AES )
+            AesEncryptDirect( &inContext->ctx, ioBuf, ioBuf );
+        #elif( AES_UTILS_USE_USSL )
+            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, ioBuf, ioBuf );
+        #else
+            AES_encrypt( ioBuf, ioBuf, &inContext->key );
+        #endif
+    }
+#endif
+    err = kNoErr;
+    
+#if( AES_UTILS_USE_COMMON_CRYPTO || AES_UTILS_USE_STM32_CRYP )
+exit:
+#endif
+    return( err );
+}
+
 //===========================================================================================================================
 //  AES_CTR_Update
 //===========================================================================================================================
@@ -102,7 +190,9 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     uint8_t *           dst;
     uint8_t *           buf;
     size_t              used;
-    size_t              i;
+    size_t              i, n;
+    uint32_t            stream[ ( kAES_CTR_BatchBlocks * kAES_CTR_Size ) / sizeof( uint32_t ) ];
+    uint8_t * const     streamPtr = (uint8_t *) stream;
     
     // inSrc and inDst may be the same, but otherwise, the buffers must not overlap.
     
@@ -125,51 +215,35 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     }
     inContext->used = used;
     
-    // Process whole blocks.
+    // Process whole blocks a batch at a time: lay out the counters, encrypt them with one backend call, then XOR
+    // the keystream into the data.
     
     while( inLen >= kAES_CTR_Size )
     {
-        #if( AES_UTILS_USE_COMMON_CRYPTO )
-            err = CCCryptorUpdate( inContext->cryptor, inContext->ctr, kAES_CTR_Size, buf, kAES_CTR_Size, &i );
-            require_noerr( err, exit );
-            require_action( i == kAES_CTR_Size, exit, err = kSizeErr );
-        #elif( AES_UTILS_USE_GLADMAN_AES )
-            aes_ecb_encrypt( inContext->ctr, buf, kAES_CTR_Size, &inContext->ctx );
-        #elif( AES_UTILS_USE_MICO_AES )
-            AesEncryptDirect( &inContext->ctx, buf, inContext->ctr );
-        #elif( AES_UTILS_USE_USSL )
-            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, inContext->ctr, buf );
-        #else
-            AES_encrypt( inContext->ctr, buf, &inContext->key );
-        #endif
-        AES_CTR_Increment( inContext->ctr );
+        n = inLen / kAES_CTR_Size;
+        if( n > kAES_CTR_BatchBlocks ) n = kAES_CTR_BatchBlocks;
         
-        for( i = 0; i < kAES_CTR_Size; ++i )
+        for( i = 0; i < n; ++i )
         {
-            dst[ i ] = src[ i ] ^ buf[ i ];
+            memcpy( &streamPtr[ i * kAES_CTR_Size ], inContext->ctr, kAES_CTR_Size );
+            AES_CTR_Increment( inContext->ctr );
         }
-        src   += kAES_CTR_Size;
-        dst   += kAES_CTR_Size;
-        inLen -= kAES_CTR_Size;
+        err = AES_CTR_EncryptBlocks( inContext, streamPtr, n );
+        require_noerr( err, exit );
+        
+        AES_XORBytes( dst, src, streamPtr, n * kAES_CTR_Size );
+        src   += n * kAES_CTR_Size;
+        dst   += n * kAES_CTR_Size;
+        inLen -= n * kAES_CTR_Size;
     }
     
     // Process any trailing sub-block bytes. Extra key material is buffered for next time.
     
     if( inLen > 0 )
     {
-        #if( AES_UTILS_USE_COMMON_CRYPTO )
-            err = CCCryptorUpdate( inContext->cryptor, inContext->ctr, kAES_CTR_Size, buf, kAES_CTR_Size, &i );
-            require_noerr( err, exit );
-            require_action( i == kAES_CTR_Size, exit, err = kSizeErr );
-        #elif( AES_UTILS_USE_GLADMAN_AES )
-            aes_ecb_encrypt( inContext->ctr, buf, kAES_CTR_Size, &inContext->ctx );
-        #elif( AES_UTILS_USE_MICO_AES )
-            AesEncryptDirect( &inContext->ctx, buf, inContext->ctr );
-        #elif( AES_UTILS_USE_USSL )
-            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, inContext->ctr, buf );
-        #else
-            AES_encrypt( inContext->ctr, buf, &inContext->key );
-        #endif
+        memcpy( buf, inContext->ctr, kAES_CTR_Size );
+        err = AES_CTR_EncryptBlocks( inContext, buf, 1 );
+        require_noerr( err, exit );
         AES_CTR_Increment( inContext->ctr );
         
         for( i = 0; i < inLen; ++i )
@@ -186,9 +260,8 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     }
     err = kNoErr;
     
-#if( AES_UTILS_USE_COMMON_CRYPTO )
 exit:
-#endif
+    memset( stream, 0, sizeof( stream ) ); // Clear keystream.
     return( err );
 }
 
@@ -235,10 +308,15 @@ OSStatus
 #elif( AES_UTILS_USE_MICO_AES )
     if( inEncrypt ) AesSetKeyDirect(&inContext->ctx, (unsigned char *) inKey, AES_BLOCK_SIZE, inIV, AES_ENCRYPTION);
     else            AesSetKeyDirect(&inContext->ctx, (unsigned char *) inKey, AES_BLOCK_SIZE, inIV, AES_DECRYPTION);
+    inContext->mode = inEncrypt ? AES_ENCRYPTION : AES_DECRYPTION;
 #elif( AES_UTILS_USE_USSL )
     if( inEncrypt ) aes_setkey_enc( &inContext->ctx, (unsigned char *) inKey, kAES_CBCFrame_Size * 8 );
     else            aes_setkey_dec( &inContext->ctx, (unsigned char *) inKey, kAES_CBCFrame_Size * 8 );
     inContext->encrypt = inEncrypt;
+#elif( AES_UTILS_USE_STM32_CRYP )
+    RCC_AHB2PeriphClockCmd( RCC_AHB2Periph_CRYP, ENABLE );
+    memcpy( inContext->key, inKey, kAES_CBCFrame_Size );
+    inContext->encrypt = inEncrypt;
 #else
     if( inEncrypt ) AES_set_encrypt_key( inKey, kAES_CBCFrame_Size * 8, &inContext->key );
     else            AES_set_decrypt_key( inKey, kAES_CBCFrame_Size * 8, &inContext->key );
@@ -248,6 +326,43 @@ OSStatus
     return( kNoErr );
 }
 
+//===========================================================================================================================
+//  AES_CBCFrame_Crypt
+//===========================================================================================================================
+
+#if( AES_UTILS_USE_MICO_AES )
+static void AES_CBCFrame_Crypt( AES_CBCFrame_Context *inContext, const uint8_t *inSrc, size_t inLen, uint8_t *inDst )
+{
+    // The library chains the IV in the context across calls.
+    
+    if( inContext->mode == AES_ENCRYPTION ) AesCbcEncrypt( &inContext->ctx, inDst, inSrc, (word32) inLen );
+    else                                    AesCbcDecrypt( &inContext->ctx, inDst, inSrc, (word32) inLen );
+}
+#elif( AES_UTILS_USE_STM32_CRYP )
+static OSStatus
+    AES_CBCFrame_Crypt( 
+        AES_CBCFrame_Context *  inContext, 
+        uint8_t                 ioIV[ kAES_CBCFrame_Size ], 
+        const uint8_t *         inSrc, 
+        size_t                  inLen, 
+        uint8_t *               inDst )
+{
+    uint8_t     next[ kAES_CBCFrame_Size ];
+    
+    // The next IV is the last ciphertext block. When decrypting that's the input, which may be overwritten in place.
+    
+    if( !inContext->encrypt ) memcpy( next, inSrc + inLen - kAES_CBCFrame_Size, kAES_CBCFrame_Size );
+    if( CRYP_AES_CBC( inContext->encrypt ? MODE_ENCRYPT : MODE_DECRYPT, ioIV, inContext->key, kAES_CBCFrame_Size * 8, 
+            (uint8_t *) inSrc, (uint32_t) inLen, inDst ) != SUCCESS )
+    {
+        return( kGeneralErr );
+    }
+    if( inContext->encrypt ) memcpy( next, inDst + inLen - kAES_CBCFrame_Size, kAES_CBCFrame_Size );
+    memcpy( ioIV, next, kAES_CBCFrame_Size );
+    return( kNoErr );
+}
+#endif
+
 //===========================================================================================================================
 //  AES_CBCFrame_Update
 //===========================================================================================================================
@@ -282,13 +397,20 @@ OSStatus    AES_CBCFrame_Update( AES_CBCFrame_Context *inContext, const void *in
             if( inContext->encrypt )    aes_cbc_encrypt( src, dst, (int) len, iv, &inContext->ctx.encrypt );
             else                        aes_cbc_decrypt( src, dst, (int) len, iv, &inContext->ctx.decrypt );
         #elif( AES_UTILS_USE_MICO_AES )
-            AesCbcEncrypt(&inContext->ctx, dst, src, len);
+            AesSetIV( &inContext->ctx, inContext->iv ); // Every frame starts from the original IV.
+            AES_CBCFrame_Crypt( inContext, src, len, dst );
         #elif( AES_UTILS_USE_USSL )
             uint8_t     iv[ kAES_CBCFrame_Size ];
 
             memcpy( iv, inContext->iv, kAES_CBCFrame_Size ); // Use local copy so original IV is not changed.
             if( inContext->encrypt )    aes_crypt_cbc( &inContext->ctx, AES_ENCRYPT, len, iv, (unsigned char *) src, dst );
             else                        aes_crypt_cbc( &inContext->ctx, AES_DECRYPT, len, iv, (unsigned char *) src, dst );
+        #elif( AES_UTILS_USE_STM32_CRYP )
+            uint8_t     iv[ kAES_CBCFrame_Size ];
+            
+            memcpy( iv, inContext->iv, kAES_CBCFrame_Size ); // Use local copy so original IV is not changed.
+            err = AES_CBCFrame_Crypt( inContext, iv, src, len, dst );
+            require_noerr( err, exit );
         #else
             uint8_t     iv[ kAES_CBCFrame_Size ];
             
@@ -304,7 +426,7 @@ OSStatus    AES_CBCFrame_Update( AES_CBCFrame_Context *inContext, const void *in
     while( src != end ) *dst++ = *src++;
     err = kNoErr;
     
-#if( AES_UTILS_USE_COMMON_CRYPTO )
+#if( AES_UTILS_USE_COMMON_CRYPTO || AES_UTILS_USE_STM32_CRYP )
 exit:
 #endif
     return( err );
@@ -343,6 +465,9 @@ OSStatus
     }
 #else
     memcpy( iv, inContext->iv, kAES_CBCFrame_Size ); // Use local copy so original IV is not changed.
+    #if( AES_UTILS_USE_MICO_AES )
+        AesSetIV( &inContext->ctx, iv );
+    #endif
 #endif
     
     // Process all whole blocks from buffer 1.
@@ -357,7 +482,10 @@ OSStatus
             if( inContext->encrypt )    aes_cbc_encrypt( src1, dst, (int) len, iv, &inContext->ctx.encrypt );
             else                        aes_cbc_decrypt( src1, dst, (int) len, iv, &inContext->ctx.decrypt );
         #elif( AES_UTILS_USE_MICO_AES )
-            AesCbcEncrypt(&inContext->ctx, dst, src1, len);
+            AES_CBCFrame_Crypt( inContext, src1, len, dst );
+        #elif( AES_UTILS_USE_STM32_CRYP )
+            err = AES_CBCFrame_Crypt( inContext, iv, src1, len, dst );
+            require_noerr( err, exit );
         #elif( AES_UTILS_USE_USSL )
             if( inContext->encrypt )    aes_crypt_cbc( &inContext->ctx, AES_ENCRYPT, len, iv, (unsigned char *) src1, dst );
             else                        aes_crypt_cbc( &inContext->ctx, AES_DECRYPT, len, iv, (unsigned char *) src1, dst );
@@ -390,7 +518,10 @@ OSStatus
             if( inContext->encrypt )    aes_cbc_encrypt( buf, dst, (int) i, iv, &inContext->ctx.encrypt );
             else                        aes_cbc_decrypt( buf, dst, (int) i, iv, &inContext->ctx.decrypt );
         #elif( AES_UTILS_USE_MICO_AES )
-            AesCbcEncrypt(&inContext->ctx, dst, buf, i);
+            AES_CBCFrame_Crypt( inContext, buf, i, dst );
+        #elif( AES_UTILS_USE_STM32_CRYP )
+            err = AES_CBCFrame_Crypt( inContext, iv, buf, i, dst );
+            require_noerr( err, exit );
         #elif( AES_UTILS_USE_USSL )
             if( inContext->encrypt )    aes_crypt_cbc( &inContext->ctx, AES_ENCRYPT, i, iv, buf, dst );
             else                        aes_crypt_cbc( &inContext->ctx, AES_DECRYPT, i, iv, buf, dst );
@@ -412,7 +543,10 @@ OSStatus
             if( inContext->encrypt )    aes_cbc_encrypt( src2, dst, (int) len, iv, &inContext->ctx.encrypt );
             else                        aes_cbc_decrypt( src2, dst, (int) len, iv, &inContext->ctx.decrypt );
         #elif( AES_UTILS_USE_MICO_AES )
-            AesCbcEncrypt(&inContext->ctx, dst, src2, len);
+            AES_CBCFrame_Crypt( inContext, src2, len, dst );
+        #elif( AES_UTILS_USE_STM32_CRYP )
+            err = AES_CBCFrame_Crypt( inContext, iv, src2, len, dst );
+            require_noerr( err, exit );
         #elif( AES_UTILS_USE_USSL )
             if( inContext->encrypt )    aes_crypt_cbc( &inContext->ctx, AES_ENCRYPT, len, iv, (unsigned char *) src2, dst );
             else                        aes_crypt_cbc( &inContext->ctx, AES_DECRYPT, len, iv, (unsigned char *) src2, dst );
@@ -429,7 +563,7 @@ OSStatus
     while( src2 != end2 ) *dst++ = *src2++;
     err = kNoErr;
     
-#if( AES_UTILS_USE_COMMON_CRYPTO )
+#if( AES_UTILS_USE_COMMON_CRYPTO || AES_UTILS_USE_STM32_CRYP )
 exit:
 #endif
     return( err );
@@ -451,7 +585,7 @@ void    AES_CBCFrame_Final( AES_CBCFrame_Context *inContext )
 //  AES_cbc_encrypt
 //===========================================================================================================================
 
-#if( !AES_UTILS_USE_COMMON_CRYPTO && !AES_UTILS_USE_GLADMAN_AES && !AES_UTILS_USE_MICO_AES && TARGET_NO_OPENSSL )
+#if( AES_UTILS_HAS_AES_KEY_API && ( TARGET_NO_OPENSSL || AES_UTILS_USE_CT_AES ) )
 // From OpenSSL
 static
 void AES_cbc_encrypt(const unsigned char *in, unsigned char *out,
@@ -548,6 +682,11 @@ OSStatus    AES_ECB_Init( AES_ECB_Context *inContext, uint32_t inMode, const uin
 #elif( AES_UTILS_USE_MICO_AES )
     if( inMode == kAES_ECB_Mode_Encrypt )   AesSetKey( &inContext->ctx, inKey, kAES_ECB_Size, NULL, AES_ENCRYPTION );
     else                                    AesSetKey( &inContext->ctx, inKey, kAES_ECB_Size, NULL, AES_DECRYPTION );
+    inContext->mode = inMode;
+#elif( AES_UTILS_USE_STM32_CRYP )
+    RCC_AHB2PeriphClockCmd( RCC_AHB2Periph_CRYP, ENABLE );
+    memcpy( inContext->key, inKey, kAES_ECB_Size );
+    inContext->mode = inMode;
 #elif( AES_UTILS_USE_USSL )
     if( inMode == kAES_ECB_Mode_Encrypt )   aes_setkey_enc( &inContext->ctx, (unsigned char *) inKey, kAES_ECB_Size * 8 );
     else                                    aes_setkey_dec( &inContext->ctx, (unsigned char *) inKey, kAES_ECB_Size * 8 );
@@ -579,6 +718,16 @@ OSStatus    AES_ECB_Update( AES_ECB_Context *inContext, const void *inSrc, size_
     
     src = (const uint8_t *) inSrc;
     dst = (uint8_t *) inDst;
+#if( AES_UTILS_USE_STM32_CRYP )
+    // The peripheral takes the whole buffer in one go.
+    
+    n = inLen & ~( (size_t)( kAES_ECB_Size - 1 ) );
+    if( n > 0 )
+    {
+        require_action( CRYP_AES_ECB( (uint8_t) inContext->mode, inContext->key, kAES_ECB_Size * 8, (uint8_t *) src, 
+            (uint32_t) n, dst ) == SUCCESS, exit, err = kGeneralErr );
+    }
+#else
     for( n = inLen / kAES_ECB_Size; n > 0; --n )
     {
         #if( AES_UTILS_USE_COMMON_CRYPTO )
@@ -591,7 +740,8 @@ OSStatus    AES_ECB_Update( AES_ECB_Context *inContext, const void *inSrc, size_
             if( inContext->encrypt )    aes_ecb_encrypt( src, dst, kAES_ECB_Size, &inContext->ctx.encrypt );
             else                        aes_ecb_decrypt( src, dst, kAES_ECB_Size, &inContext->ctx.decrypt );
         #elif( AES_UTILS_USE_MICO_AES )
-            AesEncryptDirect( &inContext->ctx, dst, src );
+            if( inContext->mode == kAES_ECB_Mode_Encrypt )  AesEncryptDirect( &inContext->ctx, dst, src );
+            else                                            AesDecryptDirect( &inContext->ctx, dst, src );
         #elif( AES_UTILS_USE_USSL )
             aes_crypt_ecb( &inContext->ctx, inContext->mode, (unsigned char *) src, dst );
         #else
@@ -600,9 +750,10 @@ OSStatus    AES_ECB_Update( AES_ECB_Context *inContext, const void *inSrc, size_
         src += kAES_ECB_Size;
         dst += kAES_ECB_Size;
     }
+#endif
     err = kNoErr;
     
-#if( AES_UTILS_USE_COMMON_CRYPTO )
+#if( AES_UTILS_USE_COMMON_CRYPTO || AES_UTILS_USE_STM32_CRYP )
 exit:
 #endif
     return( err );
@@ -635,16 +786,66 @@ OSStatus
         AES_GCM_Context *   inContext, 
         const uint8_t       inKey[ kAES_CGM_Size ], 
         const uint8_t       inNonce[ kAES_CGM_Size ] )
+{
+    return( AES_GCM_InitEx( inContext, inKey, inNonce, AES_GCM_TABLES_DEFAULT ) );
+}
+
+//===========================================================================================================================
+//  AES_GCM_SelectTables
+//===========================================================================================================================
+
+#if( AES_UTILS_HAS_GLADMAN_GCM )
+static AES_GCM_Tables   AES_GCM_SelectTables( void )
+{
+    micoMemInfo_t *     info;
+    unsigned long       budget;
+    AES_GCM_Tables      tables;
+    
+    info = MicoGetMemoryInfo();
+    budget = ( info && ( info->free_memory > 0 ) ) ? ( ( (unsigned long) info->free_memory ) >> kAES_GCM_TablesHeapShift ) : 0;
+    for( tables = kAES_GCM_Tables_64K; tables > kAES_GCM_Tables_256; --tables )
+    {
+        if( gcm_table_size( (gcm_tables_t) tables ) <= budget ) break;
+    }
+    return( tables );
+}
+#endif
+
+//===========================================================================================================================
+//  AES_GCM_InitEx
+//===========================================================================================================================
+
+OSStatus
+    AES_GCM_InitEx( 
+        AES_GCM_Context *   inContext, 
+        const uint8_t       inKey[ kAES_CGM_Size ], 
+        const uint8_t       inNonce[ kAES_CGM_Size ], 
+        AES_GCM_Tables      inTables )
 {
     OSStatus        err;
     
 #if( AES_UTILS_HAS_COMMON_CRYPTO_GCM )
+    (void) inTables;
+    
     err = CCCryptorCreateWithMode( kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, ccNoPadding, NULL, 
         inKey, kAES_CGM_Size, NULL, 0, 0, 0, &inContext->cryptor );
     require_noerr( err, exit );
 #elif( AES_UTILS_HAS_GLADMAN_GCM )
-    err = gcm_init_and_key( inKey, kAES_CGM_Size, &inContext->ctx );
-    require_noerr( err, exit );
+    unsigned long   size;
+    
+    inContext->tables = NULL; // Set before anything can fail, the exit path frees it.
+    if( inTables == kAES_GCM_Tables_Auto ) inTables = AES_GCM_SelectTables();
+    require_action( ( inTables >= kAES_GCM_Tables_None ) && ( inTables <= kAES_GCM_Tables_64K ), exit, err = kParamErr );
+    
+    size = gcm_table_size( (gcm_tables_t) inTables );
+    if( size > 0 )
+    {
+        inContext->tables = malloc( size );
+        require_action( inContext->tables, exit, err = kNoMemoryErr );
+    }
+    
+    err = gcm_init_and_key_tables( inKey, kAES_CGM_Size, (gcm_tables_t) inTables, inContext->tables, &inContext->ctx );
+    require_noerr_action( err, exit, err = kParamErr );
 #else
     #error "GCM enabled, but no implementation?"
 #endif
@@ -652,6 +853,13 @@ OSStatus
     if( inNonce ) memcpy( inContext->nonce, inNonce, kAES_CGM_Size );
     
 exit:
+#if( AES_UTILS_HAS_GLADMAN_GCM )
+    if( err && inContext->tables )
+    {
+        free( inContext->tables );
+        inContext->tables = NULL;
+    }
+#endif
     return( err );
 }
 
@@ -664,7 +872,9 @@ void    AES_GCM_Final( AES_GCM_Context *inContext )
 #if( AES_UTILS_HAS_COMMON_CRYPTO_GCM )
     if( inContext->cryptor ) CCCryptorRelease( inContext->cryptor );
 #elif( AES_UTILS_HAS_GLADMAN_GCM )
-    gcm_end( &inContext->ctx );
+    gcm_end( &inContext->ctx ); // Also clears the table.
+    if( inContext->tables ) free( inContext->tables );
+    inContext->tables = NULL;
 #else
     #error "GCM enabled, but no implementation?"
 #endif
@@ -675,8 +885,17 @@ void    AES_GCM_Final( AES_GCM_Context *inContext )
 //  AES_GCM_InitMessage
 //===========================================================================================================================
 
-#if( AES_UTILS_HAS_COMMON_CRYPTO_GCM )
 OSStatus    AES_GCM_InitMessage( AES_GCM_Context *inContext, const uint8_t inNonce[ kAES_CGM_Size ] )
+{
+    return( AES_GCM_InitMessageEx( inContext, inNonce, kAES_CGM_Size ) );
+}
+
+//===========================================================================================================================
+//  AES_GCM_InitMessageEx
+//===========================================================================================================================
+
+#if( AES_UTILS_HAS_COMMON_CRYPTO_GCM )
+OSStatus    AES_GCM_InitMessageEx( AES_GCM_Context *inContext, const uint8_t *inNonce, size_t inNonceLen )
 {
     CCCryptorRef const      cryptor = inContext->cryptor;
     OSStatus                err;
@@ -688,15 +907,17 @@ OSStatus    AES_GCM_InitMessage( AES_GCM_Context *inContext, const uint8_t inNon
     {
         AES_CTR_Increment( inContext->nonce );
         inNonce = inContext->nonce;
+        inNonceLen = kAES_CGM_Size;
     }
-    err = CCCryptorGCMAddIV( cryptor, inNonce, kAES_CGM_Size );
+    require_action( inNonceLen > 0, exit, err = kParamErr );
+    err = CCCryptorGCMAddIV( cryptor, inNonce, inNonceLen );
     require_noerr( err, exit );
     
 exit:
     return( err );
 }
 #elif( AES_UTILS_HAS_GLADMAN_GCM )
-OSStatus    AES_GCM_InitMessage( AES_GCM_Context *inContext, const uint8_t inNonce[ kAES_CGM_Size ] )
+OSStatus    AES_GCM_InitMessageEx( AES_GCM_Context *inContext, const uint8_t *inNonce, size_t inNonceLen )
 {
     OSStatus        err;
     
@@ -704,8 +925,10 @@ OSStatus    AES_GCM_InitMessage( AES_GCM_Context *inContext, const uint8_t inNon
     {
         AES_CTR_Increment( inContext->nonce );
         inNonce = inContext->nonce;
+        inNonceLen = kAES_CGM_Size;
     }
-    err = gcm_init_message( inNonce, kAES_CGM_Size, &inContext->ctx );
+    require_action( inNonceLen > 0, exit, err = kParamErr );
+    err = gcm_init_message( inNonce, inNonceLen, &inContext->ctx );
     require_noerr( err, exit );
     
 exit:
@@ -792,7 +1015,7 @@ OSStatus    AES_GCM_AddAAD( AES_GCM_Context *inContext, const void *inPtr, size_
     require_noerr( err, exit );
 #elif( AES_UTILS_HAS_GLADMAN_GCM )
     err = gcm_auth_header( inPtr, inLen, &inContext->ctx );
-    require_noerr( err, exit );
+    require_noerr_action( err, exit, err = kStateErr ); // AAD after data.
 #else
     #error "GCM enabled, but no implementation?"
 #endif
@@ -856,6 +1079,353 @@ exit:
     return( err );
 }
 #endif
+
+//===========================================================================================================================
+//  AES_GCM_Test
+//===========================================================================================================================
+
+#define kAES_GCM_TestBenchMs        500
+
+// GCM spec test case 4 inputs with a 16-byte nonce, since that is the nonce size AES_GCM_InitMessage uses.
+
+static const uint8_t        kAES_GCM_TestKey[ 16 ] = 
+{
+    0xFE, 0xFF, 0xE9, 0x92, 0x86, 0x65, 0x73, 0x1C, 0x6D, 0x6A, 0x8F, 0x94, 0x67, 0x30, 0x83, 0x08
+};
+static const uint8_t        kAES_GCM_TestNonce[ 16 ] = 
+{
+    0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD, 0xDE, 0xCA, 0xF8, 0x88, 0xB5, 0xA3, 0xC1, 0xE9
+};
+static const uint8_t        kAES_GCM_TestAAD[ 20 ] = 
+{
+    0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF, 
+    0xAB, 0xAD, 0xDA, 0xD2
+};
+static const uint8_t        kAES_GCM_TestPlain[ 60 ] = 
+{
+    0xD9, 0x31, 0x32, 0x25, 0xF8, 0x84, 0x06, 0xE5, 0xA5, 0x59, 0x09, 0xC5, 0xAF, 0xF5, 0x26, 0x9A, 
+    0x86, 0xA7, 0xA9, 0x53, 0x15, 0x34, 0xF7, 0xDA, 0x2E, 0x4C, 0x30, 0x3D, 0x8A, 0x31, 0x8A, 0x72, 
+    0x1C, 0x3C, 0x0C, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2F, 0xCF, 0x0E, 0x24, 0x49, 0xA6, 0xB5, 0x25, 
+    0xB1, 0x6A, 0xED, 0xF5, 0xAA, 0x0D, 0xE6, 0x57, 0xBA, 0x63, 0x7B, 0x39
+};
+static const uint8_t        kAES_GCM_TestCipher[ 60 ] = 
+{
+    0x54, 0x4D, 0x60, 0x9D, 0x8E, 0xB2, 0x92, 0x58, 0x50, 0xD4, 0xE5, 0x4B, 0x20, 0xD6, 0xBF, 0xD3, 
+    0x97, 0x42, 0x67, 0xED, 0xED, 0x96, 0xC6, 0x3F, 0xE8, 0xD5, 0x1E, 0x88, 0x35, 0x61, 0xE8, 0xA7, 
+    0x9E, 0x31, 0xFB, 0xD9, 0x74, 0x18, 0xE6, 0x1D, 0xFA, 0xA2, 0xAC, 0x26, 0x6D, 0xB3, 0xC2, 0xB2, 
+    0x84, 0x1C, 0x86, 0x7C, 0x08, 0x20, 0xE2, 0x8C, 0xE6, 0xEF, 0x8B, 0x16
+};
+static const uint8_t        kAES_GCM_TestTag[ 16 ] = 
+{
+    0x5E, 0xFF, 0x0F, 0xC7, 0x3D, 0x1C, 0xE1, 0x6E, 0x3F, 0x79, 0xCD, 0x35, 0xB7, 0x36, 0x7A, 0x15
+};
+
+OSStatus    AES_GCM_Test( AES_GCM_Tables inTables, size_t inBenchLen, uint32_t *outBytesPerSec )
+{
+    OSStatus                err;
+    AES_GCM_Context *       context;
+    uint8_t                 buf[ sizeof( kAES_GCM_TestPlain ) ];
+    uint8_t                 tag[ kAES_CGM_Size ];
+    uint8_t *               bench = NULL;
+    size_t                  split;
+    uint32_t                total, start, elapsed;
+    
+    context = (AES_GCM_Context *) calloc( 1, sizeof( *context ) );
+    require_action( context, exit, err = kNoMemoryErr );
+    
+    err = AES_GCM_InitEx( context, kAES_GCM_TestKey, kAES_CGM_Nonce_None, inTables );
+    require_noerr( err, exit );
+    
+    // Process the message in two pieces at every split point to cover the partial block paths.
+    
+    for( split = 0; split <= sizeof( kAES_GCM_TestPlain ); ++split )
+    {
+        err = AES_GCM_InitMessage( context, kAES_GCM_TestNonce );
+        require_noerr( err, exit );
+        err = AES_GCM_AddAAD( context, kAES_GCM_TestAAD, sizeof( kAES_GCM_TestAAD ) );
+        require_noerr( err, exit );
+        err = AES_GCM_Encrypt( context, kAES_GCM_TestPlain, split, buf );
+        require_noerr( err, exit );
+        err = AES_GCM_Encrypt( context, &kAES_GCM_TestPlain[ split ], sizeof( kAES_GCM_TestPlain ) - split, &buf[ split ] );
+        require_noerr( err, exit );
+        err = AES_GCM_FinalizeMessage( context, tag );
+        require_noerr( err, exit );
+        require_action( memcmp( buf, kAES_GCM_TestCipher, sizeof( buf ) ) == 0, exit, err = kMismatchErr );
+        require_action( memcmp( tag, kAES_GCM_TestTag, sizeof( tag ) ) == 0, exit, err = kMismatchErr );
+        
+        err = AES_GCM_InitMessage( context, kAES_GCM_TestNonce );
+        require_noerr( err, exit );
+        err = AES_GCM_AddAAD( context, kAES_GCM_TestAAD, sizeof( kAES_GCM_TestAAD ) );
+        require_noerr( err, exit );
+        err = AES_GCM_Decrypt( context, kAES_GCM_TestCipher, split, buf );
+        require_noerr( err, exit );
+        err = AES_GCM_Decrypt( context, &kAES_GCM_TestCipher[ split ], sizeof( kAES_GCM_TestCipher ) - split, &buf[ split ] );
+        require_noerr( err, exit );
+        err = AES_GCM_VerifyMessage( context, kAES_GCM_TestTag );
+        require_noerr( err, exit );
+        require_action( memcmp( buf, kAES_GCM_TestPlain, sizeof( buf ) ) == 0, exit, err = kMismatchErr );
+    }
+    
+    // Time whole messages of inBenchLen bytes, each with the test AAD, as a session would send them.
+    
+    if( outBytesPerSec )
+    {
+        require_action( inBenchLen > 0, exit, err = kParamErr );
+        bench = (uint8_t *) calloc( 1, inBenchLen );
+        require_action( bench, exit, err = kNoMemoryErr );
+        
+        total = 0;
+        start = mico_get_time();
+        do
+        {
+            err = AES_GCM_InitMessage( context, kAES_CGM_Nonce_Auto );
+            require_noerr( err, exit );
+            err = AES_GCM_AddAAD( context, kAES_GCM_TestAAD, sizeof( kAES_GCM_TestAAD ) );
+            require_noerr( err, exit );
+            err = AES_GCM_Encrypt( context, bench, inBenchLen, bench );
+            require_noerr( err, exit );
+            err = AES_GCM_FinalizeMessage( context, tag );
+            require_noerr( err, exit );
+            total += inBenchLen;
+            elapsed = mico_get_time() - start;
+            
+        }   while( elapsed < kAES_GCM_TestBenchMs );
+        
+        *outBytesPerSec = (uint32_t)( ( ( (uint64_t) total ) * 1000 ) / elapsed );
+    }
+    
+exit:
+    if( bench ) free( bench );
+    if( context )
+    {
+        AES_GCM_Final( context );
+        free( context );
+    }
+    return( err );
+}
+
+#endif // AES_UTILS_HAS_GCM
+
+
+
+#if 0
+#pragma mark -
+#pragma mark == Constant-time AES ==
 #endif
 
+#if( AES_UTILS_USE_CT_AES )
+
+//===========================================================================================================================
+//  Constant-time AES-128
+//
+//  The state is kept as 4 little endian column words. SubBytes is computed instead of looked up: the GF(2^8) inverse
+//  (x^254) followed by the affine transform, evaluated on the 4 bytes of a word in parallel with shifts and masks only.
+//  No memory access or branch depends on key or data, so there is nothing for cache or flash wait-state timing to leak.
+//===========================================================================================================================
+
+#define AES_CT_Lanes( X )       ( (uint32_t)( X ) * 0x01010101U )
+#define AES_CT_XTime( X )       ( ( ( (X) & 0x7F7F7F7FU ) << 1 ) ^ ( ( ( (X) >> 7 ) & 0x01010101U ) * 0x1BU ) )
+#define AES_CT_RotL8( X, N )    ( ( ( (X) << (N) ) & AES_CT_Lanes( ( 0xFFU << (N) ) & 0xFFU ) ) | \
+                                  ( ( (X) >> ( 8 - (N) ) ) & AES_CT_Lanes( 0xFFU >> ( 8 - (N) ) ) ) )
+#define AES_CT_RotW( X, N )     ( ( (X) >> (N) ) | ( (X) << ( 32 - (N) ) ) )
+
+static uint32_t AES_CT_Mul( uint32_t a, uint32_t b )
+{
+    uint32_t    r = 0;
+    int         i;
+    
+    for( i = 0; i < 8; ++i )
+    {
+        r ^= a & ( ( ( b >> i ) & 0x01010101U ) * 0xFFU );
+        a  = AES_CT_XTime( a );
+    }
+    return( r );
+}
+
+static uint32_t AES_CT_Square( uint32_t a )
+{
+    // Squaring is linear: bit i moves to bit 2i, and x^8, x^10, x^12, x^14 reduce to 0x1B, 0x6C, 0xAB, 0x9A.
+    
+    return( ( a & 0x01010101U ) ^ ( ( a & 0x02020202U ) << 1 ) ^ ( ( a & 0x04040404U ) << 2 ) ^ 
+        ( ( a & 0x08080808U ) << 3 ) ^ 
+        ( ( ( a >> 4 ) & 0x01010101U ) * 0x1BU ) ^ ( ( ( a >> 5 ) & 0x01010101U ) * 0x6CU ) ^ 
+        ( ( ( a >> 6 ) & 0x01010101U ) * 0xABU ) ^ ( ( ( a >> 7 ) & 0x01010101U ) * 0x9AU ) );
+}
+
+static uint32_t AES_CT_Inv( uint32_t x )
+{
+    uint32_t    x2, x3, x12, x14, y;
+    
+    // x^254 == x^-1, and maps 0 to 0 as the S-box requires.
+    
+    x2  = AES_CT_Square( x );
+    x3  = AES_CT_Mul( x2, x );
+    x12 = AES_CT_Square( AES_CT_Square( x3 ) );
+    x14 = AES_CT_Mul( x12, x2 );
+    y   = AES_CT_Mul( x12, x3 );    // x^15
+    y   = AES_CT_Square( y );
+    y   = AES_CT_Square( y );
+    y   = AES_CT_Square( y );
+    y   = AES_CT_Square( y );       // x^240
+    return( AES_CT_Mul( y, x14 ) );
+}
+
+static uint32_t AES_CT_SubWord( uint32_t x )
+{
+    x = AES_CT_Inv( x );
+    return( x ^ AES_CT_RotL8( x, 1 ) ^ AES_CT_RotL8( x, 2 ) ^ AES_CT_RotL8( x, 3 ) ^ AES_CT_RotL8( x, 4 ) ^ 
+        AES_CT_Lanes( 0x63 ) );
+}
+
+static uint32_t AES_CT_InvSubWord( uint32_t x )
+{
+    x = AES_CT_RotL8( x, 1 ) ^ AES_CT_RotL8( x, 3 ) ^ AES_CT_RotL8( x, 6 ) ^ AES_CT_Lanes( 0x05 );
+    return( AES_CT_Inv( x ) );
+}
+
+static uint32_t AES_CT_MixColumn( uint32_t x )
+{
+    uint32_t    t = AES_CT_XTime( x );
+    
+    return( t ^ AES_CT_RotW( t, 8 ) ^ AES_CT_RotW( x, 8 ) ^ AES_CT_RotW( x, 16 ) ^ AES_CT_RotW( x, 24 ) );
+}
+
+static uint32_t AES_CT_InvMixColumn( uint32_t x )
+{
+    uint32_t    t;
+    
+    // InvMixColumns is MixColumns after adding 4 * ( a[i] ^ a[i+2] ) to every byte.
+    
+    t = x ^ AES_CT_RotW( x, 16 );
+    t = AES_CT_XTime( t );
+    t = AES_CT_XTime( t );
+    return( AES_CT_MixColumn( x ^ t ) );
+}
+
+static uint32_t AES_CT_Load( const uint8_t *inPtr )
+{
+    return( ( (uint32_t) inPtr[ 0 ] ) | ( ( (uint32_t) inPtr[ 1 ] ) << 8 ) | ( ( (uint32_t) inPtr[ 2 ] ) << 16 ) | 
+        ( ( (uint32_t) inPtr[ 3 ] ) << 24 ) );
+}
+
+static void AES_CT_Store( uint8_t *inPtr, uint32_t inValue )
+{
+    inPtr[ 0 ] = (uint8_t)( inValue );
+    inPtr[ 1 ] = (uint8_t)( inValue >> 8 );
+    inPtr[ 2 ] = (uint8_t)( inValue >> 16 );
+    inPtr[ 3 ] = (uint8_t)( inValue >> 24 );
+}
+
+//===========================================================================================================================
+//  AES_CT_KeySetup
+//===========================================================================================================================
+
+void AES_CT_KeySetup( uint32_t rk[ /*44*/ ], const uint8_t inKey[] )
+{
+    uint32_t    rcon = 0x01;
+    uint32_t    t;
+    int         i;
+    
+    for( i = 0; i < 4; ++i )
+    {
+        rk[ i ] = AES_CT_Load( &inKey[ i * 4 ] );
+    }
+    for( i = 4; i < 44; ++i )
+    {
+        t = rk[ i - 1 ];
+        if( ( i % 4 ) == 0 )
+        {
+            t = AES_CT_SubWord( AES_CT_RotW( t, 8 ) ) ^ rcon;
+            rcon = AES_CT_XTime( rcon );
+        }
+        rk[ i ] = rk[ i - 4 ] ^ t;
+    }
+}
+
+//===========================================================================================================================
+//  AES_CT_Encrypt
+//===========================================================================================================================
+
+void AES_CT_Encrypt( const uint32_t rk[ /*44*/ ], const uint8_t inPlain[ 16 ], uint8_t outCipher[ 16 ] )
+{
+    uint32_t    s0, s1, s2, s3, t0, t1, t2, t3;
+    int         round;
+    
+    s0 = AES_CT_Load( &inPlain[  0 ] ) ^ rk[ 0 ];
+    s1 = AES_CT_Load( &inPlain[  4 ] ) ^ rk[ 1 ];
+    s2 = AES_CT_Load( &inPlain[  8 ] ) ^ rk[ 2 ];
+    s3 = AES_CT_Load( &inPlain[ 12 ] ) ^ rk[ 3 ];
+    for( round = 1; round <= 10; ++round )
+    {
+        s0 = AES_CT_SubWord( s0 );
+        s1 = AES_CT_SubWord( s1 );
+        s2 = AES_CT_SubWord( s2 );
+        s3 = AES_CT_SubWord( s3 );
+        
+        // ShiftRows: row r of column c comes from column c + r.
+        
+        t0 = ( s0 & 0x000000FFU ) | ( s1 & 0x0000FF00U ) | ( s2 & 0x00FF0000U ) | ( s3 & 0xFF000000U );
+        t1 = ( s1 & 0x000000FFU ) | ( s2 & 0x0000FF00U ) | ( s3 & 0x00FF0000U ) | ( s0 & 0xFF000000U );
+        t2 = ( s2 & 0x000000FFU ) | ( s3 & 0x0000FF00U ) | ( s0 & 0x00FF0000U ) | ( s1 & 0xFF000000U );
+        t3 = ( s3 & 0x000000FFU ) | ( s0 & 0x0000FF00U ) | ( s1 & 0x00FF0000U ) | ( s2 & 0xFF000000U );
+        
+        if( round < 10 )
+        {
+            t0 = AES_CT_MixColumn( t0 );
+            t1 = AES_CT_MixColumn( t1 );
+            t2 = AES_CT_MixColumn( t2 );
+            t3 = AES_CT_MixColumn( t3 );
+        }
+        s0 = t0 ^ rk[ round * 4 + 0 ];
+        s1 = t1 ^ rk[ round * 4 + 1 ];
+        s2 = t2 ^ rk[ round * 4 + 2 ];
+        s3 = t3 ^ rk[ round * 4 + 3 ];
+    }
+    AES_CT_Store( &outCipher[  0 ], s0 );
+    AES_CT_Store( &outCipher[  4 ], s1 );
+    AES_CT_Store( &outCipher[  8 ], s2 );
+    AES_CT_Store( &outCipher[ 12 ], s3 );
+}
+
+//===========================================================================================================================
+//  AES_CT_Decrypt
+//===========================================================================================================================
+
+void AES_CT_Decrypt( const uint32_t rk[ /*44*/ ], const uint8_t inCipher[ 16 ], uint8_t outPlain[ 16 ] )
+{
+    uint32_t    s0, s1, s2, s3, t0, t1, t2, t3;
+    int         round;
+    
+    s0 = AES_CT_Load( &inCipher[  0 ] ) ^ rk[ 40 ];
+    s1 = AES_CT_Load( &inCipher[  4 ] ) ^ rk[ 41 ];
+    s2 = AES_CT_Load( &inCipher[  8 ] ) ^ rk[ 42 ];
+    s3 = AES_CT_Load( &inCipher[ 12 ] ) ^ rk[ 43 ];
+    for( round = 9; round >= 0; --round )
+    {
+        // InvShiftRows: row r of column c comes from column c - r.
+        
+        t0 = ( s0 & 0x000000FFU ) | ( s3 & 0x0000FF00U ) | ( s2 & 0x00FF0000U ) | ( s1 & 0xFF000000U );
+        t1 = ( s1 & 0x000000FFU ) | ( s0 & 0x0000FF00U ) | ( s3 & 0x00FF0000U ) | ( s2 & 0xFF000000U );
+        t2 = ( s2 & 0x000000FFU ) | ( s1 & 0x0000FF00U ) | ( s0 & 0x00FF0000U ) | ( s3 & 0xFF000000U );
+        t3 = ( s3 & 0x000000FFU ) | ( s2 & 0x0000FF00U ) | ( s1 & 0x00FF0000U ) | ( s0 & 0xFF000000U );
+        
+        s0 = AES_CT_InvSubWord( t0 ) ^ rk[ round * 4 + 0 ];
+        s1 = AES_CT_InvSubWord( t1 ) ^ rk[ round * 4 + 1 ];
+        s2 = AES_CT_InvSubWord( t2 ) ^ rk[ round * 4 + 2 ];
+        s3 = AES_CT_InvSubWord( t3 ) ^ rk[ round * 4 + 3 ];
+        
+        if( round > 0 )
+        {
+            s0 = AES_CT_InvMixColumn( s0 );
+            s1 = AES_CT_InvMixColumn( s1 );
+            s2 = AES_CT_InvMixColumn( s2 );
+            s3 = AES_CT_InvMixColumn( s3 );
+        }
+    }
+    AES_CT_Store( &outPlain[  0 ], s0 );
+    AES_CT_Store( &outPlain[  4 ], s1 );
+    AES_CT_Store( &outPlain[  8 ], s2 );
+    AES_CT_Store( &outPlain[ 12 ], s3 );
+}
 
+#endif // AES_UTILS_USE_CT_AES
@@ -27,7 +27,19 @@
 #include "Debug.h"
 
 #include "SecurityUtils.h"
-#define AES_UTILS_USE_MICO_AES 1
+
+// AES backend, selected at build time by defining one of these to 1 in the project:
+//
+//      AES_UTILS_USE_MICO_AES      MiCO AES library (default).
+//      AES_UTILS_USE_GLADMAN_AES   Gladman AES, T-table based with native multi-block ECB/CBC calls.
+//      AES_UTILS_USE_STM32_CRYP    STM32F4 CRYP peripheral, only on parts that have one (STM32F415/417/437/439).
+//      AES_UTILS_USE_CT_AES        Constant-time software AES without any table lookups. Slower, but safe where
+//                                  cache or flash wait-state timing could leak key material.
+
+#if( !AES_UTILS_USE_COMMON_CRYPTO && !AES_UTILS_USE_GLADMAN_AES && !AES_UTILS_USE_USSL && \
+     !AES_UTILS_USE_STM32_CRYP && !AES_UTILS_USE_CT_AES && !defined( AES_UTILS_USE_MICO_AES ) )
+    #define AES_UTILS_USE_MICO_AES      1
+#endif
 
 #if( !defined( AES_UTILS_HAS_GLADMAN_GCM ) )
 //    #if( __has_include( "gcm.h" ) )
@@ -53,12 +65,27 @@
     #include "External/GladmanAES/aes.h"
 #elif( AES_UTILS_USE_MICO_AES )
     #include "MICOAES.h"
-#elif( !TARGET_NO_OPENSSL )
+#elif( AES_UTILS_USE_STM32_CRYP )
+    #include "stm32f4xx.h"
+    #include "stm32f4xx_cryp.h"
+    #if( !defined( CRYP ) )
+        #error "AES_UTILS_USE_STM32_CRYP selected, but this part has no CRYP peripheral"
+    #endif
+#elif( !TARGET_NO_OPENSSL && !AES_UTILS_USE_CT_AES )
     #include <openssl/aes.h>
 #else
     
-    // Emulate the OpenSSL API with the rijndael-alg-fst.c API.
+    // Emulate the OpenSSL API with the rijndael-alg-fst.c API, or the constant-time implementation in AESUtils.c.
     
+    #if( AES_UTILS_USE_CT_AES )
+        #define rijndaelKeySetupEnc     AES_CT_KeySetup
+        #define rijndaelKeySetupDec     AES_CT_KeySetup // Decryption runs the inverse rounds on the encryption schedule.
+        #define rijndaelEncrypt         AES_CT_Encrypt
+        #define rijndaelDecrypt         AES_CT_Decrypt
+    #endif
+    
+    #undef  AES_ENCRYPT         // Gladman's aes.h, pulled in by gcm.h, defines both as feature flags.
+    #undef  AES_DECRYPT
     #define AES_ENCRYPT         1
     #define AES_DECRYPT         0
     
@@ -134,6 +161,8 @@ typedef struct
     Aes                 ctx;
 #elif( AES_UTILS_USE_USSL )
     aes_context         ctx;                    //! PRIVATE: uSSL AES context.
+#elif( AES_UTILS_USE_STM32_CRYP )
+    uint8_t             key[ kAES_CTR_Size ];   //! PRIVATE: Key, loaded into the CRYP peripheral for every batch.
 #else
     AES_KEY             key;                    //! PRIVATE: Internal AES key.
 #endif
@@ -191,6 +220,9 @@ typedef struct
 #elif( AES_UTILS_USE_USSL )
     aes_context             ctx;                        //! PRIVATE: uSSL AES context.
     int                     encrypt;
+#elif( AES_UTILS_USE_STM32_CRYP )
+    uint8_t                 key[ kAES_CBCFrame_Size ];  //! PRIVATE: Key, loaded into the CRYP peripheral for every frame.
+    int                     encrypt;
 #else
     int                     mode;                       //! PRIVATE: AES_ENCRYPT or AES_DECRYPT.
     AES_KEY                 key;                        //! PRIVATE: Internal AES key.
@@ -246,6 +278,9 @@ void    AES_CBCFrame_Final( AES_CBCFrame_Context *inContext );
 #elif( AES_UTILS_USE_USSL )
     #define kAES_ECB_Mode_Encrypt       AES_ENCRYPT
     #define kAES_ECB_Mode_Decrypt       AES_DECRYPT
+#elif( AES_UTILS_USE_STM32_CRYP )
+    #define kAES_ECB_Mode_Encrypt       MODE_ENCRYPT
+    #define kAES_ECB_Mode_Decrypt       MODE_DECRYPT
 #else
     #define kAES_ECB_Mode_Encrypt       1
     #define kAES_ECB_Mode_Decrypt       0
@@ -271,6 +306,9 @@ typedef struct
 #elif( AES_UTILS_USE_USSL )
     aes_context             ctx;        //! PRIVATE: uSSL AES context.
     uint32_t                mode;
+#elif( AES_UTILS_USE_STM32_CRYP )
+    uint8_t                 key[ kAES_ECB_Size ];   //! PRIVATE: Key, loaded into the CRYP peripheral for every update.
+    uint32_t                mode;
 #else
     AES_KEY             key;            //! PRIVATE: Internal AES key.
     AESCryptFunc        cryptFunc;      //! PRIVATE: Ptr AES_encrypt to AES_decrypt.
@@ -309,6 +347,16 @@ void        AES_ECB_Final( AES_ECB_Context *inContext );
         AES_GCM_Decrypt (may repeat as many times as necessary to add each chunk of data to encrypt).
         AES_GCM_VerifyMessage (if this fails, reject the message).
     
+    All AAD for a message must be added before any data is encrypted or decrypted.
+    
+    AES_GCM_InitMessage always uses a 16-byte nonce. Use AES_GCM_InitMessageEx for other sizes, such as the 12-byte 
+    nonce most protocols and the published test vectors use.
+    
+    With the Gladman backend, GHASH uses a table built once per key in AES_GCM_Init. Larger tables are faster but need 
+    more RAM for each context. AES_GCM_Init uses AES_GCM_TABLES_DEFAULT. By default that is kAES_GCM_Tables_Auto, which 
+    picks the largest table that fits in 1/(2^kAES_GCM_TablesHeapShift) of the free heap. Use AES_GCM_InitEx to choose 
+    a size per context, and AES_GCM_Test to check and time each size on a board.
+    
     See <http://en.wikipedia.org/wiki/Galois/Counter_Mode> for more information.
 */
 
@@ -318,12 +366,30 @@ void        AES_ECB_Final( AES_ECB_Context *inContext );
 #define kAES_CGM_Nonce_None     NULL // When passed to AES_GCM_Init it means the caller is using a per-message nonce.
 #define kAES_CGM_Nonce_Auto     NULL // When passed to AES_GCM_Encrypt, it means use the internal, auto-incremented nonce.
 
+typedef enum
+{
+    kAES_GCM_Tables_Auto    = -1,   // Largest table that fits the free heap budget.
+    kAES_GCM_Tables_None    = 0,    // Bitwise multiply, no table.
+    kAES_GCM_Tables_256     = 1,    // 256 bytes, held in the context.
+    kAES_GCM_Tables_4K      = 2,    // 4 KB allocated per context.
+    kAES_GCM_Tables_8K      = 3,    // 8 KB allocated per context.
+    kAES_GCM_Tables_64K     = 4     // 64 KB allocated per context.
+    
+}   AES_GCM_Tables;
+
+#if( !defined( AES_GCM_TABLES_DEFAULT ) )
+    #define AES_GCM_TABLES_DEFAULT      kAES_GCM_Tables_Auto
+#endif
+
+#define kAES_GCM_TablesHeapShift        3   // Auto uses at most 1/8 of the free heap.
+
 typedef struct
 {
 #if( AES_UTILS_HAS_COMMON_CRYPTO_GCM )
     CCCryptorRef        cryptor;
 #elif( AES_UTILS_HAS_GLADMAN_GCM )
     gcm_ctx             ctx;
+    void *              tables;     // malloc'd GHASH table for the 4K/8K/64K sizes.
 #else
     #error "GCM enabled, but no implementation?"
 #endif
@@ -337,9 +403,17 @@ OSStatus
         const uint8_t       inKey[ kAES_CGM_Size ], 
         const uint8_t       inNonce[ kAES_CGM_Size ] ); // May be kAES_CGM_Nonce_None for per-message nonces.
 
+OSStatus
+    AES_GCM_InitEx( 
+        AES_GCM_Context *   inContext, 
+        const uint8_t       inKey[ kAES_CGM_Size ], 
+        const uint8_t       inNonce[ kAES_CGM_Size ], 
+        AES_GCM_Tables      inTables );
+
 void    AES_GCM_Final( AES_GCM_Context *inContext );
 
 OSStatus    AES_GCM_InitMessage( AES_GCM_Context *inContext, const uint8_t *inNonce );
+OSStatus    AES_GCM_InitMessageEx( AES_GCM_Context *inContext, const uint8_t *inNonce, size_t inNonceLen ); // 12 is the common size.
 OSStatus    AES_GCM_FinalizeMessage( AES_GCM_Context *inContext, uint8_t outAuthTag[ kAES_CGM_Size ] );
 OSStatus    AES_GCM_VerifyMessage( AES_GCM_Context *inContext, const uint8_t inAuthTag[ kAES_CGM_Size ] );
 
@@ -347,6 +421,10 @@ OSStatus    AES_GCM_AddAAD( AES_GCM_Context *inContext, const void *inPtr, size_
 OSStatus    AES_GCM_Encrypt( AES_GCM_Context *inContext, const void *inSrc, size_t inLen, void *inDst );
 OSStatus    AES_GCM_Decrypt( AES_GCM_Context *inContext, const void *inSrc, size_t inLen, void *inDst );
 
+// Runs the known-answer tests with the given table size. If outBytesPerSec is not NULL, it also measures 
+// encrypt throughput for messages of inBenchLen bytes.
+OSStatus    AES_GCM_Test( AES_GCM_Tables inTables, size_t inBenchLen, uint32_t *outBytesPerSec );
+
 #endif // AES_UTILS_HAS_GCM
 
 #ifdef  __cplusplus
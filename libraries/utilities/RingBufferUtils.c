@@ -26,12 +26,26 @@
 #define ring_buffer_utils_log(M, ...) custom_log("RingBufferUtils", M, ##__VA_ARGS__)
 #define ring_buffer_utils_log_trace() custom_log_trace("RingBufferUtils")
 
+/* Indices passed in are below 2 * size, so wrapping never needs a division */
+#define RING_WRAP( ring_buffer, index ) \
+  ( (ring_buffer)->mask ? ( (index) & (ring_buffer)->mask ) : ( (index) >= (ring_buffer)->size ? (index) - (ring_buffer)->size : (index) ) )
+
+/* The other side may move its index at any time, read it exactly once */
+#define RING_LOAD( index )  ( *(volatile uint32_t*)&(index) )
+
+static uint32_t ring_buffer_used( ring_buffer_t* ring_buffer, uint32_t head, uint32_t tail )
+{
+  return ( tail >= head ) ? tail - head : tail + ring_buffer->size - head;
+}
+
 OSStatus ring_buffer_init( ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size )
 {
     ring_buffer->buffer     = (uint8_t*)buffer;
     ring_buffer->size       = size;
     ring_buffer->head       = 0;
     ring_buffer->tail       = 0;
+    ring_buffer->mask       = ( ( size & ( size - 1 ) ) == 0 ) ? size - 1 : 0;
+    ring_buffer->high_water = 0;
     return kNoErr;
 }
 
@@ -43,50 +57,149 @@ OSStatus ring_buffer_deinit( ring_buffer_t* ring_buffer )
 
 uint32_t ring_buffer_free_space( ring_buffer_t* ring_buffer )
 {
-  uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
-  return ((tail_to_end + ring_buffer->head) % ring_buffer->size);
+  return ring_buffer->size - 1 - ring_buffer_used( ring_buffer, RING_LOAD( ring_buffer->head ), RING_LOAD( ring_buffer->tail ) );
 }
 
 uint32_t ring_buffer_used_space( ring_buffer_t* ring_buffer )
 {
-  uint32_t head_to_end = ring_buffer->size - ring_buffer->head;
-  return ((head_to_end + ring_buffer->tail) % ring_buffer->size);
+  return ring_buffer_used( ring_buffer, RING_LOAD( ring_buffer->head ), RING_LOAD( ring_buffer->tail ) );
 }
 
 uint8_t ring_buffer_get_data( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes )
 {
-  uint32_t head_to_end = ring_buffer->size - ring_buffer->head;
-  
-  *data = &(ring_buffer->buffer[ring_buffer->head]);
-  
-  *contiguous_bytes = MIN(head_to_end, (head_to_end + ring_buffer->tail) % ring_buffer->size);
+  uint8_t* unused_data;
+  uint32_t unused_length;
+
+  ring_buffer_peek( ring_buffer, data, contiguous_bytes, &unused_data, &unused_length );
   return 0;
 }
 
 uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed )
 {
-  ring_buffer->head = (ring_buffer->head + bytes_consumed) % ring_buffer->size;
+  /* Finish reading the data before the producer may overwrite it */
+  RING_BUFFER_BARRIER();
+  RING_LOAD( ring_buffer->head ) = RING_WRAP( ring_buffer, ring_buffer->head + bytes_consumed );
+  return 0;
+}
+
+uint32_t ring_buffer_peek( ring_buffer_t* ring_buffer, uint8_t** data1, uint32_t* length1, uint8_t** data2, uint32_t* length2 )
+{
+  uint32_t head = ring_buffer->head;
+  uint32_t tail = RING_LOAD( ring_buffer->tail );
+
+  /* Data up to tail was written before tail was published */
+  RING_BUFFER_BARRIER();
+
+  *data1 = &ring_buffer->buffer[head];
+  *data2 = ring_buffer->buffer;
+  if ( tail >= head )
+  {
+    *length1 = tail - head;
+    *length2 = 0;
+  }
+  else
+  {
+    *length1 = ring_buffer->size - head;
+    *length2 = tail;
+  }
+  return *length1 + *length2;
+}
+
+uint32_t ring_buffer_read( ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length )
+{
+  uint8_t* data1;
+  uint8_t* data2;
+  uint32_t length1;
+  uint32_t length2;
+  uint32_t amount_to_copy = MIN( data_length, ring_buffer_peek( ring_buffer, &data1, &length1, &data2, &length2 ) );
+
+  memcpy( data, data1, MIN( amount_to_copy, length1 ) );
+  if ( amount_to_copy > length1 )
+  {
+    memcpy( data + length1, data2, amount_to_copy - length1 );
+  }
+
+  ring_buffer_consume( ring_buffer, amount_to_copy );
+  return amount_to_copy;
+}
+
+uint32_t ring_buffer_write_reserve( ring_buffer_t* ring_buffer, uint8_t** data1, uint32_t* length1, uint8_t** data2, uint32_t* length2 )
+{
+  uint32_t head = RING_LOAD( ring_buffer->head );
+  uint32_t tail = ring_buffer->tail;
+
+  /* The consumer has finished with everything before head */
+  RING_BUFFER_BARRIER();
+
+  *data1 = &ring_buffer->buffer[tail];
+  *data2 = ring_buffer->buffer;
+  if ( head > tail )
+  {
+    *length1 = head - tail - 1;
+    *length2 = 0;
+  }
+  else if ( head == 0 )
+  {
+    *length1 = ring_buffer->size - tail - 1;
+    *length2 = 0;
+  }
+  else
+  {
+    *length1 = ring_buffer->size - tail;
+    *length2 = head - 1;
+  }
+  return *length1 + *length2;
+}
+
+uint8_t ring_buffer_write_commit( ring_buffer_t* ring_buffer, uint32_t bytes_written )
+{
+  uint32_t tail = RING_WRAP( ring_buffer, ring_buffer->tail + bytes_written );
+  uint32_t used;
+
+  /* Publish the data before the index that makes it visible */
+  RING_BUFFER_BARRIER();
+  RING_LOAD( ring_buffer->tail ) = tail;
+
+  used = ring_buffer_used( ring_buffer, RING_LOAD( ring_buffer->head ), tail );
+  if ( used > ring_buffer->high_water )
+  {
+    ring_buffer->high_water = used;
+  }
   return 0;
 }
 
 uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length )
 {
-  uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
-  
+  uint8_t* data1;
+  uint8_t* data2;
+  uint32_t length1;
+  uint32_t length2;
+
   /* Calculate the maximum amount we can copy */
-  uint32_t amount_to_copy = MIN(data_length, (ring_buffer->tail == ring_buffer->head) ? ring_buffer->size : (tail_to_end + ring_buffer->head) % ring_buffer->size);
-  
+  uint32_t amount_to_copy = MIN( data_length, ring_buffer_write_reserve( ring_buffer, &data1, &length1, &data2, &length2 ) );
+
   /* Copy as much as we can until we fall off the end of the buffer */
-  memcpy(&ring_buffer->buffer[ring_buffer->tail], data, MIN(amount_to_copy, tail_to_end));
-  
+  memcpy( data1, data, MIN( amount_to_copy, length1 ) );
+
   /* Check if we have more to copy to the front of the buffer */
-  if (tail_to_end < amount_to_copy)
+  if ( amount_to_copy > length1 )
   {
-    memcpy(ring_buffer->buffer, data + tail_to_end, amount_to_copy - tail_to_end);
+    memcpy( data2, data + length1, amount_to_copy - length1 );
   }
-  
+
   /* Update the tail */
-  ring_buffer->tail = (ring_buffer->tail + amount_to_copy) % ring_buffer->size;
-  
+  ring_buffer_write_commit( ring_buffer, amount_to_copy );
+
   return amount_to_copy;
 }
+
+uint32_t ring_buffer_high_water( ring_buffer_t* ring_buffer, bool reset )
+{
+  uint32_t high_water = ring_buffer->high_water;
+
+  if ( reset )
+  {
+    ring_buffer->high_water = 0;
+  }
+  return high_water;
+}
@@ -25,18 +25,37 @@
 
 #include "Common.h"
 
+/* Single producer, single consumer byte ring. The producer (an ISR, a DMA
+ * stream or a thread) only moves tail, the consumer only moves head, so the
+ * two sides need no lock. One byte is always left free to tell full from
+ * empty. Sizes that are a power of 2 wrap with a mask. */
 typedef struct
 {
   uint32_t  size;
   uint32_t  head;
   uint32_t  tail;
   uint8_t*  buffer;
+  uint32_t  mask;        /* size - 1 when size is a power of 2, otherwise 0 */
+  uint32_t  high_water;  /* most bytes ever held, see ring_buffer_high_water() */
 } ring_buffer_t;
 
 #ifndef MIN
 #define MIN(x,y)  ((x) < (y) ? (x) : (y))
 #endif /* ifndef MIN */
 
+/* Orders buffer accesses against the index that publishes them, for both
+ * the compiler and the CPU, so the ring is safe between an ISR and a thread */
+#if defined ( __ICCARM__ )
+#include <intrinsics.h>
+#define RING_BUFFER_BARRIER()  __DMB()
+#elif defined ( __CC_ARM )
+#define RING_BUFFER_BARRIER()  __dmb( 0xF )
+#elif defined ( __GNUC__ )
+#define RING_BUFFER_BARRIER()  __sync_synchronize()
+#else
+#define RING_BUFFER_BARRIER()
+#endif
+
 OSStatus ring_buffer_init( ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size );
 
 OSStatus ring_buffer_deinit( ring_buffer_t* ring_buffer );
@@ -51,6 +70,23 @@ uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed
 
 uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length );
 
+/* Copy up to data_length bytes out of the ring and consume them, returns the bytes read */
+uint32_t ring_buffer_read( ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length );
+
+/* Consumer zero-copy access: the readable bytes as up to two segments, the
+ * second one starting at the beginning of the buffer. Returns the total,
+ * release them with ring_buffer_consume(). */
+uint32_t ring_buffer_peek( ring_buffer_t* ring_buffer, uint8_t** data1, uint32_t* length1, uint8_t** data2, uint32_t* length2 );
+
+/* Producer zero-copy access: the free space as up to two segments. Returns
+ * the total, publish what was filled in with ring_buffer_write_commit(). */
+uint32_t ring_buffer_write_reserve( ring_buffer_t* ring_buffer, uint8_t** data1, uint32_t* length1, uint8_t** data2, uint32_t* length2 );
+
+uint8_t ring_buffer_write_commit( ring_buffer_t* ring_buffer, uint32_t bytes_written );
+
+/* Most bytes the ring has held since init or the last reset */
+uint32_t ring_buffer_high_water( ring_buffer_t* ring_buffer, bool reset );
+
 #endif // __RingBufferUtils_h__
 
 